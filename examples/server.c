@@ -93,12 +93,18 @@ int main(int argc, char const *argv[]) {
       FIO_CLI_INT("--keep-alive -k (" FIO_MACRO2STR(
           FIO_HTTP_DEFAULT_TIMEOUT) ") HTTP keep-alive timeout in seconds "
                                     "(0..255)"),
+      FIO_CLI_INT("--pipeline -pl pipelined requests handled concurrently "
+                  "(0..255)."),
+      FIO_CLI_INT("--compress -z compress responses longer than this, in "
+                  "bytes (0 == off, requires zlib)."),
       FIO_CLI_BOOL("--log -v log HTTP messages."),
 
       FIO_CLI_PRINT_HEADER("WebSocket / SSE"),
       FIO_CLI_INT(
           "--ws-max-msg -maxms incoming WebSocket message limit, in Kb."),
       FIO_CLI_INT("--timeout -ping WebSocket / SSE timeout, in seconds."),
+      FIO_CLI_INT("--ws-compress -wsz compress WebSocket messages longer than "
+                  "this, in bytes (0 == off, requires zlib)."),
 
       FIO_CLI_PRINT_HEADER("TLS / SSL"),
       FIO_CLI_PRINT_LINE(
@@ -171,13 +177,18 @@ int main(int argc, char const *argv[]) {
                               ? FIO_STR_INFO1((char *)fio_cli_get("-www"))
                               : FIO_STR_INFO2(NULL, 0),
                       .max_age = 0,
+                      .static_headers =
+                          FIO_STR_INFO1((char *)"server:facil.io\r\n"),
                       .max_header_size = (fio_cli_get_i("-maxhd") * 1024),
                       .max_line_len = (fio_cli_get_i("-maxhd") * 1024),
                       .max_body_size = (fio_cli_get_i("-maxbd") * 1024 * 1024),
                       .ws_max_msg_size = (fio_cli_get_i("-maxms") * 1024),
+                      .ws_compress_min = (size_t)fio_cli_get_i("-wsz"),
                       .ws_timeout = fio_cli_get_i("-ping"),
                       .sse_timeout = fio_cli_get_i("-ping"),
                       .timeout = fio_cli_get_i("-k"),
+                      .pipeline = (uint8_t)fio_cli_get_i("-pl"),
+                      .compress_min = (size_t)fio_cli_get_i("-z"),
                       .queue = &http_queue,
                       .tls = tls,
                       .log = fio_cli_get_bool("-v")),
@@ -220,9 +231,6 @@ HTTP/1.1 response callback
 ***************************************************************************** */
 
 static void http_respond(fio_http_s *h) {
-  fio_http_response_header_set(h,
-                               FIO_STR_INFO1("server"),
-                               FIO_STR_INFO1("facil.io"));
   if (0) { /* setting cookie / header data example */
     FIO_STR_INFO_TMP_VAR(tmp, 64);
     fio_string_write_hex(&tmp, NULL, fio_rand64());
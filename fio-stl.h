@@ -241,12 +241,24 @@ Address Sanitizer Detection
 /* *****************************************************************************
 Intrinsic Availability Flags
 ***************************************************************************** */
-#if defined(__ARM_FEATURE_CRYPTO) &&                                           \
-    (defined(__ARM_NEON) || defined(__ARM_NEON__))
-#include <arm_acle.h>
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
 #include <arm_neon.h>
+#define FIO___HAS_ARM_NEON 1
+#if defined(__ARM_FEATURE_CRYPTO)
+#include <arm_acle.h>
 #define FIO___HAS_ARM_INTRIN 1
 #endif
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define FIO___HAS_X86_AVX2 1
+#define FIO___HAS_X86_SSE2 1
+#elif defined(__SSE2__) || defined(_M_X64) ||                                  \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FIO___HAS_X86_SSE2 1
+#endif
 
 /* *****************************************************************************
 Aligned Memory Access Selectors
@@ -1596,14 +1608,65 @@ Byte masking (XOR)
 *****************************************************************************
 */
 
+#if FIO___HAS_X86_AVX2 || FIO___HAS_X86_SSE2 || FIO___HAS_ARM_NEON
+/* Masks 64 byte blocks using vector registers, returns the bytes masked. */
+FIO_IFUNC size_t fio___xmask_vec(char *dest,
+                                 const char *src,
+                                 size_t len,
+                                 uint64_t mask) {
+  size_t i = 0;
+#if FIO___HAS_X86_AVX2
+  const __m256i m = _mm256_set1_epi64x((long long)mask);
+  for (; i + 63 < len; i += 64) {
+    __m256i a = _mm256_loadu_si256((const __m256i *)(src + i));
+    __m256i b = _mm256_loadu_si256((const __m256i *)(src + i + 32));
+    _mm256_storeu_si256((__m256i *)(dest + i), _mm256_xor_si256(a, m));
+    _mm256_storeu_si256((__m256i *)(dest + i + 32), _mm256_xor_si256(b, m));
+  }
+#elif FIO___HAS_X86_SSE2
+  const __m128i m = _mm_set1_epi64x((long long)mask);
+  for (; i + 63 < len; i += 64) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+    __m128i b = _mm_loadu_si128((const __m128i *)(src + i + 16));
+    __m128i c = _mm_loadu_si128((const __m128i *)(src + i + 32));
+    __m128i d = _mm_loadu_si128((const __m128i *)(src + i + 48));
+    _mm_storeu_si128((__m128i *)(dest + i), _mm_xor_si128(a, m));
+    _mm_storeu_si128((__m128i *)(dest + i + 16), _mm_xor_si128(b, m));
+    _mm_storeu_si128((__m128i *)(dest + i + 32), _mm_xor_si128(c, m));
+    _mm_storeu_si128((__m128i *)(dest + i + 48), _mm_xor_si128(d, m));
+  }
+#else /* FIO___HAS_ARM_NEON */
+  const uint8x16_t m = vreinterpretq_u8_u64(vdupq_n_u64(mask));
+  for (; i + 63 < len; i += 64) {
+    /* vld1q_u8_x4 / vst1q_u8_x4 are missing on some (32 bit) toolchains */
+    uint8x16_t a = vld1q_u8((const uint8_t *)(src + i));
+    uint8x16_t b = vld1q_u8((const uint8_t *)(src + i + 16));
+    uint8x16_t c = vld1q_u8((const uint8_t *)(src + i + 32));
+    uint8x16_t d = vld1q_u8((const uint8_t *)(src + i + 48));
+    vst1q_u8((uint8_t *)(dest + i), veorq_u8(a, m));
+    vst1q_u8((uint8_t *)(dest + i + 16), veorq_u8(b, m));
+    vst1q_u8((uint8_t *)(dest + i + 32), veorq_u8(c, m));
+    vst1q_u8((uint8_t *)(dest + i + 48), veorq_u8(d, m));
+  }
+#endif
+  return i;
+}
+#else
+#define fio___xmask_vec(dest, src, len, mask) ((size_t)0)
+#endif
+
 /**
  * Masks data using a persistent 64 bit mask.
  *
- * When the buffer's memory is aligned, the function may perform significantly
- * better.
+ * Uses SIMD instructions (AVX2 / SSE2 / NEON) when available at compile time.
  */
 FIO_IFUNC void fio_xmask(char *buf_, size_t len, uint64_t mask) {
   register char *buf = (char *)buf_;
+  {
+    const size_t done = fio___xmask_vec(buf, buf, len, mask);
+    buf += done;
+    len -= done;
+  }
   for (size_t i = 31; i < len; i += 32) {
     for (size_t g = 0; g < 4; ++g) {
       fio_u2buf64u(buf, (fio_buf2u64u(buf) ^ mask));
@@ -1628,10 +1691,9 @@ FIO_IFUNC void fio_xmask(char *buf_, size_t len, uint64_t mask) {
 }
 
 /**
- * Masks data using a persistent 64 bit mask.
+ * Copies and masks data using a persistent 64 bit mask.
  *
- * When the buffer's memory is aligned, the function may perform significantly
- * better.
+ * Uses SIMD instructions (AVX2 / SSE2 / NEON) when available at compile time.
  */
 FIO_IFUNC void fio_xmask_cpy(char *restrict dest,
                              const char *src,
@@ -1641,6 +1703,12 @@ FIO_IFUNC void fio_xmask_cpy(char *restrict dest,
     fio_xmask(dest, len, mask);
     return;
   }
+  {
+    const size_t done = fio___xmask_vec(dest, src, len, mask);
+    dest += done;
+    src += done;
+    len -= done;
+  }
   for (size_t i = 31; i < len; i += 32) {
     for (size_t g = 0; g < 4; ++g) {
       fio_u2buf64u(dest, (fio_buf2u64u(src) ^ mask));
@@ -2254,8 +2322,9 @@ FIO_MAP Ordering & Naming Shortcut
 #define FIO_STATE
 #endif
 
-#if defined(FIO_HTTP_HANDLE) || defined(FIO_STR_NAME) ||                       \
-    defined(FIO_STR_SMALL) || defined(FIO_ARRAY_TYPE_STR) ||                   \
+#if defined(FIO_HTTP_HANDLE) || defined(FIO_SERVER) ||                         \
+    defined(FIO_STR_NAME) || defined(FIO_STR_SMALL) ||                         \
+    defined(FIO_ARRAY_TYPE_STR) ||                                             \
     defined(FIO_MAP_KEY_KSTR) || defined(FIO_MAP_KEY_BSTR) ||                  \
     (defined(FIO_MAP_NAME) && !defined(FIO_MAP_KEY)) || defined(FIO_MUSTACHE)
 #undef FIO_STR
@@ -2356,7 +2425,7 @@ FIO_MAP Ordering & Naming Shortcut
 #define FIO_SIGNAL
 #endif
 
-#if defined(FIO_MEMORY_NAME) || defined(FIO_QUEUE)
+#if defined(FIO_MEMORY_NAME) || defined(FIO_QUEUE) || defined(FIO_HTTP_HANDLE)
 #undef FIO_THREADS
 #define FIO_THREADS
 #endif
@@ -9579,6 +9648,7 @@ FIO_IFUNC int fio_sock_dup(int original) {
 }
 
 #elif FIO_HAVE_UNIX_TOOLS
+#include <arpa/inet.h>
 #include <fcntl.h>
 #include <netdb.h>
 #include <poll.h>
@@ -9677,6 +9747,13 @@ SFUNC size_t fio_sock_maximize_limits(size_t maximum_limit);
  */
 SFUNC short fio_sock_wait_io(int fd, short events, int timeout);
 
+/**
+ * Writes the socket's peer (remote) IP address to `dest` (NUL terminated).
+ *
+ * Returns the length of the address or 0 on error (i.e., Unix sockets).
+ */
+SFUNC size_t fio_sock_peer_addr(char *dest, size_t capa, int fd);
+
 /** A helper macro that waits on a single IO with no callbacks (0 = no event) */
 #define FIO_SOCK_WAIT_RW(fd, timeout_)                                         \
   fio_sock_wait_io(fd, POLLIN | POLLOUT, timeout_)
@@ -10023,6 +10100,26 @@ SFUNC short fio_sock_wait_io(int fd, short events, int timeout) {
   return r;
 }
 
+/** Writes the socket's peer (remote) IP address to `dest`. */
+SFUNC size_t fio_sock_peer_addr(char *dest, size_t capa, int fd) {
+  struct sockaddr_storage addr;
+  socklen_t len = sizeof(addr);
+  const void *ip;
+  if (!dest || !capa)
+    return 0;
+  dest[0] = 0;
+  if (getpeername(fd, (struct sockaddr *)&addr, &len))
+    return 0;
+  switch (addr.ss_family) {
+  case AF_INET: ip = &((struct sockaddr_in *)&addr)->sin_addr; break;
+  case AF_INET6: ip = &((struct sockaddr_in6 *)&addr)->sin6_addr; break;
+  default: return 0;
+  }
+  if (!inet_ntop(addr.ss_family, ip, dest, capa))
+    return (dest[0] = 0);
+  return strlen(dest);
+}
+
 /** Attempts to maximize the allowed open file limits. returns known limit */
 SFUNC size_t fio_sock_maximize_limits(size_t max_limit) {
   ssize_t capa = 0;
@@ -10302,9 +10399,9 @@ typedef struct {
 } fio___state_task_s;
 
 FIO_IFUNC uint64_t fio___state_callback_hash_fn(fio___state_task_s *t) {
+  /* note: `hash ^ (hash + x)` only keeps the carry bits, colliding often */
   uint64_t hash = fio_risky_ptr((void *)(uintptr_t)(t->func));
-  hash ^= hash + fio_risky_ptr(t->arg);
-  return hash;
+  return fio_risky_num((uint64_t)(uintptr_t)t->arg, hash);
 }
 
 #define FIO_STATE_CALLBACK_IS_VALID(pobj) ((pobj)->func)
@@ -16318,6 +16415,17 @@ SFUNC fio_stream_packet_s *fio_stream_pack_fd(int fd,
                                               size_t offset,
                                               uint8_t keep_open);
 
+/**
+ * Packs a shared file descriptor into a fio_stream_packet_s container.
+ *
+ * The file is never closed by the stream. Instead, `release` is called with
+ * the file descriptor (cast to a pointer) once the packet was consumed.
+ */
+SFUNC fio_stream_packet_s *fio_stream_pack_fd2(int fd,
+                                               size_t len,
+                                               size_t offset,
+                                               void (*release)(void *));
+
 /** Adds a packet to the stream. This isn't thread safe.*/
 SFUNC void fio_stream_add(fio_stream_s *stream, fio_stream_packet_s *packet);
 
@@ -16468,6 +16576,7 @@ typedef struct {
   fio_stream_packet_type_e type;
   size_t length;
   size_t offset;
+  void (*release)(void *fd);
   int fd;
 } fio_stream_packet_fd_s;
 
@@ -16493,8 +16602,11 @@ FIO_SFUNC void fio_stream_packet_free(fio_stream_packet_s *p) {
 #ifdef DEBUG
     FIO_LOG_DEBUG2("fio_stream_packet_free closed file fd %d", u.f->fd);
 #endif
-    /* fall through */
+    FIO_MEM_FREE_(p, sizeof(*p) + sizeof(*u.f));
+    break;
   case FIO_PACKET_TYPE_FILE_NO_CLOSE:
+    if (u.f->release)
+      u.f->release((void *)(intptr_t)u.f->fd);
     FIO_MEM_FREE_(p, sizeof(*p) + sizeof(*u.f));
     break;
   }
@@ -16630,6 +16742,19 @@ no_file:
   return p;
 }
 
+/** Packs a shared file descriptor into a fio_stream_packet_s container. */
+SFUNC fio_stream_packet_s *fio_stream_pack_fd2(int fd,
+                                               size_t len,
+                                               size_t offset,
+                                               void (*release)(void *)) {
+  fio_stream_packet_s *p = fio_stream_pack_fd(fd, len, offset, 1);
+  if (p)
+    ((fio_stream_packet_fd_s *)(p + 1))->release = release;
+  else if (fd >= 0 && release)
+    release((void *)(intptr_t)fd);
+  return p;
+}
+
 /** Adds a packet to the stream. This isn't thread safe.*/
 SFUNC void fio_stream_add(fio_stream_s *s, fio_stream_packet_s *p) {
   fio_stream_packet_s *last = p;
@@ -28127,6 +28252,19 @@ developer.
 #define FIO_SRV_TIMEOUT_MAX 300000
 #endif
 
+#ifndef FIO_SRV_FILE_CACHE_LIMIT
+/**
+ * The maximum number of files cached by `fio_srv_file_open` (0 disables the
+ * cache). Files in use remain open until released.
+ */
+#define FIO_SRV_FILE_CACHE_LIMIT 256
+#endif
+
+#ifndef FIO_SRV_FILE_CACHE_TTL
+/** Milliseconds before a file cached by `fio_srv_file_open` is re-validated. */
+#define FIO_SRV_FILE_CACHE_TTL 2000
+#endif
+
 #ifndef FIO_SRV_SHUTDOWN_TIMEOUT
 /* Sets the hard timeout (in milliseconds) for the server's shutdown loop. */
 #define FIO_SRV_SHUTDOWN_TIMEOUT 10000
@@ -28369,6 +28507,9 @@ typedef struct {
    * If this is a buffer, the de-allocation function used to free it.
    *
    * If NULL, the buffer will NOT be de-allocated.
+   *
+   * If this is a file, the file will NOT be closed when `dealloc` is set.
+   * Instead, `dealloc` is called with the file descriptor (cast to a pointer).
    */
   void (*dealloc)(void *);
   /** If non-zero, makes a copy of the buffer or keeps a file open. */
@@ -28405,6 +28546,42 @@ SFUNC void fio_write2(fio_s *io, fio_write_args_s args);
              .offset = (size_t)(offset_),                                      \
              .len = (bytes))
 
+/**
+ * Opens `filename` for reading, using a shared (cached) file descriptor.
+ *
+ * On success, returns the file descriptor and fills `st` (if not NULL) with the
+ * file's information. Returns -1 on error.
+ *
+ * Cached file descriptors (and their `stat` data) are re-validated every
+ * `FIO_SRV_FILE_CACHE_TTL` milliseconds, so concurrent requests for the same
+ * file share a single file descriptor.
+ *
+ * The file descriptor MUST NOT be closed (nor its file position changed).
+ * Release it using `fio_srv_file_close` or send it using `fio_srv_sendfile`.
+ */
+SFUNC int fio_srv_file_open(const char *filename, struct stat *st);
+
+/** Releases a file descriptor opened using `fio_srv_file_open`. */
+SFUNC void fio_srv_file_close(int fd);
+
+/**
+ * Releases a file descriptor opened using `fio_srv_file_open`, where the file
+ * descriptor is cast to a pointer (a `dealloc` compatible callback).
+ */
+SFUNC void fio_srv_file_release(void *fd);
+
+/**
+ * Sends data from a file opened using `fio_srv_file_open`, see `fio_sendfile`.
+ *
+ * Once the file was sent, `source_fd` is released using `fio_srv_file_close`.
+ */
+#define fio_srv_sendfile(io, source_fd, offset_, bytes)                        \
+  fio_write2((io),                                                             \
+             .fd = (source_fd),                                                \
+             .offset = (size_t)(offset_),                                      \
+             .len = (bytes),                                                   \
+             .dealloc = fio_srv_file_release)
+
 /** Marks the IO for closure as soon as scheduled data was sent. */
 SFUNC void fio_close(fio_s *io);
 
@@ -28732,6 +28909,19 @@ SFUNC int fio_tls_alpn_select(fio_tls_s *tls,
  */
 SFUNC fio_tls_s *fio_tls_trust_add(fio_tls_s *, const char *public_cert_file);
 
+/**
+ * Sets the server name sent (SNI) by client connections using the context.
+ *
+ * A `NULL` or empty `server_name` removes the server name.
+ *
+ *      fio_tls_server_name_set(tls, "www.example.com");
+ */
+SFUNC fio_tls_s *fio_tls_server_name_set(fio_tls_s *,
+                                         const char *server_name);
+
+/** Returns the server name (SNI) set for client connections, or `NULL`. */
+SFUNC const char *fio_tls_server_name(fio_tls_s *);
+
 /**
  * Returns the number of `fio_tls_cert_add` instructions.
  *
@@ -29574,6 +29764,9 @@ finish:
 static void fio___srv_poll_on_close(void *io_, void *ignr_) {
   (void)ignr_;
   fio_s *io = (fio_s *)io_;
+  /* read any data sent before the peer hung up (i.e., a final response) */
+  if (io->state == FIO_STATE_OPEN)
+    io->pr->on_data(io);
   fio_close_now(io);
   fio_free2(io);
 }
@@ -29986,7 +30179,14 @@ SFUNC void fio_write2 FIO_NOOP(fio_s *io, fio_write_args_s args) {
                                   args.copy,
                                   args.dealloc);
   } else if (args.fd != -1) {
-    packet = fio_stream_pack_fd(args.fd, args.len, args.offset, args.copy);
+    packet = (args.dealloc ? fio_stream_pack_fd2((int)args.fd,
+                                                 args.len,
+                                                 args.offset,
+                                                 args.dealloc)
+                           : fio_stream_pack_fd((int)args.fd,
+                                                args.len,
+                                                args.offset,
+                                                args.copy));
   }
   if (!packet)
     goto error;
@@ -30007,8 +30207,15 @@ write_called_after_close:
 io_error_null:
   FIO_LOG_ERROR("(%d) `fio_write2` called for invalid IO (NULL)",
                 fio___srvdata.pid);
-  if (args.dealloc)
-    args.dealloc(args.buf);
+  if (args.buf) {
+    if (args.dealloc)
+      args.dealloc(args.buf);
+  } else if (args.fd != -1) {
+    if (args.dealloc)
+      args.dealloc((void *)args.fd);
+    else if (!args.copy)
+      close((int)args.fd);
+  }
 }
 
 /** Marks the IO for closure as soon as scheduled data was sent. */
@@ -30050,6 +30257,192 @@ SFUNC int fio_srv_is_open(fio_s *io) {
   return (io->state & FIO_STATE_OPEN) && !(io->state & FIO_STATE_CLOSING);
 }
 
+/* *****************************************************************************
+Shared File Descriptors (file cache)
+***************************************************************************** */
+#if FIO_SRV_FILE_CACHE_LIMIT
+
+/** A shared, reference counted, read-only file descriptor. */
+typedef struct {
+  int64_t expires;
+  struct stat st;
+  /* number of users (+1 while cached) */
+  size_t refs;
+  int fd;
+} fio___srv_file_s;
+
+FIO___LEAK_COUNTER_DEF(fio___srv_file_s)
+
+FIO_SFUNC void fio___srv_file_unref(fio___srv_file_s *f);
+
+/* open (shared) files, by file descriptor */
+#define FIO_MAP_NAME            fio___srv_file_fds
+#define FIO_MAP_KEY             int
+#define FIO_MAP_VALUE           fio___srv_file_s *
+#define FIO_MAP_HASH_FN(fd)     fio_risky_num((uint64_t)(fd), 0)
+#define FIO___RECURSIVE_INCLUDE 1
+#include FIO_INCLUDE_FILE
+#undef FIO___RECURSIVE_INCLUDE
+
+/* cached files, by file name */
+#define FIO_MAP_NAME             fio___srv_file_cache
+#define FIO_MAP_VALUE            fio___srv_file_s *
+#define FIO_MAP_VALUE_DESTROY(f) fio___srv_file_unref(f)
+#define FIO_MAP_VALUE_DISCARD(f) fio___srv_file_unref(f)
+#define FIO_MAP_LRU              FIO_SRV_FILE_CACHE_LIMIT
+#define FIO___RECURSIVE_INCLUDE  1
+#include FIO_INCLUDE_FILE
+#undef FIO___RECURSIVE_INCLUDE
+
+static struct {
+  fio___srv_file_cache_s cache;
+  fio___srv_file_fds_s fds;
+  fio_lock_i lock;
+} fio___srv_files = {
+    .cache = FIO_MAP_INIT,
+    .fds = FIO_MAP_INIT,
+    .lock = FIO_LOCK_INIT,
+};
+
+/* Releases a shared file reference - MUST be called while holding the lock. */
+FIO_SFUNC void fio___srv_file_unref(fio___srv_file_s *f) {
+  if (!f || --f->refs)
+    return;
+  fio___srv_file_fds_remove(&fio___srv_files.fds, f->fd, NULL);
+  close(f->fd);
+  FIO_MEM_FREE_(f, sizeof(*f));
+  FIO___LEAK_COUNTER_ON_FREE(fio___srv_file_s);
+}
+
+/* Tests if the `stat` data still refers to the same (unchanged) file. */
+FIO_IFUNC int fio___srv_file_is_eq(struct stat *a, struct stat *b) {
+  return a->st_ino == b->st_ino && a->st_dev == b->st_dev &&
+         a->st_size == b->st_size && a->st_mtime == b->st_mtime;
+}
+
+/** Opens `filename` for reading, using a shared (cached) file descriptor. */
+SFUNC int fio_srv_file_open(const char *filename, struct stat *st) {
+  int fd = -1;
+  fio___srv_file_s *f;
+  struct stat tmp;
+  int64_t now;
+  uint64_t hash;
+  fio_str_info_s name;
+  if (!filename)
+    return fd;
+  now = fio_time_milli();
+  name = FIO_STR_INFO1((char *)filename);
+  hash = fio_risky_hash(name.buf, name.len, 0);
+  if (!st)
+    st = &tmp;
+
+  fio_lock(&fio___srv_files.lock);
+  f = fio___srv_file_cache_get(&fio___srv_files.cache, hash, name);
+  if (f && f->expires > now)
+    goto found_locked;
+  fio_unlock(&fio___srv_files.lock);
+
+  /* re-validate (or open) the file */
+  if (stat(filename, st))
+    goto file_missing;
+  fio_lock(&fio___srv_files.lock);
+  f = fio___srv_file_cache_get(&fio___srv_files.cache, hash, name);
+  if (f && fio___srv_file_is_eq(&f->st, st)) {
+    f->expires = now + FIO_SRV_FILE_CACHE_TTL;
+    goto found_locked;
+  }
+  fio_unlock(&fio___srv_files.lock);
+
+  fd = fio_filename_open(filename, O_RDONLY);
+  if (fd == -1)
+    goto file_missing;
+  if (fstat(fd, st)) {
+    close(fd);
+    goto file_missing;
+  }
+  f = (fio___srv_file_s *)FIO_MEM_REALLOC_(NULL, 0, sizeof(*f), 0);
+  if (!f) /* a private (unshared) file descriptor, closed when released */
+    return fd;
+  FIO___LEAK_COUNTER_ON_ALLOC(fio___srv_file_s);
+  *f = (fio___srv_file_s){
+      .expires = now + FIO_SRV_FILE_CACHE_TTL,
+      .st = *st,
+      .refs = 2,
+      .fd = fd,
+  };
+  fio_lock(&fio___srv_files.lock);
+  fio___srv_file_fds_set(&fio___srv_files.fds, fd, f, NULL);
+  fio___srv_file_cache_set(&fio___srv_files.cache, hash, name, f, NULL);
+  fio_unlock(&fio___srv_files.lock);
+  return fd;
+
+found_locked:
+  ++f->refs;
+  fd = f->fd;
+  *st = f->st;
+  fio_unlock(&fio___srv_files.lock);
+  return fd;
+
+file_missing:
+  fio_lock(&fio___srv_files.lock);
+  fio___srv_file_cache_remove(&fio___srv_files.cache, hash, name, NULL);
+  fio_unlock(&fio___srv_files.lock);
+  return -1;
+}
+
+/** Releases a file descriptor opened using `fio_srv_file_open`. */
+SFUNC void fio_srv_file_close(int fd) {
+  fio___srv_file_s *f;
+  if (fd == -1)
+    return;
+  fio_lock(&fio___srv_files.lock);
+  f = fio___srv_file_fds_get(&fio___srv_files.fds, fd);
+  if (f)
+    fio___srv_file_unref(f);
+  fio_unlock(&fio___srv_files.lock);
+  if (!f) /* a private (unshared) file descriptor */
+    close(fd);
+}
+
+/* Closes all cached files (called after all IO was closed). */
+FIO_SFUNC void fio___srv_files_cleanup(void) {
+  fio_lock(&fio___srv_files.lock);
+  fio___srv_file_cache_destroy(&fio___srv_files.cache);
+  if (!fio___srv_file_fds_count(&fio___srv_files.fds))
+    fio___srv_file_fds_destroy(&fio___srv_files.fds);
+  fio_unlock(&fio___srv_files.lock);
+}
+
+#else /* FIO_SRV_FILE_CACHE_LIMIT */
+
+/** Opens `filename` for reading (file caching was disabled). */
+SFUNC int fio_srv_file_open(const char *filename, struct stat *st) {
+  struct stat tmp;
+  int fd = fio_filename_open(filename, O_RDONLY);
+  if (fd == -1)
+    return fd;
+  if (fstat(fd, (st ? st : &tmp))) {
+    close(fd);
+    fd = -1;
+  }
+  return fd;
+}
+
+/** Releases a file descriptor opened using `fio_srv_file_open`. */
+SFUNC void fio_srv_file_close(int fd) {
+  if (fd != -1)
+    close(fd);
+}
+
+#define fio___srv_files_cleanup()
+
+#endif /* FIO_SRV_FILE_CACHE_LIMIT */
+
+/** Releases a file descriptor opened using `fio_srv_file_open`. */
+SFUNC void fio_srv_file_release(void *fd) {
+  fio_srv_file_close((int)(intptr_t)fd);
+}
+
 /* *****************************************************************************
 Listening
 ***************************************************************************** */
@@ -30509,6 +30902,8 @@ FIO_SFUNC void fio___srv_after_fork(void *ignr_) {
 
 FIO_SFUNC void fio___srv_cleanup_at_exit(void *ignr_) {
   fio___srv_after_fork(ignr_);
+  fio_timer_destroy(fio___srv_timer); /* calls `on_finish` for pending timers */
+  fio___srv_files_cleanup();
   fio_poll_destroy(&fio___srvdata.poll_data);
   fio___srv_env_safe_destroy(&fio___srvdata.env);
 }
@@ -30596,6 +30991,7 @@ struct fio_tls_s {
   fio___tls_cert_map_s cert;
   fio___tls_alpn_map_s alpn;
   fio___tls_trust_map_s trust;
+  fio_keystr_s server_name; /** The server name (SNI) sent by clients */
   uint8_t trust_sys; /** Set to 1 if system certificate registry is trusted */
 };
 
@@ -30617,6 +31013,7 @@ struct fio_tls_s {
                          FIO_STRING_FREE_KEY);                                 \
       fio_keystr_destroy(&tls.cert.ary[i].pk_password, FIO_STRING_FREE_KEY);   \
     }                                                                          \
+    fio_keystr_destroy(&tls.server_name, FIO_STRING_FREE_KEY);                 \
     fio___tls_alpn_map_destroy(&tls.alpn);                                     \
     fio___tls_trust_map_destroy(&tls.trust);                                   \
     fio___tls_cert_map_destroy(&tls.cert);                                     \
@@ -30766,6 +31163,26 @@ replace_old:
   return t;
 }
 
+/** Sets the server name sent (SNI) by client connections using the context. */
+SFUNC fio_tls_s *fio_tls_server_name_set(fio_tls_s *t,
+                                         const char *server_name) {
+  if (!t)
+    return t;
+  fio_keystr_destroy(&t->server_name, FIO_STRING_FREE_KEY);
+  t->server_name = fio_keystr_copy(FIO_STR_INFO1((char *)server_name),
+                                   FIO_STRING_ALLOC_KEY);
+  return t;
+}
+
+/** Returns the server name (SNI) set for client connections, or `NULL`. */
+SFUNC const char *fio_tls_server_name(fio_tls_s *t) {
+  fio_buf_info_s nm;
+  if (!t)
+    return NULL;
+  nm = fio_keystr_buf(&t->server_name);
+  return nm.len ? nm.buf : NULL;
+}
+
 /**
  * Returns the number of `fio_tls_cert_add` instructions.
  *
@@ -31346,10 +31763,14 @@ FIO_SFUNC void fio___openssl_start(fio_s *io) {
   BIO *bio = BIO_new_socket(fio_fd_get(io), 0);
   SSL_set_bio(ssl, bio, bio);
   SSL_set_ex_data(ssl, 0, (void *)io);
-  if (SSL_is_server(ssl))
+  if (SSL_is_server(ssl)) {
     SSL_accept(ssl);
-  else
+  } else {
+    const char *server_name = fio_tls_server_name(ctx_parent->tls);
+    if (server_name)
+      SSL_set_tlsext_host_name(ssl, server_name);
     SSL_connect(ssl);
+  }
 }
 
 /* *****************************************************************************
@@ -31626,6 +32047,14 @@ SFUNC void fio_publish(fio_publish_args_s args);
 /** for backwards compatibility */
 #define pubsub_publish fio_publish
 
+#ifndef FIO_PUBSUB_DELIVERY_BUDGET
+/**
+ * The number of subscribers a message is delivered to before the delivery task
+ * yields (is re-queued), allowing other tasks to be performed.
+ */
+#define FIO_PUBSUB_DELIVERY_BUDGET 256
+#endif
+
 /**
  * Defers the current callback, so it will be called again for the message.
  *
@@ -31733,10 +32162,28 @@ SFUNC int fio_message_metadata_add(fio_msg_metadata_fn metadata_func,
  */
 SFUNC void fio_message_metadata_remove(fio_msg_metadata_fn metadata_func);
 
-/** Finds the message's metadata, returning the data or NULL. */
+/**
+ * Finds the message's metadata, returning the data or NULL.
+ *
+ * Metadata is built for all attached callbacks on the first call (per message).
+ */
 SFUNC void *fio_message_metadata(fio_msg_s *msg,
                                  fio_msg_metadata_fn metadata_func);
 
+/**
+ * Returns data cached on the message by `build`, calling `build` on first use.
+ *
+ * Unlike metadata callbacks, nothing is attached globally and `build` is only
+ * called for messages that request the data. If concurrent threads build the
+ * data at the same time, one result is kept and the others are passed to
+ * `cleanup`.
+ *
+ * The data is passed to `cleanup` when the message is destroyed.
+ */
+SFUNC void *fio_message_cache(fio_msg_s *msg,
+                              fio_msg_metadata_fn build,
+                              void (*cleanup)(void *));
+
 /* *****************************************************************************
  * Pub/Sub Middleware and Extensions ("Engines")
  **************************************************************************** */
@@ -31878,6 +32325,7 @@ typedef struct fio_letter_s {
   void *from;
   uint8_t metadata_is_initialized; /* to compact this we need to change all? */
   void *metadata[FIO_PUBSUB_METADATA_LIMIT];
+  struct fio___letter_cache_s *cache; /* see `fio_message_cache` */
   char buf[];
 } fio_letter_s;
 
@@ -31915,6 +32363,7 @@ typedef struct fio_channel_s {
 /** The Subscription: contains subscriber data. */
 typedef struct fio_subscription_s {
   FIO_LIST_NODE node;
+  uint64_t seq; /* channel lists are ordered by subscription order */
   fio_s *io;
   fio_channel_s *channel;
   void (*on_message)(fio_msg_s *msg);
@@ -31966,6 +32415,30 @@ FIO_IFUNC uint64_t fio_channel___hash(char *buf, size_t len, int16_t filter) {
 #include FIO_INCLUDE_FILE
 #undef FIO___RECURSIVE_INCLUDE
 
+/**
+ * The Pattern Index: maps a literal pattern prefix to the pattern channels.
+ *
+ * Glob matches must start with the pattern's literal prefix (the bytes before
+ * the first `*`, `?`, `[` or `\`), so publishing only tests the patterns in
+ * buckets keyed by the prefixes of the channel's name. Patterns starting with
+ * a wildcard share the (empty prefix) bucket tested for every letter.
+ */
+#ifndef FIO___PUBSUB_PATTERN_PREFIX_LIMIT
+#define FIO___PUBSUB_PATTERN_PREFIX_LIMIT 63 /* MUST be less than 64 */
+#endif
+#define FIO_ARRAY_NAME          fio___pattern_bucket
+#define FIO_ARRAY_TYPE          fio_channel_s *
+#define FIO___RECURSIVE_INCLUDE 1
+#include FIO_INCLUDE_FILE
+#undef FIO___RECURSIVE_INCLUDE
+#define FIO_MAP_NAME               fio___pattern_map
+#define FIO_MAP_KEY                uint64_t
+#define FIO_MAP_VALUE              fio___pattern_bucket_s
+#define FIO_MAP_VALUE_DESTROY(bkt) fio___pattern_bucket_destroy(&(bkt))
+#define FIO___RECURSIVE_INCLUDE    1
+#include FIO_INCLUDE_FILE
+#undef FIO___RECURSIVE_INCLUDE
+
 /* *****************************************************************************
 
 
@@ -32031,7 +32504,7 @@ FIO_IFUNC fio_letter_s *fio_letter_new_compose(fio_buf_info_s channel,
                                                fio_buf_info_s message,
                                                int16_t filter,
                                                uint8_t flags);
-/** initializes a letter's metadata. */
+/** initializes a letter's metadata (on the first `fio_message_metadata`). */
 FIO_SFUNC void fio_letter_initialize_metadata(fio_letter_s *l);
 /** Returns a letter's message length (if any) */
 FIO_IFUNC size_t fio_letter_message_len(fio_letter_s *l);
@@ -32154,9 +32627,13 @@ static struct FIO_POSTOFFICE {
 #endif
   fio_channel_map_s channels;
   fio_channel_map_s patterns;
+  fio___pattern_map_s pattern_index;
+  uint64_t pattern_prefixes; /* bitmap of the indexed prefix lengths */
+  uint32_t pattern_prefix_count[FIO___PUBSUB_PATTERN_PREFIX_LIMIT + 1];
   FIO_LIST_NODE engines;
   fio_protocol_s *siblings_protocol;
   fio___postoffice_msmap_s master_subscriptions;
+  uint64_t subscription_seq;
   size_t secret[32 / sizeof(size_t)];
   uint8_t publish_filter;
   uint8_t local_send_filter;
@@ -32168,6 +32645,7 @@ static struct FIO_POSTOFFICE {
 #endif
     .channels = FIO_MAP_INIT,
     .patterns = FIO_MAP_INIT,
+    .pattern_index = FIO_MAP_INIT,
     .publish_filter = (FIO___PUBSUB_PROCESS | FIO___PUBSUB_ROOT),
     .local_send_filter = (FIO___PUBSUB_SIBLINGS),
     .remote_send_filter = FIO___PUBSUB_REMOTE,
@@ -32233,6 +32711,7 @@ SFUNC void fio_message_metadata_remove(fio_msg_metadata_fn metadata_func) {
 /** Finds the message's metadata, returning the data or NULL. */
 SFUNC void *fio_message_metadata(fio_msg_s *msg,
                                  fio_msg_metadata_fn metadata_func) {
+  fio_letter_initialize_metadata(fio_msg2letter(msg)); /* lazy, first call */
   for (size_t i = 0; i < FIO_PUBSUB_METADATA_LIMIT; ++i) { /* test existing */
     if (FIO_PUBSUB_METADATA[i].ref &&
         metadata_func == FIO_PUBSUB_METADATA[i].build) {
@@ -32242,8 +32721,60 @@ SFUNC void *fio_message_metadata(fio_msg_s *msg,
   return NULL;
 }
 
+/** A message cache entry (see `fio_message_cache`). */
+typedef struct fio___letter_cache_s {
+  struct fio___letter_cache_s *next;
+  fio_msg_metadata_fn build;
+  void (*cleanup)(void *);
+  void *data;
+} fio___letter_cache_s;
+
+/** Returns data cached on the message by `build`, building it on first use. */
+SFUNC void *fio_message_cache(fio_msg_s *msg,
+                              fio_msg_metadata_fn build,
+                              void (*cleanup)(void *)) {
+  fio_letter_s *l = fio_msg2letter(msg);
+  fio___letter_cache_s *head, *pos, *end = NULL, *c = NULL;
+  fio_atomic_load(head, &l->cache);
+  for (;;) {
+    for (pos = head; pos != end; pos = pos->next)
+      if (pos->build == build)
+        goto found;
+    if (!c) {
+      c = (fio___letter_cache_s *)FIO_MEM_REALLOC_(NULL, 0, sizeof(*c), 0);
+      FIO_ASSERT_ALLOC(c);
+      *c = (fio___letter_cache_s){
+          .build = build,
+          .cleanup = cleanup,
+          .data = build(
+              fio_letter_channel(l),
+              fio_letter_message(l),
+              fio_letter_filter(l),
+              ((fio_letter_flags(l) & FIO___PUBSUB_JSON) == FIO___PUBSUB_JSON)),
+      };
+    }
+    c->next = end = head; /* on failure, only test the newer entries */
+    if (fio_atomic_compare_exchange_p(&l->cache, &c->next, &c))
+      return c->data;
+    fio_atomic_load(head, &l->cache);
+  }
+found:
+  if (c) { /* a concurrent call cached the data first */
+    if (c->cleanup)
+      c->cleanup(c->data);
+    FIO_MEM_FREE_(c, sizeof(*c));
+  }
+  return pos->data;
+}
+
 /** Callback called when a letter is destroyed (reference counting). */
 FIO_SFUNC void fio_letter_on_destroy(fio_letter_s *l) {
+  for (fio___letter_cache_s *c = l->cache, *next; c; c = next) {
+    next = c->next;
+    if (c->cleanup)
+      c->cleanup(c->data);
+    FIO_MEM_FREE_(c, sizeof(*c));
+  }
   if (!l->metadata_is_initialized)
     return;
   for (size_t i = 0; i < FIO_PUBSUB_METADATA_LIMIT; ++i) {
@@ -32255,10 +32786,19 @@ FIO_SFUNC void fio_letter_on_destroy(fio_letter_s *l) {
   }
 }
 
-/** Callback called when a letter is destroyed (reference counting). */
+/** Builds the letter's metadata, once (concurrent callers wait for it). */
 FIO_SFUNC void fio_letter_initialize_metadata(fio_letter_s *l) {
-  if (fio_atomic_or(&l->metadata_is_initialized, 1)) {
+  uint8_t state;
+  fio_atomic_load(state, &l->metadata_is_initialized);
+  if ((state & 2))
     return;
+  if (fio_atomic_or(&l->metadata_is_initialized, 1)) {
+    for (;;) { /* another thread is building the metadata */
+      fio_atomic_load(state, &l->metadata_is_initialized);
+      if ((state & 2))
+        return;
+      FIO_THREAD_RESCHEDULE();
+    }
   }
   for (size_t i = 0; i < FIO_PUBSUB_METADATA_LIMIT; ++i) {
     if (fio_atomic_add(&FIO_PUBSUB_METADATA[i].ref, 1)) {
@@ -32271,6 +32811,7 @@ FIO_SFUNC void fio_letter_initialize_metadata(fio_letter_s *l) {
     }
     fio_atomic_sub(&FIO_PUBSUB_METADATA[i].ref, 1);
   }
+  fio_atomic_or(&l->metadata_is_initialized, 2);
 }
 
 /* *****************************************************************************
@@ -32713,10 +33254,71 @@ FIO_IFUNC fio_channel_s *fio_channel_new_named(fio_buf_info_s name,
   return ch;
 }
 
+/** Returns the length of the pattern's literal prefix (up to the limit). */
+FIO_IFUNC size_t fio___pattern_prefix_len(fio_channel_s *ch) {
+  size_t i = 0;
+  for (; i < ch->name_len && i < FIO___PUBSUB_PATTERN_PREFIX_LIMIT; ++i) {
+    switch (ch->name[i]) {
+    case '*': /* fall through */
+    case '?': /* fall through */
+    case '[': /* fall through */
+    case '\\': return i;
+    }
+  }
+  return i;
+}
+
+/** Adds a new pattern channel to the pattern index. */
+FIO_IFUNC void fio___pattern_index_add(fio_channel_s *ch) {
+  const size_t len = fio___pattern_prefix_len(ch);
+  const uint64_t hash = fio_channel___hash(ch->name, len, ch->filter);
+  fio___pattern_map_node_s *n =
+      fio___pattern_map_set_ptr(&FIO_POSTOFFICE.pattern_index,
+                                  hash,
+                                  hash,
+                                  (fio___pattern_bucket_s)FIO_ARRAY_INIT,
+                                  NULL,
+                                  0);
+  FIO_ASSERT_ALLOC(n);
+  fio___pattern_bucket_push(fio___pattern_map_node2val_ptr(n), ch);
+  if (!FIO_POSTOFFICE.pattern_prefix_count[len]++)
+    FIO_POSTOFFICE.pattern_prefixes |= ((uint64_t)1 << len);
+}
+
+/** Removes a pattern channel (with no more subscribers) from the index. */
+FIO_IFUNC void fio___pattern_index_remove(fio_channel_s *ch) {
+  const size_t len = fio___pattern_prefix_len(ch);
+  const uint64_t hash = fio_channel___hash(ch->name, len, ch->filter);
+  fio___pattern_map_node_s *n =
+      fio___pattern_map_get_ptr(&FIO_POSTOFFICE.pattern_index, hash, hash);
+  fio___pattern_bucket_s *bkt;
+  if (!n)
+    return;
+  bkt = fio___pattern_map_node2val_ptr(n);
+  if (!fio___pattern_bucket_remove2(bkt, ch))
+    return;
+  if (!fio___pattern_bucket_count(bkt))
+    fio___pattern_map_remove(&FIO_POSTOFFICE.pattern_index, hash, hash, NULL);
+  if (!--FIO_POSTOFFICE.pattern_prefix_count[len])
+    FIO_POSTOFFICE.pattern_prefixes &= ~((uint64_t)1 << len);
+}
+
+/** Schedules a letter's delivery to a (matching) pattern channel. */
+FIO_IFUNC void fio___channel_deliver_pattern(fio_channel_s *ch,
+                                             fio_letter_s *l,
+                                             fio_str_info_s ch_name,
+                                             int16_t filter) {
+  if (ch->filter == filter &&
+      FIO_PUBSUB_PATTERN_MATCH(FIO_STR_INFO2(ch->name, ch->name_len), ch_name))
+    fio_queue_push(fio_srv_queue(),
+                   fio___channel_deliver_task,
+                   fio_channel_dup(ch),
+                   fio_letter_dup(l));
+}
+
 /** To be used in the fio_letter_on_composed
  * callback to distribute letters. */
 FIO_IFUNC void fio___channel_deliver(fio_letter_s *l) {
-  fio_letter_initialize_metadata(l); /* lazy metadata initialization */
   const fio_str_info_s ch_name = fio_letter_channel(l);
   const int16_t filter = fio_letter_filter(l);
   fio_channel_s cpy = {
@@ -32744,14 +33346,31 @@ FIO_IFUNC void fio___channel_deliver(fio_letter_s *l) {
                    fio___channel_deliver_task,
                    fio_channel_dup(ch),
                    fio_letter_dup(l));
-  FIO_MAP_EACH(fio_channel_map, &FIO_POSTOFFICE.patterns, i) {
-    if (i.key && i.key->filter == filter &&
-        FIO_PUBSUB_PATTERN_MATCH(FIO_STR_INFO2(i.key->name, i.key->name_len),
-                                 ch_name))
-      fio_queue_push(fio_srv_queue(),
-                     fio___channel_deliver_task,
-                     fio_channel_dup(i.key),
-                     fio_letter_dup(l));
+  if (FIO_PUBSUB_PATTERN_MATCH == fio_glob_match) {
+    /* test only patterns with a literal prefix matching the channel's name */
+    for (uint64_t lens = FIO_POSTOFFICE.pattern_prefixes; lens;
+         lens &= lens - 1) {
+      const size_t len = fio_lsb_index_unsafe(lens);
+      fio___pattern_map_node_s *n;
+      if (len > ch_name.len)
+        break;
+      n = fio___pattern_map_get_ptr(
+          &FIO_POSTOFFICE.pattern_index,
+          fio_channel___hash(ch_name.buf, len, filter),
+          fio_channel___hash(ch_name.buf, len, filter));
+      if (!n)
+        continue;
+      FIO_ARRAY_EACH(fio___pattern_bucket,
+                     fio___pattern_map_node2val_ptr(n),
+                     pos) {
+        fio___channel_deliver_pattern(*pos, l, ch_name, filter);
+      }
+    }
+  } else { /* a custom matching function, the literal prefix might not apply */
+    FIO_MAP_EACH(fio_channel_map, &FIO_POSTOFFICE.patterns, i) {
+      if (i.key)
+        fio___channel_deliver_pattern(i.key, l, ch_name, filter);
+    }
   }
 #if FIO_POSTOFFICE_THREAD_LOCK
   FIO___LOCK_UNLOCK(FIO_POSTOFFICE.lock);
@@ -32809,6 +33428,9 @@ FIO_SFUNC void fio___subscribe_task(void *ch_, void *sub_) {
   if (!ch)
     goto unknown_error;
   sub->channel = fio_channel_dup(ch);
+  sub->seq = ++FIO_POSTOFFICE.subscription_seq;
+  if (ch->is_pattern && FIO_LIST_IS_EMPTY(&ch->subscriptions))
+    fio___pattern_index_add(ch); /* a new pattern channel */
   FIO_LIST_PUSH(&ch->subscriptions, &sub->node);
 
 #if FIO_POSTOFFICE_THREAD_LOCK
@@ -32838,16 +33460,21 @@ FIO_IFUNC void fio___unsubscribe_task(void *ch_, void *sub_) {
   FIO___LOCK_LOCK(FIO_POSTOFFICE.lock);
 #endif
 
-  FIO_LIST_REMOVE(&sub->node);
+  FIO_LIST_REMOVE_RESET(&sub->node); /* marks as removed for deliveries */
   if (FIO_LIST_IS_EMPTY(&ch->subscriptions)) {
     map = &FIO_POSTOFFICE.channels + ch->is_pattern;
+    if (ch->is_pattern)
+      fio___pattern_index_remove(ch);
     fio_channel_map_remove(
         map,
         fio_channel___hash(ch->name, ch->name_len, ch->filter),
         ch,
         NULL);
-    if (!fio_channel_map_count(map))
+    if (!fio_channel_map_count(map)) {
       fio_channel_map_destroy(map);
+      if (ch->is_pattern)
+        fio___pattern_map_destroy(&FIO_POSTOFFICE.pattern_index);
+    }
   }
 
 #if FIO_POSTOFFICE_THREAD_LOCK
@@ -32881,9 +33508,9 @@ FIO_IFUNC void fio___subscription_unsubscribe(fio_subscription_s *s) {
                  (void *)s);
 }
 
-FIO_IFUNC void fio___subscription_on_message_task(void *s_, void *l_) {
-  fio_subscription_s *s = (fio_subscription_s *)s_;
-  fio_letter_s *l = (fio_letter_s *)l_;
+/** Calls the subscription's callback, returns non-zero if deferred. */
+FIO_IFUNC uintptr_t fio___subscription_deliver(fio_subscription_s *s,
+                                               fio_letter_s *l) {
   struct {
     fio_msg_s msg;
     fio_letter_s *l;
@@ -32902,7 +33529,13 @@ FIO_IFUNC void fio___subscription_on_message_task(void *s_, void *l_) {
   };
   s->on_message(&m.msg);
   s->udata = m.msg.udata;
-  if (m.flag)
+  return m.flag;
+}
+
+FIO_IFUNC void fio___subscription_on_message_task(void *s_, void *l_) {
+  fio_subscription_s *s = (fio_subscription_s *)s_;
+  fio_letter_s *l = (fio_letter_s *)l_;
+  if (fio___subscription_deliver(s, l))
     goto reschedule;
   fio_subscription_free(s);
   fio_letter_free(l);
@@ -32923,33 +33556,69 @@ SFUNC void fio_message_defer(fio_msg_s *msg) {
   ((uintptr_t *)(msg + 1))[1] = 1;
 }
 
-/* delivers a letter to all of a channel's
- * subscribers */
-FIO_SFUNC void fio___channel_deliver_task(void *ch_, void *l_) {
-  fio_channel_s *ch = (fio_channel_s *)ch_;
-  fio_letter_s *l = (fio_letter_s *)l_;
-  if (l->from) {
-    FIO_LIST_EACH(fio_subscription_s, node, &ch->subscriptions, s) {
-      if (l->from != s->io)
-        fio_queue_push(
-            fio_srv_queue(),
-            (void (*)(void *, void *))fio___subscription_on_message_task,
-            fio_subscription_dup(s),
-            fio_letter_dup(l));
+/**
+ * Delivers a letter to a channel's subscribers, starting at `pos`.
+ *
+ * Consumes the letter and channel references once done, or passes them on to
+ * the continuation task when the delivery budget is exhausted.
+ */
+FIO_SFUNC void fio___channel_deliver_from(fio_channel_s *ch,
+                                          fio_letter_s *l,
+                                          FIO_LIST_NODE *pos);
+
+/* continues a delivery from a subscription (pinned by the previous task). */
+FIO_SFUNC void fio___channel_deliver_continue_task(void *s_, void *l_) {
+  fio_subscription_s *s = (fio_subscription_s *)s_;
+  /* the delivery still holds a channel reference, even if `s` unsubscribed */
+  fio_channel_s *ch = s->channel;
+  FIO_LIST_NODE *pos = &s->node;
+  if (s->node.next == &s->node) { /* unsubscribed, find the next in order */
+    for (pos = ch->subscriptions.next; pos != &ch->subscriptions;
+         pos = pos->next)
+      if (FIO_PTR_FROM_FIELD(fio_subscription_s, node, pos)->seq > s->seq)
+        break;
+  }
+  fio___channel_deliver_from(ch, (fio_letter_s *)l_, pos);
+  fio_subscription_free(s);
+}
+
+FIO_SFUNC void fio___channel_deliver_from(fio_channel_s *ch,
+                                          fio_letter_s *l,
+                                          FIO_LIST_NODE *pos) {
+  size_t budget = FIO_PUBSUB_DELIVERY_BUDGET;
+  while (pos != &ch->subscriptions) {
+    fio_subscription_s *s = FIO_PTR_FROM_FIELD(fio_subscription_s, node, pos);
+    if (!budget--) { /* yield, pinning the next subscription */
+      fio_queue_push(fio_srv_queue(),
+                     fio___channel_deliver_continue_task,
+                     fio_subscription_dup(s),
+                     (void *)l);
+      return;
     }
-  } else {
-    FIO_LIST_EACH(fio_subscription_s, node, &ch->subscriptions, s) {
+    pos = pos->next;
+    if ((l->from && l->from == s->io) ||
+        s->on_message == fio_subscription___mock_cb)
+      continue;
+    if (fio___subscription_deliver(s, l)) /* deferred by the callback */
       fio_queue_push(
           fio_srv_queue(),
           (void (*)(void *, void *))fio___subscription_on_message_task,
           fio_subscription_dup(s),
           fio_letter_dup(l));
-    }
   }
   fio_letter_free(l);
   fio_channel_free(ch);
 }
 
+/* delivers a letter to all of a channel's
+ * subscribers */
+FIO_SFUNC void fio___channel_deliver_task(void *ch_, void *l_) {
+  fio_channel_s *ch = (fio_channel_s *)ch_;
+  fio___channel_deliver_from(ch,
+                             (fio_letter_s *)l_,
+                             ch->subscriptions.next);
+}
+
 /* *****************************************************************************
 
 
@@ -33392,9 +34061,42 @@ HTTP Handle Settings
 #define FIO_HTTP_BODY_RAM_LIMIT (1 << 17)
 #endif
 
-#ifndef FIO_HTTP_CACHE_LIMIT
-/** Each of the HTTP String Caches will be limited to this String count. */
-#define FIO_HTTP_CACHE_LIMIT 0 /* ((1UL << 6) + (1UL << 5)) */
+#ifndef FIO_HTTP_FORM_HEADER_LIMIT
+/**
+ * The maximum length of a `multipart/form-data` part's header block (or of a
+ * `x-www-form-urlencoded` field name) accepted by the form parser.
+ */
+#define FIO_HTTP_FORM_HEADER_LIMIT (1UL << 12)
+#endif
+
+#ifndef FIO_HTTP_ARENA_BLOCK_SIZE
+/**
+ * Per-request strings (method, path, headers, cookies, etc') are stored in a
+ * per-handle arena, allocated in blocks of this size (larger allocations
+ * receive a dedicated block).
+ */
+#define FIO_HTTP_ARENA_BLOCK_SIZE (1UL << 12)
+#endif
+
+#ifndef FIO_HTTP_MAX_PARAMS
+/** The maximum number of path parameters stored by an HTTP handle. */
+#define FIO_HTTP_MAX_PARAMS 8
+#endif
+
+#ifndef FIO_HTTP_LOG_BUFFER_SIZE
+/**
+ * HTTP log lines are collected in a buffer (of this size) and written to
+ * STDOUT in batches by a background thread, so logging never waits on STDOUT.
+ */
+#define FIO_HTTP_LOG_BUFFER_SIZE (1UL << 16)
+#endif
+
+#ifndef FIO_HTTP_LOG_DROP_WHEN_FULL
+/**
+ * If true, HTTP log lines are dropped (and counted) when the log buffer is
+ * full. Otherwise, the logging thread waits until the buffer was written.
+ */
+#define FIO_HTTP_LOG_DROP_WHEN_FULL 0
 #endif
 
 #ifndef FIO_HTTP_CACHE_STR_MAX_LEN
@@ -33402,11 +34104,6 @@ HTTP Handle Settings
 #define FIO_HTTP_CACHE_STR_MAX_LEN (1 << 12)
 #endif
 
-#ifndef FIO_HTTP_CACHE_USES_MUTEX
-/** The HTTP cache will use a mutex to allow headers to be set concurrently. */
-#define FIO_HTTP_CACHE_USES_MUTEX 1
-#endif
-
 #ifndef FIO_HTTP_CACHE_STATIC
 /** Adds a static cache for common HTTP header names. */
 #define FIO_HTTP_CACHE_STATIC 1
@@ -33421,6 +34118,68 @@ HTTP Handle Settings
 #define FIO_HTTP_STATIC_FILE_COMPLETION 1
 #endif
 
+#ifndef FIO_HTTP_STATIC_CACHE_LIMIT
+/**
+ * The maximum number of resolved static files cached (in LRU order) by
+ * `fio_http_static_file_response`. Set to 0 to disable the cache.
+ */
+#define FIO_HTTP_STATIC_CACHE_LIMIT 1024
+#endif
+
+#ifndef FIO_HTTP_STATIC_CACHE_FILE_LIMIT
+/** Cached static files up to this size are also kept in memory. */
+#define FIO_HTTP_STATIC_CACHE_FILE_LIMIT (1 << 14)
+#endif
+
+#ifndef FIO_HTTP_STATIC_CACHE_TTL
+/** The number of seconds before a cached static file is re-validated. */
+#define FIO_HTTP_STATIC_CACHE_TTL 2
+#endif
+
+#ifndef FIO_HTTP_COMPRESS_MAX_LEN
+/** Longer responses are never compressed dynamically (see `HAVE_ZLIB`). */
+#define FIO_HTTP_COMPRESS_MAX_LEN (1UL << 22)
+#endif
+
+#ifndef FIO_HTTP_COMPRESS_TYPES
+/**
+ * The default (comma separated) list of compressible `content-type` values.
+ *
+ * Entries ending with `/` match a type prefix, entries starting with `+` match
+ * a suffix and other entries must match the type exactly (parameters, such as
+ * `charset`, are ignored).
+ */
+#define FIO_HTTP_COMPRESS_TYPES                                                \
+  "text/,application/json,application/xml,application/javascript,"            \
+  "application/x-javascript,image/svg+xml,+json,+xml"
+#endif
+
+#ifndef FIO_HTTP_COMPRESS_CACHE_LIMIT
+/**
+ * The maximum number of dynamically compressed responses cached (in LRU order,
+ * by ETag) for reuse. Set to 0 to disable the cache.
+ */
+#define FIO_HTTP_COMPRESS_CACHE_LIMIT 256
+#endif
+
+#ifndef FIO_HTTP_COMPRESS_CACHE_ITEM_LIMIT
+/** Compressed responses longer than this are never cached. */
+#define FIO_HTTP_COMPRESS_CACHE_ITEM_LIMIT (1UL << 18)
+#endif
+
+#ifndef FIO_HTTP_RESPONSE_CACHE_LIMIT
+/**
+ * The maximum number of responses kept (in LRU order) by the response cache
+ * (see `fio_http_cache`). Set to 0 to disable the cache.
+ */
+#define FIO_HTTP_RESPONSE_CACHE_LIMIT 1024
+#endif
+
+#ifndef FIO_HTTP_RESPONSE_CACHE_ITEM_LIMIT
+/** Responses with a longer body are never stored by the response cache. */
+#define FIO_HTTP_RESPONSE_CACHE_ITEM_LIMIT (1UL << 18)
+#endif
+
 /* *****************************************************************************
 HTTP Handle Type
 ***************************************************************************** */
@@ -33459,9 +34218,30 @@ SFUNC fio_http_s *fio_http_dup(fio_http_s *);
 /** Destroyed the HTTP handle object, freeing all allocated resources. */
 SFUNC fio_http_s *fio_http_destroy(fio_http_s *h);
 
+/**
+ * Resets the HTTP handle for reuse (i.e., for the next keep-alive request).
+ *
+ * Behaves like `fio_http_destroy`, except that the header and cookie maps,
+ * the request arena and (small) body buffers retain their capacity.
+ *
+ * Must only be called by the handle's sole owner.
+ */
+SFUNC fio_http_s *fio_http_reset(fio_http_s *h);
+
 /** Collects an updated timestamp for logging purposes. */
 SFUNC void fio_http_start_time_set(fio_http_s *);
 
+/**
+ * Allocates memory that remains valid until the HTTP handle is destroyed.
+ *
+ * The memory is 16 byte aligned and can't be freed or reallocated. It is
+ * released, together with all other request data, when the handle is
+ * destroyed, which makes it ideal for short lived per-request temporaries.
+ *
+ * Returns NULL on error.
+ */
+SFUNC void *fio_http_arena_alloc(fio_http_s *h, size_t len);
+
 /* *****************************************************************************
 Opaque User and Controller Data
 ***************************************************************************** */
@@ -33591,6 +34371,172 @@ SFUNC void fio_http_body_expect(fio_http_s *, size_t expected_length);
 /** Writes `data` to the body (payload) associated with the HTTP handle. */
 SFUNC void fio_http_body_write(fio_http_s *, const void *data, size_t len);
 
+/* *****************************************************************************
+Form Data (`multipart/form-data` and `application/x-www-form-urlencoded`)
+***************************************************************************** */
+
+/** Form parser callbacks - a non-zero return value stops parsing (an error). */
+typedef struct fio_http_form_settings_s {
+  /**
+   * Called when a form field starts.
+   *
+   * `filename` and `content_type` are only set by `multipart/form-data` parts
+   * (`filename` is set for file uploads).
+   */
+  int (*on_field)(fio_buf_info_s name,
+                  fio_buf_info_s filename,
+                  fio_buf_info_s content_type,
+                  void *udata);
+  /** Called with (a chunk of) the field's value, may be called repeatedly. */
+  int (*on_data)(fio_buf_info_s data, void *udata);
+  /** Called once the field's value ended. */
+  int (*on_field_end)(void *udata);
+  /** Opaque user data passed along to the callbacks. */
+  void *udata;
+} fio_http_form_settings_s;
+
+/** The incremental form parser (all fields are private). */
+typedef struct fio_http_form_s {
+  fio_http_form_settings_s settings;
+  /* unconsumed data (an incomplete header / boundary), a `fio_bstr` */
+  char *carry;
+  uint8_t type;
+  uint8_t state;
+  uint8_t delim_len;
+  /* the multipart delimiter: CRLF + "--" + boundary (up to 70 bytes) */
+  char delim[77];
+} fio_http_form_s;
+
+/**
+ * Initializes a form parser using the `content-type` header value.
+ *
+ * Returns -1 (and the parser can be ignored) if the content type isn't a
+ * supported form type.
+ */
+SFUNC int fio_http_form_init(fio_http_form_s *p,
+                             fio_str_info_s content_type,
+                             fio_http_form_settings_s settings);
+
+/**
+ * Parses a chunk of form data, calling the callbacks (in order) as fields are
+ * found. Chunks can be of any length (i.e., as received by `on_body_chunk`).
+ *
+ * Names, values and headers are passed to the callbacks as views into `data`
+ * (they are valid only during the callback). Only incomplete tails (a partial
+ * part header or boundary) are copied and kept until the next call.
+ *
+ * Note: `x-www-form-urlencoded` data is decoded in place (`data` is altered).
+ *
+ * Returns -1 on error.
+ */
+SFUNC int fio_http_form_parse(fio_http_form_s *p, fio_buf_info_s data);
+
+/**
+ * Completes parsing and frees the parser's resources (must always be called).
+ *
+ * Returns -1 if the form data was incomplete or an error occurred.
+ */
+SFUNC int fio_http_form_finish(fio_http_form_s *p);
+
+/**
+ * Parses the HTTP handle's body as form data in a single pass (files are read
+ * in blocks when the body was stored in a temporary file).
+ *
+ * Note: `x-www-form-urlencoded` data is decoded in place.
+ *
+ * Returns -1 on error or if the body isn't a supported form type.
+ */
+SFUNC int fio_http_body_parse_form(fio_http_s *, fio_http_form_settings_s);
+
+/* *****************************************************************************
+Path Parameters (i.e., captured by a router)
+***************************************************************************** */
+
+/**
+ * Gets the value of the named path parameter, or an empty value if missing.
+ *
+ * Path parameters are usually set by the HTTP router (see `fio_http_route`)
+ * when a route pattern contains `:name` or `*name` segments.
+ */
+SFUNC fio_str_info_s fio_http_param(fio_http_s *, fio_str_info_s name);
+
+/**
+ * Adds a path parameter (up to `FIO_HTTP_MAX_PARAMS` parameters).
+ *
+ * The data is NOT copied - both `name` and `value` must remain valid for as
+ * long as the handle (or until `fio_http_reset` is called).
+ *
+ * Returns -1 if there's no room for more parameters.
+ */
+SFUNC int fio_http_param_add(fio_http_s *,
+                             fio_str_info_s name,
+                             fio_str_info_s value);
+
+/**
+ * Iterates through all path parameters (in path order).
+ *
+ * A non-zero return will stop iteration. Returns the number of parameters
+ * (if `callback` is NULL) or the number of parameters visited.
+ */
+SFUNC size_t fio_http_param_each(fio_http_s *,
+                                 int (*callback)(fio_http_s *,
+                                                 fio_str_info_s name,
+                                                 fio_str_info_s value,
+                                                 void *udata),
+                                 void *udata);
+
+/* *****************************************************************************
+Response (Micro) Cache
+***************************************************************************** */
+
+/** Arguments for the `fio_http_cache` function. */
+typedef struct {
+  /** The time (in seconds) a response is reused (required). */
+  uint32_t ttl;
+  /**
+   * Request header names (comma separated, lower case) that are part of the
+   * cache key, in addition to the request's host, path and query.
+   */
+  fio_str_info_s vary;
+  /**
+   * Called (possibly on a different thread) once a request that was waiting
+   * for a concurrent request to the same resource may continue.
+   *
+   * If `fio_http_is_finished(h)`, the response was sent from the cache.
+   * Otherwise, the concurrent request couldn't be cached and the request
+   * should be handled as usual.
+   *
+   * The callback takes ownership of the handle (which must be freed).
+   */
+  void (*on_release)(fio_http_s *h, void *udata);
+  /** Opaque user data for the `on_release` callback. */
+  void *udata;
+} fio_http_cache_args_s;
+
+/**
+ * Attempts to answer a `GET` request from the response (micro) cache.
+ *
+ * Returns 0 if the request was handled by the cache, in which case
+ * `on_release` is called (possibly before the function returns) and the
+ * ownership of the handle passes to the callback. This happens when:
+ *
+ * - A fresh response was cached - the response is sent from the cache (the
+ *   body is shared, not copied).
+ *
+ * - A concurrent request to the same resource is being handled - the request
+ *   waits for the other response, so a single handler runs (coalescing).
+ *
+ * Returns -1 if the request should be handled as usual. If the request is
+ * cacheable, its response is stored by the cache when it is sent (a `200`
+ * response with a body that's written at once, that sets no cookies and that
+ * isn't marked as `private` / `no-store` / `no-cache`).
+ *
+ * The cache key includes the `host` header. Requests with an `authorization`
+ * or `cookie` header are only answered by (and only store) responses that
+ * are explicitly marked as `public` (`cache-control: public`).
+ */
+SFUNC int fio_http_cache(fio_http_s *h, fio_http_cache_args_s args);
+
 /* *****************************************************************************
 Cookies
 ***************************************************************************** */
@@ -33774,9 +34720,14 @@ typedef struct fio_http_write_args_s {
   size_t len;
   /** The offset at which writing should begin. */
   size_t offset;
-  /** If streaming a file, set this value. The file is always closed. */
+  /** If streaming a file, set this value. The file is closed once sent. */
   int fd;
-  /** If the data is a buffer, this callback may be set to free it once sent. */
+  /**
+   * If the data is a buffer, this callback may be set to free it once sent.
+   *
+   * If the data is a file and `dealloc` is set, it is called (instead of
+   * `close`) with the file descriptor cast to a pointer, i.e., for shared files.
+   */
   void (*dealloc)(void *);
   /** If the data is a buffer / a file - should it be copied? */
   int copy;
@@ -33799,6 +34750,27 @@ SFUNC void fio_http_write(fio_http_s *, fio_http_write_args_s args);
   fio_http_write(http_handle, (fio_http_write_args_s){__VA_ARGS__})
 #define fio_http_finish(http_handle) fio_http_write(http_handle, .finish = 1)
 
+/**
+ * Allows the response body to be compressed (gzip / deflate) on the fly.
+ *
+ * Responses are compressed if the client's `accept-encoding` allows it, the
+ * `content-type` is listed in `types` and the body is at least `min_len` bytes
+ * long. Streamed responses are always compressed. File backed responses are
+ * never compressed (static files may use pre-compressed variants instead).
+ *
+ * `types` is a comma separated list (see `FIO_HTTP_COMPRESS_TYPES`, used when
+ * empty). It isn't copied and must remain valid while the handle is used.
+ *
+ * A compressed response's `etag` header is marked with the encoding (i.e.,
+ * `"v1"` becomes `"v1-gzip"`). Compressed responses with an `etag` header are
+ * cached and reused.
+ *
+ * Set `min_len` to zero to disable. Requires zlib (`HAVE_ZLIB`).
+ */
+SFUNC void fio_http_compress_set(fio_http_s *h,
+                                 size_t min_len,
+                                 fio_str_info_s types);
+
 /* *****************************************************************************
 WebSocket / SSE Helpers
 ***************************************************************************** */
@@ -33960,9 +34932,16 @@ SFUNC int fio_http_static_file_response(fio_http_s *h,
 /** Returns a human readable string related to the HTTP status number. */
 SFUNC fio_str_info_s fio_http_status2str(size_t status);
 
-/** Logs an HTTP (response) to STDOUT. */
+/**
+ * Logs an HTTP (response) to STDOUT.
+ *
+ * Log lines are buffered and written by a background thread (in batches).
+ */
 SFUNC void fio_http_write_log(fio_http_s *h, fio_buf_info_s peer_addr);
 
+/** Returns the number of log lines dropped because the log buffer was full. */
+SFUNC size_t fio_http_log_dropped(void);
+
 /* *****************************************************************************
 The HTTP Controller
 ***************************************************************************** */
@@ -34108,23 +35087,14 @@ HTTP Handle Implementation - possibly externed functions.
 ***************************************************************************** */
 #if defined(FIO_EXTERN_COMPLETE) || !defined(FIO_EXTERN)
 
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+
 /* *****************************************************************************
-Helpers - memory allocation & logging time collection
+Helpers - logging time collection
 ***************************************************************************** */
 
-FIO___LEAK_COUNTER_DEF(http___keystr_allocator)
-
-FIO_SFUNC void fio___http_keystr_free(void *ptr, size_t len) {
-  FIO_MEM_FREE_(ptr, len);
-  if (ptr)
-    FIO___LEAK_COUNTER_ON_FREE(http___keystr_allocator);
-  (void)len; /* if unused */
-}
-FIO_SFUNC void *fio___http_keystr_alloc(size_t capa) {
-  FIO___LEAK_COUNTER_ON_ALLOC(http___keystr_allocator);
-  return FIO_MEM_REALLOC_(NULL, 0, capa, 0);
-}
-
 #if FIO_HTTP_EXACT_LOGGING
 #define FIO___HTTP_TIME_DIV  1000000
 #define FIO___HTTP_TIME_UNIT "us"
@@ -34154,22 +35124,9 @@ FIO_SFUNC fio_str_info_s fio_http_date(uint64_t now_in_seconds) {
 
 #define FIO___RECURSIVE_INCLUDE 1
 /* *****************************************************************************
-String Cache
+Static Header Name Cache
 ***************************************************************************** */
 
-#define FIO_MAP_NAME fio___http_str_cache
-#define FIO_MAP_LRU  FIO_HTTP_CACHE_LIMIT
-#define FIO_MAP_KEY_BSTR
-#include FIO_INCLUDE_FILE
-
-static struct {
-  fio___http_str_cache_s cache;
-  FIO___LOCK_TYPE lock;
-} FIO___HTTP_STRING_CACHE[2] = {{.lock = FIO___LOCK_INIT},
-                                {.lock = FIO___LOCK_INIT}};
-#define FIO___HTTP_STR_CACHE_COOKIE 0
-#define FIO___HTTP_STR_CACHE_VALUE  1
-
 #if FIO_HTTP_CACHE_STATIC
 
 #define FIO___HTTP_STATIC_CACHE_MASK       127
@@ -34319,181 +35276,407 @@ static char *fio___http_str_cached_static(char *str, size_t len) {
 #define fio___http_str_cached_init() (void)0
 #endif /* FIO_HTTP_CACHE_STATIC */
 
-FIO_IFUNC char *fio___http_str_cached_inner(size_t group,
-                                            uint64_t hash,
-                                            fio_str_info_s s) {
-#if !FIO_HTTP_CACHE_LIMIT
-  return fio_bstr_write(NULL, s.buf, s.len);
-#endif
-  fio_str_info_s cached;
-  hash ^= (uint64_t)(uintptr_t)fio_http_new;
-#if FIO_HTTP_CACHE_USES_MUTEX
-  FIO___LOCK_LOCK(FIO___HTTP_STRING_CACHE[group].lock);
-#endif
-  cached =
-      fio___http_str_cache_set_if_missing(&FIO___HTTP_STRING_CACHE[group].cache,
-                                          hash,
-                                          s);
-#if FIO_HTTP_CACHE_USES_MUTEX
-  FIO___LOCK_UNLOCK(FIO___HTTP_STRING_CACHE[group].lock);
-#endif
-  return fio_bstr_copy(cached.buf);
+/* *****************************************************************************
+Per-Handle Arena (request lifetime memory)
+***************************************************************************** */
+
+typedef struct fio___http_arena_block_s fio___http_arena_block_s;
+struct fio___http_arena_block_s {
+  fio___http_arena_block_s *next;
+  size_t capa;
+  size_t len;
+  char buf[];
+};
+
+/** A bump allocator - memory is only released when the arena is destroyed. */
+typedef struct {
+  fio___http_arena_block_s *head;
+} fio___http_arena_s;
+
+FIO___LEAK_COUNTER_DEF(http___arena_block)
+
+FIO_SFUNC fio___http_arena_block_s *fio___http_arena_block_new(size_t capa) {
+  fio___http_arena_block_s *b = (fio___http_arena_block_s *)
+      FIO_MEM_REALLOC_(NULL, 0, sizeof(*b) + capa, 0);
+  if (!b)
+    return b;
+  FIO___LEAK_COUNTER_ON_ALLOC(http___arena_block);
+  *b = (fio___http_arena_block_s){.capa = capa};
+  return b;
 }
-FIO_IFUNC char *fio___http_str_cached(size_t group, fio_str_info_s s) {
-#if !FIO_HTTP_CACHE_LIMIT
-  return fio_bstr_write(NULL, s.buf, s.len);
-#endif
-  if (!s.len)
+
+/** Carves a 16 byte aligned memory region from the block, if possible. */
+FIO_IFUNC void *fio___http_arena_block_carve(fio___http_arena_block_s *b,
+                                             size_t len) {
+  uintptr_t start = ((uintptr_t)(b->buf + b->len) + 15) & (~(uintptr_t)15);
+  size_t end = (size_t)(start - (uintptr_t)b->buf) + len;
+  if (end > b->capa)
     return NULL;
-  if (s.len > FIO_HTTP_CACHE_STR_MAX_LEN)
-    goto avoid_caching;
-  return fio___http_str_cached_inner(group, fio_risky_hash(s.buf, s.len, 0), s);
-avoid_caching:
-  return fio_bstr_write(NULL, s.buf, s.len);
+  b->len = end;
+  return (void *)start;
 }
 
-FIO_IFUNC char *fio___http_str_cached_with_static(fio_str_info_s s) {
-#if FIO_HTTP_CACHE_STATIC
-  char *tmp;
-  if (!s.len)
+/** Allocates memory that remains valid until the arena is destroyed. */
+FIO_SFUNC void *fio___http_arena_alloc(fio___http_arena_s *a, size_t len) {
+  void *r;
+  fio___http_arena_block_s *b = a->head;
+  if (b && (r = fio___http_arena_block_carve(b, len)))
+    return r;
+  if (len > (FIO_HTTP_ARENA_BLOCK_SIZE >> 2)) {
+    /* large allocations get a dedicated block, keeping the head's leftovers */
+    b = fio___http_arena_block_new(len + 15);
+    if (!b)
+      return NULL;
+    if (a->head) {
+      b->next = a->head->next;
+      a->head->next = b;
+    } else
+      a->head = b;
+    return fio___http_arena_block_carve(b, len);
+  }
+  b = fio___http_arena_block_new(FIO_HTTP_ARENA_BLOCK_SIZE -
+                                 sizeof(fio___http_arena_block_s));
+  if (!b)
     return NULL;
-  if (s.len > FIO_HTTP_CACHE_STR_MAX_LEN)
-    goto skip_cache_test;
-  tmp = fio___http_str_cached_static(s.buf, s.len);
-  if (tmp)
-    return fio_bstr_copy(tmp);
-skip_cache_test:
-#endif /* FIO_HTTP_CACHE_STATIC */
-  return fio_bstr_write(NULL, s.buf, s.len);
+  b->next = a->head;
+  a->head = b;
+  return fio___http_arena_block_carve(b, len);
+}
+
+/** Copies a String to the arena, adding a NUL terminator. */
+FIO_IFUNC char *fio___http_arena_strdup(fio___http_arena_s *a,
+                                        fio_str_info_s s) {
+  char *r = (char *)fio___http_arena_alloc(a, s.len + 1);
+  if (!r)
+    return r;
+  if (s.len)
+    FIO_MEMCPY(r, s.buf, s.len);
+  r[s.len] = 0;
+  return r;
+}
+
+/** Short Key Strings are embedded, longer Strings are copied to the arena. */
+FIO_IFUNC fio_keystr_s fio___http_arena_keystr(fio___http_arena_s *a,
+                                               fio_str_info_s s) {
+  fio_keystr_s r = {0};
+  if (!s.buf || !s.len || ((uint64_t)s.len >> 32))
+    return r;
+  if (s.len + 1 < sizeof(r))
+    return fio_keystr(s.buf, (uint32_t)s.len);
+  r.buf = fio___http_arena_strdup(a, s);
+  if (r.buf)
+    r.len = (uint32_t)s.len; /* never passed to `fio_keystr_destroy` */
+  return r;
+}
+
+/** Releases all but one (default sized) block, which is kept for reuse. */
+FIO_SFUNC void fio___http_arena_reset(fio___http_arena_s *a) {
+  fio___http_arena_block_s *keep = NULL;
+  while (a->head) {
+    fio___http_arena_block_s *b = a->head;
+    a->head = b->next;
+    if (!keep &&
+        b->capa == FIO_HTTP_ARENA_BLOCK_SIZE - sizeof(fio___http_arena_block_s)) {
+      keep = b;
+      continue;
+    }
+    FIO_MEM_FREE_(b, sizeof(*b) + b->capa);
+    FIO___LEAK_COUNTER_ON_FREE(http___arena_block);
+  }
+  if (keep) {
+    keep->next = NULL;
+    keep->len = 0;
+  }
+  a->head = keep;
+}
+
+/** Releases all the memory owned by the arena. */
+FIO_SFUNC void fio___http_arena_destroy(fio___http_arena_s *a) {
+  while (a->head) {
+    fio___http_arena_block_s *b = a->head;
+    a->head = b->next;
+    FIO_MEM_FREE_(b, sizeof(*b) + b->capa);
+    FIO___LEAK_COUNTER_ON_FREE(http___arena_block);
+  }
 }
 
 /* *****************************************************************************
 Headers Maps
+
+Header names and values are stored in the handle's arena (or point to the
+static header name cache), so no per-header allocations are performed.
+
+Entries are kept in insertion order. The first entry for each name (the "head")
+is indexed by a compact open addressing index (stored after the entries) and
+any additional values for the same name are linked to it.
 ***************************************************************************** */
 
-#define FIO_ARRAY_NAME              fio___http_sary
-#define FIO_ARRAY_TYPE              char *
-#define FIO_ARRAY_TYPE_DESTROY(obj) fio_bstr_free(obj)
+typedef struct {
+  char *name;         /* NULL for non-head entries */
+  char *value;        /* NUL terminated */
+  uint32_t name_len;  /* name length */
+  uint32_t value_len; /* value length */
+  uint32_t hash;      /* name hash */
+  uint32_t next;      /* next value for the same name (index + 1) */
+  uint32_t last;      /* head entries: last value for the name (index + 1) */
+  uint32_t count;     /* head entries: number of values (0 == removed) */
+} fio___http_hentry_s;
 
-#define FIO_MAP_NAME                 fio___http_hmap
-#define FIO_MAP_KEY                  fio_str_info_s
-#define FIO_MAP_KEY_INTERNAL         char *
-#define FIO_MAP_KEY_FROM_INTERNAL(k) fio_bstr_info((k))
-#define FIO_MAP_KEY_CMP(a, b)        fio_bstr_is_eq2info((a), (b))
-#define FIO_MAP_KEY_DESTROY(key)     fio_bstr_free((key))
-#define FIO_MAP_KEY_COPY(dest, src)                                            \
-  (dest) = fio___http_str_cached_with_static((src))
-#define FIO_MAP_KEY_DISCARD(key)
-#define FIO_MAP_VALUE fio___http_sary_s
-#define FIO_MAP_VALUE_COPY(a, b)                                               \
-  do {                                                                         \
-    (a) = (fio___http_sary_s)FIO_ARRAY_INIT;                                   \
-    (void)(b);                                                                 \
-  } while (0) /*no-op*/
-#define FIO_MAP_VALUE_DESTROY(o) fio___http_sary_destroy(&(o))
-#define FIO_MAP_HASH_FN(k)                                                     \
-  fio_risky_hash((k).buf, (k).len, (uint64_t)(uintptr_t)fio___http_sary_destroy)
-#include FIO_INCLUDE_FILE
+typedef struct {
+  fio___http_hentry_s *ary; /* `capa` entries followed by `capa * 2` slots */
+  uint32_t len;             /* entries used */
+  uint32_t capa;            /* entry capacity (a power of 2) */
+  uint32_t count;           /* number of header names with values */
+} fio___http_hmap_s;
+
+#define FIO___HTTP_HMAP_MIN_CAPA 16
+#define FIO___HTTP_HMAP_MEM_SIZE(capa)                                         \
+  ((size_t)(capa) * (sizeof(fio___http_hentry_s) + (sizeof(uint32_t) << 1)))
+
+FIO___LEAK_COUNTER_DEF(http___hmap)
+
+FIO_IFUNC uint32_t fio___http_hmap_hash(fio_str_info_s key) {
+  return (uint32_t)fio_risky_hash(key.buf,
+                                  key.len,
+                                  (uint64_t)(uintptr_t)fio___http_arena_alloc);
+}
+
+/** Returns the index slot for the header name (zero if name is missing). */
+FIO_IFUNC uint32_t *fio___http_hmap_slot(fio___http_hmap_s *m,
+                                         fio_str_info_s key,
+                                         uint32_t hash) {
+  uint32_t *imap = (uint32_t *)(m->ary + m->capa);
+  const uint32_t mask = (m->capa << 1) - 1;
+  for (uint32_t i = hash;; ++i) { /* load factor never exceeds 50% */
+    uint32_t *slot = imap + (i & mask);
+    if (!slot[0])
+      return slot;
+    fio___http_hentry_s *e = m->ary + (slot[0] - 1);
+    if (e->hash == hash && e->name_len == key.len &&
+        (e->name == key.buf || !FIO_MEMCMP(e->name, key.buf, key.len)))
+      return slot;
+  }
+}
+
+/** Doubles the map's capacity and rebuilds the index. */
+FIO_SFUNC int fio___http_hmap_grow(fio___http_hmap_s *m) {
+  const uint32_t capa = m->capa ? (m->capa << 1) : FIO___HTTP_HMAP_MIN_CAPA;
+  fio___http_hentry_s *ary = (fio___http_hentry_s *)
+      FIO_MEM_REALLOC_(m->ary,
+                       FIO___HTTP_HMAP_MEM_SIZE(m->capa),
+                       FIO___HTTP_HMAP_MEM_SIZE(capa),
+                       sizeof(*ary) * m->len);
+  if (!ary)
+    return -1;
+  if (!m->ary)
+    FIO___LEAK_COUNTER_ON_ALLOC(http___hmap);
+  m->ary = ary;
+  m->capa = capa;
+  FIO_MEMSET(ary + capa, 0, sizeof(uint32_t) * (capa << 1));
+  for (uint32_t i = 0; i < m->len; ++i) {
+    if (!ary[i].name)
+      continue;
+    fio_str_info_s key = FIO_STR_INFO2(ary[i].name, ary[i].name_len);
+    fio___http_hmap_slot(m, key, ary[i].hash)[0] = i + 1;
+  }
+  return 0;
+}
+
+FIO_IFUNC void fio___http_hmap_destroy(fio___http_hmap_s *m) {
+  if (m->ary) {
+    FIO_MEM_FREE_(m->ary, FIO___HTTP_HMAP_MEM_SIZE(m->capa));
+    FIO___LEAK_COUNTER_ON_FREE(http___hmap);
+  }
+  *m = (fio___http_hmap_s){0};
+}
+
+/** Removes all headers, keeping the map's capacity. */
+FIO_IFUNC void fio___http_hmap_reset(fio___http_hmap_s *m) {
+  if (!m->ary)
+    return;
+  m->len = 0;
+  m->count = 0;
+  FIO_MEMSET(m->ary + m->capa, 0, sizeof(uint32_t) * (m->capa << 1));
+}
+
+FIO_IFUNC size_t fio___http_hmap_count(fio___http_hmap_s *m) {
+  return m->count;
+}
+
+/** Returns the head entry for the header name, or NULL if it has no value. */
+FIO_IFUNC fio___http_hentry_s *fio___http_hmap_get(fio___http_hmap_s *m,
+                                                   fio_str_info_s key) {
+  if (!m->capa || !key.buf || !key.len)
+    return NULL;
+  uint32_t *slot = fio___http_hmap_slot(m, key, fio___http_hmap_hash(key));
+  if (!slot[0] || !m->ary[slot[0] - 1].count)
+    return NULL;
+  return m->ary + (slot[0] - 1);
+}
+
+/** Header names point to the static name cache when possible. */
+FIO_IFUNC char *fio___http_hmap_name(fio___http_arena_s *a,
+                                     fio_str_info_s key) {
+#if FIO_HTTP_CACHE_STATIC
+  if (key.len <= FIO_HTTP_CACHE_STR_MAX_LEN) {
+    char *tmp = fio___http_str_cached_static(key.buf, key.len);
+    if (tmp)
+      return tmp;
+  }
+#endif /* FIO_HTTP_CACHE_STATIC */
+  return fio___http_arena_strdup(a, key);
+}
 
 /** set `add` to positive to add multiple values or negative to overwrite. */
-FIO_IFUNC fio_str_info_s fio___http_hmap_set2(fio___http_hmap_s *map,
+FIO_SFUNC fio_str_info_s fio___http_hmap_set2(fio___http_hmap_s *m,
+                                              fio___http_arena_s *a,
                                               fio_str_info_s key,
                                               fio_str_info_s val,
                                               int add) {
   fio_str_info_s r = {0};
-  fio___http_sary_s *o;
-  if (!key.buf || !key.len || !map)
+  uint32_t *slot;
+  fio___http_hentry_s *head, *e;
+  char *value;
+  if (!key.buf || !key.len || !m)
     return r;
+  const uint32_t hash = fio___http_hmap_hash(key);
   if (!val.buf || !val.len)
     goto remove_key;
-  o = fio___http_hmap_node2val_ptr(fio___http_hmap_get_ptr(map, key));
-  if (!o) {
-    fio___http_sary_s va = {0};
-    o = fio___http_hmap_node2val_ptr(
-        fio___http_hmap_set_ptr(map, key, va, NULL, 1));
-    add = 1;
-  }
-  if (FIO_UNLIKELY(!o)) {
-    FIO_LOG_ERROR("Couldn't add value to header: %.*s:%.*s",
-                  (int)key.len,
-                  key.buf,
-                  (int)val.len,
-                  val.buf);
-    return r;
+  if (FIO_UNLIKELY(((uint64_t)key.len | (uint64_t)val.len) >> 32))
+    goto error;
+  if (m->len == m->capa && fio___http_hmap_grow(m))
+    goto error;
+  slot = fio___http_hmap_slot(m, key, hash);
+  if (!slot[0]) { /* new header name */
+    e = m->ary + m->len;
+    *e = (fio___http_hentry_s){
+        .name = fio___http_hmap_name(a, key),
+        .value = fio___http_arena_strdup(a, val),
+        .name_len = (uint32_t)key.len,
+        .value_len = (uint32_t)val.len,
+        .hash = hash,
+        .last = m->len + 1,
+        .count = 1,
+    };
+    if (!e->name || !e->value)
+      goto error;
+    slot[0] = ++m->len;
+    ++m->count;
+    return FIO_STR_INFO2(e->value, e->value_len);
   }
-  if (add) {
-    if (add < 0) {
-      fio___http_sary_destroy(o);
-    }
-    r = fio_bstr_info(fio___http_str_cached(FIO___HTTP_STR_CACHE_VALUE, val));
-    fio___http_sary_push(o, r.buf);
-    return r;
+  head = m->ary + (slot[0] - 1);
+  if (head->count && !add) {
+    e = m->ary + (head->last - 1);
+    return FIO_STR_INFO2(e->value, e->value_len);
   }
-  r = fio_bstr_info(fio___http_sary_get(o, -1));
-  return r;
+  if (!(value = fio___http_arena_strdup(a, val)))
+    goto error;
+  if (!head->count || add < 0) { /* (re)set the first value, drop the rest */
+    m->count += !head->count;
+    head->value = value;
+    head->value_len = (uint32_t)val.len;
+    head->next = 0;
+    head->last = slot[0];
+    head->count = 1;
+    return FIO_STR_INFO2(head->value, head->value_len);
+  }
+  e = m->ary + m->len;
+  *e = (fio___http_hentry_s){
+      .value = value,
+      .value_len = (uint32_t)val.len,
+      .hash = hash,
+  };
+  m->ary[head->last - 1].next = ++m->len;
+  head->last = m->len;
+  ++head->count;
+  return FIO_STR_INFO2(e->value, e->value_len);
 
 remove_key:
-  if (add < 1)
-    fio___http_hmap_remove(map, key, NULL);
+  if (add > 0 || !m->capa)
+    return r;
+  slot = fio___http_hmap_slot(m, key, hash);
+  if (!slot[0])
+    return r;
+  head = m->ary + (slot[0] - 1);
+  m->count -= !!head->count;
+  head->next = 0;
+  head->last = slot[0];
+  head->count = 0;
+  return r;
+
+error:
+  FIO_LOG_ERROR("Couldn't add value to header: %.*s:%.*s",
+                (int)key.len,
+                key.buf,
+                (int)val.len,
+                val.buf);
   return r;
 }
 
-FIO_IFUNC fio_str_info_s fio___http_hmap_get2(fio___http_hmap_s *map,
+FIO_SFUNC fio_str_info_s fio___http_hmap_get2(fio___http_hmap_s *m,
                                               fio_str_info_s key,
                                               int32_t index) {
   fio_str_info_s r = {0};
-  fio___http_sary_s *a =
-      fio___http_hmap_node2val_ptr(fio___http_hmap_get_ptr(map, key));
-  if (!a)
-    return r;
-  const uint32_t count = fio___http_sary_count(a);
-  if (!count)
+  fio___http_hentry_s *e = fio___http_hmap_get(m, key);
+  if (!e)
     return r;
   if (index < 0) {
-    index += count;
+    index += e->count;
     if (index < 0)
       index = 0;
   }
-  if ((uint32_t)index >= count)
+  if ((uint32_t)index >= e->count)
     return r;
-  r = fio_bstr_info(fio___http_sary_get(a, index));
+  while (index--)
+    e = m->ary + (e->next - 1);
+  r = FIO_STR_INFO2(e->value, e->value_len);
   return r;
 }
 
+/** Loops over each of the values stored in a header's head entry. */
+#define FIO___HTTP_HMAP_EACH_VALUE(map, head, pos)                             \
+  for (fio___http_hentry_s *pos = (head); pos;                                 \
+       pos = pos->next ? ((map)->ary + (pos->next - 1)) : NULL)
+
 /* *****************************************************************************
 Header iteration Task
 ***************************************************************************** */
 
-typedef struct {
-  fio_http_s *h;
-  int (*callback)(fio_http_s *, fio_str_info_s, fio_str_info_s, void *);
-  void *udata;
-} fio___http_hmap_each_info_s;
-
-FIO_SFUNC int fio___http_h_each_task_wrapper(fio___http_hmap_each_s *e) {
-  fio___http_hmap_each_info_s *data = (fio___http_hmap_each_info_s *)(e->udata);
-  FIO_ARRAY_EACH(fio___http_sary, &e->value, pos) {
-    if (data->callback(data->h, e->key, fio_bstr_info(*pos), data->udata) == -1)
-      return -1;
+/** Iterates header names in insertion order (callbacks may edit the map). */
+FIO_SFUNC size_t fio___http_hmap_each(fio___http_hmap_s *m,
+                                      fio_http_s *h,
+                                      int (*callback)(fio_http_s *,
+                                                      fio_str_info_s,
+                                                      fio_str_info_s,
+                                                      void *),
+                                      void *udata) {
+  size_t r = 0;
+  for (uint32_t i = 0; i < m->len; ++i) {
+    if (!m->ary[i].name || !m->ary[i].count)
+      continue;
+    ++r;
+    for (uint32_t v = i + 1; v; v = m->ary[v - 1].next) {
+      fio_str_info_s name = FIO_STR_INFO2(m->ary[i].name, m->ary[i].name_len);
+      fio_str_info_s value =
+          FIO_STR_INFO2(m->ary[v - 1].value, m->ary[v - 1].value_len);
+      if (callback(h, name, value, udata) == -1)
+        return r;
+    }
   }
-  return 0;
+  return r;
 }
 
 /* *****************************************************************************
 Cookie Maps
-***************************************************************************** */
 
-#define FIO_MAP_NAME                 fio___http_cmap /* cached names */
-#define FIO_MAP_KEY                  fio_str_info_s
-#define FIO_MAP_KEY_INTERNAL         char *
-#define FIO_MAP_KEY_FROM_INTERNAL(k) fio_bstr_info((k))
-#define FIO_MAP_KEY_CMP(a, b)        fio_bstr_is_eq2info((a), (b))
-#define FIO_MAP_KEY_DESTROY(key)     fio_bstr_free((key))
-#define FIO_MAP_KEY_COPY(dest, src)                                            \
-  (dest) = fio___http_str_cached(FIO___HTTP_STR_CACHE_COOKIE, (src))
-#define FIO_MAP_KEY_DISCARD(key)
+Cookie names and values are owned by the handle's arena (received cookies
+point into the arena stored `cookie` header), so the map only stores views.
+***************************************************************************** */
 
-#define FIO_MAP_VALUE_BSTR /* not cached */
+#define FIO_MAP_NAME          fio___http_cmap
+#define FIO_MAP_KEY           fio_str_info_s
+#define FIO_MAP_KEY_CMP(a, b) FIO_STR_INFO_IS_EQ((a), (b))
+#define FIO_MAP_VALUE         fio_str_info_s
 #define FIO_MAP_HASH_FN(k)                                                     \
   fio_risky_hash((k).buf, (k).len, (uint64_t)(uintptr_t)fio___http_cmap_destroy)
 #include FIO_INCLUDE_FILE
@@ -34509,7 +35692,10 @@ FIO_SFUNC void fio___mock_c_write_body(fio_http_s *h,
     if (args.dealloc)
       args.dealloc((void *)args.buf);
   } else if (args.fd != -1) {
-    close(args.fd);
+    if (args.dealloc)
+      args.dealloc((void *)(intptr_t)args.fd);
+    else
+      close(args.fd);
   }
   (void)h;
 }
@@ -34551,6 +35737,16 @@ HTTP Handle Type
 
 FIO_SFUNC int fio____http_write_start(fio_http_s *, fio_http_write_args_s *);
 FIO_SFUNC int fio____http_write_cont(fio_http_s *, fio_http_write_args_s *);
+#if HAVE_ZLIB
+FIO_SFUNC void fio___http_compress_free(fio_http_s *);
+#else
+#define fio___http_compress_free(h)
+#endif
+#if FIO_HTTP_RESPONSE_CACHE_LIMIT
+FIO_SFUNC void fio___http_rcache_abort(fio_http_s *);
+#else
+#define fio___http_rcache_abort(h)
+#endif
 
 struct fio_http_s {
   void *udata;
@@ -34568,12 +35764,24 @@ struct fio_http_s {
   fio_keystr_s version;
   fio___http_hmap_s headers[2]; /* request, response */
   fio___http_cmap_s cookies[2]; /* read, write */
+  fio___http_arena_s arena; /* owns all per-request strings */
+  struct {
+    fio_buf_info_s name[FIO_HTTP_MAX_PARAMS];
+    fio_buf_info_s value[FIO_HTTP_MAX_PARAMS]; /* views, not copied */
+    size_t count;
+  } params;
   struct {
     char *buf;
     size_t len;
     size_t pos;
     int fd;
   } body;
+  struct {
+    size_t min;           /* zero == disabled */
+    void *z;              /* stream state for compressed (streamed) responses */
+    fio_str_info_s types; /* compressible types (not owned) */
+  } compress;
+  void *cache; /* a pending response cache entry, filled by this response */
 };
 
 #define HTTP_HDR_REQUEST(h)  (h->headers + 0)
@@ -34591,20 +35799,48 @@ SFUNC fio_http_s *fio_http_destroy(fio_http_s *h) {
     return h;
   h->controller->on_destroyed(h);
 
-  fio_keystr_destroy(&h->method, fio___http_keystr_free);
-  fio_keystr_destroy(&h->path, fio___http_keystr_free);
-  fio_keystr_destroy(&h->query, fio___http_keystr_free);
-  fio_keystr_destroy(&h->version, fio___http_keystr_free);
   fio___http_hmap_destroy(h->headers);
   fio___http_hmap_destroy(h->headers + 1);
   fio___http_cmap_destroy(h->cookies);
   fio___http_cmap_destroy(h->cookies + 1);
+  fio___http_arena_destroy(&h->arena);
   fio_bstr_free(h->body.buf);
+  fio___http_compress_free(h);
+  fio___http_rcache_abort(h);
   if (h->body.fd != -1)
     close(h->body.fd);
   FIO_REF_INIT(*h);
   return h;
 }
+
+SFUNC fio_http_s *fio_http_reset(fio_http_s *h) {
+  if (!h)
+    return h;
+  h->controller->on_destroyed(h);
+
+  fio___http_hmap_reset(h->headers);
+  fio___http_hmap_reset(h->headers + 1);
+  fio___http_cmap_clear(h->cookies);
+  fio___http_cmap_clear(h->cookies + 1);
+  fio___http_arena_reset(&h->arena);
+  fio___http_compress_free(h);
+  fio___http_rcache_abort(h);
+  if (h->body.fd != -1)
+    close(h->body.fd);
+  if (fio_bstr_len(h->body.buf) > FIO_HTTP_ARENA_BLOCK_SIZE) {
+    fio_bstr_free(h->body.buf); /* don't hoard large buffers */
+    h->body.buf = NULL;
+  }
+  fio_http_s old = *h;
+  FIO_REF_INIT(*h);
+  h->headers[0] = old.headers[0];
+  h->headers[1] = old.headers[1];
+  h->cookies[0] = old.cookies[0];
+  h->cookies[1] = old.cookies[1];
+  h->arena = old.arena;
+  h->body.buf = fio_bstr_len_set(old.body.buf, 0);
+  return h;
+}
 #include FIO_INCLUDE_FILE
 
 /** Create a new http_s handle. */
@@ -34621,6 +35857,12 @@ SFUNC void fio_http_start_time_set(fio_http_s *h) {
   h->received_at = fio_http_get_timestump();
 }
 
+/** Allocates memory that is released when the HTTP handle is destroyed. */
+SFUNC void *fio_http_arena_alloc(fio_http_s *h, size_t len) {
+  FIO_ASSERT_DEBUG(h, "NULL HTTP handler!");
+  return fio___http_arena_alloc(&h->arena, len);
+}
+
 #undef FIO___RECURSIVE_INCLUDE
 /* *****************************************************************************
 Simple Property Set / Get
@@ -34635,8 +35877,7 @@ Simple Property Set / Get
   fio_str_info_s fio_http_##property##_set(fio_http_s *h,                      \
                                            fio_str_info_s value) {             \
     FIO_ASSERT_DEBUG(h, "NULL HTTP handler!");                                 \
-    fio_keystr_destroy(&h->property, fio___http_keystr_free);                  \
-    h->property = fio_keystr_copy(value, fio___http_keystr_alloc);             \
+    h->property = fio___http_arena_keystr(&h->arena, value);                   \
     return fio_keystr_info(&h->property);                                      \
   }
 
@@ -34711,7 +35952,7 @@ Header Data Management
                                                       fio_str_info_s name,     \
                                                       fio_str_info_s value) {  \
     FIO_ASSERT_DEBUG(h, "NULL HTTP Handle!");                                  \
-    return fio___http_hmap_set2(headers(h), name, value, add_val);             \
+    return fio___http_hmap_set2(headers(h), &h->arena, name, value, add_val);  \
   }
 FIO___HTTP_HEADER_SET_FN(request, set, HTTP_HDR_REQUEST, -1)
 FIO___HTTP_HEADER_SET_FN(request, set_if_missing, HTTP_HDR_REQUEST, 0)
@@ -34744,13 +35985,7 @@ size_t fio_http_request_header_each(fio_http_s *h,
   FIO_ASSERT_DEBUG(h, "NULL HTTP Handle!");
   if (!callback)
     return fio___http_hmap_count(HTTP_HDR_REQUEST(h));
-  fio___http_hmap_each_info_s d = {.h = h,
-                                   .callback = callback,
-                                   .udata = udata};
-  return fio___http_hmap_each(HTTP_HDR_REQUEST(h),
-                              fio___http_h_each_task_wrapper,
-                              &d,
-                              0);
+  return fio___http_hmap_each(HTTP_HDR_REQUEST(h), h, callback, udata);
 }
 
 /** Iterates through all headers. A non-zero return will stop iteration. */
@@ -34761,13 +35996,56 @@ size_t fio_http_response_header_each(
   FIO_ASSERT_DEBUG(h, "NULL HTTP Handle!");
   if (!callback)
     return fio___http_hmap_count(HTTP_HDR_RESPONSE(h));
-  fio___http_hmap_each_info_s d = {.h = h,
-                                   .callback = callback,
-                                   .udata = udata};
-  return fio___http_hmap_each(HTTP_HDR_RESPONSE(h),
-                              fio___http_h_each_task_wrapper,
-                              &d,
-                              0);
+  return fio___http_hmap_each(HTTP_HDR_RESPONSE(h), h, callback, udata);
+}
+
+/* *****************************************************************************
+Path Parameters
+***************************************************************************** */
+
+/** Gets the value of the named path parameter, or an empty value. */
+SFUNC fio_str_info_s fio_http_param(fio_http_s *h, fio_str_info_s name) {
+  FIO_ASSERT_DEBUG(h, "NULL HTTP Handle!");
+  for (size_t i = 0; i < h->params.count; ++i) {
+    if (h->params.name[i].len == name.len &&
+        !FIO_MEMCMP(h->params.name[i].buf, name.buf, name.len))
+      return FIO_BUF2STR_INFO(h->params.value[i]);
+  }
+  return (fio_str_info_s){0};
+}
+
+/** Adds a path parameter (views, not copied). Returns -1 if full. */
+SFUNC int fio_http_param_add(fio_http_s *h,
+                             fio_str_info_s name,
+                             fio_str_info_s value) {
+  FIO_ASSERT_DEBUG(h, "NULL HTTP Handle!");
+  if (h->params.count == FIO_HTTP_MAX_PARAMS)
+    return -1;
+  h->params.name[h->params.count] = FIO_STR2BUF_INFO(name);
+  h->params.value[h->params.count] = FIO_STR2BUF_INFO(value);
+  ++h->params.count;
+  return 0;
+}
+
+/** Iterates through all path parameters. */
+SFUNC size_t fio_http_param_each(fio_http_s *h,
+                                 int (*callback)(fio_http_s *,
+                                                 fio_str_info_s name,
+                                                 fio_str_info_s value,
+                                                 void *udata),
+                                 void *udata) {
+  FIO_ASSERT_DEBUG(h, "NULL HTTP Handle!");
+  size_t i = 0;
+  if (!callback)
+    return h->params.count;
+  while (i < h->params.count) {
+    fio_str_info_s name = FIO_BUF2STR_INFO(h->params.name[i]);
+    fio_str_info_s value = FIO_BUF2STR_INFO(h->params.value[i]);
+    ++i;
+    if (callback(h, name, value, udata))
+      break;
+  }
+  return i;
 }
 
 /* *****************************************************************************
@@ -34809,15 +36087,11 @@ FIO_IFUNC void fio___http_cookie_parse_cookie(fio_http_s *h, fio_str_info_s s) {
 
 /** (Helper) Parses all HTTP Cookies */
 FIO_SFUNC void fio___http_cookie_collect(fio_http_s *h) {
-  fio___http_sary_s *header = NULL;
-  {
-    header = fio___http_hmap_node2val_ptr(
-        fio___http_hmap_get_ptr(h->headers, FIO_STR_INFO1((char *)"cookie")));
-  }
-  if (!header)
-    return;
-  FIO_ARRAY_EACH(fio___http_sary, header, pos) {
-    fio___http_cookie_parse_cookie(h, fio_bstr_info(*pos));
+  fio___http_hentry_s *header =
+      fio___http_hmap_get(h->headers, FIO_STR_INFO2((char *)"cookie", 6));
+  FIO___HTTP_HMAP_EACH_VALUE(h->headers, header, pos) {
+    fio___http_cookie_parse_cookie(h,
+                                   FIO_STR_INFO2(pos->value, pos->value_len));
   }
   return;
 }
@@ -35005,12 +36279,19 @@ SFUNC int fio_http_cookie_set FIO_NOOP(fio_http_s *h,
   if (t.buf[t.len - 1] == ' ')
     --t.len;
 
+  /* copy strings to the arena */
+  cookie.name.buf = fio___http_arena_strdup(&h->arena, cookie.name);
+  cookie.value.buf = fio___http_arena_strdup(&h->arena, cookie.value);
+  fio_str_info_s old = t;
+  t.buf = fio___http_arena_strdup(&h->arena, old);
+  if (old.buf != tmp_buf)
+    FIO_STRING_FREE2(old);
+  if (!cookie.name.buf || !cookie.value.buf || !t.buf)
+    return -1;
   /* set the "write" cookie store data */
   fio___http_cmap_set(h->cookies + 1, cookie.name, t, NULL);
   /* set the "read" cookie store data */
   fio___http_cmap_set(h->cookies, cookie.name, cookie.value, NULL);
-  if (t.buf != tmp_buf)
-    FIO_STRING_FREE2(t);
   return 0;
 }
 
@@ -35228,6 +36509,1249 @@ SFUNC void fio_http_body_write(fio_http_s *h, const void *data, size_t len) {
                       : fio___http_body_write_fd)(h, data, len);
 }
 
+/* *****************************************************************************
+Form Data Parsing
+***************************************************************************** */
+
+#define FIO___HTTP_FORM_URLENCODED 1
+#define FIO___HTTP_FORM_MULTIPART  2
+
+#define FIO___HTTP_FORM_START    0 /* multipart: first boundary, url: name */
+#define FIO___HTTP_FORM_PREAMBLE 1 /* skipped (multipart preamble) */
+#define FIO___HTTP_FORM_BOUNDARY 2 /* multipart: right after a boundary */
+#define FIO___HTTP_FORM_HEADERS  3 /* multipart: part headers */
+#define FIO___HTTP_FORM_DATA     4 /* field value */
+#define FIO___HTTP_FORM_DONE     5 /* multipart: final boundary found */
+#define FIO___HTTP_FORM_ERROR    6
+
+FIO_SFUNC int fio___http_form_on_field_noop(fio_buf_info_s n,
+                                            fio_buf_info_s f,
+                                            fio_buf_info_s t,
+                                            void *u) {
+  return ((void)n, (void)f, (void)t, (void)u, 0);
+}
+FIO_SFUNC int fio___http_form_on_data_noop(fio_buf_info_s d, void *u) {
+  return ((void)d, (void)u, 0);
+}
+FIO_SFUNC int fio___http_form_on_field_end_noop(void *u) {
+  return ((void)u, 0);
+}
+
+/* case insensitive prefix test (`lower` must be lower case) */
+FIO_SFUNC int fio___http_form_is_prefix(char *pos,
+                                        char *end,
+                                        const char *lower,
+                                        size_t len) {
+  if ((size_t)(end - pos) < len)
+    return 0;
+  for (size_t i = 0; i < len; ++i) {
+    char c = pos[i];
+    if (c >= 'A' && c <= 'Z')
+      c |= 32;
+    if (c != lower[i])
+      return 0;
+  }
+  return 1;
+}
+
+FIO_IFUNC char *fio___http_form_skip_ws(char *pos, char *end) {
+  while (pos < end && (*pos == ' ' || *pos == '\t'))
+    ++pos;
+  return pos;
+}
+
+/* reads a header parameter value (quoted or token), updating `*ppos` */
+FIO_SFUNC fio_buf_info_s fio___http_form_param_value(char **ppos, char *end) {
+  fio_buf_info_s v;
+  char *pos = *ppos;
+  if (pos < end && *pos == '"') {
+    v.buf = ++pos;
+    pos = (char *)FIO_MEMCHR(pos, '"', end - pos);
+    if (!pos)
+      pos = end;
+    v.len = pos - v.buf;
+  } else {
+    v.buf = pos;
+    while (pos < end && *pos != ';' && *pos != ' ' && *pos != '\t')
+      ++pos;
+    v.len = pos - v.buf;
+  }
+  *ppos = pos;
+  return v;
+}
+
+/* decodes `x-www-form-urlencoded` data in place, returns the new length */
+FIO_SFUNC size_t fio___http_form_url_decode(char *buf, size_t len) {
+  char *w = buf;
+  char *const end = buf + len;
+  for (char *r = buf; r < end; ++r) {
+    if (*r == '+') {
+      *w++ = ' ';
+    } else if (*r == '%' && end - r > 2 && fio_c2i((uint8_t)r[1]) < 16 &&
+               fio_c2i((uint8_t)r[2]) < 16) {
+      *w++ = (char)((fio_c2i((uint8_t)r[1]) << 4) | fio_c2i((uint8_t)r[2]));
+      r += 2;
+    } else {
+      *w++ = *r;
+    }
+  }
+  return (size_t)(w - buf);
+}
+
+/* finds the multipart delimiter, or where a partial delimiter might start */
+FIO_SFUNC char *fio___http_form_delim_find(fio_http_form_s *p,
+                                           char *pos,
+                                           char *end,
+                                           char **safe) {
+  const size_t dlen = p->delim_len;
+  /* the delimiter starts with CR, which is rare enough to memchr for */
+  while (pos < end && (pos = (char *)FIO_MEMCHR(pos, '\r', end - pos))) {
+    const size_t left = end - pos;
+    if (left >= dlen) {
+      if (!FIO_MEMCMP(pos, p->delim, dlen))
+        return pos;
+    } else if (!FIO_MEMCMP(pos, p->delim, left)) {
+      *safe = pos;
+      return NULL;
+    }
+    ++pos;
+  }
+  *safe = end;
+  return NULL;
+}
+
+/* parses a part's header block (`end` points to the final empty line) */
+FIO_SFUNC int fio___http_form_part_headers(fio_http_form_s *p,
+                                           char *pos,
+                                           char *end) {
+  fio_buf_info_s name = {0}, filename = {0}, content_type = {0};
+  while (pos < end) {
+    char *eol = (char *)FIO_MEMCHR(pos, '\r', end - pos);
+    if (!eol)
+      eol = end;
+    if (fio___http_form_is_prefix(pos, eol, "content-disposition:", 20)) {
+      /* form-data; name="field"; filename="file.txt" */
+      pos += 20;
+      while (pos < eol && (pos = (char *)FIO_MEMCHR(pos, ';', eol - pos))) {
+        pos = fio___http_form_skip_ws(pos + 1, eol);
+        if (fio___http_form_is_prefix(pos, eol, "name=", 5)) {
+          pos += 5;
+          name = fio___http_form_param_value(&pos, eol);
+        } else if (fio___http_form_is_prefix(pos, eol, "filename=", 9)) {
+          pos += 9;
+          filename = fio___http_form_param_value(&pos, eol);
+        }
+      }
+    } else if (fio___http_form_is_prefix(pos, eol, "content-type:", 13)) {
+      char *tail = eol;
+      pos = fio___http_form_skip_ws(pos + 13, eol);
+      while (tail > pos && (tail[-1] == ' ' || tail[-1] == '\t'))
+        --tail;
+      content_type = FIO_BUF_INFO2(pos, (size_t)(tail - pos));
+    }
+    pos = eol + 2;
+  }
+  return p->settings.on_field(name, filename, content_type, p->settings.udata);
+}
+
+/* consumes as much multipart data as possible, returns bytes consumed */
+FIO_SFUNC size_t fio___http_form_multipart(fio_http_form_s *p,
+                                           char *buf,
+                                           size_t len) {
+  char *pos = buf, *end = buf + len, *tmp;
+  for (;;) {
+    switch (p->state) {
+    case FIO___HTTP_FORM_START: /* the first boundary has no leading CRLF */
+      if ((size_t)(end - pos) < (size_t)(p->delim_len - 2))
+        return pos - buf;
+      p->state = FIO___HTTP_FORM_PREAMBLE;
+      if (!FIO_MEMCMP(pos, p->delim + 2, p->delim_len - 2)) {
+        pos += p->delim_len - 2;
+        p->state = FIO___HTTP_FORM_BOUNDARY;
+      }
+      continue;
+
+    case FIO___HTTP_FORM_PREAMBLE: /* ignored */
+      if (!(tmp = fio___http_form_delim_find(p, pos, end, &pos)))
+        return pos - buf;
+      pos = tmp + p->delim_len;
+      p->state = FIO___HTTP_FORM_BOUNDARY;
+      continue;
+
+    case FIO___HTTP_FORM_BOUNDARY: /* either `--` (done) or CRLF */
+      if (end - pos < 2)
+        return pos - buf;
+      if (pos[0] == '-' && pos[1] == '-') {
+        p->state = FIO___HTTP_FORM_DONE;
+        return len; /* the epilogue is ignored */
+      }
+      tmp = fio___http_form_skip_ws(pos, end); /* transport padding */
+      if (end - tmp < 2) {
+        if (tmp - pos > 64)
+          return (size_t)-1;
+        return pos - buf;
+      }
+      if (tmp[0] != '\r' || tmp[1] != '\n')
+        return (size_t)-1;
+      pos = tmp + 2;
+      p->state = FIO___HTTP_FORM_HEADERS;
+      continue;
+
+    case FIO___HTTP_FORM_HEADERS: /* find the empty line ending the headers */
+      tmp = pos;
+      if (end - pos >= 2 && pos[0] == '\r' && pos[1] == '\n')
+        goto headers_found;
+      while (tmp < end && (tmp = (char *)FIO_MEMCHR(tmp, '\n', end - tmp))) {
+        if (end - tmp < 3)
+          break;
+        if (tmp[1] == '\r' && tmp[2] == '\n') {
+          tmp -= 1; /* point to the CRLF ending the last header line */
+          goto headers_found;
+        }
+        ++tmp;
+      }
+      if ((size_t)(end - pos) > FIO_HTTP_FORM_HEADER_LIMIT)
+        return (size_t)-1;
+      return pos - buf;
+    headers_found:
+      if (fio___http_form_part_headers(p, pos, tmp))
+        return (size_t)-1;
+      pos = tmp + 2 + (tmp != pos) * 2;
+      p->state = FIO___HTTP_FORM_DATA;
+      continue;
+
+    case FIO___HTTP_FORM_DATA: {
+      char *safe;
+      char *found = fio___http_form_delim_find(p, pos, end, &safe);
+      char *data_end = found ? found : safe;
+      if (data_end > pos &&
+          p->settings.on_data(FIO_BUF_INFO2(pos, (size_t)(data_end - pos)),
+                              p->settings.udata))
+        return (size_t)-1;
+      if (!found)
+        return data_end - buf;
+      if (p->settings.on_field_end(p->settings.udata))
+        return (size_t)-1;
+      pos = found + p->delim_len;
+      p->state = FIO___HTTP_FORM_BOUNDARY;
+      continue;
+    }
+
+    case FIO___HTTP_FORM_DONE: return len;
+    default: return (size_t)-1;
+    }
+  }
+}
+
+/* consumes as much urlencoded data as possible, returns bytes consumed */
+FIO_SFUNC size_t fio___http_form_urlencoded(fio_http_form_s *p,
+                                            char *buf,
+                                            size_t len) {
+  char *pos = buf, *end = buf + len, *tmp;
+  for (;;) {
+    switch (p->state) {
+    case FIO___HTTP_FORM_START: /* field name */
+      tmp = pos;
+      while (tmp < end && *tmp != '=' && *tmp != '&')
+        ++tmp;
+      if (tmp == end) {
+        if ((size_t)(end - pos) > FIO_HTTP_FORM_HEADER_LIMIT)
+          return (size_t)-1;
+        return pos - buf;
+      }
+      if (tmp == pos) { /* no name (i.e., `&&`) */
+        pos = tmp + 1;
+        if (*tmp == '=')
+          p->state = FIO___HTTP_FORM_PREAMBLE; /* skip the value */
+        continue;
+      }
+      if (p->settings.on_field(
+              FIO_BUF_INFO2(pos, fio___http_form_url_decode(pos, tmp - pos)),
+              FIO_BUF_INFO2(NULL, 0),
+              FIO_BUF_INFO2(NULL, 0),
+              p->settings.udata))
+        return (size_t)-1;
+      pos = tmp + 1;
+      if (*tmp == '=') {
+        p->state = FIO___HTTP_FORM_DATA;
+        continue;
+      }
+      if (p->settings.on_field_end(p->settings.udata))
+        return (size_t)-1;
+      continue;
+
+    case FIO___HTTP_FORM_PREAMBLE: /* skip a value without a name */
+      if (!(pos = (char *)FIO_MEMCHR(pos, '&', end - pos)))
+        return len;
+      ++pos;
+      p->state = FIO___HTTP_FORM_START;
+      continue;
+
+    case FIO___HTTP_FORM_DATA: /* field value */
+      tmp = (char *)FIO_MEMCHR(pos, '&', end - pos);
+      {
+        char *data_end = tmp;
+        if (!data_end) { /* keep a partial `%XX` escape for the next chunk */
+          data_end = end;
+          if (data_end - pos > 0 && data_end[-1] == '%')
+            data_end -= 1;
+          else if (data_end - pos > 1 && data_end[-2] == '%')
+            data_end -= 2;
+        }
+        if (data_end > pos) {
+          size_t dlen = fio___http_form_url_decode(pos, data_end - pos);
+          if (p->settings.on_data(FIO_BUF_INFO2(pos, dlen), p->settings.udata))
+            return (size_t)-1;
+        }
+        if (!tmp)
+          return data_end - buf;
+      }
+      if (p->settings.on_field_end(p->settings.udata))
+        return (size_t)-1;
+      pos = tmp + 1;
+      p->state = FIO___HTTP_FORM_START;
+      continue;
+
+    default: return (size_t)-1;
+    }
+  }
+}
+
+FIO_IFUNC size_t fio___http_form_consume(fio_http_form_s *p,
+                                         char *buf,
+                                         size_t len) {
+  size_t r = ((p->type == FIO___HTTP_FORM_MULTIPART)
+                  ? fio___http_form_multipart
+                  : fio___http_form_urlencoded)(p, buf, len);
+  if (r == (size_t)-1)
+    p->state = FIO___HTTP_FORM_ERROR;
+  return r;
+}
+
+/** Initializes a form parser using the `content-type` header value. */
+SFUNC int fio_http_form_init(fio_http_form_s *p,
+                             fio_str_info_s content_type,
+                             fio_http_form_settings_s settings) {
+  *p = (fio_http_form_s){.settings = settings};
+  if (!p->settings.on_field)
+    p->settings.on_field = fio___http_form_on_field_noop;
+  if (!p->settings.on_data)
+    p->settings.on_data = fio___http_form_on_data_noop;
+  if (!p->settings.on_field_end)
+    p->settings.on_field_end = fio___http_form_on_field_end_noop;
+  char *pos = content_type.buf, *end = content_type.buf + content_type.len;
+  if (fio___http_form_is_prefix(pos,
+                                end,
+                                "application/x-www-form-urlencoded",
+                                33)) {
+    pos += 33;
+    if (pos == end || *pos == ';' || *pos == ' ' || *pos == '\t') {
+      p->type = FIO___HTTP_FORM_URLENCODED;
+      return 0;
+    }
+    return -1;
+  }
+  if (!fio___http_form_is_prefix(pos, end, "multipart/form-data", 19))
+    return -1;
+  pos += 19;
+  while (pos < end && (pos = (char *)FIO_MEMCHR(pos, ';', end - pos))) {
+    pos = fio___http_form_skip_ws(pos + 1, end);
+    if (!fio___http_form_is_prefix(pos, end, "boundary=", 9))
+      continue;
+    pos += 9;
+    fio_buf_info_s b = fio___http_form_param_value(&pos, end);
+    if (!b.len || b.len > 70)
+      return -1;
+    FIO_MEMCPY(p->delim, "\r\n--", 4);
+    FIO_MEMCPY(p->delim + 4, b.buf, b.len);
+    p->delim_len = (uint8_t)(b.len + 4);
+    p->type = FIO___HTTP_FORM_MULTIPART;
+    return 0;
+  }
+  return -1;
+}
+
+/** Parses a chunk of form data, calling the callbacks as fields are found. */
+SFUNC int fio_http_form_parse(fio_http_form_s *p, fio_buf_info_s data) {
+  size_t consumed;
+  if (!p->type || p->state == FIO___HTTP_FORM_ERROR)
+    return -1;
+  if (!data.len)
+    return 0;
+  if (fio_bstr_len(p->carry)) {
+    /* complete the tail using as little of the new data as possible */
+    const size_t old = fio_bstr_len(p->carry);
+    size_t add = FIO_HTTP_FORM_HEADER_LIMIT + p->delim_len + 4;
+    if (add > data.len)
+      add = data.len;
+    p->carry = fio_bstr_write(p->carry, data.buf, add);
+    consumed = fio___http_form_consume(p, p->carry, old + add);
+    if (consumed == (size_t)-1)
+      return -1;
+    if (consumed < old) { /* still incomplete (all data was added) */
+      if (add < data.len)
+        goto error;
+      FIO_MEMMOVE(p->carry, p->carry + consumed, (old + add) - consumed);
+      p->carry = fio_bstr_len_set(p->carry, (old + add) - consumed);
+      return 0;
+    }
+    p->carry = fio_bstr_len_set(p->carry, 0);
+    data.buf += consumed - old;
+    data.len -= consumed - old;
+  }
+  consumed = fio___http_form_consume(p, data.buf, data.len);
+  if (consumed == (size_t)-1)
+    return -1;
+  if (consumed < data.len)
+    p->carry =
+        fio_bstr_write(p->carry, data.buf + consumed, data.len - consumed);
+  return 0;
+error:
+  p->state = FIO___HTTP_FORM_ERROR;
+  return -1;
+}
+
+/** Completes parsing and frees the parser's resources. */
+SFUNC int fio_http_form_finish(fio_http_form_s *p) {
+  int r = -1;
+  if (p->type == FIO___HTTP_FORM_MULTIPART) {
+    if (p->state == FIO___HTTP_FORM_DONE)
+      r = 0;
+  } else if (p->type == FIO___HTTP_FORM_URLENCODED &&
+             p->state != FIO___HTTP_FORM_ERROR) {
+    /* the last field is terminated by the end of the data */
+    p->carry = fio_bstr_write(p->carry, "&", 1);
+    if (fio___http_form_consume(p, p->carry, fio_bstr_len(p->carry)) !=
+        (size_t)-1)
+      r = 0;
+  }
+  fio_bstr_free(p->carry);
+  p->carry = NULL;
+  p->type = 0;
+  return r;
+}
+
+/** Parses the HTTP handle's body as form data in a single pass. */
+SFUNC int fio_http_body_parse_form(fio_http_s *h,
+                                   fio_http_form_settings_s settings) {
+  fio_http_form_s p;
+  int r = 0;
+  if (fio_http_form_init(
+          &p,
+          fio_http_request_header(h,
+                                  FIO_STR_INFO2((char *)"content-type", 12),
+                                  0),
+          settings))
+    return -1;
+  /* in-memory bodies are parsed in place, files are read in blocks */
+  const size_t block = (h->body.fd == -1) ? h->body.len : (1UL << 16);
+  fio_http_body_seek(h, 0);
+  for (;;) {
+    fio_str_info_s s = fio_http_body_read(h, block);
+    if (!s.len || (r = fio_http_form_parse(&p, FIO_STR2BUF_INFO(s))))
+      break;
+  }
+  return fio_http_form_finish(&p) | r;
+}
+
+/* *****************************************************************************
+Dynamic Compression (gzip / deflate)
+***************************************************************************** */
+
+/** Allows the response body to be compressed (gzip / deflate) on the fly. */
+SFUNC void fio_http_compress_set(fio_http_s *h,
+                                 size_t min_len,
+                                 fio_str_info_s types) {
+  h->compress.min = min_len;
+  h->compress.types = types;
+}
+
+/** Returns true if a `cache-control` header has the directive (any case). */
+FIO_SFUNC int fio___http_cache_control_has(fio_http_s *h,
+                                           int is_request,
+                                           fio_str_info_s directive) {
+  FIO_HTTP_HEADER_EACH_VALUE(h,
+                             is_request,
+                             FIO_STR_INFO2((char *)"cache-control", 13),
+                             v) {
+    size_t i = 0;
+    if (v.len < directive.len ||
+        (v.len > directive.len && v.buf[directive.len] != '='))
+      continue;
+    while (i < directive.len && (v.buf[i] | 32) == directive.buf[i])
+      ++i;
+    if (i == directive.len)
+      return 1;
+  }
+  return 0;
+}
+
+#if HAVE_ZLIB
+
+#define FIO___HTTP_COMPRESS_GZIP    1
+#define FIO___HTTP_COMPRESS_DEFLATE 2
+
+#if FIO_HTTP_COMPRESS_CACHE_LIMIT
+#define FIO_MAP_NAME             fio___http_zcache_map
+#define FIO_MAP_VALUE            char *
+#define FIO_MAP_VALUE_DESTROY(o) fio_bstr_free(o)
+#define FIO_MAP_VALUE_DISCARD(o) fio_bstr_free(o)
+#define FIO_MAP_LRU              FIO_HTTP_COMPRESS_CACHE_LIMIT
+#define FIO___RECURSIVE_INCLUDE  1
+#include FIO_INCLUDE_FILE
+#undef FIO___RECURSIVE_INCLUDE
+
+static struct {
+  fio___http_zcache_map_s map;
+  fio_lock_i lock;
+} fio___http_zcache = {.map = FIO_MAP_INIT, .lock = FIO_LOCK_INIT};
+
+/** Returns a copy of a cached compressed response (or NULL). */
+FIO_SFUNC char *fio___http_zcache_get(fio_str_info_s key) {
+  char *r;
+  const uint64_t hash = fio_risky_hash(key.buf, key.len, 0);
+  fio_lock(&fio___http_zcache.lock);
+  r = fio_bstr_copy(fio___http_zcache_map_get(&fio___http_zcache.map,
+                                               hash,
+                                               key));
+  fio_unlock(&fio___http_zcache.lock);
+  return r;
+}
+
+/** Caches a compressed response (a copy of `data` is stored). */
+FIO_SFUNC void fio___http_zcache_set(fio_str_info_s key, char *data) {
+  const uint64_t hash = fio_risky_hash(key.buf, key.len, 0);
+  if (fio_bstr_len(data) > FIO_HTTP_COMPRESS_CACHE_ITEM_LIMIT)
+    return;
+  fio_lock(&fio___http_zcache.lock);
+  fio___http_zcache_map_set(&fio___http_zcache.map,
+                            hash,
+                            key,
+                            fio_bstr_copy(data),
+                            NULL);
+  fio_unlock(&fio___http_zcache.lock);
+}
+
+FIO_SFUNC void fio___http_zcache_destroy(void) {
+  fio_lock(&fio___http_zcache.lock);
+  fio___http_zcache_map_destroy(&fio___http_zcache.map);
+  fio_unlock(&fio___http_zcache.lock);
+}
+#else
+#define fio___http_zcache_get(key)       NULL
+#define fio___http_zcache_set(key, data) ((void)(data))
+#define fio___http_zcache_destroy()
+#endif /* FIO_HTTP_COMPRESS_CACHE_LIMIT */
+
+/** Returns the preferred encoding accepted by the client (or zero). */
+FIO_SFUNC int fio___http_compress_encoding(fio_http_s *h) {
+  int r = 0;
+  FIO_HTTP_HEADER_EACH_VALUE(h,
+                             1,
+                             FIO_STR_INFO2((char *)"accept-encoding", 15),
+                             val) {
+    int e;
+    if (val.len == 4 && (fio_buf2u32u(val.buf) | 0x20202020UL) ==
+                            fio_buf2u32u("gzip"))
+      e = FIO___HTTP_COMPRESS_GZIP;
+    else if (val.len == 7 &&
+             (fio_buf2u64u(val.buf) | 0x0020202020202020ULL) ==
+                 (fio_buf2u64u("deflate") | 0x0020202020202020ULL))
+      e = FIO___HTTP_COMPRESS_DEFLATE;
+    else if (val.len == 1 && val.buf[0] == '*')
+      e = FIO___HTTP_COMPRESS_GZIP;
+    else
+      continue;
+    FIO_HTTP_HEADER_VALUE_EACH_PROPERTY(val, p) { /* test for `q=0` */
+      if (p.name.len == 1 && (p.name.buf[0] | 32) == 'q' && p.value.len &&
+          p.value.buf[0] == '0') {
+        size_t i = 1;
+        while (i < p.value.len &&
+               (p.value.buf[i] == '.' || p.value.buf[i] == '0'))
+          ++i;
+        if (i == p.value.len)
+          e = 0;
+      }
+    }
+    if (e == FIO___HTTP_COMPRESS_GZIP)
+      return e;
+    r |= e;
+  }
+  return r;
+}
+
+/** Returns true if the `content-type` is listed in `types` (see above). */
+FIO_SFUNC int fio___http_compress_mime_test(fio_str_info_s types,
+                                            fio_str_info_s t) {
+  if (!types.len)
+    types = FIO_STR_INFO2((char *)FIO_HTTP_COMPRESS_TYPES,
+                          sizeof(FIO_HTTP_COMPRESS_TYPES) - 1);
+  for (size_t i = 0; i < t.len; ++i) { /* ignore parameters (i.e., charset) */
+    if (t.buf[i] != ';' && t.buf[i] != ' ')
+      continue;
+    t.len = i;
+    break;
+  }
+  while (types.len) {
+    fio_str_info_s e = types;
+    char *comma = (char *)FIO_MEMCHR(types.buf, ',', types.len);
+    size_t offset = 0, i = 0;
+    if (comma)
+      e.len = (size_t)(comma - types.buf);
+    types.buf += e.len + !!comma;
+    types.len -= e.len + !!comma;
+    while (e.len && e.buf[0] == ' ')
+      ++e.buf, --e.len;
+    while (e.len && e.buf[e.len - 1] == ' ')
+      --e.len;
+    if (!e.len || e.len > t.len)
+      continue;
+    if (e.buf[0] == '+') /* suffix */
+      offset = t.len - e.len;
+    else if (e.buf[e.len - 1] != '/' && e.len != t.len) /* exact match */
+      continue;
+    while (i < e.len && (t.buf[offset + i] | 32) == (e.buf[i] | 32))
+      ++i;
+    if (i == e.len)
+      return 1;
+  }
+  return 0;
+}
+
+/** Returns the preferred encoding if the response should be compressed. */
+FIO_SFUNC int fio___http_compress_test(fio_http_s *h) {
+  fio_str_info_s tmp;
+  if (h->status < 200 || h->status > 299 || h->status == 204 ||
+      h->status == 206 || (h->state & FIO_HTTP_STATE_UPGRADED))
+    return 0;
+  tmp = fio_keystr_info(&h->method);
+  if (tmp.len == 4 &&
+      (fio_buf2u32u(tmp.buf) | 0x20202020UL) == fio_buf2u32u("head"))
+    return 0;
+  if (fio___http_hmap_get(HTTP_HDR_RESPONSE(h),
+                          FIO_STR_INFO2((char *)"content-encoding", 16)))
+    return 0;
+  if (fio___http_cache_control_has(
+          h,
+          0,
+          FIO_STR_INFO2((char *)"no-transform", 12)))
+    return 0;
+  tmp = fio_http_response_header(h,
+                                 FIO_STR_INFO2((char *)"content-type", 12),
+                                 0);
+  if (!fio___http_compress_mime_test(h->compress.types, tmp))
+    return 0;
+  return fio___http_compress_encoding(h);
+}
+
+/** Compresses `data` (gzip / deflate), returning a `fio_bstr` (or NULL). */
+FIO_SFUNC char *fio___http_compress_data(fio_buf_info_s data, int encoding) {
+  char *r;
+  z_stream z = {0};
+  if (deflateInit2(&z,
+                   Z_DEFAULT_COMPRESSION,
+                   Z_DEFLATED,
+                   (encoding == FIO___HTTP_COMPRESS_GZIP ? 31 : 15),
+                   8,
+                   Z_DEFAULT_STRATEGY) != Z_OK)
+    return NULL;
+  r = fio_bstr_reserve(NULL, (size_t)deflateBound(&z, (uLong)data.len));
+  z.next_in = (Bytef *)data.buf;
+  z.avail_in = (uInt)data.len;
+  z.next_out = (Bytef *)r;
+  z.avail_out = (uInt)(fio_bstr_info(r).capa - 1);
+  if (deflate(&z, Z_FINISH) != Z_STREAM_END || z.total_out >= data.len) {
+    /* failed, or not worth it */
+    fio_bstr_free(r);
+    r = NULL;
+  } else
+    r = fio_bstr_len_set(r, (size_t)z.total_out);
+  deflateEnd(&z);
+  return r;
+}
+
+/** Releases the data described by the write arguments. */
+FIO_IFUNC void fio___http_compress_args_free(fio_http_write_args_s *args) {
+  if (args->buf) {
+    if (args->dealloc)
+      args->dealloc((void *)args->buf);
+  } else if (args->fd > 0) {
+    if (args->dealloc)
+      args->dealloc((void *)(intptr_t)args->fd);
+    else
+      close(args->fd);
+  }
+}
+
+/** Reads the file described by the write arguments to a `fio_bstr`. */
+FIO_SFUNC char *fio___http_compress_args_read(fio_http_write_args_s *args) {
+  char *r = NULL;
+  if (args->fd < 1 || !args->len)
+    return r;
+  r = fio_bstr_readfd(NULL, args->fd, (intptr_t)args->offset, args->len);
+  if (fio_bstr_len(r) != args->len)
+    r = (fio_bstr_free(r), NULL);
+  return r;
+}
+
+/** Frees the streaming compression state (if any). */
+FIO_SFUNC void fio___http_compress_free(fio_http_s *h) {
+  z_stream *z = (z_stream *)h->compress.z;
+  if (!z)
+    return;
+  h->compress.z = NULL;
+  deflateEnd(z);
+  FIO_MEM_FREE_(z, sizeof(*z));
+}
+
+/** The writer for streamed (compressed) responses. */
+FIO_SFUNC int fio____http_write_deflate(fio_http_s *h,
+                                        fio_http_write_args_s *args) {
+  z_stream *z = (z_stream *)h->compress.z;
+  const int flush = args->finish ? Z_FINISH : Z_SYNC_FLUSH;
+  char *out = NULL;
+  char *in = NULL;
+  fio_http_write_args_s a = {.finish = args->finish};
+  if (args->buf)
+    z->next_in = (Bytef *)args->buf + args->offset;
+  else if (args->fd > 0 && !(in = fio___http_compress_args_read(args)))
+    FIO_LOG_ERROR("HTTP compression couldn't read file data (fd %d)",
+                  args->fd);
+  else
+    z->next_in = (Bytef *)in;
+  z->avail_in = (uInt)((in || args->buf) ? args->len : 0);
+  do {
+    fio_str_info_s i;
+    out = fio_bstr_reserve(out, (z->avail_in >> 1) + 64);
+    i = fio_bstr_info(out);
+    z->next_out = (Bytef *)i.buf + i.len;
+    z->avail_out = (uInt)(i.capa - i.len - 1);
+    deflate(z, flush);
+    out = fio_bstr_len_set(out, i.capa - 1 - z->avail_out);
+  } while (!z->avail_out);
+  fio_bstr_free(in);
+  fio___http_compress_args_free(args);
+  if (args->finish)
+    fio___http_compress_free(h);
+  if (fio_bstr_len(out)) {
+    a.buf = out;
+    a.len = fio_bstr_len(out);
+    a.dealloc = (void (*)(void *))fio_bstr_free;
+  } else
+    fio_bstr_free(out);
+  return fio____http_write_cont(h, &a);
+}
+
+static const fio_str_info_s fio___http_compress_names[] = {
+    {0},
+    {.buf = (char *)"gzip", .len = 4},
+    {.buf = (char *)"deflate", .len = 7},
+};
+
+/**
+ * Marks (or un-marks) the `etag` header with the encoding, so the compressed
+ * representation has a different ETag. Returns -1 if the ETag is too long.
+ */
+FIO_SFUNC int fio___http_compress_etag(fio_http_s *h, int encoding, int mark) {
+  FIO_STR_INFO_TMP_VAR(tag, 255);
+  const fio_str_info_s name = fio___http_compress_names[encoding];
+  fio_str_info_s etag =
+      fio_http_response_header(h, FIO_STR_INFO2((char *)"etag", 4), 0);
+  size_t quote;
+  if (!etag.len)
+    return 0;
+  if (etag.len + name.len + 2 > tag.capa)
+    return -1;
+  quote = (etag.buf[etag.len - 1] == '"');
+  etag.len -= quote;
+  if (mark) {
+    fio_string_write2(&tag,
+                      NULL,
+                      FIO_STRING_WRITE_STR2(etag.buf, etag.len),
+                      FIO_STRING_WRITE_STR2("-", 1),
+                      FIO_STRING_WRITE_STR2(name.buf, name.len),
+                      FIO_STRING_WRITE_STR2("\"", quote));
+  } else {
+    if (etag.len < name.len + 1 ||
+        FIO_MEMCMP(etag.buf + etag.len - name.len, name.buf, name.len))
+      return 0;
+    etag.len -= name.len + 1;
+    fio_string_write2(&tag,
+                      NULL,
+                      FIO_STRING_WRITE_STR2(etag.buf, etag.len),
+                      FIO_STRING_WRITE_STR2("\"", quote));
+  }
+  fio___http_hmap_set2(HTTP_HDR_RESPONSE(h),
+                       &h->arena,
+                       FIO_STR_INFO2((char *)"etag", 4),
+                       tag,
+                       -1);
+  return 0;
+}
+
+/**
+ * Returns the encoding if the response should be compressed (or zero), marking
+ * the `etag` header, so `if-none-match` is tested against the compressed ETag.
+ */
+FIO_SFUNC int fio___http_compress_prepare(fio_http_s *h,
+                                          fio_http_write_args_s *args) {
+  int encoding;
+  if (args->finish) { /* file backed responses are never compressed */
+    if (args->len < h->compress.min || args->len > FIO_HTTP_COMPRESS_MAX_LEN ||
+        !args->buf)
+      return 0;
+  } else if (fio___http_hmap_get(HTTP_HDR_RESPONSE(h),
+                                 FIO_STR_INFO2((char *)"content-length", 14)))
+    return 0; /* not streaming */
+  encoding = fio___http_compress_test(h);
+  if (encoding && fio___http_compress_etag(h, encoding, 1))
+    encoding = 0;
+  return encoding;
+}
+
+/**
+ * Compresses the response using `encoding` (see `fio___http_compress_prepare`),
+ * updating the headers and the write arguments (or the writer, for streamed
+ * responses).
+ */
+FIO_SFUNC void fio___http_compress_start(fio_http_s *h,
+                                         fio_http_write_args_s *args,
+                                         int encoding) {
+  char *out = NULL;
+  if (!args->finish) { /* streaming */
+    z_stream *z = (z_stream *)FIO_MEM_REALLOC_(NULL, 0, sizeof(*z), 0);
+    if (!z)
+      goto no_compression;
+    *z = (z_stream){0};
+    if (deflateInit2(z,
+                     Z_DEFAULT_COMPRESSION,
+                     Z_DEFLATED,
+                     (encoding == FIO___HTTP_COMPRESS_GZIP ? 31 : 15),
+                     8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+      FIO_MEM_FREE_(z, sizeof(*z));
+      goto no_compression;
+    }
+    h->compress.z = z;
+    h->writer = fio____http_write_deflate;
+    goto set_headers;
+  }
+  {
+    FIO_STR_INFO_TMP_VAR(key, 1023);
+    fio_str_info_s etag =
+        fio_http_response_header(h, FIO_STR_INFO2((char *)"etag", 4), 0);
+    if (etag.len) { /* cache key: length, (marked) etag and path */
+      fio_str_info_s path = fio_keystr_info(&h->path);
+      if (etag.len + path.len + 48 < key.capa)
+        fio_string_write2(&key,
+                          NULL,
+                          FIO_STRING_WRITE_UNUM(args->len),
+                          FIO_STRING_WRITE_STR2(" ", 1),
+                          FIO_STRING_WRITE_STR2(etag.buf, etag.len),
+                          FIO_STRING_WRITE_STR2(" ", 1),
+                          FIO_STRING_WRITE_STR2(path.buf, path.len));
+      if (key.len)
+        out = fio___http_zcache_get(key);
+    }
+    if (!out) {
+      out = fio___http_compress_data(
+          FIO_BUF_INFO2((char *)args->buf + args->offset, args->len),
+          encoding);
+      if (!out)
+        goto no_compression;
+      if (key.len)
+        fio___http_zcache_set(key, out);
+    }
+  }
+  fio___http_compress_args_free(args);
+  *args = (fio_http_write_args_s){
+      .buf = out,
+      .len = fio_bstr_len(out),
+      .dealloc = (void (*)(void *))fio_bstr_free,
+      .finish = 1,
+  };
+  { /* set the (updated) content-length */
+    char ibuf[32];
+    fio_str_info_s v = FIO_STR_INFO3(ibuf, 0, 32);
+    v.len = fio_digits10u(args->len);
+    fio_ltoa10u(v.buf, args->len, v.len);
+    fio___http_hmap_set2(HTTP_HDR_RESPONSE(h),
+                         &h->arena,
+                         FIO_STR_INFO2((char *)"content-length", 14),
+                         v,
+                         -1);
+  }
+
+set_headers: /* ranges refer to the identity (uncompressed) representation */
+  fio___http_hmap_set2(HTTP_HDR_RESPONSE(h),
+                       &h->arena,
+                       FIO_STR_INFO2((char *)"accept-ranges", 13),
+                       FIO_STR_INFO2(NULL, 0),
+                       0);
+  fio_http_response_header_set(h,
+                               FIO_STR_INFO2((char *)"content-encoding", 16),
+                               fio___http_compress_names[encoding]);
+  fio_http_response_header_add(h,
+                               FIO_STR_INFO2((char *)"vary", 4),
+                               FIO_STR_INFO2((char *)"accept-encoding", 15));
+  return;
+
+no_compression: /* the identity representation keeps the original etag */
+  fio___http_compress_etag(h, encoding, 0);
+}
+
+#undef FIO___HTTP_COMPRESS_GZIP
+#undef FIO___HTTP_COMPRESS_DEFLATE
+#else
+#define fio___http_zcache_destroy()
+#endif /* HAVE_ZLIB */
+
+/* *****************************************************************************
+Response (Micro) Cache
+
+Responses are stored by a key built from the request's path, query and
+selected (`vary`) request headers. An entry holds the response status, the
+response headers (serialized) and the body, in a single (shared) buffer.
+
+While the first request to a resource is handled (the entry is pending),
+concurrent requests to the same resource wait for its response.
+***************************************************************************** */
+#if FIO_HTTP_RESPONSE_CACHE_LIMIT
+
+/** A request waiting for a pending cache entry. */
+typedef struct fio___http_rcache_waiter_s {
+  struct fio___http_rcache_waiter_s *next;
+  fio_http_s *h;
+  void (*on_release)(fio_http_s *h, void *udata);
+  void *udata;
+} fio___http_rcache_waiter_s;
+
+/** A cached response (or a pending one, if `data` is NULL). */
+typedef struct {
+  /** Serialized headers, followed by the body (a `fio_bstr`). */
+  char *data;
+  /** Requests waiting for the response (while pending). */
+  fio___http_rcache_waiter_s *waiters;
+  /** The time (in seconds) the response was stored. */
+  int64_t stored;
+  /** The time (in seconds) after which the response is stale. */
+  int64_t expires;
+  /** The length of the serialized headers. */
+  uint32_t headers_len;
+  /** The cache time-to-live in seconds. */
+  uint32_t ttl;
+  /** True if the response may be sent to requests with credentials. */
+  uint8_t is_public;
+} fio___http_rcache_s;
+
+FIO_SFUNC void fio___http_rcache_release(fio___http_rcache_waiter_s *w,
+                                         fio___http_rcache_s *e);
+
+#define FIO_REF_NAME             fio___http_rcache
+#define FIO_REF_CONSTRUCTOR_ONLY 1
+#define FIO_REF_DESTROY(o)                                                     \
+  do {                                                                         \
+    fio___http_rcache_release((o).waiters, NULL);                              \
+    fio_bstr_free((o).data);                                                   \
+  } while (0)
+#define FIO___RECURSIVE_INCLUDE 1
+#include FIO_INCLUDE_FILE
+#undef FIO___RECURSIVE_INCLUDE
+
+#define FIO_MAP_NAME             fio___http_rcache_map
+#define FIO_MAP_VALUE            fio___http_rcache_s *
+#define FIO_MAP_VALUE_DESTROY(o) fio___http_rcache_free(o)
+#define FIO_MAP_VALUE_DISCARD(o) fio___http_rcache_free(o)
+#define FIO_MAP_LRU              FIO_HTTP_RESPONSE_CACHE_LIMIT
+#define FIO___RECURSIVE_INCLUDE  1
+#include FIO_INCLUDE_FILE
+#undef FIO___RECURSIVE_INCLUDE
+
+static struct {
+  fio___http_rcache_map_s map;
+  fio_lock_i lock;
+} fio___http_rcache = {.map = FIO_MAP_INIT, .lock = FIO_LOCK_INIT};
+
+FIO_SFUNC void fio___http_rcache_destroy(void) {
+  fio_lock(&fio___http_rcache.lock);
+  fio___http_rcache_map_destroy(&fio___http_rcache.map);
+  fio_unlock(&fio___http_rcache.lock);
+}
+
+/** Sends a cached response using the HTTP handle (the body is shared). */
+FIO_SFUNC void fio___http_rcache_send(fio_http_s *h, fio___http_rcache_s *e) {
+  char *data = fio_bstr_copy(e->data);
+  const size_t len = fio_bstr_len(data);
+  const int64_t age = (h->received_at / FIO___HTTP_TIME_DIV) - e->stored;
+  char *pos = data + 4;
+  char *end = data + e->headers_len;
+  h->status = fio_buf2u32u(data);
+  while (pos < end) { /* name length, value length, name, value */
+    const uint32_t nlen = fio_buf2u32u(pos);
+    const uint32_t vlen = fio_buf2u32u(pos + 4);
+    fio___http_hmap_set2(HTTP_HDR_RESPONSE(h),
+                         &h->arena,
+                         FIO_STR_INFO2(pos + 8, nlen),
+                         FIO_STR_INFO2(pos + 8 + nlen, vlen),
+                         1);
+    pos += 8 + nlen + vlen;
+  }
+  if (age > 0) {
+    char buf[32];
+    fio_str_info_s v = FIO_STR_INFO3(buf, 0, 32);
+    v.len = fio_digits10u((uint64_t)age);
+    fio_ltoa10u(v.buf, (uint64_t)age, v.len);
+    fio___http_hmap_set2(HTTP_HDR_RESPONSE(h),
+                         &h->arena,
+                         FIO_STR_INFO2((char *)"age", 3),
+                         v,
+                         -1);
+  }
+  fio_http_write(h,
+                 .buf = data,
+                 .offset = e->headers_len,
+                 .len = len - e->headers_len,
+                 .dealloc = (void (*)(void *))fio_bstr_free,
+                 .finish = 1);
+}
+
+/** Releases waiting requests (sending the response, if `e` is available). */
+FIO_SFUNC void fio___http_rcache_release(fio___http_rcache_waiter_s *w,
+                                         fio___http_rcache_s *e) {
+  while (w) {
+    fio___http_rcache_waiter_s *tmp = w;
+    w = w->next;
+    if (e)
+      fio___http_rcache_send(tmp->h, e);
+    tmp->on_release(tmp->h, tmp->udata);
+    FIO_MEM_FREE_(tmp, sizeof(*tmp));
+  }
+}
+
+/** Returns true if the request carries credentials (authorization / cookie). */
+FIO_SFUNC int fio___http_rcache_is_personal(fio_http_s *h) {
+  return fio___http_hmap_get(HTTP_HDR_REQUEST(h),
+                             FIO_STR_INFO2((char *)"authorization", 13)) ||
+         fio___http_hmap_get(HTTP_HDR_REQUEST(h),
+                             FIO_STR_INFO2((char *)"cookie", 6));
+}
+
+/** Writes the cache key (host, path, query and `vary` headers). -1 if long. */
+FIO_SFUNC int fio___http_rcache_key(fio_str_info_s *key,
+                                    fio_http_s *h,
+                                    fio_str_info_s vary) {
+  fio_str_info_s host =
+      fio_http_request_header(h, FIO_STR_INFO2((char *)"host", 4), 0);
+  fio_str_info_s path = fio_keystr_info(&h->path);
+  fio_str_info_s query = fio_keystr_info(&h->query);
+  if (host.len + path.len + query.len + 2 >= key->capa)
+    return -1;
+  fio_string_write2(key,
+                    NULL,
+                    FIO_STRING_WRITE_STR2(host.buf, host.len),
+                    FIO_STRING_WRITE_STR2("\0", 1),
+                    FIO_STRING_WRITE_STR2(path.buf, path.len),
+                    FIO_STRING_WRITE_STR2("?", 1));
+  if (query.len)
+    fio_string_write(key, NULL, query.buf, query.len);
+  while (vary.len) {
+    fio_str_info_s name = vary;
+    char *comma = (char *)FIO_MEMCHR(vary.buf, ',', vary.len);
+    if (comma)
+      name.len = (size_t)(comma - vary.buf);
+    vary.buf += name.len + !!comma;
+    vary.len -= name.len + !!comma;
+    while (name.len && name.buf[0] == ' ')
+      ++name.buf, --name.len;
+    while (name.len && name.buf[name.len - 1] == ' ')
+      --name.len;
+    if (!name.len)
+      continue;
+    for (size_t i = 0;; ++i) {
+      fio_str_info_s value = fio_http_request_header(h, name, i);
+      if (!value.buf)
+        break;
+      if (key->len + value.len + 1 >= key->capa)
+        return -1;
+      fio_string_write2(key,
+                        NULL,
+                        FIO_STRING_WRITE_STR2("\n", 1),
+                        FIO_STRING_WRITE_STR2(value.buf, value.len));
+    }
+    if (key->len + 1 >= key->capa)
+      return -1;
+    fio_string_write(key, NULL, "\0", 1);
+  }
+  return 0;
+}
+
+/** Collects a response header's serialized length. */
+FIO_SFUNC int fio___http_rcache_header_len(fio_http_s *h,
+                                           fio_str_info_s name,
+                                           fio_str_info_s value,
+                                           void *len_) {
+  *(size_t *)len_ += 8 + name.len + value.len;
+  return 0;
+  (void)h;
+}
+
+/** Serializes a response header (except `date` and `content-length`). */
+FIO_SFUNC int fio___http_rcache_header_write(fio_http_s *h,
+                                             fio_str_info_s name,
+                                             fio_str_info_s value,
+                                             void *pos_) {
+  char **pos = (char **)pos_;
+  if (FIO_STR_INFO_IS_EQ(name, FIO_STR_INFO2((char *)"date", 4)) ||
+      FIO_STR_INFO_IS_EQ(name, FIO_STR_INFO2((char *)"content-length", 14)))
+    return 0;
+  fio_u2buf32u(*pos, (uint32_t)name.len);
+  fio_u2buf32u(*pos + 4, (uint32_t)value.len);
+  FIO_MEMCPY(*pos + 8, name.buf, name.len);
+  FIO_MEMCPY(*pos + 8 + name.len, value.buf, value.len);
+  *pos += 8 + name.len + value.len;
+  return 0;
+  (void)h;
+}
+
+/** Stores the response in the pending cache entry (or aborts). */
+FIO_SFUNC void fio___http_rcache_store(fio_http_s *h,
+                                       fio_http_write_args_s *args) {
+  fio___http_rcache_s *e = (fio___http_rcache_s *)h->cache;
+  fio___http_rcache_waiter_s *waiters;
+  char *data = NULL;
+  if (h->status != 200 || !args->finish || !args->buf ||
+      args->len > FIO_HTTP_RESPONSE_CACHE_ITEM_LIMIT ||
+      fio___http_cmap_count(h->cookies + 1) ||
+      fio___http_cache_control_has(h,
+                                   0,
+                                   FIO_STR_INFO2((char *)"no-store", 8)) ||
+      fio___http_cache_control_has(h,
+                                   0,
+                                   FIO_STR_INFO2((char *)"private", 7)) ||
+      fio___http_cache_control_has(h,
+                                   0,
+                                   FIO_STR_INFO2((char *)"no-cache", 8)))
+    goto abort;
+  e->is_public =
+      fio___http_cache_control_has(h, 0, FIO_STR_INFO2((char *)"public", 6));
+  if (!e->is_public && fio___http_rcache_is_personal(h))
+    goto abort;
+  { /* serialize: status, (name length, value length, name, value)... body */
+    size_t len = 4 + args->len;
+    char *pos;
+    fio_http_response_header_each(h, fio___http_rcache_header_len, &len);
+    data = fio_bstr_reserve(NULL, len);
+    if (!data)
+      goto abort;
+    pos = data;
+    fio_u2buf32u(pos, h->status);
+    pos += 4;
+    fio_http_response_header_each(h, fio___http_rcache_header_write, &pos);
+    e->headers_len = (uint32_t)(pos - data);
+    FIO_MEMCPY(pos, (char *)args->buf + args->offset, args->len);
+    pos += args->len;
+    data = fio_bstr_len_set(data, (size_t)(pos - data));
+  }
+  e->stored = fio_http_get_timestump() / FIO___HTTP_TIME_DIV;
+  fio_lock(&fio___http_rcache.lock);
+  e->data = data;
+  e->expires = e->stored + e->ttl;
+  waiters = e->waiters;
+  e->waiters = NULL;
+  fio_unlock(&fio___http_rcache.lock);
+  h->cache = NULL;
+  fio___http_rcache_release(waiters, e);
+  fio___http_rcache_free(e);
+  return;
+abort:
+  fio___http_rcache_abort(h);
+}
+
+/** Removes a pending cache entry (if any), releasing waiting requests. */
+FIO_SFUNC void fio___http_rcache_abort(fio_http_s *h) {
+  fio___http_rcache_s *e = (fio___http_rcache_s *)h->cache;
+  fio___http_rcache_waiter_s *waiters;
+  if (!e)
+    return;
+  h->cache = NULL;
+  fio_lock(&fio___http_rcache.lock);
+  waiters = e->waiters;
+  e->waiters = NULL;
+  e->expires = 0; /* the next request will retry */
+  fio_unlock(&fio___http_rcache.lock);
+  fio___http_rcache_release(waiters, NULL);
+  fio___http_rcache_free(e);
+}
+
+/** Attempts to answer a `GET` request from the response cache. */
+SFUNC int fio_http_cache(fio_http_s *h, fio_http_cache_args_s args) {
+  FIO_STR_INFO_TMP_VAR(key, 2047);
+  fio_str_info_s method = fio_keystr_info(&h->method);
+  fio___http_rcache_s *e;
+  fio___http_rcache_waiter_s *w = NULL;
+  uint64_t hash;
+  int64_t now;
+  int personal;
+  if (!args.ttl || !args.on_release || h->cache || method.len != 3 ||
+      fio_buf2u32u(method.buf) != fio_buf2u32u("GET\0") ||
+      fio___http_rcache_key(&key, h, args.vary))
+    return -1;
+  hash = fio_risky_hash(key.buf, key.len, 0);
+  now = h->received_at / FIO___HTTP_TIME_DIV;
+  personal = fio___http_rcache_is_personal(h);
+  fio_lock(&fio___http_rcache.lock);
+  e = fio___http_rcache_map_get(&fio___http_rcache.map, hash, key);
+  if (e && personal && e->expires && (!e->data || !e->is_public))
+    goto no_cache; /* only explicitly public responses are shared */
+  if (e && e->data && e->expires > now) { /* cache hit */
+    e = fio___http_rcache_dup(e);
+    fio_unlock(&fio___http_rcache.lock);
+    fio___http_rcache_send(h, e);
+    fio___http_rcache_free(e);
+    args.on_release(h, args.udata);
+    return 0;
+  }
+  if (e && !e->data && e->expires) { /* pending, wait for the response */
+    w = (fio___http_rcache_waiter_s *)
+        FIO_MEM_REALLOC_(NULL, 0, sizeof(*w), 0);
+    if (!w)
+      goto no_cache;
+    *w = (fio___http_rcache_waiter_s){.next = e->waiters,
+                                      .h = h,
+                                      .on_release = args.on_release,
+                                      .udata = args.udata};
+    e->waiters = w;
+    fio_unlock(&fio___http_rcache.lock);
+    return 0;
+  }
+  /* a miss, the response will be stored in a new (pending) entry */
+  e = fio___http_rcache_new();
+  if (!e)
+    goto no_cache;
+  e->ttl = args.ttl;
+  e->expires = 1; /* pending */
+  fio___http_rcache_map_set(&fio___http_rcache.map,
+                            hash,
+                            key,
+                            fio___http_rcache_dup(e),
+                            NULL);
+  fio_unlock(&fio___http_rcache.lock);
+  h->cache = (void *)e;
+  return -1;
+no_cache:
+  fio_unlock(&fio___http_rcache.lock);
+  return -1;
+}
+
+#else
+#define fio___http_rcache_store(h, args) fio___http_rcache_abort(h)
+#define fio___http_rcache_destroy()
+SFUNC int fio_http_cache(fio_http_s *h, fio_http_cache_args_s args) {
+  return -1;
+  (void)h, (void)args;
+}
+#endif /* FIO_HTTP_RESPONSE_CACHE_LIMIT */
+
 /* *****************************************************************************
 A Response Payload
 ***************************************************************************** */
@@ -35238,6 +37762,7 @@ FIO_IFUNC int fio___http_response_etag_if_none_match(fio_http_s *h) {
     return 0;
   h->status = 304;
   fio___http_hmap_set2(HTTP_HDR_RESPONSE(h),
+                       &h->arena,
                        FIO_STR_INFO2((char *)"content-length", 14),
                        FIO_STR_INFO2((char *)"0", 1),
                        -1);
@@ -35263,11 +37788,23 @@ FIO_SFUNC int fio____http_write_start(fio_http_s *h,
                                       fio_http_write_args_s *args) {
   /* if response has an `etag` header matching `if-none-match`, skip */
   fio___http_hmap_s *hdrs = h->headers + (!!h->status);
+  if (h->cache) /* store the response (before it's compressed / validated) */
+    fio___http_rcache_store(h, args);
+#if HAVE_ZLIB
+  /* select an encoding (marking the etag) before testing `if-none-match` */
+  int encoding = 0;
+  if (h->compress.min && h->status)
+    encoding = fio___http_compress_prepare(h, args);
+#endif
   if (h->status && args->len && fio___http_response_etag_if_none_match(h))
     return -1;
+#if HAVE_ZLIB
+  /* compress the response (updates headers and arguments) */
+  if (encoding)
+    fio___http_compress_start(h, args, encoding);
+#endif
   /* test if streaming / single body response */
-  if (!fio___http_hmap_get_ptr(hdrs,
-                               FIO_STR_INFO2((char *)"content-length", 14))) {
+  if (!fio___http_hmap_get(hdrs, FIO_STR_INFO2((char *)"content-length", 14))) {
     if (args->finish) {
       /* validate / set Content-Length (not streaming) */
       char ibuf[32];
@@ -35275,7 +37812,7 @@ FIO_SFUNC int fio____http_write_start(fio_http_s *h,
       fio_str_info_s v = FIO_STR_INFO3(ibuf, 0, 32);
       v.len = fio_digits10u(args->len);
       fio_ltoa10u(v.buf, args->len, v.len);
-      fio___http_hmap_set2(hdrs, k, v, -1);
+      fio___http_hmap_set2(hdrs, &h->arena, k, v, -1);
     } else {
       h->state |= FIO_HTTP_STATE_STREAMING;
     }
@@ -35283,13 +37820,16 @@ FIO_SFUNC int fio____http_write_start(fio_http_s *h,
   /* validate Date header */
   fio___http_hmap_set2(
       hdrs,
+      &h->arena,
       FIO_STR_INFO2((char *)"date", 4),
       fio_http_date(fio_http_get_timestump() / FIO___HTTP_TIME_DIV),
       0);
 
   /* start a response, unless status == 0 (which starts a request). */
   h->controller->send_headers(h);
-  return (h->writer = fio____http_write_cont)(h, args);
+  if (h->writer == fio____http_write_start)
+    h->writer = fio____http_write_cont;
+  return h->writer(h, args);
 }
 FIO_SFUNC int fio____http_write_cont(fio_http_s *h,
                                      fio_http_write_args_s *args) {
@@ -35320,10 +37860,15 @@ SFUNC void fio_http_write FIO_NOOP(fio_http_s *h, fio_http_write_args_s args) {
   return;
 
 handle_error:
-  if (args.fd)
-    close(args.fd);
-  if (args.dealloc && args.buf)
-    args.dealloc((void *)args.buf);
+  if (args.buf) {
+    if (args.dealloc)
+      args.dealloc((void *)args.buf);
+  } else if (args.fd > 0) {
+    if (args.dealloc)
+      args.dealloc((void *)(intptr_t)args.fd);
+    else
+      close(args.fd);
+  }
 }
 
 /* *****************************************************************************
@@ -35462,9 +38007,11 @@ SFUNC void fio_http_upgrade_sse(fio_http_s *h) {
   fio_http_response_header_set(h,
                                FIO_STR_INFO2((char *)"cache-control", 13),
                                FIO_STR_INFO2((char *)"no-store", 8));
-  fio___http_hmap_remove(HTTP_HDR_RESPONSE(h),
-                         FIO_STR_INFO2((char *)"content-length", 14),
-                         NULL);
+  fio___http_hmap_set2(HTTP_HDR_RESPONSE(h),
+                       &h->arena,
+                       FIO_STR_INFO2((char *)"content-length", 14),
+                       FIO_STR_INFO2(NULL, 0),
+                       -1);
   h->state |=
       FIO_HTTP_STATE_FINISHED | FIO_HTTP_STATE_UPGRADED | FIO_HTTP_STATE_SSE;
   h->controller->send_headers(h);
@@ -35546,16 +38093,15 @@ FIO_SFUNC int fio___http_header_parse_properties(fio_str_info_s *dst,
 FIO_IFUNC int fio___http_header_parse(fio___http_hmap_s *map,
                                       fio_str_info_s *dst,
                                       fio_str_info_s header_name) {
-  fio___http_sary_s *a =
-      fio___http_hmap_node2val_ptr(fio___http_hmap_get_ptr(map, header_name));
-  if (!a)
+  fio___http_hentry_s *head = fio___http_hmap_get(map, header_name);
+  if (!head)
     return -1;
   dst->len = 0;
   if (dst->capa < 3)
     return -1;
   dst->buf[dst->len++] = 0; /* first byte is a pretend NUL */
-  FIO_ARRAY_EACH(fio___http_sary, a, pos) {
-    fio_buf_info_s i = fio_bstr_buf(*pos);
+  FIO___HTTP_HMAP_EACH_VALUE(map, head, pos) {
+    fio_buf_info_s i = FIO_BUF_INFO2(pos->value, pos->value_len);
     if (!i.len)
       continue;
     char *const end = i.buf + i.len;
@@ -35577,6 +38123,8 @@ FIO_IFUNC int fio___http_header_parse(fio___http_hmap_s *map,
       dst->buf[dst->len++] = 0;
       if (prop != sep) { /* parse properties */
         ++prop;
+        while (prop < sep && (*prop == ' ' || *prop == '\t'))
+          ++prop;
         len = sep - prop;
         if ((len & (~(size_t)0x3FFF)) | (dst->len + len + 3 > dst->capa))
           return -1;
@@ -35661,6 +38209,170 @@ SFUNC void fio_http_send_error_response(fio_http_s *h, size_t status) {
   fio_http_write FIO_NOOP(h, args);
 }
 
+/* *****************************************************************************
+HTTP Logging - Buffered Writer
+
+Log lines are collected in one buffer while the other is written to STDOUT by a
+background thread (started lazily, per process).
+***************************************************************************** */
+
+static struct {
+  fio_thread_mutex_t lock;    /* protects the buffer */
+  fio_thread_mutex_t writing; /* held while a batch is written */
+  fio_thread_cond_t wake;
+  fio_thread_t thread;
+  fio_thread_pid_t pid; /* the process running the writer thread */
+  size_t len;
+  size_t dropped;
+  char *buf; /* collects log lines */
+  char *out; /* being written */
+  uint8_t sleeping;
+  uint8_t stop;
+  uint8_t sync; /* no writer thread, write lines immediately */
+} fio___http_log = {
+    .lock = FIO_THREAD_MUTEX_INIT,
+    .writing = FIO_THREAD_MUTEX_INIT,
+};
+static char fio___http_log_mem[2][FIO_HTTP_LOG_BUFFER_SIZE];
+
+/* writes the collected log lines (call with `writing` locked). */
+FIO_SFUNC void fio___http_log_flush_unsafe(void) {
+  char *out;
+  size_t len;
+  fio_thread_mutex_lock(&fio___http_log.lock);
+  out = fio___http_log.buf;
+  len = fio___http_log.len;
+  fio___http_log.buf = fio___http_log.out;
+  fio___http_log.out = out;
+  fio___http_log.len = 0;
+  fio_thread_mutex_unlock(&fio___http_log.lock);
+  if (!len)
+    return;
+  fwrite(out, 1, len, stdout);
+  fflush(stdout);
+}
+
+FIO_SFUNC void *fio___http_log_thread(void *ignr_) {
+  for (;;) {
+    fio_thread_mutex_lock(&fio___http_log.lock);
+    while (!fio___http_log.len && !fio___http_log.stop) {
+      fio___http_log.sleeping = 1;
+      fio_thread_cond_wait(&fio___http_log.wake, &fio___http_log.lock);
+    }
+    fio___http_log.sleeping = 0;
+    if (!fio___http_log.len) { /* stopped */
+      fio_thread_mutex_unlock(&fio___http_log.lock);
+      return NULL;
+    }
+    fio_thread_mutex_unlock(&fio___http_log.lock);
+    fio_thread_mutex_lock(&fio___http_log.writing);
+    fio___http_log_flush_unsafe();
+    fio_thread_mutex_unlock(&fio___http_log.writing);
+  }
+  (void)ignr_;
+}
+
+/* starts the writer thread for this process (call with `lock` locked). */
+FIO_SFUNC void fio___http_log_start(void) {
+  fio___http_log.pid = fio_thread_getpid();
+  fio___http_log.buf = fio___http_log_mem[0];
+  fio___http_log.out = fio___http_log_mem[1];
+  fio___http_log.len = 0; /* lines collected by a parent are the parent's */
+  fio___http_log.sleeping = 0;
+  fio___http_log.stop = 0;
+  fio___http_log.sync = 1;
+  if (fio_thread_cond_init(&fio___http_log.wake))
+    goto failed;
+  if (fio_thread_create(&fio___http_log.thread, fio___http_log_thread, NULL))
+    goto failed_thread;
+  fio___http_log.sync = 0;
+  return;
+failed_thread:
+  fio_thread_cond_destroy(&fio___http_log.wake);
+failed:
+  FIO_LOG_ERROR("HTTP logging thread failed to start, logging synchronously.");
+}
+
+/* adds a line to the log buffer, waking the writer thread if sleeping. */
+FIO_SFUNC void fio___http_log_write(const char *line, size_t len) {
+  uint8_t wake;
+  if (len > FIO_HTTP_LOG_BUFFER_SIZE)
+    len = FIO_HTTP_LOG_BUFFER_SIZE;
+  for (;;) {
+    fio_thread_mutex_lock(&fio___http_log.lock);
+    if (fio___http_log.pid != fio_thread_getpid())
+      fio___http_log_start();
+    if (fio___http_log.len + len <= FIO_HTTP_LOG_BUFFER_SIZE)
+      break;
+    if (FIO_HTTP_LOG_DROP_WHEN_FULL && !fio___http_log.sync) {
+      ++fio___http_log.dropped;
+      fio_thread_mutex_unlock(&fio___http_log.lock);
+      return;
+    }
+    fio_thread_mutex_unlock(&fio___http_log.lock);
+    if (fio___http_log.sync) { /* no writer thread, write the buffer now */
+      fio_thread_mutex_lock(&fio___http_log.writing);
+      fio___http_log_flush_unsafe();
+      fio_thread_mutex_unlock(&fio___http_log.writing);
+      continue;
+    }
+    FIO_THREAD_RESCHEDULE(); /* wait for the writer thread */
+  }
+  FIO_MEMCPY(fio___http_log.buf + fio___http_log.len, line, len);
+  fio___http_log.len += len;
+  wake = fio___http_log.sleeping;
+  fio___http_log.sleeping = 0;
+  fio_thread_mutex_unlock(&fio___http_log.lock);
+  if (wake)
+    fio_thread_cond_signal(&fio___http_log.wake);
+  if (!fio___http_log.sync)
+    return;
+  fio_thread_mutex_lock(&fio___http_log.writing);
+  fio___http_log_flush_unsafe();
+  fio_thread_mutex_unlock(&fio___http_log.writing);
+}
+
+/* the writer thread isn't copied by `fork`, reset the state for the child. */
+FIO_SFUNC void fio___http_log_on_fork(void *ignr_) {
+  fio_thread_mutex_init(&fio___http_log.lock);
+  fio_thread_mutex_init(&fio___http_log.writing);
+  fio___http_log.pid = 0;
+  (void)ignr_;
+}
+
+/* stops the writer thread and writes any remaining log lines. */
+FIO_SFUNC void fio___http_log_at_exit(void *ignr_) {
+  if (fio___http_log.pid != fio_thread_getpid())
+    return;
+  if (!fio___http_log.sync) {
+    fio_thread_mutex_lock(&fio___http_log.lock);
+    fio___http_log.stop = 1;
+    fio___http_log.sync = 1;
+    fio_thread_mutex_unlock(&fio___http_log.lock);
+    fio_thread_cond_signal(&fio___http_log.wake);
+    fio_thread_join(&fio___http_log.thread);
+    fio_thread_cond_destroy(&fio___http_log.wake);
+  }
+  fio_thread_mutex_lock(&fio___http_log.writing);
+  fio___http_log_flush_unsafe();
+  fio_thread_mutex_unlock(&fio___http_log.writing);
+  (void)ignr_;
+}
+
+FIO_CONSTRUCTOR(fio___http_log_constructor) {
+  fio_state_callback_add(FIO_CALL_IN_CHILD, fio___http_log_on_fork, NULL);
+  fio_state_callback_add(FIO_CALL_AT_EXIT, fio___http_log_at_exit, NULL);
+}
+
+/** Returns the number of log lines dropped because the log buffer was full. */
+SFUNC size_t fio_http_log_dropped(void) {
+  size_t r;
+  fio_thread_mutex_lock(&fio___http_log.lock);
+  r = fio___http_log.dropped;
+  fio_thread_mutex_unlock(&fio___http_log.lock);
+  return r;
+}
+
 /* *****************************************************************************
 HTTP Logging
 ***************************************************************************** */
@@ -35732,7 +38444,7 @@ SFUNC void fio_http_write_log(fio_http_s *h, fio_buf_info_s peer_addr) {
   if (buf.buf[buf.len - 1] != '\n')
     buf.buf[buf.len++] = '\n'; /* log was truncated, data too long */
 
-  fwrite(buf.buf, 1, buf.len, stdout);
+  fio___http_log_write(buf.buf, buf.len);
   h->received_at = time_end;
 }
 
@@ -35768,7 +38480,9 @@ SFUNC int fio_http_etag_is_match(fio_http_s *h) {
       ++cond.buf;
     if (cond.buf > end || (size_t)(end - cond.buf) < (size_t)etag.len)
       return 0;
-    if (FIO_MEMCMP(cond.buf, etag.buf, etag.len)) {
+    if (FIO_MEMCMP(cond.buf, etag.buf, etag.len) ||
+        (cond.buf + etag.len < end && cond.buf[etag.len] != ',' &&
+         cond.buf[etag.len] != ' ')) { /* no match (or only a prefix match) */
       cond.buf = (char *)FIO_MEMCHR(cond.buf, ',', end - cond.buf);
       if (!cond.buf)
         return 0;
@@ -35791,159 +38505,360 @@ Param Parsing (TODO! - parse query, parse mime/multipart parse text/json)
 ***************************************************************************** */
 
 /* *****************************************************************************
-Static file helper
+Static file cache
+
+Resolved static files (and their pre-compressed variants) are cached by the
+requested (decoded) path. Small files are also kept in memory.
+
+Entries are re-validated against the file system after
+FIO_HTTP_STATIC_CACHE_TTL seconds and are immutable once published, so they
+can be safely shared between threads (using reference counting).
 ***************************************************************************** */
 
-/**
- * Attempts to send a static file from the `root` folder. On success the
- * response is complete and 0 is returned. Otherwise returns -1.
- */
-SFUNC int fio_http_static_file_response(fio_http_s *h,
-                                        fio_str_info_s rt,
-                                        fio_str_info_s fnm,
-                                        size_t max_age) {
-  int fd = -1;
-  /* combine public folder with path to get file name */
-  fio_str_info_s mime_type = {0};
-  FIO_STR_INFO_TMP_VAR(etag, 31);
-  FIO_STR_INFO_TMP_VAR(filename, 4095);
-  { /* test for HEAD and OPTIONS requests */
-    fio_str_info_s m = fio_keystr_info(&h->method);
-    if ((m.len == 7 && (fio_buf2u64u(m.buf) | 0x2020202020202020ULL) ==
-                           (fio_buf2u64u("options") | 0x2020202020202020ULL)))
-      goto file_not_found;
+/** Number of static file variants: identity, `gz`, `br`, `zip` (deflate). */
+#define FIO___HTTP_SFILE_VARIANTS 4
+
+static const struct {
+  fio_str_info_s encoding;
+  fio_buf_info_s ext;
+} fio___http_sfile_variants[FIO___HTTP_SFILE_VARIANTS] = {
+    {{0}, {0}},
+    {{.buf = (char *)"gzip", .len = 4}, {.buf = (char *)".gz", .len = 3}},
+    {{.buf = (char *)"br", .len = 2}, {.buf = (char *)".br", .len = 3}},
+    {{.buf = (char *)"deflate", .len = 7}, {.buf = (char *)".zip", .len = 4}},
+};
+
+/** A resolved static file and its pre-compressed variants. */
+typedef struct {
+  /** Time (in seconds) after which the file system must be re-checked. */
+  int64_t expires;
+  /** A bitmap of the available variants (bit 0 is the file itself). */
+  uint8_t variants;
+  /** The resolved file name length (the name is stored in `name`). */
+  uint32_t len;
+  struct {
+    /** File data (a `fio_bstr`), if the file is small enough. */
+    char *data;
+    /** File length. */
+    size_t len;
+    /** Last modification time, used to validate open files. */
+    time_t mtime;
+    /** Pre-rendered ETag value. */
+    uint8_t etag_len;
+    char etag[19];
+    /** Pre-rendered Last-Modified value. */
+    uint8_t date_len;
+    char date[35];
+  } v[FIO___HTTP_SFILE_VARIANTS];
+  /** The resolved file name. */
+  char name[];
+} fio___http_sfile_s;
+
+#define FIO_REF_NAME             fio___http_sfile
+#define FIO_REF_FLEX_TYPE        char
+#define FIO_REF_CONSTRUCTOR_ONLY 1
+#define FIO_REF_DESTROY(o)                                                     \
+  do {                                                                         \
+    for (size_t i_ = 0; i_ < FIO___HTTP_SFILE_VARIANTS; ++i_)                  \
+      fio_bstr_free(o.v[i_].data);                                             \
+  } while (0)
+#define FIO___RECURSIVE_INCLUDE 1
+#include FIO_INCLUDE_FILE
+#undef FIO___RECURSIVE_INCLUDE
+
+/** Used as a `dealloc` callback for in-memory file data. */
+FIO_SFUNC void fio___http_sfile_data_free(void *data) {
+  fio_bstr_free((char *)data);
+}
+
+#ifdef H___FIO_SERVER___H
+/* when available, use the server's shared file descriptors */
+#define fio___http_sfile_open(name, st) fio_srv_file_open((name), (st))
+#define fio___http_sfile_close(fd)      fio_srv_file_close((fd))
+#define fio___http_sfile_release        fio_srv_file_release
+#else
+FIO_SFUNC int fio___http_sfile_open(const char *name, struct stat *st) {
+  int fd = fio_filename_open(name, O_RDONLY);
+  if (fd != -1 && fstat(fd, st)) {
+    close(fd);
+    fd = -1;
   }
-  rt.len -= ((rt.len > 0) && fnm.buf[0] == '/' &&
-             (rt.buf[rt.len - 1] == '/' || rt.buf[rt.len - 1] == '\\'));
-  fio_string_write(&filename, NULL, rt.buf, rt.len);
-  fio_string_write_url_dec(&filename, NULL, fnm.buf, fnm.len);
-  if (fio_filename_is_unsafe_url(filename.buf))
-    goto file_not_found;
+  return fd;
+}
+FIO_SFUNC void fio___http_sfile_close(int fd) {
+  if (fd != -1)
+    close(fd);
+}
+#define fio___http_sfile_release NULL
+#endif
 
-  if (filename.buf[filename.len - 1] == '/')
-    fio_string_write(&filename,
+/** Resolves a (decoded) file name to a static file object, or returns NULL. */
+FIO_SFUNC fio___http_sfile_s *fio___http_sfile_resolve(
+    fio_str_info_s *filename) {
+  fio___http_sfile_s *f;
+  struct stat stt;
+  if (filename->buf[filename->len - 1] == '/')
+    fio_string_write(filename,
                      NULL,
                      "/" FIO_HTTP_DEFAULT_INDEX_FILENAME,
                      sizeof(FIO_HTTP_DEFAULT_INDEX_FILENAME));
 
   { /* Test for incomplete file name */
-    size_t file_type = fio_filename_type(filename.buf);
+    size_t file_type = fio_filename_type(filename->buf);
 #if FIO_HTTP_STATIC_FILE_COMPLETION
     if (!file_type) {
-      char *ext = filename.buf + filename.len;
+      char *ext = filename->buf + filename->len;
       do {
         --ext;
       } while (ext[0] != '.' && ext[0] != '/');
       if (ext[0] == '.')
-        goto file_not_found;
-      fio_string_write(&filename, NULL, ".html", 5);
-      file_type = fio_filename_type(filename.buf);
+        return NULL;
+      fio_string_write(filename, NULL, ".html", 5);
+      file_type = fio_filename_type(filename->buf);
     }
     switch (file_type) {
 #ifdef S_IFDIR
     case S_IFDIR:
-      fio_string_write(&filename,
+      fio_string_write(filename,
                        NULL,
                        "/" FIO_HTTP_DEFAULT_INDEX_FILENAME,
                        sizeof(FIO_HTTP_DEFAULT_INDEX_FILENAME));
-      if (!fio_filename_type(filename.buf))
-        goto file_not_found;
+      if (!fio_filename_type(filename->buf))
+        return NULL;
       break;
 #endif
     case S_IFREG: break;
 #ifdef S_IFLNK
     case S_IFLNK: break;
 #endif
-    default: goto file_not_found;
+    default: return NULL;
     }
 #else
     if (!file_type)
-      goto file_not_found;
+      return NULL;
 #endif
   }
-  {
-    /* find mime type if registered */
-    char *end = filename.buf + filename.len;
-    char *ext = end;
-    do {
-      --ext;
-    } while (ext[0] != '.' && ext[0] != '/');
-    if ((ext++)[0] == '.') {
-      mime_type = fio_http_mimetype(ext, end - ext);
-      if (!mime_type.len)
-        FIO_LOG_WARNING("missing mime-type for extension %s (not registered).",
-                        ext);
+
+  f = fio___http_sfile_new(filename->len + 1);
+  if (!f)
+    return f;
+  f->expires = (fio_http_get_timestump() / FIO___HTTP_TIME_DIV) +
+               FIO_HTTP_STATIC_CACHE_TTL;
+  f->len = (uint32_t)filename->len;
+  FIO_MEMCPY(f->name, filename->buf, filename->len);
+  f->name[f->len] = 0;
+
+  for (size_t i = 0; i < FIO___HTTP_SFILE_VARIANTS; ++i) {
+    fio_string_write(filename,
+                     NULL,
+                     fio___http_sfile_variants[i].ext.buf,
+                     fio___http_sfile_variants[i].ext.len);
+    if (stat(filename->buf, &stt) || (stt.st_mode & S_IFMT) != S_IFREG)
+      goto next_variant;
+    f->variants |= (uint8_t)(1U << i);
+    f->v[i].len = (size_t)stt.st_size;
+    f->v[i].mtime = stt.st_mtime;
+    { /* ETag only hashes stable data (access time is ignored) */
+      uint64_t etag_data[4] = {(uint64_t)stt.st_dev,
+                               (uint64_t)stt.st_ino,
+                               (uint64_t)stt.st_size,
+                               (uint64_t)stt.st_mtime};
+      fio_str_info_s etag = FIO_STR_INFO3(f->v[i].etag, 0, 18);
+      fio_string_write_hex(&etag,
+                           NULL,
+                           fio_risky_hash(etag_data, sizeof(etag_data), 0));
+      f->v[i].etag_len = (uint8_t)etag.len;
+    }
+    f->v[i].date_len = (uint8_t)fio_time2rfc7231(f->v[i].date, stt.st_mtime);
+    if (f->v[i].len && f->v[i].len <= FIO_HTTP_STATIC_CACHE_FILE_LIMIT) {
+      f->v[i].data = fio_bstr_readfile(NULL, filename->buf, 0, f->v[i].len);
+      if (fio_bstr_len(f->v[i].data) != f->v[i].len) { /* file changed? */
+        fio_bstr_free(f->v[i].data);
+        f->v[i].data = NULL;
+      }
     }
+  next_variant:
+    filename->len = f->len;
+    filename->buf[filename->len] = 0;
   }
-  {
+  if (!(f->variants & 1)) {
+    fio___http_sfile_free(f);
+    return NULL;
+  }
+  return f;
+}
+
+#if FIO_HTTP_STATIC_CACHE_LIMIT
+#define FIO_MAP_NAME              fio___http_sfile_map
+#define FIO_MAP_VALUE             fio___http_sfile_s *
+#define FIO_MAP_VALUE_DESTROY(o)  fio___http_sfile_free(o)
+#define FIO_MAP_VALUE_DISCARD(o)  fio___http_sfile_free(o)
+#define FIO_MAP_LRU               FIO_HTTP_STATIC_CACHE_LIMIT
+#define FIO___RECURSIVE_INCLUDE   1
+#include FIO_INCLUDE_FILE
+#undef FIO___RECURSIVE_INCLUDE
+
+static struct {
+  fio___http_sfile_map_s map;
+  fio_lock_i lock;
+} fio___http_sfile_cache = {.map = FIO_MAP_INIT, .lock = FIO_LOCK_INIT};
+
+/** Removes a cached static file object (i.e., if it changed on disk). */
+FIO_SFUNC void fio___http_sfile_forget(fio_str_info_s key, uint64_t hash) {
+  fio_lock(&fio___http_sfile_cache.lock);
+  fio___http_sfile_map_remove(&fio___http_sfile_cache.map, hash, key, NULL);
+  fio_unlock(&fio___http_sfile_cache.lock);
+}
+
+FIO_SFUNC void fio___http_sfile_cache_destroy(void) {
+  fio_lock(&fio___http_sfile_cache.lock);
+  fio___http_sfile_map_destroy(&fio___http_sfile_cache.map);
+  fio_unlock(&fio___http_sfile_cache.lock);
+}
+#else
+#define fio___http_sfile_forget(key, hash)
+#define fio___http_sfile_cache_destroy()
+#endif /* FIO_HTTP_STATIC_CACHE_LIMIT */
+
+/**
+ * Returns a static file object (caller must free), or NULL if not found.
+ *
+ * `filename` is used as a buffer (should have enough capacity for the file
+ * name's completion). On success, the cache key is left intact in `filename`.
+ */
+FIO_SFUNC fio___http_sfile_s *fio___http_sfile_get(fio_str_info_s *filename,
+                                                   uint64_t hash,
+                                                   int skip_cache) {
+  fio___http_sfile_s *f;
+#if FIO_HTTP_STATIC_CACHE_LIMIT
+  const fio_str_info_s key = FIO_STR_INFO2(filename->buf, filename->len);
+  if (!skip_cache) {
+    const int64_t now = fio_http_get_timestump() / FIO___HTTP_TIME_DIV;
+    fio_lock(&fio___http_sfile_cache.lock);
+    f = fio___http_sfile_map_get(&fio___http_sfile_cache.map, hash, key);
+    f = (f && f->expires > now) ? fio___http_sfile_dup(f) : NULL;
+    fio_unlock(&fio___http_sfile_cache.lock);
+    if (f)
+      return f;
+  }
+  f = fio___http_sfile_resolve(filename);
+  filename->len = key.len;
+  filename->buf[key.len] = 0;
+  fio_lock(&fio___http_sfile_cache.lock);
+  if (f)
+    fio___http_sfile_map_set(&fio___http_sfile_cache.map,
+                             hash,
+                             key,
+                             fio___http_sfile_dup(f),
+                             NULL);
+  else
+    fio___http_sfile_map_remove(&fio___http_sfile_cache.map, hash, key, NULL);
+  fio_unlock(&fio___http_sfile_cache.lock);
+#else
+  f = fio___http_sfile_resolve(filename);
+  (void)hash, (void)skip_cache;
+#endif
+  return f;
+}
+
+/* *****************************************************************************
+Static file helper
+***************************************************************************** */
+
+/**
+ * Attempts to send a static file from the `root` folder. On success the
+ * response is complete and 0 is returned. Otherwise returns -1.
+ */
+SFUNC int fio_http_static_file_response(fio_http_s *h,
+                                        fio_str_info_s rt,
+                                        fio_str_info_s fnm,
+                                        size_t max_age) {
+  int fd = -1;
+  size_t v = 0; /* variant */
+  size_t file_length, file_offset = 0;
+  uint64_t hash;
+  int skip_cache = 0;
+  fio___http_sfile_s *f = NULL;
+  fio_str_info_s mime_type = {0};
+  FIO_STR_INFO_TMP_VAR(filename, 4095);
+  { /* test for HEAD and OPTIONS requests */
+    fio_str_info_s m = fio_keystr_info(&h->method);
+    if ((m.len == 7 && (fio_buf2u64u(m.buf) | 0x2020202020202020ULL) ==
+                           (fio_buf2u64u("options") | 0x2020202020202020ULL)))
+      return -1;
+  }
+  /* combine public folder with path to get file name */
+  rt.len -= ((rt.len > 0) && fnm.buf[0] == '/' &&
+             (rt.buf[rt.len - 1] == '/' || rt.buf[rt.len - 1] == '\\'));
+  fio_string_write(&filename, NULL, rt.buf, rt.len);
+  fio_string_write_url_dec(&filename, NULL, fnm.buf, fnm.len);
+  if (fio_filename_is_unsafe_url(filename.buf))
+    return -1;
+  hash = fio_risky_hash(filename.buf, filename.len, 0);
+
+find_file:
+  f = fio___http_sfile_get(&filename, hash, skip_cache);
+  if (!f)
+    return -1;
+
+  if (f->variants > 1) { /* test for pre-compressed variants */
     fio_str_info_s ac =
         fio_http_request_header(h,
                                 FIO_STR_INFO2((char *)"accept-encoding", 15),
                                 0);
-    if (!ac.len)
-      goto accept_encoding_header_test_done;
-    struct {
-      char *value;
-      fio_buf_info_s ext;
-    } options[] = {{(char *)"gzip", FIO_BUF_INFO2((char *)".gz", 3)},
-                   {(char *)"br", FIO_BUF_INFO2((char *)".br", 3)},
-                   {(char *)"deflate", FIO_BUF_INFO2((char *)".zip", 4)},
-                   {NULL}};
-    for (size_t i = 0; options[i].value; ++i) {
-      if (!strstr(ac.buf, options[i].value))
-        continue;
-      fio_string_write(&filename, NULL, options[i].ext.buf, options[i].ext.len);
-      if (!fio_filename_type(filename.buf)) {
-        filename.len -= options[i].ext.len;
-        filename.buf[filename.len] = 0;
+    for (size_t i = 1; ac.len && i < FIO___HTTP_SFILE_VARIANTS; ++i) {
+      if (!(f->variants & (1U << i)) ||
+          !strstr(ac.buf, fio___http_sfile_variants[i].encoding.buf))
         continue;
-      }
-      fio_http_response_header_set(
-          h,
-          FIO_STR_INFO2((char *)"vary", 4),
-          FIO_STR_INFO2((char *)"accept-encoding", 15));
-      fio_http_response_header_set(
-          h,
-          FIO_STR_INFO2((char *)"content-encoding", 16),
-          FIO_STR_INFO1(options[i].value));
+      v = i;
       break;
     }
   }
 
-accept_encoding_header_test_done:
-  /* attempt to open file */
-  fd = fio_filename_open(filename.buf, O_RDONLY);
-  if (fd == -1)
-    goto file_not_found;
-
-  { /* test / validate etag */
+  if (!f->v[v].data) { /* attempt to open file */
     struct stat stt;
-    if (fstat(fd, &stt))
-      goto file_not_found;
-    uint64_t etag_hash = fio_risky_hash(&stt, sizeof(stt), 0);
-    fio_string_write_hex(&etag, NULL, etag_hash);
-    fio_http_response_header_set(h, FIO_STR_INFO2((char *)"etag", 4), etag);
+    FIO_STR_INFO_TMP_VAR(name, 4103);
+    fio_string_write2(
+        &name,
+        NULL,
+        FIO_STRING_WRITE_STR2(f->name, f->len),
+        FIO_STRING_WRITE_STR2(fio___http_sfile_variants[v].ext.buf,
+                              fio___http_sfile_variants[v].ext.len));
+    fd = fio___http_sfile_open(name.buf, &stt);
+    if (fd == -1 || (size_t)stt.st_size != f->v[v].len ||
+        stt.st_mtime != f->v[v].mtime)
+      goto file_changed;
+  }
+
+  if (v) {
+    fio_http_response_header_set(h,
+                                 FIO_STR_INFO2((char *)"vary", 4),
+                                 FIO_STR_INFO2((char *)"accept-encoding", 15));
+    fio_http_response_header_set(h,
+                                 FIO_STR_INFO2((char *)"content-encoding", 16),
+                                 fio___http_sfile_variants[v].encoding);
+  }
+  fio_http_response_header_set(
+      h,
+      FIO_STR_INFO2((char *)"etag", 4),
+      FIO_STR_INFO2(f->v[v].etag, (size_t)f->v[v].etag_len));
+  fio_http_response_header_set(
+      h,
+      FIO_STR_INFO1((char *)"last-modified"),
+      FIO_STR_INFO2(f->v[v].date, (size_t)f->v[v].date_len));
+  if (max_age) {
     filename.len = 0;
-    filename.len = fio_time2rfc7231(filename.buf, stt.st_mtime);
+    fio_string_write2(&filename,
+                      NULL,
+                      FIO_STRING_WRITE_STR2("max-age=", 8),
+                      FIO_STRING_WRITE_UNUM(max_age));
     fio_http_response_header_set(h,
-                                 FIO_STR_INFO1((char *)"last-modified"),
+                                 FIO_STR_INFO1((char *)"cache-control"),
                                  filename);
-    if (max_age) {
-      filename.len = 0;
-      fio_string_write2(&filename,
-                        NULL,
-                        FIO_STRING_WRITE_STR2("max-age=", 8),
-                        FIO_STRING_WRITE_UNUM(max_age));
-      fio_http_response_header_set(h,
-                                   FIO_STR_INFO1((char *)"cache-control"),
-                                   filename);
-    }
-    filename.len = stt.st_size;
-    filename.capa = 0;
-    if (fio___http_response_etag_if_none_match(h))
-      return 0;
   }
-  /* Note: at this point filename.len holds the length of the file */
+  if (fio___http_response_etag_if_none_match(h))
+    goto finish;
+  file_length = f->v[v].len;
 
   /* test for range requests. */
   {
@@ -35955,13 +38870,15 @@ accept_encoding_header_test_done:
     {
       fio_str_info_s ifrng =
           fio_http_request_header(h, FIO_STR_INFO2((char *)"if-range", 8), 0);
-      if (ifrng.len && !FIO_STR_INFO_IS_EQ(ifrng, etag))
+      if (ifrng.len &&
+          !FIO_STR_INFO_IS_EQ(
+              ifrng,
+              FIO_STR_INFO2(f->v[v].etag, (size_t)f->v[v].etag_len)))
         goto range_request_review_finished;
     }
     if (rng.len < 7 || fio_buf2u32u(rng.buf) != fio_buf2u32u("byte") ||
         fio_buf2u16u(rng.buf + 4) != fio_buf2u16u("s="))
       goto range_request_review_finished;
-    const size_t file_length = filename.len;
     char *ipos = rng.buf + 6;
     size_t start_range = fio_atol10u(&ipos);
     if (ipos == rng.buf + 6)
@@ -35970,20 +38887,19 @@ accept_encoding_header_test_done:
       goto range_request_review_finished;
     ++ipos;
     size_t end_range = fio_atol10u(&ipos);
-    if (end_range > file_length)
+    if (end_range > f->v[v].len)
       goto range_request_review_finished;
     if (!end_range)
-      end_range = file_length - 1;
+      end_range = f->v[v].len - 1;
     if (start_range > end_range) {
-      start_range = file_length - end_range;
-      end_range = file_length - 1;
+      start_range = f->v[v].len - end_range;
+      end_range = f->v[v].len - 1;
     }
-    if (!start_range && end_range + 1 == file_length)
+    if (!start_range && end_range + 1 == f->v[v].len)
       goto range_request_review_finished;
     /* update response headers and info */
     h->status = 206;
     filename.len = 0;
-    filename.capa = 1024;
     fio_string_write2(&filename,
                       NULL,
                       FIO_STRING_WRITE_STR2("bytes ", 6),
@@ -35991,12 +38907,12 @@ accept_encoding_header_test_done:
                       FIO_STRING_WRITE_STR2("-", 1),
                       FIO_STRING_WRITE_UNUM((end_range)),
                       FIO_STRING_WRITE_STR2("/", 1),
-                      FIO_STRING_WRITE_UNUM(file_length));
+                      FIO_STRING_WRITE_UNUM(f->v[v].len));
     fio_http_response_header_set(h,
                                  FIO_STR_INFO2((char *)"content-range", 13),
                                  filename);
-    filename.len = (end_range - start_range) + 1;
-    filename.capa = start_range;
+    file_length = (end_range - start_range) + 1;
+    file_offset = start_range;
     fio_http_response_header_set(h,
                                  FIO_STR_INFO2((char *)"etag", 4),
                                  FIO_STR_INFO2(NULL, 0));
@@ -36015,6 +38931,19 @@ range_request_review_finished:
       goto head_request;
   }
 
+  { /* find mime type if registered */
+    char *end = f->name + f->len;
+    char *ext = end;
+    do {
+      --ext;
+    } while (ext > f->name && ext[0] != '.' && ext[0] != '/');
+    if ((ext++)[0] == '.') {
+      mime_type = fio_http_mimetype(ext, end - ext);
+      if (!mime_type.len)
+        FIO_LOG_WARNING("missing mime-type for extension %s (not registered).",
+                        ext);
+    }
+  }
   /* finish up (set mime type and send file) */
   if (mime_type.len)
     fio_http_response_header_set(h,
@@ -36022,27 +38951,39 @@ range_request_review_finished:
                                  mime_type);
   { /* send response (avoid macro for C++ compatibility) */
     fio_http_write_args_s args = {
+        .buf = fio_bstr_copy(f->v[v].data),
         .fd = fd,
-        .len = filename.len,     /* now holds body length */
-        .offset = filename.capa, /* now holds starting offset */
+        .len = file_length,
+        .offset = file_offset,
+        .dealloc = (f->v[v].data ? fio___http_sfile_data_free
+                                 : fio___http_sfile_release),
         .finish = 1};
     fio_http_write FIO_NOOP(h, args);
   }
+  fio___http_sfile_free(f);
   return 0;
 
-file_not_found:
-  if (fd != -1)
-    close(fd);
-  return -1;
+file_changed:
+  fio___http_sfile_close(fd);
+  fd = -1;
+  fio___http_sfile_forget(FIO_STR_INFO2(filename.buf, filename.len), hash);
+  fio___http_sfile_free(f);
+  if (skip_cache)
+    return -1;
+  skip_cache = 1;
+  v = 0;
+  goto find_file;
 
 head_request:
   /* TODO! HEAD responses should close?. */
-  if (fd != -1)
-    close(fd);
   {
     fio_http_write_args_s args = {.finish = 1};
     fio_http_write FIO_NOOP(h, args);
   }
+
+finish:
+  fio___http_sfile_close(fd);
+  fio___http_sfile_free(f);
   return 0;
 }
 
@@ -36346,32 +39287,13 @@ Constructor / Destructor
 
 FIO_SFUNC void fio___http_cleanup(void *ignr_) {
   (void)ignr_;
-#if FIO_HTTP_CACHE_LIMIT
-  for (size_t i = 0; i < 2; ++i) {
-    const char *names[] = {"cookie names", "header values"};
-    FIO_LOG_DEBUG2(
-        "freeing %zu strings from %s cache (capacity was: %zu)",
-        fio___http_str_cache_count(&FIO___HTTP_STRING_CACHE[i].cache),
-        names[i],
-        fio___http_str_cache_capa(&FIO___HTTP_STRING_CACHE[i].cache));
-#ifdef FIO_LOG_LEVEL_DEBUG
-    if (FIO_LOG_LEVEL_DEBUG == FIO_LOG_LEVEL) {
-      FIO_MAP_EACH(fio___http_str_cache,
-                   (&FIO___HTTP_STRING_CACHE[i].cache),
-                   pos) {
-        fprintf(stderr, "\t \"%s\" (%zu bytes)\n", pos.key.buf, pos.key.len);
-      }
-    }
-#endif
-    fio___http_str_cache_destroy(&FIO___HTTP_STRING_CACHE[i].cache);
-    FIO___LOCK_DESTROY(FIO___HTTP_STRING_CACHE[i].lock);
-    (void)names; /* if unused */
-  }
-#endif /* FIO_HTTP_CACHE_LIMIT */
   FIO_LOG_DEBUG2("HTTP MIME hash storage count/capa: %zu / %zu",
                  FIO___HTTP_MIMETYPES.count,
                  fio___http_mime_map_capa(&FIO___HTTP_MIMETYPES));
   fio___http_mime_map_destroy(&FIO___HTTP_MIMETYPES);
+  fio___http_sfile_cache_destroy();
+  fio___http_zcache_destroy();
+  fio___http_rcache_destroy();
 }
 
 FIO_CONSTRUCTOR(fio___http_str_cache_static_builder) {
@@ -36384,6 +39306,14 @@ FIO_CONSTRUCTOR(fio___http_str_cache_static_builder) {
 Cleanup
 ***************************************************************************** */
 #undef FIO___HTTP_TIME_DIV
+#undef FIO___HTTP_SFILE_VARIANTS
+#undef fio___http_sfile_open
+#undef fio___http_sfile_close
+#undef fio___http_sfile_release
+#undef fio___http_compress_free
+#undef fio___http_zcache_get
+#undef fio___http_zcache_set
+#undef fio___http_zcache_destroy
 #undef FIO___HTTP_TIME_UNIT
 
 #endif /* FIO_EXTERN_COMPLETE */
@@ -36436,6 +39366,24 @@ FIO_SFUNC size_t fio_http1_parse(fio_http1_parser_s *p,
 /** Returns true if the parser is waiting to parse a new request/response .*/
 FIO_IFUNC size_t fio_http1_parser_is_empty(fio_http1_parser_s *p);
 
+/** Returns true if the parser is reading a body (the headers were parsed). */
+FIO_IFUNC size_t fio_http1_parser_is_body(fio_http1_parser_s *p);
+
+/**
+ * Marks the response being parsed as ending when the connection closes, unless
+ * its headers set a length (`content-length` or a chunked encoding).
+ *
+ * Call from `fio_http1_on_status` (not for HEAD, 1xx, 204 and 304 responses).
+ */
+FIO_IFUNC void fio_http1_parser_until_close(fio_http1_parser_s *p);
+
+/**
+ * Completes a response read until the connection closed (EOF).
+ *
+ * Returns 0 if `fio_http1_on_complete` was called, otherwise -1.
+ */
+FIO_SFUNC int fio_http1_parse_eof(fio_http1_parser_s *p, void *udata);
+
 /** The error return value for fio_http1_parse. */
 #define FIO_HTTP1_PARSER_ERROR ((size_t)-1)
 
@@ -36490,6 +39438,10 @@ static int fio_http1___read_body(fio_http1_parser_s *p,
 static int fio_http1___read_body_chunked(fio_http1_parser_s *p,
                                          fio_buf_info_s *buf,
                                          void *udata);
+/* parsing stage 2 - read body until the connection closes (responses). */
+static int fio_http1___read_body_until_close(fio_http1_parser_s *p,
+                                             fio_buf_info_s *buf,
+                                             void *udata);
 /* parsing stage 1 - read headers. */
 static int fio_http1___read_trailer(fio_http1_parser_s *p,
                                     fio_buf_info_s *buf,
@@ -36514,6 +39466,14 @@ FIO_IFUNC size_t fio_http1_parser_is_empty(fio_http1_parser_s *p) {
   return !p->fn || p->fn == fio_http1___start;
 }
 
+/** Returns true if the parser is reading a body (the headers were parsed). */
+FIO_IFUNC size_t fio_http1_parser_is_body(fio_http1_parser_s *p) {
+  return p->fn == fio_http1___read_body ||
+         p->fn == fio_http1___read_body_chunked ||
+         p->fn == fio_http1___read_trailer ||
+         p->fn == fio_http1___read_body_until_close;
+}
+
 /* *****************************************************************************
 Main Parsing Loop
 ***************************************************************************** */
@@ -36533,7 +39493,14 @@ FIO_SFUNC size_t fio_http1_parse(fio_http1_parser_s *p,
     return FIO_HTTP1_PARSER_ERROR;
   return buf.buf - buf_start;
 }
-#define HTTP1___EXPECTED_CHUNKED ((size_t)(-1))
+#define HTTP1___EXPECTED_CHUNKED     ((size_t)(-1))
+#define HTTP1___EXPECTED_UNTIL_CLOSE ((size_t)(-2))
+
+/** Marks the response being parsed as ending when the connection closes. */
+FIO_IFUNC void fio_http1_parser_until_close(fio_http1_parser_s *p) {
+  if (!p->expected)
+    p->expected = HTTP1___EXPECTED_UNTIL_CLOSE;
+}
 
 /* completed parsing. */
 static int fio_http1___finish(fio_http1_parser_s *p,
@@ -36545,6 +39512,280 @@ static int fio_http1___finish(fio_http1_parser_s *p,
   return 1;
 }
 
+/* *****************************************************************************
+Tokenizer - Block Scanning (SIMD / SWAR)
+
+The first line and header names are scanned in 16-32 byte blocks (8 byte words
+when no vector registers are available), finding delimiters and validating the
+bytes in the same pass. The (less common) bytes that stop a block are tested one
+at a time by the caller.
+
+Header lines are found using `FIO_MEMCHR`, as the (runtime selected) SIMD of
+the C library is faster than a validating scan for the many short lines.
+***************************************************************************** */
+
+#define FIO___HTTP1_SWAR_ONES ((uint64_t)0x0101010101010101ULL)
+#define FIO___HTTP1_SWAR_7F   ((uint64_t)0x7F7F7F7F7F7F7F7FULL)
+#define FIO___HTTP1_SWAR_80   ((uint64_t)0x8080808080808080ULL)
+/* high bit set for bytes (with a clear high bit) within the range [lo, hi] */
+#define FIO___HTTP1_SWAR_RANGE(heptets, lo, hi)                                \
+  (((heptets) + FIO___HTTP1_SWAR_ONES * (0x80U - (lo))) ^                      \
+   ((heptets) + FIO___HTTP1_SWAR_ONES * (0x7FU - (hi))))
+
+/*
+ * Returns the first control character (< 0x20), `end` or (without vector
+ * registers) a position within 8 bytes of `end`.
+ *
+ * Vector loads are aligned, so they never cross a page boundary and may safely
+ * read past `end` (the extra bytes are masked away or ignored).
+ */
+FIO_IFUNC FIO___ASAN_AVOID char *fio___http1_skip_text(char *pos, char *end) {
+  if (pos >= end) /* an aligned load at `end` might cross a page boundary */
+    return end;
+#if FIO___HAS_X86_AVX2
+#define FIO___HTTP1_AVX2_CTL(p)                                                \
+  ((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(                           \
+      _mm256_min_epu8(_mm256_load_si256((const __m256i *)(p)),                 \
+                      _mm256_set1_epi8(0x1F)),                                 \
+      _mm256_load_si256((const __m256i *)(p)))))
+  char *a = FIO_PTR_MATH_RMASK(char, pos, 5);
+  uint32_t m = FIO___HTTP1_AVX2_CTL(a) & (~(uint32_t)0 << (pos - a));
+  while (!m) {
+    if ((a += 32) >= end)
+      return end;
+    m = FIO___HTTP1_AVX2_CTL(a);
+  }
+#undef FIO___HTTP1_AVX2_CTL
+  a += fio_lsb_index_unsafe((uint64_t)m);
+  return (a < end ? a : end);
+#elif FIO___HAS_X86_SSE2
+#define FIO___HTTP1_SSE2_CTL(p)                                                \
+  ((uint32_t)_mm_movemask_epi8(                                                \
+      _mm_cmpeq_epi8(_mm_min_epu8(_mm_load_si128((const __m128i *)(p)),        \
+                                  _mm_set1_epi8(0x1F)),                        \
+                     _mm_load_si128((const __m128i *)(p)))))
+  char *a = FIO_PTR_MATH_RMASK(char, pos, 4);
+  uint32_t m = FIO___HTTP1_SSE2_CTL(a) & (~(uint32_t)0 << (pos - a));
+  while (!m) {
+    if ((a += 16) >= end)
+      return end;
+    m = FIO___HTTP1_SSE2_CTL(a);
+  }
+#undef FIO___HTTP1_SSE2_CTL
+  a += fio_lsb_index_unsafe((uint64_t)m);
+  return (a < end ? a : end);
+#elif FIO___HAS_ARM_NEON
+  /* narrowed to 4 bits per byte, so the result fits a 64 bit word */
+#define FIO___HTTP1_NEON_CTL(p)                                                \
+  vget_lane_u64(                                                               \
+      vreinterpret_u64_u8(vshrn_n_u16(                                         \
+          vreinterpretq_u16_u8(                                                \
+              vcleq_u8(vld1q_u8((const uint8_t *)(p)), vdupq_n_u8(0x1F))),     \
+          4)),                                                                 \
+      0)
+  char *a = FIO_PTR_MATH_RMASK(char, pos, 4);
+  uint64_t m = FIO___HTTP1_NEON_CTL(a) & (~(uint64_t)0 << ((pos - a) << 2));
+  while (!m) {
+    if ((a += 16) >= end)
+      return end;
+    m = FIO___HTTP1_NEON_CTL(a);
+  }
+#undef FIO___HTTP1_NEON_CTL
+  a += fio_lsb_index_unsafe(m) >> 2;
+  return (a < end ? a : end);
+#else
+  for (; pos + 8 <= end; pos += 8) {
+    /* the first (least significant) flag is exact, later ones may not be */
+    const uint64_t w = fio_buf2u64_le(pos);
+    const uint64_t m =
+        ((w - FIO___HTTP1_SWAR_ONES * 0x20U) & ~w) & FIO___HTTP1_SWAR_80;
+    if (m)
+      return pos + (fio_lsb_index_unsafe(m) >> 3);
+  }
+  return pos;
+#endif
+}
+
+/* Lower-cases and skips `[A-Za-z0-9-]` blocks, stops at 8 bytes to `end`. */
+FIO_IFUNC char *fio___http1_skip_name(char *pos, char *end) {
+#if FIO___HAS_X86_AVX2
+  for (; pos + 32 <= end; pos += 32) {
+    const __m256i v = _mm256_loadu_si256((const __m256i *)pos);
+    __m256i t = _mm256_sub_epi8(v, _mm256_set1_epi8('A'));
+    __m256i up = _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(25)), t);
+    const __m256i l =
+        _mm256_or_si256(v, _mm256_and_si256(up, _mm256_set1_epi8(32)));
+    __m256i ok;
+    uint32_t m;
+    t = _mm256_sub_epi8(l, _mm256_set1_epi8('a'));
+    ok = _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(25)), t);
+    t = _mm256_sub_epi8(l, _mm256_set1_epi8('0'));
+    ok = _mm256_or_si256(
+        ok,
+        _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(9)), t));
+    ok = _mm256_or_si256(ok, _mm256_cmpeq_epi8(l, _mm256_set1_epi8('-')));
+    m = ~(uint32_t)_mm256_movemask_epi8(ok);
+    if (m) { /* write the name only, as the next scan reads the rest */
+      const size_t k = fio_lsb_index_unsafe((uint64_t)m);
+      if ((uint32_t)_mm256_movemask_epi8(up) & ((1UL << k) - 1)) {
+        char tmp[32];
+        _mm256_storeu_si256((__m256i *)tmp, l);
+        fio_memcpy31x(pos, tmp, k);
+      }
+      return pos + k;
+    }
+    if (_mm256_movemask_epi8(up))
+      _mm256_storeu_si256((__m256i *)pos, l);
+  }
+#endif
+#if FIO___HAS_X86_SSE2
+  for (; pos + 16 <= end; pos += 16) {
+    const __m128i v = _mm_loadu_si128((const __m128i *)pos);
+    __m128i t = _mm_sub_epi8(v, _mm_set1_epi8('A'));
+    __m128i up = _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(25)), t);
+    const __m128i l = _mm_or_si128(v, _mm_and_si128(up, _mm_set1_epi8(32)));
+    __m128i ok;
+    uint32_t m;
+    t = _mm_sub_epi8(l, _mm_set1_epi8('a'));
+    ok = _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(25)), t);
+    t = _mm_sub_epi8(l, _mm_set1_epi8('0'));
+    ok = _mm_or_si128(ok, _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(9)), t));
+    ok = _mm_or_si128(ok, _mm_cmpeq_epi8(l, _mm_set1_epi8('-')));
+    m = ~(uint32_t)_mm_movemask_epi8(ok) & 0xFFFFU;
+    if (m) { /* lower-case the name only, the rest of the block is unchanged */
+      const size_t k = fio_lsb_index_unsafe((uint64_t)m);
+      const __m128i idx =
+          _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+      up = _mm_and_si128(up, _mm_cmpgt_epi8(_mm_set1_epi8((char)k), idx));
+      if (_mm_movemask_epi8(up))
+        _mm_storeu_si128((__m128i *)pos,
+                         _mm_or_si128(v, _mm_and_si128(up, _mm_set1_epi8(32))));
+      return pos + k;
+    }
+    if (_mm_movemask_epi8(up))
+      _mm_storeu_si128((__m128i *)pos, l);
+  }
+#elif FIO___HAS_ARM_NEON
+  for (; pos + 16 <= end; pos += 16) {
+    const uint8x16_t v = vld1q_u8((const uint8_t *)pos);
+    uint8x16_t up = vcleq_u8(vsubq_u8(v, vdupq_n_u8('A')), vdupq_n_u8(25));
+    const uint8x16_t l = vorrq_u8(v, vandq_u8(up, vdupq_n_u8(32)));
+    uint8x16_t ok =
+        vorrq_u8(vcleq_u8(vsubq_u8(l, vdupq_n_u8('a')), vdupq_n_u8(25)),
+                 vcleq_u8(vsubq_u8(l, vdupq_n_u8('0')), vdupq_n_u8(9)));
+    uint64_t m;
+    ok = vorrq_u8(ok, vceqq_u8(l, vdupq_n_u8('-')));
+    /* narrow to 4 bits per byte, so the result fits a 64 bit word */
+    m = ~vget_lane_u64(
+        vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(ok), 4)),
+        0);
+    if (m) { /* write the name only, as the next scan reads the rest */
+      const size_t k = fio_lsb_index_unsafe(m) >> 2;
+      char tmp[16];
+      vst1q_u8((uint8_t *)tmp, l);
+      fio_memcpy15x(pos, tmp, k);
+      return pos + k;
+    }
+    vst1q_u8((uint8_t *)pos, l);
+  }
+#endif
+  for (; pos + 8 <= end; pos += 8) {
+    /* ASCII bytes only (high bit clear), so the ranges never carry over */
+    const uint64_t w = fio_buf2u64_le(pos);
+    const uint64_t ascii = ~w & FIO___HTTP1_SWAR_80;
+    const uint64_t up =
+        FIO___HTTP1_SWAR_RANGE(w & FIO___HTTP1_SWAR_7F, 'A', 'Z') & ascii;
+    const uint64_t h = (w | (up >> 2)) & FIO___HTTP1_SWAR_7F;
+    const uint64_t d = h ^ (FIO___HTTP1_SWAR_ONES * '-');
+    const uint64_t ok =
+        (FIO___HTTP1_SWAR_RANGE(h, 'a', 'z') |
+         FIO___HTTP1_SWAR_RANGE(h, '0', '9') | ~(d + FIO___HTTP1_SWAR_7F)) &
+        ascii;
+    if (ok != FIO___HTTP1_SWAR_80) { /* write the name only */
+      const size_t k = fio_lsb_index_unsafe(~ok & FIO___HTTP1_SWAR_80) >> 3;
+      if (up & ((1ULL << (k << 3)) - 1)) {
+        char tmp[8];
+        fio_u2buf64_le(tmp, w | (up >> 2));
+        fio_memcpy7x(pos, tmp, k);
+      }
+      return pos + k;
+    }
+    if (up)
+      fio_u2buf64_le(pos, w | (up >> 2));
+  }
+  return pos;
+}
+
+#undef FIO___HTTP1_SWAR_RANGE
+#undef FIO___HTTP1_SWAR_80
+#undef FIO___HTTP1_SWAR_7F
+#undef FIO___HTTP1_SWAR_ONES
+
+/*
+ * Seeks the end of the line, testing for control characters (except HTAB).
+ *
+ * Returns the EOL (the first `\r` or `\n`) and sets `next` to the next line.
+ *
+ * Returns NULL if the line is incomplete or `end` if the line is invalid.
+ */
+FIO_IFUNC char *fio_http1___seek_eol(char *pos, char *end, char **next) {
+  for (;;) {
+    pos = fio___http1_skip_text(pos, end);
+    if (pos == end)
+      return NULL;
+    if ((uint8_t)pos[0] < 0x20U && pos[0] != '\t')
+      break;
+    ++pos;
+  }
+  if (pos[0] == '\n') {
+    *next = pos + 1;
+    return pos;
+  }
+  if (pos[0] != '\r')
+    return end;
+  if (pos + 1 == end)
+    return NULL;
+  if (pos[1] != '\n')
+    return end;
+  *next = pos + 2;
+  return pos;
+}
+
+/* returns either a lower case (ASCII) or the original char. */
+FIO_IFUNC uint8_t fio_http1_tolower(uint8_t c) {
+  c |= (uint8_t)((uint8_t)(c - 'A') < 26U) << 5;
+  return c;
+}
+
+/*
+ * Seeks the ':' divisor while testing and converting the name to downcase.
+ *
+ * The line's (`\r` or `\n`) EOL must be found before `end`, as it stops the
+ * scan. Blocks are scanned up to `end`, so short lines still use whole blocks.
+ */
+FIO_IFUNC char *fio_http1___seek_header_div(char *pos, char *end) {
+  /* this is the subset of the forbidden chars that allows UTF-8 headers */
+  static const _Bool forbidden_name_chars[256] = {
+      1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+      1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 0, 0, 0, 0, 0, 1, 1, 0, 0, 1, 0, 0, 1,
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 1, 0, 1, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+  for (;;) { /* the `eol` byte is always forbidden, stopping the loop */
+    const uint8_t c =
+        fio_http1_tolower((uint8_t)(pos = fio___http1_skip_name(pos, end))[0]);
+    if (FIO_UNLIKELY(forbidden_name_chars[c]))
+      return pos;
+    *(pos++) = (char)c;
+  }
+}
+
 /* *****************************************************************************
 Reading the first line
 ***************************************************************************** */
@@ -36555,27 +39796,29 @@ static int fio_http1___start(fio_http1_parser_s *p,
                              void *udata) {
   /* find line start/end and test */
   char *start = buf->buf;
+  char *end = buf->buf + buf->len;
   char *tmp;
-  while ((start[0] == ' ' || start[0] == '\r' || start[0] == '\n') &&
-         start < buf->buf + buf->len) /* skip white space */
-    ++start;
-  if (start == buf->buf + buf->len) {
+  char *eol;
+  while (start < end &&
+         (start[0] == ' ' || start[0] == '\r' || start[0] == '\n'))
+    ++start; /* skip white space */
+  if (start == end) {
     buf->buf = start;
     return 1;
   }
-  char *eol = (char *)FIO_MEMCHR(start, '\n', buf->len);
-  if (!eol)
+  if (!(eol = fio_http1___seek_eol(start, end, &tmp)))
     return 1;
-  if (start + 13 > eol) /* test for minimal data GET HTTP/1 or ### HTTP/1 */
+  if (eol == end)
+    return -1;
+  if (start + 12 > eol) /* test for minimal data GET / HTTP/1 or ### HTTP/1 */
     return -1;
 
   /* prep next stage */
-  buf->len -= (eol - buf->buf) + 1;
-  buf->buf = eol + 1;
-  eol -= eol[-1] == '\r';
+  buf->len -= tmp - buf->buf;
+  buf->buf = tmp;
 
-  /* parse first line */
-  if (start[0] > ('0' - 1) && start[0] < ('9' + 1))
+  /* parse first line (a response starts with the version, i.e., "HTTP/") */
+  if (fio_buf2u32u(start) == fio_buf2u32u("HTTP") && start[4] == '/')
     goto parse_response_line;
   /* request: method path version */
   if (!(tmp = (char *)FIO_MEMCHR(start, ' ', (size_t)(eol - start))))
@@ -36597,21 +39840,28 @@ static int fio_http1___start(fio_http1_parser_s *p,
     return -1;
   return (p->fn = fio_http1___read_header)(p, buf, udata);
 
-parse_response_line:
-  /* response: version code text */
+parse_response_line: {
+  /* response: version code text (the status callback comes first) */
+  fio_buf_info_s version;
+  size_t status;
   if (!(tmp = (char *)FIO_MEMCHR(start, ' ', eol - start)))
     return -1;
-  if (fio_http1_on_version(FIO_BUF_INFO2(start, (size_t)(tmp - start)), udata))
+  version = FIO_BUF_INFO2(start, (size_t)(tmp - start));
+  start = tmp = tmp + 1;
+  status = (size_t)fio_atol10u(&tmp);
+  if (status < 100 || status > 999 || tmp != start + 3 ||
+      (tmp != eol && *tmp != ' '))
     return -1;
-  start = tmp + 1;
-  if (!(tmp = (char *)FIO_MEMCHR(start, ' ', eol - start)))
-    return -1;
-  if (fio_http1_on_status(fio_atol10(&start),
-                          FIO_BUF_INFO2((tmp + 1), (size_t)(eol - tmp)),
+  tmp += (tmp != eol); /* the reason phrase may be empty */
+  if (fio_http1_on_status(status,
+                          FIO_BUF_INFO2(tmp, (size_t)(eol - tmp)),
                           udata))
     return -1;
+  if (fio_http1_on_version(version, udata))
+    return -1;
   return (p->fn = fio_http1___read_header)(p, buf, udata);
 }
+}
 
 /* *****************************************************************************
 Reading Headers
@@ -36637,7 +39887,7 @@ static inline int fio_http1___on_header(fio_http1_parser_s *p,
       uint64_t clen = fio_atol10u(&tmp);
       if (tmp != value.buf + value.len)
         return -1;
-      if (p->expected)
+      if (p->expected && p->expected != HTTP1___EXPECTED_UNTIL_CLOSE)
         return 0 - (p->expected != clen);
       p->expected = clen;
       return 0 -
@@ -36652,7 +39902,8 @@ static inline int fio_http1___on_header(fio_http1_parser_s *p,
       char *c_start = value.buf + value.len - 7;
       if ((fio_buf2u32u(c_start) | 0x20202020UL) == fio_buf2u32u("chun") &&
           (fio_buf2u32u(c_start + 3) | 0x20202020UL) == fio_buf2u32u("nked")) {
-        if (p->expected && p->expected != HTTP1___EXPECTED_CHUNKED)
+        if (p->expected && p->expected != HTTP1___EXPECTED_CHUNKED &&
+            p->expected != HTTP1___EXPECTED_UNTIL_CLOSE)
           return -1;
         p->expected = HTTP1___EXPECTED_CHUNKED;
         /* endpoint does not need to know if the body was chunked or not */
@@ -36704,36 +39955,6 @@ static inline int fio_http1___on_trailer(fio_http1_parser_s *p,
   return fio_http1_on_header(name, value, udata);
 }
 
-/* returns either a lower case (ASCI) or the original char. */
-static uint8_t fio_http1_tolower(uint8_t c) {
-  if ((c - ((uint8_t)'A' - 1U)) < ((uint8_t)'Z' - (uint8_t)'A'))
-    c |= 32;
-  return c;
-}
-
-/* seeks to the ':' divisor while testing and converting to downcase. */
-static char *fio_http1___seek_header_div(char *p) {
-  /* this is the subset of the forbidden chars that allows UTF-8 headers */
-  static const _Bool forbidden_name_chars[256] = {
-      1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-      1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 0, 0, 0, 0, 0, 1, 1, 0, 0, 1, 0, 0, 1,
-      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0,
-      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 0, 0,
-      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-      0, 0, 0, 1, 0, 1, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-  for (;;) {
-    *p = (char)fio_http1_tolower((uint8_t)(*p));
-    ++p;
-    if (FIO_UNLIKELY(forbidden_name_chars[((uint8_t)(*p))]))
-      return p;
-  }
-}
-
 /* extract header name and value from a line and pass info to handler */
 static inline int fio_http1___read_header_line(
     fio_http1_parser_s *p,
@@ -36746,6 +39967,7 @@ static inline int fio_http1___read_header_line(
   int r;
   for (;;) {
     char *start = buf->buf;
+    char *end = start + buf->len;
     char *eol = (char *)FIO_MEMCHR(start, '\n', buf->len);
     char *div;
     fio_buf_info_s name, value;
@@ -36758,8 +39980,8 @@ static inline int fio_http1___read_header_line(
     if (FIO_UNLIKELY(eol == start))
       goto headers_finished;
 
-    div = fio_http1___seek_header_div(start);
-    if (div[0] != ':')
+    div = fio_http1___seek_header_div(start, end);
+    if (div[0] != ':' || div == start)
       return -1;
     name = FIO_BUF_INFO2(start, (size_t)(div - start));
     do {
@@ -36778,6 +40000,7 @@ static inline int fio_http1___read_header_line(
 headers_finished:
   p->fn = (!p->expected)         ? fio_http1___finish
           : (!(p->expected + 1)) ? fio_http1___read_body_chunked
+          : (!(p->expected + 2)) ? fio_http1___read_body_until_close
                                  : fio_http1___read_body;
   return p->fn(p, buf, udata);
 }
@@ -36821,6 +40044,28 @@ static int fio_http1___read_body(fio_http1_parser_s *p,
   return 1;
 }
 
+/* parsing stage 2 - read body until the connection closes (responses). */
+static int fio_http1___read_body_until_close(fio_http1_parser_s *p,
+                                             fio_buf_info_s *buf,
+                                             void *udata) {
+  (void)p;
+  if (!buf->len)
+    return 1;
+  if (fio_http1_on_body_chunk(*buf, udata))
+    return -1;
+  buf->buf += buf->len;
+  buf->len = 0;
+  return 1;
+}
+
+/** Completes a response read until the connection closed (EOF). */
+FIO_SFUNC int fio_http1_parse_eof(fio_http1_parser_s *p, void *udata) {
+  if (p->fn != fio_http1___read_body_until_close)
+    return -1;
+  fio_http1___finish(p, NULL, udata);
+  return 0;
+}
+
 /* *****************************************************************************
 Reading the Body (chunked)
 ***************************************************************************** */
@@ -36963,6 +40208,20 @@ FIO_SFUNC void fio_websocket_on_message(void *udata,
                                         fio_buf_info_s msg,
                                         unsigned char is_text);
 
+/**
+ * Called with each (unmasked) chunk of a streamed message.
+ *
+ * Messages are only streamed if the parser's `stream` flag is set (compressed
+ * messages are never streamed). A chunk may be empty only if `is_last` is set.
+ *
+ * Return -1 to stop parsing (i.e., invalid UTF-8 data), otherwise return 0.
+ */
+FIO_SFUNC int fio_websocket_on_message_partial(void *udata,
+                                               fio_buf_info_s chunk,
+                                               unsigned char is_text,
+                                               unsigned char is_first,
+                                               unsigned char is_last);
+
 /**
  * Called when the parser needs to copy the message to an external buffer.
  *
@@ -37083,20 +40342,20 @@ FIO_IFUNC uint64_t fio_websocket_header(void *target,
   ((uint8_t *)target)[1] = ((!!mask) << 7U);
   size_t mask_l = ((!!mask) << 2);
   if (message_len < 126) {
-    ((uint8_t *)target)[1] = message_len;
+    ((uint8_t *)target)[1] |= message_len;
     if (mask)
       fio_u2buf32u(((uint8_t *)target + 2), mask);
     return 2 + mask_l;
   } else if (message_len < (1UL << 16)) {
     /* head is 4 bytes */
-    ((uint8_t *)target)[1] = 126;
+    ((uint8_t *)target)[1] |= 126;
     fio_u2buf16_be(((uint8_t *)target + 2), message_len);
     if (mask)
       fio_u2buf32u(((uint8_t *)target + 4), mask);
     return 4 + mask_l;
   } else {
     /* Really Long Message  */
-    ((uint8_t *)target)[1] = 127;
+    ((uint8_t *)target)[1] |= 127;
     fio_u2buf64_be(((uint8_t *)target + 2), message_len);
     if (mask)
       fio_u2buf32u(((uint8_t *)target + 10), mask);
@@ -37191,6 +40450,9 @@ struct fio_websocket_parser_s {
   uint8_t first;
   uint8_t current;
   uint8_t must_mask;
+  uint8_t stream;    /* set to stream data messages (see on_message_partial) */
+  uint8_t streaming; /* the current message is streamed */
+  uint8_t started;   /* the streamed message's first chunk was delivered */
 };
 
 /* *****************************************************************************
@@ -37222,7 +40484,7 @@ FIO_SFUNC int fio___websocket_consume_frame_finish(fio_websocket_parser_s *p,
   fio_xmask(msg.buf + p->start_at,
             msg.len - p->start_at,
             (((uint64_t)p->mask) << 32) | (uint64_t)p->mask);
-  p->start_at += msg.len;
+  p->start_at = msg.len; /* `msg` is the whole message (all fragments) */
   p->fn = fio___websocket_consume_header;
   if (!(p->current & 128)) /* done? if not, consume next frame */
     return 0;
@@ -37233,11 +40495,18 @@ FIO_SFUNC int fio___websocket_consume_frame_finish(fio_websocket_parser_s *p,
       return -1;
   }
   size_t cond = (p->first & 15);
-  *p = (fio_websocket_parser_s){.fn = fio___websocket_consume_header};
+  *p = (fio_websocket_parser_s){.fn = fio___websocket_consume_header,
+                                .stream = p->stream};
   switch (cond) {
   case 0: return -1;         /* continuation - error? */
   case 1: /* fall through */ /* text / data frame */
-  case 2: fio_websocket_on_message(udata, msg, (cond & 1)); return 1;
+  case 2:
+    if (p->stream) /* compressed messages are streamed as a single chunk */
+      return fio_websocket_on_message_partial(udata, msg, (cond & 1), 1, 1)
+                 ? -1
+                 : 1;
+    fio_websocket_on_message(udata, msg, (cond & 1));
+    return 1;
   case 8: fio_websocket_on_protocol_close(udata, msg); return 1;
   case 9: fio_websocket_on_protocol_ping(udata, msg); return 1;
   case 10: fio_websocket_on_protocol_pong(udata, msg); return 1;
@@ -37249,9 +40518,50 @@ FIO_SFUNC int fio___websocket_consume_frame_finish(fio_websocket_parser_s *p,
   return 1;
 }
 
+FIO_SFUNC int fio___websocket_consume_frame_stream(fio_websocket_parser_s *p,
+                                                   fio_buf_info_s *buf,
+                                                   void *udata) {
+  fio_buf_info_s chunk =
+      FIO_BUF_INFO2(buf->buf, (p->expect > buf->len ? buf->len : p->expect));
+  unsigned char is_last;
+  buf->buf += chunk.len;
+  buf->len -= chunk.len;
+  p->expect -= chunk.len;
+  if (p->mask) { /* unmask and rotate the mask for the frame's next byte */
+    char m[8];
+    fio_xmask(chunk.buf,
+              chunk.len,
+              (((uint64_t)p->mask) << 32) | (uint64_t)p->mask);
+    fio_u2buf32u(m, p->mask);
+    fio_u2buf32u(m + 4, p->mask);
+    p->mask = fio_buf2u32u(m + (chunk.len & 3));
+  }
+  is_last = (!p->expect && (p->current & 128));
+  if (chunk.len || is_last) {
+    if (fio_websocket_on_message_partial(udata,
+                                         chunk,
+                                         ((p->first & 15) == 1),
+                                         !p->started,
+                                         is_last))
+      return -1;
+    p->started = 1;
+  }
+  if (p->expect)
+    return 1; /* wait for more data */
+  if (!is_last) { /* consume the next frame */
+    p->fn = fio___websocket_consume_header;
+    return 0;
+  }
+  *p = (fio_websocket_parser_s){.fn = fio___websocket_consume_header,
+                                .stream = p->stream};
+  return 1;
+}
+
 FIO_SFUNC int fio___websocket_consume_frame(fio_websocket_parser_s *p,
                                             fio_buf_info_s *buf,
                                             void *udata) {
+  if (p->streaming)
+    return fio___websocket_consume_frame_stream(p, buf, udata);
   return (p->expect > buf->len
               ? fio___websocket_consume_frame_partial
               : fio___websocket_consume_frame_finish)(p, buf, udata);
@@ -37308,6 +40618,9 @@ FIO_SFUNC int fio___websocket_consume_header(fio_websocket_parser_s *p,
     p->start_at = 0;
     if (!(info & 15)) /* continuation frame == 0 ; where's the first? */
       return -1;
+    /* stream uncompressed text / binary messages (if requested) */
+    p->streaming = p->stream && !(info & 64) &&
+                   ((info & 15) == 1 || (info & 15) == 2);
   }
   if (p->must_mask && !p->mask)
     return -1;
@@ -37386,6 +40699,18 @@ HTTP Setting Defaults
 #ifndef FIO_HTTP_DEFAULT_TIMEOUT_LONG
 #define FIO_HTTP_DEFAULT_TIMEOUT_LONG 50
 #endif
+#ifndef FIO_HTTP_DEFAULT_HEADER_TIMEOUT
+/** The default `header_timeout`, in seconds (0 == disabled). */
+#define FIO_HTTP_DEFAULT_HEADER_TIMEOUT 0
+#endif
+#ifndef FIO_HTTP_DEFAULT_MIN_BODY_RATE
+/** The default `min_body_rate`, in bytes per second (0 == disabled). */
+#define FIO_HTTP_DEFAULT_MIN_BODY_RATE 0
+#endif
+#ifndef FIO_HTTP_BODY_RATE_WINDOW
+/** The request body upload rate is measured once every this many seconds. */
+#define FIO_HTTP_BODY_RATE_WINDOW 10
+#endif
 
 #ifndef FIO_HTTP_SHOW_CONTENT_LENGTH_HEADER
 /** Adds a "content-length" header to the HTTP handle (usually redundant). */
@@ -37402,12 +40727,78 @@ HTTP Setting Defaults
 #define FIO_WEBSOCKET_STATS 0
 #endif
 
+#ifndef FIO_HTTP_PIPELINE_COPY_LIMIT
+/** Pipelined responses shorter than this are copied and sent as one batch. */
+#define FIO_HTTP_PIPELINE_COPY_LIMIT 16384
+#endif
+
+#ifndef FIO_HTTP_CHUNK_COPY_LIMIT
+/** Streamed response chunks shorter than this are framed in a single copy. */
+#define FIO_HTTP_CHUNK_COPY_LIMIT 16384
+#endif
+
+#ifndef FIO_HTTP_BODY_STREAM_LIMIT
+/** Streamed request body data is delivered once this many bytes are read. */
+#define FIO_HTTP_BODY_STREAM_LIMIT (1UL << 16)
+#endif
+
+#ifndef FIO_HTTP_WEBSOCKET_DEFLATE_WINDOW_BITS
+/**
+ * The deflate window (log2, 9..15) for compressed outgoing WebSocket messages.
+ *
+ * Larger windows compress better, but require more memory per connection.
+ */
+#define FIO_HTTP_WEBSOCKET_DEFLATE_WINDOW_BITS 13
+#endif
+
+#ifndef FIO_HTTP_CLIENT_MAX_CONNECTIONS
+/** The default maximum number of client connections per host. */
+#define FIO_HTTP_CLIENT_MAX_CONNECTIONS 8
+#endif
+
+#ifndef FIO_HTTP_READ_BUFFER_POOL_LIMIT
+/**
+ * The maximum number of idle read buffers kept for reuse (per listener).
+ *
+ * Connections only borrow a read buffer (of `max_line_len` bytes) while data
+ * is pending, so idle connections don't hold a buffer.
+ */
+#define FIO_HTTP_READ_BUFFER_POOL_LIMIT 64
+#endif
+
 /* *****************************************************************************
 HTTP Listen
 ***************************************************************************** */
+
+/** An HTTP router, see `fio_http_router_new`. */
+typedef struct fio_http_router_s fio_http_router_s;
+
 typedef struct fio_http_settings_s {
   /** Callback for HTTP requests (server) or responses (client). */
   void (*on_http)(fio_http_s *h);
+  /**
+   * (optional) Streams request bodies (server only) instead of storing them.
+   *
+   * When set, the request body is never stored by the HTTP handle (neither in
+   * memory nor in a temporary file). Instead, `on_body_chunk` is called (using
+   * the same task queue as `on_http`) for each chunk of body data, in order,
+   * and `on_http` is called once the whole body was received (the handle's
+   * body will be empty).
+   *
+   * The connection stops reading while a chunk is being handled, so slow
+   * consumers throttle the client rather than buffer the upload.
+   *
+   * If the connection is lost mid-body, `on_http` is never called.
+   *
+   * A response may be sent early, by finishing the handle from `on_body_chunk`
+   * (i.e., to reject an upload), in which case `on_http` is never called. If
+   * the body wasn't fully received, the rest of it is never read and the
+   * connection is closed once the response was sent. When pipelining, such
+   * responses are discarded if responses to previous requests are pending.
+   *
+   * Form data can be parsed as it arrives using `fio_http_form_parse`.
+   */
+  void (*on_body_chunk)(fio_http_s *h, fio_buf_info_s chunk);
   /** (optional) the callback to be performed when the HTTP service closes. */
   void (*on_finish)(struct fio_http_settings_s *settings);
 
@@ -37421,6 +40812,19 @@ typedef struct fio_http_settings_s {
 
   /** Called when a WebSocket message is received. */
   void (*on_message)(fio_http_s *h, fio_buf_info_s msg, uint8_t is_text);
+  /**
+   * (optional) Streams WebSocket messages, called for each chunk as it arrives.
+   *
+   * If set, `on_message` is never called for WebSocket messages, which are not
+   * collected in memory (except compressed messages, delivered as one chunk).
+   *
+   * Text is UTF-8 validated, a code point may be split between chunks.
+   */
+  void (*on_message_partial)(fio_http_s *h,
+                             fio_buf_info_s chunk,
+                             uint8_t is_text,
+                             uint8_t is_first,
+                             uint8_t is_last);
   /** Called when an EventSource event is received. */
   void (*on_eventsource)(fio_http_s *h,
                          fio_buf_info_s id,
@@ -37444,11 +40848,22 @@ typedef struct fio_http_settings_s {
   fio_tls_s *tls;
   /** Optional HTTP task queue (for multi-threading HTTP responses) */
   fio_srv_async_s *queue;
+  /**
+   * (optional) Routes requests by method and path (see `fio_http_route`).
+   *
+   * Requests that match no route are handled by `on_http`. The listener keeps
+   * its own reference, so the router may be freed once `fio_http_listen`
+   * returns.
+   */
+  fio_http_router_s *router;
   /**
    * A public folder for file transfers - allows to circumvent any application
    * layer logic and simply serve static files.
    *
    * Supports automatic `gz` pre-compressed alternatives.
+   *
+   * Resolved files are cached (small files are kept in memory) and
+   * re-validated every `FIO_HTTP_STATIC_CACHE_TTL` seconds.
    */
   fio_str_info_s public_folder;
   /**
@@ -37458,6 +40873,57 @@ typedef struct fio_http_settings_s {
    * Defaults to 0 (not sent).
    */
   size_t max_age;
+  /**
+   * Pre-rendered header lines sent with every HTTP/1.1 response, i.e.:
+   *
+   *     .static_headers = FIO_STR_INFO1("server:facil.io\r\n")
+   *
+   * Each line MUST end with CRLF. The data is copied.
+   *
+   * This is faster than setting the same headers for every response, but the
+   * headers will not be visible using `fio_http_response_header`.
+   */
+  fio_str_info_s static_headers;
+  /**
+   * Opt-in response (micro) cache for `GET` requests, see `fio_http_cache`.
+   *
+   * Responses are cached for `cache_ttl` seconds, keyed by the request's path,
+   * query and the request headers listed in `cache_vary`. Concurrent requests
+   * for the same resource wait for a single handler to respond.
+   *
+   * Defaults to 0 (disabled).
+   */
+  uint32_t cache_ttl;
+  /**
+   * Request header names (comma separated, lower case) that are part of the
+   * response cache key (i.e., "accept-language,x-tenant").
+   *
+   * The data is copied.
+   */
+  fio_str_info_s cache_vary;
+  /**
+   * Opt-in dynamic response compression (gzip / deflate), requires zlib.
+   *
+   * Responses at least `compress_min` bytes long, with a `content-type` listed
+   * in `compress_types`, are compressed when the client's `accept-encoding`
+   * allows it. Streamed responses are always compressed (when allowed).
+   * Compressed responses are cached by ETag. Responses sent from a file (i.e.,
+   * static files) are never compressed dynamically.
+   *
+   * Defaults to 0 (disabled).
+   */
+  size_t compress_min;
+  /**
+   * A comma separated list of compressible `content-type` values, i.e.:
+   *
+   *     .compress_types = FIO_STR_INFO1("text/,application/json,+xml")
+   *
+   * Entries ending with `/` match a type prefix, entries starting with `+`
+   * match a suffix and other entries must match the type exactly.
+   *
+   * Defaults to `FIO_HTTP_COMPRESS_TYPES`. The data is copied.
+   */
+  fio_str_info_s compress_types;
   /**
    * The maximum total of bytes for the overall size of the request string and
    * headers, combined.
@@ -37480,12 +40946,41 @@ typedef struct fio_http_settings_s {
   /**
    * The maximum websocket message size/buffer (in bytes) for Websocket
    * connections. Defaults to FIO_HTTP_DEFAULT_WS_MAX_MSG_SIZE bytes.
+   *
+   * Uncompressed messages streamed by `on_message_partial` aren't limited.
    */
   size_t ws_max_msg_size;
+  /**
+   * Opt-in WebSocket compression (permessage-deflate, RFC 7692), requires zlib.
+   *
+   * When set, the extension is accepted when offered by the client and
+   * outgoing messages at least `ws_compress_min` bytes long are compressed.
+   *
+   * Defaults to 0 (disabled).
+   */
+  size_t ws_compress_min;
   /** reserved for future use. */
   intptr_t reserved1;
   /** reserved for future use. */
   intptr_t reserved2;
+  /**
+   * The minimal upload rate (in bytes per second) for request bodies, measured
+   * once every FIO_HTTP_BODY_RATE_WINDOW seconds. Slower clients are
+   * disconnected. Time spent waiting for the server (i.e., while a streamed
+   * body chunk is handled) isn't counted.
+   *
+   * Defaults to FIO_HTTP_DEFAULT_MIN_BODY_RATE (0, disabled).
+   */
+  uint32_t min_body_rate;
+  /**
+   * The maximum number of concurrent connections per client IP address.
+   * Further connections from the same address are closed once accepted.
+   *
+   * Connections are counted per worker process.
+   *
+   * Defaults to 0 (no limit).
+   */
+  uint32_t max_clients_per_ip;
   /**
    * An HTTP/1.x connection timeout.
    *
@@ -37494,6 +40989,16 @@ typedef struct fio_http_settings_s {
    * Note: the connection might be closed (by other side) before timeout occurs.
    */
   uint8_t timeout;
+  /**
+   * The time (in seconds) a client has to send a complete request head (the
+   * request line and headers), measured from the request's first byte.
+   *
+   * Unlike `timeout`, this deadline isn't extended when data arrives, so
+   * clients trickling a request (i.e., "slowloris") are disconnected.
+   *
+   * Defaults to FIO_HTTP_DEFAULT_HEADER_TIMEOUT (0, disabled).
+   */
+  uint8_t header_timeout;
   /**
    * Timeout for the WebSocket connections, a ping will be sent whenever the
    * timeout is reached. Defaults to FIO_HTTP_DEFAULT_TIMEOUT_LONG seconds.
@@ -37510,6 +41015,23 @@ typedef struct fio_http_settings_s {
    * fails).
    */
   uint8_t sse_timeout;
+  /**
+   * If set, WebSocket compression doesn't retain its context between messages
+   * (`server_no_context_takeover` and `client_no_context_takeover`).
+   *
+   * This lowers the compression ratio, but compression memory is only used
+   * while a message is processed, rather than for the connection's lifetime.
+   */
+  uint8_t ws_no_context_takeover;
+  /**
+   * The number of pipelined HTTP/1.1 requests that may be handled concurrently
+   * per connection.
+   *
+   * Responses are sequenced in request order and sent in batches.
+   *
+   * Defaults to 0 (requests are handled one at a time).
+   */
+  uint8_t pipeline;
   /** Logging flag - set to TRUE to log HTTP requests. */
   uint8_t log;
 } fio_http_settings_s;
@@ -37531,6 +41053,151 @@ SFUNC fio_s *fio_http_io(fio_http_s *);
 #define fio_http_subscribe(h, ...)                                             \
   fio_subscribe(.io = fio_http_io(h), __VA_ARGS__)
 
+/* *****************************************************************************
+HTTP Router - Method and Path Dispatch
+***************************************************************************** */
+
+/** Per-route settings, see `fio_http_route`. */
+typedef struct {
+  /** Callback for requests matching the route (required). */
+  void (*on_http)(fio_http_s *h);
+  /** (optional) Opaque user data, replaces the listener's `udata`. */
+  void *udata;
+  /** (optional) The task queue for `on_http`, replaces the listener's. */
+  fio_srv_async_s *queue;
+  /** (optional) The maximum body size, replaces the listener's. */
+  size_t max_body_size;
+  /** (optional) Response cache TTL in seconds, replaces the listener's. */
+  uint32_t cache_ttl;
+  /** (optional) Request headers that vary cached responses (copied). */
+  fio_str_info_s cache_vary;
+} fio_http_route_s;
+
+/** Creates a new (empty) HTTP router. */
+SFUNC fio_http_router_s *fio_http_router_new(void);
+
+/** Reduces a router's reference count or frees it. */
+SFUNC void fio_http_router_free(fio_http_router_s *);
+
+/** Increases a router's reference count. */
+SFUNC fio_http_router_s *fio_http_router_dup(fio_http_router_s *);
+
+/**
+ * Adds a route to the router, replacing any existing route with the same
+ * method and pattern.
+ *
+ * The `method` is case sensitive (i.e., "GET"). If `method` is NULL or empty,
+ * the route accepts any method not routed explicitly.
+ *
+ * The `pattern` is a path that may contain parameter segments:
+ *
+ * - `:name` matches a single (non-empty) path segment, i.e., "/users/:id".
+ *
+ * - `*name` matches the rest of the path (may be empty) and must be the last
+ *   segment, i.e., "/files/" followed by "*path".
+ *
+ * Static segments take precedence over `:name` segments, which take
+ * precedence over `*name` segments.
+ *
+ * Routes are compiled into a radix tree, so matching is performed in a single
+ * pass over the path (O(path length)) and without allocating memory.
+ *
+ * Routes should be added before the server starts (the router isn't
+ * thread-safe).
+ *
+ * Returns -1 on error (i.e., invalid pattern or conflicting parameter names).
+ */
+SFUNC int fio_http_route(fio_http_router_s *router,
+                         const char *method,
+                         const char *pattern,
+                         fio_http_route_s route);
+
+/** Adds a route to the router, see `fio_http_route_s`. */
+#define fio_http_route(router, method, pattern, ...)                           \
+  fio_http_route((router), (method), (pattern), (fio_http_route_s){__VA_ARGS__})
+
+/**
+ * Returns the route matching the HTTP handle's method and path (or NULL).
+ *
+ * Captured path parameters are set on the handle (see `fio_http_param`).
+ * Parameter values are views into the (raw, undecoded) path.
+ *
+ * Note: this is performed automatically for listeners with a `router`.
+ */
+SFUNC fio_http_route_s *fio_http_router_match(fio_http_router_s *router,
+                                              fio_http_s *h);
+
+/* *****************************************************************************
+HTTP Client - Pooled (Keep-Alive) Connections
+***************************************************************************** */
+
+/** Named arguments for the `fio_http_request` function. */
+typedef struct {
+  /**
+   * Called (on a worker thread) once the response was received.
+   *
+   * The response's status is 0 if the request failed (no response available).
+   *
+   * The HTTP handle is freed once the callback returns, unless `fio_http_dup`
+   * was called.
+   */
+  void (*on_response)(fio_http_s *h);
+  /** Opaque user data, available using `fio_http_udata(h)`. */
+  void *udata;
+  /** The request method, defaults to "GET" (or "POST" if a body is set). */
+  fio_str_info_s method;
+  /** Additional request headers - each header line MUST end with CRLF. */
+  fio_str_info_s headers;
+  /** The request body (copied). */
+  fio_str_info_s body;
+  /** TLS settings for `https` requests (used when the pool is created). */
+  fio_tls_s *tls;
+  /** Maximum response body size, defaults to the HTTP server's default. */
+  size_t max_body_size;
+  /** Maximum connections to the host, see FIO_HTTP_CLIENT_MAX_CONNECTIONS. */
+  uint16_t max_connections;
+  /** Connection timeout in seconds, defaults to FIO_HTTP_DEFAULT_TIMEOUT. */
+  uint8_t timeout;
+  /**
+   * The number of requests that may be pipelined on a busy connection.
+   *
+   * Requests are only pipelined when all `max_connections` connections are
+   * busy. Defaults to 1 (requests wait for an idle connection).
+   */
+  uint8_t pipeline;
+} fio_http_request_args_s;
+
+/**
+ * Sends an HTTP/1.1 request to `url` (`http://` or `https://`).
+ *
+ * Connections are pooled per host (scheme, host and port) and kept alive, so
+ * subsequent requests to the same host reuse existing connections instead of
+ * performing a new TCP (and TLS) handshake.
+ *
+ * The pool's limits (`max_connections`, `pipeline`, `max_body_size` and
+ * `timeout`) follow the most recent request to the host.
+ *
+ * Idempotent requests that were sent on a reused connection which was closed
+ * before a response arrived (i.e., a stale keep-alive connection) are retried
+ * once on a different connection.
+ *
+ * Host names are resolved by a short lived thread, so DNS lookups never block
+ * the IO thread (IP addresses are connected immediately). For `https` requests
+ * the host name is sent as the TLS server name (SNI), unless the `tls` settings
+ * set one using `fio_tls_server_name_set`.
+ *
+ * Responses with neither a `content-length` nor a chunked `transfer-encoding`
+ * are read until the server closes the connection.
+ *
+ * Returns -1 on error (i.e., unsupported URL) or 0 if the request was
+ * scheduled (`on_response` will be called).
+ */
+SFUNC int fio_http_request(const char *url, fio_http_request_args_s args);
+
+/** Sends an HTTP/1.1 request to `url`, see `fio_http_request_args_s`. */
+#define fio_http_request(url, ...)                                             \
+  fio_http_request(url, (fio_http_request_args_s){__VA_ARGS__})
+
 /* *****************************************************************************
 WebSocket Helpers - HTTP Upgraded Connections
 ***************************************************************************** */
@@ -37597,6 +41264,10 @@ All memory allocations should use:
 
 */
 
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+
 /* *****************************************************************************
 HTTP Settings Validation
 ***************************************************************************** */
@@ -37672,9 +41343,20 @@ static void http_settings_validate(fio_http_settings_s *s, int is_client) {
     s->timeout = FIO_HTTP_DEFAULT_TIMEOUT;
   if (!s->ws_timeout)
     s->ws_timeout = FIO_HTTP_DEFAULT_TIMEOUT_LONG;
+  if (!s->header_timeout)
+    s->header_timeout = FIO_HTTP_DEFAULT_HEADER_TIMEOUT;
+  if (!s->min_body_rate)
+    s->min_body_rate = FIO_HTTP_DEFAULT_MIN_BODY_RATE;
 
   if (s->max_header_size < s->max_line_len)
     s->max_header_size = s->max_line_len;
+#if !HAVE_ZLIB
+  if (s->compress_min || s->ws_compress_min) {
+    FIO_LOG_WARNING("HTTP / WebSocket compression requires zlib (HAVE_ZLIB).");
+    s->compress_min = 0;
+    s->ws_compress_min = 0;
+  }
+#endif
 
   if (s->public_folder.buf) {
     if (s->public_folder.len > 1 &&
@@ -37688,6 +41370,13 @@ static void http_settings_validate(fio_http_settings_s *s, int is_client) {
       s->public_folder = ((fio_str_info_s){0});
     }
   }
+  if (s->static_headers.len &&
+      (s->static_headers.len < 4 ||
+       s->static_headers.buf[s->static_headers.len - 2] != '\r' ||
+       s->static_headers.buf[s->static_headers.len - 1] != '\n')) {
+    FIO_LOG_ERROR("HTTP static headers must end with CRLF, setting ignored.");
+    s->static_headers = ((fio_str_info_s){0});
+  }
 }
 
 /* *****************************************************************************
@@ -37710,6 +41399,72 @@ FIO_IFUNC fio_protocol_s fio___http_protocol_get(fio___http_protocol_selector_e,
 FIO_IFUNC fio_http_controller_s
 fio___http_controller_get(fio___http_protocol_selector_e, int is_client);
 
+/* *****************************************************************************
+HTTP Read Buffer Pool (idle buffers are linked using their first bytes)
+***************************************************************************** */
+
+typedef struct {
+  void **head;
+  uint32_t count;
+  fio_lock_i lock;
+} fio___http_buffer_pool_s;
+
+FIO___LEAK_COUNTER_DEF(http___read_buffer)
+
+/** Borrows a buffer from the pool, allocating a new buffer if none are idle. */
+FIO_SFUNC char *fio___http_buffer_pool_pop(fio___http_buffer_pool_s *pool,
+                                           size_t capa) {
+  void **b;
+  fio_lock(&pool->lock);
+  b = pool->head;
+  if (b) {
+    pool->head = (void **)*b;
+    --pool->count;
+  }
+  fio_unlock(&pool->lock);
+  if (b)
+    return (char *)b;
+  b = (void **)FIO_MEM_REALLOC_(NULL, 0, capa, 0);
+  FIO_ASSERT_ALLOC(b);
+  FIO___LEAK_COUNTER_ON_ALLOC(http___read_buffer);
+  return (char *)b;
+}
+
+/** Returns a buffer to the pool, freeing it if the pool is full. */
+FIO_SFUNC void fio___http_buffer_pool_push(fio___http_buffer_pool_s *pool,
+                                           char *buf,
+                                           size_t capa) {
+  void **b = (void **)buf;
+  if (!b)
+    return;
+  fio_lock(&pool->lock);
+  if (pool->count < FIO_HTTP_READ_BUFFER_POOL_LIMIT) {
+    *b = (void *)pool->head;
+    pool->head = b;
+    ++pool->count;
+    b = NULL;
+  }
+  fio_unlock(&pool->lock);
+  if (!b)
+    return;
+  FIO_MEM_FREE_(b, capa);
+  FIO___LEAK_COUNTER_ON_FREE(http___read_buffer);
+  (void)capa; /* if unused */
+}
+
+/** Frees all idle buffers. */
+FIO_SFUNC void fio___http_buffer_pool_destroy(fio___http_buffer_pool_s *pool,
+                                              size_t capa) {
+  while (pool->head) {
+    void **b = pool->head;
+    pool->head = (void **)*b;
+    FIO_MEM_FREE_(b, capa);
+    FIO___LEAK_COUNTER_ON_FREE(http___read_buffer);
+  }
+  pool->count = 0;
+  (void)capa; /* if unused */
+}
+
 /* *****************************************************************************
 HTTP Protocol Container (vtable + settings storage)
 ***************************************************************************** */
@@ -37719,6 +41474,7 @@ typedef struct {
   fio_http_settings_s settings;
   void (*on_http_callback)(void *, void *);
   fio_queue_s *queue;
+  fio___http_buffer_pool_s buffers; /* read buffers (`max_line_len` bytes) */
   struct {
     fio_protocol_s protocol;
     fio_http_controller_s controller;
@@ -37732,13 +41488,468 @@ typedef struct {
 #define FIO_REF_CONSTRUCTOR_ONLY 1
 #define FIO_REF_DESTROY(o)                                                     \
   do {                                                                         \
+    fio___http_buffer_pool_destroy(&o.buffers, o.settings.max_line_len);       \
     if (o.settings.tls)                                                        \
       fio_tls_free(o.settings.tls);                                            \
+    if (o.settings.router)                                                     \
+      fio_http_router_free(o.settings.router);                                 \
     if (o.settings.on_finish)                                                  \
       o.settings.on_finish(&o.settings);                                       \
   } while (0)
 #include FIO_INCLUDE_FILE
 
+/* *****************************************************************************
+HTTP Client Containers (requests and per-host connection pools)
+***************************************************************************** */
+
+/** A client request, waiting to be sent or for its response. */
+typedef struct fio___http_client_req_s {
+  struct fio___http_client_req_s *next;
+  fio_http_request_args_s args; /* only callbacks and settings are valid */
+  char *data; /* the rendered request (bstr), kept in case of a retry */
+  char *key;  /* the pool's key / URL (bstr), until the request is queued */
+  uint8_t is_head;
+  uint8_t retry; /* idempotent requests may be retried once */
+} fio___http_client_req_s;
+
+/** A FIFO queue of client requests. */
+typedef struct {
+  fio___http_client_req_s *head;
+  fio___http_client_req_s *tail;
+} fio___http_client_fifo_s;
+
+FIO___LEAK_COUNTER_DEF(http___client_request)
+
+FIO_IFUNC void fio___http_client_fifo_push(fio___http_client_fifo_s *q,
+                                           fio___http_client_req_s *r) {
+  r->next = NULL;
+  if (q->tail)
+    q->tail->next = r;
+  else
+    q->head = r;
+  q->tail = r;
+}
+
+FIO_IFUNC fio___http_client_req_s *fio___http_client_fifo_shift(
+    fio___http_client_fifo_s *q) {
+  fio___http_client_req_s *r = q->head;
+  if (!r)
+    return r;
+  q->head = r->next;
+  if (!q->head)
+    q->tail = NULL;
+  return r;
+}
+
+FIO_SFUNC fio___http_client_req_s *fio___http_client_req_new(void) {
+  fio___http_client_req_s *r =
+      (fio___http_client_req_s *)FIO_MEM_REALLOC_(NULL, 0, sizeof(*r), 0);
+  FIO_ASSERT_ALLOC(r);
+  FIO___LEAK_COUNTER_ON_ALLOC(http___client_request);
+  return r;
+}
+
+FIO_SFUNC void fio___http_client_req_free(fio___http_client_req_s *r) {
+  fio_bstr_free(r->data);
+  fio_bstr_free(r->key);
+  fio_tls_free(r->args.tls);
+  FIO_MEM_FREE_(r, sizeof(*r));
+  FIO___LEAK_COUNTER_ON_FREE(http___client_request);
+}
+
+/** A per-host pool of keep-alive connections (IO thread only). */
+typedef struct fio___http_client_pool_s {
+  FIO_LIST_HEAD connections;
+  fio___http_client_fifo_s pending; /* requests waiting for a connection */
+  fio___http_protocol_s *protocol;
+  void *tls; /* a TLS context built for client connections (https) */
+  char *url;
+  uint32_t count;
+  uint16_t max_connections;
+  uint8_t pipeline;
+} fio___http_client_pool_s;
+
+FIO_SFUNC void fio___http_client_pool_destroy(fio___http_client_pool_s *pool) {
+  fio___http_client_req_s *r;
+  while ((r = fio___http_client_fifo_shift(&pool->pending)))
+    fio___http_client_req_free(r);
+  if (pool->tls)
+    pool->protocol->state[FIO___HTTP_PROTOCOL_HTTP1]
+        .protocol.io_functions.free_context(pool->tls);
+  fio_bstr_free(pool->url);
+  fio___http_protocol_free(pool->protocol);
+}
+
+#define FIO_REF_NAME             fio___http_client_pool
+#define FIO_REF_CONSTRUCTOR_ONLY 1
+#define FIO_REF_DESTROY(o)       fio___http_client_pool_destroy(&(o))
+#include FIO_INCLUDE_FILE
+
+#define FIO_MAP_NAME             fio___http_client_pool_map
+#define FIO_MAP_VALUE            fio___http_client_pool_s *
+#define FIO_MAP_VALUE_DESTROY(o) fio___http_client_pool_free(o)
+#define FIO_MAP_VALUE_DISCARD(o) fio___http_client_pool_free(o)
+#include FIO_INCLUDE_FILE
+
+/* *****************************************************************************
+HTTP Router Container (radix tree)
+***************************************************************************** */
+
+/** A route, as stored by a radix tree node. */
+typedef struct {
+  fio_http_route_s route;
+  uint32_t method_len; /* zero == any method */
+  char method[20];
+} fio___http_rentry_s;
+
+/** A radix tree node - static children are keyed by their label's 1st byte. */
+typedef struct fio___http_rnode_s {
+  fio_buf_info_s label; /* the static edge (or the `:name` / `*name` segment) */
+  struct fio___http_rnode_s **kids; /* static children */
+  struct fio___http_rnode_s *param; /* the `:name` child (if any) */
+  struct fio___http_rnode_s *wild;  /* the `*name` child (if any) */
+  fio___http_rentry_s *routes;      /* routes ending at this node */
+  uint32_t kids_len;
+  uint32_t routes_len;
+  char buf[];
+} fio___http_rnode_s;
+
+/** Captured path parameters (collected before they're set on the handle). */
+typedef struct {
+  fio_buf_info_s name[FIO_HTTP_MAX_PARAMS];
+  fio_buf_info_s value[FIO_HTTP_MAX_PARAMS];
+  size_t count;
+} fio___http_rparams_s;
+
+struct fio_http_router_s {
+  fio___http_rnode_s *root;
+  size_t body_limits; /* routes with a `max_body_size` (tested early) */
+};
+
+FIO___LEAK_COUNTER_DEF(http___router_node)
+
+FIO_SFUNC fio___http_rnode_s *fio___http_rnode_new(const char *label,
+                                                   size_t len) {
+  fio___http_rnode_s *n = (fio___http_rnode_s *)
+      FIO_MEM_REALLOC_(NULL, 0, sizeof(*n) + len + 1, 0);
+  if (!n)
+    return n;
+  FIO___LEAK_COUNTER_ON_ALLOC(http___router_node);
+  *n = (fio___http_rnode_s){.label = FIO_BUF_INFO2(n->buf, len)};
+  if (len)
+    FIO_MEMCPY(n->buf, label, len);
+  n->buf[len] = 0;
+  return n;
+}
+
+FIO_SFUNC void fio___http_rnode_free(fio___http_rnode_s *n) {
+  if (!n)
+    return;
+  for (uint32_t i = 0; i < n->kids_len; ++i)
+    fio___http_rnode_free(n->kids[i]);
+  for (uint32_t i = 0; i < n->routes_len; ++i)
+    fio_bstr_free(n->routes[i].route.cache_vary.buf);
+  fio___http_rnode_free(n->param);
+  fio___http_rnode_free(n->wild);
+  FIO_MEM_FREE_(n->kids, sizeof(*n->kids) * n->kids_len);
+  FIO_MEM_FREE_(n->routes, sizeof(*n->routes) * n->routes_len);
+  /* the label may have been shortened (from the front) when splitting */
+  FIO_MEM_FREE_(n,
+                sizeof(*n) + (size_t)(n->label.buf - n->buf) + n->label.len +
+                    1);
+  FIO___LEAK_COUNTER_ON_FREE(http___router_node);
+}
+
+/** Copies the route's `cache_vary` string (a `fio_bstr`). */
+FIO_SFUNC int fio___http_rentry_vary_copy(fio_http_route_s *route) {
+  if (!route->cache_vary.len) {
+    route->cache_vary = (fio_str_info_s){0};
+    return 0;
+  }
+  route->cache_vary.buf =
+      fio_bstr_write(NULL, route->cache_vary.buf, route->cache_vary.len);
+  return -(!route->cache_vary.buf);
+}
+
+/** Adds a static child (takes ownership of `kid`), returns -1 on error. */
+FIO_SFUNC int fio___http_rnode_kid_add(fio___http_rnode_s *n,
+                                       fio___http_rnode_s *kid) {
+  fio___http_rnode_s **kids = (fio___http_rnode_s **)
+      FIO_MEM_REALLOC_(n->kids,
+                       sizeof(*kids) * n->kids_len,
+                       sizeof(*kids) * (n->kids_len + 1),
+                       sizeof(*kids) * n->kids_len);
+  if (!kids) {
+    fio___http_rnode_free(kid);
+    return -1;
+  }
+  kids[n->kids_len++] = kid;
+  n->kids = kids;
+  return 0;
+}
+
+/** Inserts a static path fragment, returning the node where it ends. */
+FIO_SFUNC fio___http_rnode_s *fio___http_rnode_insert(fio___http_rnode_s *n,
+                                                      const char *s,
+                                                      size_t len) {
+  while (len) {
+    fio___http_rnode_s *k = NULL;
+    uint32_t i = 0;
+    size_t common = 1;
+    for (; i < n->kids_len; ++i) {
+      if (n->kids[i]->label.buf[0] != s[0])
+        continue;
+      k = n->kids[i];
+      break;
+    }
+    if (!k) { /* a new edge */
+      k = fio___http_rnode_new(s, len);
+      if (!k || fio___http_rnode_kid_add(n, k))
+        return NULL;
+      return k;
+    }
+    while (common < len && common < k->label.len &&
+           k->label.buf[common] == s[common])
+      ++common;
+    if (common < k->label.len) { /* split the edge at the common prefix */
+      fio___http_rnode_s *m = fio___http_rnode_new(s, common);
+      if (!m)
+        return NULL;
+      m->kids = (fio___http_rnode_s **)
+          FIO_MEM_REALLOC_(NULL, 0, sizeof(*m->kids), 0);
+      if (!m->kids) {
+        fio___http_rnode_free(m);
+        return NULL;
+      }
+      m->kids[0] = k;
+      m->kids_len = 1;
+      k->label.buf += common;
+      k->label.len -= common;
+      n->kids[i] = m;
+      k = m;
+    }
+    n = k;
+    s += common;
+    len -= common;
+  }
+  return n;
+}
+
+/** Returns a method specific route, or a route accepting any method. */
+FIO_IFUNC fio___http_rentry_s *fio___http_rnode_pick(fio___http_rnode_s *n,
+                                                     fio_str_info_s method) {
+  fio___http_rentry_s *any = NULL;
+  for (uint32_t i = 0; i < n->routes_len; ++i) {
+    fio___http_rentry_s *e = n->routes + i;
+    if (!e->method_len)
+      any = e;
+    else if (e->method_len == method.len &&
+             !FIO_MEMCMP(e->method, method.buf, method.len))
+      return e;
+  }
+  return any;
+}
+
+/** Matches the rest of the path (`pos` to `end`), backtracking if needed. */
+FIO_SFUNC fio___http_rentry_s *fio___http_rnode_match(fio___http_rnode_s *n,
+                                                      fio_str_info_s method,
+                                                      const char *pos,
+                                                      const char *end,
+                                                      fio___http_rparams_s *p) {
+  fio___http_rentry_s *r;
+  if (pos == end) {
+    if ((r = fio___http_rnode_pick(n, method)))
+      return r;
+    goto wildcard;
+  }
+  for (uint32_t i = 0; i < n->kids_len; ++i) {
+    fio___http_rnode_s *k = n->kids[i];
+    if (k->label.buf[0] != pos[0])
+      continue;
+    /* only a single child may start with the same byte */
+    if (k->label.len <= (size_t)(end - pos) &&
+        !FIO_MEMCMP(k->label.buf, pos, k->label.len) &&
+        (r = fio___http_rnode_match(k, method, pos + k->label.len, end, p)))
+      return r;
+    break;
+  }
+  if (n->param && p->count < FIO_HTTP_MAX_PARAMS && pos[0] != '/') {
+    const char *eos = (const char *)FIO_MEMCHR(pos, '/', (size_t)(end - pos));
+    if (!eos)
+      eos = end;
+    p->name[p->count] = n->param->label;
+    p->value[p->count] = FIO_BUF_INFO2((char *)pos, (size_t)(eos - pos));
+    ++p->count;
+    if ((r = fio___http_rnode_match(n->param, method, eos, end, p)))
+      return r;
+    --p->count;
+  }
+wildcard:
+  if (n->wild && p->count < FIO_HTTP_MAX_PARAMS &&
+      (r = fio___http_rnode_pick(n->wild, method))) {
+    p->name[p->count] = n->wild->label;
+    if (p->name[p->count].len > 1) { /* "*name" => "name" */
+      ++p->name[p->count].buf;
+      --p->name[p->count].len;
+    }
+    p->value[p->count] = FIO_BUF_INFO2((char *)pos, (size_t)(end - pos));
+    ++p->count;
+    return r;
+  }
+  return NULL;
+}
+
+FIO_SFUNC fio___http_rentry_s *fio___http_router_find(fio_http_router_s *r,
+                                                      fio_str_info_s method,
+                                                      fio_str_info_s path,
+                                                      fio___http_rparams_s *p) {
+  p->count = 0;
+  if (!r->root || !path.len)
+    return NULL;
+  return fio___http_rnode_match(r->root,
+                                method,
+                                path.buf,
+                                path.buf + path.len,
+                                p);
+}
+
+FIO_SFUNC void fio___http_router_destroy(fio_http_router_s *r) {
+  fio___http_rnode_free(r->root);
+  *r = (fio_http_router_s){0};
+}
+
+#define FIO_REF_NAME       fio_http_router
+#define FIO_REF_DESTROY(o) fio___http_router_destroy(&(o))
+#include FIO_INCLUDE_FILE
+
+/** Creates a new (empty) HTTP router. */
+SFUNC fio_http_router_s *fio_http_router_new(void) {
+  return fio_http_router_new2();
+}
+
+/** Reduces a router's reference count or frees it. */
+SFUNC void fio_http_router_free(fio_http_router_s *r) {
+  fio_http_router_free2(r);
+}
+
+/** Increases a router's reference count. */
+SFUNC fio_http_router_s *fio_http_router_dup(fio_http_router_s *r) {
+  return fio_http_router_dup2(r);
+}
+
+/** Adds a route to the router. */
+SFUNC int fio_http_route FIO_NOOP(fio_http_router_s *r,
+                                  const char *method,
+                                  const char *pattern,
+                                  fio_http_route_s route) {
+  fio___http_rnode_s *n;
+  size_t params = 0;
+  size_t method_len = method ? FIO_STRLEN(method) : 0;
+  if (!r || !pattern || pattern[0] != '/' || !route.on_http ||
+      method_len >= sizeof(((fio___http_rentry_s *)0)->method))
+    goto bad_route;
+  if (!r->root && !(r->root = fio___http_rnode_new(NULL, 0)))
+    return -1;
+  n = r->root;
+  for (const char *pos = pattern; *pos;) {
+    const char *start = pos;
+    size_t len;
+    /* static text, up to a `:name` / `*name` segment */
+    while (*pos && !((pos[0] == ':' || pos[0] == '*') && pos[-1] == '/'))
+      ++pos;
+    if (pos > start && !(n = fio___http_rnode_insert(n,
+                                                     start,
+                                                     (size_t)(pos - start))))
+      return -1;
+    if (!*pos)
+      break;
+    start = pos;
+    if (pos[0] == '*') {
+      len = FIO_STRLEN(pos);
+      if (FIO_MEMCHR(pos, '/', len) || ++params > FIO_HTTP_MAX_PARAMS)
+        goto bad_route;
+      if (!n->wild && !(n->wild = fio___http_rnode_new(pos, len)))
+        return -1;
+      if (n->wild->label.len != len || FIO_MEMCMP(n->wild->label.buf, pos, len))
+        goto bad_name;
+      n = n->wild;
+      break;
+    }
+    while (*pos && *pos != '/')
+      ++pos;
+    len = (size_t)(pos - ++start);
+    if (!len || ++params > FIO_HTTP_MAX_PARAMS)
+      goto bad_route;
+    if (!n->param && !(n->param = fio___http_rnode_new(start, len)))
+      return -1;
+    if (n->param->label.len != len ||
+        FIO_MEMCMP(n->param->label.buf, start, len))
+      goto bad_name;
+    n = n->param;
+  }
+  for (uint32_t i = 0; i < n->routes_len; ++i) {
+    if (n->routes[i].method_len != method_len ||
+        FIO_MEMCMP(n->routes[i].method, method, method_len))
+      continue;
+    if (fio___http_rentry_vary_copy(&route))
+      return -1;
+    fio_bstr_free(n->routes[i].route.cache_vary.buf);
+    r->body_limits -= !!n->routes[i].route.max_body_size;
+    r->body_limits += !!route.max_body_size;
+    n->routes[i].route = route;
+    return 0;
+  }
+  {
+    fio___http_rentry_s *routes;
+    if (fio___http_rentry_vary_copy(&route))
+      return -1;
+    routes = (fio___http_rentry_s *)
+        FIO_MEM_REALLOC_(n->routes,
+                         sizeof(*routes) * n->routes_len,
+                         sizeof(*routes) * (n->routes_len + 1),
+                         sizeof(*routes) * n->routes_len);
+    if (!routes) {
+      fio_bstr_free(route.cache_vary.buf);
+      return -1;
+    }
+    n->routes = routes;
+    routes += n->routes_len++;
+    *routes = (fio___http_rentry_s){.route = route,
+                                    .method_len = (uint32_t)method_len};
+    if (method_len)
+      FIO_MEMCPY(routes->method, method, method_len);
+  }
+  r->body_limits += !!route.max_body_size;
+  return 0;
+
+bad_route:
+  FIO_LOG_ERROR("HTTP router: invalid route %s %s",
+                (method ? method : "*"),
+                (pattern ? pattern : "(NULL)"));
+  return -1;
+bad_name:
+  FIO_LOG_ERROR("HTTP router: conflicting parameter names in %s",
+                pattern);
+  return -1;
+}
+
+/** Returns the route matching the HTTP handle (setting path parameters). */
+SFUNC fio_http_route_s *fio_http_router_match(fio_http_router_s *r,
+                                              fio_http_s *h) {
+  fio___http_rparams_s p;
+  fio___http_rentry_s *e;
+  if (!r || !h)
+    return NULL;
+  e = fio___http_router_find(r, fio_http_method(h), fio_http_path(h), &p);
+  if (!e)
+    return NULL;
+  for (size_t i = 0; i < p.count; ++i)
+    fio_http_param_add(h,
+                       FIO_BUF2STR_INFO(p.name[i]),
+                       FIO_BUF2STR_INFO(p.value[i]));
+  return &e->route;
+}
+
 /* *****************************************************************************
 HTTP Connection Container
 ***************************************************************************** */
@@ -37747,12 +41958,38 @@ struct fio___http_connection_http_s {
   void (*on_http_callback)(void *, void *);
   void (*on_http)(fio_http_s *h);
   fio_http1_parser_s parser;
+  char *body;      /* streamed request body data, pending delivery */
+  size_t streamed; /* total streamed request body length */
+  size_t max_body; /* the request's body limit (may be set by a route) */
   uint32_t max_header;
+  uint8_t streaming; /* a body chunk is being delivered, don't parse */
+  struct {         /* client connections only */
+    fio___http_client_pool_s *pool;
+    fio___http_client_fifo_s sent; /* requests waiting for a response */
+    FIO_LIST_NODE node;            /* the pool's connection list */
+    uint32_t in_flight;
+    uint32_t served;
+    uint8_t closing; /* 1: no new requests, 2: also, don't retry requests */
+  } client;
 };
 struct fio___http_connection_ws_s {
   void (*on_message)(fio_http_s *h, fio_buf_info_s msg, uint8_t is_text);
   fio_websocket_parser_s parser;
   char *msg;
+  uint8_t utf8_len; /* bytes of a code point split between streamed chunks */
+  char utf8[4];
+#if HAVE_ZLIB
+  struct { /* permessage-deflate state */
+    z_stream *in;  /* lazily allocated */
+    z_stream *out; /* lazily allocated */
+    size_t min;    /* shorter messages aren't compressed */
+    fio_lock_i lock; /* compression order MUST match the write order */
+    uint8_t on;
+    uint8_t bits;      /* window bits for outgoing messages */
+    uint8_t in_reset;  /* client_no_context_takeover */
+    uint8_t out_reset; /* server_no_context_takeover */
+  } deflate;
+#endif
 };
 struct fio___http_connection_sse_s {
   void (*on_message)(fio_http_s *h, fio_buf_info_s msg, uint8_t is_text);
@@ -37761,6 +41998,86 @@ struct fio___http_connection_sse_s {
   void (*on_close)(fio_http_s *h);
 };
 
+/** A pending (buffered) segment of a pipelined response. */
+typedef struct fio___http_pipeline_seg_s {
+  struct fio___http_pipeline_seg_s *next;
+  fio_write_args_s args;
+} fio___http_pipeline_seg_s;
+
+/** A pipelined request, waiting for its turn to send the response. */
+typedef struct {
+  fio_http_s *h;
+  fio___http_pipeline_seg_s *seg;
+  fio___http_pipeline_seg_s *last;
+  uint8_t finished;
+  uint8_t upgraded;
+} fio___http_pipeline_slot_s;
+
+/** HTTP/1.1 pipelining state - sequences responses in request order. */
+typedef struct {
+  fio_http_s *held; /* upgrade request, waiting for pipeline to drain */
+  char *held_body;  /* the held request's (streamed) body, if any */
+  fio_lock_i lock;
+  uint32_t head;
+  uint32_t count;
+  uint32_t capa;
+  uint8_t flush_scheduled;
+  uint8_t upgraded;
+  uint8_t closing;
+  fio___http_pipeline_slot_s slots[];
+} fio___http_pipeline_s;
+
+FIO___LEAK_COUNTER_DEF(http___pipeline)
+FIO___LEAK_COUNTER_DEF(http___pipeline_segment)
+
+FIO_SFUNC void fio___http_pipeline_bstr_free(void *b) {
+  fio_bstr_free((char *)b);
+}
+
+/** Deallocates a segment, including any data it owns. */
+FIO_SFUNC void fio___http_pipeline_seg_free(fio___http_pipeline_seg_s *seg) {
+  if (seg->args.buf) {
+    if (seg->args.dealloc)
+      seg->args.dealloc(seg->args.buf);
+  } else if (seg->args.fd != -1) {
+    if (seg->args.dealloc)
+      seg->args.dealloc((void *)seg->args.fd);
+    else
+      close((int)seg->args.fd);
+  }
+  FIO_MEM_FREE_(seg, sizeof(*seg));
+  FIO___LEAK_COUNTER_ON_FREE(http___pipeline_segment);
+}
+
+FIO_SFUNC fio___http_pipeline_s *fio___http_pipeline_new(uint32_t capa) {
+  const size_t len = sizeof(fio___http_pipeline_s) +
+                     (sizeof(fio___http_pipeline_slot_s) * capa);
+  fio___http_pipeline_s *p =
+      (fio___http_pipeline_s *)FIO_MEM_REALLOC_(NULL, 0, len, 0);
+  FIO_ASSERT_ALLOC(p);
+  FIO___LEAK_COUNTER_ON_ALLOC(http___pipeline);
+  FIO_MEMSET(p, 0, len);
+  p->capa = capa;
+  return p;
+}
+
+FIO_SFUNC void fio___http_pipeline_free(fio___http_pipeline_s *p) {
+  if (!p)
+    return;
+  for (uint32_t i = 0; i < p->capa; ++i) {
+    while (p->slots[i].seg) {
+      fio___http_pipeline_seg_s *tmp = p->slots[i].seg;
+      p->slots[i].seg = tmp->next;
+      fio___http_pipeline_seg_free(tmp);
+    }
+  }
+  fio_bstr_free(p->held_body);
+  FIO_MEM_FREE_(p,
+                sizeof(fio___http_pipeline_s) +
+                    (sizeof(fio___http_pipeline_slot_s) * p->capa));
+  FIO___LEAK_COUNTER_ON_FREE(http___pipeline);
+}
+
 /** Connection objects for managing HTTP / WebSocket connection state. */
 typedef struct {
   fio_s *io;
@@ -37768,6 +42085,12 @@ typedef struct {
   fio_http_settings_s *settings;
   fio_queue_s *queue;
   void *udata;
+  fio___http_pipeline_s *pipeline;
+  fio_http_s *spare; /* a reset handle, recycled for the next request */
+  FIO_LIST_NODE deadline_node; /* the deadline wheel's bucket (IO thread) */
+  int64_t deadline;            /* in seconds, see `deadline_kind` */
+  size_t received;             /* bytes read, for the minimal body rate */
+  size_t received_mark;        /* `received` when the deadline was set */
   union {
     struct fio___http_connection_http_s http;
     struct fio___http_connection_ws_s ws;
@@ -37778,25 +42101,275 @@ typedef struct {
   uint8_t log;
   uint8_t suspend;
   uint8_t is_client;
-  char buf[];
+  uint8_t deadline_kind; /* a `fio___http_deadline_e` value */
+  uint8_t ip_counted;    /* counted by the per IP connection limit */
+  uint8_t peer_len;
+  char peer[48]; /* the peer address (when logging or limiting per IP) */
+  char *buf;     /* borrowed from the pool only while data is pending */
 } fio___http_connection_s;
 
 #define FIO_REF_NAME             fio___http_connection
 #define FIO_REF_CONSTRUCTOR_ONLY 1
-#define FIO_REF_FLEX_TYPE        char
 #define FIO_REF_DESTROY(o)                                                     \
   do {                                                                         \
+    fio___http_pipeline_free(o.pipeline);                                      \
+    fio_http_free(o.spare);                                                    \
+    fio___http_buffer_pool_push(                                               \
+        &FIO_PTR_FROM_FIELD(fio___http_protocol_s, settings, o.settings)       \
+             ->buffers,                                                        \
+        o.buf,                                                                 \
+        o.capa);                                                               \
     fio___http_protocol_free(                                                  \
         FIO_PTR_FROM_FIELD(fio___http_protocol_s, settings, o.settings));      \
   } while (0)
 #include FIO_INCLUDE_FILE
 
+/** Returns the connection's read buffer, borrowing one from the pool. */
+FIO_IFUNC char *fio___http_buffer(fio___http_connection_s *c) {
+  if (!c->buf)
+    c->buf = fio___http_buffer_pool_pop(
+        &FIO_PTR_FROM_FIELD(fio___http_protocol_s, settings, c->settings)
+             ->buffers,
+        c->capa);
+  return c->buf;
+}
+
+/** Returns the read buffer to the pool once all pending data was consumed. */
+FIO_IFUNC void fio___http_buffer_release(fio___http_connection_s *c) {
+  if (c->len || !c->buf)
+    return;
+  fio___http_buffer_pool_push(
+      &FIO_PTR_FROM_FIELD(fio___http_protocol_s, settings, c->settings)
+           ->buffers,
+      c->buf,
+      c->capa);
+  c->buf = NULL;
+}
+
+/* concurrent connection count per peer address (IO thread only) */
+#define FIO_MAP_NAME  fio___http_ip_map
+#define FIO_MAP_VALUE uint32_t
+#include FIO_INCLUDE_FILE
+
 #undef FIO___RECURSIVE_INCLUDE
 
+/* *****************************************************************************
+HTTP/1.1 Slow Clients (request deadlines and per IP connection limits)
+
+Request deadlines are stored in a wheel of one second buckets, reviewed once a
+second by a single server timer, rather than using per connection timers. The
+wheel and the per IP connection count are only accessed by the IO thread.
+***************************************************************************** */
+
+#define FIO___HTTP_DEADLINE_BUCKETS 64 /* must be a power of 2 */
+
+typedef enum {
+  FIO___HTTP_DEADLINE_NONE = 0,
+  FIO___HTTP_DEADLINE_HEAD, /* the request line and headers must arrive */
+  FIO___HTTP_DEADLINE_BODY, /* the body must arrive at `min_body_rate` */
+} fio___http_deadline_e;
+
+static struct {
+  FIO_LIST_HEAD bucket[FIO___HTTP_DEADLINE_BUCKETS];
+  int64_t reviewed; /* the last second reviewed */
+  uint8_t running;
+} fio___http_deadlines;
+
+static fio___http_ip_map_s fio___http_ips = FIO_MAP_INIT;
+
+FIO_SFUNC int fio___http_deadline_review(void *ignr1_, void *ignr2_);
+
+FIO_SFUNC void fio___http_deadline_on_finish(void *ignr1_, void *ignr2_) {
+  fio___http_deadlines.running = 0;
+  (void)ignr1_, (void)ignr2_;
+}
+
+/** Removes the connection from the deadline wheel (if listed). */
+FIO_IFUNC void fio___http_deadline_clear(fio___http_connection_s *c) {
+  if (!c->deadline_kind)
+    return;
+  FIO_LIST_REMOVE(&c->deadline_node);
+  c->deadline_kind = FIO___HTTP_DEADLINE_NONE;
+}
+
+/** Sets (or replaces) the connection's deadline, `seconds` from now. */
+FIO_SFUNC void fio___http_deadline_set(fio___http_connection_s *c,
+                                       fio___http_deadline_e kind,
+                                       int64_t seconds) {
+  const int64_t now = fio_srv_last_tick() / 1000;
+  if (!fio___http_deadlines.running) {
+    fio___http_deadlines.running = 1;
+    fio___http_deadlines.reviewed = now;
+    if (!fio___http_deadlines.bucket[0].next) {
+      for (size_t i = 0; i < FIO___HTTP_DEADLINE_BUCKETS; ++i)
+        fio___http_deadlines.bucket[i] =
+            FIO_LIST_INIT(fio___http_deadlines.bucket[i]);
+    }
+    fio_srv_run_every(.fn = fio___http_deadline_review,
+                      .on_finish = fio___http_deadline_on_finish,
+                      .every = 1000,
+                      .repetitions = -1);
+  }
+  fio___http_deadline_clear(c);
+  c->deadline = now + seconds;
+  c->received_mark = c->received;
+  c->deadline_kind = (uint8_t)kind;
+  FIO_LIST_PUSH(fio___http_deadlines.bucket +
+                    (c->deadline & (FIO___HTTP_DEADLINE_BUCKETS - 1)),
+                &c->deadline_node);
+}
+
+/** Sets, keeps or clears the deadline, according to the parser's state. */
+FIO_SFUNC void fio___http1_deadline_update(fio___http_connection_s *c,
+                                           size_t pending) {
+  fio___http_deadline_e kind = FIO___HTTP_DEADLINE_NONE;
+  if (c->is_client || c->suspend)
+    kind = FIO___HTTP_DEADLINE_NONE; /* waiting for the server, not the peer */
+  else if (fio_http1_parser_is_body(&c->state.http.parser))
+    kind = FIO___HTTP_DEADLINE_BODY;
+  else if (pending || !fio_http1_parser_is_empty(&c->state.http.parser))
+    kind = FIO___HTTP_DEADLINE_HEAD;
+  if ((uint8_t)kind == c->deadline_kind)
+    return; /* deadlines are never extended while waiting for the same data */
+  switch (kind) {
+  case FIO___HTTP_DEADLINE_NONE: break;
+  case FIO___HTTP_DEADLINE_HEAD:
+    if (!c->settings->header_timeout)
+      kind = FIO___HTTP_DEADLINE_NONE;
+    break;
+  case FIO___HTTP_DEADLINE_BODY:
+    if (!c->settings->min_body_rate)
+      kind = FIO___HTTP_DEADLINE_NONE;
+    break;
+  }
+  if (!kind) {
+    fio___http_deadline_clear(c);
+    return;
+  }
+  fio___http_deadline_set(c,
+                          kind,
+                          (kind == FIO___HTTP_DEADLINE_HEAD
+                               ? (int64_t)c->settings->header_timeout
+                               : (int64_t)FIO_HTTP_BODY_RATE_WINDOW));
+}
+
+/** Closes a connection that reached its deadline (or sets the next one). */
+FIO_SFUNC void fio___http_deadline_expired(fio___http_connection_s *c) {
+  if (c->deadline_kind == FIO___HTTP_DEADLINE_BODY &&
+      (c->suspend || c->state.http.streaming ||
+       (c->received - c->received_mark) >=
+           ((size_t)c->settings->min_body_rate * FIO_HTTP_BODY_RATE_WINDOW))) {
+    fio___http_deadline_set(c,
+                            FIO___HTTP_DEADLINE_BODY,
+                            FIO_HTTP_BODY_RATE_WINDOW);
+    return;
+  }
+  FIO_LOG_DDEBUG2("(%d) HTTP closing slow client (%p), %s deadline reached",
+                  (int)fio_thread_getpid(),
+                  (void *)c->io,
+                  (c->deadline_kind == FIO___HTTP_DEADLINE_HEAD ? "header"
+                                                                : "body"));
+  fio___http_deadline_clear(c);
+  fio_close(c->io);
+}
+
+/** Reviews the wheel's buckets for every second since the last review. */
+FIO_SFUNC int fio___http_deadline_review(void *ignr1_, void *ignr2_) {
+  const int64_t now = fio_srv_last_tick() / 1000;
+  int64_t i = fio___http_deadlines.reviewed;
+  if (now - i > FIO___HTTP_DEADLINE_BUCKETS)
+    i = now - FIO___HTTP_DEADLINE_BUCKETS;
+  while (i < now) {
+    ++i;
+    FIO_LIST_EACH(fio___http_connection_s,
+                  deadline_node,
+                  fio___http_deadlines.bucket +
+                      (i & (FIO___HTTP_DEADLINE_BUCKETS - 1)),
+                  c) {
+      if (c->deadline <= now)
+        fio___http_deadline_expired(c);
+    }
+  }
+  fio___http_deadlines.reviewed = now;
+  return 0;
+  (void)ignr1_, (void)ignr2_;
+}
+
+FIO_SFUNC void fio___http_ip_cleanup(void *ignr_) {
+  fio___http_ip_map_destroy(&fio___http_ips);
+  (void)ignr_;
+}
+
+/** Counts the peer's connections, returning -1 if the limit was reached. */
+FIO_SFUNC int fio___http_ip_add(fio___http_connection_s *c, uint32_t limit) {
+  fio___http_ip_map_node_s *n;
+  uint64_t hash;
+  if (!c->peer_len)
+    return 0; /* unknown address (i.e., a Unix socket) */
+  hash = fio_risky_hash(c->peer, c->peer_len, 0);
+  n = fio___http_ip_map_get_ptr(&fio___http_ips,
+                                hash,
+                                FIO_STR_INFO2(c->peer, c->peer_len));
+  if (n && n->value >= limit)
+    return -1;
+  if (n) {
+    ++n->value;
+  } else {
+    if (!fio___http_ip_map_capa(&fio___http_ips)) /* freed at exit */
+      fio_state_callback_add(FIO_CALL_AT_EXIT, fio___http_ip_cleanup, NULL);
+    fio___http_ip_map_set(&fio___http_ips,
+                          hash,
+                          FIO_STR_INFO2(c->peer, c->peer_len),
+                          1,
+                          NULL);
+  }
+  c->ip_counted = 1;
+  return 0;
+}
+
+/** Releases the connection's slot in the per IP connection count. */
+FIO_SFUNC void fio___http_ip_remove(fio___http_connection_s *c) {
+  fio___http_ip_map_node_s *n;
+  uint64_t hash;
+  if (!c->ip_counted)
+    return;
+  c->ip_counted = 0;
+  hash = fio_risky_hash(c->peer, c->peer_len, 0);
+  n = fio___http_ip_map_get_ptr(&fio___http_ips,
+                                hash,
+                                FIO_STR_INFO2(c->peer, c->peer_len));
+  if (n && !--n->value)
+    fio___http_ip_map_remove(&fio___http_ips,
+                             hash,
+                             FIO_STR_INFO2(c->peer, c->peer_len),
+                             NULL);
+}
+
 /* *****************************************************************************
 HTTP Request handling / handling
 ***************************************************************************** */
 
+/** Releases the connection reference held by an HTTP handle. */
+FIO_SFUNC void fio___http_controller_on_destroyed_task(void *c_, void *ignr_);
+
+/** Frees the handle, or resets it for the next keep-alive request. */
+FIO_SFUNC void fio___http_handle_free_or_recycle(fio___http_connection_s *c,
+                                                 fio_http_s *h) {
+  /* recycle only if the user didn't keep a reference and is done with it */
+  if (fio_http_references(h) != 1 ||
+      (fio_http_is_upgraded(h) | !fio_http_is_finished(h)) ||
+      !fio_srv_is_open(c->io) || c->spare) {
+    fio_http_free(h);
+    return;
+  }
+  /* the controller's `on_destroyed` is skipped, so the connection is kept */
+  fio_http_controller_set(h, NULL);
+  fio_http_reset(h);
+  h = fio_atomic_exchange(&c->spare, h);
+  fio_http_free(h); /* in case another thread recycled a handle first */
+  fio_queue_push(fio_srv_queue(), fio___http_controller_on_destroyed_task, c);
+}
+
 FIO_SFUNC void fio___http_perform_user_callback(void *cb_, void *h_) {
   union {
     void (*fn)(fio_http_s *);
@@ -37806,77 +42379,287 @@ FIO_SFUNC void fio___http_perform_user_callback(void *cb_, void *h_) {
   fio___http_connection_s *c = (fio___http_connection_s *)fio_http_cdata(h);
   if (FIO_LIKELY(fio_srv_is_open(c->io)))
     cb.fn(h);
-  fio_http_free(h);
+  fio___http_handle_free_or_recycle(c, h);
 }
 
-FIO_SFUNC void fio___http_perform_user_upgrade_callback_websockets(void *cb_,
-                                                                   void *h_) {
-  union {
-    int (*fn)(fio_http_s *);
-    void *ptr;
-  } cb = {.ptr = cb_};
-  fio_http_s *h = (fio_http_s *)h_;
-  fio___http_connection_s *c = (fio___http_connection_s *)fio_http_cdata(h);
-  struct fio___http_connection_http_s old = c->state.http;
-  if (cb.fn(h))
-    goto refuse_upgrade;
-  if (c->h) /* request after WebSocket Upgrade? an attack vector? */
-    goto refuse_upgrade;
-#if HAVE_ZLIB && 0           /* TODO: logs and fix extension handling logic */
-  FIO_HTTP_HEADER_EACH_VALUE(/* TODO: setup WebSocket extension */
-                             h,
+/* *****************************************************************************
+WebSocket permessage-deflate negotiation (RFC 7692)
+***************************************************************************** */
+#if HAVE_ZLIB
+
+/** Accepts the first valid permessage-deflate offer (if any). */
+FIO_SFUNC void fio___websocket_deflate_negotiate(fio_http_s *h,
+                                                fio___http_connection_s *c) {
+  if (!c->settings->ws_compress_min)
+    return;
+  FIO_HTTP_HEADER_EACH_VALUE(h,
                              1,
                              FIO_STR_INFO2((char *)"sec-websocket-extensions",
                                            24),
                              val) {
-    FIO_LOG_DDEBUG2("WebSocket extension requested: %.*s",
-                    (int)val.len,
-                    val.buf);
+    FIO_STR_INFO_TMP_VAR(ext, 127);
+    size_t server_bits = 0;
+    uint8_t ok = 1;
+    uint8_t server_nct = c->settings->ws_no_context_takeover;
+    uint8_t client_nct = c->settings->ws_no_context_takeover;
     if (!FIO_STR_INFO_IS_EQ(val,
                             FIO_STR_INFO2((char *)"permessage-deflate", 18)))
       continue;
-    size_t client_bits = 0, server_bits = 0;
     FIO_HTTP_HEADER_VALUE_EACH_PROPERTY(val, p) {
-      FIO_LOG_DDEBUG2("\t %.*s: %.*s",
-                      (int)p.name.len,
-                      p.name.buf,
-                      (int)p.value.len,
-                      p.value.buf);
-      if (FIO_STR_INFO_IS_EQ(p.name,
-                             FIO_STR_INFO2((char *)"client_max_window_bits",
-                                           22))) { /* used by chrome */
-        char *iptr = p.value.buf;
-        client_bits = iptr ? fio_atol10u(&iptr) : 0;
-        if (client_bits < 8 || client_bits > 15)
-          client_bits = (size_t)-1;
-      }
+      char *iptr = p.value.buf;
       if (FIO_STR_INFO_IS_EQ(
               p.name,
-              FIO_STR_INFO2((char *)"server_max_window_bits", 22))) {
-        char *iptr = p.value.buf;
-        server_bits = iptr ? fio_atol10u(&iptr) : 0;
-        if (server_bits < 8 || server_bits > 15)
-          server_bits = (size_t)-1;
-      }
+              FIO_STR_INFO2((char *)"server_no_context_takeover", 26)))
+        server_nct = 1;
+      else if (FIO_STR_INFO_IS_EQ(
+                   p.name,
+                   FIO_STR_INFO2((char *)"client_no_context_takeover", 26)))
+        client_nct = 1;
+      else if (FIO_STR_INFO_IS_EQ(
+                   p.name,
+                   FIO_STR_INFO2((char *)"server_max_window_bits", 22))) {
+        /* zlib's raw deflate can't use a 256 byte window (8 bits) */
+        server_bits = (p.value.len ? fio_atol10u(&iptr) : 0);
+        ok &= (server_bits > 8 && server_bits < 16 &&
+               iptr == p.value.buf + p.value.len);
+      } else if (FIO_STR_INFO_IS_EQ(
+                     p.name,
+                     FIO_STR_INFO2((char *)"client_max_window_bits", 22))) {
+        /* we inflate using a 15 bit window, any client window is supported */
+        size_t client_bits = (p.value.len ? fio_atol10u(&iptr) : 15);
+        ok &= (client_bits > 7 && client_bits < 16 &&
+               iptr == p.value.buf + p.value.len);
+      } else
+        ok = 0; /* unknown parameter, decline offer */
     }
-    if (client_bits)
-      ; /* TODO */
-    if (server_bits)
-      ; /* TODO */
-    break;
-  } /* HAVE_ZLIB */
-#endif
-  fio_http_upgrade_websockets(h);
-  return;
+    if (!ok)
+      continue;
+    fio_string_write(&ext, NULL, "permessage-deflate", 18);
+    if (server_nct)
+      fio_string_write(&ext, NULL, "; server_no_context_takeover", 28);
+    if (client_nct)
+      fio_string_write(&ext, NULL, "; client_no_context_takeover", 28);
+    if (server_bits) {
+      if (server_bits > FIO_HTTP_WEBSOCKET_DEFLATE_WINDOW_BITS)
+        server_bits = FIO_HTTP_WEBSOCKET_DEFLATE_WINDOW_BITS;
+      fio_string_write2(&ext,
+                        NULL,
+                        FIO_STRING_WRITE_STR2("; server_max_window_bits=", 25),
+                        FIO_STRING_WRITE_UNUM(server_bits));
+    }
+    fio_http_response_header_set(
+        h,
+        FIO_STR_INFO2((char *)"sec-websocket-extensions", 24),
+        ext);
+    return;
+  }
+}
 
-refuse_upgrade:
-  c->state.http = old;
-  fio_http_send_error_response(h, 403);
-  fio_http_free(h);
+/** Sets up the permessage-deflate state using the negotiation's response. */
+FIO_SFUNC void fio___websocket_deflate_setup(fio___http_connection_s *c) {
+  FIO_HTTP_HEADER_EACH_VALUE(c->h,
+                             0,
+                             FIO_STR_INFO2((char *)"sec-websocket-extensions",
+                                           24),
+                             val) {
+    if (!FIO_STR_INFO_IS_EQ(val,
+                            FIO_STR_INFO2((char *)"permessage-deflate", 18)))
+      continue;
+    c->state.ws.deflate.on = 1;
+    c->state.ws.deflate.min = c->settings->ws_compress_min;
+    c->state.ws.deflate.bits = FIO_HTTP_WEBSOCKET_DEFLATE_WINDOW_BITS;
+    FIO_HTTP_HEADER_VALUE_EACH_PROPERTY(val, p) {
+      char *iptr = p.value.buf;
+      if (FIO_STR_INFO_IS_EQ(
+              p.name,
+              FIO_STR_INFO2((char *)"server_no_context_takeover", 26)))
+        c->state.ws.deflate.out_reset = 1;
+      else if (FIO_STR_INFO_IS_EQ(
+                   p.name,
+                   FIO_STR_INFO2((char *)"client_no_context_takeover", 26)))
+        c->state.ws.deflate.in_reset = 1;
+      else if (FIO_STR_INFO_IS_EQ(
+                   p.name,
+                   FIO_STR_INFO2((char *)"server_max_window_bits", 22)) &&
+               iptr)
+        c->state.ws.deflate.bits = (uint8_t)fio_atol10u(&iptr);
+    }
+    return;
+  }
 }
 
-FIO_SFUNC void fio___http_perform_user_upgrade_callback_sse(void *cb_,
-                                                            void *h_) {
+/** Frees the permessage-deflate state. */
+FIO_SFUNC void fio___websocket_deflate_destroy(fio___http_connection_s *c) {
+  if (c->state.ws.deflate.in) {
+    inflateEnd(c->state.ws.deflate.in);
+    FIO_MEM_FREE_(c->state.ws.deflate.in, sizeof(z_stream));
+  }
+  if (c->state.ws.deflate.out) {
+    deflateEnd(c->state.ws.deflate.out);
+    FIO_MEM_FREE_(c->state.ws.deflate.out, sizeof(z_stream));
+  }
+  c->state.ws.deflate.in = c->state.ws.deflate.out = NULL;
+}
+
+/** Inflates a compressed message, returns NULL on error. */
+FIO_SFUNC char *fio___websocket_inflate(fio___http_connection_s *c,
+                                        fio_buf_info_s msg) {
+  z_stream *z = c->state.ws.deflate.in;
+  char *r = NULL;
+  const size_t limit = c->settings->ws_max_msg_size;
+  if (!c->state.ws.deflate.on)
+    return r;
+  if (!z) {
+    z = (z_stream *)FIO_MEM_REALLOC_(NULL, 0, sizeof(*z), 0);
+    if (!z)
+      return r;
+    *z = (z_stream){0};
+    if (inflateInit2(z, -15) != Z_OK) {
+      FIO_MEM_FREE_(z, sizeof(*z));
+      return r;
+    }
+    c->state.ws.deflate.in = z;
+  }
+  z->next_in = (Bytef *)msg.buf;
+  z->avail_in = (uInt)msg.len;
+  for (;;) {
+    fio_str_info_s i;
+    int e;
+    r = fio_bstr_reserve(r, (msg.len << 1) + 64);
+    i = fio_bstr_info(r);
+    z->next_out = (Bytef *)i.buf + i.len;
+    z->avail_out = (uInt)(i.capa - i.len - 1);
+    e = inflate(z, Z_SYNC_FLUSH);
+    r = fio_bstr_len_set(r, i.capa - 1 - z->avail_out);
+    if (e == Z_STREAM_END) { /* the peer used BFINAL, start a new stream */
+      inflateReset(z);
+      if (!z->avail_in)
+        break;
+      continue;
+    }
+    if (e != Z_OK && e != Z_BUF_ERROR)
+      goto inflate_error;
+    if (fio_bstr_len(r) > limit)
+      goto inflate_error;
+    if (!z->avail_in && z->avail_out)
+      break;
+    if (e == Z_BUF_ERROR && z->avail_out)
+      break; /* no progress possible */
+  }
+  if (c->state.ws.deflate.in_reset) {
+    inflateEnd(z);
+    FIO_MEM_FREE_(z, sizeof(*z));
+    c->state.ws.deflate.in = NULL;
+  }
+  return r;
+
+inflate_error:
+  FIO_LOG_DDEBUG2("WebSocket message inflate error (or message too big)");
+  fio_bstr_free(r);
+  return NULL;
+}
+
+/** Writes a compressed WebSocket message, returns -1 on error. */
+FIO_SFUNC int fio___websocket_write_deflated(fio___http_connection_s *c,
+                                             const void *buf,
+                                             size_t len,
+                                             uint8_t opcode) {
+  z_stream *z;
+  char *tmp = NULL, *payload;
+  fio_lock(&c->state.ws.deflate.lock);
+  z = c->state.ws.deflate.out;
+  if (!z) {
+    const int bits = c->state.ws.deflate.bits;
+    z = (z_stream *)FIO_MEM_REALLOC_(NULL, 0, sizeof(*z), 0);
+    if (!z)
+      goto error;
+    *z = (z_stream){0};
+    if (deflateInit2(z,
+                     Z_DEFAULT_COMPRESSION,
+                     Z_DEFLATED,
+                     0 - bits,
+                     (bits > 9 ? bits - 7 : 2),
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+      FIO_MEM_FREE_(z, sizeof(*z));
+      goto error;
+    }
+    c->state.ws.deflate.out = z;
+  }
+  z->next_in = (Bytef *)buf;
+  z->avail_in = (uInt)len;
+  do {
+    fio_str_info_s i;
+    tmp = fio_bstr_reserve(tmp, (z->avail_in >> 1) + 64);
+    i = fio_bstr_info(tmp);
+    z->next_out = (Bytef *)i.buf + i.len;
+    z->avail_out = (uInt)(i.capa - i.len - 1);
+    deflate(z, Z_SYNC_FLUSH);
+    tmp = fio_bstr_len_set(tmp, i.capa - 1 - z->avail_out);
+  } while (!z->avail_out);
+  if (c->state.ws.deflate.out_reset) {
+    deflateEnd(z);
+    FIO_MEM_FREE_(z, sizeof(*z));
+    c->state.ws.deflate.out = NULL;
+  }
+  /* remove the trailing 0x00 0x00 0xFF 0xFF (RFC 7692, section 7.2.1) */
+  len = fio_bstr_len(tmp) - 4;
+  payload =
+      fio_bstr_reserve(NULL,
+                       fio_websocket_wrapped_len(len) + (c->is_client << 2));
+  payload = fio_bstr_len_set(
+      payload,
+      (c->is_client ? fio_websocket_client_wrap : fio_websocket_server_wrap)(
+          payload,
+          tmp,
+          len,
+          opcode,
+          1,
+          1,
+          4 /* RSV1 */));
+  fio_bstr_free(tmp);
+  fio_write2(c->io,
+             .buf = payload,
+             .len = fio_bstr_len(payload),
+             .dealloc = (void (*)(void *))fio_bstr_free);
+  fio_unlock(&c->state.ws.deflate.lock);
+  return 0 - !fio_srv_is_open(c->io);
+error:
+  fio_unlock(&c->state.ws.deflate.lock);
+  return -1;
+}
+
+#else
+#define fio___websocket_deflate_negotiate(h, c)
+#define fio___websocket_deflate_setup(c)
+#define fio___websocket_deflate_destroy(c)
+#define fio___websocket_inflate(c, msg) ((void)(msg), (char *)NULL)
+#endif /* HAVE_ZLIB */
+
+FIO_SFUNC void fio___http_perform_user_upgrade_callback_websockets(void *cb_,
+                                                                   void *h_) {
+  union {
+    int (*fn)(fio_http_s *);
+    void *ptr;
+  } cb = {.ptr = cb_};
+  fio_http_s *h = (fio_http_s *)h_;
+  fio___http_connection_s *c = (fio___http_connection_s *)fio_http_cdata(h);
+  struct fio___http_connection_http_s old = c->state.http;
+  if (cb.fn(h))
+    goto refuse_upgrade;
+  if (c->h) /* request after WebSocket Upgrade? an attack vector? */
+    goto refuse_upgrade;
+  fio___websocket_deflate_negotiate(h, c);
+  fio_http_upgrade_websockets(h);
+  return;
+
+refuse_upgrade:
+  c->state.http = old;
+  fio_http_send_error_response(h, 403);
+  fio_http_free(h);
+}
+
+FIO_SFUNC void fio___http_perform_user_upgrade_callback_sse(void *cb_,
+                                                            void *h_) {
   union {
     int (*fn)(fio_http_s *);
     void *ptr;
@@ -37930,17 +42713,62 @@ http2_requested:
 #endif
 }
 
-FIO_SFUNC void fio___http_on_http_direct(void *h_, void *ignr) {
-  fio_http_s *h = (fio_http_s *)h_;
-  fio_http_status_set(h, 200);
+/** Continues a request released by the response cache. */
+FIO_SFUNC void fio___http_cache_on_release(fio_http_s *h, void *route_) {
   fio___http_connection_s *c = (fio___http_connection_s *)fio_http_cdata(h);
-  if (fio___http_on_http_test4upgrade(h, c))
+  fio_http_route_s *r = (fio_http_route_s *)route_;
+  union {
+    void (*fn)(fio_http_s *);
+    void *ptr;
+  } cb = {.fn = (r ? r->on_http : c->state.http.on_http)};
+  if (fio_http_is_finished(h)) {
+    /* sent from the cache, the connection may already be closed */
+    fio_http_free(h);
     return;
+  }
+  fio_queue_push(((r && r->queue) ? r->queue->q : c->queue),
+                 fio___http_perform_user_callback,
+                 cb.ptr,
+                 (void *)h);
+}
+
+/** Routes the request (if a router was set) and schedules `on_http`. */
+FIO_IFUNC void fio___http_on_http_dispatch(fio___http_connection_s *c,
+                                           fio_http_s *h) {
   union {
     void (*fn)(fio_http_s *);
     void *ptr;
   } cb = {.fn = c->state.http.on_http};
-  fio_queue_push(c->queue, fio___http_perform_user_callback, cb.ptr, (void *)h);
+  fio_queue_s *q = c->queue;
+  fio_http_route_s *r = NULL;
+  fio_http_cache_args_s cache = {.ttl = c->settings->cache_ttl,
+                                 .vary = c->settings->cache_vary,
+                                 .on_release = fio___http_cache_on_release};
+  if (c->settings->router &&
+      (r = fio_http_router_match(c->settings->router, h))) {
+    cb.fn = r->on_http;
+    if (r->udata)
+      fio_http_udata_set(h, r->udata);
+    if (r->queue)
+      q = r->queue->q;
+    if (r->cache_ttl) {
+      cache.ttl = r->cache_ttl;
+      cache.vary = r->cache_vary;
+    }
+    cache.udata = (void *)r;
+  }
+  if (cache.ttl && !fio_http_cache(h, cache))
+    return;
+  fio_queue_push(q, fio___http_perform_user_callback, cb.ptr, (void *)h);
+}
+
+FIO_SFUNC void fio___http_on_http_direct(void *h_, void *ignr) {
+  fio_http_s *h = (fio_http_s *)h_;
+  fio_http_status_set(h, 200);
+  fio___http_connection_s *c = (fio___http_connection_s *)fio_http_cdata(h);
+  if (fio___http_on_http_test4upgrade(h, c))
+    return;
+  fio___http_on_http_dispatch(c, h);
   (void)ignr;
 }
 
@@ -37959,11 +42787,7 @@ FIO_SFUNC void fio___http_on_http_with_public_folder(void *h_, void *ignr) {
     fio_http_free(h);
     return;
   }
-  union {
-    void (*fn)(fio_http_s *);
-    void *ptr;
-  } cb = {.fn = c->state.http.on_http};
-  fio_queue_push(c->queue, fio___http_perform_user_callback, cb.ptr, (void *)h);
+  fio___http_on_http_dispatch(c, h);
   (void)ignr;
 }
 
@@ -38000,7 +42824,9 @@ static void fio___http_listen_on_finished(fio_protocol_s *p, void *u) {
 void fio_http_listen___(void); /* IDE marker */
 SFUNC void *fio_http_listen FIO_NOOP(const char *url, fio_http_settings_s s) {
   http_settings_validate(&s, 0);
-  fio___http_protocol_s *p = fio___http_protocol_new(s.public_folder.len + 1);
+  fio___http_protocol_s *p = fio___http_protocol_new(
+      s.public_folder.len + s.static_headers.len + s.cache_vary.len +
+      s.compress_types.len + 1);
   fio_tls_s *auto_tls_detected = NULL;
   FIO_ASSERT_ALLOC(p);
   for (size_t i = 0; i < FIO___HTTP_PROTOCOL_NONE + 1; ++i) {
@@ -38046,14 +42872,33 @@ SFUNC void *fio_http_listen FIO_NOOP(const char *url, fio_http_settings_s s) {
     for (size_t i = 0; i < FIO___HTTP_PROTOCOL_NONE + 1; ++i)
       p->state[i].protocol.io_functions = *s.tls_io_func;
   }
+  if (s.router)
+    s.router = fio_http_router_dup(s.router);
   p->settings = s;
   p->on_http_callback = (p->settings.public_folder.len)
                             ? fio___http_on_http_with_public_folder
                             : fio___http_on_http_direct;
   p->settings.public_folder.buf = p->public_folder_buf;
+  p->settings.static_headers.buf = p->public_folder_buf + s.public_folder.len;
+  p->settings.cache_vary.buf =
+      p->settings.static_headers.buf + s.static_headers.len;
+  p->settings.compress_types.buf =
+      p->settings.cache_vary.buf + s.cache_vary.len;
   p->queue = p->settings.queue ? p->settings.queue->q : fio_srv_queue();
   if (s.public_folder.len)
     FIO_MEMCPY(p->public_folder_buf, s.public_folder.buf, s.public_folder.len);
+  if (s.static_headers.len)
+    FIO_MEMCPY(p->settings.static_headers.buf,
+               s.static_headers.buf,
+               s.static_headers.len);
+  if (s.cache_vary.len)
+    FIO_MEMCPY(p->settings.cache_vary.buf, s.cache_vary.buf, s.cache_vary.len);
+  if (s.compress_types.len)
+    FIO_MEMCPY(p->settings.compress_types.buf,
+               s.compress_types.buf,
+               s.compress_types.len);
+  p->public_folder_buf[s.public_folder.len + s.static_headers.len +
+                       s.cache_vary.len + s.compress_types.len] = 0;
   void *listener =
       fio_srv_listen(.url = url,
                      .protocol = &p->state[FIO___HTTP_PROTOCOL_ACCEPT].protocol,
@@ -38065,19 +42910,391 @@ SFUNC void *fio_http_listen FIO_NOOP(const char *url, fio_http_settings_s s) {
   return listener;
 }
 
+/* *****************************************************************************
+HTTP/1.1 Pipelining - sequencing and batching responses
+***************************************************************************** */
+
+FIO_SFUNC int fio___http1_process_data(fio_s *io, fio___http_connection_s *c);
+FIO_IFUNC void fio___http1_on_http_schedule(fio___http_connection_s *c,
+                                            fio_http_s *h,
+                                            char *body);
+
+/** Finds the (unfinished) slot for the HTTP handle. Call within lock. */
+FIO_IFUNC fio___http_pipeline_slot_s *fio___http_pipeline_find(
+    fio___http_pipeline_s *p,
+    fio_http_s *h) {
+  for (uint32_t i = 0, pos = p->head; i < p->count; ++i) {
+    if (p->slots[pos].h == h && !p->slots[pos].finished)
+      return p->slots + pos;
+    if (++pos == p->capa)
+      pos = 0;
+  }
+  return NULL;
+}
+
+/** Adds a request to the pipeline (reactor thread only). */
+FIO_SFUNC void fio___http_pipeline_add(fio___http_connection_s *c,
+                                       fio_http_s *h) {
+  fio___http_pipeline_s *p = c->pipeline;
+  uint32_t pos;
+  fio_lock(&p->lock);
+  pos = p->head + p->count;
+  if (pos >= p->capa)
+    pos -= p->capa;
+  p->slots[pos] = (fio___http_pipeline_slot_s){.h = h};
+  ++p->count;
+  fio_unlock(&p->lock);
+  if (p->count < p->capa)
+    return;
+  c->suspend = 1; /* pipeline is full, stop parsing until it drains. */
+  fio_srv_suspend(c->io);
+}
+
+/** Writes a batch of segments to the IO. Call within lock. */
+FIO_SFUNC void fio___http_pipeline_send(fio___http_connection_s *c,
+                                        fio___http_pipeline_seg_s *seg) {
+  char *batch = NULL;
+  const int is_open = c->io && fio_srv_is_open(c->io);
+  while (seg) {
+    fio___http_pipeline_seg_s *next = seg->next;
+    if (!is_open)
+      goto discard;
+    if (seg->args.dealloc == fio___http_pipeline_bstr_free) {
+      /* merge copied data into a single write */
+      if (!batch) {
+        batch = (char *)seg->args.buf;
+        seg->args.buf = NULL;
+      } else {
+        batch = fio_bstr_write(batch,
+                               seg->args.buf,
+                               fio_bstr_len((char *)seg->args.buf));
+      }
+      goto discard;
+    }
+    if (batch)
+      fio_write2(c->io,
+                 .buf = batch,
+                 .len = fio_bstr_len(batch),
+                 .dealloc = fio___http_pipeline_bstr_free);
+    batch = NULL;
+    fio_write2 FIO_NOOP(c->io, seg->args);
+    seg->args = (fio_write_args_s){.fd = -1};
+  discard:
+    fio___http_pipeline_seg_free(seg);
+    seg = next;
+  }
+  if (batch)
+    fio_write2(c->io,
+               .buf = batch,
+               .len = fio_bstr_len(batch),
+               .dealloc = fio___http_pipeline_bstr_free);
+}
+
+/** Sends all responses that are next in line and resumes parsing. */
+FIO_SFUNC void fio___http_pipeline_flush_task(void *c_, void *ignr_) {
+  fio___http_connection_s *c = (fio___http_connection_s *)c_;
+  fio___http_pipeline_s *p = c->pipeline;
+  fio_http_s *held = NULL;
+  char *held_body = NULL;
+  fio_lock(&p->lock);
+  p->flush_scheduled = 0;
+  while (p->count) {
+    fio___http_pipeline_slot_s *s = p->slots + p->head;
+    fio___http_pipeline_send(c, s->seg);
+    s->seg = s->last = NULL;
+    if (!s->finished)
+      break;
+    p->upgraded |= s->upgraded;
+    if (++p->head == p->capa)
+      p->head = 0;
+    --p->count;
+  }
+  if (!p->count && p->held) { /* upgrade requests are handled on their own */
+    held = p->held;
+    held_body = p->held_body;
+    p->held = NULL;
+    p->held_body = NULL;
+    p->slots[p->head] = (fio___http_pipeline_slot_s){.h = held};
+    ++p->count;
+  }
+  fio_unlock(&p->lock);
+  if (!c->io) { /* connection lost, the held request is never handled */
+    fio_bstr_free(held_body);
+    fio_http_free(held);
+    goto finish;
+  }
+  if (held) {
+    fio___http1_on_http_schedule(c, held, held_body);
+    goto finish;
+  }
+  if (p->closing) {
+    if (!p->count)
+      fio_close(c->io);
+    goto finish;
+  }
+  if (c->suspend && !p->held && !p->upgraded && p->count < p->capa &&
+      fio_srv_is_open(c->io)) {
+    c->suspend = 0;
+    fio___http1_process_data(c->io, c);
+    if (!c->suspend)
+      fio_srv_unsuspend(c->io);
+  }
+finish:
+  fio___http_connection_free(c);
+  (void)ignr_;
+}
+
+/** Schedules a flush task (if one isn't scheduled). Call within lock. */
+FIO_IFUNC int fio___http_pipeline_flush_schedule(fio___http_pipeline_s *p) {
+  if (p->flush_scheduled)
+    return 0;
+  p->flush_scheduled = 1;
+  return 1;
+}
+
+/** Appends a new segment to the slot. Call within lock. */
+FIO_SFUNC fio___http_pipeline_seg_s *fio___http_pipeline_seg_push(
+    fio___http_pipeline_slot_s *s,
+    fio_write_args_s args) {
+  fio___http_pipeline_seg_s *seg =
+      (fio___http_pipeline_seg_s *)FIO_MEM_REALLOC_(NULL, 0, sizeof(*seg), 0);
+  FIO_ASSERT_ALLOC(seg);
+  FIO___LEAK_COUNTER_ON_ALLOC(http___pipeline_segment);
+  *seg = (fio___http_pipeline_seg_s){.args = args};
+  if (s->last)
+    s->last->next = seg;
+  else
+    s->seg = seg;
+  s->last = seg;
+  return seg;
+}
+
+/**
+ * Buffers the data if the response must wait for its turn.
+ *
+ * Returns -1 if the data should be written directly to the IO.
+ */
+FIO_SFUNC int fio___http_pipeline_write(fio___http_connection_s *c,
+                                        fio_http_s *h,
+                                        fio_write_args_s args) {
+  fio___http_pipeline_s *p = c->pipeline;
+  fio___http_pipeline_slot_s *s;
+  int flush = 0;
+  fio_lock(&p->lock);
+  s = fio___http_pipeline_find(p, h);
+  if (!s)
+    goto not_pipelined;
+  if (s == p->slots + p->head) {
+    if (p->count == 1 && !s->seg)
+      goto write_directly; /* nothing to sequence or batch */
+    if (fio_http_is_streaming(h))
+      flush = fio___http_pipeline_flush_schedule(p);
+  }
+  if (args.buf && (args.copy || args.len < FIO_HTTP_PIPELINE_COPY_LIMIT)) {
+    /* copy small / volatile data, so it can be sent as part of a batch */
+    fio___http_pipeline_seg_s *seg = s->last;
+    if (!seg || seg->args.dealloc != fio___http_pipeline_bstr_free)
+      seg = fio___http_pipeline_seg_push(
+          s,
+          (fio_write_args_s){.fd = -1,
+                             .dealloc = fio___http_pipeline_bstr_free});
+    seg->args.buf = fio_bstr_write((char *)seg->args.buf,
+                                   (char *)args.buf + args.offset,
+                                   args.len);
+    if (args.dealloc)
+      args.dealloc(args.buf);
+  } else {
+    fio___http_pipeline_seg_push(s, args);
+  }
+  fio_unlock(&p->lock);
+  if (flush)
+    fio_srv_defer(fio___http_pipeline_flush_task,
+                  (void *)fio___http_connection_dup(c),
+                  NULL);
+  return 0;
+not_pipelined:
+  if (p->count && h == c->h)
+    goto discard; /* an early response (before `on_http`) can't be sequenced */
+write_directly:
+  fio_unlock(&p->lock);
+  return -1;
+discard: /* the connection is closed once pending responses were sent */
+  fio_unlock(&p->lock);
+  if (args.buf) {
+    if (args.dealloc)
+      args.dealloc(args.buf);
+  } else if (args.fd != -1) {
+    if (args.dealloc)
+      args.dealloc((void *)args.fd);
+    else if (!args.copy)
+      close((int)args.fd);
+  }
+  return 0;
+}
+
+/** Marks a pipelined response as finished. */
+FIO_SFUNC void fio___http_pipeline_finish(fio___http_connection_s *c,
+                                          fio_http_s *h) {
+  fio___http_pipeline_s *p = c->pipeline;
+  fio___http_pipeline_slot_s *s;
+  int flush = 0;
+  fio_lock(&p->lock);
+  s = fio___http_pipeline_find(p, h);
+  if (s) {
+    s->finished = 1;
+    s->upgraded = !!fio_http_is_upgraded(h);
+    if (s == p->slots + p->head)
+      flush = fio___http_pipeline_flush_schedule(p);
+  }
+  fio_unlock(&p->lock);
+  if (flush)
+    fio_srv_defer(fio___http_pipeline_flush_task,
+                  (void *)fio___http_connection_dup(c),
+                  NULL);
+}
+
+/** Closes the connection once all pending responses were sent. */
+FIO_SFUNC void fio___http_pipeline_close(fio___http_connection_s *c) {
+  fio___http_pipeline_s *p = c->pipeline;
+  c->suspend = 1;
+  fio_srv_suspend(c->io);
+  fio_lock(&p->lock);
+  p->closing = 1;
+  if (!p->count)
+    fio_close(c->io);
+  fio_unlock(&p->lock);
+}
+
+/** Writes response data, sequencing the data when pipelining. */
+FIO_IFUNC void fio___http1_write(fio___http_connection_s *c,
+                                 fio_http_s *h,
+                                 fio_write_args_s args) {
+  if (c->pipeline && !fio___http_pipeline_write(c, h, args))
+    return;
+  fio_write2 FIO_NOOP(c->io, args);
+}
+
+/* *****************************************************************************
+HTTP/1.1 Streamed Request Bodies
+***************************************************************************** */
+
+FIO_SFUNC void fio___http1_body_flush(fio___http_connection_s *c);
+
+/** Delivers the last of the streamed body data, then handles the request. */
+FIO_SFUNC void fio___http1_body_last_task(void *h_, void *body) {
+  fio_http_s *h = (fio_http_s *)h_;
+  fio___http_connection_s *c = (fio___http_connection_s *)fio_http_cdata(h);
+  c->settings->on_body_chunk(h, fio_bstr_buf((char *)body));
+  fio_bstr_free((char *)body);
+  if (fio_http_is_finished(h)) { /* responded from `on_body_chunk` */
+    fio_http_free(h);
+    return;
+  }
+  fio_queue_push(
+      fio_srv_queue(),
+      FIO_PTR_FROM_FIELD(fio___http_protocol_s, settings, c->settings)
+          ->on_http_callback,
+      h);
+}
+
+/** Resumes parsing once a body chunk was delivered (IO thread). */
+FIO_SFUNC void fio___http1_body_resume_task(void *c_, void *body) {
+  fio___http_connection_s *c = (fio___http_connection_s *)c_;
+  c->state.http.streaming = 0;
+  if (c->io && !c->state.http.body) { /* reuse the buffer */
+    c->state.http.body = fio_bstr_len_set((char *)body, 0);
+    body = NULL;
+  }
+  fio_bstr_free((char *)body);
+  if (!c->io || (c->pipeline && c->pipeline->closing))
+    goto finish;
+  c->suspend = 0;
+  if (fio_srv_is_open(c->io))
+    fio___http1_process_data(c->io, c);
+  fio___http1_body_flush(c); /* don't wait for more data, deliver it now */
+  if (!c->suspend)
+    fio_srv_unsuspend(c->io);
+finish:
+  fio___http_connection_free(c);
+}
+
+/** Delivers streamed body data, then resumes parsing. */
+FIO_SFUNC void fio___http1_body_chunk_task(void *h_, void *body) {
+  fio_http_s *h = (fio_http_s *)h_;
+  fio___http_connection_s *c =
+      fio___http_connection_dup((fio___http_connection_s *)fio_http_cdata(h));
+  c->settings->on_body_chunk(h, fio_bstr_buf((char *)body));
+  fio_http_free(h);
+  fio_srv_defer(fio___http1_body_resume_task, (void *)c, body);
+}
+
+/** Delivers any streamed body data, suspending the IO until it's handled. */
+FIO_SFUNC void fio___http1_body_flush(fio___http_connection_s *c) {
+  char *body = c->state.http.body;
+  if (!c->h || !body || !fio_bstr_len(body) || c->state.http.streaming)
+    return;
+  c->state.http.body = NULL;
+  c->state.http.streaming = 1;
+  c->suspend = 1;
+  fio_srv_suspend(c->io);
+  fio_queue_push(c->queue,
+                 fio___http1_body_chunk_task,
+                 (void *)fio_http_dup(c->h),
+                 (void *)body);
+}
+
 /* *****************************************************************************
 HTTP/1.1 Request / Response Completed
 ***************************************************************************** */
 
+/** Schedules the `on_http` callback, delivering any streamed body data. */
+FIO_IFUNC void fio___http1_on_http_schedule(fio___http_connection_s *c,
+                                            fio_http_s *h,
+                                            char *body) {
+  if (body && fio_bstr_len(body)) {
+    fio_queue_push(c->queue, fio___http1_body_last_task, (void *)h, body);
+    return;
+  }
+  fio_bstr_free(body);
+  fio_queue_push(fio_srv_queue(), c->state.http.on_http_callback, h);
+}
+
+/** Delivers a client's response and sends pending requests (IO thread). */
+FIO_SFUNC void fio___http_client_on_response(fio___http_connection_s *c);
+
 /** called when either a request or a response was received. */
 static void fio_http1_on_complete(void *udata) {
   fio___http_connection_s *c = (fio___http_connection_s *)udata;
+  if (c->is_client) {
+    fio___http_client_on_response(c);
+    return;
+  }
   fio_dup(c->io);
-  fio_srv_suspend(c->io);
+  fio___http_deadline_clear(c); /* the next request gets a new deadline */
   fio_http_s *h = c->h;
+  char *body = c->state.http.body;
   c->h = NULL;
+  c->state.http.body = NULL;
+  if (c->pipeline)
+    goto pipelined;
+  fio_srv_suspend(c->io);
   c->suspend = 1;
-  fio_queue_push(fio_srv_queue(), c->state.http.on_http_callback, h);
+  fio___http1_on_http_schedule(c, h, body);
+  return;
+
+pipelined:
+  if (fio_http_websockets_requested(h) || fio_http_sse_requested(h)) {
+    /* stop parsing, the connection might switch protocols */
+    c->suspend = 1;
+    fio_srv_suspend(c->io);
+    if (c->pipeline->count) { /* wait for pending responses */
+      c->pipeline->held = h;
+      c->pipeline->held_body = body;
+      return;
+    }
+  }
+  fio___http_pipeline_add(c, h);
+  fio___http1_on_http_schedule(c, h, body);
 }
 
 /* *****************************************************************************
@@ -38085,7 +43302,11 @@ HTTP/1.1 Parser callbacks
 ***************************************************************************** */
 
 FIO_IFUNC void fio_http1_attach_handle(fio___http_connection_s *c) {
-  c->h = fio_http_new();
+  c->h = c->spare ? fio_atomic_exchange(&c->spare, NULL) : NULL;
+  if (c->h)
+    fio_http_start_time_set(c->h);
+  else
+    c->h = fio_http_new();
   FIO_ASSERT_ALLOC(c->h);
   fio_http_controller_set(
       c->h,
@@ -38094,6 +43315,24 @@ FIO_IFUNC void fio_http1_attach_handle(fio___http_connection_s *c) {
            .controller);
   fio_http_udata_set(c->h, c->udata);
   fio_http_cdata_set(c->h, fio___http_connection_dup(c));
+  c->state.http.max_body = c->settings->max_body_size;
+  if (c->is_client)
+    return;
+  fio_http_compress_set(c->h,
+                        c->settings->compress_min,
+                        c->settings->compress_types);
+  c->state.http.streamed = 0;
+}
+
+/** Applies a route's body limit (if any), once the path is known. */
+FIO_SFUNC void fio___http_route_body_limit(fio___http_connection_s *c) {
+  fio___http_rparams_s p;
+  fio___http_rentry_s *e = fio___http_router_find(c->settings->router,
+                                                  fio_http_method(c->h),
+                                                  fio_http_path(c->h),
+                                                  &p);
+  if (e && e->route.max_body_size)
+    c->state.http.max_body = e->route.max_body_size;
 }
 
 /** called when a request method is parsed. */
@@ -38107,6 +43346,13 @@ static int fio_http1_on_method(fio_buf_info_s method, void *udata) {
 }
 /** called when a response status is parsed. the status_str is the string
  * without the prefixed numerical status indicator.*/
+/** Tests if a client's response has no body (HEAD, 1xx, 204 and 304). */
+FIO_IFUNC int fio___http_client_no_body(fio___http_connection_s *c) {
+  const size_t status = fio_http_status(c->h);
+  return (status < 200) | (status == 204) | (status == 304) |
+         (c->state.http.client.sent.head &&
+          c->state.http.client.sent.head->is_head);
+}
 static int fio_http1_on_status(size_t istatus,
                                fio_buf_info_s status,
                                void *udata) {
@@ -38115,6 +43361,8 @@ static int fio_http1_on_status(size_t istatus,
     return -1;
   fio_http1_attach_handle(c);
   fio_http_status_set(c->h, istatus);
+  if (c->is_client && !fio___http_client_no_body(c))
+    fio_http1_parser_until_close(&c->state.http.parser);
   return 0;
   (void)status;
 }
@@ -38127,6 +43375,8 @@ static int fio_http1_on_url(fio_buf_info_s url, void *udata) {
   fio_http_path_set(c->h, FIO_BUF2STR_INFO(u.path));
   if (u.query.len)
     fio_http_query_set(c->h, FIO_BUF2STR_INFO(u.query));
+  if (c->settings->router && c->settings->router->body_limits)
+    fio___http_route_body_limit(c);
   if (u.host.len)
     (!(c->h) ? fio_http_request_header_set
              : fio_http_response_header_set)(c->h,
@@ -38159,9 +43409,13 @@ static int fio_http1_on_header_content_length(fio_buf_info_s name,
                                               void *udata) {
   fio___http_connection_s *c = (fio___http_connection_s *)udata;
   fio_http_s *h = c->h;
-  if (content_length > c->settings->max_body_size)
+  if (c->is_client && fio___http_client_no_body(c)) {
+    c->state.http.parser.expected = 0; /* i.e., a response to a HEAD request */
+    return 0;
+  }
+  if (content_length > c->state.http.max_body)
     goto too_big;
-  if (content_length)
+  if (content_length && !(c->settings->on_body_chunk && !c->is_client))
     fio_http_body_expect(c->h, content_length);
 #if FIO_HTTP_SHOW_CONTENT_LENGTH_HEADER
   (!(h->status) ? fio_http_request_header_add
@@ -38171,8 +43425,12 @@ static int fio_http1_on_header_content_length(fio_buf_info_s name,
 #endif
   return 0;
 too_big:
+  if (c->is_client) /* the connection is closed and the request fails */
+    return -1;
   c->h = NULL;
   fio_dup(c->io);
+  if (c->pipeline)
+    fio___http_pipeline_add(c, h);
   fio_http_send_error_response(h, 413);
   fio_http_free(h);
   return -1;
@@ -38181,7 +43439,10 @@ too_big:
 /** called when `Expect` arrives and may require a 100 continue response. */
 static int fio_http1_on_expect(fio_buf_info_s expected, void *udata) {
   fio___http_connection_s *c = (fio___http_connection_s *)udata;
-  fio_write2(c->io, .buf = (char *)"100 Continue\r\n", .len = 14, .copy = 0);
+  fio_write2(c->io,
+             .buf = (char *)"HTTP/1.1 100 Continue\r\n\r\n",
+             .len = 25,
+             .copy = 0);
   return 0; /* TODO?: improve support for `expect` headers? */
   (void)expected;
 }
@@ -38189,10 +43450,18 @@ static int fio_http1_on_expect(fio_buf_info_s expected, void *udata) {
 /** called when a body chunk is parsed. */
 static int fio_http1_on_body_chunk(fio_buf_info_s chunk, void *udata) {
   fio___http_connection_s *c = (fio___http_connection_s *)udata;
-  if (chunk.len + fio_http_body_length(c->h) > c->settings->max_body_size)
+  if (c->settings->on_body_chunk && !c->is_client)
+    goto stream_body;
+  if (chunk.len + fio_http_body_length(c->h) > c->state.http.max_body)
     return -1;
   fio_http_body_write(c->h, chunk.buf, chunk.len);
   return 0;
+
+stream_body:
+  if ((c->state.http.streamed += chunk.len) > c->state.http.max_body)
+    return -1;
+  c->state.http.body = fio_bstr_write(c->state.http.body, chunk.buf, chunk.len);
+  return 0;
 }
 
 /* *****************************************************************************
@@ -38208,7 +43477,7 @@ FIO_SFUNC void fio___http_on_attach_accept(fio_s *io) {
                          fio_protocol_get(io));
   fio___http_protocol_dup(p);
   const uint32_t capa = p->settings.max_line_len;
-  fio___http_connection_s *c = fio___http_connection_new(capa);
+  fio___http_connection_s *c = fio___http_connection_new();
   FIO_ASSERT_ALLOC(c);
   *c = (fio___http_connection_s){
       .settings = &(p->settings),
@@ -38224,7 +43493,20 @@ FIO_SFUNC void fio___http_on_attach_accept(fio_s *io) {
       .capa = capa,
       .log = p->settings.log,
   };
+  if (p->settings.pipeline > 1)
+    c->pipeline = fio___http_pipeline_new(p->settings.pipeline);
+  if (c->log || p->settings.max_clients_per_ip) /* collected only once */
+    c->peer_len =
+        (uint8_t)fio_sock_peer_addr(c->peer, sizeof(c->peer), fio_fd_get(io));
   fio_udata_set(io, (void *)c);
+  if (p->settings.max_clients_per_ip &&
+      fio___http_ip_add(c, p->settings.max_clients_per_ip)) {
+    FIO_LOG_DDEBUG2("(%d) HTTP connection limit reached for %s",
+                    (int)fio_thread_getpid(),
+                    c->peer);
+    fio_close(io);
+    return;
+  }
   FIO_LOG_DDEBUG2("(%d) HTTP accepted a new connection (%p)",
                   (int)fio_thread_getpid(),
                   c->io);
@@ -38245,10 +43527,13 @@ FIO_SFUNC void fio___http1_accept_on_data(fio_s *io) {
       24);
   fio___http_connection_s *c = (fio___http_connection_s *)fio_udata_get(io);
   fio_protocol_s *phttp_new;
-  size_t r = fio_read(io, c->buf + c->len, c->capa - c->len);
-  if (!r) /* nothing happened */
+  size_t r = fio_read(io, fio___http_buffer(c) + c->len, c->capa - c->len);
+  if (!r) { /* nothing happened */
+    fio___http_buffer_release(c);
     return;
+  }
   c->len = r;
+  c->received = r;
   if (prior_knowledge.buf[0] != c->buf[0] ||
       FIO_MEMCMP(
           prior_knowledge.buf,
@@ -38270,6 +43555,7 @@ FIO_SFUNC void fio___http1_accept_on_data(fio_s *io) {
                 c->buf + prior_knowledge.len,
                 c->len - prior_knowledge.len);
   c->len -= prior_knowledge.len;
+  fio___http_buffer_release(c);
   phttp_new = &(FIO_PTR_FROM_FIELD(fio___http_protocol_s, settings, c->settings)
                     ->state[FIO___HTTP_PROTOCOL_HTTP2]
                     .protocol);
@@ -38283,7 +43569,11 @@ FIO_SFUNC void fio___http_on_close(void *udata) {
                   udata);
   fio___http_connection_s *c = (fio___http_connection_s *)udata;
   c->io = NULL;
+  fio___http_deadline_clear(c);
+  fio___http_ip_remove(c);
   fio_http_free(c->h);
+  fio_bstr_free(c->state.http.body);
+  c->state.http.body = NULL;
   fio___http_connection_free(c);
 }
 
@@ -38292,29 +43582,55 @@ HTTP/1.1 Protocol
 ***************************************************************************** */
 
 FIO_SFUNC int fio___http1_process_data(fio_s *io, fio___http_connection_s *c) {
-  (void)io, (void)c;
-  size_t consumed = fio_http1_parse(&c->state.http.parser,
-                                    FIO_BUF_INFO2(c->buf, c->len),
-                                    (void *)c);
-  if (!consumed)
+  size_t consumed, total = 0;
+  if (c->state.http.streaming) { /* wait for the body chunk to be handled */
+    c->suspend = 1;
     return -1;
-  if (consumed == FIO_HTTP1_PARSER_ERROR)
-    goto http1_error;
-  c->len -= consumed;
+  }
+  while (total < c->len) { /* pipelined requests are parsed without waiting */
+    consumed = fio_http1_parse(&c->state.http.parser,
+                               FIO_BUF_INFO2(c->buf + total, c->len - total),
+                               (void *)c);
+    if (consumed == FIO_HTTP1_PARSER_ERROR)
+      goto http1_error;
+    total += consumed;
+    if (!consumed || c->suspend)
+      break;
+  }
+  fio___http1_deadline_update(c, c->len - total);
+  if (!total)
+    return -1;
+  c->len -= total;
   if (c->len)
-    FIO_MEMMOVE(c->buf, c->buf + consumed, c->len);
+    FIO_MEMMOVE(c->buf, c->buf + total, c->len);
+  else
+    fio___http_buffer_release(c);
+  if (c->state.http.body &&
+      fio_bstr_len(c->state.http.body) >= FIO_HTTP_BODY_STREAM_LIMIT)
+    fio___http1_body_flush(c);
   if (c->suspend)
     return -1;
   return 0;
 
 http1_error:
+  if (c->is_client) {
+    c->state.http.client.closing = 2; /* don't retry, the response was bad */
+    fio_close(io);
+    return -1;
+  }
   if (c->h) {
     fio_http_s *h = c->h;
     c->h = NULL;
     fio_dup(c->io);
+    if (c->pipeline)
+      fio___http_pipeline_add(c, h);
     fio_http_send_error_response(h, 400);
     fio_http_free(h);
   }
+  if (c->pipeline) {
+    fio___http_pipeline_close(c);
+    return -1;
+  }
   fio_close(io);
   return -1;
 }
@@ -38326,12 +43642,15 @@ FIO_SFUNC void fio___http1_on_data(fio_s *io) {
   for (;;) {
     if (c->capa == c->len)
       return;
-    if (!(r = fio_read(io, c->buf + c->len, c->capa - c->len)))
-      return;
+    if (!(r = fio_read(io, fio___http_buffer(c) + c->len, c->capa - c->len)))
+      break;
     c->len += r;
+    c->received += r;
     if (fio___http1_process_data(io, c))
       return;
   }
+  fio___http_buffer_release(c);
+  fio___http1_body_flush(c); /* no more data for now, deliver streamed body */
 }
 
 // /** Called when an IO is attached to a protocol. */
@@ -38346,20 +43665,135 @@ FIO_SFUNC void fio___http1_on_attach(fio_s *io) {
 HTTP/1 Controller
 ***************************************************************************** */
 
-/** called by the HTTP handle for each header. */
+/** called by the HTTP handle for each header - collects the exact length. */
+FIO_SFUNC int fio_http1___header_length_callback(fio_http_s *h,
+                                                 fio_str_info_s name,
+                                                 fio_str_info_s value,
+                                                 void *len_) {
+  *(size_t *)len_ += name.len + value.len + 3;
+  return 0;
+  (void)h;
+}
+
+/** called by the HTTP handle for each header (buffer size is pre-computed). */
 FIO_SFUNC int fio_http1___write_header_callback(fio_http_s *h,
                                                 fio_str_info_s name,
                                                 fio_str_info_s value,
-                                                void *out_) {
+                                                void *pos_) {
+  char **pos = (char **)pos_;
+  FIO_MEMCPY(*pos, name.buf, name.len);
+  (*pos)[name.len] = ':';
+  *pos += name.len + 1;
+  FIO_MEMCPY(*pos, value.buf, value.len);
+  (*pos)[value.len] = '\r';
+  (*pos)[value.len + 1] = '\n';
+  *pos += value.len + 2;
+  return 0;
   (void)h;
-  /* manually copy, as this is an "all or nothing" copy (no truncation) */
-  fio_str_info_s *out = (fio_str_info_s *)out_;
-  return fio_string_write2(out,
-                           FIO_STRING_REALLOC,
-                           FIO_STRING_WRITE_STR2(name.buf, name.len),
-                           FIO_STRING_WRITE_STR2(":", 1),
-                           FIO_STRING_WRITE_STR2(value.buf, value.len),
-                           FIO_STRING_WRITE_STR2("\r\n", 2));
+}
+
+/** Returns a pre-rendered HTTP/1.1 status line for common status codes. */
+FIO_IFUNC fio_str_info_s fio___http1_status_line_cached(size_t status) {
+#define FIO___HTTP1_STATUS_LINE(code, str)                                     \
+  case code:                                                                   \
+    return FIO_STR_INFO2((char *)"HTTP/1.1 " #code " " str "\r\n",             \
+                         sizeof("HTTP/1.1 " #code " " str "\r\n") - 1)
+  switch (status) {
+    FIO___HTTP1_STATUS_LINE(101, "Switching Protocols");
+    FIO___HTTP1_STATUS_LINE(200, "OK");
+    FIO___HTTP1_STATUS_LINE(201, "Created");
+    FIO___HTTP1_STATUS_LINE(202, "Accepted");
+    FIO___HTTP1_STATUS_LINE(204, "No Content");
+    FIO___HTTP1_STATUS_LINE(206, "Partial Content");
+    FIO___HTTP1_STATUS_LINE(301, "Moved Permanently");
+    FIO___HTTP1_STATUS_LINE(302, "Found");
+    FIO___HTTP1_STATUS_LINE(303, "See Other");
+    FIO___HTTP1_STATUS_LINE(304, "Not Modified");
+    FIO___HTTP1_STATUS_LINE(307, "Temporary Redirect");
+    FIO___HTTP1_STATUS_LINE(400, "Bad Request");
+    FIO___HTTP1_STATUS_LINE(401, "Unauthorized");
+    FIO___HTTP1_STATUS_LINE(403, "Forbidden");
+    FIO___HTTP1_STATUS_LINE(404, "Not Found");
+    FIO___HTTP1_STATUS_LINE(405, "Method Not Allowed");
+    FIO___HTTP1_STATUS_LINE(413, "Content Too Large");
+    FIO___HTTP1_STATUS_LINE(500, "Internal Server Error");
+    FIO___HTTP1_STATUS_LINE(502, "Bad Gateway");
+    FIO___HTTP1_STATUS_LINE(503, "Service Unavailable");
+  }
+#undef FIO___HTTP1_STATUS_LINE
+  return FIO_STR_INFO2(NULL, 0);
+}
+
+/** Writes the status line to `dest` (if not NULL), returns its length. */
+FIO_SFUNC size_t fio___http1_status_line(char *dest, fio_http_s *h) {
+  const size_t status = fio_http_status(h);
+  fio_str_info_s ver = fio_http_version(h);
+  fio_str_info_s line = fio___http1_status_line_cached(status);
+  fio_str_info_s reason;
+  size_t len;
+  if (line.buf &&
+      (!ver.len ||
+       FIO_STR_INFO_IS_EQ(ver, FIO_STR_INFO2((char *)"HTTP/1.1", 8)))) {
+    if (dest)
+      FIO_MEMCPY(dest, line.buf, line.len);
+    return line.len;
+  }
+  if (ver.len > 15) {
+    if (!dest)
+      FIO_LOG_ERROR("HTTP/1.1 client version string too long!");
+    ver.len = 0;
+  }
+  if (!ver.len)
+    ver = FIO_STR_INFO2((char *)"HTTP/1.1", 8);
+  reason = fio_http_status2str(status);
+  len = ver.len + reason.len + fio_digits10u(status) + 4;
+  if (!dest)
+    return len;
+  FIO_MEMCPY(dest, ver.buf, ver.len);
+  dest += ver.len;
+  *(dest++) = ' ';
+  fio_ltoa10u(dest, status, fio_digits10u(status));
+  dest += fio_digits10u(status);
+  *(dest++) = ' ';
+  FIO_MEMCPY(dest, reason.buf, reason.len);
+  dest += reason.len;
+  dest[0] = '\r';
+  dest[1] = '\n';
+  return len;
+}
+
+/**
+ * Writes the response head to `dest` (if not NULL), returns its length.
+ *
+ * When `dest` is NULL, the exact length is computed without writing.
+ */
+FIO_SFUNC size_t fio___http1_head(char *dest,
+                                  fio_http_s *h,
+                                  fio_str_info_s static_headers) {
+  const size_t streaming = (fio_http_is_streaming(h) ? 28 : 0);
+  char *pos = dest;
+  size_t len;
+  if (!dest) {
+    len = fio___http1_status_line(NULL, h) + static_headers.len + streaming + 2;
+    fio_http_response_header_each(h, fio_http1___header_length_callback, &len);
+    fio_http_set_cookie_each(h, fio_http1___header_length_callback, &len);
+    return len;
+  }
+  /* write status line, headers, cookies and static headers */
+  pos += fio___http1_status_line(pos, h);
+  fio_http_response_header_each(h, fio_http1___write_header_callback, &pos);
+  fio_http_set_cookie_each(h, fio_http1___write_header_callback, &pos);
+  if (static_headers.len) {
+    FIO_MEMCPY(pos, static_headers.buf, static_headers.len);
+    pos += static_headers.len;
+  }
+  if (streaming) { /* add streaming headers */
+    FIO_MEMCPY(pos, "transfer-encoding: chunked\r\n", 28);
+    pos += 28;
+  }
+  *(pos++) = '\r';
+  *(pos++) = '\n';
+  return (size_t)(pos - dest);
 }
 
 /** Informs the controller that request / response headers must be sent. */
@@ -38367,40 +43801,30 @@ FIO_SFUNC void fio___http_controller_http1_send_headers(fio_http_s *h) {
   fio___http_connection_s *c = (fio___http_connection_s *)fio_http_cdata(h);
   if (!c->io || !fio_srv_is_open(c->io))
     return;
-  fio_str_info_s buf = FIO_STR_INFO2(NULL, 0);
-  { /* write status string */
-    fio_str_info_s ver = fio_http_version(h);
-    fio_str_info_s status = fio_http_status2str(fio_http_status(h));
-    if (ver.len > 15) {
-      FIO_LOG_ERROR("HTTP/1.1 client version string too long!");
-      ver = FIO_STR_INFO1((char *)"HTTP/1.1");
+  char tmp[4096];
+  /* compute exact length */
+  size_t len = fio___http1_head(NULL, h, c->settings->static_headers);
+  /* small headers are copied by the stream (a single allocation) */
+  fio_str_info_s buf = FIO_STR_INFO3(tmp, 0, sizeof(tmp));
+  if (len > sizeof(tmp)) {
+    buf = FIO_STR_INFO2(NULL, 0);
+    if (FIO_STRING_REALLOC(&buf, len)) {
+      FIO_LOG_ERROR("HTTP/1.1 couldn't allocate memory for response headers");
+      fio_close(c->io);
+      return;
     }
-    fio_string_write2(&buf,
-                      FIO_STRING_REALLOC,
-                      FIO_STRING_WRITE_STR2(ver.buf, ver.len),
-                      FIO_STRING_WRITE_STR2(" ", 1),
-                      FIO_STRING_WRITE_NUM(fio_http_status(h)),
-                      FIO_STRING_WRITE_STR2(" ", 1),
-                      FIO_STRING_WRITE_STR2(status.buf, status.len),
-                      FIO_STRING_WRITE_STR2("\r\n", 2));
-  }
-  /* write headers */
-  fio_http_response_header_each(h, fio_http1___write_header_callback, &buf);
-  /* write cookies */
-  fio_http_set_cookie_each(h, fio_http1___write_header_callback, &buf);
-  /* add streaming headers? */
-  if (fio_http_is_streaming(h))
-    fio_string_write(&buf,
-                     FIO_STRING_REALLOC,
-                     "transfer-encoding: chunked\r\n",
-                     28);
-  fio_string_write(&buf, FIO_STRING_REALLOC, "\r\n", 2);
-  /* send data (move memory ownership) */
-  fio_write2(c->io,
-             .buf = buf.buf,
-             .len = buf.len,
-             .copy = 0,
-             .dealloc = FIO_STRING_FREE);
+  }
+  buf.len = fio___http1_head(buf.buf, h, c->settings->static_headers);
+  FIO_ASSERT_DEBUG(buf.len == len, "HTTP/1.1 header length miscalculated");
+  /* send data (move memory ownership, unless on the stack) */
+  fio___http1_write(c,
+                    h,
+                    (fio_write_args_s){.buf = buf.buf,
+                                       .len = buf.len,
+                                       .copy = (buf.buf == tmp),
+                                       .dealloc = ((buf.buf == tmp)
+                                                       ? NULL
+                                                       : FIO_STRING_FREE)});
 }
 /** called by the HTTP handle for each body chunk (or to finish a response. */
 FIO_SFUNC void fio___http_controller_http1_write_body(
@@ -38411,36 +43835,81 @@ FIO_SFUNC void fio___http_controller_http1_write_body(
     goto no_write_err;
   if (fio_http_is_streaming(h))
     goto stream_chunk;
-  fio_write2(c->io,
-             .buf = (void *)args.buf,
-             .len = args.len,
-             .fd = args.fd,
-             .offset = args.offset,
-             .dealloc = args.dealloc,
-             .copy = (uint8_t)args.copy);
+  fio___http1_write(c,
+                    h,
+                    (fio_write_args_s){.buf = (void *)args.buf,
+                                       .len = args.len,
+                                       .fd = args.fd,
+                                       .offset = args.offset,
+                                       .dealloc = args.dealloc,
+                                       .copy = (uint8_t)args.copy});
   return;
 stream_chunk:
-  if (args.len) { /* print chunk header */
+  if (!args.len) { /* an empty chunk would end the (chunked) response */
+    FIO_LOG_ERROR("HTTP1 streaming requires a correctly pre-determined "
+                  "length per chunk.");
+    goto no_write_err;
+  }
+  if (args.buf && (args.copy || args.len < FIO_HTTP_CHUNK_COPY_LIMIT)) {
+    /* frame the chunk in a single packet (header, data and trailer) */
+    char tmp[4096];
+    const size_t digits = fio_digits16u(args.len);
+    const size_t len = digits + args.len + 4;
+    fio_str_info_s buf = FIO_STR_INFO3(tmp, 0, sizeof(tmp));
+    if (len > sizeof(tmp)) {
+      buf = FIO_STR_INFO2(NULL, 0);
+      if (FIO_STRING_REALLOC(&buf, len)) {
+        FIO_LOG_ERROR("HTTP/1.1 couldn't allocate memory for response chunk");
+        fio_close(c->io);
+        goto no_write_err;
+      }
+    }
+    fio_ltoa16u(buf.buf, args.len, digits);
+    buf.buf[digits] = '\r';
+    buf.buf[digits + 1] = '\n';
+    FIO_MEMCPY(buf.buf + digits + 2,
+               (char *)args.buf + args.offset,
+               args.len);
+    buf.buf[len - 2] = '\r';
+    buf.buf[len - 1] = '\n';
+    if (args.dealloc)
+      args.dealloc((void *)args.buf);
+    /* small chunks are copied by the stream (a single allocation) */
+    fio___http1_write(c,
+                      h,
+                      (fio_write_args_s){.buf = buf.buf,
+                                         .len = len,
+                                         .copy = (buf.buf == tmp),
+                                         .dealloc = ((buf.buf == tmp)
+                                                         ? NULL
+                                                         : FIO_STRING_FREE)});
+    return;
+  }
+  { /* large buffers and files aren't copied, the framing is written apart */
     char buf[24];
     fio_str_info_s i = FIO_STR_INFO3(buf, 0, 24);
     fio_string_write_hex(&i, NULL, args.len);
     fio_string_write(&i, NULL, "\r\n", 2);
-    fio_write2(c->io, .buf = (void *)i.buf, .len = i.len, .copy = 1);
-  } else {
-    FIO_LOG_ERROR("HTTP1 streaming requires a correctly pre-determined "
-                  "length per chunk.");
-  }
-  fio_write2(c->io,
-             .buf = (void *)args.buf,
-             .len = args.len,
-             .fd = args.fd,
-             .offset = args.offset,
-             .dealloc = args.dealloc,
-             .copy = (uint8_t)args.copy);
+    fio___http1_write(
+        c,
+        h,
+        (fio_write_args_s){.buf = (void *)i.buf, .len = i.len, .copy = 1});
+  }
+  fio___http1_write(c,
+                    h,
+                    (fio_write_args_s){.buf = (void *)args.buf,
+                                       .len = args.len,
+                                       .fd = args.fd,
+                                       .offset = args.offset,
+                                       .dealloc = args.dealloc,
+                                       .copy = (uint8_t)args.copy});
   /* print chunk trailer */
   {
     fio_buf_info_s trailer = FIO_BUF_INFO2((char *)"\r\n", 2);
-    fio_write2(c->io, .buf = trailer.buf, .len = trailer.len, .copy = 1);
+    fio___http1_write(
+        c,
+        h,
+        (fio_write_args_s){.buf = trailer.buf, .len = trailer.len, .copy = 1});
   }
   return;
 no_write_err:
@@ -38448,16 +43917,21 @@ no_write_err:
     if (args.dealloc)
       args.dealloc((void *)args.buf);
   } else if (args.fd != -1) {
-    close(args.fd);
+    if (args.dealloc)
+      args.dealloc((void *)(intptr_t)args.fd);
+    else
+      close(args.fd);
   }
 }
 
 FIO_SFUNC void fio___http_controller_http1_on_finish_task(void *c_,
                                                           void *upgraded) {
   fio___http_connection_s *c = (fio___http_connection_s *)c_;
-  c->suspend = 0;
   if (upgraded)
     goto upgraded;
+  if (c->pipeline) /* parsing is resumed once the response was sent */
+    goto pipelined;
+  c->suspend = 0;
   if (fio_srv_is_open(c->io)) {
     fio___http1_process_data(c->io, c);
   }
@@ -38466,7 +43940,13 @@ FIO_SFUNC void fio___http_controller_http1_on_finish_task(void *c_,
   fio_undup(c->io);
   return;
 
+pipelined:
+  fio_undup(c->io);
+  return;
+
 upgraded:
+  c->suspend = 0;
+  fio___http_deadline_clear(c);
   if (c->h || !fio_srv_is_open(c->io))
     goto something_is_wrong;
   c->h = (fio_http_s *)upgraded;
@@ -38502,16 +43982,47 @@ something_is_wrong:
   fio___http_connection_free(c); /* free HTTP connection element */
 }
 
+/** Closes a connection that responded before the request body was read. */
+FIO_SFUNC void fio___http1_finished_early_task(void *c_, void *ignr_) {
+  fio___http_connection_s *c = (fio___http_connection_s *)c_;
+  if (!c->io)
+    goto finish;
+  if (c->pipeline)
+    fio___http_pipeline_close(c); /* send pending responses first */
+  else
+    fio_close(c->io);
+finish:
+  fio___http_connection_free(c);
+  (void)ignr_;
+}
+
 /** called once a request / response had finished */
 FIO_SFUNC void fio___http_controller_http1_on_finish(fio_http_s *h) {
   fio___http_connection_s *c = (fio___http_connection_s *)fio_http_cdata(h);
   if (fio_http_is_streaming(h))
-    fio_write2(c->io, .buf = (char *)"0\r\n\r\n", .len = 5, .copy = 1);
+    fio___http1_write(
+        c,
+        h,
+        (fio_write_args_s){.buf = (char *)"0\r\n\r\n", .len = 5, .copy = 1});
   if (c->log)
-    fio_http_write_log(h, FIO_BUF_INFO2(NULL, 0)); /* TODO: get_peer_addr */
+    fio_http_write_log(h, FIO_BUF_INFO2(c->peer, c->peer_len));
+  if (c->pipeline)
+    fio___http_pipeline_finish(c, h);
+  if (!c->io) /* connection lost before the request was handed off */
+    return;
+  /* `fio_http1_on_complete` hands the handle off (`c->h = NULL`) when calling
+   * `fio_dup`. Until then, the IO wasn't duplicated nor suspended for us. */
+  if (h == c->h)
+    goto finished_early;
   fio_srv_defer(fio___http_controller_http1_on_finish_task,
                 (void *)(c),
                 fio_http_is_upgraded(h) ? (void *)h : NULL);
+  return;
+
+finished_early: /* from `on_body_chunk`, the rest of the body is never read */
+  fio_srv_defer(fio___http1_finished_early_task,
+                (void *)fio___http_connection_dup(c),
+                NULL);
 }
 
 /* *****************************************************************************
@@ -38601,6 +44112,67 @@ FIO_SFUNC void fio_websocket_on_message(void *udata,
   (void)msg;
 }
 
+/** Returns the expected UTF-8 sequence length for a lead byte (0 if invalid) */
+FIO_IFUNC size_t fio___websocket_utf8_seq_len(uint8_t c) {
+  return (c < 0x80)            ? 1
+         : ((c & 0xE0) == 0xC0) ? 2
+         : ((c & 0xF0) == 0xE0) ? 3
+         : ((c & 0xF8) == 0xF0) ? 4
+                                : 0;
+}
+
+/** Validates streamed UTF-8 text, where chunks may split a code point. */
+FIO_SFUNC int fio___websocket_utf8_stream(fio___http_connection_s *c,
+                                          fio_buf_info_s chunk,
+                                          uint8_t is_last) {
+  size_t tail = 0;
+  if (c->state.ws.utf8_len) { /* complete the code point from the last chunk */
+    size_t l = fio___websocket_utf8_seq_len((uint8_t)c->state.ws.utf8[0]);
+    while (c->state.ws.utf8_len < l && chunk.len) {
+      c->state.ws.utf8[c->state.ws.utf8_len++] = *chunk.buf++;
+      --chunk.len;
+    }
+    if (c->state.ws.utf8_len < l)
+      return (is_last ? -1 : 0);
+    if (fio_string_utf8_valid_code_point(c->state.ws.utf8, l) != l)
+      return -1;
+    c->state.ws.utf8_len = 0;
+  }
+  /* look for a code point that continues in the next chunk */
+  for (size_t i = 1; i < 4 && i <= chunk.len; ++i) {
+    uint8_t u = (uint8_t)chunk.buf[chunk.len - i];
+    if ((u & 0xC0) == 0x80)
+      continue;
+    if (fio___websocket_utf8_seq_len(u) > i)
+      tail = i;
+    break;
+  }
+  if (tail && is_last)
+    return -1;
+  if (!fio_string_utf8_valid(FIO_STR_INFO2(chunk.buf, chunk.len - tail)))
+    return -1;
+  FIO_MEMCPY(c->state.ws.utf8, chunk.buf + chunk.len - tail, tail);
+  c->state.ws.utf8_len = (uint8_t)tail;
+  return 0;
+}
+
+/** Called with each (unmasked) chunk of a streamed message. */
+FIO_SFUNC int fio_websocket_on_message_partial(void *udata,
+                                               fio_buf_info_s chunk,
+                                               unsigned char is_text,
+                                               unsigned char is_first,
+                                               unsigned char is_last) {
+  fio___http_connection_s *c = (fio___http_connection_s *)udata;
+  if (is_text && fio___websocket_utf8_stream(c, chunk, is_last))
+    return -1;
+  c->settings->on_message_partial(c->h, chunk, is_text, is_first, is_last);
+  if (is_last) { /* compressed messages are inflated to `msg` */
+    fio_bstr_free(c->state.ws.msg);
+    c->state.ws.msg = NULL;
+  }
+  return 0;
+}
+
 /**
  * Called when the parser needs to copy the message to an external buffer.
  *
@@ -38622,9 +44194,16 @@ FIO_SFUNC fio_buf_info_s fio_websocket_write_partial(void *udata,
 FIO_SFUNC fio_buf_info_s fio_websocket_decompress(void *udata,
                                                   fio_buf_info_s msg) {
   fio___http_connection_s *c = (fio___http_connection_s *)udata;
-  FIO_LOG_ERROR("WebSocket permessage-deflate not yet implemented!");
-  (void)c;
-  return msg;
+  char *inflated;
+  /* append the removed 0x00 0x00 0xFF 0xFF tail (RFC 7692, section 7.2.2) */
+  c->state.ws.msg = fio_bstr_write(c->state.ws.msg, "\x00\x00\xFF\xFF", 4);
+  msg = fio_bstr_buf(c->state.ws.msg);
+  inflated = fio___websocket_inflate(c, msg);
+  if (!inflated) /* protocol error (RSV1 without negotiation?) */
+    return (fio_buf_info_s){0};
+  fio_bstr_free(c->state.ws.msg);
+  c->state.ws.msg = inflated;
+  return fio_bstr_buf(inflated);
 }
 
 /** Called when a `ping` message was received. */
@@ -38691,17 +44270,21 @@ WebSocket Protocol
 
 FIO_SFUNC int fio___websocket_process_data(fio_s *io,
                                            fio___http_connection_s *c) {
-  (void)io, (void)c;
-  size_t consumed = fio_websocket_parse(&c->state.ws.parser,
-                                        FIO_BUF_INFO2(c->buf, c->len),
-                                        (void *)c);
-  if (!consumed)
-    return -1;
-  if (consumed == FIO_WEBSOCKET_PARSER_ERROR)
-    goto ws_error;
-  c->len -= consumed;
-  if (c->len)
-    FIO_MEMMOVE(c->buf, c->buf + consumed, c->len);
+  (void)io;
+  while (c->len && !c->suspend) { /* the parser stops after each message */
+    size_t consumed = fio_websocket_parse(&c->state.ws.parser,
+                                          FIO_BUF_INFO2(c->buf, c->len),
+                                          (void *)c);
+    if (!consumed)
+      break; /* incomplete frame header, wait for more data */
+    if (consumed == FIO_WEBSOCKET_PARSER_ERROR)
+      goto ws_error;
+    c->len -= consumed;
+    if (c->len)
+      FIO_MEMMOVE(c->buf, c->buf + consumed, c->len);
+  }
+  if (!c->len)
+    fio___http_buffer_release(c);
   if (c->suspend)
     return -1;
   return 0;
@@ -38719,8 +44302,10 @@ FIO_SFUNC void fio___websocket_on_data(fio_s *io) {
   for (;;) {
     if (c->capa == c->len)
       return;
-    if (!(r = fio_read(io, c->buf + c->len, c->capa - c->len)))
+    if (!(r = fio_read(io, fio___http_buffer(c) + c->len, c->capa - c->len))) {
+      fio___http_buffer_release(c);
       return;
+    }
     c->len += r;
     if (fio___websocket_process_data(io, c))
       return;
@@ -38747,7 +44332,9 @@ FIO_SFUNC void fio___websocket_on_attach(fio_s *io) {
   fio_http_s *h = c->h;
   c->state.ws = (struct fio___http_connection_ws_s){
       .on_message = c->settings->on_message,
+      .parser.stream = !!c->settings->on_message_partial,
   };
+  fio___websocket_deflate_setup(c);
   c->settings->on_open(h);
   fio___websocket_process_data(io, c);
 }
@@ -38760,6 +44347,7 @@ FIO_SFUNC void fio___websocket_on_close(void *udata) {
   fio___http_connection_s *c = (fio___http_connection_s *)udata;
   c->io = NULL;
   fio_bstr_free(c->state.ws.msg);
+  fio___websocket_deflate_destroy(c);
   fio_http_free(c->h);
   fio___http_connection_free(c);
 }
@@ -38788,13 +44376,68 @@ SFUNC int fio_http_on_message_set(fio_http_s *h,
 WebSocket Writing / Subscription Helpers
 ***************************************************************************** */
 
+/** Tests if a message should be sent as UTF-8 text (for direct writes). */
+FIO_IFUNC uint8_t fio___http_websocket_is_text(fio_str_info_s msg) {
+  return (msg.len < FIO_HTTP_WEBSOCKET_WRITE_VALIDITY_TEST_LIMIT) &&
+         fio_string_utf8_valid(msg);
+}
+
+/* Pub/Sub message cache: the message, framed once for all connections. */
+FIO_SFUNC void *fio___http_websocket_frame(fio_str_info_s ch,
+                                           fio_str_info_s msg,
+                                           int16_t filter,
+                                           uint8_t is_json) {
+  char *frame = fio_bstr_reserve(NULL, fio_websocket_wrapped_len(msg.len));
+  frame = fio_bstr_len_set(
+      frame,
+      fio_websocket_server_wrap(frame,
+                                msg.buf,
+                                msg.len,
+                                (fio___http_websocket_is_text(msg) ? 1 : 2),
+                                1,
+                                1,
+                                0));
+  return (void *)frame;
+  (void)ch, (void)filter, (void)is_json;
+}
+
+FIO_SFUNC void fio___http_websocket_frame_free(void *frame) {
+  fio_bstr_free((char *)frame);
+}
+
+/* opcode: 1 = text, 2 = binary, 0 = test message (text if UTF-8 valid) */
 FIO_IFUNC void fio___http_websocket_subscribe_imp(fio_msg_s *msg,
-                                                  uint8_t is_text) {
+                                                  uint8_t opcode) {
   fio___http_connection_s *c =
       (fio___http_connection_s *)fio_udata_get(msg->io);
+  char *frame;
   if (!c)
     return;
-  fio_http_websocket_write(c->h, msg->message.buf, msg->message.len, is_text);
+  if (c->is_client || !c->h || !fio_http_is_websocket(c->h))
+    goto write_message;
+#if HAVE_ZLIB
+  if (c->state.ws.deflate.on && msg->message.len >= c->state.ws.deflate.min)
+    goto write_message;
+#endif
+  frame = (char *)fio_message_cache(msg,
+                                    fio___http_websocket_frame,
+                                    fio___http_websocket_frame_free);
+  /* the shared frame's opcode must match (a single write, never split) */
+  if (!frame || (opcode && opcode != (frame[0] & 15)))
+    goto write_message;
+  fio_write2(c->io,
+             .buf = fio_bstr_copy(frame),
+             .len = fio_bstr_len(frame),
+             .dealloc = (void (*)(void *))fio_bstr_free);
+  return;
+
+write_message:
+  if (!opcode)
+    opcode = 2 - fio___http_websocket_is_text(msg->message);
+  fio_http_websocket_write(c->h,
+                           msg->message.buf,
+                           msg->message.len,
+                           (opcode == 1));
 }
 
 /** Optional WebSocket subscription callback - all messages are UTF-8 valid. */
@@ -38803,16 +44446,12 @@ SFUNC void FIO_HTTP_WEBSOCKET_SUBSCRIBE_DIRECT_TEXT(fio_msg_s *msg) {
 }
 /** Optional WebSocket subscription callback - messages may be non-UTF-8. */
 SFUNC void FIO_HTTP_WEBSOCKET_SUBSCRIBE_DIRECT_BINARY(fio_msg_s *msg) {
-  fio___http_websocket_subscribe_imp(msg, 0);
+  fio___http_websocket_subscribe_imp(msg, 2);
 }
 
 /** Optional WebSocket subscription callback. */
 SFUNC void FIO_HTTP_WEBSOCKET_SUBSCRIBE_DIRECT(fio_msg_s *msg) {
-  ((msg->message.len < FIO_HTTP_WEBSOCKET_WRITE_VALIDITY_TEST_LIMIT) &&
-           (fio_string_utf8_valid(
-               FIO_STR_INFO2((char *)msg->message.buf, msg->message.len)))
-       ? FIO_HTTP_WEBSOCKET_SUBSCRIBE_DIRECT_TEXT
-       : FIO_HTTP_WEBSOCKET_SUBSCRIBE_DIRECT_BINARY)(msg);
+  fio___http_websocket_subscribe_imp(msg, 0);
 }
 
 /* *****************************************************************************
@@ -38899,6 +44538,10 @@ SFUNC int fio_http_websocket_write(fio_http_s *h,
   is_text = (!!is_text);
   is_text |= (!is_text) << 1;
   uint8_t rsv = 0;
+#if HAVE_ZLIB
+  if (c->state.ws.deflate.on && len >= c->state.ws.deflate.min)
+    return fio___websocket_write_deflated(c, buf, len, is_text);
+#endif
   if (len < 512) {
     char tmp[520];
     size_t wlen =
@@ -38908,9 +44551,6 @@ SFUNC int fio_http_websocket_write(fio_http_s *h,
     fio_write2(c->io, .buf = tmp, .len = wlen, .copy = 1);
     return 0;
   }
-#if HAVE_ZLIB /* TODO: compress? */
-  // if(len > 512 && c->state.ws.deflate) ;
-#endif
   char *payload =
       fio_bstr_reserve(NULL,
                        fio_websocket_wrapped_len(len) + (c->is_client << 2));
@@ -38991,6 +44631,8 @@ static void fio___sse_on_attach(fio_s *io) {
   c->state.sse = (struct fio___http_connection_sse_s){
       .on_message = c->settings->on_message,
   };
+  c->len = 0; /* EventSource clients don't send data, release the buffer */
+  fio___http_buffer_release(c);
   c->settings->on_open(h);
   // fio___websocket_process_data(io, c); /* TODO: SSE client mode */
 }
@@ -39032,10 +44674,15 @@ FIO_SFUNC void fio___http_controller_sse_write_body(
   if (args.buf && args.len) {
     fio_http_sse_write(c->h, .data = FIO_BUF_INFO2((char *)args.buf, args.len));
   }
-  if (args.dealloc && args.buf)
-    args.dealloc((void *)args.buf);
-  if (args.fd != -1)
-    close(args.fd);
+  if (args.buf) {
+    if (args.dealloc)
+      args.dealloc((void *)args.buf);
+  } else if (args.fd != -1) {
+    if (args.dealloc)
+      args.dealloc((void *)(intptr_t)args.fd);
+    else
+      close(args.fd);
+  }
 }
 /* *****************************************************************************
 Connection Lost
@@ -39068,6 +44715,507 @@ FIO_SFUNC void fio__http_controller_on_destroyed2(fio_http_s *h) {
                  fio_http_cdata(h));
 }
 
+/* *****************************************************************************
+HTTP Client - Pooled Connections (pool state is only accessed by the IO thread)
+***************************************************************************** */
+
+static fio___http_client_pool_map_s fio___http_client_pools = FIO_MAP_INIT;
+
+FIO_SFUNC void fio___http_client_on_response_task(void *cb_, void *h_) {
+  union {
+    void (*fn)(fio_http_s *);
+    void *ptr;
+  } cb = {.ptr = cb_};
+  fio_http_s *h = (fio_http_s *)h_;
+  cb.fn(h);
+  fio_http_free(h);
+}
+
+/** Schedules the user's `on_response` callback and frees the request. */
+FIO_SFUNC void fio___http_client_respond(fio___http_client_req_s *r,
+                                         fio_http_s *h) {
+  union {
+    void (*fn)(fio_http_s *);
+    void *ptr;
+  } cb = {.fn = r->args.on_response};
+  fio_http_udata_set(h, r->args.udata);
+  fio_queue_push(fio_srv_queue(),
+                 fio___http_client_on_response_task,
+                 cb.ptr,
+                 (void *)h);
+  fio___http_client_req_free(r);
+}
+
+/** Fails a request - `on_response` is called with a status of 0. */
+FIO_SFUNC void fio___http_client_fail(fio___http_client_req_s *r) {
+  fio_http_s *h = fio_http_new();
+  FIO_ASSERT_ALLOC(h);
+  fio___http_client_respond(r, h);
+}
+
+/** Returns the pool's host name (the URL without the scheme and port). */
+FIO_IFUNC fio_buf_info_s
+fio___http_client_host(fio___http_client_pool_s *pool) {
+  char *start = pool->url + 7 + (pool->url[4] == 's');
+  char *end = pool->url + fio_bstr_len(pool->url);
+  while (end > start && end[-1] != ':') /* the key always ends with a port */
+    --end;
+  return FIO_BUF_INFO2(start, (size_t)(end - start) - (end > start));
+}
+
+/** Tests if a host is an IP address (connecting performs no DNS lookup). */
+FIO_IFUNC int fio___http_client_is_ip(fio_buf_info_s host) {
+  if (host.len && host.buf[0] == '[') /* IPv6 */
+    return 1;
+  for (size_t i = 0; i < host.len; ++i)
+    if (host.buf[i] != '.' && (host.buf[i] < '0' || host.buf[i] > '9'))
+      return 0;
+  return 1;
+}
+
+/** Sends a request on an attached connection. */
+FIO_IFUNC void fio___http_client_send(fio___http_connection_s *c,
+                                      fio___http_client_req_s *r) {
+  fio_write2(c->io,
+             .buf = fio_bstr_copy(r->data),
+             .len = fio_bstr_len(r->data),
+             .dealloc = fio___http_pipeline_bstr_free);
+}
+
+/** Attaches a connected socket and sends any requests already assigned. */
+FIO_SFUNC void fio___http_client_attach(fio___http_connection_s *c, int fd) {
+  fio___http_client_pool_s *pool = c->state.http.client.pool;
+  c->io = fio_srv_attach_fd(
+      fd,
+      &pool->protocol->state[FIO___HTTP_PROTOCOL_HTTP1].protocol,
+      (void *)c,
+      pool->tls);
+  FIO_LOG_DDEBUG2("(%d) HTTP client connecting to %s (%p)",
+                  (int)fio_thread_getpid(),
+                  pool->url,
+                  (void *)c->io);
+  for (fio___http_client_req_s *r = c->state.http.client.sent.head; r;
+       r = r->next)
+    fio___http_client_send(c, r);
+}
+
+FIO_SFUNC void fio___http_client_on_close(void *udata);
+
+/** Attaches a resolved connection or fails it (IO thread). */
+FIO_SFUNC void fio___http_client_connect_task(void *c_, void *fd_) {
+  fio___http_connection_s *c = (fio___http_connection_s *)c_;
+  int fd = (int)(intptr_t)fd_;
+  if (fd != -1 && fio_srv_is_running()) {
+    fio___http_client_attach(c, fd);
+    return;
+  }
+  if (fd != -1)
+    fio_sock_close(fd);
+  fio___http_client_on_close(c);
+}
+
+/** Resolves the host name and connects, as DNS lookups may block. */
+FIO_SFUNC void *fio___http_client_connect_thread(void *c_) {
+  fio___http_connection_s *c = (fio___http_connection_s *)c_;
+  int fd = fio_sock_open2(c->state.http.client.pool->url,
+                          FIO_SOCK_CLIENT | FIO_SOCK_NONBLOCK);
+  fio_srv_defer(fio___http_client_connect_task, c_, (void *)(intptr_t)fd);
+  return NULL;
+}
+
+/**
+ * Opens a new (non-blocking) connection to the pool's host.
+ *
+ * Host names are resolved on a new thread, requests assigned to the connection
+ * meanwhile are sent once it's attached.
+ */
+FIO_SFUNC fio___http_connection_s *fio___http_client_connect(
+    fio___http_client_pool_s *pool) {
+  fio___http_protocol_s *p = pool->protocol;
+  fio___http_connection_s *c;
+  fio_thread_t thread;
+  int fd = -1;
+  if (fio___http_client_is_ip(fio___http_client_host(pool)) &&
+      (fd = fio_sock_open2(pool->url, FIO_SOCK_CLIENT | FIO_SOCK_NONBLOCK)) ==
+          -1)
+    return NULL;
+  c = fio___http_connection_new();
+  FIO_ASSERT_ALLOC(c);
+  fio___http_protocol_dup(p);
+  *c = (fio___http_connection_s){
+      .settings = &(p->settings),
+      .queue = p->queue,
+      .state.http =
+          {
+              .max_header = p->settings.max_header_size,
+              .client.pool = fio___http_client_pool_dup(pool),
+          },
+      .capa = p->settings.max_line_len,
+      .is_client = 1,
+  };
+  FIO_LIST_PUSH(&pool->connections, &c->state.http.client.node);
+  ++pool->count;
+  if (fd != -1) {
+    fio___http_client_attach(c, fd);
+    return c;
+  }
+  if (!fio_thread_create(&thread, fio___http_client_connect_thread, c)) {
+    fio_thread_detach(&thread);
+    return c;
+  }
+  FIO_LOG_WARNING("(%d) HTTP client couldn't spawn a DNS thread for %s",
+                  (int)fio_thread_getpid(),
+                  pool->url);
+  fio___http_client_connect_thread(c); /* resolve on the IO thread */
+  return c;
+}
+
+/** Selects an idle connection, a new connection or the least busy one. */
+FIO_SFUNC fio___http_connection_s *fio___http_client_select(
+    fio___http_client_pool_s *pool) {
+  fio___http_connection_s *best = NULL, *c;
+  FIO_LIST_EACH(fio___http_connection_s,
+                state.http.client.node,
+                &pool->connections,
+                pos) {
+    if (pos->state.http.client.closing)
+      continue;
+    if (!pos->state.http.client.in_flight)
+      return pos;
+    if (pos->state.http.client.in_flight < pool->pipeline &&
+        (!best ||
+         best->state.http.client.in_flight > pos->state.http.client.in_flight))
+      best = pos;
+  }
+  if (pool->count < pool->max_connections &&
+      (c = fio___http_client_connect(pool)))
+    return c;
+  return best;
+}
+
+/** Sends pending requests, failing them if the host can't be reached. */
+FIO_SFUNC void fio___http_client_dispatch(fio___http_client_pool_s *pool) {
+  fio___http_client_req_s *r;
+  fio___http_connection_s *c;
+  if (!fio_srv_is_running())
+    goto fail_pending;
+  while (pool->pending.head && (c = fio___http_client_select(pool))) {
+    r = fio___http_client_fifo_shift(&pool->pending);
+    fio___http_client_fifo_push(&c->state.http.client.sent, r);
+    ++c->state.http.client.in_flight;
+    if (c->io) /* otherwise, sent once connected */
+      fio___http_client_send(c, r);
+  }
+  if (pool->count)
+    return;
+fail_pending:
+  while ((r = fio___http_client_fifo_shift(&pool->pending)))
+    fio___http_client_fail(r);
+}
+
+/** Tests if the server will close the connection after this response. */
+FIO_SFUNC int fio___http_client_is_last(fio_http_s *h) {
+  fio_str_info_s v =
+      fio_http_response_header(h, FIO_STR_INFO2((char *)"connection", 10), 0);
+  if (v.len == 5)
+    return (fio_buf2u32u(v.buf) | 0x20202020UL) == fio_buf2u32u("clos") &&
+           (v.buf[4] | 0x20) == 'e';
+  if (v.len) /* i.e., keep-alive */
+    return 0;
+  v = fio_http_version(h);
+  return (v.len == 8 && v.buf[7] == '0'); /* HTTP/1.0 */
+}
+
+FIO_SFUNC void fio___http_client_on_response(fio___http_connection_s *c) {
+  fio_http_s *h = c->h;
+  fio___http_client_req_s *r;
+  c->h = NULL;
+  if (fio_http_status(h) < 200) { /* ignore informational (1xx) responses */
+    fio_http_free(h);
+    return;
+  }
+  r = fio___http_client_fifo_shift(&c->state.http.client.sent);
+  if (!r) { /* a response without a request */
+    fio_http_free(h);
+    c->state.http.client.closing = 2;
+    fio_close(c->io);
+    return;
+  }
+  --c->state.http.client.in_flight;
+  ++c->state.http.client.served;
+  if (fio___http_client_is_last(h)) {
+    c->state.http.client.closing |= 1; /* requests sent after it are retried */
+    fio_close(c->io);
+  }
+  fio___http_client_respond(r, h);
+  fio___http_client_dispatch(c->state.http.client.pool);
+}
+
+FIO_SFUNC void fio___http_client_on_timeout(fio_s *io) {
+  fio___http_connection_s *c = (fio___http_connection_s *)fio_udata_get(io);
+  c->state.http.client.closing = 2; /* timed out requests aren't retried */
+  fio_close_now(io);
+}
+
+FIO_SFUNC void fio___http_client_on_close(void *udata) {
+  fio___http_connection_s *c = (fio___http_connection_s *)udata;
+  fio___http_client_pool_s *pool = c->state.http.client.pool;
+  fio___http_client_fifo_s retry = {0};
+  fio___http_client_req_s *r;
+  int reused, partial;
+  FIO_LOG_DDEBUG2("(%d) HTTP client connection closed for %p",
+                  (int)fio_thread_getpid(),
+                  udata);
+  c->io = NULL;
+  c->state.http.client.closing |= 1;
+  if (c->h) /* a response without a length ends when the connection closes */
+    fio_http1_parse_eof(&c->state.http.parser, c);
+  /* requests on a stale keep-alive connection (closed by the server) may be
+   * retried, unless a response had started arriving */
+  reused = c->state.http.client.served && !(c->state.http.client.closing & 2);
+  partial = !!c->h;
+  fio_http_free(c->h);
+  c->h = NULL;
+  FIO_LIST_REMOVE(&c->state.http.client.node);
+  --pool->count;
+  while ((r = fio___http_client_fifo_shift(&c->state.http.client.sent))) {
+    if (reused && !partial && r->retry) {
+      r->retry = 0;
+      fio___http_client_fifo_push(&retry, r);
+    } else
+      fio___http_client_fail(r);
+    partial = 0;
+  }
+  if (retry.head) { /* retried requests are sent first */
+    retry.tail->next = pool->pending.head;
+    if (!pool->pending.head)
+      pool->pending.tail = retry.tail;
+    pool->pending.head = retry.head;
+  }
+  if (!c->state.http.client.served && !pool->count) /* host unreachable */
+    while ((r = fio___http_client_fifo_shift(&pool->pending)))
+      fio___http_client_fail(r);
+  fio___http_client_dispatch(pool);
+  fio___http_client_pool_free(pool);
+  fio___http_connection_free(c);
+}
+
+FIO_SFUNC int fio___http_client_tls_cert(fio_tls_each_s *e,
+                                         const char *server_name,
+                                         const char *public_cert_file,
+                                         const char *private_key_file,
+                                         const char *pk_password) {
+  fio_tls_cert_add((fio_tls_s *)e->udata,
+                   server_name,
+                   public_cert_file,
+                   private_key_file,
+                   pk_password);
+  return 0;
+}
+FIO_SFUNC int fio___http_client_tls_alpn(fio_tls_each_s *e,
+                                         const char *protocol_name,
+                                         void (*on_selected)(fio_s *)) {
+  fio_tls_alpn_add((fio_tls_s *)e->udata, protocol_name, on_selected);
+  return 0;
+}
+FIO_SFUNC int fio___http_client_tls_trust(fio_tls_each_s *e,
+                                          const char *public_cert_file) {
+  fio_tls_trust_add((fio_tls_s *)e->udata, public_cert_file);
+  return 0;
+}
+
+/** Copies the user's TLS settings, setting the host as server name (SNI). */
+FIO_SFUNC fio_tls_s *fio___http_client_tls(fio_tls_s *settings,
+                                           fio_buf_info_s host) {
+  fio_tls_s *tls = fio_tls_new();
+  const char *server_name = fio_tls_server_name(settings);
+  char buf[256];
+  fio_tls_each(settings,
+               .udata = tls,
+               .each_cert = fio___http_client_tls_cert,
+               .each_alpn = fio___http_client_tls_alpn,
+               .each_trust = fio___http_client_tls_trust);
+  if (!server_name && host.len < sizeof(buf) &&
+      !fio___http_client_is_ip(host)) { /* IP addresses aren't sent (SNI) */
+    FIO_MEMCPY(buf, host.buf, host.len);
+    buf[host.len] = 0;
+    server_name = buf;
+  }
+  return fio_tls_server_name_set(tls, server_name);
+}
+
+/** Creates a connection pool for the request's host (IO thread). */
+FIO_SFUNC fio___http_client_pool_s *fio___http_client_pool_create(
+    fio___http_client_req_s *r) {
+  fio_http_settings_s s = {.max_body_size = r->args.max_body_size};
+  fio___http_client_pool_s *pool;
+  fio___http_protocol_s *p;
+  http_settings_validate(&s, 1);
+  p = fio___http_protocol_new(1);
+  FIO_ASSERT_ALLOC(p);
+  for (size_t i = 0; i < FIO___HTTP_PROTOCOL_NONE + 1; ++i) {
+    p->state[i].protocol =
+        fio___http_protocol_get((fio___http_protocol_selector_e)i, 1);
+    p->state[i].controller =
+        fio___http_controller_get((fio___http_protocol_selector_e)i, 1);
+  }
+  p->settings = s;
+  p->settings.public_folder.buf = p->public_folder_buf;
+  p->public_folder_buf[0] = 0;
+  p->queue = fio_srv_queue();
+  pool = fio___http_client_pool_new();
+  FIO_ASSERT_ALLOC(pool);
+  *pool = (fio___http_client_pool_s){
+      .connections = FIO_LIST_INIT(pool->connections),
+      .protocol = p,
+      .url = r->key,
+  };
+  r->key = NULL;
+  if (pool->url[4] == 's') { /* https */
+    fio_io_functions_s *io_fn =
+        &p->state[FIO___HTTP_PROTOCOL_HTTP1].protocol.io_functions;
+    p->settings.tls = fio___http_client_tls(r->args.tls,
+                                            fio___http_client_host(pool));
+    *io_fn = fio_tls_default_io_functions(NULL);
+    pool->tls = io_fn->build_context(p->settings.tls, 1);
+  }
+  return pool;
+}
+
+FIO_SFUNC void fio___http_client_request_task(void *r_, void *ignr_) {
+  fio___http_client_req_s *r = (fio___http_client_req_s *)r_;
+  fio___http_client_pool_s *pool;
+  const fio_str_info_s key = FIO_STR_INFO2(r->key, fio_bstr_len(r->key));
+  const uint64_t hash = fio_risky_hash(key.buf, key.len, 0);
+  pool = fio___http_client_pool_map_get(&fio___http_client_pools, hash, key);
+  if (!pool) {
+    pool = fio___http_client_pool_create(r);
+    fio___http_client_pool_map_set(&fio___http_client_pools,
+                                   hash,
+                                   FIO_STR_INFO2(pool->url, key.len),
+                                   pool,
+                                   NULL);
+  }
+  /* the pool's limits follow the most recent request */
+  pool->max_connections = r->args.max_connections
+                              ? r->args.max_connections
+                              : FIO_HTTP_CLIENT_MAX_CONNECTIONS;
+  pool->pipeline = r->args.pipeline ? r->args.pipeline : 1;
+  pool->protocol->settings.max_body_size =
+      r->args.max_body_size ? r->args.max_body_size
+                            : FIO_HTTP_DEFAULT_MAX_BODY_SIZE;
+  pool->protocol->state[FIO___HTTP_PROTOCOL_HTTP1].protocol.timeout =
+      (r->args.timeout ? r->args.timeout : FIO_HTTP_DEFAULT_TIMEOUT) * 1000;
+  fio_bstr_free(r->key);
+  r->key = NULL;
+  fio_tls_free(r->args.tls);
+  r->args.tls = NULL;
+  fio___http_client_fifo_push(&pool->pending, r);
+  fio___http_client_dispatch(pool);
+  (void)ignr_;
+}
+
+FIO_SFUNC void fio___http_client_cleanup(void *ignr_) {
+  fio___http_client_pool_map_destroy(&fio___http_client_pools);
+  (void)ignr_;
+}
+
+FIO_CONSTRUCTOR(fio___http_client_constructor) {
+  fio_state_callback_add(FIO_CALL_AT_EXIT, fio___http_client_cleanup, NULL);
+}
+
+/** Tests for idempotent request methods (these may be retried). */
+FIO_IFUNC uint8_t fio___http_client_is_idempotent(fio_str_info_s m) {
+  switch (m.len) {
+  case 3: return !FIO_MEMCMP(m.buf, "GET", 3) || !FIO_MEMCMP(m.buf, "PUT", 3);
+  case 4: return !FIO_MEMCMP(m.buf, "HEAD", 4);
+  case 5: return !FIO_MEMCMP(m.buf, "TRACE", 5);
+  case 6: return !FIO_MEMCMP(m.buf, "DELETE", 6);
+  case 7: return !FIO_MEMCMP(m.buf, "OPTIONS", 7);
+  }
+  return 0;
+}
+
+void fio_http_request___(void); /* IDE marker */
+SFUNC int fio_http_request FIO_NOOP(const char *url,
+                                    fio_http_request_args_s args) {
+  fio_url_s u;
+  fio___http_client_req_s *r;
+  size_t is_tls = 0;
+  if (!url)
+    return -1;
+  u = fio_url_parse(url, FIO_STRLEN(url));
+  if (!u.host.len)
+    return -1;
+  if (u.scheme.len == 5 && (u.scheme.buf[4] | 0x20) == 's')
+    is_tls = 1, --u.scheme.len;
+  if (u.scheme.len && (u.scheme.len != 4 ||
+                       (fio_buf2u32u(u.scheme.buf) | 0x20202020UL) !=
+                           fio_buf2u32u("http")))
+    return -1;
+  if (args.headers.len &&
+      (args.headers.len < 4 || args.headers.buf[args.headers.len - 2] != '\r' ||
+       args.headers.buf[args.headers.len - 1] != '\n'))
+    return -1;
+  if (!args.method.len)
+    args.method = args.body.len ? FIO_STR_INFO2((char *)"POST", 4)
+                                : FIO_STR_INFO2((char *)"GET", 3);
+  if (!args.on_response)
+    args.on_response = fio___http_default_noop;
+  if (!u.path.len)
+    u.path = FIO_BUF_INFO2((char *)"/", 1);
+
+  r = fio___http_client_req_new();
+  *r = (fio___http_client_req_s){
+      .args = args,
+      .is_head =
+          (args.method.len == 4 && !FIO_MEMCMP(args.method.buf, "HEAD", 4)),
+      .retry = fio___http_client_is_idempotent(args.method),
+  };
+  r->args.method = r->args.headers = r->args.body = (fio_str_info_s){0};
+  r->args.tls = (is_tls && args.tls) ? fio_tls_dup(args.tls) : NULL;
+  /* the pool key is also the URL used for opening new connections */
+  r->key = fio_bstr_write2(
+      NULL,
+      FIO_STRING_WRITE_STR2((is_tls ? "https://" : "http://"), 7 + is_tls),
+      FIO_STRING_WRITE_STR2(u.host.buf, u.host.len),
+      FIO_STRING_WRITE_STR2(":", 1));
+  if (u.port.len)
+    r->key = fio_bstr_write(r->key, u.port.buf, u.port.len);
+  else
+    r->key = fio_bstr_write(r->key, (is_tls ? "443" : "80"), 2 + is_tls);
+  /* render the request once, it is copied by reference when sent */
+  r->data = fio_bstr_write2(NULL,
+                            FIO_STRING_WRITE_STR2(args.method.buf,
+                                                  args.method.len),
+                            FIO_STRING_WRITE_STR2(" ", 1),
+                            FIO_STRING_WRITE_STR2(u.path.buf, u.path.len));
+  if (u.query.len)
+    r->data = fio_bstr_write2(r->data,
+                              FIO_STRING_WRITE_STR2("?", 1),
+                              FIO_STRING_WRITE_STR2(u.query.buf, u.query.len));
+  r->data = fio_bstr_write2(r->data,
+                            FIO_STRING_WRITE_STR2(" HTTP/1.1\r\nhost: ", 17),
+                            FIO_STRING_WRITE_STR2(u.host.buf, u.host.len));
+  if (u.port.len)
+    r->data = fio_bstr_write2(r->data,
+                              FIO_STRING_WRITE_STR2(":", 1),
+                              FIO_STRING_WRITE_STR2(u.port.buf, u.port.len));
+  r->data = fio_bstr_write(r->data, "\r\n", 2);
+  if (args.headers.len)
+    r->data = fio_bstr_write(r->data, args.headers.buf, args.headers.len);
+  if (args.body.len)
+    r->data = fio_bstr_write2(r->data,
+                              FIO_STRING_WRITE_STR2("content-length: ", 16),
+                              FIO_STRING_WRITE_UNUM(args.body.len),
+                              FIO_STRING_WRITE_STR2("\r\n", 2));
+  r->data = fio_bstr_write(r->data, "\r\n", 2);
+  if (args.body.len)
+    r->data = fio_bstr_write(r->data, args.body.buf, args.body.len);
+  fio_srv_defer(fio___http_client_request_task, (void *)r, NULL);
+  return 0;
+}
+
 /* *****************************************************************************
 The Protocols at play
 ***************************************************************************** */
@@ -39084,6 +45232,13 @@ fio___http_protocol_get(fio___http_protocol_selector_e s, int is_client) {
                          .on_close = fio___http_on_close};
     return r;
   case FIO___HTTP_PROTOCOL_HTTP1:
+    if (is_client) {
+      r = (fio_protocol_s){.on_attach = fio___http1_on_attach,
+                           .on_data = fio___http1_on_data,
+                           .on_timeout = fio___http_client_on_timeout,
+                           .on_close = fio___http_client_on_close};
+      return r;
+    }
     r = (fio_protocol_s){.on_attach = fio___http1_on_attach,
                          .on_data = fio___http1_on_data,
                          .on_close = fio___http_on_close};
@@ -39135,6 +45290,12 @@ fio___http_controller_get(fio___http_protocol_selector_e s, int is_client) {
     };
     return r;
   case FIO___HTTP_PROTOCOL_HTTP1:
+    if (is_client) { /* responses are only read, never written */
+      r = (fio_http_controller_s){
+          .on_destroyed = fio__http_controller_on_destroyed2,
+      };
+      return r;
+    }
     r = (fio_http_controller_s){
         .send_headers = fio___http_controller_http1_send_headers,
         .write_body = fio___http_controller_http1_write_body,
@@ -39182,12 +45343,16 @@ SFUNC fio_s *fio_http_io(fio_http_s *h) {
   if (!h)
     return NULL;
   fio___http_connection_s *c = (fio___http_connection_s *)fio_http_cdata(h);
-  return c->io;
+  return c ? c->io : NULL;
 }
 
 /* *****************************************************************************
 Cleanup
 ***************************************************************************** */
+#undef fio___websocket_deflate_negotiate
+#undef fio___websocket_deflate_setup
+#undef fio___websocket_deflate_destroy
+#undef fio___websocket_inflate
 
 #endif /* FIO_EXTERN_COMPLETE */
 #undef FIO_HTTP
@@ -42994,6 +49159,26 @@ FIO_SFUNC void FIO_NAME_TEST(stl, core)(void) {
       FIO_ASSERT(!memcmp(buf + i + 1, data, len),
                  "fio_xmask rountrip (with move) error");
     }
+    char big[515], expected[515], cpy[515];
+    fio_rand_bytes(big, 515);
+    for (size_t l = 0; l < 512; l += 1 + (l >> 4)) {
+      for (size_t i = 0; i < 3; ++i) {
+        for (size_t j = 0; j < l; ++j)
+          expected[j] = big[i + j] ^ ((char *)&mask)[j & 7];
+        cpy[l] = '\xFF';
+        fio_xmask_cpy(cpy, big + i, l, mask);
+        FIO_ASSERT(!memcmp(cpy, expected, l) && cpy[l] == '\xFF',
+                   "fio_xmask_cpy error (%zu bytes, offset %zu)",
+                   l,
+                   i);
+        fio_xmask(big + i, l, mask);
+        FIO_ASSERT(!memcmp(big + i, expected, l),
+                   "fio_xmask error (%zu bytes, offset %zu)",
+                   l,
+                   i);
+        fio_xmask(big + i, l, mask);
+      }
+    }
   }
 }
 /* *****************************************************************************
@@ -43558,298 +49743,2865 @@ FIO_SFUNC void FIO_NAME_TEST(stl, fiobj)(void) {
 }
 #undef FIOBJ_TEST_REPETITIONS
 /* *****************************************************************************
-Cleanup
+Cleanup
+***************************************************************************** */
+#endif /* FIO_TEST_ALL */
+/* ************************************************************************* */
+#if !defined(FIO_INCLUDE_FILE) /* Dev test - ignore line */
+#define FIO___DEV___           /* Development inclusion - ignore line */
+#define FIO_TEST_ALL           /* Development inclusion - ignore line */
+#include "./include.h"         /* Development inclusion - ignore line */
+#endif                         /* Development inclusion - ignore line */
+/* *****************************************************************************
+
+
+
+
+                        FIO_GLOB_MATCH Test Helper
+
+
+
+
+Copyright and License: see header file (000 copyright.h) or top of file
+***************************************************************************** */
+#if defined(FIO_TEST_ALL) && !defined(FIO___TEST_REINCLUDE) &&                 \
+    !defined(H___FIO_GLOB_MATCH_TEST___H)
+#define H___FIO_GLOB_MATCH_TEST___H
+
+#ifndef H___FIO_GLOB_MATCH___H
+#define FIO_GLOB_MATCH
+#define FIO___TEST_REINCLUDE
+#include FIO_INCLUDE_FILE
+#undef FIO___TEST_REINCLUDE
+#endif
+
+FIO_SFUNC void FIO_NAME_TEST(stl, glob_matching)(void) {
+  struct {
+    char *pat;
+    char *str;
+    uint8_t expect;
+  } t[] = {
+      // clang-format off
+      /* test empty string */
+      {.pat = (char *)"", .str = (char *)"", .expect = 1},
+      /* test exact match */
+      {.pat = (char *)"a", .str = (char *)"a", .expect = 1},
+      /* test empty pattern */
+      {.pat = (char *)"", .str = (char *)"a", .expect = 0},
+      /* test longer pattern */
+      {.pat = (char *)"a", .str = (char *)"", .expect = 0},
+      /* test empty string with glob pattern */
+      {.pat = (char *)"*", .str = (char *)"", .expect = 1},
+      /* test glob pattern */
+      {.pat = (char *)"*", .str = (char *)"Whatever", .expect = 1},
+      /* test glob pattern at end */
+      {.pat = (char *)"W*", .str = (char *)"Whatever", .expect = 1},
+      /* test glob pattern as bookends */
+      {.pat = (char *)"*Whatever*", .str = (char *)"Whatever", .expect = 1},
+      /* test glob pattern in the middle */
+      {.pat = (char *)"W*er", .str = (char *)"Whatever", .expect = 1},
+      /* test glob pattern in the middle - empty match*/
+      {.pat = (char *)"W*hatever", .str = (char *)"Whatever", .expect = 1},
+      /* test glob pattern in the middle  - no match */
+      {.pat = (char *)"W*htever", .str = (char *)"Whatever", .expect = 0},
+      /* test partial match with glob at end */
+      {.pat = (char *)"h*", .str = (char *)"Whatever", .expect = 0},
+      /* test partial match with glob in the middle */
+      {.pat = (char *)"h*er", .str = (char *)"Whatever", .expect = 0},
+      /* test glob match with "?"  */
+      {.pat = (char *)"?h*er", .str = (char *)"Whatever", .expect = 1},
+      /* test "?" for length restrictions */
+      {.pat = (char *)"?", .str = (char *)"Whatever", .expect = 0},
+      /* test ? in the middle */
+      {.pat = (char *)"What?ver", .str = (char *)"Whatever", .expect = 1},
+      /* test letter list */
+      {.pat = (char *)"[ASW]hat?ver", .str = (char *)"Whatever", .expect = 1},
+      /* test letter range */
+      {.pat = (char *)"[A-Z]hat?ver", .str = (char *)"Whatever", .expect = 1},
+      /* test letter range (fail) */
+      {.pat = (char *)"[a-z]hat?ver", .str = (char *)"Whatever", .expect = 0},
+      /* test inverted letter range */
+      {.pat = (char *)"[!a-z]hat?ver", .str = (char *)"Whatever", .expect = 1},
+      /* test inverted list */
+      {.pat = (char *)"[!F]hat?ver", .str = (char *)"Whatever", .expect = 1},
+      /* test escaped range */
+      {.pat = (char *)"[!a-z\\]]hat?ver", .str = (char *)"Whatever", .expect = 1},
+      /* test "?" after range (no skip) */
+      {.pat = (char *)"[A-Z]?at?ver", .str = (char *)"Whatever", .expect = 1},
+      /* test error after range (no skip) */
+      {.pat = (char *)"[A-Z]Fat?ver", .str = (char *)"Whatever", .expect = 0},
+      /* end of test marker */
+      {.pat = (char *)NULL, .str = (char *)NULL, .expect = 0},
+      // clang-format on
+  };
+  fprintf(stderr, "* Testing glob matching.\n");
+  for (size_t i = 0; t[i].pat; ++i) {
+    fio_str_info_s p = FIO_STR_INFO1(t[i].pat);
+    fio_str_info_s s = FIO_STR_INFO1(t[i].str);
+    FIO_ASSERT(t[i].expect == fio_glob_match(p, s),
+               "glob matching error for:\n\t String: %s\n\t Pattern: %s",
+               s.buf,
+               p.buf);
+  }
+}
+/* *****************************************************************************
+Cleanup
+***************************************************************************** */
+#endif /* FIO_TEST_ALL */
+/* ************************************************************************* */
+#if !defined(FIO_INCLUDE_FILE) /* Dev test - ignore line */
+#define FIO___DEV___           /* Development inclusion - ignore line */
+#define FIO_TEST_ALL           /* Development inclusion - ignore line */
+#include "./include.h"         /* Development inclusion - ignore line */
+#endif                         /* Development inclusion - ignore line */
+/* *****************************************************************************
+
+
+
+
+                        fio_http_s Test Helper
+
+
+
+
+Copyright and License: see header file (000 copyright.h) or top of file
+***************************************************************************** */
+#if defined(FIO_TEST_ALL) && !defined(FIO___TEST_REINCLUDE) &&                 \
+    !defined(H___FIO_HTTP_HANDLE_TEST___H)
+#define H___FIO_HTTP_HANDLE_TEST___H
+// #ifndef H___FIO_MODULE_NAME___H
+// #define FIO_MODULE_NAME
+// #define FIO___TEST_REINCLUDE
+// #include FIO_INCLUDE_FILE
+// #undef FIO___TEST_REINCLUDE
+// #endif
+
+#if HAVE_ZLIB
+/* collects the response body written to a mock controller */
+static char *fio___test_http_compress_body;
+
+FIO_SFUNC void fio___test_http_compress_write_body(fio_http_s *h,
+                                                   fio_http_write_args_s args) {
+  if (args.buf) {
+    fio___test_http_compress_body =
+        fio_bstr_write(fio___test_http_compress_body,
+                       (char *)args.buf + args.offset,
+                       args.len);
+    if (args.dealloc)
+      args.dealloc((void *)args.buf);
+  } else if (args.fd > 0) {
+    fio___test_http_compress_body =
+        fio_bstr_readfd(fio___test_http_compress_body,
+                        args.fd,
+                        (intptr_t)args.offset,
+                        args.len);
+    close(args.fd);
+  }
+  (void)h;
+}
+
+/* decompresses `fio___test_http_compress_body` (gzip / deflate) */
+FIO_SFUNC char *fio___test_http_inflate(void) {
+  char *r = fio_bstr_reserve(NULL, (1 << 16));
+  z_stream z = {0};
+  FIO_ASSERT(inflateInit2(&z, 47) == Z_OK, "inflateInit2 failed");
+  z.next_in = (Bytef *)fio___test_http_compress_body;
+  z.avail_in = (uInt)fio_bstr_len(fio___test_http_compress_body);
+  z.next_out = (Bytef *)r;
+  z.avail_out = (uInt)(1 << 16);
+  FIO_ASSERT(inflate(&z, Z_FINISH) == Z_STREAM_END,
+             "compressed HTTP response couldn't be inflated");
+  r = fio_bstr_len_set(r, (size_t)z.total_out);
+  inflateEnd(&z);
+  return r;
+}
+#endif /* HAVE_ZLIB */
+
+FIO_SFUNC void FIO_NAME_TEST(stl, http_s)(void) {
+  fprintf(stderr, "* Testing HTTP handle (fio_http_s).\n");
+  fio_http_s *h = fio_http_new();
+  FIO_ASSERT(!fio_http_cdata(h), "fio_http_cdata should start as NULL");
+  fio_http_cdata_set(h, (void *)(uintptr_t)42);
+  FIO_ASSERT((uintptr_t)fio_http_cdata(h) == 42,
+             "fio_http_cdata roundtrip error");
+  FIO_ASSERT(!fio_http_udata(h), "fio_http_udata should start as NULL");
+  fio_http_udata_set(h, (void *)(uintptr_t)43);
+  FIO_ASSERT((uintptr_t)fio_http_udata(h) == 43,
+             "fio_http_udata roundtrip error");
+  FIO_ASSERT(!fio_http_udata2(h), "fio_http_udata2 should start as NULL");
+  fio_http_udata2_set(h, (void *)(uintptr_t)44);
+  FIO_ASSERT((uintptr_t)fio_http_udata2(h) == 44,
+             "fio_http_udata2 roundtrip error");
+
+  FIO_ASSERT(!fio_http_status(h), "fio_http_status should start as NULL");
+  fio_http_status_set(h, 101);
+  FIO_ASSERT((uintptr_t)fio_http_status(h) == 101,
+             "fio_http_status roundtrip error");
+
+  FIO_ASSERT(!fio_http_method(h).buf, "fio_http_method should start as empty");
+  fio_http_method_set(h, FIO_STR_INFO1((char *)"POST"));
+  FIO_ASSERT(
+      FIO_STR_INFO_IS_EQ(fio_http_method(h), FIO_STR_INFO1((char *)"POST")),
+      "fio_http_method roundtrip error");
+
+  FIO_ASSERT(!fio_http_path(h).buf, "fio_http_path should start as empty");
+  fio_http_path_set(h, FIO_STR_INFO1((char *)"/path"));
+  FIO_ASSERT(
+      FIO_STR_INFO_IS_EQ(fio_http_path(h), FIO_STR_INFO1((char *)"/path")),
+      "fio_http_path roundtrip error");
+
+  FIO_ASSERT(!fio_http_query(h).buf, "fio_http_query should start as empty");
+  fio_http_query_set(h, FIO_STR_INFO1((char *)"query=null"));
+  FIO_ASSERT(FIO_STR_INFO_IS_EQ(fio_http_query(h),
+                                FIO_STR_INFO1((char *)"query=null")),
+             "fio_http_query roundtrip error");
+
+  FIO_ASSERT(!fio_http_version(h).buf,
+             "fio_http_version should start as empty");
+  fio_http_version_set(h, FIO_STR_INFO1((char *)"HTTP/1.1"));
+  FIO_ASSERT(FIO_STR_INFO_IS_EQ(fio_http_version(h),
+                                FIO_STR_INFO1((char *)"HTTP/1.1")),
+             "fio_http_version roundtrip error");
+
+  { /* test multiple header support */
+    fio_str_info_s test_data[] = {
+        FIO_STR_INFO1((char *)"header-name"),
+        FIO_STR_INFO1(
+            (char *)"a long enough value to require memory allocation 001"),
+        FIO_STR_INFO1(
+            (char *)"a long enough value to require memory allocation 002"),
+        FIO_STR_INFO1(
+            (char *)"a long enough value to require memory allocation 003"),
+        FIO_STR_INFO1(
+            (char *)"a long enough value to require memory allocation 004"),
+        FIO_STR_INFO1(
+            (char *)"a long enough value to require memory allocation 005"),
+        FIO_STR_INFO1(
+            (char *)"a long enough value to require memory allocation 006"),
+        FIO_STR_INFO1(
+            (char *)"a long enough value to require memory allocation 007"),
+        FIO_STR_INFO1(
+            (char *)"a long enough value to require memory allocation 008"),
+    };
+    size_t count = sizeof(test_data) / sizeof(test_data[0]);
+    FIO_ASSERT(!fio_http_request_header(h, test_data[0], 0).buf,
+               "fio_http_request_header should start as empty");
+    FIO_ASSERT(!fio_http_response_header(h, test_data[0], 0).buf,
+               "fio_http_response_header should start as empty");
+    for (size_t i = 1; i < count; ++i) {
+      FIO_ASSERT(!fio_http_request_header(h, test_data[0], i - 1ULL).buf,
+                 "fio_http_request_header index (%zu) should start as empty",
+                 (size_t)(i - 1ULL));
+      FIO_ASSERT(!fio_http_response_header(h, test_data[0], i - 1ULL).buf,
+                 "fio_http_response_header index (%zu) should start as empty",
+                 (size_t)(i - 1ULL));
+      fio_str_info_s req_h =
+          fio_http_request_header_add(h, test_data[0], test_data[i]);
+      fio_str_info_s res_h =
+          fio_http_response_header_add(h, test_data[0], test_data[i]);
+      FIO_ASSERT(FIO_STR_INFO_IS_EQ(req_h, test_data[i]),
+                 "fio_http_request_header_set error");
+      FIO_ASSERT(FIO_STR_INFO_IS_EQ(res_h, test_data[i]),
+                 "fio_http_response_header_set error");
+      req_h = fio_http_request_header(h, test_data[0], i - 1ULL);
+      res_h = fio_http_response_header(h, test_data[0], i - 1ULL);
+      FIO_ASSERT(FIO_STR_INFO_IS_EQ(req_h, test_data[i]),
+                 "fio_http_request_header_set error");
+      FIO_ASSERT(FIO_STR_INFO_IS_EQ(res_h, test_data[i]),
+                 "fio_http_response_header_set error");
+    }
+    for (size_t i = 0; i < count - 1; ++i) {
+      fio_str_info_s req_h = fio_http_request_header(h, test_data[0], i);
+      fio_str_info_s res_h = fio_http_response_header(h, test_data[0], i);
+      FIO_ASSERT(FIO_STR_INFO_IS_EQ(req_h, test_data[i + 1]),
+                 "fio_http_request_header_set error");
+      FIO_ASSERT(FIO_STR_INFO_IS_EQ(res_h, test_data[i + 1]),
+                 "fio_http_response_header_set error");
+    }
+    fio_http_request_header_set(h, test_data[0], test_data[1]);
+    fio_http_response_header_set(h, test_data[0], test_data[1]);
+    FIO_ASSERT(!fio_http_request_header(h, test_data[0], 1ULL).buf,
+               "fio_http_request_header_set index should reset header values");
+    FIO_ASSERT(!fio_http_response_header(h, test_data[0], 1ULL).buf,
+               "fio_http_response_header_set index should reset header values");
+  }
+  { /* test body writer */
+    size_t written = 0;
+    do {
+      union {
+        char buf[32];
+        uint64_t u64[4];
+        void *p[4];
+      } w, r;
+      fio_rand_bytes(r.buf, sizeof(r.buf));
+      fio_http_body_write(h, r.buf, sizeof(r.buf));
+      fio_http_body_seek(h, written);
+      fio_str_info_s got = fio_http_body_read(h, sizeof(r.buf));
+      FIO_MEMSET(w.buf, 0, sizeof(w.buf));
+      FIO_MEMCPY(w.buf, got.buf, got.len);
+      written += sizeof(r.buf);
+      FIO_ASSERT(written == fio_http_body_length(h),
+                 "fio_http_body_length error (%zu != %zu)",
+                 fio_http_body_length(h),
+                 written);
+      FIO_ASSERT(FIO_STR_INFO_IS_EQ(FIO_STR_INFO2(r.buf, sizeof(r.buf)), got),
+                 "fio_http_body_write-fio_http_body_read roundtrip error @ %zu"
+                 "\n\t expected (32):\t%p%p%p%p)"
+                 "\n\t got (%zu):     \t%p%p%p%p)",
+                 written - sizeof(r.buf),
+                 r.p[0],
+                 r.p[1],
+                 r.p[2],
+                 r.p[3],
+                 got.len,
+                 w.p[0],
+                 w.p[1],
+                 w.p[2],
+                 w.p[3]);
+    } while (written < (FIO_HTTP_BODY_RAM_LIMIT << 1));
+    fio_http_body_seek(h, 0);
+    fio_http_body_write(h, "\n1234", 5);
+    fio_str_info_s ln = fio_http_body_read_until(h, '\n', 0);
+    FIO_ASSERT(ln.buf && ln.len && ln.buf[ln.len - 1] == '\n',
+               "fio_http_body_read_until token error");
+  }
+
+  { /* test arena allocations and arena owned strings */
+    char long_path[FIO_HTTP_ARENA_BLOCK_SIZE];
+    FIO_MEMSET(long_path, '/', sizeof(long_path));
+    for (size_t i = 1; i < FIO_HTTP_ARENA_BLOCK_SIZE; i <<= 1) {
+      char *mem = (char *)fio_http_arena_alloc(h, i);
+      FIO_ASSERT(mem && !((uintptr_t)mem & 15),
+                 "fio_http_arena_alloc should return aligned memory (%zu)",
+                 i);
+      FIO_MEMSET(mem, 0xFF, i);
+    }
+    fio_http_path_set(h, FIO_STR_INFO2(long_path, sizeof(long_path)));
+    FIO_ASSERT(FIO_STR_INFO_IS_EQ(fio_http_path(h),
+                                  FIO_STR_INFO2(long_path, sizeof(long_path))),
+               "fio_http_path roundtrip error for long paths");
+    fio_http_cookie_set(h,
+                        .name = FIO_STR_INFO1((char *)"my_cookie"),
+                        .value = FIO_STR_INFO1((char *)"my_value"));
+    FIO_ASSERT(FIO_STR_INFO_IS_EQ(fio_http_cookie(h, "my_cookie", 9),
+                                  FIO_STR_INFO1((char *)"my_value")),
+               "fio_http_cookie_set roundtrip error");
+    fio_http_path_set(h, FIO_STR_INFO1((char *)"/path"));
+  }
+  { /* test handle reset (reused for keep-alive requests) */
+    fio_http_s *r = fio_http_new();
+    for (size_t round = 0; round < 3; ++round) {
+      FIO_ASSERT(!fio_http_path(r).buf && !fio_http_status(r) &&
+                     !fio_http_request_header_each(r, NULL, NULL) &&
+                     !fio_http_response_header_each(r, NULL, NULL) &&
+                     !fio_http_body_length(r),
+                 "fio_http_reset should clear all data (round %zu)",
+                 round);
+      FIO_ASSERT(!fio_http_request_header(r, FIO_STR_INFO1((char *)"host"), 0)
+                      .buf,
+                 "fio_http_reset should clear request headers");
+      fio_http_path_set(r, FIO_STR_INFO1((char *)"/a/long/enough/path/name"));
+      fio_http_request_header_add(r,
+                                  FIO_STR_INFO1((char *)"host"),
+                                  FIO_STR_INFO1((char *)"example.com"));
+      fio_http_request_header_add(r,
+                                  FIO_STR_INFO1((char *)"cookie"),
+                                  FIO_STR_INFO1((char *)"a=1; b=2"));
+      fio_http_response_header_add(r,
+                                   FIO_STR_INFO1((char *)"x-round"),
+                                   FIO_STR_INFO1((char *)"value"));
+      fio_http_body_write(r, "body", 4);
+      FIO_ASSERT(FIO_STR_INFO_IS_EQ(fio_http_cookie(r, "b", 1),
+                                    FIO_STR_INFO1((char *)"2")),
+                 "cookie parsing error after fio_http_reset");
+      FIO_ASSERT(FIO_STR_INFO_IS_EQ(
+                     fio_http_request_header(r,
+                                             FIO_STR_INFO1((char *)"host"),
+                                             0),
+                     FIO_STR_INFO1((char *)"example.com")),
+                 "request header error after fio_http_reset");
+      FIO_ASSERT(fio_http_reset(r) == r, "fio_http_reset should return handle");
+    }
+    fio_http_free(r);
+  }
+
+#if HAVE_ZLIB
+  { /* test dynamic compression */
+    static fio_http_controller_s ctrl = {
+        .write_body = fio___test_http_compress_write_body,
+    };
+    struct {
+      const char *accept;
+      const char *encoding;
+      int streaming;
+      const char *types;
+      const char *if_none_match;
+      int from_file;
+      size_t status;
+      const char *etag;
+    } tests[] = {
+        {"gzip, deflate", "gzip", 0, NULL, NULL, 0, 200, "\"v1-gzip\""},
+        {"gzip;q=0, deflate",
+         "deflate",
+         0,
+         NULL,
+         NULL,
+         0,
+         200,
+         "\"v1-deflate\""},
+        {"br", NULL, 0, NULL, NULL, 0, 200, "\"v1\""},
+        {"*", "gzip", 1, NULL, NULL, 0, 200, "\"v1-gzip\""},
+        {"deflate;q=0.5", "deflate", 1, NULL, NULL, 0, 200, "\"v1-deflate\""},
+        {"gzip",
+         "gzip",
+         0,
+         "text/, APPLICATION/JSON",
+         NULL,
+         0,
+         200,
+         "\"v1-gzip\""},
+        {"gzip", NULL, 0, "+json, +xml", NULL, 0, 200, "\"v1\""},
+        {"gzip", "gzip", 0, "application/json", NULL, 0, 200, "\"v1-gzip\""},
+        {"gzip", NULL, 0, "text/,application/jso", NULL, 0, 200, "\"v1\""},
+        {"gzip", NULL, 0, "application/", NULL, 1, 200, "\"v1\""},
+        {"gzip", NULL, 0, NULL, "\"v1-gzip\"", 0, 304, "\"v1-gzip\""},
+        {"gzip", "gzip", 0, NULL, "\"v1\"", 0, 200, "\"v1-gzip\""},
+        {"br", NULL, 0, NULL, "\"v1-gzip\"", 0, 200, "\"v1\""},
+        {"br", NULL, 0, NULL, "\"v1\"", 0, 304, "\"v1\""},
+    };
+    char data[4096];
+    for (size_t i = 0; i < sizeof(data); ++i)
+      data[i] = "{\"key\": \"value\"},\n"[i & 15];
+    fio_http_s *r = fio_http_new();
+    for (size_t t = 0; t < sizeof(tests) / sizeof(tests[0]); ++t) {
+      fio_str_info_s enc, etag;
+      fio_http_reset(r);
+      fio_http_controller_set(r, &ctrl);
+      fio_http_compress_set(
+          r,
+          64,
+          (tests[t].types ? FIO_STR_INFO1((char *)tests[t].types)
+                          : FIO_STR_INFO2(NULL, 0)));
+      fio_http_method_set(r, FIO_STR_INFO1((char *)"GET"));
+      fio_http_status_set(r, 200);
+      fio_http_path_set(r, FIO_STR_INFO1((char *)"/json"));
+      fio_http_request_header_add(r,
+                                  FIO_STR_INFO1((char *)"accept-encoding"),
+                                  FIO_STR_INFO1((char *)tests[t].accept));
+      if (tests[t].if_none_match)
+        fio_http_request_header_add(
+            r,
+            FIO_STR_INFO1((char *)"if-none-match"),
+            FIO_STR_INFO1((char *)tests[t].if_none_match));
+      fio_http_response_header_set(
+          r,
+          FIO_STR_INFO1((char *)"content-type"),
+          FIO_STR_INFO1((char *)"application/json; charset=utf-8"));
+      fio_http_response_header_set(r,
+                                   FIO_STR_INFO1((char *)"etag"),
+                                   FIO_STR_INFO1((char *)"\"v1\""));
+      if (tests[t].streaming) {
+        for (size_t pos = 0; pos < sizeof(data); pos += 1024)
+          fio_http_write(r, .buf = data + pos, .len = 1024, .copy = 1);
+        fio_http_finish(r);
+      } else if (tests[t].from_file) {
+        FILE *tmp = tmpfile();
+        FIO_ASSERT(tmp && fwrite(data, 1, sizeof(data), tmp) == sizeof(data) &&
+                       !fflush(tmp),
+                   "couldn't create a temporary file for testing");
+        fio_http_write(r,
+                       .fd = dup(fileno(tmp)),
+                       .len = sizeof(data),
+                       .finish = 1);
+        fclose(tmp);
+      } else {
+        fio_http_write(r, .buf = data, .len = sizeof(data), .finish = 1);
+      }
+      FIO_ASSERT(fio_http_status(r) == tests[t].status,
+                 "dynamic compression status error for %s (%s): %zu",
+                 tests[t].accept,
+                 (tests[t].if_none_match ? tests[t].if_none_match : "-"),
+                 fio_http_status(r));
+      enc = fio_http_response_header(r,
+                                     FIO_STR_INFO1((char *)"content-encoding"),
+                                     0);
+      etag = fio_http_response_header(r, FIO_STR_INFO1((char *)"etag"), 0);
+      FIO_ASSERT(tests[t].encoding
+                     ? FIO_STR_INFO_IS_EQ(
+                           enc,
+                           FIO_STR_INFO1((char *)tests[t].encoding))
+                     : !enc.buf,
+                 "dynamic compression encoding error for %s (%s)",
+                 tests[t].accept,
+                 (enc.buf ? enc.buf : "none"));
+      FIO_ASSERT(FIO_STR_INFO_IS_EQ(etag, FIO_STR_INFO1((char *)tests[t].etag)),
+                 "compressed responses should mark the etag (%s != %s)",
+                 etag.buf,
+                 tests[t].etag);
+      if (tests[t].status == 304) {
+        FIO_ASSERT(!fio_bstr_len(fio___test_http_compress_body),
+                   "304 responses should have no body");
+      } else if (tests[t].encoding) {
+        char *inflated = fio___test_http_inflate();
+        FIO_ASSERT(fio_bstr_len(fio___test_http_compress_body) < sizeof(data),
+                   "dynamic compression should reduce the body's length");
+        FIO_ASSERT(fio_bstr_len(inflated) == sizeof(data) &&
+                       !FIO_MEMCMP(inflated, data, sizeof(data)),
+                   "dynamically compressed body error (%s)",
+                   tests[t].accept);
+        fio_bstr_free(inflated);
+      } else {
+        FIO_ASSERT(fio_bstr_len(fio___test_http_compress_body) ==
+                           sizeof(data) &&
+                       !FIO_MEMCMP(fio___test_http_compress_body,
+                                   data,
+                                   sizeof(data)),
+                   "uncompressed body error");
+      }
+      fio_bstr_free(fio___test_http_compress_body);
+      fio___test_http_compress_body = NULL;
+    }
+    fio_http_free(r);
+  }
+#endif /* HAVE_ZLIB */
+
+  /* almost done, just make sure reference counting doesn't destroy object */
+  fio_http_free(fio_http_dup(h));
+  FIO_ASSERT(
+      (uintptr_t)fio_http_udata2(h) == 44 &&
+          FIO_STR_INFO_IS_EQ(fio_http_method(h), FIO_STR_INFO1((char *)"POST")),
+      "fio_http_s reference counting shouldn't object");
+
+  fio_http_free(h);
+}
+
+/* *****************************************************************************
+Form Data Parsing Tests
+***************************************************************************** */
+
+/* collects parsed fields as: `[name|filename|content_type]value;` */
+FIO_SFUNC int fio___test_http_form_on_field(fio_buf_info_s name,
+                                            fio_buf_info_s filename,
+                                            fio_buf_info_s content_type,
+                                            void *udata) {
+  char **out = (char **)udata;
+  *out = fio_bstr_write2(*out,
+                         FIO_STRING_WRITE_STR2("[", 1),
+                         FIO_STRING_WRITE_STR2(name.buf, name.len),
+                         FIO_STRING_WRITE_STR2("|", 1),
+                         FIO_STRING_WRITE_STR2(filename.buf, filename.len),
+                         FIO_STRING_WRITE_STR2("|", 1),
+                         FIO_STRING_WRITE_STR2(content_type.buf,
+                                               content_type.len),
+                         FIO_STRING_WRITE_STR2("]", 1));
+  return 0;
+}
+FIO_SFUNC int fio___test_http_form_on_data(fio_buf_info_s data, void *udata) {
+  char **out = (char **)udata;
+  FIO_ASSERT(data.len, "form parser shouldn't report empty data");
+  *out = fio_bstr_write(*out, data.buf, data.len);
+  return 0;
+}
+FIO_SFUNC int fio___test_http_form_on_field_end(void *udata) {
+  char **out = (char **)udata;
+  *out = fio_bstr_write(*out, ";", 1);
+  return 0;
+}
+
+FIO_SFUNC void FIO_NAME_TEST(stl, http_form)(void) {
+  fprintf(stderr, "* Testing HTTP form data parsing.\n");
+  char *out = NULL;
+  fio_http_form_settings_s settings = {
+      .on_field = fio___test_http_form_on_field,
+      .on_data = fio___test_http_form_on_data,
+      .on_field_end = fio___test_http_form_on_field_end,
+      .udata = &out,
+  };
+  struct {
+    const char *content_type;
+    const char *body;
+    const char *expected;
+  } tests[] = {
+      {
+          .content_type = "multipart/form-data; boundary=\"-xYz-\"",
+          .body = "ignored preamble\r\n"
+                  "---xYz-\r\n"
+                  "Content-Disposition: form-data; name=\"text\"\r\n"
+                  "\r\n"
+                  "Hello\r\n---xY not a boundary\r\n"
+                  "---xYz-  \r\n"
+                  "Content-Disposition: form-data; name=\"file\"; "
+                  "filename=\"a.txt\"\r\n"
+                  "Content-Type: text/plain \r\n"
+                  "\r\n"
+                  "\r\n\r\nfile\r\n"
+                  "---xYz-\r\n"
+                  "content-disposition: form-data; name=empty\r\n"
+                  "\r\n"
+                  "\r\n"
+                  "---xYz---\r\n"
+                  "ignored epilogue",
+          .expected = "[text||]Hello\r\n---xY not a boundary;"
+                      "[file|a.txt|text/plain]\r\n\r\nfile;"
+                      "[empty||];",
+      },
+      {
+          .content_type = "Multipart/Form-Data;boundary=b",
+          .body = "--b\r\n\r\nno headers\r\n--b--",
+          .expected = "[||]no headers;",
+      },
+      {
+          .content_type = "application/x-www-form-urlencoded",
+          .body = "a=1&b=hello+world%21&&flag&=skipped&c=%41%4&d=",
+          .expected = "[a||]1;[b||]hello world!;[flag||];[c||]A%4;[d||];",
+      },
+  };
+  for (size_t t = 0; t < sizeof(tests) / sizeof(tests[0]); ++t) {
+    const size_t len = FIO_STRLEN(tests[t].body);
+    /* test every possible split point, as well as byte-by-byte parsing */
+    for (size_t split = 0; split <= len + 1; ++split) {
+      fio_http_form_s p;
+      char *body = fio_bstr_write(NULL, tests[t].body, len);
+      FIO_ASSERT(
+          !fio_http_form_init(&p,
+                              FIO_STR_INFO1((char *)tests[t].content_type),
+                              settings),
+                 "fio_http_form_init failed for %s",
+                 tests[t].content_type);
+      if (split > len) {
+        for (size_t i = 0; i < len; ++i)
+          FIO_ASSERT(!fio_http_form_parse(&p, FIO_BUF_INFO2(body + i, 1)),
+                     "form parsing error (byte by byte) at %zu",
+                     i);
+      } else {
+        FIO_ASSERT(!fio_http_form_parse(&p, FIO_BUF_INFO2(body, split)) &&
+                       !fio_http_form_parse(
+                           &p,
+                           FIO_BUF_INFO2(body + split, len - split)),
+                   "form parsing error (split at %zu)",
+                   split);
+      }
+      FIO_ASSERT(!fio_http_form_finish(&p), "form parsing incomplete");
+      FIO_ASSERT(FIO_STR_INFO_IS_EQ(fio_bstr_info(out),
+                                    FIO_STR_INFO1((char *)tests[t].expected)),
+                 "form parsing error (split at %zu):\n%s\nexpected:\n%s",
+                 split,
+                 out,
+                 tests[t].expected);
+      fio_bstr_free(body);
+      fio_bstr_free(out);
+      out = NULL;
+    }
+  }
+  { /* errors */
+    fio_http_form_s p;
+    FIO_ASSERT(fio_http_form_init(&p,
+                                  FIO_STR_INFO1((char *)"text/plain"),
+                                  settings),
+               "fio_http_form_init should fail for non-form data");
+    FIO_ASSERT(fio_http_form_init(&p,
+                                  FIO_STR_INFO1((char *)"multipart/form-data"),
+                                  settings),
+               "fio_http_form_init should fail without a boundary");
+    FIO_ASSERT(!fio_http_form_init(
+                   &p,
+                   FIO_STR_INFO1((char *)"multipart/form-data; boundary=b"),
+                   settings),
+               "fio_http_form_init failed");
+    FIO_ASSERT(!fio_http_form_parse(
+                   &p,
+                   FIO_BUF_INFO1((char *)"--b\r\n\r\nunterminated")),
+               "form parsing error");
+    FIO_ASSERT(fio_http_form_finish(&p),
+               "fio_http_form_finish should fail for incomplete data");
+    fio_bstr_free(out);
+    out = NULL;
+  }
+  { /* parsing a body stored in a temporary file */
+    fio_http_s *h = fio_http_new();
+    const size_t value_len = FIO_HTTP_BODY_RAM_LIMIT + 1024;
+    char *value = fio_bstr_reserve(NULL, value_len);
+    for (size_t i = 0; i < value_len; ++i)
+      value[i] = (i & 1023) ? (char)('a' + (i % 26)) : '\r';
+    value = fio_bstr_len_set(value, value_len);
+    fio_http_request_header_set(
+        h,
+        FIO_STR_INFO1((char *)"content-type"),
+        FIO_STR_INFO1((char *)"multipart/form-data; boundary=0123456789"));
+    char *prefix = (char *)"--0123456789\r\n"
+                           "Content-Disposition: form-data; name=\"big\"\r\n"
+                           "\r\n";
+    fio_http_body_write(h, prefix, FIO_STRLEN(prefix));
+    fio_http_body_write(h, value, value_len);
+    fio_http_body_write(h, "\r\n--0123456789--\r\n", 18);
+    FIO_ASSERT(!fio_http_body_parse_form(h, settings),
+               "fio_http_body_parse_form failed");
+    FIO_ASSERT(fio_bstr_len(out) == value_len + 8 &&
+                   !FIO_MEMCMP(out, "[big||]", 7) &&
+                   !FIO_MEMCMP(out + 7, value, value_len),
+               "fio_http_body_parse_form error (file body)");
+    fio_bstr_free(out);
+    fio_bstr_free(value);
+    fio_http_free(h);
+  }
+}
+
+/* *****************************************************************************
+Response Cache Tests
+***************************************************************************** */
+
+/* collects the response body written to a mock controller */
+static char *fio___test_http_cache_body;
+static size_t fio___test_http_cache_sent;
+static size_t fio___test_http_cache_failed;
+
+FIO_SFUNC void fio___test_http_cache_write_body(fio_http_s *h,
+                                                fio_http_write_args_s args) {
+  if (args.buf) {
+    fio___test_http_cache_body = fio_bstr_write(fio___test_http_cache_body,
+                                                (char *)args.buf + args.offset,
+                                                args.len);
+    if (args.dealloc)
+      args.dealloc((void *)args.buf);
+  }
+  (void)h;
+}
+
+FIO_SFUNC void fio___test_http_cache_on_release(fio_http_s *h, void *udata) {
+  if (fio_http_is_finished(h)) {
+    FIO_ASSERT(fio_http_status(h) == 200,
+               "cached response status error (%zu)",
+               fio_http_status(h));
+    FIO_ASSERT(
+        fio_http_response_header(h, FIO_STR_INFO1((char *)"x-test"), 0).len ==
+            2,
+        "cached response header missing");
+    ++fio___test_http_cache_sent;
+  } else {
+    ++fio___test_http_cache_failed;
+  }
+  fio_http_free(h);
+  (void)udata;
+}
+
+FIO_SFUNC fio_http_s *fio___test_http_cache_request(const char *method,
+                                                    const char *lang) {
+  static fio_http_controller_s ctrl = {
+      .write_body = fio___test_http_cache_write_body,
+  };
+  fio_http_s *h = fio_http_new();
+  fio_http_controller_set(h, &ctrl);
+  fio_http_method_set(h, FIO_STR_INFO1((char *)method));
+  fio_http_path_set(h, FIO_STR_INFO1((char *)"/cached"));
+  fio_http_query_set(h, FIO_STR_INFO1((char *)"a=1"));
+  fio_http_request_header_set(h,
+                              FIO_STR_INFO1((char *)"accept-language"),
+                              FIO_STR_INFO1((char *)lang));
+  return h;
+}
+
+FIO_SFUNC void FIO_NAME_TEST(stl, http_cache)(void) {
+  fprintf(stderr, "* Testing HTTP response cache (fio_http_cache).\n");
+#if FIO_HTTP_RESPONSE_CACHE_LIMIT
+  fio_http_cache_args_s args = {
+      .ttl = 10,
+      .vary = FIO_STR_INFO1((char *)"accept-language"),
+      .on_release = fio___test_http_cache_on_release,
+  };
+  fio_http_s *leader = fio___test_http_cache_request("GET", "en");
+  fio_http_s *h;
+  FIO_ASSERT(fio_http_cache(leader, args) == -1,
+             "fio_http_cache should miss for the first request");
+  h = fio___test_http_cache_request("GET", "en");
+  FIO_ASSERT(!fio_http_cache(h, args) && !fio___test_http_cache_sent,
+             "fio_http_cache should wait for a pending response");
+  fio_http_status_set(leader, 200);
+  fio_http_response_header_set(leader,
+                               FIO_STR_INFO1((char *)"x-test"),
+                               FIO_STR_INFO1((char *)"ok"));
+  fio_http_write(leader, .buf = "hello", .len = 5, .copy = 1, .finish = 1);
+  FIO_ASSERT(fio___test_http_cache_sent == 1,
+             "waiting requests should be sent the cached response");
+  FIO_ASSERT(fio_bstr_len(fio___test_http_cache_body) == 10 &&
+                 !FIO_MEMCMP(fio___test_http_cache_body, "hellohello", 10),
+             "cached response body error");
+  fio_http_free(leader);
+  h = fio___test_http_cache_request("GET", "en");
+  FIO_ASSERT(!fio_http_cache(h, args) && fio___test_http_cache_sent == 2,
+             "fio_http_cache should hit");
+  h = fio___test_http_cache_request("POST", "en");
+  FIO_ASSERT(fio_http_cache(h, args) == -1, "POST requests aren't cached");
+  fio_http_free(h);
+  /* a response that can't be cached releases waiting requests */
+  leader = fio___test_http_cache_request("GET", "fr");
+  FIO_ASSERT(fio_http_cache(leader, args) == -1,
+             "fio_http_cache should miss for a different vary header");
+  h = fio___test_http_cache_request("GET", "fr");
+  FIO_ASSERT(!fio_http_cache(h, args), "fio_http_cache should wait");
+  fio_http_status_set(leader, 500);
+  fio_http_write(leader, .buf = "error", .len = 5, .copy = 1, .finish = 1);
+  FIO_ASSERT(fio___test_http_cache_failed == 1 &&
+                 fio___test_http_cache_sent == 2,
+             "waiting requests should be released if caching failed");
+  fio_http_free(leader);
+  leader = fio___test_http_cache_request("GET", "fr");
+  FIO_ASSERT(fio_http_cache(leader, args) == -1,
+             "fio_http_cache should miss after a failed attempt");
+  h = fio___test_http_cache_request("GET", "fr");
+  FIO_ASSERT(!fio_http_cache(h, args), "fio_http_cache should wait");
+  fio_http_free(leader); /* no response */
+  FIO_ASSERT(fio___test_http_cache_failed == 2,
+             "waiting requests should be released if the handle is freed");
+  /* the host is part of the key, credentials require a public response */
+  {
+    size_t sent = fio___test_http_cache_sent;
+    struct {
+      const char *host;
+      const char *cookie;
+      const char *cc; /* response cache-control (NULL == not responding) */
+      int hit;
+    } cases[] = {
+        {"a.test", NULL, "max-age=10", 0},           /* stored */
+        {"a.test", NULL, NULL, 1},                   /* same host hits */
+        {"b.test", NULL, "Max-Age=10, No-Cache", 0}, /* not stored */
+        {"b.test", NULL, NULL, 0},                   /* so this misses */
+        {"a.test", "id=1", NULL, 0},                 /* credentials miss */
+        {"c.test", "id=1", "max-age=10", 0},         /* not stored */
+        {"c.test", NULL, NULL, 0},                   /* so this misses */
+        {"d.test", "id=1", "Public, max-age=10", 0}, /* stored (public) */
+        {"d.test", "id=2", NULL, 1},                 /* and shared */
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+      h = fio___test_http_cache_request("GET", "de");
+      fio_http_request_header_set(h,
+                                  FIO_STR_INFO1((char *)"host"),
+                                  FIO_STR_INFO1((char *)cases[i].host));
+      if (cases[i].cookie)
+        fio_http_request_header_set(h,
+                                    FIO_STR_INFO1((char *)"cookie"),
+                                    FIO_STR_INFO1((char *)cases[i].cookie));
+      if (cases[i].hit) {
+        FIO_ASSERT(!fio_http_cache(h, args) &&
+                       fio___test_http_cache_sent == ++sent,
+                   "fio_http_cache should hit (%zu)",
+                   i);
+        continue;
+      }
+      FIO_ASSERT(fio_http_cache(h, args) == -1,
+                 "fio_http_cache should miss (%zu)",
+                 i);
+      if (cases[i].cc) {
+        fio_http_status_set(h, 200);
+        fio_http_response_header_set(h,
+                                     FIO_STR_INFO1((char *)"x-test"),
+                                     FIO_STR_INFO1((char *)"ok"));
+        fio_http_response_header_set(h,
+                                     FIO_STR_INFO1((char *)"cache-control"),
+                                     FIO_STR_INFO1((char *)cases[i].cc));
+        fio_http_write(h, .buf = "hello", .len = 5, .copy = 1, .finish = 1);
+      }
+      fio_http_free(h);
+    }
+  }
+  fio_bstr_free(fio___test_http_cache_body);
+  fio___test_http_cache_body = NULL;
+#endif
+}
+
+/* *****************************************************************************
+HTTP Logging Tests (buffered writer)
+***************************************************************************** */
+#if FIO_OS_POSIX
+/* redirects STDOUT to a temporary file, returns the original STDOUT */
+FIO_SFUNC int fio___test_http_log_redirect(FILE *tmp) {
+  int org;
+  fflush(stdout);
+  org = dup(fileno(stdout));
+  FIO_ASSERT(tmp && org != -1 && dup2(fileno(tmp), fileno(stdout)) != -1,
+             "couldn't redirect STDOUT for testing");
+  return org;
+}
+
+/* stops the writer thread (writing all lines), restores STDOUT */
+FIO_SFUNC char *fio___test_http_log_collect(FILE *tmp, int org) {
+  char *r;
+  fio___http_log_at_exit(NULL);
+  fio___http_log.pid = 0; /* the next line restarts the writer thread */
+  fflush(stdout);
+  dup2(org, fileno(stdout));
+  close(org);
+  r = fio_bstr_readfd(NULL, fileno(tmp), 0, 0);
+  fclose(tmp);
+  return r;
+}
+
+/* writes `count` numbered log lines, `len` bytes each */
+FIO_SFUNC void fio___test_http_log_lines(const char *prefix,
+                                         size_t count,
+                                         size_t len) {
+  char line[128];
+  FIO_ASSERT(len < sizeof(line), "test log line too long");
+  for (size_t i = 0; i < count; ++i) {
+    FIO_MEMSET(line, '.', len);
+    snprintf(line, len, "%s %06zu", prefix, i);
+    line[strlen(line)] = ' ';
+    line[len - 1] = '\n';
+    fio___http_log_write(line, len);
+  }
+}
+
+/* counts the lines starting with `prefix`, -1 if out of order */
+FIO_SFUNC long fio___test_http_log_count(const char *log, const char *prefix) {
+  long count = 0;
+  uint64_t next = 0; /* dropped lines may be skipped */
+  const size_t prefix_len = strlen(prefix);
+  for (const char *pos = log; pos && *pos; pos = strchr(pos, '\n'), ++pos) {
+    char *num;
+    uint64_t i;
+    if (strncmp(pos, prefix, prefix_len) || pos[prefix_len] != ' ')
+      continue;
+    num = (char *)pos + prefix_len + 1;
+    if ((i = fio_atol10u(&num)) < next)
+      return -1;
+    next = i + 1;
+    ++count;
+  }
+  return count;
+}
+
+FIO_SFUNC void FIO_NAME_TEST(stl, http_log)(void) {
+  fprintf(stderr, "* Testing HTTP logging (buffered writer).\n");
+  const size_t count = (FIO_HTTP_LOG_BUFFER_SIZE / 100) * 4;
+  size_t dropped = fio_http_log_dropped();
+  FILE *tmp = tmpfile();
+  int org = fio___test_http_log_redirect(tmp);
+  char *log;
+  long written;
+  { /* lines are written in order, even if the buffer fills up */
+    fio___test_http_log_lines("a", count, 100);
+    FIO_ASSERT(fio___http_log.pid == fio_thread_getpid() &&
+                   !fio___http_log.sync,
+               "HTTP log lines should be written by a background thread");
+    log = fio___test_http_log_collect(tmp, org);
+    written = fio___test_http_log_count(log, "a");
+    FIO_ASSERT(written != -1, "HTTP log lines written out of order");
+    FIO_ASSERT((size_t)written + (fio_http_log_dropped() - dropped) == count &&
+                   fio_bstr_len(log) == (size_t)written * 100,
+               "HTTP log lines missing (%ld / %zu written)",
+               written,
+               count);
+    FIO_ASSERT(FIO_HTTP_LOG_DROP_WHEN_FULL || written == (long)count,
+               "HTTP log lines shouldn't be dropped (%ld / %zu written)",
+               written,
+               count);
+    fio_bstr_free(log);
+  }
+#if FIO_HTTP_LOG_DROP_WHEN_FULL
+  { /* lines are dropped (and counted) while the writer is busy */
+    tmp = tmpfile();
+    org = fio___test_http_log_redirect(tmp);
+    fio___test_http_log_lines("start", 1, 100); /* start the writer */
+    fio_thread_mutex_lock(&fio___http_log.writing); /* the writer is busy */
+    dropped = fio_http_log_dropped();
+    fio___test_http_log_lines("c", count, 100);
+    fio_thread_mutex_unlock(&fio___http_log.writing);
+    log = fio___test_http_log_collect(tmp, org);
+    written = fio___test_http_log_count(log, "c");
+    FIO_ASSERT(written > 0 && (size_t)written < count &&
+                   (size_t)written + (fio_http_log_dropped() - dropped) ==
+                       count,
+               "HTTP log dropped line count error (%ld written, %zu dropped)",
+               written,
+               fio_http_log_dropped() - dropped);
+    fio_bstr_free(log);
+  }
+#endif
+  { /* a forked child starts its own writer, parent lines aren't copied */
+    int status = -1;
+    fio_thread_pid_t child;
+    tmp = tmpfile();
+    org = fio___test_http_log_redirect(tmp);
+    fio___test_http_log_lines("start", 1, 100); /* start the writer */
+    fio_thread_mutex_lock(&fio___http_log.writing); /* keep lines buffered */
+    fio___test_http_log_lines("p", 10, 100);
+    child = fio_thread_fork();
+    FIO_ASSERT(child != -1, "fork failed");
+    if (!child) {
+      fio___http_log_on_fork(NULL); /* a FIO_CALL_IN_CHILD callback */
+      fio___test_http_log_lines("child", 10, 100);
+      status = (fio___http_log.pid == fio_thread_getpid() &&
+                !fio___http_log.sync);
+      fio___http_log_at_exit(NULL);
+      _exit(status ? 0 : 1);
+    }
+    fio_thread_mutex_unlock(&fio___http_log.writing);
+    FIO_ASSERT(fio_thread_waitpid(child, &status, 0) == child &&
+                   WIFEXITED(status) && !WEXITSTATUS(status),
+               "forked child should start its own HTTP log writer");
+    log = fio___test_http_log_collect(tmp, org);
+    FIO_ASSERT(fio___test_http_log_count(log, "start") == 1 &&
+                   fio___test_http_log_count(log, "p") == 10 &&
+                   fio___test_http_log_count(log, "child") == 10,
+               "forked HTTP logs error:\n%s",
+               log);
+    fio_bstr_free(log);
+  }
+}
+#else
+FIO_SFUNC void FIO_NAME_TEST(stl, http_log)(void) {}
+#endif /* FIO_OS_POSIX */
+
+/* *****************************************************************************
+Static File Cache Tests
+***************************************************************************** */
+#if FIO_HTTP_STATIC_CACHE_LIMIT && FIO_OS_POSIX
+/* writes `len` bytes of `c` to `dir/name`, leaving the file name in `fn` */
+FIO_SFUNC void fio___test_sfile_write(fio_str_info_s *fn,
+                                      const char *dir,
+                                      const char *name,
+                                      int c,
+                                      size_t len) {
+  FILE *f;
+  fn->len = 0;
+  fio_string_printf(fn, NULL, "%s/%s", dir, name);
+  f = fopen(fn->buf, "wb");
+  FIO_ASSERT(f, "couldn't create a temporary file for testing");
+  for (size_t i = 0; i < len; ++i)
+    fputc(c, f);
+  fclose(f);
+}
+
+/* gets a static file object from the cache (or the file system) */
+FIO_SFUNC fio___http_sfile_s *fio___test_sfile_get(fio_str_info_s *fn) {
+  return fio___http_sfile_get(fn, fio_risky_hash(fn->buf, fn->len, 0), 0);
+}
+
+/* returns the cached object (if any), without resolving the file */
+FIO_SFUNC fio___http_sfile_s *fio___test_sfile_peek(fio_str_info_s fn) {
+  return fio___http_sfile_map_get(&fio___http_sfile_cache.map,
+                                  fio_risky_hash(fn.buf, fn.len, 0),
+                                  fn);
+}
+
+FIO_SFUNC void FIO_NAME_TEST(stl, http_static_cache)(void) {
+  fprintf(stderr, "* Testing HTTP static file cache (fio___http_sfile).\n");
+  char dir[] = "/tmp/fio_test_sfile_XXXXXX";
+  FIO_STR_INFO_TMP_VAR(fn, 1023);
+  fio___http_sfile_s *f, *f2;
+  FIO_ASSERT(mkdtemp(dir), "couldn't create a temporary folder for testing");
+  fio___http_sfile_cache_destroy();
+
+  /* hit within the TTL, even if the file changed */
+  fio___test_sfile_write(&fn, dir, "a.txt", 'a', 5);
+  f = fio___test_sfile_get(&fn);
+  FIO_ASSERT(f && f->v[0].len == 5 && fio_bstr_len(f->v[0].data) == 5 &&
+                 !FIO_MEMCMP(f->v[0].data, "aaaaa", 5),
+             "static file should be resolved and kept in memory");
+  fio___test_sfile_write(&fn, dir, "a.txt", 'b', 7);
+  f2 = fio___test_sfile_get(&fn);
+  FIO_ASSERT(f2 == f && f2->v[0].len == 5,
+             "static file cache should hit within the TTL");
+  fio___http_sfile_free(f2);
+
+  /* re-validated (re-stat) once the TTL expired */
+  f->expires = 0; /* expire the cached object */
+  fio___http_sfile_free(f);
+  f = fio___test_sfile_get(&fn);
+  FIO_ASSERT(f && f != f2 && f->v[0].len == 7 &&
+                 fio_bstr_len(f->v[0].data) == 7 &&
+                 !FIO_MEMCMP(f->v[0].data, "bbbbbbb", 7),
+             "static file should be re-validated after the TTL");
+  FIO_ASSERT(fio___test_sfile_peek(fn) == f,
+             "re-validated file should replace the cached object");
+  fio___http_sfile_free(f);
+
+  /* files over the size limit aren't kept in memory */
+  fio___test_sfile_write(&fn,
+                         dir,
+                         "big.txt",
+                         'c',
+                         FIO_HTTP_STATIC_CACHE_FILE_LIMIT + 1);
+  f = fio___test_sfile_get(&fn);
+  FIO_ASSERT(f && f->v[0].len == FIO_HTTP_STATIC_CACHE_FILE_LIMIT + 1 &&
+                 !f->v[0].data,
+             "large static files should bypass the in-memory cache");
+  fio___http_sfile_free(f);
+  fio___test_sfile_write(&fn,
+                         dir,
+                         "limit.txt",
+                         'c',
+                         FIO_HTTP_STATIC_CACHE_FILE_LIMIT);
+  f = fio___test_sfile_get(&fn);
+  FIO_ASSERT(f && fio_bstr_len(f->v[0].data) ==
+                      FIO_HTTP_STATIC_CACHE_FILE_LIMIT,
+             "static files up to the size limit should be kept in memory");
+  fio___http_sfile_free(f);
+
+  /* LRU eviction: the least recently used file is evicted first */
+  fio___http_sfile_cache_destroy();
+  for (size_t i = 0; i <= FIO_HTTP_STATIC_CACHE_LIMIT; ++i) {
+    char name[32];
+    snprintf(name, sizeof(name), "%zu.txt", i);
+    fio___test_sfile_write(&fn, dir, name, 'd', 1);
+    if (i == FIO_HTTP_STATIC_CACHE_LIMIT) { /* touch file 0 before overflow */
+      FIO_STR_INFO_TMP_VAR(first, 1023);
+      fio___test_sfile_write(&first, dir, "0.txt", 'd', 1);
+      fio___http_sfile_free(fio___test_sfile_get(&first));
+    }
+    fio___http_sfile_free(fio___test_sfile_get(&fn));
+  }
+  FIO_ASSERT(fio___http_sfile_map_count(&fio___http_sfile_cache.map) ==
+                 FIO_HTTP_STATIC_CACHE_LIMIT,
+             "static file cache should be limited to %zu entries (%zu)",
+             (size_t)FIO_HTTP_STATIC_CACHE_LIMIT,
+             (size_t)fio___http_sfile_map_count(&fio___http_sfile_cache.map));
+  FIO_ASSERT(fio___test_sfile_peek(fn),
+             "newest static file should be cached");
+  fn.len = 0;
+  fio_string_printf(&fn, NULL, "%s/0.txt", dir);
+  FIO_ASSERT(fio___test_sfile_peek(fn),
+             "recently used static file shouldn't be evicted");
+  fn.len = 0;
+  fio_string_printf(&fn, NULL, "%s/1.txt", dir);
+  FIO_ASSERT(!fio___test_sfile_peek(fn),
+             "least recently used static file should be evicted");
+
+  /* cleanup */
+  fio___http_sfile_cache_destroy();
+  for (size_t i = 0; i <= FIO_HTTP_STATIC_CACHE_LIMIT; ++i) {
+    fn.len = 0;
+    fio_string_printf(&fn, NULL, "%s/%zu.txt", dir, i);
+    unlink(fn.buf);
+  }
+  const char *others[] = {"a.txt", "big.txt", "limit.txt"};
+  for (size_t i = 0; i < sizeof(others) / sizeof(others[0]); ++i) {
+    fn.len = 0;
+    fio_string_printf(&fn, NULL, "%s/%s", dir, others[i]);
+    unlink(fn.buf);
+  }
+  FIO_ASSERT(!rmdir(dir), "couldn't remove the temporary test folder");
+}
+#else
+FIO_SFUNC void FIO_NAME_TEST(stl, http_static_cache)(void) {}
+#endif /* FIO_HTTP_STATIC_CACHE_LIMIT */
+
+/* *****************************************************************************
+Router Tests
+***************************************************************************** */
+#if defined(H___FIO_HTTP___H)
+FIO_SFUNC void fio___test_http_route_a(fio_http_s *h) { (void)h; }
+FIO_SFUNC void fio___test_http_route_b(fio_http_s *h) { (void)h; }
+FIO_SFUNC void fio___test_http_route_c(fio_http_s *h) { (void)h; }
+FIO_SFUNC void fio___test_http_route_d(fio_http_s *h) { (void)h; }
+FIO_SFUNC void fio___test_http_route_e(fio_http_s *h) { (void)h; }
+
+FIO_SFUNC void FIO_NAME_TEST(stl, http_router)(void) {
+  fprintf(stderr, "* Testing HTTP router (fio_http_router_s).\n");
+  fio_http_router_s *r = fio_http_router_new();
+  fio_http_s *h = fio_http_new();
+  FIO_ASSERT(!fio_http_route(r, "GET", "/", .on_http = fio___test_http_route_a),
+             "route / should be valid");
+  FIO_ASSERT(!fio_http_route(r,
+                             "GET",
+                             "/users/list",
+                             .on_http = fio___test_http_route_b),
+             "route /users/list should be valid");
+  FIO_ASSERT(!fio_http_route(r,
+                             "GET",
+                             "/users/:id",
+                             .on_http = fio___test_http_route_c),
+             "route /users/:id should be valid");
+  FIO_ASSERT(!fio_http_route(r,
+                             "GET",
+                             "/users/:id/posts/:post",
+                             .on_http = fio___test_http_route_d),
+             "route /users/:id/posts/:post should be valid");
+  FIO_ASSERT(!fio_http_route(r,
+                             NULL,
+                             "/users/:id/*rest",
+                             .on_http = fio___test_http_route_e,
+                             .max_body_size = 10),
+             "route /users/:id/*rest should be valid");
+  FIO_ASSERT(!fio_http_route(r,
+                             "POST",
+                             "/users/lisp",
+                             .on_http = fio___test_http_route_a),
+             "route /users/lisp should be valid (splits an edge)");
+  FIO_ASSERT(fio_http_route(r,
+                            "GET",
+                            "/users/:name/x",
+                            .on_http = fio___test_http_route_a),
+             "conflicting parameter names should fail");
+  FIO_ASSERT(fio_http_route(r,
+                            "GET",
+                            "/*a/b",
+                            .on_http = fio___test_http_route_a),
+             "wildcard segments must be last");
+  FIO_ASSERT(fio_http_route(r,
+                            "GET",
+                            "no/slash",
+                            .on_http = fio___test_http_route_a),
+             "patterns must start with a slash");
+  struct {
+    const char *method;
+    const char *path;
+    void (*expected)(fio_http_s *);
+    const char *name;
+    const char *value;
+  } tests[] = {
+      {"GET", "/", fio___test_http_route_a, NULL, NULL},
+      {"GET", "/users/list", fio___test_http_route_b, NULL, NULL},
+      {"POST", "/users/lisp", fio___test_http_route_a, NULL, NULL},
+      {"GET", "/users/lisp", fio___test_http_route_c, "id", "lisp"},
+      {"GET", "/users/42", fio___test_http_route_c, "id", "42"},
+      {"GET", "/users/42/posts/7", fio___test_http_route_d, "post", "7"},
+      {"GET", "/users/42/posts", fio___test_http_route_e, "rest", "posts"},
+      {"PUT", "/users/42/posts/7", fio___test_http_route_e, "rest", "posts/7"},
+      {"GET", "/users/42/", fio___test_http_route_e, "rest", ""},
+      {"POST", "/users/list", NULL, NULL, NULL},
+      {"GET", "/users/", NULL, NULL, NULL},
+      {"GET", "/nothing", NULL, NULL, NULL},
+      {NULL},
+  };
+  for (size_t i = 0; tests[i].method; ++i) {
+    fio_http_reset(h);
+    fio_http_method_set(h, FIO_STR_INFO1((char *)tests[i].method));
+    fio_http_path_set(h, FIO_STR_INFO1((char *)tests[i].path));
+    fio_http_route_s *route = fio_http_router_match(r, h);
+    FIO_ASSERT((route ? route->on_http : NULL) == tests[i].expected,
+               "HTTP router match error for %s %s",
+               tests[i].method,
+               tests[i].path);
+    if (!tests[i].name)
+      continue;
+    fio_str_info_s v =
+        fio_http_param(h, FIO_STR_INFO1((char *)tests[i].name));
+    FIO_ASSERT(v.buf && v.len == FIO_STRLEN(tests[i].value) &&
+                   !FIO_MEMCMP(v.buf, tests[i].value, v.len),
+               "HTTP router param error for %s %s (%s => %.*s)",
+               tests[i].method,
+               tests[i].path,
+               tests[i].name,
+               (int)v.len,
+               v.buf);
+  }
+  fio_http_reset(h);
+  fio_http_method_set(h, FIO_STR_INFO1((char *)"GET"));
+  fio_http_path_set(h, FIO_STR_INFO1((char *)"/users/42/posts/7"));
+  FIO_ASSERT(fio_http_router_match(r, h)->max_body_size == 0,
+             "HTTP router route settings error");
+  FIO_ASSERT(fio_http_param_each(h, NULL, NULL) == 2,
+             "HTTP router should capture 2 params");
+  FIO_ASSERT(fio_http_param(h, FIO_STR_INFO1((char *)"id")).len == 2,
+             "HTTP router param id error");
+  fio_http_free(h);
+  fio_http_router_free(r);
+}
+#else
+FIO_SFUNC void FIO_NAME_TEST(stl, http_router)(void) {}
+#endif /* H___FIO_HTTP___H */
+
+/* *****************************************************************************
+Cleanup
+***************************************************************************** */
+#endif /* FIO_TEST_ALL */
+/* ************************************************************************* */
+#if !defined(FIO_INCLUDE_FILE) /* Dev test - ignore line */
+#define FIO___DEV___           /* Development inclusion - ignore line */
+#define FIO_TEST_ALL           /* Development inclusion - ignore line */
+#include "./include.h"         /* Development inclusion - ignore line */
+#endif                         /* Development inclusion - ignore line */
+/* *****************************************************************************
+
+
+
+
+                        FIO_HTTP Test Helper
+
+
+
+
+Copyright and License: see header file (000 copyright.h) or top of file
+***************************************************************************** */
+#if defined(FIO_TEST_ALL) && !defined(FIO___TEST_REINCLUDE) &&                 \
+    !defined(H___FIO_HTTP_TEST___H)
+#define H___FIO_HTTP_TEST___H
+#if defined(H___FIO_HTTP___H)
+
+/* *****************************************************************************
+Mock WebSocket Connections (data is fed directly, without an IO object)
+***************************************************************************** */
+
+/* collects the messages received by a mock WebSocket connection */
+static struct {
+  char *msg;    /* the message data (all messages, concatenated) */
+  size_t count; /* the number of messages received */
+  size_t text;  /* the number of text messages received */
+} fio___test_ws;
+
+FIO_SFUNC void fio___test_ws_reset(void) {
+  fio_bstr_free(fio___test_ws.msg);
+  fio___test_ws.msg = NULL;
+  fio___test_ws.count = 0;
+  fio___test_ws.text = 0;
+}
+
+FIO_SFUNC void fio___test_ws_on_message(fio_http_s *h,
+                                        fio_buf_info_s msg,
+                                        uint8_t is_text) {
+  fio___test_ws.msg = fio_bstr_write(fio___test_ws.msg, msg.buf, msg.len);
+  ++fio___test_ws.count;
+  fio___test_ws.text += is_text;
+  (void)h;
+}
+
+FIO_SFUNC void fio___test_ws_on_partial(fio_http_s *h,
+                                        fio_buf_info_s chunk,
+                                        uint8_t is_text,
+                                        uint8_t is_first,
+                                        uint8_t is_last) {
+  fio___test_ws.msg = fio_bstr_write(fio___test_ws.msg, chunk.buf, chunk.len);
+  fio___test_ws.count += is_last;
+  fio___test_ws.text += (is_text & is_first);
+  (void)h;
+}
+
+/* creates a server side connection, as if upgraded to WebSockets */
+FIO_SFUNC fio___http_connection_s *fio___test_ws_new(fio_http_settings_s s) {
+  fio___http_protocol_s *p = fio___http_protocol_new(0);
+  fio___http_connection_s *c = fio___http_connection_new();
+  FIO_ASSERT_ALLOC(p && c);
+  FIO_MEMSET(p, 0, sizeof(*p));
+  if (!s.on_message)
+    s.on_message = fio___test_ws_on_message;
+  http_settings_validate(&s, 0);
+  p->settings = s;
+  p->queue = fio_srv_queue();
+  *c = (fio___http_connection_s){
+      .settings = &p->settings,
+      .queue = p->queue,
+      .h = fio_http_new(),
+      .capa = p->settings.max_line_len,
+  };
+  c->state.ws = (struct fio___http_connection_ws_s){
+      .on_message = c->settings->on_message,
+      .parser.stream = !!c->settings->on_message_partial,
+  };
+  return c;
+}
+
+FIO_SFUNC void fio___test_ws_free(fio___http_connection_s *c) {
+  c->len = 0;
+  fio___http_buffer_release(c);
+  fio_bstr_free(c->state.ws.msg);
+#if HAVE_ZLIB
+  fio___websocket_deflate_destroy(c);
+#endif
+  fio_http_free(c->h);
+  fio___http_connection_free(c);
+}
+
+/* feeds data to the connection, returns -1 on a protocol error */
+FIO_SFUNC int fio___test_ws_feed(fio___http_connection_s *c,
+                                 const char *data,
+                                 size_t len) {
+  fio___http_buffer_pool_s *pool =
+      &FIO_PTR_FROM_FIELD(fio___http_protocol_s, settings, c->settings)
+           ->buffers;
+  int r;
+  FIO_ASSERT(c->len + len <= c->capa, "mock WebSocket data too long");
+  FIO_MEMCPY(fio___http_buffer(c) + c->len, data, len);
+  FIO_ASSERT(c->buf && !pool->count, "read buffer should be borrowed");
+  c->len += (uint32_t)len;
+  r = fio___websocket_process_data(NULL, c);
+  FIO_ASSERT(c->len ? (c->buf && !pool->count) : (!c->buf && pool->count == 1),
+             "idle connections should return the read buffer (%u bytes left)",
+             (unsigned)c->len);
+  return r;
+}
+
+FIO_SFUNC void FIO_NAME_TEST(stl, http_buffer_pool)(void) {
+  fprintf(stderr, "* Testing HTTP read buffer pool.\n");
+  enum { FIO___TEST_BUF_COUNT = FIO_HTTP_READ_BUFFER_POOL_LIMIT + 8 };
+  fio___http_buffer_pool_s pool = {0};
+  char *buffers[FIO___TEST_BUF_COUNT];
+  for (size_t i = 0; i < FIO___TEST_BUF_COUNT; ++i)
+    buffers[i] = fio___http_buffer_pool_pop(&pool, 128);
+  for (size_t i = 0; i < FIO___TEST_BUF_COUNT; ++i) {
+    fio___http_buffer_pool_push(&pool, buffers[i], 128);
+    FIO_ASSERT(pool.count == (i < FIO_HTTP_READ_BUFFER_POOL_LIMIT
+                                  ? i + 1
+                                  : FIO_HTTP_READ_BUFFER_POOL_LIMIT),
+               "read buffer pool should keep at most %zu idle buffers (%u)",
+               (size_t)FIO_HTTP_READ_BUFFER_POOL_LIMIT,
+               (unsigned)pool.count);
+  }
+  /* idle buffers are reused (most recently returned first) */
+  for (size_t i = FIO_HTTP_READ_BUFFER_POOL_LIMIT; i--;) {
+    char *b = fio___http_buffer_pool_pop(&pool, 128);
+    FIO_ASSERT(b == buffers[i] && pool.count == i,
+               "read buffer pool should reuse idle buffers (%zu)",
+               i);
+  }
+  FIO_ASSERT(!pool.count && !pool.head, "read buffer pool should be empty");
+  for (size_t i = 0; i < FIO_HTTP_READ_BUFFER_POOL_LIMIT; ++i)
+    fio___http_buffer_pool_push(&pool, buffers[i], 128);
+  fio___http_buffer_pool_destroy(&pool, 128);
+  FIO_ASSERT(!pool.count && !pool.head, "read buffer pool destroy error");
+}
+
+/* *****************************************************************************
+WebSocket permessage-deflate (RFC 7692)
+***************************************************************************** */
+#if HAVE_ZLIB
+
+/* compresses and frames a (masked) client message, returns the frame length */
+FIO_SFUNC size_t fio___test_ws_deflate_frame(char *dest,
+                                             z_stream *z,
+                                             const char *msg,
+                                             size_t len,
+                                             uint8_t opcode) {
+  char tmp[4096];
+  z->next_in = (Bytef *)msg;
+  z->avail_in = (uInt)len;
+  z->next_out = (Bytef *)tmp;
+  z->avail_out = (uInt)sizeof(tmp);
+  FIO_ASSERT(deflate(z, Z_SYNC_FLUSH) == Z_OK && z->avail_out,
+             "test message deflate error");
+  /* remove the trailing 0x00 0x00 0xFF 0xFF (RFC 7692, section 7.2.1) */
+  len = sizeof(tmp) - z->avail_out - 4;
+  return (size_t)fio_websocket_client_wrap(dest, tmp, len, opcode, 1, 1, 4);
+}
+
+FIO_SFUNC void FIO_NAME_TEST(stl, http_websocket_deflate)(void) {
+  fprintf(stderr, "* Testing WebSocket permessage-deflate.\n");
+  { /* offer / response negotiation */
+    struct {
+      const char *offer;
+      const char *response; /* NULL == declined */
+      uint8_t no_context_takeover;
+      uint8_t in_reset;
+      uint8_t out_reset;
+      uint8_t bits;
+    } tests[] = {
+        {"permessage-deflate", "permessage-deflate", 0, 0, 0, 13},
+        {"permessage-deflate; server_no_context_takeover",
+         "permessage-deflate; server_no_context_takeover",
+         0,
+         0,
+         1,
+         13},
+        {"permessage-deflate; client_no_context_takeover",
+         "permessage-deflate; client_no_context_takeover",
+         0,
+         1,
+         0,
+         13},
+        {"permessage-deflate",
+         "permessage-deflate; server_no_context_takeover; "
+         "client_no_context_takeover",
+         1,
+         1,
+         1,
+         13},
+        {"permessage-deflate; server_max_window_bits=10",
+         "permessage-deflate; server_max_window_bits=10",
+         0,
+         0,
+         0,
+         10},
+        {"permessage-deflate; server_max_window_bits=15",
+         "permessage-deflate; server_max_window_bits=13",
+         0,
+         0,
+         0,
+         13},
+        {"permessage-deflate; client_max_window_bits",
+         "permessage-deflate",
+         0,
+         0,
+         0,
+         13},
+        {"permessage-deflate; client_max_window_bits=9",
+         "permessage-deflate",
+         0,
+         0,
+         0,
+         13},
+        {"permessage-deflate; server_max_window_bits=8", NULL, 0, 0, 0, 0},
+        {"permessage-deflate; server_max_window_bits", NULL, 0, 0, 0, 0},
+        {"permessage-deflate; client_max_window_bits=16", NULL, 0, 0, 0, 0},
+        {"permessage-deflate; unknown_parameter", NULL, 0, 0, 0, 0},
+        {"x-webkit-deflate-frame", NULL, 0, 0, 0, 0},
+        {"permessage-deflate; server_max_window_bits=8, permessage-deflate",
+         "permessage-deflate",
+         0,
+         0,
+         0,
+         13},
+    };
+    for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i) {
+      fio___http_connection_s *c =
+          fio___test_ws_new((fio_http_settings_s){
+              .ws_compress_min = 1,
+              .ws_no_context_takeover = tests[i].no_context_takeover});
+      fio_str_info_s r;
+      fio_http_request_header_set(
+          c->h,
+          FIO_STR_INFO1((char *)"sec-websocket-extensions"),
+          FIO_STR_INFO1((char *)tests[i].offer));
+      fio___websocket_deflate_negotiate(c->h, c);
+      r = fio_http_response_header(
+          c->h,
+          FIO_STR_INFO1((char *)"sec-websocket-extensions"),
+          0);
+      FIO_ASSERT(tests[i].response
+                     ? FIO_STR_INFO_IS_EQ(
+                           r,
+                           FIO_STR_INFO1((char *)tests[i].response))
+                     : !r.len,
+                 "permessage-deflate negotiation error for:\n\t%s\n\t%s",
+                 tests[i].offer,
+                 (r.len ? r.buf : "(declined)"));
+      fio___websocket_deflate_setup(c);
+      FIO_ASSERT(c->state.ws.deflate.on == !!tests[i].response &&
+                     c->state.ws.deflate.in_reset == tests[i].in_reset &&
+                     c->state.ws.deflate.out_reset == tests[i].out_reset &&
+                     c->state.ws.deflate.bits == tests[i].bits,
+                 "permessage-deflate setup error for:\n\t%s",
+                 tests[i].offer);
+      fio___test_ws_free(c);
+    }
+    { /* compression is opt-in */
+      fio___http_connection_s *c =
+          fio___test_ws_new((fio_http_settings_s){0});
+      fio_http_request_header_set(
+          c->h,
+          FIO_STR_INFO1((char *)"sec-websocket-extensions"),
+          FIO_STR_INFO1((char *)"permessage-deflate"));
+      fio___websocket_deflate_negotiate(c->h, c);
+      FIO_ASSERT(!fio_http_response_header(
+                      c->h,
+                      FIO_STR_INFO1((char *)"sec-websocket-extensions"),
+                      0)
+                      .len,
+                 "permessage-deflate should be declined unless enabled");
+      fio___test_ws_free(c);
+    }
+  }
+  { /* compressed messages round-trip through the parser */
+    char msg[2048];
+    char frame[4096];
+    for (size_t i = 0; i < sizeof(msg); ++i)
+      msg[i] = "permessage-deflate test message\n"[i & 31];
+    for (size_t reset = 0; reset < 2; ++reset) {
+      for (size_t stream = 0; stream < 2; ++stream) {
+        fio___http_connection_s *c = fio___test_ws_new((fio_http_settings_s){
+            .ws_compress_min = 1,
+            .ws_no_context_takeover = (uint8_t)reset,
+            .on_message_partial =
+                (stream ? fio___test_ws_on_partial : NULL),
+        });
+        z_stream z = {0};
+        FIO_ASSERT(deflateInit2(&z,
+                                Z_DEFAULT_COMPRESSION,
+                                Z_DEFLATED,
+                                -15,
+                                8,
+                                Z_DEFAULT_STRATEGY) == Z_OK,
+                   "deflateInit2 failed");
+        fio_http_request_header_set(
+            c->h,
+            FIO_STR_INFO1((char *)"sec-websocket-extensions"),
+            FIO_STR_INFO1((char *)"permessage-deflate"));
+        fio___websocket_deflate_negotiate(c->h, c);
+        fio___websocket_deflate_setup(c);
+        fio___test_ws_reset();
+        for (size_t round = 0; round < 3; ++round) {
+          /* messages reuse the compression context, unless reset */
+          size_t len = fio___test_ws_deflate_frame(frame,
+                                                   &z,
+                                                   msg,
+                                                   sizeof(msg),
+                                                   (round & 1) + 1);
+          FIO_ASSERT(len < sizeof(msg), "test message should be compressed");
+          FIO_ASSERT(!fio___test_ws_feed(c, frame, len),
+                     "compressed WebSocket message rejected (round %zu)",
+                     round);
+          if (reset)
+            deflateReset(&z);
+        }
+        FIO_ASSERT(fio___test_ws.count == 3 && fio___test_ws.text == 2 &&
+                       fio_bstr_len(fio___test_ws.msg) == sizeof(msg) * 3,
+                   "compressed WebSocket messages missing (%zu, %zu bytes)",
+                   fio___test_ws.count,
+                   fio_bstr_len(fio___test_ws.msg));
+        for (size_t i = 0; i < 3; ++i)
+          FIO_ASSERT(!FIO_MEMCMP(fio___test_ws.msg + (i * sizeof(msg)),
+                                 msg,
+                                 sizeof(msg)),
+                     "compressed WebSocket message corrupted");
+        FIO_ASSERT(!reset || !c->state.ws.deflate.in,
+                   "client_no_context_takeover should release the inflater");
+        deflateEnd(&z);
+        fio___test_ws_free(c);
+      }
+    }
+  }
+  { /* inflated messages are limited by `ws_max_msg_size` */
+    char msg[4096];
+    char frame[4096];
+    size_t len;
+    fio___http_connection_s *c =
+        fio___test_ws_new((fio_http_settings_s){.ws_compress_min = 1,
+                                                .ws_max_msg_size = 1024});
+    z_stream z = {0};
+    FIO_MEMSET(msg, 'a', sizeof(msg));
+    FIO_ASSERT(
+        deflateInit2(&z, Z_BEST_COMPRESSION, Z_DEFLATED, -15, 8, 0) == Z_OK,
+        "deflateInit2 failed");
+    fio_http_request_header_set(
+        c->h,
+        FIO_STR_INFO1((char *)"sec-websocket-extensions"),
+        FIO_STR_INFO1((char *)"permessage-deflate"));
+    fio___websocket_deflate_negotiate(c->h, c);
+    fio___websocket_deflate_setup(c);
+    fio___test_ws_reset();
+    len = fio___test_ws_deflate_frame(frame, &z, msg, 1000, 2);
+    FIO_ASSERT(!fio___test_ws_feed(c, frame, len) && fio___test_ws.count == 1,
+               "compressed messages within the limit should be accepted");
+    len = fio___test_ws_deflate_frame(frame, &z, msg, sizeof(msg), 2);
+    FIO_ASSERT(len < 1024, "test message should be compressed below limit");
+    { /* the protocol error attempts to send a close frame to a NULL IO */
+      int old_level = FIO_LOG_LEVEL_GET();
+      FIO_LOG_LEVEL_SET(FIO_LOG_LEVEL_FATAL);
+      FIO_ASSERT(
+          fio___test_ws_feed(c, frame, len) && fio___test_ws.count == 1,
+          "messages exceeding ws_max_msg_size once inflated should fail");
+      FIO_LOG_LEVEL_SET(old_level);
+    }
+    deflateEnd(&z);
+    fio___test_ws_free(c);
+    fio___test_ws_reset();
+  }
+}
+#else
+FIO_SFUNC void FIO_NAME_TEST(stl, http_websocket_deflate)(void) {}
+#endif /* HAVE_ZLIB */
+
+/* *****************************************************************************
+WebSocket Parsing (split frames, streaming and UTF-8 validation)
+***************************************************************************** */
+
+/* frames a (masked) client message as `frames` fragments, returns the length */
+FIO_SFUNC size_t fio___test_ws_frames(char *dest,
+                                      const char *msg,
+                                      size_t len,
+                                      size_t frames,
+                                      uint8_t opcode) {
+  size_t r = 0;
+  for (size_t i = 0; i < frames; ++i) {
+    const size_t start = (len * i) / frames;
+    const size_t end = (len * (i + 1)) / frames;
+    r += (size_t)fio_websocket_client_wrap(dest + r,
+                                           msg + start,
+                                           end - start,
+                                           opcode,
+                                           !i,
+                                           (i + 1 == frames),
+                                           0);
+  }
+  return r;
+}
+
+/* feeds data in two chunks (split at `at`), returns -1 on a protocol error */
+FIO_SFUNC int fio___test_ws_feed_split(fio___http_connection_s *c,
+                                       const char *data,
+                                       size_t len,
+                                       size_t at) {
+  int r = fio___test_ws_feed(c, data, at);
+  if (!r && at < len)
+    r = fio___test_ws_feed(c, data + at, len - at);
+  return r;
+}
+
+/* tests that a fed message was received once, as `msg` */
+#define FIO___TEST_WS_RECEIVED(msg, len, ...)                                  \
+  FIO_ASSERT(fio___test_ws.count == 1 && fio___test_ws.text == 1 &&            \
+                 fio_bstr_len(fio___test_ws.msg) == (len) &&                   \
+                 !FIO_MEMCMP(fio___test_ws.msg, (msg), (len)),                 \
+             __VA_ARGS__)
+
+FIO_SFUNC void FIO_NAME_TEST(stl, http_websocket_parser)(void) {
+  fprintf(stderr, "* Testing WebSocket parsing (split frames, UTF-8).\n");
+  /* ASCII and 2, 3 and 4 byte code points, split by fragments and chunks */
+  static const char msg[] = "WebSocket: \xC3\xA9t\xC3\xA9 \xE2\x82\xAC" "5 "
+                            "\xF0\x9F\x98\x80 - text, split everywhere.";
+  const size_t len = sizeof(msg) - 1;
+  char frame[512];
+  for (size_t stream = 0; stream < 2; ++stream) {
+    fio___http_connection_s *c = fio___test_ws_new((fio_http_settings_s){
+        .on_message_partial = (stream ? fio___test_ws_on_partial : NULL),
+    });
+    for (size_t frames = 1; frames < 4; ++frames) {
+      /* frames may split a code point, chunks split at every mask offset */
+      size_t flen = fio___test_ws_frames(frame, msg, len, frames, 1);
+      for (size_t at = 0; at <= flen; ++at) {
+        fio___test_ws_reset();
+        FIO_ASSERT(!fio___test_ws_feed_split(c, frame, flen, at),
+                   "split WebSocket message rejected (stream %zu, frames "
+                   "%zu, split at %zu)",
+                   stream,
+                   frames,
+                   at);
+        FIO___TEST_WS_RECEIVED(msg,
+                               len,
+                               "split WebSocket message error (stream %zu, "
+                               "frames %zu, split at %zu)",
+                               stream,
+                               frames,
+                               at);
+      }
+      fio___test_ws_reset();
+      for (size_t i = 0; i < flen; ++i) /* a byte at a time */
+        FIO_ASSERT(!fio___test_ws_feed(c, frame + i, 1),
+                   "WebSocket message fed a byte at a time rejected");
+      FIO___TEST_WS_RECEIVED(msg,
+                             len,
+                             "WebSocket message fed a byte at a time error");
+    }
+    { /* many messages in a single feed are all delivered */
+      size_t flen = fio___test_ws_frames(frame, msg, len, 1, 1);
+      flen += fio___test_ws_frames(frame + flen, msg, len, 2, 2);
+      flen += fio___test_ws_frames(frame + flen, msg, len, 3, 1);
+      fio___test_ws_reset();
+      FIO_ASSERT(!fio___test_ws_feed(c, frame, flen) &&
+                     fio___test_ws.count == 3 && fio___test_ws.text == 2 &&
+                     fio_bstr_len(fio___test_ws.msg) == len * 3,
+                 "WebSocket messages in a single feed missing (stream %zu, "
+                 "%zu messages)",
+                 stream,
+                 fio___test_ws.count);
+    }
+    fio___test_ws_free(c);
+  }
+  { /* invalid or truncated UTF-8 text fails when streamed */
+    struct {
+      const char *msg;
+      size_t frames;
+      size_t at; /* the second chunk (0 == fed at once) */
+    } tests[] = {
+        {"abc\xC3\x28" "def", 1, 0},         /* an invalid continuation */
+        {"abc\x80" "def", 1, 0},              /* a lone continuation byte */
+        {"abc\xFF\xBF\xBF\xBF" "def", 1, 0}, /* an invalid lead byte */
+        {"abc\xE2\x82", 1, 0},               /* truncated (end of message) */
+        {"abc\xE2\x82", 2, 0},               /* truncated, fragmented */
+        {"abc\xE2\x82", 1, 10},              /* truncated, split chunks */
+        {"abc\xE2\x28\xA1" "def", 2, 0},     /* invalid, split fragments */
+        {"abc\xE2\x28\xA1" "def", 1, 10},    /* invalid, split chunks */
+    };
+    int old_level = FIO_LOG_LEVEL_GET();
+    FIO_LOG_LEVEL_SET(FIO_LOG_LEVEL_FATAL); /* the close frame has no IO */
+    for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i) {
+      fio___http_connection_s *c = fio___test_ws_new((fio_http_settings_s){
+          .on_message_partial = fio___test_ws_on_partial,
+      });
+      size_t flen = fio___test_ws_frames(frame,
+                                         tests[i].msg,
+                                         FIO_STRLEN(tests[i].msg),
+                                         tests[i].frames,
+                                         1);
+      fio___test_ws_reset();
+      FIO_ASSERT(fio___test_ws_feed_split(c,
+                                          frame,
+                                          flen,
+                                          (tests[i].at ? tests[i].at : flen)) &&
+                     !fio___test_ws.count,
+                 "invalid UTF-8 should fail a streamed message (%zu)",
+                 i);
+      fio___test_ws_free(c);
+    }
+    FIO_LOG_LEVEL_SET(old_level);
+    fio___test_ws_reset();
+  }
+}
+#undef FIO___TEST_WS_RECEIVED
+
+/* *****************************************************************************
+WebSocket Tests
 ***************************************************************************** */
-#endif /* FIO_TEST_ALL */
-/* ************************************************************************* */
-#if !defined(FIO_INCLUDE_FILE) /* Dev test - ignore line */
-#define FIO___DEV___           /* Development inclusion - ignore line */
-#define FIO_TEST_ALL           /* Development inclusion - ignore line */
-#include "./include.h"         /* Development inclusion - ignore line */
-#endif                         /* Development inclusion - ignore line */
-/* *****************************************************************************
-
 
+FIO_SFUNC void FIO_NAME_TEST(stl, http_websocket)(void) {
+  FIO_NAME_TEST(stl, http_buffer_pool)();
+  FIO_NAME_TEST(stl, http_websocket_parser)();
+  FIO_NAME_TEST(stl, http_websocket_deflate)();
+}
 
+/* *****************************************************************************
+Mock HTTP Client Connections (responses are fed directly, without an IO object)
+***************************************************************************** */
 
-                        FIO_GLOB_MATCH Test Helper
+/* collects the responses received by the HTTP client */
+static struct {
+  void *listener;    /* the test server's listener */
+  char *body;        /* the response bodies (all responses, concatenated) */
+  size_t count;      /* the number of responses received */
+  size_t status[8];  /* the response status codes, in order */
+  size_t accepted;   /* connections accepted by the test server */
+  size_t limit;      /* requests served per connection before it's closed */
+} fio___test_client;
+
+FIO_SFUNC void fio___test_client_reset(void) {
+  fio_bstr_free(fio___test_client.body);
+  FIO_MEMSET(&fio___test_client, 0, sizeof(fio___test_client));
+}
+
+FIO_SFUNC void fio___test_client_on_response(fio_http_s *h) {
+  fio_str_info_s body = fio_http_body_read(h, (size_t)-1);
+  fio___test_client.body =
+      fio_bstr_write(fio___test_client.body, body.buf, body.len);
+  if (fio___test_client.count < 8)
+    fio___test_client.status[fio___test_client.count] = fio_http_status(h);
+  ++fio___test_client.count;
+}
+
+/* creates a client connection (and pool), as if connected to a server */
+FIO_SFUNC fio___http_connection_s *fio___test_client_new(void) {
+  fio___http_client_req_s r = {
+      .key = fio_bstr_write(NULL, "http://127.0.0.1:9", 18)};
+  fio___http_client_pool_s *pool = fio___http_client_pool_create(&r);
+  fio___http_protocol_s *p = pool->protocol;
+  fio___http_connection_s *c = fio___http_connection_new();
+  FIO_ASSERT_ALLOC(c);
+  fio___http_protocol_dup(p);
+  *c = (fio___http_connection_s){
+      .settings = &p->settings,
+      .queue = p->queue,
+      .state.http = {.max_header = p->settings.max_header_size,
+                     .client.pool = pool}, /* the pool's only reference */
+      .capa = p->settings.max_line_len,
+      .is_client = 1,
+  };
+  FIO_LIST_PUSH(&pool->connections, &c->state.http.client.node);
+  ++pool->count;
+  return c;
+}
 
+/* adds a request that waits for a response */
+FIO_SFUNC void fio___test_client_send(fio___http_connection_s *c,
+                                      uint8_t is_head) {
+  fio___http_client_req_s *r = fio___http_client_req_new();
+  *r = (fio___http_client_req_s){
+      .args.on_response = fio___test_client_on_response,
+      .is_head = is_head,
+  };
+  fio___http_client_fifo_push(&c->state.http.client.sent, r);
+  ++c->state.http.client.in_flight;
+}
 
+/* feeds response data, returns -1 if the response was rejected */
+FIO_SFUNC int fio___test_client_feed(fio___http_connection_s *c,
+                                     const char *data) {
+  size_t len = FIO_STRLEN(data);
+  FIO_ASSERT(c->len + len <= c->capa, "mock response data too long");
+  FIO_MEMCPY(fio___http_buffer(c) + c->len, data, len);
+  c->len += (uint32_t)len;
+  fio___http1_process_data(NULL, c);
+  fio_queue_perform_all(fio_srv_queue());
+  return 0 - (c->state.http.client.closing == 2);
+}
 
+/* closes the connection (failing requests without a response) */
+FIO_SFUNC void fio___test_client_close(fio___http_connection_s *c) {
+  c->len = 0;
+  fio___http_buffer_release(c);
+  fio___http_client_on_close(c);
+  fio_queue_perform_all(fio_srv_queue());
+}
 
-Copyright and License: see header file (000 copyright.h) or top of file
+/* *****************************************************************************
+HTTP Client - Response Parsing
 ***************************************************************************** */
-#if defined(FIO_TEST_ALL) && !defined(FIO___TEST_REINCLUDE) &&                 \
-    !defined(H___FIO_GLOB_MATCH_TEST___H)
-#define H___FIO_GLOB_MATCH_TEST___H
 
-#ifndef H___FIO_GLOB_MATCH___H
-#define FIO_GLOB_MATCH
-#define FIO___TEST_REINCLUDE
-#include FIO_INCLUDE_FILE
-#undef FIO___TEST_REINCLUDE
-#endif
-
-FIO_SFUNC void FIO_NAME_TEST(stl, glob_matching)(void) {
+FIO_SFUNC void FIO_NAME_TEST(stl, http_client_response)(void) {
+  fprintf(stderr, "* Testing HTTP client response parsing.\n");
   struct {
-    char *pat;
-    char *str;
-    uint8_t expect;
-  } t[] = {
-      // clang-format off
-      /* test empty string */
-      {.pat = (char *)"", .str = (char *)"", .expect = 1},
-      /* test exact match */
-      {.pat = (char *)"a", .str = (char *)"a", .expect = 1},
-      /* test empty pattern */
-      {.pat = (char *)"", .str = (char *)"a", .expect = 0},
-      /* test longer pattern */
-      {.pat = (char *)"a", .str = (char *)"", .expect = 0},
-      /* test empty string with glob pattern */
-      {.pat = (char *)"*", .str = (char *)"", .expect = 1},
-      /* test glob pattern */
-      {.pat = (char *)"*", .str = (char *)"Whatever", .expect = 1},
-      /* test glob pattern at end */
-      {.pat = (char *)"W*", .str = (char *)"Whatever", .expect = 1},
-      /* test glob pattern as bookends */
-      {.pat = (char *)"*Whatever*", .str = (char *)"Whatever", .expect = 1},
-      /* test glob pattern in the middle */
-      {.pat = (char *)"W*er", .str = (char *)"Whatever", .expect = 1},
-      /* test glob pattern in the middle - empty match*/
-      {.pat = (char *)"W*hatever", .str = (char *)"Whatever", .expect = 1},
-      /* test glob pattern in the middle  - no match */
-      {.pat = (char *)"W*htever", .str = (char *)"Whatever", .expect = 0},
-      /* test partial match with glob at end */
-      {.pat = (char *)"h*", .str = (char *)"Whatever", .expect = 0},
-      /* test partial match with glob in the middle */
-      {.pat = (char *)"h*er", .str = (char *)"Whatever", .expect = 0},
-      /* test glob match with "?"  */
-      {.pat = (char *)"?h*er", .str = (char *)"Whatever", .expect = 1},
-      /* test "?" for length restrictions */
-      {.pat = (char *)"?", .str = (char *)"Whatever", .expect = 0},
-      /* test ? in the middle */
-      {.pat = (char *)"What?ver", .str = (char *)"Whatever", .expect = 1},
-      /* test letter list */
-      {.pat = (char *)"[ASW]hat?ver", .str = (char *)"Whatever", .expect = 1},
-      /* test letter range */
-      {.pat = (char *)"[A-Z]hat?ver", .str = (char *)"Whatever", .expect = 1},
-      /* test letter range (fail) */
-      {.pat = (char *)"[a-z]hat?ver", .str = (char *)"Whatever", .expect = 0},
-      /* test inverted letter range */
-      {.pat = (char *)"[!a-z]hat?ver", .str = (char *)"Whatever", .expect = 1},
-      /* test inverted list */
-      {.pat = (char *)"[!F]hat?ver", .str = (char *)"Whatever", .expect = 1},
-      /* test escaped range */
-      {.pat = (char *)"[!a-z\\]]hat?ver", .str = (char *)"Whatever", .expect = 1},
-      /* test "?" after range (no skip) */
-      {.pat = (char *)"[A-Z]?at?ver", .str = (char *)"Whatever", .expect = 1},
-      /* test error after range (no skip) */
-      {.pat = (char *)"[A-Z]Fat?ver", .str = (char *)"Whatever", .expect = 0},
-      /* end of test marker */
-      {.pat = (char *)NULL, .str = (char *)NULL, .expect = 0},
-      // clang-format on
+    const char *response[2]; /* the second is fed after the first */
+    const char *body;
+    size_t status[2];
+    uint8_t requests;
+    uint8_t is_head;
+    uint8_t error;
+  } tests[] = {
+      {{"HTTP/1.1 200 OK\r\ncontent-length: 5\r\n\r\nHello", NULL},
+       "Hello",
+       {200},
+       1},
+      {{"HTTP/1.1 204 No Content\r\n\r\n", NULL}, "", {204}, 1},
+      {{"HTTP/1.1 204\r\n\r\n", NULL}, "", {204}, 1},
+      {{"HTTP/1.1 304 \r\n\r\n", NULL}, "", {304}, 1},
+      {{"HTTP/1.1 100 Continue\r\n\r\n",
+        "HTTP/1.1 201 Created\r\ncontent-length: 2\r\n\r\nOK"},
+       "OK",
+       {201},
+       1},
+      {{"HTTP/1.1 200 OK\r\ncontent-length: 9\r\n\r\n"
+        "HTTP/1.1 404 Not Found\r\ncontent-length: 1\r\n\r\nX",
+        NULL},
+       "X",
+       {200, 404},
+       2,
+       1},
+      {{"HTTP/1.1 200 OK\r\ntransfer-encoding: chunked\r\n\r\n3\r\nabc\r\n",
+        "2\r\nde\r\n0\r\n\r\n"},
+       "abcde",
+       {200},
+       1},
+      {{"HTTP/1.1 200 OK\r\ncontent-length: 3\r\n\r\nab", "c"},
+       "abc",
+       {200},
+       1},
+      {{"HTTP/1.1 200 OK\r\ncontent-length: 1\r\n\r\n1"
+        "HTTP/1.1 200 OK\r\ncontent-length: 1\r\n\r\n2",
+        NULL},
+       "12",
+       {200, 200},
+       2},
+      /* bodies without a length end when the connection closes */
+      {{"HTTP/1.0 200 OK\r\n\r\nuntil ", "closed"},
+       "until closed",
+       {200},
+       1},
+      {{"HTTP/1.1 200 OK\r\nconnection: close\r\n\r\n", NULL},
+       "",
+       {200},
+       1},
+      /* invalid response lines fail the request (status 0) */
+      {{"HTTP/1.1 20 OK\r\n\r\n", NULL}, "", {0}, 1, 0, 1},
+      {{"HTTP/1.1 2000 OK\r\n\r\n", NULL}, "", {0}, 1, 0, 1},
+      {{"HTTP/1.1 200OK\r\n\r\n", NULL}, "", {0}, 1, 0, 1},
+      {{"HTTP/1.1 099 Low\r\n\r\n", NULL}, "", {0}, 1, 0, 1},
+      {{"HTTP/1.1 abc OK\r\n\r\n", NULL}, "", {0}, 1, 0, 1},
+      {{"HTTP/1.1\r\n\r\n", NULL}, "", {0}, 1, 0, 1},
+      {{"HTTP/1.1 200 OK\r\ncontent-length: 1\r\ncontent-length: 2\r\n\r\n",
+        NULL},
+       "",
+       {0},
+       1,
+       0,
+       1},
   };
-  fprintf(stderr, "* Testing glob matching.\n");
-  for (size_t i = 0; t[i].pat; ++i) {
-    fio_str_info_s p = FIO_STR_INFO1(t[i].pat);
-    fio_str_info_s s = FIO_STR_INFO1(t[i].str);
-    FIO_ASSERT(t[i].expect == fio_glob_match(p, s),
-               "glob matching error for:\n\t String: %s\n\t Pattern: %s",
-               s.buf,
-               p.buf);
+  for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i) {
+    fio___http_connection_s *c = fio___test_client_new();
+    int r = 0;
+    fio___test_client_reset();
+    for (size_t j = 0; j < tests[i].requests; ++j)
+      fio___test_client_send(c, (uint8_t)(tests[i].is_head & !j));
+    for (size_t j = 0; j < 2 && tests[i].response[j] && !r; ++j)
+      r = fio___test_client_feed(c, tests[i].response[j]);
+    FIO_ASSERT(r == 0 - (int)tests[i].error,
+               "HTTP client response error state wrong for test %zu",
+               i);
+    fio___test_client_close(c);
+    FIO_ASSERT(fio___test_client.count == tests[i].requests,
+               "HTTP client response count error for test %zu (%zu)",
+               i,
+               fio___test_client.count);
+    for (size_t j = 0; j < tests[i].requests; ++j)
+      FIO_ASSERT(fio___test_client.status[j] == tests[i].status[j],
+                 "HTTP client response %zu status error for test %zu (%zu)",
+                 j,
+                 i,
+                 fio___test_client.status[j]);
+    FIO_ASSERT(fio_bstr_len(fio___test_client.body) ==
+                       FIO_STRLEN(tests[i].body) &&
+                   (!fio_bstr_len(fio___test_client.body) ||
+                    !FIO_MEMCMP(fio___test_client.body,
+                                tests[i].body,
+                                FIO_STRLEN(tests[i].body))),
+               "HTTP client response body error for test %zu",
+               i);
   }
+  fio___test_client_reset();
 }
+
 /* *****************************************************************************
-Cleanup
+HTTP Client - Pooled Connections (reuse, retry and failure, using a server)
 ***************************************************************************** */
-#endif /* FIO_TEST_ALL */
-/* ************************************************************************* */
-#if !defined(FIO_INCLUDE_FILE) /* Dev test - ignore line */
-#define FIO___DEV___           /* Development inclusion - ignore line */
-#define FIO_TEST_ALL           /* Development inclusion - ignore line */
-#include "./include.h"         /* Development inclusion - ignore line */
-#endif                         /* Development inclusion - ignore line */
-/* *****************************************************************************
 
+/* a raw test server that closes a connection after `limit` requests */
+FIO_SFUNC void fio___test_client_srv_on_attach(fio_s *io) {
+  ++fio___test_client.accepted;
+  fio_udata_set(io, NULL);
+}
 
+FIO_SFUNC void fio___test_client_srv_on_data(fio_s *io) {
+  char buf[1024];
+  size_t len;
+  while ((len = fio_read(io, buf, sizeof(buf) - 1))) {
+    uintptr_t served = (uintptr_t)fio_udata_get(io);
+    buf[len] = 0;
+    for (char *pos = buf; (pos = strstr(pos, "\r\n\r\n")); pos += 4) {
+      if (served >= fio___test_client.limit) { /* a stale keep-alive */
+        fio_close_now(io);
+        return;
+      }
+      fio_udata_set(io, (void *)++served);
+      fio_write(io, "HTTP/1.1 200 OK\r\ncontent-length: 2\r\n\r\nOK", 40);
+    }
+  }
+}
 
+static fio_protocol_s FIO___TEST_CLIENT_SRV_PROTOCOL = {
+    .on_attach = fio___test_client_srv_on_attach,
+    .on_data = fio___test_client_srv_on_data,
+};
 
-                        fio_http_s Test Helper
+#define FIO___TEST_CLIENT_URL "http://127.0.0.1:9438/"
+
+/* each response sends the next request */
+FIO_SFUNC void fio___test_client_pool_step(fio_http_s *h) {
+  if (h)
+    fio___test_client_on_response(h);
+  switch (fio___test_client.count) {
+  case 0: /* a new connection */
+  case 1: /* the same (idle) connection is reused */
+  case 3: /* the retried request's connection is reused */
+    fio_http_request(FIO___TEST_CLIENT_URL,
+                     .on_response = fio___test_client_pool_step);
+    return;
+  case 2: /* the idle connection is closed when used, the GET is retried */
+    fio___test_client.limit = 2;
+    fio_http_request(FIO___TEST_CLIENT_URL,
+                     .on_response = fio___test_client_pool_step);
+    return;
+  case 4: /* the connection is closed when used, a POST isn't retried */
+    fio_http_request(FIO___TEST_CLIENT_URL,
+                     .on_response = fio___test_client_pool_step,
+                     .body = FIO_STR_INFO2((char *)"x", 1));
+    return;
+  case 5: /* an unreachable host (resolved by a DNS thread) fails */
+    fio_http_request("http://localhost:1/",
+                     .on_response = fio___test_client_pool_step);
+    return;
+  }
+}
 
+FIO_SFUNC void fio___test_client_pool_start(fio_protocol_s *p, void *u) {
+  if (!fio___test_client.count)
+    fio___test_client_pool_step(NULL);
+  (void)p, (void)u;
+}
 
+/* listens while the server is running, so the listener can be stopped */
+FIO_SFUNC int fio___test_client_pool_listen(void *ignr1_, void *ignr2_) {
+  fio___test_client.listener =
+      fio_srv_listen(.url = "tcp://127.0.0.1:9438",
+                     .protocol = &FIO___TEST_CLIENT_SRV_PROTOCOL,
+                     .on_start = fio___test_client_pool_start,
+                     .hide_from_log = 1);
+  FIO_ASSERT(fio___test_client.listener, "HTTP client test couldn't listen");
+  return -1;
+  (void)ignr1_, (void)ignr2_;
+}
 
+FIO_SFUNC int fio___test_client_pool_watch(void *deadline_, void *ignr_) {
+  if (fio___test_client.count < 6 &&
+      fio_time_milli() < (int64_t)(uintptr_t)deadline_)
+    return 0;
+  fio_srv_listen_stop(fio___test_client.listener);
+  fio___test_client.listener = NULL;
+  fio_srv_stop();
+  return -1;
+  (void)ignr_;
+}
 
-Copyright and License: see header file (000 copyright.h) or top of file
-***************************************************************************** */
-#if defined(FIO_TEST_ALL) && !defined(FIO___TEST_REINCLUDE) &&                 \
-    !defined(H___FIO_HTTP_HANDLE_TEST___H)
-#define H___FIO_HTTP_HANDLE_TEST___H
-// #ifndef H___FIO_MODULE_NAME___H
-// #define FIO_MODULE_NAME
-// #define FIO___TEST_REINCLUDE
-// #include FIO_INCLUDE_FILE
-// #undef FIO___TEST_REINCLUDE
-// #endif
+FIO_SFUNC void FIO_NAME_TEST(stl, http_client_pool)(void) {
+  fprintf(stderr, "* Testing HTTP client connection pool.\n");
+  size_t expected[] = {200, 200, 200, 200, 0, 0};
+  size_t old_level = FIO_LOG_LEVEL_GET();
+  fio___test_client_reset();
+  fio___test_client.limit = (size_t)-1;
+  fio_srv_run_every(.fn = fio___test_client_pool_listen,
+                    .every = 1,
+                    .repetitions = 1);
+  fio_srv_run_every(.fn = fio___test_client_pool_watch,
+                    .udata1 = (void *)(uintptr_t)(fio_time_milli() + 5000),
+                    .every = 10,
+                    .repetitions = -1);
+  FIO_LOG_LEVEL_SET(FIO_LOG_LEVEL_FATAL); /* failed connections are logged */
+  fio_srv_start(0);
+  FIO_LOG_LEVEL_SET(old_level);
+  FIO_ASSERT(fio___test_client.count == 6,
+             "HTTP client pool test timed out (%zu responses)",
+             fio___test_client.count);
+  for (size_t i = 0; i < 6; ++i)
+    FIO_ASSERT(fio___test_client.status[i] == expected[i],
+               "HTTP client pool response %zu status error (%zu)",
+               i,
+               fio___test_client.status[i]);
+  FIO_ASSERT(fio___test_client.accepted == 2,
+             "HTTP client pool should reuse connections (%zu accepted)",
+             fio___test_client.accepted);
+  fio___test_client_reset();
+}
+#undef FIO___TEST_CLIENT_URL
+
+/** Tests the TLS settings used by the client (the SNI server name). */
+FIO_SFUNC void FIO_NAME_TEST(stl, http_client_tls)(void) {
+  fprintf(stderr, "* Testing HTTP client TLS settings (SNI).\n");
+  fio_tls_s *user = fio_tls_new();
+  fio_tls_s *t = fio___http_client_tls(NULL, FIO_BUF_INFO1("example.com"));
+  FIO_ASSERT(fio_tls_server_name(t) &&
+                 !strcmp(fio_tls_server_name(t), "example.com"),
+             "the host should be set as the server name (SNI)");
+  fio_tls_free(t);
+  t = fio___http_client_tls(NULL, FIO_BUF_INFO1("10.0.0.1"));
+  FIO_ASSERT(!fio_tls_server_name(t), "IP addresses aren't sent as SNI");
+  fio_tls_free(t);
+  t = fio___http_client_tls(NULL, FIO_BUF_INFO1("[::1]"));
+  FIO_ASSERT(!fio_tls_server_name(t), "IPv6 addresses aren't sent as SNI");
+  fio_tls_free(t);
+  fio_tls_alpn_add(user, "http/1.1", NULL);
+  fio_tls_trust_add(user, NULL);
+  t = fio___http_client_tls(user, FIO_BUF_INFO1("example.com"));
+  FIO_ASSERT(fio_tls_alpn_count(t) == 1 && !fio_tls_server_name(user),
+             "the user's TLS settings should be copied, not changed");
+  fio_tls_free(t);
+  fio_tls_server_name_set(user, "other.example.com");
+  t = fio___http_client_tls(user, FIO_BUF_INFO1("example.com"));
+  FIO_ASSERT(!strcmp(fio_tls_server_name(t), "other.example.com"),
+             "a server name set by the user should be kept");
+  fio_tls_free(t);
+  fio_tls_free(user);
+}
 
-FIO_SFUNC void FIO_NAME_TEST(stl, http_s)(void) {
-  fprintf(stderr, "* Testing HTTP handle (fio_http_s).\n");
-  fio_http_s *h = fio_http_new();
-  FIO_ASSERT(!fio_http_cdata(h), "fio_http_cdata should start as NULL");
-  fio_http_cdata_set(h, (void *)(uintptr_t)42);
-  FIO_ASSERT((uintptr_t)fio_http_cdata(h) == 42,
-             "fio_http_cdata roundtrip error");
-  FIO_ASSERT(!fio_http_udata(h), "fio_http_udata should start as NULL");
-  fio_http_udata_set(h, (void *)(uintptr_t)43);
-  FIO_ASSERT((uintptr_t)fio_http_udata(h) == 43,
-             "fio_http_udata roundtrip error");
-  FIO_ASSERT(!fio_http_udata2(h), "fio_http_udata2 should start as NULL");
-  fio_http_udata2_set(h, (void *)(uintptr_t)44);
-  FIO_ASSERT((uintptr_t)fio_http_udata2(h) == 44,
-             "fio_http_udata2 roundtrip error");
+FIO_SFUNC void FIO_NAME_TEST(stl, http_client)(void) {
+  FIO_NAME_TEST(stl, http_client_response)();
+  FIO_NAME_TEST(stl, http_client_tls)();
+  FIO_NAME_TEST(stl, http_client_pool)();
+}
 
-  FIO_ASSERT(!fio_http_status(h), "fio_http_status should start as NULL");
-  fio_http_status_set(h, 101);
-  FIO_ASSERT((uintptr_t)fio_http_status(h) == 101,
-             "fio_http_status roundtrip error");
+/* *****************************************************************************
+HTTP/1.1 Slow Clients (request deadlines and per IP connection limits)
+***************************************************************************** */
 
-  FIO_ASSERT(!fio_http_method(h).buf, "fio_http_method should start as empty");
-  fio_http_method_set(h, FIO_STR_INFO1((char *)"POST"));
-  FIO_ASSERT(
-      FIO_STR_INFO_IS_EQ(fio_http_method(h), FIO_STR_INFO1((char *)"POST")),
-      "fio_http_method roundtrip error");
+/* the raw test clients ('a', 'b', 'c'), in the order they were closed */
+static struct {
+  void *listener; /* the HTTP listener, stopped once the test is done */
+  char closed[4]; /* the client names, in the order closed */
+  size_t count;   /* the number of clients closed */
+  size_t ok;      /* the number of responses received */
+} fio___test_slow;
 
-  FIO_ASSERT(!fio_http_path(h).buf, "fio_http_path should start as empty");
-  fio_http_path_set(h, FIO_STR_INFO1((char *)"/path"));
-  FIO_ASSERT(
-      FIO_STR_INFO_IS_EQ(fio_http_path(h), FIO_STR_INFO1((char *)"/path")),
-      "fio_http_path roundtrip error");
+#define FIO___TEST_SLOW_URL "tcp://127.0.0.1:9439"
 
-  FIO_ASSERT(!fio_http_query(h).buf, "fio_http_query should start as empty");
-  fio_http_query_set(h, FIO_STR_INFO1((char *)"query=null"));
-  FIO_ASSERT(FIO_STR_INFO_IS_EQ(fio_http_query(h),
-                                FIO_STR_INFO1((char *)"query=null")),
-             "fio_http_query roundtrip error");
+FIO_SFUNC void fio___test_slow_on_http(fio_http_s *h) {
+  fio_http_write(h, .buf = "ok", .len = 2, .finish = 1);
+}
 
-  FIO_ASSERT(!fio_http_version(h).buf,
-             "fio_http_version should start as empty");
-  fio_http_version_set(h, FIO_STR_INFO1((char *)"HTTP/1.1"));
-  FIO_ASSERT(FIO_STR_INFO_IS_EQ(fio_http_version(h),
-                                FIO_STR_INFO1((char *)"HTTP/1.1")),
-             "fio_http_version roundtrip error");
+/* clients 'a' and 'b' trickle a request, 'c' sends a complete request */
+FIO_SFUNC void fio___test_slow_on_attach(fio_s *io) {
+  if ((uintptr_t)fio_udata_get(io) == 'c')
+    fio_write(io, "GET / HTTP/1.1\r\nhost: c\r\n\r\n", 27);
+  else
+    fio_write(io, "GET / HTTP/1.1\r\nhost: ", 22);
+}
 
-  { /* test multiple header support */
-    fio_str_info_s test_data[] = {
-        FIO_STR_INFO1((char *)"header-name"),
-        FIO_STR_INFO1(
-            (char *)"a long enough value to require memory allocation 001"),
-        FIO_STR_INFO1(
-            (char *)"a long enough value to require memory allocation 002"),
-        FIO_STR_INFO1(
-            (char *)"a long enough value to require memory allocation 003"),
-        FIO_STR_INFO1(
-            (char *)"a long enough value to require memory allocation 004"),
-        FIO_STR_INFO1(
-            (char *)"a long enough value to require memory allocation 005"),
-        FIO_STR_INFO1(
-            (char *)"a long enough value to require memory allocation 006"),
-        FIO_STR_INFO1(
-            (char *)"a long enough value to require memory allocation 007"),
-        FIO_STR_INFO1(
-            (char *)"a long enough value to require memory allocation 008"),
-    };
-    size_t count = sizeof(test_data) / sizeof(test_data[0]);
-    FIO_ASSERT(!fio_http_request_header(h, test_data[0], 0).buf,
-               "fio_http_request_header should start as empty");
-    FIO_ASSERT(!fio_http_response_header(h, test_data[0], 0).buf,
-               "fio_http_response_header should start as empty");
-    for (size_t i = 1; i < count; ++i) {
-      FIO_ASSERT(!fio_http_request_header(h, test_data[0], i - 1ULL).buf,
-                 "fio_http_request_header index (%zu) should start as empty",
-                 (size_t)(i - 1ULL));
-      FIO_ASSERT(!fio_http_response_header(h, test_data[0], i - 1ULL).buf,
-                 "fio_http_response_header index (%zu) should start as empty",
-                 (size_t)(i - 1ULL));
-      fio_str_info_s req_h =
-          fio_http_request_header_add(h, test_data[0], test_data[i]);
-      fio_str_info_s res_h =
-          fio_http_response_header_add(h, test_data[0], test_data[i]);
-      FIO_ASSERT(FIO_STR_INFO_IS_EQ(req_h, test_data[i]),
-                 "fio_http_request_header_set error");
-      FIO_ASSERT(FIO_STR_INFO_IS_EQ(res_h, test_data[i]),
-                 "fio_http_response_header_set error");
-      req_h = fio_http_request_header(h, test_data[0], i - 1ULL);
-      res_h = fio_http_response_header(h, test_data[0], i - 1ULL);
-      FIO_ASSERT(FIO_STR_INFO_IS_EQ(req_h, test_data[i]),
-                 "fio_http_request_header_set error");
-      FIO_ASSERT(FIO_STR_INFO_IS_EQ(res_h, test_data[i]),
-                 "fio_http_response_header_set error");
+FIO_SFUNC void fio___test_slow_on_data(fio_s *io) {
+  char buf[256];
+  size_t len;
+  while ((len = fio_read(io, buf, sizeof(buf)))) {
+    if (len > 12 && !FIO_MEMCMP(buf, "HTTP/1.1 200", 12)) {
+      ++fio___test_slow.ok;
+      fio_close(io);
     }
-    for (size_t i = 0; i < count - 1; ++i) {
-      fio_str_info_s req_h = fio_http_request_header(h, test_data[0], i);
-      fio_str_info_s res_h = fio_http_response_header(h, test_data[0], i);
-      FIO_ASSERT(FIO_STR_INFO_IS_EQ(req_h, test_data[i + 1]),
-                 "fio_http_request_header_set error");
-      FIO_ASSERT(FIO_STR_INFO_IS_EQ(res_h, test_data[i + 1]),
-                 "fio_http_response_header_set error");
+  }
+}
+
+FIO_SFUNC void fio___test_slow_on_close(void *udata);
+
+static fio_protocol_s FIO___TEST_SLOW_PROTOCOL = {
+    .on_attach = fio___test_slow_on_attach,
+    .on_data = fio___test_slow_on_data,
+    .on_close = fio___test_slow_on_close,
+};
+
+FIO_SFUNC int fio___test_slow_connect(void *name, void *ignr_) {
+  FIO_ASSERT(!fio_srv_connect(FIO___TEST_SLOW_URL,
+                              &FIO___TEST_SLOW_PROTOCOL,
+                              name,
+                              NULL),
+             "slow client test couldn't connect");
+  return 0;
+  (void)ignr_;
+}
+
+/* stops the listener while the server is running (avoids restarting it) */
+FIO_SFUNC void fio___test_slow_done(void) {
+  fio_srv_listen_stop(fio___test_slow.listener);
+  fio___test_slow.listener = NULL;
+  fio_srv_stop();
+}
+
+FIO_SFUNC void fio___test_slow_on_close(void *udata) {
+  if (fio___test_slow.count < 3)
+    fio___test_slow.closed[fio___test_slow.count] = (char)(uintptr_t)udata;
+  ++fio___test_slow.count;
+  if ((uintptr_t)udata == 'a') /* 'a' released its slot, 'c' can connect */
+    fio_srv_run_every(.fn = fio___test_slow_connect,
+                      .udata1 = (void *)(uintptr_t)'c',
+                      .every = 100,
+                      .repetitions = 1);
+  else if ((uintptr_t)udata == 'c')
+    fio___test_slow_done();
+}
+
+FIO_SFUNC int fio___test_slow_start(void *ignr1_, void *ignr2_) {
+  fio___test_slow.listener =
+      fio_http_listen("http://127.0.0.1:9439",
+                      .on_http = fio___test_slow_on_http,
+                      .header_timeout = 1,
+                      .max_clients_per_ip = 1);
+  FIO_ASSERT(fio___test_slow.listener, "slow client test couldn't listen");
+  fio___test_slow_connect((void *)(uintptr_t)'a', NULL);
+  fio___test_slow_connect((void *)(uintptr_t)'b', NULL);
+  return -1;
+  (void)ignr1_, (void)ignr2_;
+}
+
+FIO_SFUNC int fio___test_slow_watch(void *deadline_, void *ignr_) {
+  if (!fio___test_slow.listener)
+    return -1;
+  if (fio_time_milli() < (int64_t)(uintptr_t)deadline_)
+    return 0;
+  fio___test_slow_done();
+  return -1;
+  (void)ignr_;
+}
+
+FIO_SFUNC void FIO_NAME_TEST(stl, http_deadlines)(void) {
+  fprintf(stderr, "* Testing HTTP/1.1 request deadlines and IP limits.\n");
+  { /* the body rate window is renewed only while the client keeps up */
+    fio_http_settings_s s = {.min_body_rate = 16};
+    fio___http_connection_s c = {.settings = &s};
+    fio___http_deadline_set(&c,
+                            FIO___HTTP_DEADLINE_BODY,
+                            FIO_HTTP_BODY_RATE_WINDOW);
+    c.received += 16 * FIO_HTTP_BODY_RATE_WINDOW;
+    fio___http_deadline_expired(&c);
+    FIO_ASSERT(c.deadline_kind == FIO___HTTP_DEADLINE_BODY &&
+                   c.received_mark == c.received,
+               "the body rate window should be renewed at the minimal rate");
+    c.received += 16 * FIO_HTTP_BODY_RATE_WINDOW - 1;
+    fio___http_deadline_expired(&c);
+    FIO_ASSERT(c.deadline_kind == FIO___HTTP_DEADLINE_NONE,
+               "a slow body upload should reach its deadline");
+  }
+  { /* 'a' reaches the head deadline, 'b' exceeds the IP limit, 'c' is ok */
+    size_t old_level = FIO_LOG_LEVEL_GET();
+    FIO_MEMSET(&fio___test_slow, 0, sizeof(fio___test_slow));
+    fio_srv_run_every(.fn = fio___test_slow_start,
+                      .every = 1,
+                      .repetitions = 1);
+    fio_srv_run_every(.fn = fio___test_slow_watch,
+                      .udata1 = (void *)(uintptr_t)(fio_time_milli() + 6000),
+                      .every = 10,
+                      .repetitions = -1);
+    FIO_LOG_LEVEL_SET(FIO_LOG_LEVEL_FATAL);
+    fio_srv_start(0);
+    FIO_LOG_LEVEL_SET(old_level);
+    FIO_ASSERT(fio___test_slow.count == 3 &&
+                   !FIO_MEMCMP(fio___test_slow.closed, "bac", 3),
+               "slow client test close order error (%zu: %.3s)",
+               fio___test_slow.count,
+               fio___test_slow.closed);
+    FIO_ASSERT(fio___test_slow.ok == 1,
+               "the per IP connection count should be released on close");
+  }
+}
+#undef FIO___TEST_SLOW_URL
+
+/* *****************************************************************************
+HTTP/1.1 Server (raw requests and the data on the wire, using a server)
+***************************************************************************** */
+
+/* a raw client, sending a request to a test listener and collecting replies */
+static struct {
+  fio_http_settings_s settings; /* the listener's settings */
+  void *listener;               /* stopped once the client was closed */
+  fio_buf_info_s request;       /* sent by the client once connected */
+  const char *until;            /* the client closes once this was received */
+  char *response;               /* the data received by the client */
+  char *log;                    /* events, logged by the server's callbacks */
+  size_t received;              /* streamed request body bytes received */
+  size_t chunks;                /* the number of `on_body_chunk` calls */
+  uint8_t body_error;           /* set if streamed body data was corrupted */
+  uint8_t hangup;               /* the client closes after sending `request` */
+  uint8_t timeout;              /* set if the client wasn't closed in time */
+} fio___test_srv;
+
+#define FIO___TEST_SRV_URL "http://127.0.0.1:9440"
+
+FIO_SFUNC void fio___test_srv_on_attach(fio_s *io) {
+  fio_write(io, fio___test_srv.request.buf, fio___test_srv.request.len);
+  if (fio___test_srv.hangup)
+    fio_close(io);
+}
+
+FIO_SFUNC void fio___test_srv_on_data(fio_s *io) {
+  char buf[4096];
+  size_t len;
+  while ((len = fio_read(io, buf, sizeof(buf))))
+    fio___test_srv.response = fio_bstr_write(fio___test_srv.response, buf, len);
+  if (fio___test_srv.until && fio___test_srv.response &&
+      strstr(fio___test_srv.response, fio___test_srv.until))
+    fio_close(io);
+}
+
+/* stops the listener while the server is running (avoids restarting it) */
+FIO_SFUNC void fio___test_srv_done(void) {
+  if (!fio___test_srv.listener)
+    return;
+  fio_srv_listen_stop(fio___test_srv.listener);
+  fio___test_srv.listener = NULL;
+  fio_srv_stop();
+}
+
+FIO_SFUNC int fio___test_srv_done_task(void *ignr1_, void *ignr2_) {
+  fio___test_srv_done();
+  return -1;
+  (void)ignr1_, (void)ignr2_;
+}
+
+FIO_SFUNC void fio___test_srv_on_close(void *udata) {
+  if (fio___test_srv.hangup) /* let the server handle the lost connection */
+    fio_srv_run_every(.fn = fio___test_srv_done_task,
+                      .every = 50,
+                      .repetitions = 1);
+  else
+    fio___test_srv_done();
+  (void)udata;
+}
+
+static fio_protocol_s FIO___TEST_SRV_PROTOCOL = {
+    .on_attach = fio___test_srv_on_attach,
+    .on_data = fio___test_srv_on_data,
+    .on_close = fio___test_srv_on_close,
+};
+
+FIO_SFUNC int fio___test_srv_start(void *ignr1_, void *ignr2_) {
+  fio___test_srv.listener =
+      fio_http_listen FIO_NOOP(FIO___TEST_SRV_URL, fio___test_srv.settings);
+  FIO_ASSERT(fio___test_srv.listener, "HTTP server test couldn't listen");
+  FIO_ASSERT(!fio_srv_connect(FIO___TEST_SRV_URL,
+                              &FIO___TEST_SRV_PROTOCOL,
+                              NULL,
+                              NULL),
+             "HTTP server test couldn't connect");
+  return -1;
+  (void)ignr1_, (void)ignr2_;
+}
+
+FIO_SFUNC int fio___test_srv_watch(void *deadline_, void *ignr_) {
+  if (!fio___test_srv.listener)
+    return -1;
+  if (fio_time_milli() < (int64_t)(uintptr_t)deadline_)
+    return 0;
+  fio___test_srv.timeout = 1;
+  fio___test_srv_done();
+  return -1;
+  (void)ignr_;
+}
+
+/* sends `request`, returns the data received until the client was closed */
+FIO_SFUNC char *fio___test_srv_run2(fio_http_settings_s settings,
+                                    fio_buf_info_s request,
+                                    const char *until,
+                                    uint8_t hangup) {
+  size_t old_level = FIO_LOG_LEVEL_GET();
+  fio_bstr_free(fio___test_srv.response);
+  fio_bstr_free(fio___test_srv.log);
+  fio___test_srv = (__typeof__(fio___test_srv)){
+      .settings = settings,
+      .request = request,
+      .until = until,
+      .hangup = hangup,
+  };
+  fio_srv_run_every(.fn = fio___test_srv_start, .every = 1, .repetitions = 1);
+  fio_srv_run_every(.fn = fio___test_srv_watch,
+                    .udata1 = (void *)(uintptr_t)(fio_time_milli() + 5000),
+                    .every = 10,
+                    .repetitions = -1);
+  FIO_LOG_LEVEL_SET(FIO_LOG_LEVEL_FATAL); /* bad requests are logged */
+  fio_srv_start(0);
+  FIO_LOG_LEVEL_SET(old_level);
+  FIO_ASSERT(!fio___test_srv.timeout,
+             "HTTP server test timed out, received:\n%s",
+             (fio___test_srv.response ? fio___test_srv.response : ""));
+  return fio___test_srv.response ? fio___test_srv.response : (char *)"";
+}
+
+FIO_SFUNC char *fio___test_srv_run(fio_http_settings_s settings,
+                                   fio_buf_info_s request,
+                                   const char *until) {
+  return fio___test_srv_run2(settings, request, until, 0);
+}
+
+/* tests that the strings (a NULL terminated list) were received, in order */
+FIO_SFUNC int fio___test_srv_in_order(const char *r, const char **list) {
+  for (; r && *list; ++list)
+    if ((r = strstr(r, *list)))
+      r += strlen(*list);
+  return !!r;
+}
+
+/* responds with the path's name (i.e., "[a]"), delayed by the query's ms */
+FIO_SFUNC int fio___test_srv_respond(void *h_, void *ignr_) {
+  fio_http_s *h = (fio_http_s *)h_;
+  char buf[3] = {'[', fio_http_path(h).buf[1], ']'};
+  fio_http_write(h, .buf = buf, .len = 3, .copy = 1, .finish = 1);
+  fio_http_free(h);
+  return -1;
+  (void)ignr_;
+}
+
+FIO_SFUNC void fio___test_srv_on_http_delayed(fio_http_s *h) {
+  char *query = fio_http_query(h).buf;
+  size_t delay = (size_t)fio_atol10u(&query);
+  if (!delay) {
+    fio___test_srv_respond(fio_http_dup(h), NULL);
+    return;
+  }
+  fio_srv_run_every(.fn = fio___test_srv_respond,
+                    .udata1 = fio_http_dup(h),
+                    .every = (uint32_t)delay,
+                    .repetitions = 1);
+}
+
+/* *****************************************************************************
+HTTP/1.1 Response Heads (status lines, exact length and static headers)
+***************************************************************************** */
+
+FIO_SFUNC void FIO_NAME_TEST(stl, http1_head)(void) {
+  fprintf(stderr, "* Testing HTTP/1.1 response heads (exact length).\n");
+  for (size_t i = 100; i < 600; ++i) { /* pre-rendered lines can't drift */
+    fio_str_info_s line = fio___http1_status_line_cached(i);
+    char expected[128];
+    int len;
+    if (!line.buf)
+      continue;
+    len = snprintf(expected,
+                   sizeof(expected),
+                   "HTTP/1.1 %zu %s\r\n",
+                   i,
+                   fio_http_status2str(i).buf);
+    FIO_ASSERT(FIO_STR_INFO_IS_EQ(line, FIO_STR_INFO2(expected, (size_t)len)),
+               "pre-rendered status line error for %zu: %s",
+               i,
+               line.buf);
+  }
+  struct {
+    size_t status;
+    const char *version;
+    const char *line; /* the expected status line */
+    size_t headers;   /* the number of (100 byte) headers */
+    size_t cookies;
+    const char *static_headers;
+  } tests[] = {
+      {200, NULL, "HTTP/1.1 200 OK\r\n", 0, 0, NULL},
+      {404, "HTTP/1.1", "HTTP/1.1 404 Not Found\r\n", 2, 0, NULL},
+      {404, "HTTP/1.0", "HTTP/1.0 404 Not Found\r\n", 2, 1, NULL},
+      {599, NULL, "HTTP/1.1 599 Unknown\r\n", 1, 1, "server:facil.io\r\n"},
+      {200, NULL, "HTTP/1.1 200 OK\r\n", 60, 3, "x-a:1\r\nx-b:2\r\n"},
+      {499, "HTTP/1.1", "HTTP/1.1 499 Client Closed Request\r\n", 50, 0, "x:3\r\n"},
+  };
+  for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i) {
+    fio_http_s *h = fio_http_new();
+    fio_str_info_s sh = FIO_STR_INFO1((char *)tests[i].static_headers);
+    char value[100];
+    char *buf;
+    size_t len, written;
+    fio_http_status_set(h, tests[i].status);
+    if (tests[i].version)
+      fio_http_version_set(h, FIO_STR_INFO1((char *)tests[i].version));
+    FIO_MEMSET(value, 'v', sizeof(value));
+    for (size_t j = 0; j < tests[i].headers; ++j) {
+      char name[16] = {'x', '-', 'h'};
+      fio_ltoa10u(name + 3, j, fio_digits10u(j));
+      fio_http_response_header_add(h,
+                                   FIO_STR_INFO1(name),
+                                   FIO_STR_INFO2(value, sizeof(value)));
+    }
+    for (size_t j = 0; j < tests[i].cookies; ++j) {
+      char name[4] = {'c', (char)('a' + j)};
+      fio_http_cookie_set(h,
+                          .name = FIO_STR_INFO1(name),
+                          .value = FIO_STR_INFO1((char *)"value"),
+                          .path = FIO_STR_INFO1((char *)"/"));
+    }
+    len = fio___http1_head(NULL, h, sh);
+    buf = (char *)FIO_MEM_REALLOC(NULL, 0, len + 8, 0);
+    FIO_ASSERT_ALLOC(buf);
+    FIO_MEMSET(buf, '#', len + 8);
+    written = fio___http1_head(buf, h, sh);
+    FIO_ASSERT(written == len && buf[len] == '#',
+               "HTTP/1.1 head length miscalculated (%zu): %zu != %zu",
+               i,
+               written,
+               len);
+    FIO_ASSERT(len > strlen(tests[i].line) &&
+                   !FIO_MEMCMP(buf, tests[i].line, strlen(tests[i].line)) &&
+                   !FIO_MEMCMP(buf + len - 4, "\r\n\r\n", 4),
+               "HTTP/1.1 head status line error (%zu):\n%.*s",
+               i,
+               (int)len,
+               buf);
+    FIO_ASSERT(!sh.len || !FIO_MEMCMP(buf + len - 2 - sh.len, sh.buf, sh.len),
+               "HTTP/1.1 static headers should end the head (%zu)",
+               i);
+    {
+      size_t found = 0, cookies = 0;
+      buf[len] = 0;
+      for (char *pos = buf; (pos = strstr(pos, "\r\nx-h")); ++pos)
+        ++found;
+      for (char *pos = buf; (pos = strstr(pos, "\r\nset-cookie:c")); ++pos)
+        ++cookies;
+      FIO_ASSERT(found == tests[i].headers && cookies == tests[i].cookies,
+                 "HTTP/1.1 head should contain all headers and cookies (%zu)",
+                 i);
     }
-    fio_http_request_header_set(h, test_data[0], test_data[1]);
-    fio_http_response_header_set(h, test_data[0], test_data[1]);
-    FIO_ASSERT(!fio_http_request_header(h, test_data[0], 1ULL).buf,
-               "fio_http_request_header_set index should reset header values");
-    FIO_ASSERT(!fio_http_response_header(h, test_data[0], 1ULL).buf,
-               "fio_http_response_header_set index should reset header values");
+    FIO_MEM_FREE(buf, len + 8);
+    fio_http_free(h);
   }
-  { /* test body writer */
-    size_t written = 0;
-    do {
-      union {
-        char buf[32];
-        uint64_t u64[4];
-        void *p[4];
-      } w, r;
-      fio_rand_bytes(r.buf, sizeof(r.buf));
-      fio_http_body_write(h, r.buf, sizeof(r.buf));
-      fio_http_body_seek(h, written);
-      fio_str_info_s got = fio_http_body_read(h, sizeof(r.buf));
-      FIO_MEMSET(w.buf, 0, sizeof(w.buf));
-      FIO_MEMCPY(w.buf, got.buf, got.len);
-      written += sizeof(r.buf);
-      FIO_ASSERT(written == fio_http_body_length(h),
-                 "fio_http_body_length error (%zu != %zu)",
-                 fio_http_body_length(h),
-                 written);
-      FIO_ASSERT(FIO_STR_INFO_IS_EQ(FIO_STR_INFO2(r.buf, sizeof(r.buf)), got),
-                 "fio_http_body_write-fio_http_body_read roundtrip error @ %zu"
-                 "\n\t expected (32):\t%p%p%p%p)"
-                 "\n\t got (%zu):     \t%p%p%p%p)",
-                 written - sizeof(r.buf),
-                 r.p[0],
-                 r.p[1],
-                 r.p[2],
-                 r.p[3],
-                 got.len,
-                 w.p[0],
-                 w.p[1],
-                 w.p[2],
-                 w.p[3]);
-    } while (written < (FIO_HTTP_BODY_RAM_LIMIT << 1));
-    fio_http_body_seek(h, 0);
-    fio_http_body_write(h, "\n1234", 5);
-    fio_str_info_s ln = fio_http_body_read_until(h, '\n', 0);
-    FIO_ASSERT(ln.buf && ln.len && ln.buf[ln.len - 1] == '\n',
-               "fio_http_body_read_until token error");
+}
+
+/* a response with large headers, cookies and static headers, streamed */
+FIO_SFUNC void fio___test_srv_on_http_head(fio_http_s *h) {
+  char value[100];
+  FIO_MEMSET(value, 'v', sizeof(value));
+  for (size_t j = 0; j < 60; ++j) { /* over 4KiB of headers */
+    char name[16] = {'x', '-', 'h'};
+    fio_ltoa10u(name + 3, j, fio_digits10u(j));
+    fio_http_response_header_add(h,
+                                 FIO_STR_INFO1(name),
+                                 FIO_STR_INFO2(value, sizeof(value)));
+  }
+  fio_http_cookie_set(h,
+                      .name = FIO_STR_INFO1((char *)"ca"),
+                      .value = FIO_STR_INFO1((char *)"value"));
+  fio_http_write(h, .buf = "hello", .len = 5, .copy = 1);
+  fio_http_write(h, .finish = 1);
+}
+
+FIO_SFUNC void FIO_NAME_TEST(stl, http1_head_wire)(void) {
+  fprintf(stderr, "* Testing HTTP/1.1 response heads (large, chunked).\n");
+  const char *expected[] = {"HTTP/1.1 200 OK",
+                            "\r\nx-h0:",
+                            "\r\nx-h59:",
+                            "\r\nset-cookie:ca=value",
+                            "\r\nserver:test\r\nx-static:1\r\n"
+                            "transfer-encoding: chunked\r\n\r\n",
+                            "\r\nhello\r\n0\r\n\r\n",
+                            NULL};
+  char *r = fio___test_srv_run(
+      (fio_http_settings_s){
+          .on_http = fio___test_srv_on_http_head,
+          .static_headers =
+              FIO_STR_INFO1((char *)"server:test\r\nx-static:1\r\n"),
+      },
+      FIO_BUF_INFO1((char *)"GET / HTTP/1.1\r\nhost: x\r\n\r\n"),
+      "0\r\n\r\n");
+  FIO_ASSERT(strlen(r) > 6000 && fio___test_srv_in_order(r, expected),
+             "HTTP/1.1 large / chunked response head error:\n%s",
+             r);
+}
+
+/* streams chunks using every framing path (stack, heap and separate writes) */
+FIO_SFUNC void fio___test_srv_on_http_chunks(fio_http_s *h) {
+  static char large[FIO_HTTP_CHUNK_COPY_LIMIT + 3616]; /* not copied */
+  char mid[8000];
+  FILE *tmp = tmpfile();
+  FIO_ASSERT(tmp, "couldn't create a temporary file for testing");
+  for (size_t i = 0; i < 6000; ++i)
+    fputc('d', tmp);
+  fflush(tmp);
+  FIO_MEMSET(mid, 'b', sizeof(mid));
+  FIO_MEMSET(large, 'c', sizeof(large));
+  fio_http_write(h, .buf = "hello", .len = 5, .copy = 1);
+  fio_http_write(h, .buf = mid, .len = sizeof(mid), .copy = 1);
+  fio_http_write(h, .buf = "", .len = 0, .copy = 1); /* no (final) chunk */
+  fio_http_write(h, .buf = large, .len = sizeof(large));
+  fio_http_write(h, .fd = dup(fileno(tmp)), .len = 6000);
+  fio_http_write(h, .finish = 1);
+  fclose(tmp);
+}
+
+/* decodes a chunked response body, returning the number of chunks (or -1) */
+FIO_SFUNC int fio___test_srv_unchunk(const char *r, char **body) {
+  if (!(r = strstr(r, "\r\n\r\n")))
+    return -1;
+  r += 4;
+  for (int count = 0;; ++count) {
+    char *end;
+    size_t len = (size_t)strtoul(r, &end, 16);
+    if (end == r || end[0] != '\r' || end[1] != '\n')
+      return -1;
+    r = end + 2;
+    if (!len)
+      return count;
+    if (strlen(r) < len + 2 || r[len] != '\r' || r[len + 1] != '\n')
+      return -1;
+    *body = fio_bstr_write(*body, r, len);
+    r += len + 2;
+  }
+}
+
+FIO_SFUNC void FIO_NAME_TEST(stl, http1_stream_chunk)(void) {
+  fprintf(stderr, "* Testing HTTP/1.1 streamed response chunks.\n");
+  const size_t lengths[] = {8000, FIO_HTTP_CHUNK_COPY_LIMIT + 3616, 6000};
+  char *expected = fio_bstr_write(NULL, "hello", 5);
+  char *body = NULL;
+  char *r;
+  int chunks;
+  for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); ++i)
+    for (size_t j = 0; j < lengths[i]; ++j)
+      expected = fio_bstr_write(expected, "bcd" + i, 1);
+  r = fio___test_srv_run(
+      (fio_http_settings_s){.on_http = fio___test_srv_on_http_chunks},
+      FIO_BUF_INFO1((char *)"GET / HTTP/1.1\r\nhost: x\r\n\r\n"),
+      "\r\n0\r\n\r\n");
+  chunks = fio___test_srv_unchunk(r, &body);
+  FIO_ASSERT(chunks == 4,
+             "streamed response should have 4 chunks (%d):\n%.*s",
+             chunks,
+             256,
+             r);
+  FIO_ASSERT(fio_bstr_is_eq2info(body, fio_bstr_info(expected)),
+             "streamed response body error (%zu bytes)",
+             fio_bstr_len(body));
+  fio_bstr_free(expected);
+  fio_bstr_free(body);
+}
+
+/* *****************************************************************************
+HTTP/1.1 Pipelining (responses are sent in request order)
+***************************************************************************** */
+
+#define FIO___TEST_SRV_REQ(name, delay)                                        \
+  "GET /" name "?" delay " HTTP/1.1\r\nhost: x\r\n\r\n"
+
+FIO_SFUNC void FIO_NAME_TEST(stl, http_pipeline)(void) {
+  fprintf(stderr, "* Testing HTTP/1.1 pipelining (response order).\n");
+  struct {
+    const char *request;
+    const char *expected[8];
+    const char *until; /* NULL: the server closes the connection */
+    uint8_t pipeline;
+  } tests[] = {
+      { /* responses finish out of order, but are sent in order */
+       FIO___TEST_SRV_REQ("a", "60") FIO___TEST_SRV_REQ("b", "0")
+           FIO___TEST_SRV_REQ("c", "30") FIO___TEST_SRV_REQ("d", "0"),
+       {"[a]", "[b]", "[c]", "[d]", NULL},
+       "[d]",
+       4},
+      { /* a full pipeline stops parsing until responses were sent */
+       FIO___TEST_SRV_REQ("a", "20") FIO___TEST_SRV_REQ("b", "0")
+           FIO___TEST_SRV_REQ("c", "10") FIO___TEST_SRV_REQ("d", "0")
+               FIO___TEST_SRV_REQ("e", "0") FIO___TEST_SRV_REQ("f", "0"),
+       {"[a]", "[b]", "[c]", "[d]", "[e]", "[f]", NULL},
+       "[f]",
+       2},
+      { /* a bad request is answered (and closed) after pending responses */
+       FIO___TEST_SRV_REQ("a", "30") FIO___TEST_SRV_REQ("b", "0")
+           "GET /c HTTP/1.1\r\nno colon\r\n\r\n",
+       {"[a]", "[b]", "HTTP/1.1 400", NULL},
+       NULL,
+       4},
+  };
+  for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i) {
+    char *r = fio___test_srv_run(
+        (fio_http_settings_s){.on_http = fio___test_srv_on_http_delayed,
+                              .pipeline = tests[i].pipeline},
+        FIO_BUF_INFO1((char *)tests[i].request),
+        tests[i].until);
+    FIO_ASSERT(fio___test_srv_in_order(r, tests[i].expected),
+               "pipelined responses out of order (%zu):\n%s",
+               i,
+               r);
   }
+}
+#undef FIO___TEST_SRV_REQ
 
-  /* almost done, just make sure reference counting doesn't destroy object */
-  fio_http_free(fio_http_dup(h));
-  FIO_ASSERT(
-      (uintptr_t)fio_http_udata2(h) == 44 &&
-          FIO_STR_INFO_IS_EQ(fio_http_method(h), FIO_STR_INFO1((char *)"POST")),
-      "fio_http_s reference counting shouldn't object");
+/* *****************************************************************************
+HTTP/1.1 Streamed Request Bodies (`on_body_chunk`)
+***************************************************************************** */
 
-  fio_http_free(h);
+/* the streamed body data at `pos` (so the order can be validated) */
+#define FIO___TEST_SRV_BODY_BYTE(pos) ((char)('a' + ((pos) % 26)))
+
+/* validates and counts body data, responding early if the path is "/early" */
+FIO_SFUNC void fio___test_srv_on_body_chunk(fio_http_s *h,
+                                            fio_buf_info_s chunk) {
+  for (size_t i = 0; i < chunk.len; ++i)
+    fio___test_srv.body_error |=
+        (chunk.buf[i] != FIO___TEST_SRV_BODY_BYTE(fio___test_srv.received + i));
+  fio___test_srv.received += chunk.len;
+  ++fio___test_srv.chunks;
+  if (FIO_STR_INFO_IS_EQ(fio_http_path(h), FIO_STR_INFO2((char *)"/early", 6)))
+    fio_http_write(h, .buf = "{early}", .len = 7, .copy = 1, .finish = 1);
 }
 
+/* responds with the number of body bytes received, i.e., "{10}" */
+FIO_SFUNC void fio___test_srv_on_http_body(fio_http_s *h) {
+  char buf[32];
+  size_t len;
+  fio___test_srv.log = fio_bstr_write(fio___test_srv.log, "[on_http]", 9);
+  len = (size_t)snprintf(buf, sizeof(buf), "{%zu}", fio___test_srv.received);
+  fio_http_write(h, .buf = buf, .len = len, .copy = 1, .finish = 1);
+}
+
+FIO_SFUNC int fio___test_srv_deny(fio_http_s *h) {
+  return -1;
+  (void)h;
+}
+
+/* returns a request (a `fio_bstr`) with a (streamed) body of `len` bytes */
+FIO_SFUNC char *fio___test_srv_body_request(const char *path,
+                                            size_t len,
+                                            size_t content_length,
+                                            size_t chunk_size) {
+  char *r = fio_bstr_printf(NULL, "POST %s HTTP/1.1\r\nhost: x\r\n", path);
+  if (chunk_size)
+    r = fio_bstr_write(r, "transfer-encoding: chunked\r\n\r\n", 30);
+  else
+    r = fio_bstr_printf(r, "content-length: %zu\r\n\r\n", content_length);
+  for (size_t pos = 0; pos < len;) {
+    size_t end = chunk_size ? pos + chunk_size : len;
+    if (end > len)
+      end = len;
+    if (chunk_size)
+      r = fio_bstr_printf(r, "%zx\r\n", end - pos);
+    for (; pos < end; ++pos) {
+      char c = FIO___TEST_SRV_BODY_BYTE(pos);
+      r = fio_bstr_write(r, &c, 1);
+    }
+    if (chunk_size)
+      r = fio_bstr_write(r, "\r\n", 2);
+  }
+  if (chunk_size)
+    r = fio_bstr_write(r, "0\r\n\r\n", 5);
+  return r;
+}
+
+FIO_SFUNC void FIO_NAME_TEST(stl, http_body_chunk)(void) {
+  fprintf(stderr, "* Testing HTTP/1.1 streamed request bodies.\n");
+  fio_http_settings_s settings = {
+      .on_http = fio___test_srv_on_http_body,
+      .on_body_chunk = fio___test_srv_on_body_chunk,
+  };
+  char *req;
+  char *r;
+  { /* body chunks arrive in order, `on_http` is called once it's complete */
+    const size_t len = (FIO_HTTP_BODY_STREAM_LIMIT * 3) + 17;
+    char expected[32];
+    snprintf(expected, sizeof(expected), "{%zu}", len);
+    req = fio___test_srv_body_request("/", len, len, 0);
+    r = fio___test_srv_run(settings, fio_bstr_buf(req), "}");
+    FIO_ASSERT(strstr(r, expected) && fio___test_srv.chunks > 1 &&
+                   !fio___test_srv.body_error,
+               "streamed body error (%zu chunks):\n%s",
+               fio___test_srv.chunks,
+               r);
+    fio_bstr_free(req);
+    /* chunked (transfer-encoding) bodies are streamed as well */
+    req = fio___test_srv_body_request("/", len, 0, 1000);
+    r = fio___test_srv_run(settings, fio_bstr_buf(req), "}");
+    FIO_ASSERT(strstr(r, expected) && !fio___test_srv.body_error,
+               "streamed (chunked) body error:\n%s",
+               r);
+    fio_bstr_free(req);
+  }
+  { /* `max_body_size` is enforced against the streamed total */
+    fio_http_settings_s limited = settings;
+    limited.max_body_size = 1000;
+    req = fio___test_srv_body_request("/", 1800, 0, 600);
+    r = fio___test_srv_run(limited, fio_bstr_buf(req), NULL);
+    FIO_ASSERT(!strncmp(r, "HTTP/1.1 400", 12) && !fio___test_srv.log &&
+                   fio___test_srv.received <= 1000,
+               "streamed body should respect max_body_size:\n%s",
+               r);
+    fio_bstr_free(req);
+    req = fio___test_srv_body_request("/", 1800, 1800, 0);
+    r = fio___test_srv_run(limited, fio_bstr_buf(req), NULL);
+    FIO_ASSERT(!strncmp(r, "HTTP/1.1 413", 12) && !fio___test_srv.log &&
+                   !fio___test_srv.received,
+               "streamed body content-length should respect max_body_size:\n%s",
+               r);
+    fio_bstr_free(req);
+  }
+  { /* a response sent from `on_body_chunk` skips `on_http` */
+    const size_t len = FIO_HTTP_BODY_STREAM_LIMIT * 8;
+    req = fio___test_srv_body_request("/early", len, len, 0);
+    r = fio___test_srv_run(settings, fio_bstr_buf(req), NULL);
+    FIO_ASSERT(strstr(r, "{early}") && !strstr(r, "}{") &&
+                   !fio___test_srv.log && fio___test_srv.chunks &&
+                   fio___test_srv.received < len && !fio___test_srv.body_error,
+               "early response from on_body_chunk error:\n%s",
+               r);
+    fio_bstr_free(req);
+  }
+  { /* `on_http` is never called if the connection was lost mid-body */
+    const size_t len = FIO_HTTP_BODY_STREAM_LIMIT * 2;
+    req = fio___test_srv_body_request("/", len, len * 2, 0);
+    fio___test_srv_run2(settings, fio_bstr_buf(req), NULL, 1);
+    FIO_ASSERT(!fio___test_srv.log && fio___test_srv.chunks &&
+                   fio___test_srv.received <= len && !fio___test_srv.body_error,
+               "on_http called for a lost connection (%zu bytes received)",
+               fio___test_srv.received);
+    fio_bstr_free(req);
+  }
+  { /* a pipelined upgrade request waits for pending responses, with its body */
+    fio_http_settings_s sse = settings;
+    const char *expected[] = {"[a]", "HTTP/1.1 403", NULL};
+    sse.on_http = fio___test_srv_on_http_delayed;
+    sse.on_authenticate_sse = fio___test_srv_deny;
+    sse.pipeline = 4;
+    r = fio___test_srv_run(
+        sse,
+        FIO_BUF_INFO1((char *)"GET /a?30 HTTP/1.1\r\nhost: x\r\n\r\n"
+                              "GET /s HTTP/1.1\r\nhost: x\r\n"
+                              "accept: text/event-stream\r\n"
+                              "content-length: 5\r\n\r\nabcde"),
+        "HTTP/1.1 403");
+    FIO_ASSERT(fio___test_srv_in_order(r, expected) &&
+                   fio___test_srv.received == 5 && !fio___test_srv.body_error,
+               "held upgrade request body error (%zu bytes):\n%s",
+               fio___test_srv.received,
+               r);
+  }
+}
+#undef FIO___TEST_SRV_BODY_BYTE
+
+FIO_SFUNC void FIO_NAME_TEST(stl, http_server)(void) {
+  FIO_NAME_TEST(stl, http1_head)();
+  FIO_NAME_TEST(stl, http1_head_wire)();
+  FIO_NAME_TEST(stl, http1_stream_chunk)();
+  FIO_NAME_TEST(stl, http_pipeline)();
+  FIO_NAME_TEST(stl, http_body_chunk)();
+  fio_bstr_free(fio___test_srv.response);
+  fio_bstr_free(fio___test_srv.log);
+  fio___test_srv.response = fio___test_srv.log = NULL;
+}
+#undef FIO___TEST_SRV_URL
+
+#else
+FIO_SFUNC void FIO_NAME_TEST(stl, http_websocket)(void) {}
+FIO_SFUNC void FIO_NAME_TEST(stl, http_client)(void) {}
+FIO_SFUNC void FIO_NAME_TEST(stl, http_deadlines)(void) {}
+FIO_SFUNC void FIO_NAME_TEST(stl, http_server)(void) {}
+#endif /* H___FIO_HTTP___H */
+
 /* *****************************************************************************
 Cleanup
 ***************************************************************************** */
@@ -45005,6 +53757,235 @@ FIO_SFUNC void FIO_NAME_TEST(stl, pubsub_roundtrip)(void) {
 #undef FIO___PUBLISH2TEST
 }
 
+/* *****************************************************************************
+Pattern Matching Testing
+***************************************************************************** */
+
+FIO_SFUNC uint8_t FIO_NAME_TEST(stl, pubsub_match)(fio_str_info_s pattern,
+                                                   fio_str_info_s channel) {
+  return fio_glob_match(pattern, channel);
+}
+
+FIO_SFUNC void FIO_NAME_TEST(stl, pubsub_patterns)(void) {
+  fprintf(stderr, "* Testing pub/sub pattern matching (indexed).\n");
+  static const char *patterns[] = {
+      "user.*.events",
+      "user.1.*",
+      "user.1?.events",
+      "user.[0-9].events",
+      "*",
+      "*.events",
+      "news",
+      "news*",
+      "[nu]*",
+      "\\news",
+      "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa*",
+      "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaab",
+  };
+  static const char *channels[] = {
+      "user.1.events",
+      "user.12.events",
+      "user.1.other",
+      "user.x.events",
+      "news",
+      "newsroom",
+      "",
+      "u",
+      "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaab",
+      "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaac",
+  };
+  const size_t pattern_count = sizeof(patterns) / sizeof(patterns[0]);
+  const size_t channel_count = sizeof(channels) / sizeof(channels[0]);
+  int state[sizeof(patterns) / sizeof(patterns[0])] = {0};
+  int ignored = 0;
+  /* the same pattern, using a different filter, is never matched */
+  fio_subscribe(.channel = FIO_BUF_INFO1((char *)"*"),
+                .on_message = FIO_NAME_TEST(stl, pubsub_on_message),
+                .filter = -125,
+                .udata = &ignored,
+                .is_pattern = 1);
+  for (size_t i = 0; i < pattern_count; ++i)
+    fio_subscribe(.channel = FIO_BUF_INFO1((char *)patterns[i]),
+                  .on_message = FIO_NAME_TEST(stl, pubsub_on_message),
+                  .filter = -126,
+                  .udata = state + i,
+                  .is_pattern = 1);
+  fio_queue_perform_all(fio___srv_tasks);
+  for (int round = 0; round < 2; ++round) {
+    /* the second round tests the fallback (non-indexed) matching */
+    if (round)
+      FIO_PUBSUB_PATTERN_MATCH = FIO_NAME_TEST(stl, pubsub_match);
+    for (size_t c = 0; c < channel_count; ++c) {
+      FIO_MEMSET(state, 0, sizeof(state));
+      fio_publish(.channel = FIO_BUF_INFO1((char *)channels[c]),
+                  .filter = -126,
+                  .engine = FIO_PUBSUB_PROCESS);
+      fio_queue_perform_all(fio___srv_tasks);
+      for (size_t i = 0; i < pattern_count; ++i) {
+        int expected = fio_glob_match(FIO_STR_INFO1((char *)patterns[i]),
+                                      FIO_STR_INFO1((char *)channels[c]));
+        FIO_ASSERT(state[i] == expected,
+                   "pattern delivery error (round %d) for %s => %s (%d)",
+                   round,
+                   patterns[i],
+                   channels[c],
+                   state[i]);
+      }
+    }
+  }
+  FIO_PUBSUB_PATTERN_MATCH = fio_glob_match;
+  FIO_ASSERT(!ignored, "pattern filter ignored!");
+  fio_unsubscribe(.channel = FIO_BUF_INFO1((char *)"*"),
+                  .on_message = FIO_NAME_TEST(stl, pubsub_on_message),
+                  .filter = -125,
+                  .udata = &ignored,
+                  .is_pattern = 1);
+  for (size_t i = 0; i < pattern_count; ++i)
+    fio_unsubscribe(.channel = FIO_BUF_INFO1((char *)patterns[i]),
+                    .on_message = FIO_NAME_TEST(stl, pubsub_on_message),
+                    .filter = -126,
+                    .udata = state + i,
+                    .is_pattern = 1);
+  fio_queue_perform_all(fio___srv_tasks);
+  FIO_ASSERT(!FIO_POSTOFFICE.pattern_prefixes &&
+                 !fio___pattern_map_count(&FIO_POSTOFFICE.pattern_index),
+             "pattern index should be empty once all patterns unsubscribed");
+}
+
+/* *****************************************************************************
+Channel Fan-out Testing
+***************************************************************************** */
+
+#define FIO___PUBSUB_FANOUT_TEST_COUNT ((FIO_PUBSUB_DELIVERY_BUDGET * 3) + 7)
+static struct {
+  int state[FIO___PUBSUB_FANOUT_TEST_COUNT];
+  uintptr_t handles[FIO___PUBSUB_FANOUT_TEST_COUNT];
+} FIO_NAME_TEST(stl, pubsub_fanout_data);
+
+FIO_SFUNC void FIO_NAME_TEST(stl, pubsub_fanout_on_message)(fio_msg_s *msg) {
+  int *state = (int *)msg->udata;
+  const size_t i = state - FIO_NAME_TEST(stl, pubsub_fanout_data).state;
+  *state += 1;
+  if (i == 0) { /* unsubscribes the subscriber pinned by the delivery task */
+    fio_unsubscribe(.subscription_handle_ptr =
+                        FIO_NAME_TEST(stl, pubsub_fanout_data).handles +
+                        FIO_PUBSUB_DELIVERY_BUDGET);
+    fio_unsubscribe(.subscription_handle_ptr =
+                        FIO_NAME_TEST(stl, pubsub_fanout_data).handles +
+                        FIO_PUBSUB_DELIVERY_BUDGET + 1);
+  }
+  if (i == 2 && *state == 1)
+    fio_message_defer(msg);
+}
+
+FIO_SFUNC void FIO_NAME_TEST(stl, pubsub_fanout)(void) {
+  fprintf(stderr,
+          "* Testing pub/sub channel fan-out (%d subscribers).\n",
+          (int)FIO___PUBSUB_FANOUT_TEST_COUNT);
+  int *state = FIO_NAME_TEST(stl, pubsub_fanout_data).state;
+  uintptr_t *handles = FIO_NAME_TEST(stl, pubsub_fanout_data).handles;
+  fio_buf_info_s channel = FIO_BUF_INFO1((char *)"pubsub_fanout_test");
+  for (size_t i = 0; i < FIO___PUBSUB_FANOUT_TEST_COUNT; ++i)
+    fio_subscribe(.channel = channel,
+                  .on_message = FIO_NAME_TEST(stl, pubsub_fanout_on_message),
+                  .subscription_handle_ptr = handles + i,
+                  .filter = -124,
+                  .udata = state + i);
+  fio_queue_perform_all(fio___srv_tasks);
+  fio_publish(.channel = channel,
+              .filter = -124,
+              .engine = FIO_PUBSUB_PROCESS);
+  fio_queue_perform_all(fio___srv_tasks);
+  for (size_t i = 0; i < FIO___PUBSUB_FANOUT_TEST_COUNT; ++i) {
+    int expected = (i == 2) ? 2 : (i == FIO_PUBSUB_DELIVERY_BUDGET ||
+                                   i == FIO_PUBSUB_DELIVERY_BUDGET + 1)
+                                      ? 0
+                                      : 1;
+    FIO_ASSERT(state[i] == expected,
+               "fan-out delivery error for subscriber %zu (%d != %d)",
+               i,
+               state[i],
+               expected);
+  }
+  for (size_t i = 0; i < FIO___PUBSUB_FANOUT_TEST_COUNT; ++i)
+    if (i != FIO_PUBSUB_DELIVERY_BUDGET && i != FIO_PUBSUB_DELIVERY_BUDGET + 1)
+      fio_unsubscribe(.subscription_handle_ptr = handles + i);
+  fio_queue_perform_all(fio___srv_tasks);
+}
+#undef FIO___PUBSUB_FANOUT_TEST_COUNT
+
+/* *****************************************************************************
+Message Cache Testing
+***************************************************************************** */
+
+static struct {
+  size_t built;
+  size_t freed;
+  size_t matched;
+} FIO_NAME_TEST(stl, pubsub_cache_data);
+
+FIO_SFUNC void *FIO_NAME_TEST(stl, pubsub_cache_build)(fio_str_info_s ch,
+                                                       fio_str_info_s msg,
+                                                       int16_t filter,
+                                                       uint8_t is_json) {
+  ++FIO_NAME_TEST(stl, pubsub_cache_data).built;
+  return (void *)fio_bstr_write(NULL, msg.buf, msg.len);
+  (void)ch, (void)filter, (void)is_json;
+}
+
+FIO_SFUNC void FIO_NAME_TEST(stl, pubsub_cache_free)(void *data) {
+  ++FIO_NAME_TEST(stl, pubsub_cache_data).freed;
+  fio_bstr_free((char *)data);
+}
+
+FIO_SFUNC void FIO_NAME_TEST(stl, pubsub_cache_on_message)(fio_msg_s *msg) {
+  if (!msg->udata)
+    return;
+  char *data = (char *)fio_message_cache(msg,
+                                         FIO_NAME_TEST(stl, pubsub_cache_build),
+                                         FIO_NAME_TEST(stl, pubsub_cache_free));
+  FIO_NAME_TEST(stl, pubsub_cache_data).matched +=
+      FIO_BUF_INFO_IS_EQ(fio_bstr_buf(data),
+                         FIO_BUF_INFO2(msg->message.buf, msg->message.len));
+}
+
+FIO_SFUNC void FIO_NAME_TEST(stl, pubsub_cache)(void) {
+  fprintf(stderr, "* Testing pub/sub message cache.\n");
+  uintptr_t handles[4] = {0};
+  fio_buf_info_s channels[] = {
+      FIO_BUF_INFO1((char *)"pubsub_cache_test"),
+      FIO_BUF_INFO1((char *)"pubsub_cache_skip"),
+  };
+  /* 3 subscribers use the cache, one ignores it (udata == NULL) */
+  for (size_t i = 0; i < 4; ++i)
+    fio_subscribe(.channel = channels[i == 3],
+                  .on_message = FIO_NAME_TEST(stl, pubsub_cache_on_message),
+                  .subscription_handle_ptr = handles + i,
+                  .filter = -123,
+                  .udata = (void *)(uintptr_t)(i != 3));
+  fio_queue_perform_all(fio___srv_tasks);
+  fio_publish(.channel = channels[0],
+              .message = FIO_BUF_INFO1((char *)"cached message"),
+              .filter = -123,
+              .engine = FIO_PUBSUB_PROCESS);
+  fio_publish(.channel = channels[1],
+              .message = FIO_BUF_INFO1((char *)"never cached"),
+              .filter = -123,
+              .engine = FIO_PUBSUB_PROCESS);
+  fio_queue_perform_all(fio___srv_tasks);
+  FIO_ASSERT(FIO_NAME_TEST(stl, pubsub_cache_data).matched == 3,
+             "fio_message_cache returned wrong data (%zu/3)",
+             FIO_NAME_TEST(stl, pubsub_cache_data).matched);
+  FIO_ASSERT(FIO_NAME_TEST(stl, pubsub_cache_data).built == 1,
+             "fio_message_cache should build once, only when requested (%zu)",
+             FIO_NAME_TEST(stl, pubsub_cache_data).built);
+  FIO_ASSERT(FIO_NAME_TEST(stl, pubsub_cache_data).freed == 1,
+             "fio_message_cache data should be freed with the message");
+  for (size_t i = 0; i < 4; ++i)
+    fio_unsubscribe(.subscription_handle_ptr = handles + i);
+  fio_queue_perform_all(fio___srv_tasks);
+}
+
 /* *****************************************************************************
 
 ***************************************************************************** */
@@ -45012,6 +53993,9 @@ FIO_SFUNC void FIO_NAME_TEST(stl, pubsub_roundtrip)(void) {
 FIO_SFUNC void FIO_NAME_TEST(stl, pubsub)(void) {
   FIO_NAME_TEST(stl, letter)();
   FIO_NAME_TEST(stl, pubsub_roundtrip)();
+  FIO_NAME_TEST(stl, pubsub_patterns)();
+  FIO_NAME_TEST(stl, pubsub_fanout)();
+  FIO_NAME_TEST(stl, pubsub_cache)();
   fio___srv_cleanup_at_exit(NULL);
 }
 
@@ -46214,6 +55198,101 @@ FIO_SFUNC void FIO_NAME_TEST(FIO_NAME_TEST(stl, server), env)(void) {
   FIO_ASSERT(a == 2 && b == 1 && c == 1, "destroy should call callbacks.");
 }
 
+/* *****************************************************************************
+Test shared (cached) file descriptors
+***************************************************************************** */
+#if FIO_SRV_FILE_CACHE_LIMIT && FIO_OS_POSIX
+/* tests if a file descriptor is (still) open */
+FIO_IFUNC int FIO_NAME_TEST(FIO_NAME_TEST(stl, server), fd_is_open)(int fd) {
+  return fcntl(fd, F_GETFD) != -1;
+}
+
+FIO_SFUNC void FIO_NAME_TEST(FIO_NAME_TEST(stl, server), files)(void) {
+  fprintf(stderr, "   * Testing fio_srv_file_open (shared files).\n");
+  char name[] = "/tmp/fio_test_srv_file_XXXXXX";
+  char buf[16];
+  struct stat st;
+  int fd, fd2;
+  int tmp = mkstemp(name);
+  FIO_ASSERT(tmp != -1 && write(tmp, "hello", 5) == 5 && !close(tmp),
+             "couldn't create a temporary file for testing");
+
+  /* concurrent users share a single file descriptor */
+  fd = fio_srv_file_open(name, &st);
+  fd2 = fio_srv_file_open(name, NULL);
+  FIO_ASSERT(fd != -1 && st.st_size == 5, "fio_srv_file_open failed");
+  FIO_ASSERT(fd == fd2, "fio_srv_file_open should share file descriptors");
+  fio_srv_file_close(fd2);
+  FIO_ASSERT(FIO_NAME_TEST(FIO_NAME_TEST(stl, server), fd_is_open)(fd),
+             "shared file descriptor closed while still in use");
+
+  /* `fio_srv_sendfile` releases (rather than closes) the file descriptor */
+  fd2 = fio_srv_file_open(name, NULL);
+  FIO_ASSERT(fd == fd2, "fio_srv_file_open should share file descriptors");
+  {
+    int old_level = FIO_LOG_LEVEL_GET();
+    FIO_LOG_LEVEL_SET(FIO_LOG_LEVEL_FATAL); /* writing to a NULL IO errors */
+    fio_srv_sendfile(NULL, fd2, 0, 5);
+    FIO_LOG_LEVEL_SET(old_level);
+  }
+  FIO_ASSERT(FIO_NAME_TEST(FIO_NAME_TEST(stl, server), fd_is_open)(fd),
+             "fio_srv_sendfile shouldn't close shared file descriptors");
+  { /* stream packets release the file once the data was consumed */
+    fio_stream_s s = FIO_STREAM_INIT(s);
+    char *pos = buf;
+    size_t len = sizeof(buf);
+    fd2 = fio_srv_file_open(name, NULL);
+    fio_stream_add(&s, fio_stream_pack_fd2(fd2, 5, 0, fio_srv_file_release));
+    fio_stream_read(&s, &pos, &len);
+    FIO_ASSERT(len == 5 && !FIO_MEMCMP(pos, "hello", 5),
+               "shared file descriptor read error");
+    fio_stream_advance(&s, len);
+    fio_stream_destroy(&s);
+  }
+  fio_srv_file_close(fd);
+  FIO_ASSERT(FIO_NAME_TEST(FIO_NAME_TEST(stl, server), fd_is_open)(fd),
+             "cached file descriptors should remain open");
+  FIO_ASSERT(fio___srv_file_fds_count(&fio___srv_files.fds) == 1,
+             "shared file descriptor should be tracked while cached");
+  fio___srv_files_cleanup();
+  FIO_ASSERT(!FIO_NAME_TEST(FIO_NAME_TEST(stl, server), fd_is_open)(fd) &&
+                 !fio___srv_file_fds_count(&fio___srv_files.fds),
+             "released file descriptor should be closed once uncached");
+
+  /* a changed file gets a new file descriptor, the old one remains valid */
+  fd = fio_srv_file_open(name, NULL);
+  FIO_ASSERT(fd != -1, "fio_srv_file_open failed");
+  tmp = open(name, O_WRONLY | O_APPEND);
+  FIO_ASSERT(tmp != -1 && write(tmp, " world", 6) == 6 && !close(tmp),
+             "couldn't update the temporary file");
+  {
+    fio_str_info_s key = FIO_STR_INFO1(name);
+    fio___srv_file_s *f =
+        fio___srv_file_cache_get(&fio___srv_files.cache,
+                                 fio_risky_hash(key.buf, key.len, 0),
+                                 key);
+    FIO_ASSERT(f && f->fd == fd, "file should be cached");
+    f->expires = 0; /* skip waiting for FIO_SRV_FILE_CACHE_TTL */
+  }
+  fd2 = fio_srv_file_open(name, &st);
+  FIO_ASSERT(fd2 != -1 && fd2 != fd && st.st_size == 11,
+             "changed file should be re-opened after the TTL");
+  FIO_ASSERT(FIO_NAME_TEST(FIO_NAME_TEST(stl, server), fd_is_open)(fd) &&
+                 pread(fd, buf, 5, 0) == 5 && !FIO_MEMCMP(buf, "hello", 5),
+             "stale file descriptor should remain valid until released");
+  fio_srv_file_close(fd);
+  FIO_ASSERT(!FIO_NAME_TEST(FIO_NAME_TEST(stl, server), fd_is_open)(fd),
+             "stale file descriptor should be closed once released");
+  fio_srv_file_close(fd2);
+  fio___srv_files_cleanup();
+  FIO_ASSERT(!FIO_NAME_TEST(FIO_NAME_TEST(stl, server), fd_is_open)(fd2),
+             "released file descriptor should be closed once uncached");
+  unlink(name);
+}
+#else
+FIO_SFUNC void FIO_NAME_TEST(FIO_NAME_TEST(stl, server), files)(void) {}
+#endif /* FIO_SRV_FILE_CACHE_LIMIT */
+
 /* *****************************************************************************
 Test Server Modules
 ***************************************************************************** */
@@ -46222,6 +55301,7 @@ FIO_SFUNC void FIO_NAME_TEST(stl, server)(void) {
   fprintf(stderr, "* Testing fio_srv units (TODO).\n");
   FIO_NAME_TEST(FIO_NAME_TEST(stl, server), env)();
   FIO_NAME_TEST(FIO_NAME_TEST(stl, server), tls_helpers)();
+  FIO_NAME_TEST(FIO_NAME_TEST(stl, server), files)();
 }
 /* *****************************************************************************
 Cleanup
@@ -46355,6 +55435,71 @@ FIO_SFUNC void FIO_NAME_TEST(stl, sock)(void) {
       unlink(server_tests[i].address);
 #endif
   }
+  {
+    /* peer addresses (Unix sockets have no IP address) */
+    fprintf(stderr, "* Testing fio_sock_peer_addr\n");
+    struct {
+      const char *address;
+      const char *port;
+      const char *peer;
+      uint16_t flag;
+    } peer_tests[] = {
+      {"127.0.0.1", "9438", "127.0.0.1", FIO_SOCK_TCP},
+      {"::1", "9438", "::1", FIO_SOCK_TCP},
+#ifdef AF_UNIX
+#if defined(P_tmpdir) && !defined(__MINGW32__)
+      {P_tmpdir "/tmp_unix_testing_peer_facil_io.sock",
+       NULL,
+       "",
+       FIO_SOCK_UNIX},
+#else
+      {"./tmp_unix_testing_peer_facil_io.sock", NULL, "", FIO_SOCK_UNIX},
+#endif
+#endif
+      {.address = NULL},
+    };
+    char buf[64];
+    FIO_ASSERT(!fio_sock_peer_addr(buf, sizeof(buf), -1) && !buf[0],
+               "fio_sock_peer_addr should fail for an invalid socket");
+    for (size_t i = 0; peer_tests[i].address; ++i) {
+      size_t len;
+      int srv = fio_sock_open(peer_tests[i].address,
+                              peer_tests[i].port,
+                              peer_tests[i].flag | FIO_SOCK_SERVER);
+      if (srv == -1 && peer_tests[i].address[0] == ':') {
+        fprintf(stderr, "\t- IPv6 unavailable, skipped\n");
+        continue;
+      }
+      FIO_ASSERT(srv != -1,
+                 "server socket failed to open: %s",
+                 strerror(errno));
+      int cl = fio_sock_open(peer_tests[i].address,
+                             peer_tests[i].port,
+                             peer_tests[i].flag | FIO_SOCK_CLIENT);
+      FIO_ASSERT(FIO_SOCK_FD_ISVALID(cl) &&
+                     (fio_sock_wait_io(srv, POLLIN, 200) & POLLIN),
+                 "client socket failed to connect (%s)",
+                 peer_tests[i].address);
+      int accepted = (int)accept(srv, NULL, NULL);
+      FIO_ASSERT(FIO_SOCK_FD_ISVALID(accepted), "accept failed");
+      FIO_MEMSET(buf, 'x', sizeof(buf));
+      len = fio_sock_peer_addr(buf, sizeof(buf), accepted);
+      FIO_ASSERT(len == strlen(peer_tests[i].peer) &&
+                     !memcmp(buf, peer_tests[i].peer, len + 1),
+                 "fio_sock_peer_addr error for %s: %s",
+                 peer_tests[i].address,
+                 buf);
+      FIO_ASSERT(!fio_sock_peer_addr(buf, 2, accepted) && !buf[0],
+                 "fio_sock_peer_addr should fail if `dest` is too short");
+      fio_sock_close(accepted);
+      fio_sock_close(cl);
+      fio_sock_close(srv);
+#ifdef AF_UNIX
+      if (FIO_SOCK_UNIX == peer_tests[i].flag)
+        unlink(peer_tests[i].address);
+#endif
+    }
+  }
   {
     /* UDP semi test */
     fprintf(stderr, "* Testing UDP socket (abbreviated test)\n");
@@ -46820,6 +55965,37 @@ FIO_SFUNC void FIO_NAME_TEST(stl, stream)(void) {
   FIO_ASSERT(!fio_stream_length(&s),
              "stream length should be zero at this point.");
   fio_stream_destroy(&s);
+  { /* shared file descriptors are released, not closed */
+    int fd = open(__FILE__, O_RDONLY);
+    FIO_ASSERT(fd != -1, "couldn't open test file");
+    fio_stream_add(&s,
+                   fio_stream_pack_fd2(fd,
+                                       20,
+                                       0,
+                                       FIO_NAME_TEST(stl, stream___noop_dealloc)));
+    fio_stream_add(&s,
+                   fio_stream_pack_fd2(fd,
+                                       20,
+                                       0,
+                                       FIO_NAME_TEST(stl, stream___noop_dealloc)));
+    buf = mem;
+    len = 4000;
+    fio_stream_read(&s, &buf, &len);
+    FIO_ASSERT(len == 40 && !memcmp(buf, buf + 20, 20) &&
+                   !memcmp("/* *****************", buf, 20),
+               "fio_stream_read shared file read error (%zu)",
+               len);
+    fio_stream_advance(&s, 20);
+    FIO_ASSERT(FIO_NAME_TEST(stl, stream___noop_dealloc_count) ==
+                   ++expect_dealloc,
+               "consumed shared file packets should be released.");
+    fio_stream_destroy(&s);
+    FIO_ASSERT(FIO_NAME_TEST(stl, stream___noop_dealloc_count) ==
+                   ++expect_dealloc,
+               "destroyed shared file packets should be released.");
+    FIO_ASSERT(fio_fd_size(fd) && !close(fd),
+               "shared file descriptors shouldn't be closed by the stream.");
+  }
 }
 
 /* *****************************************************************************
@@ -49001,9 +58177,19 @@ FIO_SFUNC void fio_test_dynamic_types(void) {
   FIO_NAME_TEST(stl, fiobj)();
   fprintf(stderr, "===============\n");
   FIO_NAME_TEST(stl, server)();
+  /* these run the server, before the pub/sub test cleans up its state */
+  FIO_NAME_TEST(stl, http_client)();
+  FIO_NAME_TEST(stl, http_deadlines)();
+  FIO_NAME_TEST(stl, http_server)();
   FIO_NAME_TEST(stl, pubsub)();
   fprintf(stderr, "===============\n");
   FIO_NAME_TEST(stl, http_s)();
+  FIO_NAME_TEST(stl, http_form)();
+  FIO_NAME_TEST(stl, http_cache)();
+  FIO_NAME_TEST(stl, http_static_cache)();
+  FIO_NAME_TEST(stl, http_log)();
+  FIO_NAME_TEST(stl, http_router)();
+  FIO_NAME_TEST(stl, http_websocket)();
   fprintf(stderr, "===============\n");
   FIO_NAME_TEST(stl, risky)();
   fprintf(stderr, "===============\n");
@@ -49226,6 +58412,7 @@ Finish testing segment
 #include "902 fiobj.h"
 #include "902 glob matching.h"
 #include "902 http handle.h"
+#include "902 http.h"
 #include "902 imap.h"
 #include "902 math.h"
 #include "902 memalt.h"
@@ -204,12 +204,24 @@ Address Sanitizer Detection
 /* *****************************************************************************
 Intrinsic Availability Flags
 ***************************************************************************** */
-#if defined(__ARM_FEATURE_CRYPTO) &&                                           \
-    (defined(__ARM_NEON) || defined(__ARM_NEON__))
-#include <arm_acle.h>
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
 #include <arm_neon.h>
+#define FIO___HAS_ARM_NEON 1
+#if defined(__ARM_FEATURE_CRYPTO)
+#include <arm_acle.h>
 #define FIO___HAS_ARM_INTRIN 1
 #endif
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define FIO___HAS_X86_AVX2 1
+#define FIO___HAS_X86_SSE2 1
+#elif defined(__SSE2__) || defined(_M_X64) ||                                  \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FIO___HAS_X86_SSE2 1
+#endif
 
 /* *****************************************************************************
 Aligned Memory Access Selectors
@@ -1559,14 +1571,65 @@ Byte masking (XOR)
 *****************************************************************************
 */
 
+#if FIO___HAS_X86_AVX2 || FIO___HAS_X86_SSE2 || FIO___HAS_ARM_NEON
+/* Masks 64 byte blocks using vector registers, returns the bytes masked. */
+FIO_IFUNC size_t fio___xmask_vec(char *dest,
+                                 const char *src,
+                                 size_t len,
+                                 uint64_t mask) {
+  size_t i = 0;
+#if FIO___HAS_X86_AVX2
+  const __m256i m = _mm256_set1_epi64x((long long)mask);
+  for (; i + 63 < len; i += 64) {
+    __m256i a = _mm256_loadu_si256((const __m256i *)(src + i));
+    __m256i b = _mm256_loadu_si256((const __m256i *)(src + i + 32));
+    _mm256_storeu_si256((__m256i *)(dest + i), _mm256_xor_si256(a, m));
+    _mm256_storeu_si256((__m256i *)(dest + i + 32), _mm256_xor_si256(b, m));
+  }
+#elif FIO___HAS_X86_SSE2
+  const __m128i m = _mm_set1_epi64x((long long)mask);
+  for (; i + 63 < len; i += 64) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+    __m128i b = _mm_loadu_si128((const __m128i *)(src + i + 16));
+    __m128i c = _mm_loadu_si128((const __m128i *)(src + i + 32));
+    __m128i d = _mm_loadu_si128((const __m128i *)(src + i + 48));
+    _mm_storeu_si128((__m128i *)(dest + i), _mm_xor_si128(a, m));
+    _mm_storeu_si128((__m128i *)(dest + i + 16), _mm_xor_si128(b, m));
+    _mm_storeu_si128((__m128i *)(dest + i + 32), _mm_xor_si128(c, m));
+    _mm_storeu_si128((__m128i *)(dest + i + 48), _mm_xor_si128(d, m));
+  }
+#else /* FIO___HAS_ARM_NEON */
+  const uint8x16_t m = vreinterpretq_u8_u64(vdupq_n_u64(mask));
+  for (; i + 63 < len; i += 64) {
+    /* vld1q_u8_x4 / vst1q_u8_x4 are missing on some (32 bit) toolchains */
+    uint8x16_t a = vld1q_u8((const uint8_t *)(src + i));
+    uint8x16_t b = vld1q_u8((const uint8_t *)(src + i + 16));
+    uint8x16_t c = vld1q_u8((const uint8_t *)(src + i + 32));
+    uint8x16_t d = vld1q_u8((const uint8_t *)(src + i + 48));
+    vst1q_u8((uint8_t *)(dest + i), veorq_u8(a, m));
+    vst1q_u8((uint8_t *)(dest + i + 16), veorq_u8(b, m));
+    vst1q_u8((uint8_t *)(dest + i + 32), veorq_u8(c, m));
+    vst1q_u8((uint8_t *)(dest + i + 48), veorq_u8(d, m));
+  }
+#endif
+  return i;
+}
+#else
+#define fio___xmask_vec(dest, src, len, mask) ((size_t)0)
+#endif
+
 /**
  * Masks data using a persistent 64 bit mask.
  *
- * When the buffer's memory is aligned, the function may perform significantly
- * better.
+ * Uses SIMD instructions (AVX2 / SSE2 / NEON) when available at compile time.
  */
 FIO_IFUNC void fio_xmask(char *buf_, size_t len, uint64_t mask) {
   register char *buf = (char *)buf_;
+  {
+    const size_t done = fio___xmask_vec(buf, buf, len, mask);
+    buf += done;
+    len -= done;
+  }
   for (size_t i = 31; i < len; i += 32) {
     for (size_t g = 0; g < 4; ++g) {
       fio_u2buf64u(buf, (fio_buf2u64u(buf) ^ mask));
@@ -1591,10 +1654,9 @@ FIO_IFUNC void fio_xmask(char *buf_, size_t len, uint64_t mask) {
 }
 
 /**
- * Masks data using a persistent 64 bit mask.
+ * Copies and masks data using a persistent 64 bit mask.
  *
- * When the buffer's memory is aligned, the function may perform significantly
- * better.
+ * Uses SIMD instructions (AVX2 / SSE2 / NEON) when available at compile time.
  */
 FIO_IFUNC void fio_xmask_cpy(char *restrict dest,
                              const char *src,
@@ -1604,6 +1666,12 @@ FIO_IFUNC void fio_xmask_cpy(char *restrict dest,
     fio_xmask(dest, len, mask);
     return;
   }
+  {
+    const size_t done = fio___xmask_vec(dest, src, len, mask);
+    dest += done;
+    src += done;
+    len -= done;
+  }
   for (size_t i = 31; i < len; i += 32) {
     for (size_t g = 0; g < 4; ++g) {
       fio_u2buf64u(dest, (fio_buf2u64u(src) ^ mask));
@@ -318,8 +318,9 @@ FIO_MAP Ordering & Naming Shortcut
 #define FIO_STATE
 #endif
 
-#if defined(FIO_HTTP_HANDLE) || defined(FIO_STR_NAME) ||                       \
-    defined(FIO_STR_SMALL) || defined(FIO_ARRAY_TYPE_STR) ||                   \
+#if defined(FIO_HTTP_HANDLE) || defined(FIO_SERVER) ||                         \
+    defined(FIO_STR_NAME) || defined(FIO_STR_SMALL) ||                         \
+    defined(FIO_ARRAY_TYPE_STR) ||                                             \
     defined(FIO_MAP_KEY_KSTR) || defined(FIO_MAP_KEY_BSTR) ||                  \
     (defined(FIO_MAP_NAME) && !defined(FIO_MAP_KEY)) || defined(FIO_MUSTACHE)
 #undef FIO_STR
@@ -420,7 +421,7 @@ FIO_MAP Ordering & Naming Shortcut
 #define FIO_SIGNAL
 #endif
 
-#if defined(FIO_MEMORY_NAME) || defined(FIO_QUEUE)
+#if defined(FIO_MEMORY_NAME) || defined(FIO_QUEUE) || defined(FIO_HTTP_HANDLE)
 #undef FIO_THREADS
 #define FIO_THREADS
 #endif
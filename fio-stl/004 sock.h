@@ -75,6 +75,7 @@ FIO_IFUNC int fio_sock_dup(int original) {
 }
 
 #elif FIO_HAVE_UNIX_TOOLS
+#include <arpa/inet.h>
 #include <fcntl.h>
 #include <netdb.h>
 #include <poll.h>
@@ -173,6 +174,13 @@ SFUNC size_t fio_sock_maximize_limits(size_t maximum_limit);
  */
 SFUNC short fio_sock_wait_io(int fd, short events, int timeout);
 
+/**
+ * Writes the socket's peer (remote) IP address to `dest` (NUL terminated).
+ *
+ * Returns the length of the address or 0 on error (i.e., Unix sockets).
+ */
+SFUNC size_t fio_sock_peer_addr(char *dest, size_t capa, int fd);
+
 /** A helper macro that waits on a single IO with no callbacks (0 = no event) */
 #define FIO_SOCK_WAIT_RW(fd, timeout_)                                         \
   fio_sock_wait_io(fd, POLLIN | POLLOUT, timeout_)
@@ -519,6 +527,26 @@ SFUNC short fio_sock_wait_io(int fd, short events, int timeout) {
   return r;
 }
 
+/** Writes the socket's peer (remote) IP address to `dest`. */
+SFUNC size_t fio_sock_peer_addr(char *dest, size_t capa, int fd) {
+  struct sockaddr_storage addr;
+  socklen_t len = sizeof(addr);
+  const void *ip;
+  if (!dest || !capa)
+    return 0;
+  dest[0] = 0;
+  if (getpeername(fd, (struct sockaddr *)&addr, &len))
+    return 0;
+  switch (addr.ss_family) {
+  case AF_INET: ip = &((struct sockaddr_in *)&addr)->sin_addr; break;
+  case AF_INET6: ip = &((struct sockaddr_in6 *)&addr)->sin6_addr; break;
+  default: return 0;
+  }
+  if (!inet_ntop(addr.ss_family, ip, dest, capa))
+    return (dest[0] = 0);
+  return strlen(dest);
+}
+
 /** Attempts to maximize the allowed open file limits. returns known limit */
 SFUNC size_t fio_sock_maximize_limits(size_t max_limit) {
   ssize_t capa = 0;
@@ -86,6 +86,17 @@ SFUNC fio_stream_packet_s *fio_stream_pack_fd(int fd,
                                               size_t offset,
                                               uint8_t keep_open);
 
+/**
+ * Packs a shared file descriptor into a fio_stream_packet_s container.
+ *
+ * The file is never closed by the stream. Instead, `release` is called with
+ * the file descriptor (cast to a pointer) once the packet was consumed.
+ */
+SFUNC fio_stream_packet_s *fio_stream_pack_fd2(int fd,
+                                               size_t len,
+                                               size_t offset,
+                                               void (*release)(void *));
+
 /** Adds a packet to the stream. This isn't thread safe.*/
 SFUNC void fio_stream_add(fio_stream_s *stream, fio_stream_packet_s *packet);
 
@@ -236,6 +247,7 @@ typedef struct {
   fio_stream_packet_type_e type;
   size_t length;
   size_t offset;
+  void (*release)(void *fd);
   int fd;
 } fio_stream_packet_fd_s;
 
@@ -261,8 +273,11 @@ FIO_SFUNC void fio_stream_packet_free(fio_stream_packet_s *p) {
 #ifdef DEBUG
     FIO_LOG_DEBUG2("fio_stream_packet_free closed file fd %d", u.f->fd);
 #endif
-    /* fall through */
+    FIO_MEM_FREE_(p, sizeof(*p) + sizeof(*u.f));
+    break;
   case FIO_PACKET_TYPE_FILE_NO_CLOSE:
+    if (u.f->release)
+      u.f->release((void *)(intptr_t)u.f->fd);
     FIO_MEM_FREE_(p, sizeof(*p) + sizeof(*u.f));
     break;
   }
@@ -398,6 +413,19 @@ no_file:
   return p;
 }
 
+/** Packs a shared file descriptor into a fio_stream_packet_s container. */
+SFUNC fio_stream_packet_s *fio_stream_pack_fd2(int fd,
+                                               size_t len,
+                                               size_t offset,
+                                               void (*release)(void *)) {
+  fio_stream_packet_s *p = fio_stream_pack_fd(fd, len, offset, 1);
+  if (p)
+    ((fio_stream_packet_fd_s *)(p + 1))->release = release;
+  else if (fd >= 0 && release)
+    release((void *)(intptr_t)fd);
+  return p;
+}
+
 /** Adds a packet to the stream. This isn't thread safe.*/
 SFUNC void fio_stream_add(fio_stream_s *s, fio_stream_packet_s *p) {
   fio_stream_packet_s *last = p;
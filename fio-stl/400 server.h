@@ -40,6 +40,19 @@ developer.
 #define FIO_SRV_TIMEOUT_MAX 300000
 #endif
 
+#ifndef FIO_SRV_FILE_CACHE_LIMIT
+/**
+ * The maximum number of files cached by `fio_srv_file_open` (0 disables the
+ * cache). Files in use remain open until released.
+ */
+#define FIO_SRV_FILE_CACHE_LIMIT 256
+#endif
+
+#ifndef FIO_SRV_FILE_CACHE_TTL
+/** Milliseconds before a file cached by `fio_srv_file_open` is re-validated. */
+#define FIO_SRV_FILE_CACHE_TTL 2000
+#endif
+
 #ifndef FIO_SRV_SHUTDOWN_TIMEOUT
 /* Sets the hard timeout (in milliseconds) for the server's shutdown loop. */
 #define FIO_SRV_SHUTDOWN_TIMEOUT 10000
@@ -282,6 +295,9 @@ typedef struct {
    * If this is a buffer, the de-allocation function used to free it.
    *
    * If NULL, the buffer will NOT be de-allocated.
+   *
+   * If this is a file, the file will NOT be closed when `dealloc` is set.
+   * Instead, `dealloc` is called with the file descriptor (cast to a pointer).
    */
   void (*dealloc)(void *);
   /** If non-zero, makes a copy of the buffer or keeps a file open. */
@@ -318,6 +334,42 @@ SFUNC void fio_write2(fio_s *io, fio_write_args_s args);
              .offset = (size_t)(offset_),                                      \
              .len = (bytes))
 
+/**
+ * Opens `filename` for reading, using a shared (cached) file descriptor.
+ *
+ * On success, returns the file descriptor and fills `st` (if not NULL) with the
+ * file's information. Returns -1 on error.
+ *
+ * Cached file descriptors (and their `stat` data) are re-validated every
+ * `FIO_SRV_FILE_CACHE_TTL` milliseconds, so concurrent requests for the same
+ * file share a single file descriptor.
+ *
+ * The file descriptor MUST NOT be closed (nor its file position changed).
+ * Release it using `fio_srv_file_close` or send it using `fio_srv_sendfile`.
+ */
+SFUNC int fio_srv_file_open(const char *filename, struct stat *st);
+
+/** Releases a file descriptor opened using `fio_srv_file_open`. */
+SFUNC void fio_srv_file_close(int fd);
+
+/**
+ * Releases a file descriptor opened using `fio_srv_file_open`, where the file
+ * descriptor is cast to a pointer (a `dealloc` compatible callback).
+ */
+SFUNC void fio_srv_file_release(void *fd);
+
+/**
+ * Sends data from a file opened using `fio_srv_file_open`, see `fio_sendfile`.
+ *
+ * Once the file was sent, `source_fd` is released using `fio_srv_file_close`.
+ */
+#define fio_srv_sendfile(io, source_fd, offset_, bytes)                        \
+  fio_write2((io),                                                             \
+             .fd = (source_fd),                                                \
+             .offset = (size_t)(offset_),                                      \
+             .len = (bytes),                                                   \
+             .dealloc = fio_srv_file_release)
+
 /** Marks the IO for closure as soon as scheduled data was sent. */
 SFUNC void fio_close(fio_s *io);
 
@@ -645,6 +697,19 @@ SFUNC int fio_tls_alpn_select(fio_tls_s *tls,
  */
 SFUNC fio_tls_s *fio_tls_trust_add(fio_tls_s *, const char *public_cert_file);
 
+/**
+ * Sets the server name sent (SNI) by client connections using the context.
+ *
+ * A `NULL` or empty `server_name` removes the server name.
+ *
+ *      fio_tls_server_name_set(tls, "www.example.com");
+ */
+SFUNC fio_tls_s *fio_tls_server_name_set(fio_tls_s *,
+                                         const char *server_name);
+
+/** Returns the server name (SNI) set for client connections, or `NULL`. */
+SFUNC const char *fio_tls_server_name(fio_tls_s *);
+
 /**
  * Returns the number of `fio_tls_cert_add` instructions.
  *
@@ -1487,6 +1552,9 @@ finish:
 static void fio___srv_poll_on_close(void *io_, void *ignr_) {
   (void)ignr_;
   fio_s *io = (fio_s *)io_;
+  /* read any data sent before the peer hung up (i.e., a final response) */
+  if (io->state == FIO_STATE_OPEN)
+    io->pr->on_data(io);
   fio_close_now(io);
   fio_free2(io);
 }
@@ -1899,7 +1967,14 @@ SFUNC void fio_write2 FIO_NOOP(fio_s *io, fio_write_args_s args) {
                                   args.copy,
                                   args.dealloc);
   } else if (args.fd != -1) {
-    packet = fio_stream_pack_fd(args.fd, args.len, args.offset, args.copy);
+    packet = (args.dealloc ? fio_stream_pack_fd2((int)args.fd,
+                                                 args.len,
+                                                 args.offset,
+                                                 args.dealloc)
+                           : fio_stream_pack_fd((int)args.fd,
+                                                args.len,
+                                                args.offset,
+                                                args.copy));
   }
   if (!packet)
     goto error;
@@ -1920,8 +1995,15 @@ write_called_after_close:
 io_error_null:
   FIO_LOG_ERROR("(%d) `fio_write2` called for invalid IO (NULL)",
                 fio___srvdata.pid);
-  if (args.dealloc)
-    args.dealloc(args.buf);
+  if (args.buf) {
+    if (args.dealloc)
+      args.dealloc(args.buf);
+  } else if (args.fd != -1) {
+    if (args.dealloc)
+      args.dealloc((void *)args.fd);
+    else if (!args.copy)
+      close((int)args.fd);
+  }
 }
 
 /** Marks the IO for closure as soon as scheduled data was sent. */
@@ -1963,6 +2045,192 @@ SFUNC int fio_srv_is_open(fio_s *io) {
   return (io->state & FIO_STATE_OPEN) && !(io->state & FIO_STATE_CLOSING);
 }
 
+/* *****************************************************************************
+Shared File Descriptors (file cache)
+***************************************************************************** */
+#if FIO_SRV_FILE_CACHE_LIMIT
+
+/** A shared, reference counted, read-only file descriptor. */
+typedef struct {
+  int64_t expires;
+  struct stat st;
+  /* number of users (+1 while cached) */
+  size_t refs;
+  int fd;
+} fio___srv_file_s;
+
+FIO___LEAK_COUNTER_DEF(fio___srv_file_s)
+
+FIO_SFUNC void fio___srv_file_unref(fio___srv_file_s *f);
+
+/* open (shared) files, by file descriptor */
+#define FIO_MAP_NAME            fio___srv_file_fds
+#define FIO_MAP_KEY             int
+#define FIO_MAP_VALUE           fio___srv_file_s *
+#define FIO_MAP_HASH_FN(fd)     fio_risky_num((uint64_t)(fd), 0)
+#define FIO___RECURSIVE_INCLUDE 1
+#include FIO_INCLUDE_FILE
+#undef FIO___RECURSIVE_INCLUDE
+
+/* cached files, by file name */
+#define FIO_MAP_NAME             fio___srv_file_cache
+#define FIO_MAP_VALUE            fio___srv_file_s *
+#define FIO_MAP_VALUE_DESTROY(f) fio___srv_file_unref(f)
+#define FIO_MAP_VALUE_DISCARD(f) fio___srv_file_unref(f)
+#define FIO_MAP_LRU              FIO_SRV_FILE_CACHE_LIMIT
+#define FIO___RECURSIVE_INCLUDE  1
+#include FIO_INCLUDE_FILE
+#undef FIO___RECURSIVE_INCLUDE
+
+static struct {
+  fio___srv_file_cache_s cache;
+  fio___srv_file_fds_s fds;
+  fio_lock_i lock;
+} fio___srv_files = {
+    .cache = FIO_MAP_INIT,
+    .fds = FIO_MAP_INIT,
+    .lock = FIO_LOCK_INIT,
+};
+
+/* Releases a shared file reference - MUST be called while holding the lock. */
+FIO_SFUNC void fio___srv_file_unref(fio___srv_file_s *f) {
+  if (!f || --f->refs)
+    return;
+  fio___srv_file_fds_remove(&fio___srv_files.fds, f->fd, NULL);
+  close(f->fd);
+  FIO_MEM_FREE_(f, sizeof(*f));
+  FIO___LEAK_COUNTER_ON_FREE(fio___srv_file_s);
+}
+
+/* Tests if the `stat` data still refers to the same (unchanged) file. */
+FIO_IFUNC int fio___srv_file_is_eq(struct stat *a, struct stat *b) {
+  return a->st_ino == b->st_ino && a->st_dev == b->st_dev &&
+         a->st_size == b->st_size && a->st_mtime == b->st_mtime;
+}
+
+/** Opens `filename` for reading, using a shared (cached) file descriptor. */
+SFUNC int fio_srv_file_open(const char *filename, struct stat *st) {
+  int fd = -1;
+  fio___srv_file_s *f;
+  struct stat tmp;
+  int64_t now;
+  uint64_t hash;
+  fio_str_info_s name;
+  if (!filename)
+    return fd;
+  now = fio_time_milli();
+  name = FIO_STR_INFO1((char *)filename);
+  hash = fio_risky_hash(name.buf, name.len, 0);
+  if (!st)
+    st = &tmp;
+
+  fio_lock(&fio___srv_files.lock);
+  f = fio___srv_file_cache_get(&fio___srv_files.cache, hash, name);
+  if (f && f->expires > now)
+    goto found_locked;
+  fio_unlock(&fio___srv_files.lock);
+
+  /* re-validate (or open) the file */
+  if (stat(filename, st))
+    goto file_missing;
+  fio_lock(&fio___srv_files.lock);
+  f = fio___srv_file_cache_get(&fio___srv_files.cache, hash, name);
+  if (f && fio___srv_file_is_eq(&f->st, st)) {
+    f->expires = now + FIO_SRV_FILE_CACHE_TTL;
+    goto found_locked;
+  }
+  fio_unlock(&fio___srv_files.lock);
+
+  fd = fio_filename_open(filename, O_RDONLY);
+  if (fd == -1)
+    goto file_missing;
+  if (fstat(fd, st)) {
+    close(fd);
+    goto file_missing;
+  }
+  f = (fio___srv_file_s *)FIO_MEM_REALLOC_(NULL, 0, sizeof(*f), 0);
+  if (!f) /* a private (unshared) file descriptor, closed when released */
+    return fd;
+  FIO___LEAK_COUNTER_ON_ALLOC(fio___srv_file_s);
+  *f = (fio___srv_file_s){
+      .expires = now + FIO_SRV_FILE_CACHE_TTL,
+      .st = *st,
+      .refs = 2,
+      .fd = fd,
+  };
+  fio_lock(&fio___srv_files.lock);
+  fio___srv_file_fds_set(&fio___srv_files.fds, fd, f, NULL);
+  fio___srv_file_cache_set(&fio___srv_files.cache, hash, name, f, NULL);
+  fio_unlock(&fio___srv_files.lock);
+  return fd;
+
+found_locked:
+  ++f->refs;
+  fd = f->fd;
+  *st = f->st;
+  fio_unlock(&fio___srv_files.lock);
+  return fd;
+
+file_missing:
+  fio_lock(&fio___srv_files.lock);
+  fio___srv_file_cache_remove(&fio___srv_files.cache, hash, name, NULL);
+  fio_unlock(&fio___srv_files.lock);
+  return -1;
+}
+
+/** Releases a file descriptor opened using `fio_srv_file_open`. */
+SFUNC void fio_srv_file_close(int fd) {
+  fio___srv_file_s *f;
+  if (fd == -1)
+    return;
+  fio_lock(&fio___srv_files.lock);
+  f = fio___srv_file_fds_get(&fio___srv_files.fds, fd);
+  if (f)
+    fio___srv_file_unref(f);
+  fio_unlock(&fio___srv_files.lock);
+  if (!f) /* a private (unshared) file descriptor */
+    close(fd);
+}
+
+/* Closes all cached files (called after all IO was closed). */
+FIO_SFUNC void fio___srv_files_cleanup(void) {
+  fio_lock(&fio___srv_files.lock);
+  fio___srv_file_cache_destroy(&fio___srv_files.cache);
+  if (!fio___srv_file_fds_count(&fio___srv_files.fds))
+    fio___srv_file_fds_destroy(&fio___srv_files.fds);
+  fio_unlock(&fio___srv_files.lock);
+}
+
+#else /* FIO_SRV_FILE_CACHE_LIMIT */
+
+/** Opens `filename` for reading (file caching was disabled). */
+SFUNC int fio_srv_file_open(const char *filename, struct stat *st) {
+  struct stat tmp;
+  int fd = fio_filename_open(filename, O_RDONLY);
+  if (fd == -1)
+    return fd;
+  if (fstat(fd, (st ? st : &tmp))) {
+    close(fd);
+    fd = -1;
+  }
+  return fd;
+}
+
+/** Releases a file descriptor opened using `fio_srv_file_open`. */
+SFUNC void fio_srv_file_close(int fd) {
+  if (fd != -1)
+    close(fd);
+}
+
+#define fio___srv_files_cleanup()
+
+#endif /* FIO_SRV_FILE_CACHE_LIMIT */
+
+/** Releases a file descriptor opened using `fio_srv_file_open`. */
+SFUNC void fio_srv_file_release(void *fd) {
+  fio_srv_file_close((int)(intptr_t)fd);
+}
+
 /* *****************************************************************************
 Listening
 ***************************************************************************** */
@@ -2422,6 +2690,8 @@ FIO_SFUNC void fio___srv_after_fork(void *ignr_) {
 
 FIO_SFUNC void fio___srv_cleanup_at_exit(void *ignr_) {
   fio___srv_after_fork(ignr_);
+  fio_timer_destroy(fio___srv_timer); /* calls `on_finish` for pending timers */
+  fio___srv_files_cleanup();
   fio_poll_destroy(&fio___srvdata.poll_data);
   fio___srv_env_safe_destroy(&fio___srvdata.env);
 }
@@ -2509,6 +2779,7 @@ struct fio_tls_s {
   fio___tls_cert_map_s cert;
   fio___tls_alpn_map_s alpn;
   fio___tls_trust_map_s trust;
+  fio_keystr_s server_name; /** The server name (SNI) sent by clients */
   uint8_t trust_sys; /** Set to 1 if system certificate registry is trusted */
 };
 
@@ -2530,6 +2801,7 @@ struct fio_tls_s {
                          FIO_STRING_FREE_KEY);                                 \
       fio_keystr_destroy(&tls.cert.ary[i].pk_password, FIO_STRING_FREE_KEY);   \
     }                                                                          \
+    fio_keystr_destroy(&tls.server_name, FIO_STRING_FREE_KEY);                 \
     fio___tls_alpn_map_destroy(&tls.alpn);                                     \
     fio___tls_trust_map_destroy(&tls.trust);                                   \
     fio___tls_cert_map_destroy(&tls.cert);                                     \
@@ -2679,6 +2951,26 @@ replace_old:
   return t;
 }
 
+/** Sets the server name sent (SNI) by client connections using the context. */
+SFUNC fio_tls_s *fio_tls_server_name_set(fio_tls_s *t,
+                                         const char *server_name) {
+  if (!t)
+    return t;
+  fio_keystr_destroy(&t->server_name, FIO_STRING_FREE_KEY);
+  t->server_name = fio_keystr_copy(FIO_STR_INFO1((char *)server_name),
+                                   FIO_STRING_ALLOC_KEY);
+  return t;
+}
+
+/** Returns the server name (SNI) set for client connections, or `NULL`. */
+SFUNC const char *fio_tls_server_name(fio_tls_s *t) {
+  fio_buf_info_s nm;
+  if (!t)
+    return NULL;
+  nm = fio_keystr_buf(&t->server_name);
+  return nm.len ? nm.buf : NULL;
+}
+
 /**
  * Returns the number of `fio_tls_cert_add` instructions.
  *
@@ -438,10 +438,14 @@ FIO_SFUNC void fio___openssl_start(fio_s *io) {
   BIO *bio = BIO_new_socket(fio_fd_get(io), 0);
   SSL_set_bio(ssl, bio, bio);
   SSL_set_ex_data(ssl, 0, (void *)io);
-  if (SSL_is_server(ssl))
+  if (SSL_is_server(ssl)) {
     SSL_accept(ssl);
-  else
+  } else {
+    const char *server_name = fio_tls_server_name(ctx_parent->tls);
+    if (server_name)
+      SSL_set_tlsext_host_name(ssl, server_name);
     SSL_connect(ssl);
+  }
 }
 
 /* *****************************************************************************
@@ -211,6 +211,14 @@ SFUNC void fio_publish(fio_publish_args_s args);
 /** for backwards compatibility */
 #define pubsub_publish fio_publish
 
+#ifndef FIO_PUBSUB_DELIVERY_BUDGET
+/**
+ * The number of subscribers a message is delivered to before the delivery task
+ * yields (is re-queued), allowing other tasks to be performed.
+ */
+#define FIO_PUBSUB_DELIVERY_BUDGET 256
+#endif
+
 /**
  * Defers the current callback, so it will be called again for the message.
  *
@@ -318,10 +326,28 @@ SFUNC int fio_message_metadata_add(fio_msg_metadata_fn metadata_func,
  */
 SFUNC void fio_message_metadata_remove(fio_msg_metadata_fn metadata_func);
 
-/** Finds the message's metadata, returning the data or NULL. */
+/**
+ * Finds the message's metadata, returning the data or NULL.
+ *
+ * Metadata is built for all attached callbacks on the first call (per message).
+ */
 SFUNC void *fio_message_metadata(fio_msg_s *msg,
                                  fio_msg_metadata_fn metadata_func);
 
+/**
+ * Returns data cached on the message by `build`, calling `build` on first use.
+ *
+ * Unlike metadata callbacks, nothing is attached globally and `build` is only
+ * called for messages that request the data. If concurrent threads build the
+ * data at the same time, one result is kept and the others are passed to
+ * `cleanup`.
+ *
+ * The data is passed to `cleanup` when the message is destroyed.
+ */
+SFUNC void *fio_message_cache(fio_msg_s *msg,
+                              fio_msg_metadata_fn build,
+                              void (*cleanup)(void *));
+
 /* *****************************************************************************
  * Pub/Sub Middleware and Extensions ("Engines")
  **************************************************************************** */
@@ -463,6 +489,7 @@ typedef struct fio_letter_s {
   void *from;
   uint8_t metadata_is_initialized; /* to compact this we need to change all? */
   void *metadata[FIO_PUBSUB_METADATA_LIMIT];
+  struct fio___letter_cache_s *cache; /* see `fio_message_cache` */
   char buf[];
 } fio_letter_s;
 
@@ -500,6 +527,7 @@ typedef struct fio_channel_s {
 /** The Subscription: contains subscriber data. */
 typedef struct fio_subscription_s {
   FIO_LIST_NODE node;
+  uint64_t seq; /* channel lists are ordered by subscription order */
   fio_s *io;
   fio_channel_s *channel;
   void (*on_message)(fio_msg_s *msg);
@@ -551,6 +579,30 @@ FIO_IFUNC uint64_t fio_channel___hash(char *buf, size_t len, int16_t filter) {
 #include FIO_INCLUDE_FILE
 #undef FIO___RECURSIVE_INCLUDE
 
+/**
+ * The Pattern Index: maps a literal pattern prefix to the pattern channels.
+ *
+ * Glob matches must start with the pattern's literal prefix (the bytes before
+ * the first `*`, `?`, `[` or `\`), so publishing only tests the patterns in
+ * buckets keyed by the prefixes of the channel's name. Patterns starting with
+ * a wildcard share the (empty prefix) bucket tested for every letter.
+ */
+#ifndef FIO___PUBSUB_PATTERN_PREFIX_LIMIT
+#define FIO___PUBSUB_PATTERN_PREFIX_LIMIT 63 /* MUST be less than 64 */
+#endif
+#define FIO_ARRAY_NAME          fio___pattern_bucket
+#define FIO_ARRAY_TYPE          fio_channel_s *
+#define FIO___RECURSIVE_INCLUDE 1
+#include FIO_INCLUDE_FILE
+#undef FIO___RECURSIVE_INCLUDE
+#define FIO_MAP_NAME               fio___pattern_map
+#define FIO_MAP_KEY                uint64_t
+#define FIO_MAP_VALUE              fio___pattern_bucket_s
+#define FIO_MAP_VALUE_DESTROY(bkt) fio___pattern_bucket_destroy(&(bkt))
+#define FIO___RECURSIVE_INCLUDE    1
+#include FIO_INCLUDE_FILE
+#undef FIO___RECURSIVE_INCLUDE
+
 /* *****************************************************************************
 
 
@@ -616,7 +668,7 @@ FIO_IFUNC fio_letter_s *fio_letter_new_compose(fio_buf_info_s channel,
                                                fio_buf_info_s message,
                                                int16_t filter,
                                                uint8_t flags);
-/** initializes a letter's metadata. */
+/** initializes a letter's metadata (on the first `fio_message_metadata`). */
 FIO_SFUNC void fio_letter_initialize_metadata(fio_letter_s *l);
 /** Returns a letter's message length (if any) */
 FIO_IFUNC size_t fio_letter_message_len(fio_letter_s *l);
@@ -739,9 +791,13 @@ static struct FIO_POSTOFFICE {
 #endif
   fio_channel_map_s channels;
   fio_channel_map_s patterns;
+  fio___pattern_map_s pattern_index;
+  uint64_t pattern_prefixes; /* bitmap of the indexed prefix lengths */
+  uint32_t pattern_prefix_count[FIO___PUBSUB_PATTERN_PREFIX_LIMIT + 1];
   FIO_LIST_NODE engines;
   fio_protocol_s *siblings_protocol;
   fio___postoffice_msmap_s master_subscriptions;
+  uint64_t subscription_seq;
   size_t secret[32 / sizeof(size_t)];
   uint8_t publish_filter;
   uint8_t local_send_filter;
@@ -753,6 +809,7 @@ static struct FIO_POSTOFFICE {
 #endif
     .channels = FIO_MAP_INIT,
     .patterns = FIO_MAP_INIT,
+    .pattern_index = FIO_MAP_INIT,
     .publish_filter = (FIO___PUBSUB_PROCESS | FIO___PUBSUB_ROOT),
     .local_send_filter = (FIO___PUBSUB_SIBLINGS),
     .remote_send_filter = FIO___PUBSUB_REMOTE,
@@ -818,6 +875,7 @@ SFUNC void fio_message_metadata_remove(fio_msg_metadata_fn metadata_func) {
 /** Finds the message's metadata, returning the data or NULL. */
 SFUNC void *fio_message_metadata(fio_msg_s *msg,
                                  fio_msg_metadata_fn metadata_func) {
+  fio_letter_initialize_metadata(fio_msg2letter(msg)); /* lazy, first call */
   for (size_t i = 0; i < FIO_PUBSUB_METADATA_LIMIT; ++i) { /* test existing */
     if (FIO_PUBSUB_METADATA[i].ref &&
         metadata_func == FIO_PUBSUB_METADATA[i].build) {
@@ -827,8 +885,60 @@ SFUNC void *fio_message_metadata(fio_msg_s *msg,
   return NULL;
 }
 
+/** A message cache entry (see `fio_message_cache`). */
+typedef struct fio___letter_cache_s {
+  struct fio___letter_cache_s *next;
+  fio_msg_metadata_fn build;
+  void (*cleanup)(void *);
+  void *data;
+} fio___letter_cache_s;
+
+/** Returns data cached on the message by `build`, building it on first use. */
+SFUNC void *fio_message_cache(fio_msg_s *msg,
+                              fio_msg_metadata_fn build,
+                              void (*cleanup)(void *)) {
+  fio_letter_s *l = fio_msg2letter(msg);
+  fio___letter_cache_s *head, *pos, *end = NULL, *c = NULL;
+  fio_atomic_load(head, &l->cache);
+  for (;;) {
+    for (pos = head; pos != end; pos = pos->next)
+      if (pos->build == build)
+        goto found;
+    if (!c) {
+      c = (fio___letter_cache_s *)FIO_MEM_REALLOC_(NULL, 0, sizeof(*c), 0);
+      FIO_ASSERT_ALLOC(c);
+      *c = (fio___letter_cache_s){
+          .build = build,
+          .cleanup = cleanup,
+          .data = build(
+              fio_letter_channel(l),
+              fio_letter_message(l),
+              fio_letter_filter(l),
+              ((fio_letter_flags(l) & FIO___PUBSUB_JSON) == FIO___PUBSUB_JSON)),
+      };
+    }
+    c->next = end = head; /* on failure, only test the newer entries */
+    if (fio_atomic_compare_exchange_p(&l->cache, &c->next, &c))
+      return c->data;
+    fio_atomic_load(head, &l->cache);
+  }
+found:
+  if (c) { /* a concurrent call cached the data first */
+    if (c->cleanup)
+      c->cleanup(c->data);
+    FIO_MEM_FREE_(c, sizeof(*c));
+  }
+  return pos->data;
+}
+
 /** Callback called when a letter is destroyed (reference counting). */
 FIO_SFUNC void fio_letter_on_destroy(fio_letter_s *l) {
+  for (fio___letter_cache_s *c = l->cache, *next; c; c = next) {
+    next = c->next;
+    if (c->cleanup)
+      c->cleanup(c->data);
+    FIO_MEM_FREE_(c, sizeof(*c));
+  }
   if (!l->metadata_is_initialized)
     return;
   for (size_t i = 0; i < FIO_PUBSUB_METADATA_LIMIT; ++i) {
@@ -840,10 +950,19 @@ FIO_SFUNC void fio_letter_on_destroy(fio_letter_s *l) {
   }
 }
 
-/** Callback called when a letter is destroyed (reference counting). */
+/** Builds the letter's metadata, once (concurrent callers wait for it). */
 FIO_SFUNC void fio_letter_initialize_metadata(fio_letter_s *l) {
-  if (fio_atomic_or(&l->metadata_is_initialized, 1)) {
+  uint8_t state;
+  fio_atomic_load(state, &l->metadata_is_initialized);
+  if ((state & 2))
     return;
+  if (fio_atomic_or(&l->metadata_is_initialized, 1)) {
+    for (;;) { /* another thread is building the metadata */
+      fio_atomic_load(state, &l->metadata_is_initialized);
+      if ((state & 2))
+        return;
+      FIO_THREAD_RESCHEDULE();
+    }
   }
   for (size_t i = 0; i < FIO_PUBSUB_METADATA_LIMIT; ++i) {
     if (fio_atomic_add(&FIO_PUBSUB_METADATA[i].ref, 1)) {
@@ -856,6 +975,7 @@ FIO_SFUNC void fio_letter_initialize_metadata(fio_letter_s *l) {
     }
     fio_atomic_sub(&FIO_PUBSUB_METADATA[i].ref, 1);
   }
+  fio_atomic_or(&l->metadata_is_initialized, 2);
 }
 
 /* *****************************************************************************
@@ -1298,10 +1418,71 @@ FIO_IFUNC fio_channel_s *fio_channel_new_named(fio_buf_info_s name,
   return ch;
 }
 
+/** Returns the length of the pattern's literal prefix (up to the limit). */
+FIO_IFUNC size_t fio___pattern_prefix_len(fio_channel_s *ch) {
+  size_t i = 0;
+  for (; i < ch->name_len && i < FIO___PUBSUB_PATTERN_PREFIX_LIMIT; ++i) {
+    switch (ch->name[i]) {
+    case '*': /* fall through */
+    case '?': /* fall through */
+    case '[': /* fall through */
+    case '\\': return i;
+    }
+  }
+  return i;
+}
+
+/** Adds a new pattern channel to the pattern index. */
+FIO_IFUNC void fio___pattern_index_add(fio_channel_s *ch) {
+  const size_t len = fio___pattern_prefix_len(ch);
+  const uint64_t hash = fio_channel___hash(ch->name, len, ch->filter);
+  fio___pattern_map_node_s *n =
+      fio___pattern_map_set_ptr(&FIO_POSTOFFICE.pattern_index,
+                                  hash,
+                                  hash,
+                                  (fio___pattern_bucket_s)FIO_ARRAY_INIT,
+                                  NULL,
+                                  0);
+  FIO_ASSERT_ALLOC(n);
+  fio___pattern_bucket_push(fio___pattern_map_node2val_ptr(n), ch);
+  if (!FIO_POSTOFFICE.pattern_prefix_count[len]++)
+    FIO_POSTOFFICE.pattern_prefixes |= ((uint64_t)1 << len);
+}
+
+/** Removes a pattern channel (with no more subscribers) from the index. */
+FIO_IFUNC void fio___pattern_index_remove(fio_channel_s *ch) {
+  const size_t len = fio___pattern_prefix_len(ch);
+  const uint64_t hash = fio_channel___hash(ch->name, len, ch->filter);
+  fio___pattern_map_node_s *n =
+      fio___pattern_map_get_ptr(&FIO_POSTOFFICE.pattern_index, hash, hash);
+  fio___pattern_bucket_s *bkt;
+  if (!n)
+    return;
+  bkt = fio___pattern_map_node2val_ptr(n);
+  if (!fio___pattern_bucket_remove2(bkt, ch))
+    return;
+  if (!fio___pattern_bucket_count(bkt))
+    fio___pattern_map_remove(&FIO_POSTOFFICE.pattern_index, hash, hash, NULL);
+  if (!--FIO_POSTOFFICE.pattern_prefix_count[len])
+    FIO_POSTOFFICE.pattern_prefixes &= ~((uint64_t)1 << len);
+}
+
+/** Schedules a letter's delivery to a (matching) pattern channel. */
+FIO_IFUNC void fio___channel_deliver_pattern(fio_channel_s *ch,
+                                             fio_letter_s *l,
+                                             fio_str_info_s ch_name,
+                                             int16_t filter) {
+  if (ch->filter == filter &&
+      FIO_PUBSUB_PATTERN_MATCH(FIO_STR_INFO2(ch->name, ch->name_len), ch_name))
+    fio_queue_push(fio_srv_queue(),
+                   fio___channel_deliver_task,
+                   fio_channel_dup(ch),
+                   fio_letter_dup(l));
+}
+
 /** To be used in the fio_letter_on_composed
  * callback to distribute letters. */
 FIO_IFUNC void fio___channel_deliver(fio_letter_s *l) {
-  fio_letter_initialize_metadata(l); /* lazy metadata initialization */
   const fio_str_info_s ch_name = fio_letter_channel(l);
   const int16_t filter = fio_letter_filter(l);
   fio_channel_s cpy = {
@@ -1329,14 +1510,31 @@ FIO_IFUNC void fio___channel_deliver(fio_letter_s *l) {
                    fio___channel_deliver_task,
                    fio_channel_dup(ch),
                    fio_letter_dup(l));
-  FIO_MAP_EACH(fio_channel_map, &FIO_POSTOFFICE.patterns, i) {
-    if (i.key && i.key->filter == filter &&
-        FIO_PUBSUB_PATTERN_MATCH(FIO_STR_INFO2(i.key->name, i.key->name_len),
-                                 ch_name))
-      fio_queue_push(fio_srv_queue(),
-                     fio___channel_deliver_task,
-                     fio_channel_dup(i.key),
-                     fio_letter_dup(l));
+  if (FIO_PUBSUB_PATTERN_MATCH == fio_glob_match) {
+    /* test only patterns with a literal prefix matching the channel's name */
+    for (uint64_t lens = FIO_POSTOFFICE.pattern_prefixes; lens;
+         lens &= lens - 1) {
+      const size_t len = fio_lsb_index_unsafe(lens);
+      fio___pattern_map_node_s *n;
+      if (len > ch_name.len)
+        break;
+      n = fio___pattern_map_get_ptr(
+          &FIO_POSTOFFICE.pattern_index,
+          fio_channel___hash(ch_name.buf, len, filter),
+          fio_channel___hash(ch_name.buf, len, filter));
+      if (!n)
+        continue;
+      FIO_ARRAY_EACH(fio___pattern_bucket,
+                     fio___pattern_map_node2val_ptr(n),
+                     pos) {
+        fio___channel_deliver_pattern(*pos, l, ch_name, filter);
+      }
+    }
+  } else { /* a custom matching function, the literal prefix might not apply */
+    FIO_MAP_EACH(fio_channel_map, &FIO_POSTOFFICE.patterns, i) {
+      if (i.key)
+        fio___channel_deliver_pattern(i.key, l, ch_name, filter);
+    }
   }
 #if FIO_POSTOFFICE_THREAD_LOCK
   FIO___LOCK_UNLOCK(FIO_POSTOFFICE.lock);
@@ -1394,6 +1592,9 @@ FIO_SFUNC void fio___subscribe_task(void *ch_, void *sub_) {
   if (!ch)
     goto unknown_error;
   sub->channel = fio_channel_dup(ch);
+  sub->seq = ++FIO_POSTOFFICE.subscription_seq;
+  if (ch->is_pattern && FIO_LIST_IS_EMPTY(&ch->subscriptions))
+    fio___pattern_index_add(ch); /* a new pattern channel */
   FIO_LIST_PUSH(&ch->subscriptions, &sub->node);
 
 #if FIO_POSTOFFICE_THREAD_LOCK
@@ -1423,16 +1624,21 @@ FIO_IFUNC void fio___unsubscribe_task(void *ch_, void *sub_) {
   FIO___LOCK_LOCK(FIO_POSTOFFICE.lock);
 #endif
 
-  FIO_LIST_REMOVE(&sub->node);
+  FIO_LIST_REMOVE_RESET(&sub->node); /* marks as removed for deliveries */
   if (FIO_LIST_IS_EMPTY(&ch->subscriptions)) {
     map = &FIO_POSTOFFICE.channels + ch->is_pattern;
+    if (ch->is_pattern)
+      fio___pattern_index_remove(ch);
     fio_channel_map_remove(
         map,
         fio_channel___hash(ch->name, ch->name_len, ch->filter),
         ch,
         NULL);
-    if (!fio_channel_map_count(map))
+    if (!fio_channel_map_count(map)) {
       fio_channel_map_destroy(map);
+      if (ch->is_pattern)
+        fio___pattern_map_destroy(&FIO_POSTOFFICE.pattern_index);
+    }
   }
 
 #if FIO_POSTOFFICE_THREAD_LOCK
@@ -1466,9 +1672,9 @@ FIO_IFUNC void fio___subscription_unsubscribe(fio_subscription_s *s) {
                  (void *)s);
 }
 
-FIO_IFUNC void fio___subscription_on_message_task(void *s_, void *l_) {
-  fio_subscription_s *s = (fio_subscription_s *)s_;
-  fio_letter_s *l = (fio_letter_s *)l_;
+/** Calls the subscription's callback, returns non-zero if deferred. */
+FIO_IFUNC uintptr_t fio___subscription_deliver(fio_subscription_s *s,
+                                               fio_letter_s *l) {
   struct {
     fio_msg_s msg;
     fio_letter_s *l;
@@ -1487,7 +1693,13 @@ FIO_IFUNC void fio___subscription_on_message_task(void *s_, void *l_) {
   };
   s->on_message(&m.msg);
   s->udata = m.msg.udata;
-  if (m.flag)
+  return m.flag;
+}
+
+FIO_IFUNC void fio___subscription_on_message_task(void *s_, void *l_) {
+  fio_subscription_s *s = (fio_subscription_s *)s_;
+  fio_letter_s *l = (fio_letter_s *)l_;
+  if (fio___subscription_deliver(s, l))
     goto reschedule;
   fio_subscription_free(s);
   fio_letter_free(l);
@@ -1508,33 +1720,69 @@ SFUNC void fio_message_defer(fio_msg_s *msg) {
   ((uintptr_t *)(msg + 1))[1] = 1;
 }
 
-/* delivers a letter to all of a channel's
- * subscribers */
-FIO_SFUNC void fio___channel_deliver_task(void *ch_, void *l_) {
-  fio_channel_s *ch = (fio_channel_s *)ch_;
-  fio_letter_s *l = (fio_letter_s *)l_;
-  if (l->from) {
-    FIO_LIST_EACH(fio_subscription_s, node, &ch->subscriptions, s) {
-      if (l->from != s->io)
-        fio_queue_push(
-            fio_srv_queue(),
-            (void (*)(void *, void *))fio___subscription_on_message_task,
-            fio_subscription_dup(s),
-            fio_letter_dup(l));
+/**
+ * Delivers a letter to a channel's subscribers, starting at `pos`.
+ *
+ * Consumes the letter and channel references once done, or passes them on to
+ * the continuation task when the delivery budget is exhausted.
+ */
+FIO_SFUNC void fio___channel_deliver_from(fio_channel_s *ch,
+                                          fio_letter_s *l,
+                                          FIO_LIST_NODE *pos);
+
+/* continues a delivery from a subscription (pinned by the previous task). */
+FIO_SFUNC void fio___channel_deliver_continue_task(void *s_, void *l_) {
+  fio_subscription_s *s = (fio_subscription_s *)s_;
+  /* the delivery still holds a channel reference, even if `s` unsubscribed */
+  fio_channel_s *ch = s->channel;
+  FIO_LIST_NODE *pos = &s->node;
+  if (s->node.next == &s->node) { /* unsubscribed, find the next in order */
+    for (pos = ch->subscriptions.next; pos != &ch->subscriptions;
+         pos = pos->next)
+      if (FIO_PTR_FROM_FIELD(fio_subscription_s, node, pos)->seq > s->seq)
+        break;
+  }
+  fio___channel_deliver_from(ch, (fio_letter_s *)l_, pos);
+  fio_subscription_free(s);
+}
+
+FIO_SFUNC void fio___channel_deliver_from(fio_channel_s *ch,
+                                          fio_letter_s *l,
+                                          FIO_LIST_NODE *pos) {
+  size_t budget = FIO_PUBSUB_DELIVERY_BUDGET;
+  while (pos != &ch->subscriptions) {
+    fio_subscription_s *s = FIO_PTR_FROM_FIELD(fio_subscription_s, node, pos);
+    if (!budget--) { /* yield, pinning the next subscription */
+      fio_queue_push(fio_srv_queue(),
+                     fio___channel_deliver_continue_task,
+                     fio_subscription_dup(s),
+                     (void *)l);
+      return;
     }
-  } else {
-    FIO_LIST_EACH(fio_subscription_s, node, &ch->subscriptions, s) {
+    pos = pos->next;
+    if ((l->from && l->from == s->io) ||
+        s->on_message == fio_subscription___mock_cb)
+      continue;
+    if (fio___subscription_deliver(s, l)) /* deferred by the callback */
       fio_queue_push(
           fio_srv_queue(),
           (void (*)(void *, void *))fio___subscription_on_message_task,
           fio_subscription_dup(s),
           fio_letter_dup(l));
-    }
   }
   fio_letter_free(l);
   fio_channel_free(ch);
 }
 
+/* delivers a letter to all of a channel's
+ * subscribers */
+FIO_SFUNC void fio___channel_deliver_task(void *ch_, void *l_) {
+  fio_channel_s *ch = (fio_channel_s *)ch_;
+  fio___channel_deliver_from(ch,
+                             (fio_letter_s *)l_,
+                             ch->subscriptions.next);
+}
+
 /* *****************************************************************************
 
 
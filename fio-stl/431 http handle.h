@@ -57,9 +57,42 @@ HTTP Handle Settings
 #define FIO_HTTP_BODY_RAM_LIMIT (1 << 17)
 #endif
 
-#ifndef FIO_HTTP_CACHE_LIMIT
-/** Each of the HTTP String Caches will be limited to this String count. */
-#define FIO_HTTP_CACHE_LIMIT 0 /* ((1UL << 6) + (1UL << 5)) */
+#ifndef FIO_HTTP_FORM_HEADER_LIMIT
+/**
+ * The maximum length of a `multipart/form-data` part's header block (or of a
+ * `x-www-form-urlencoded` field name) accepted by the form parser.
+ */
+#define FIO_HTTP_FORM_HEADER_LIMIT (1UL << 12)
+#endif
+
+#ifndef FIO_HTTP_ARENA_BLOCK_SIZE
+/**
+ * Per-request strings (method, path, headers, cookies, etc') are stored in a
+ * per-handle arena, allocated in blocks of this size (larger allocations
+ * receive a dedicated block).
+ */
+#define FIO_HTTP_ARENA_BLOCK_SIZE (1UL << 12)
+#endif
+
+#ifndef FIO_HTTP_MAX_PARAMS
+/** The maximum number of path parameters stored by an HTTP handle. */
+#define FIO_HTTP_MAX_PARAMS 8
+#endif
+
+#ifndef FIO_HTTP_LOG_BUFFER_SIZE
+/**
+ * HTTP log lines are collected in a buffer (of this size) and written to
+ * STDOUT in batches by a background thread, so logging never waits on STDOUT.
+ */
+#define FIO_HTTP_LOG_BUFFER_SIZE (1UL << 16)
+#endif
+
+#ifndef FIO_HTTP_LOG_DROP_WHEN_FULL
+/**
+ * If true, HTTP log lines are dropped (and counted) when the log buffer is
+ * full. Otherwise, the logging thread waits until the buffer was written.
+ */
+#define FIO_HTTP_LOG_DROP_WHEN_FULL 0
 #endif
 
 #ifndef FIO_HTTP_CACHE_STR_MAX_LEN
@@ -67,11 +100,6 @@ HTTP Handle Settings
 #define FIO_HTTP_CACHE_STR_MAX_LEN (1 << 12)
 #endif
 
-#ifndef FIO_HTTP_CACHE_USES_MUTEX
-/** The HTTP cache will use a mutex to allow headers to be set concurrently. */
-#define FIO_HTTP_CACHE_USES_MUTEX 1
-#endif
-
 #ifndef FIO_HTTP_CACHE_STATIC
 /** Adds a static cache for common HTTP header names. */
 #define FIO_HTTP_CACHE_STATIC 1
@@ -86,6 +114,68 @@ HTTP Handle Settings
 #define FIO_HTTP_STATIC_FILE_COMPLETION 1
 #endif
 
+#ifndef FIO_HTTP_STATIC_CACHE_LIMIT
+/**
+ * The maximum number of resolved static files cached (in LRU order) by
+ * `fio_http_static_file_response`. Set to 0 to disable the cache.
+ */
+#define FIO_HTTP_STATIC_CACHE_LIMIT 1024
+#endif
+
+#ifndef FIO_HTTP_STATIC_CACHE_FILE_LIMIT
+/** Cached static files up to this size are also kept in memory. */
+#define FIO_HTTP_STATIC_CACHE_FILE_LIMIT (1 << 14)
+#endif
+
+#ifndef FIO_HTTP_STATIC_CACHE_TTL
+/** The number of seconds before a cached static file is re-validated. */
+#define FIO_HTTP_STATIC_CACHE_TTL 2
+#endif
+
+#ifndef FIO_HTTP_COMPRESS_MAX_LEN
+/** Longer responses are never compressed dynamically (see `HAVE_ZLIB`). */
+#define FIO_HTTP_COMPRESS_MAX_LEN (1UL << 22)
+#endif
+
+#ifndef FIO_HTTP_COMPRESS_TYPES
+/**
+ * The default (comma separated) list of compressible `content-type` values.
+ *
+ * Entries ending with `/` match a type prefix, entries starting with `+` match
+ * a suffix and other entries must match the type exactly (parameters, such as
+ * `charset`, are ignored).
+ */
+#define FIO_HTTP_COMPRESS_TYPES                                                \
+  "text/,application/json,application/xml,application/javascript,"            \
+  "application/x-javascript,image/svg+xml,+json,+xml"
+#endif
+
+#ifndef FIO_HTTP_COMPRESS_CACHE_LIMIT
+/**
+ * The maximum number of dynamically compressed responses cached (in LRU order,
+ * by ETag) for reuse. Set to 0 to disable the cache.
+ */
+#define FIO_HTTP_COMPRESS_CACHE_LIMIT 256
+#endif
+
+#ifndef FIO_HTTP_COMPRESS_CACHE_ITEM_LIMIT
+/** Compressed responses longer than this are never cached. */
+#define FIO_HTTP_COMPRESS_CACHE_ITEM_LIMIT (1UL << 18)
+#endif
+
+#ifndef FIO_HTTP_RESPONSE_CACHE_LIMIT
+/**
+ * The maximum number of responses kept (in LRU order) by the response cache
+ * (see `fio_http_cache`). Set to 0 to disable the cache.
+ */
+#define FIO_HTTP_RESPONSE_CACHE_LIMIT 1024
+#endif
+
+#ifndef FIO_HTTP_RESPONSE_CACHE_ITEM_LIMIT
+/** Responses with a longer body are never stored by the response cache. */
+#define FIO_HTTP_RESPONSE_CACHE_ITEM_LIMIT (1UL << 18)
+#endif
+
 /* *****************************************************************************
 HTTP Handle Type
 ***************************************************************************** */
@@ -124,9 +214,30 @@ SFUNC fio_http_s *fio_http_dup(fio_http_s *);
 /** Destroyed the HTTP handle object, freeing all allocated resources. */
 SFUNC fio_http_s *fio_http_destroy(fio_http_s *h);
 
+/**
+ * Resets the HTTP handle for reuse (i.e., for the next keep-alive request).
+ *
+ * Behaves like `fio_http_destroy`, except that the header and cookie maps,
+ * the request arena and (small) body buffers retain their capacity.
+ *
+ * Must only be called by the handle's sole owner.
+ */
+SFUNC fio_http_s *fio_http_reset(fio_http_s *h);
+
 /** Collects an updated timestamp for logging purposes. */
 SFUNC void fio_http_start_time_set(fio_http_s *);
 
+/**
+ * Allocates memory that remains valid until the HTTP handle is destroyed.
+ *
+ * The memory is 16 byte aligned and can't be freed or reallocated. It is
+ * released, together with all other request data, when the handle is
+ * destroyed, which makes it ideal for short lived per-request temporaries.
+ *
+ * Returns NULL on error.
+ */
+SFUNC void *fio_http_arena_alloc(fio_http_s *h, size_t len);
+
 /* *****************************************************************************
 Opaque User and Controller Data
 ***************************************************************************** */
@@ -256,6 +367,172 @@ SFUNC void fio_http_body_expect(fio_http_s *, size_t expected_length);
 /** Writes `data` to the body (payload) associated with the HTTP handle. */
 SFUNC void fio_http_body_write(fio_http_s *, const void *data, size_t len);
 
+/* *****************************************************************************
+Form Data (`multipart/form-data` and `application/x-www-form-urlencoded`)
+***************************************************************************** */
+
+/** Form parser callbacks - a non-zero return value stops parsing (an error). */
+typedef struct fio_http_form_settings_s {
+  /**
+   * Called when a form field starts.
+   *
+   * `filename` and `content_type` are only set by `multipart/form-data` parts
+   * (`filename` is set for file uploads).
+   */
+  int (*on_field)(fio_buf_info_s name,
+                  fio_buf_info_s filename,
+                  fio_buf_info_s content_type,
+                  void *udata);
+  /** Called with (a chunk of) the field's value, may be called repeatedly. */
+  int (*on_data)(fio_buf_info_s data, void *udata);
+  /** Called once the field's value ended. */
+  int (*on_field_end)(void *udata);
+  /** Opaque user data passed along to the callbacks. */
+  void *udata;
+} fio_http_form_settings_s;
+
+/** The incremental form parser (all fields are private). */
+typedef struct fio_http_form_s {
+  fio_http_form_settings_s settings;
+  /* unconsumed data (an incomplete header / boundary), a `fio_bstr` */
+  char *carry;
+  uint8_t type;
+  uint8_t state;
+  uint8_t delim_len;
+  /* the multipart delimiter: CRLF + "--" + boundary (up to 70 bytes) */
+  char delim[77];
+} fio_http_form_s;
+
+/**
+ * Initializes a form parser using the `content-type` header value.
+ *
+ * Returns -1 (and the parser can be ignored) if the content type isn't a
+ * supported form type.
+ */
+SFUNC int fio_http_form_init(fio_http_form_s *p,
+                             fio_str_info_s content_type,
+                             fio_http_form_settings_s settings);
+
+/**
+ * Parses a chunk of form data, calling the callbacks (in order) as fields are
+ * found. Chunks can be of any length (i.e., as received by `on_body_chunk`).
+ *
+ * Names, values and headers are passed to the callbacks as views into `data`
+ * (they are valid only during the callback). Only incomplete tails (a partial
+ * part header or boundary) are copied and kept until the next call.
+ *
+ * Note: `x-www-form-urlencoded` data is decoded in place (`data` is altered).
+ *
+ * Returns -1 on error.
+ */
+SFUNC int fio_http_form_parse(fio_http_form_s *p, fio_buf_info_s data);
+
+/**
+ * Completes parsing and frees the parser's resources (must always be called).
+ *
+ * Returns -1 if the form data was incomplete or an error occurred.
+ */
+SFUNC int fio_http_form_finish(fio_http_form_s *p);
+
+/**
+ * Parses the HTTP handle's body as form data in a single pass (files are read
+ * in blocks when the body was stored in a temporary file).
+ *
+ * Note: `x-www-form-urlencoded` data is decoded in place.
+ *
+ * Returns -1 on error or if the body isn't a supported form type.
+ */
+SFUNC int fio_http_body_parse_form(fio_http_s *, fio_http_form_settings_s);
+
+/* *****************************************************************************
+Path Parameters (i.e., captured by a router)
+***************************************************************************** */
+
+/**
+ * Gets the value of the named path parameter, or an empty value if missing.
+ *
+ * Path parameters are usually set by the HTTP router (see `fio_http_route`)
+ * when a route pattern contains `:name` or `*name` segments.
+ */
+SFUNC fio_str_info_s fio_http_param(fio_http_s *, fio_str_info_s name);
+
+/**
+ * Adds a path parameter (up to `FIO_HTTP_MAX_PARAMS` parameters).
+ *
+ * The data is NOT copied - both `name` and `value` must remain valid for as
+ * long as the handle (or until `fio_http_reset` is called).
+ *
+ * Returns -1 if there's no room for more parameters.
+ */
+SFUNC int fio_http_param_add(fio_http_s *,
+                             fio_str_info_s name,
+                             fio_str_info_s value);
+
+/**
+ * Iterates through all path parameters (in path order).
+ *
+ * A non-zero return will stop iteration. Returns the number of parameters
+ * (if `callback` is NULL) or the number of parameters visited.
+ */
+SFUNC size_t fio_http_param_each(fio_http_s *,
+                                 int (*callback)(fio_http_s *,
+                                                 fio_str_info_s name,
+                                                 fio_str_info_s value,
+                                                 void *udata),
+                                 void *udata);
+
+/* *****************************************************************************
+Response (Micro) Cache
+***************************************************************************** */
+
+/** Arguments for the `fio_http_cache` function. */
+typedef struct {
+  /** The time (in seconds) a response is reused (required). */
+  uint32_t ttl;
+  /**
+   * Request header names (comma separated, lower case) that are part of the
+   * cache key, in addition to the request's host, path and query.
+   */
+  fio_str_info_s vary;
+  /**
+   * Called (possibly on a different thread) once a request that was waiting
+   * for a concurrent request to the same resource may continue.
+   *
+   * If `fio_http_is_finished(h)`, the response was sent from the cache.
+   * Otherwise, the concurrent request couldn't be cached and the request
+   * should be handled as usual.
+   *
+   * The callback takes ownership of the handle (which must be freed).
+   */
+  void (*on_release)(fio_http_s *h, void *udata);
+  /** Opaque user data for the `on_release` callback. */
+  void *udata;
+} fio_http_cache_args_s;
+
+/**
+ * Attempts to answer a `GET` request from the response (micro) cache.
+ *
+ * Returns 0 if the request was handled by the cache, in which case
+ * `on_release` is called (possibly before the function returns) and the
+ * ownership of the handle passes to the callback. This happens when:
+ *
+ * - A fresh response was cached - the response is sent from the cache (the
+ *   body is shared, not copied).
+ *
+ * - A concurrent request to the same resource is being handled - the request
+ *   waits for the other response, so a single handler runs (coalescing).
+ *
+ * Returns -1 if the request should be handled as usual. If the request is
+ * cacheable, its response is stored by the cache when it is sent (a `200`
+ * response with a body that's written at once, that sets no cookies and that
+ * isn't marked as `private` / `no-store` / `no-cache`).
+ *
+ * The cache key includes the `host` header. Requests with an `authorization`
+ * or `cookie` header are only answered by (and only store) responses that
+ * are explicitly marked as `public` (`cache-control: public`).
+ */
+SFUNC int fio_http_cache(fio_http_s *h, fio_http_cache_args_s args);
+
 /* *****************************************************************************
 Cookies
 ***************************************************************************** */
@@ -439,9 +716,14 @@ typedef struct fio_http_write_args_s {
   size_t len;
   /** The offset at which writing should begin. */
   size_t offset;
-  /** If streaming a file, set this value. The file is always closed. */
+  /** If streaming a file, set this value. The file is closed once sent. */
   int fd;
-  /** If the data is a buffer, this callback may be set to free it once sent. */
+  /**
+   * If the data is a buffer, this callback may be set to free it once sent.
+   *
+   * If the data is a file and `dealloc` is set, it is called (instead of
+   * `close`) with the file descriptor cast to a pointer, i.e., for shared files.
+   */
   void (*dealloc)(void *);
   /** If the data is a buffer / a file - should it be copied? */
   int copy;
@@ -464,6 +746,27 @@ SFUNC void fio_http_write(fio_http_s *, fio_http_write_args_s args);
   fio_http_write(http_handle, (fio_http_write_args_s){__VA_ARGS__})
 #define fio_http_finish(http_handle) fio_http_write(http_handle, .finish = 1)
 
+/**
+ * Allows the response body to be compressed (gzip / deflate) on the fly.
+ *
+ * Responses are compressed if the client's `accept-encoding` allows it, the
+ * `content-type` is listed in `types` and the body is at least `min_len` bytes
+ * long. Streamed responses are always compressed. File backed responses are
+ * never compressed (static files may use pre-compressed variants instead).
+ *
+ * `types` is a comma separated list (see `FIO_HTTP_COMPRESS_TYPES`, used when
+ * empty). It isn't copied and must remain valid while the handle is used.
+ *
+ * A compressed response's `etag` header is marked with the encoding (i.e.,
+ * `"v1"` becomes `"v1-gzip"`). Compressed responses with an `etag` header are
+ * cached and reused.
+ *
+ * Set `min_len` to zero to disable. Requires zlib (`HAVE_ZLIB`).
+ */
+SFUNC void fio_http_compress_set(fio_http_s *h,
+                                 size_t min_len,
+                                 fio_str_info_s types);
+
 /* *****************************************************************************
 WebSocket / SSE Helpers
 ***************************************************************************** */
@@ -625,9 +928,16 @@ SFUNC int fio_http_static_file_response(fio_http_s *h,
 /** Returns a human readable string related to the HTTP status number. */
 SFUNC fio_str_info_s fio_http_status2str(size_t status);
 
-/** Logs an HTTP (response) to STDOUT. */
+/**
+ * Logs an HTTP (response) to STDOUT.
+ *
+ * Log lines are buffered and written by a background thread (in batches).
+ */
 SFUNC void fio_http_write_log(fio_http_s *h, fio_buf_info_s peer_addr);
 
+/** Returns the number of log lines dropped because the log buffer was full. */
+SFUNC size_t fio_http_log_dropped(void);
+
 /* *****************************************************************************
 The HTTP Controller
 ***************************************************************************** */
@@ -773,23 +1083,14 @@ HTTP Handle Implementation - possibly externed functions.
 ***************************************************************************** */
 #if defined(FIO_EXTERN_COMPLETE) || !defined(FIO_EXTERN)
 
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+
 /* *****************************************************************************
-Helpers - memory allocation & logging time collection
+Helpers - logging time collection
 ***************************************************************************** */
 
-FIO___LEAK_COUNTER_DEF(http___keystr_allocator)
-
-FIO_SFUNC void fio___http_keystr_free(void *ptr, size_t len) {
-  FIO_MEM_FREE_(ptr, len);
-  if (ptr)
-    FIO___LEAK_COUNTER_ON_FREE(http___keystr_allocator);
-  (void)len; /* if unused */
-}
-FIO_SFUNC void *fio___http_keystr_alloc(size_t capa) {
-  FIO___LEAK_COUNTER_ON_ALLOC(http___keystr_allocator);
-  return FIO_MEM_REALLOC_(NULL, 0, capa, 0);
-}
-
 #if FIO_HTTP_EXACT_LOGGING
 #define FIO___HTTP_TIME_DIV  1000000
 #define FIO___HTTP_TIME_UNIT "us"
@@ -819,22 +1120,9 @@ FIO_SFUNC fio_str_info_s fio_http_date(uint64_t now_in_seconds) {
 
 #define FIO___RECURSIVE_INCLUDE 1
 /* *****************************************************************************
-String Cache
+Static Header Name Cache
 ***************************************************************************** */
 
-#define FIO_MAP_NAME fio___http_str_cache
-#define FIO_MAP_LRU  FIO_HTTP_CACHE_LIMIT
-#define FIO_MAP_KEY_BSTR
-#include FIO_INCLUDE_FILE
-
-static struct {
-  fio___http_str_cache_s cache;
-  FIO___LOCK_TYPE lock;
-} FIO___HTTP_STRING_CACHE[2] = {{.lock = FIO___LOCK_INIT},
-                                {.lock = FIO___LOCK_INIT}};
-#define FIO___HTTP_STR_CACHE_COOKIE 0
-#define FIO___HTTP_STR_CACHE_VALUE  1
-
 #if FIO_HTTP_CACHE_STATIC
 
 #define FIO___HTTP_STATIC_CACHE_MASK       127
@@ -984,181 +1272,407 @@ static char *fio___http_str_cached_static(char *str, size_t len) {
 #define fio___http_str_cached_init() (void)0
 #endif /* FIO_HTTP_CACHE_STATIC */
 
-FIO_IFUNC char *fio___http_str_cached_inner(size_t group,
-                                            uint64_t hash,
-                                            fio_str_info_s s) {
-#if !FIO_HTTP_CACHE_LIMIT
-  return fio_bstr_write(NULL, s.buf, s.len);
-#endif
-  fio_str_info_s cached;
-  hash ^= (uint64_t)(uintptr_t)fio_http_new;
-#if FIO_HTTP_CACHE_USES_MUTEX
-  FIO___LOCK_LOCK(FIO___HTTP_STRING_CACHE[group].lock);
-#endif
-  cached =
-      fio___http_str_cache_set_if_missing(&FIO___HTTP_STRING_CACHE[group].cache,
-                                          hash,
-                                          s);
-#if FIO_HTTP_CACHE_USES_MUTEX
-  FIO___LOCK_UNLOCK(FIO___HTTP_STRING_CACHE[group].lock);
-#endif
-  return fio_bstr_copy(cached.buf);
+/* *****************************************************************************
+Per-Handle Arena (request lifetime memory)
+***************************************************************************** */
+
+typedef struct fio___http_arena_block_s fio___http_arena_block_s;
+struct fio___http_arena_block_s {
+  fio___http_arena_block_s *next;
+  size_t capa;
+  size_t len;
+  char buf[];
+};
+
+/** A bump allocator - memory is only released when the arena is destroyed. */
+typedef struct {
+  fio___http_arena_block_s *head;
+} fio___http_arena_s;
+
+FIO___LEAK_COUNTER_DEF(http___arena_block)
+
+FIO_SFUNC fio___http_arena_block_s *fio___http_arena_block_new(size_t capa) {
+  fio___http_arena_block_s *b = (fio___http_arena_block_s *)
+      FIO_MEM_REALLOC_(NULL, 0, sizeof(*b) + capa, 0);
+  if (!b)
+    return b;
+  FIO___LEAK_COUNTER_ON_ALLOC(http___arena_block);
+  *b = (fio___http_arena_block_s){.capa = capa};
+  return b;
 }
-FIO_IFUNC char *fio___http_str_cached(size_t group, fio_str_info_s s) {
-#if !FIO_HTTP_CACHE_LIMIT
-  return fio_bstr_write(NULL, s.buf, s.len);
-#endif
-  if (!s.len)
+
+/** Carves a 16 byte aligned memory region from the block, if possible. */
+FIO_IFUNC void *fio___http_arena_block_carve(fio___http_arena_block_s *b,
+                                             size_t len) {
+  uintptr_t start = ((uintptr_t)(b->buf + b->len) + 15) & (~(uintptr_t)15);
+  size_t end = (size_t)(start - (uintptr_t)b->buf) + len;
+  if (end > b->capa)
     return NULL;
-  if (s.len > FIO_HTTP_CACHE_STR_MAX_LEN)
-    goto avoid_caching;
-  return fio___http_str_cached_inner(group, fio_risky_hash(s.buf, s.len, 0), s);
-avoid_caching:
-  return fio_bstr_write(NULL, s.buf, s.len);
+  b->len = end;
+  return (void *)start;
 }
 
-FIO_IFUNC char *fio___http_str_cached_with_static(fio_str_info_s s) {
-#if FIO_HTTP_CACHE_STATIC
-  char *tmp;
-  if (!s.len)
+/** Allocates memory that remains valid until the arena is destroyed. */
+FIO_SFUNC void *fio___http_arena_alloc(fio___http_arena_s *a, size_t len) {
+  void *r;
+  fio___http_arena_block_s *b = a->head;
+  if (b && (r = fio___http_arena_block_carve(b, len)))
+    return r;
+  if (len > (FIO_HTTP_ARENA_BLOCK_SIZE >> 2)) {
+    /* large allocations get a dedicated block, keeping the head's leftovers */
+    b = fio___http_arena_block_new(len + 15);
+    if (!b)
+      return NULL;
+    if (a->head) {
+      b->next = a->head->next;
+      a->head->next = b;
+    } else
+      a->head = b;
+    return fio___http_arena_block_carve(b, len);
+  }
+  b = fio___http_arena_block_new(FIO_HTTP_ARENA_BLOCK_SIZE -
+                                 sizeof(fio___http_arena_block_s));
+  if (!b)
     return NULL;
-  if (s.len > FIO_HTTP_CACHE_STR_MAX_LEN)
-    goto skip_cache_test;
-  tmp = fio___http_str_cached_static(s.buf, s.len);
-  if (tmp)
-    return fio_bstr_copy(tmp);
-skip_cache_test:
-#endif /* FIO_HTTP_CACHE_STATIC */
-  return fio_bstr_write(NULL, s.buf, s.len);
+  b->next = a->head;
+  a->head = b;
+  return fio___http_arena_block_carve(b, len);
+}
+
+/** Copies a String to the arena, adding a NUL terminator. */
+FIO_IFUNC char *fio___http_arena_strdup(fio___http_arena_s *a,
+                                        fio_str_info_s s) {
+  char *r = (char *)fio___http_arena_alloc(a, s.len + 1);
+  if (!r)
+    return r;
+  if (s.len)
+    FIO_MEMCPY(r, s.buf, s.len);
+  r[s.len] = 0;
+  return r;
+}
+
+/** Short Key Strings are embedded, longer Strings are copied to the arena. */
+FIO_IFUNC fio_keystr_s fio___http_arena_keystr(fio___http_arena_s *a,
+                                               fio_str_info_s s) {
+  fio_keystr_s r = {0};
+  if (!s.buf || !s.len || ((uint64_t)s.len >> 32))
+    return r;
+  if (s.len + 1 < sizeof(r))
+    return fio_keystr(s.buf, (uint32_t)s.len);
+  r.buf = fio___http_arena_strdup(a, s);
+  if (r.buf)
+    r.len = (uint32_t)s.len; /* never passed to `fio_keystr_destroy` */
+  return r;
+}
+
+/** Releases all but one (default sized) block, which is kept for reuse. */
+FIO_SFUNC void fio___http_arena_reset(fio___http_arena_s *a) {
+  fio___http_arena_block_s *keep = NULL;
+  while (a->head) {
+    fio___http_arena_block_s *b = a->head;
+    a->head = b->next;
+    if (!keep &&
+        b->capa == FIO_HTTP_ARENA_BLOCK_SIZE - sizeof(fio___http_arena_block_s)) {
+      keep = b;
+      continue;
+    }
+    FIO_MEM_FREE_(b, sizeof(*b) + b->capa);
+    FIO___LEAK_COUNTER_ON_FREE(http___arena_block);
+  }
+  if (keep) {
+    keep->next = NULL;
+    keep->len = 0;
+  }
+  a->head = keep;
+}
+
+/** Releases all the memory owned by the arena. */
+FIO_SFUNC void fio___http_arena_destroy(fio___http_arena_s *a) {
+  while (a->head) {
+    fio___http_arena_block_s *b = a->head;
+    a->head = b->next;
+    FIO_MEM_FREE_(b, sizeof(*b) + b->capa);
+    FIO___LEAK_COUNTER_ON_FREE(http___arena_block);
+  }
 }
 
 /* *****************************************************************************
 Headers Maps
+
+Header names and values are stored in the handle's arena (or point to the
+static header name cache), so no per-header allocations are performed.
+
+Entries are kept in insertion order. The first entry for each name (the "head")
+is indexed by a compact open addressing index (stored after the entries) and
+any additional values for the same name are linked to it.
 ***************************************************************************** */
 
-#define FIO_ARRAY_NAME              fio___http_sary
-#define FIO_ARRAY_TYPE              char *
-#define FIO_ARRAY_TYPE_DESTROY(obj) fio_bstr_free(obj)
-
-#define FIO_MAP_NAME                 fio___http_hmap
-#define FIO_MAP_KEY                  fio_str_info_s
-#define FIO_MAP_KEY_INTERNAL         char *
-#define FIO_MAP_KEY_FROM_INTERNAL(k) fio_bstr_info((k))
-#define FIO_MAP_KEY_CMP(a, b)        fio_bstr_is_eq2info((a), (b))
-#define FIO_MAP_KEY_DESTROY(key)     fio_bstr_free((key))
-#define FIO_MAP_KEY_COPY(dest, src)                                            \
-  (dest) = fio___http_str_cached_with_static((src))
-#define FIO_MAP_KEY_DISCARD(key)
-#define FIO_MAP_VALUE fio___http_sary_s
-#define FIO_MAP_VALUE_COPY(a, b)                                               \
-  do {                                                                         \
-    (a) = (fio___http_sary_s)FIO_ARRAY_INIT;                                   \
-    (void)(b);                                                                 \
-  } while (0) /*no-op*/
-#define FIO_MAP_VALUE_DESTROY(o) fio___http_sary_destroy(&(o))
-#define FIO_MAP_HASH_FN(k)                                                     \
-  fio_risky_hash((k).buf, (k).len, (uint64_t)(uintptr_t)fio___http_sary_destroy)
-#include FIO_INCLUDE_FILE
+typedef struct {
+  char *name;         /* NULL for non-head entries */
+  char *value;        /* NUL terminated */
+  uint32_t name_len;  /* name length */
+  uint32_t value_len; /* value length */
+  uint32_t hash;      /* name hash */
+  uint32_t next;      /* next value for the same name (index + 1) */
+  uint32_t last;      /* head entries: last value for the name (index + 1) */
+  uint32_t count;     /* head entries: number of values (0 == removed) */
+} fio___http_hentry_s;
+
+typedef struct {
+  fio___http_hentry_s *ary; /* `capa` entries followed by `capa * 2` slots */
+  uint32_t len;             /* entries used */
+  uint32_t capa;            /* entry capacity (a power of 2) */
+  uint32_t count;           /* number of header names with values */
+} fio___http_hmap_s;
+
+#define FIO___HTTP_HMAP_MIN_CAPA 16
+#define FIO___HTTP_HMAP_MEM_SIZE(capa)                                         \
+  ((size_t)(capa) * (sizeof(fio___http_hentry_s) + (sizeof(uint32_t) << 1)))
+
+FIO___LEAK_COUNTER_DEF(http___hmap)
+
+FIO_IFUNC uint32_t fio___http_hmap_hash(fio_str_info_s key) {
+  return (uint32_t)fio_risky_hash(key.buf,
+                                  key.len,
+                                  (uint64_t)(uintptr_t)fio___http_arena_alloc);
+}
+
+/** Returns the index slot for the header name (zero if name is missing). */
+FIO_IFUNC uint32_t *fio___http_hmap_slot(fio___http_hmap_s *m,
+                                         fio_str_info_s key,
+                                         uint32_t hash) {
+  uint32_t *imap = (uint32_t *)(m->ary + m->capa);
+  const uint32_t mask = (m->capa << 1) - 1;
+  for (uint32_t i = hash;; ++i) { /* load factor never exceeds 50% */
+    uint32_t *slot = imap + (i & mask);
+    if (!slot[0])
+      return slot;
+    fio___http_hentry_s *e = m->ary + (slot[0] - 1);
+    if (e->hash == hash && e->name_len == key.len &&
+        (e->name == key.buf || !FIO_MEMCMP(e->name, key.buf, key.len)))
+      return slot;
+  }
+}
+
+/** Doubles the map's capacity and rebuilds the index. */
+FIO_SFUNC int fio___http_hmap_grow(fio___http_hmap_s *m) {
+  const uint32_t capa = m->capa ? (m->capa << 1) : FIO___HTTP_HMAP_MIN_CAPA;
+  fio___http_hentry_s *ary = (fio___http_hentry_s *)
+      FIO_MEM_REALLOC_(m->ary,
+                       FIO___HTTP_HMAP_MEM_SIZE(m->capa),
+                       FIO___HTTP_HMAP_MEM_SIZE(capa),
+                       sizeof(*ary) * m->len);
+  if (!ary)
+    return -1;
+  if (!m->ary)
+    FIO___LEAK_COUNTER_ON_ALLOC(http___hmap);
+  m->ary = ary;
+  m->capa = capa;
+  FIO_MEMSET(ary + capa, 0, sizeof(uint32_t) * (capa << 1));
+  for (uint32_t i = 0; i < m->len; ++i) {
+    if (!ary[i].name)
+      continue;
+    fio_str_info_s key = FIO_STR_INFO2(ary[i].name, ary[i].name_len);
+    fio___http_hmap_slot(m, key, ary[i].hash)[0] = i + 1;
+  }
+  return 0;
+}
+
+FIO_IFUNC void fio___http_hmap_destroy(fio___http_hmap_s *m) {
+  if (m->ary) {
+    FIO_MEM_FREE_(m->ary, FIO___HTTP_HMAP_MEM_SIZE(m->capa));
+    FIO___LEAK_COUNTER_ON_FREE(http___hmap);
+  }
+  *m = (fio___http_hmap_s){0};
+}
+
+/** Removes all headers, keeping the map's capacity. */
+FIO_IFUNC void fio___http_hmap_reset(fio___http_hmap_s *m) {
+  if (!m->ary)
+    return;
+  m->len = 0;
+  m->count = 0;
+  FIO_MEMSET(m->ary + m->capa, 0, sizeof(uint32_t) * (m->capa << 1));
+}
+
+FIO_IFUNC size_t fio___http_hmap_count(fio___http_hmap_s *m) {
+  return m->count;
+}
+
+/** Returns the head entry for the header name, or NULL if it has no value. */
+FIO_IFUNC fio___http_hentry_s *fio___http_hmap_get(fio___http_hmap_s *m,
+                                                   fio_str_info_s key) {
+  if (!m->capa || !key.buf || !key.len)
+    return NULL;
+  uint32_t *slot = fio___http_hmap_slot(m, key, fio___http_hmap_hash(key));
+  if (!slot[0] || !m->ary[slot[0] - 1].count)
+    return NULL;
+  return m->ary + (slot[0] - 1);
+}
+
+/** Header names point to the static name cache when possible. */
+FIO_IFUNC char *fio___http_hmap_name(fio___http_arena_s *a,
+                                     fio_str_info_s key) {
+#if FIO_HTTP_CACHE_STATIC
+  if (key.len <= FIO_HTTP_CACHE_STR_MAX_LEN) {
+    char *tmp = fio___http_str_cached_static(key.buf, key.len);
+    if (tmp)
+      return tmp;
+  }
+#endif /* FIO_HTTP_CACHE_STATIC */
+  return fio___http_arena_strdup(a, key);
+}
 
 /** set `add` to positive to add multiple values or negative to overwrite. */
-FIO_IFUNC fio_str_info_s fio___http_hmap_set2(fio___http_hmap_s *map,
+FIO_SFUNC fio_str_info_s fio___http_hmap_set2(fio___http_hmap_s *m,
+                                              fio___http_arena_s *a,
                                               fio_str_info_s key,
                                               fio_str_info_s val,
                                               int add) {
   fio_str_info_s r = {0};
-  fio___http_sary_s *o;
-  if (!key.buf || !key.len || !map)
+  uint32_t *slot;
+  fio___http_hentry_s *head, *e;
+  char *value;
+  if (!key.buf || !key.len || !m)
     return r;
+  const uint32_t hash = fio___http_hmap_hash(key);
   if (!val.buf || !val.len)
     goto remove_key;
-  o = fio___http_hmap_node2val_ptr(fio___http_hmap_get_ptr(map, key));
-  if (!o) {
-    fio___http_sary_s va = {0};
-    o = fio___http_hmap_node2val_ptr(
-        fio___http_hmap_set_ptr(map, key, va, NULL, 1));
-    add = 1;
-  }
-  if (FIO_UNLIKELY(!o)) {
-    FIO_LOG_ERROR("Couldn't add value to header: %.*s:%.*s",
-                  (int)key.len,
-                  key.buf,
-                  (int)val.len,
-                  val.buf);
-    return r;
+  if (FIO_UNLIKELY(((uint64_t)key.len | (uint64_t)val.len) >> 32))
+    goto error;
+  if (m->len == m->capa && fio___http_hmap_grow(m))
+    goto error;
+  slot = fio___http_hmap_slot(m, key, hash);
+  if (!slot[0]) { /* new header name */
+    e = m->ary + m->len;
+    *e = (fio___http_hentry_s){
+        .name = fio___http_hmap_name(a, key),
+        .value = fio___http_arena_strdup(a, val),
+        .name_len = (uint32_t)key.len,
+        .value_len = (uint32_t)val.len,
+        .hash = hash,
+        .last = m->len + 1,
+        .count = 1,
+    };
+    if (!e->name || !e->value)
+      goto error;
+    slot[0] = ++m->len;
+    ++m->count;
+    return FIO_STR_INFO2(e->value, e->value_len);
   }
-  if (add) {
-    if (add < 0) {
-      fio___http_sary_destroy(o);
-    }
-    r = fio_bstr_info(fio___http_str_cached(FIO___HTTP_STR_CACHE_VALUE, val));
-    fio___http_sary_push(o, r.buf);
-    return r;
+  head = m->ary + (slot[0] - 1);
+  if (head->count && !add) {
+    e = m->ary + (head->last - 1);
+    return FIO_STR_INFO2(e->value, e->value_len);
   }
-  r = fio_bstr_info(fio___http_sary_get(o, -1));
-  return r;
+  if (!(value = fio___http_arena_strdup(a, val)))
+    goto error;
+  if (!head->count || add < 0) { /* (re)set the first value, drop the rest */
+    m->count += !head->count;
+    head->value = value;
+    head->value_len = (uint32_t)val.len;
+    head->next = 0;
+    head->last = slot[0];
+    head->count = 1;
+    return FIO_STR_INFO2(head->value, head->value_len);
+  }
+  e = m->ary + m->len;
+  *e = (fio___http_hentry_s){
+      .value = value,
+      .value_len = (uint32_t)val.len,
+      .hash = hash,
+  };
+  m->ary[head->last - 1].next = ++m->len;
+  head->last = m->len;
+  ++head->count;
+  return FIO_STR_INFO2(e->value, e->value_len);
 
 remove_key:
-  if (add < 1)
-    fio___http_hmap_remove(map, key, NULL);
+  if (add > 0 || !m->capa)
+    return r;
+  slot = fio___http_hmap_slot(m, key, hash);
+  if (!slot[0])
+    return r;
+  head = m->ary + (slot[0] - 1);
+  m->count -= !!head->count;
+  head->next = 0;
+  head->last = slot[0];
+  head->count = 0;
+  return r;
+
+error:
+  FIO_LOG_ERROR("Couldn't add value to header: %.*s:%.*s",
+                (int)key.len,
+                key.buf,
+                (int)val.len,
+                val.buf);
   return r;
 }
 
-FIO_IFUNC fio_str_info_s fio___http_hmap_get2(fio___http_hmap_s *map,
+FIO_SFUNC fio_str_info_s fio___http_hmap_get2(fio___http_hmap_s *m,
                                               fio_str_info_s key,
                                               int32_t index) {
   fio_str_info_s r = {0};
-  fio___http_sary_s *a =
-      fio___http_hmap_node2val_ptr(fio___http_hmap_get_ptr(map, key));
-  if (!a)
-    return r;
-  const uint32_t count = fio___http_sary_count(a);
-  if (!count)
+  fio___http_hentry_s *e = fio___http_hmap_get(m, key);
+  if (!e)
     return r;
   if (index < 0) {
-    index += count;
+    index += e->count;
     if (index < 0)
       index = 0;
   }
-  if ((uint32_t)index >= count)
+  if ((uint32_t)index >= e->count)
     return r;
-  r = fio_bstr_info(fio___http_sary_get(a, index));
+  while (index--)
+    e = m->ary + (e->next - 1);
+  r = FIO_STR_INFO2(e->value, e->value_len);
   return r;
 }
 
+/** Loops over each of the values stored in a header's head entry. */
+#define FIO___HTTP_HMAP_EACH_VALUE(map, head, pos)                             \
+  for (fio___http_hentry_s *pos = (head); pos;                                 \
+       pos = pos->next ? ((map)->ary + (pos->next - 1)) : NULL)
+
 /* *****************************************************************************
 Header iteration Task
 ***************************************************************************** */
 
-typedef struct {
-  fio_http_s *h;
-  int (*callback)(fio_http_s *, fio_str_info_s, fio_str_info_s, void *);
-  void *udata;
-} fio___http_hmap_each_info_s;
-
-FIO_SFUNC int fio___http_h_each_task_wrapper(fio___http_hmap_each_s *e) {
-  fio___http_hmap_each_info_s *data = (fio___http_hmap_each_info_s *)(e->udata);
-  FIO_ARRAY_EACH(fio___http_sary, &e->value, pos) {
-    if (data->callback(data->h, e->key, fio_bstr_info(*pos), data->udata) == -1)
-      return -1;
+/** Iterates header names in insertion order (callbacks may edit the map). */
+FIO_SFUNC size_t fio___http_hmap_each(fio___http_hmap_s *m,
+                                      fio_http_s *h,
+                                      int (*callback)(fio_http_s *,
+                                                      fio_str_info_s,
+                                                      fio_str_info_s,
+                                                      void *),
+                                      void *udata) {
+  size_t r = 0;
+  for (uint32_t i = 0; i < m->len; ++i) {
+    if (!m->ary[i].name || !m->ary[i].count)
+      continue;
+    ++r;
+    for (uint32_t v = i + 1; v; v = m->ary[v - 1].next) {
+      fio_str_info_s name = FIO_STR_INFO2(m->ary[i].name, m->ary[i].name_len);
+      fio_str_info_s value =
+          FIO_STR_INFO2(m->ary[v - 1].value, m->ary[v - 1].value_len);
+      if (callback(h, name, value, udata) == -1)
+        return r;
+    }
   }
-  return 0;
+  return r;
 }
 
 /* *****************************************************************************
 Cookie Maps
+
+Cookie names and values are owned by the handle's arena (received cookies
+point into the arena stored `cookie` header), so the map only stores views.
 ***************************************************************************** */
 
-#define FIO_MAP_NAME                 fio___http_cmap /* cached names */
-#define FIO_MAP_KEY                  fio_str_info_s
-#define FIO_MAP_KEY_INTERNAL         char *
-#define FIO_MAP_KEY_FROM_INTERNAL(k) fio_bstr_info((k))
-#define FIO_MAP_KEY_CMP(a, b)        fio_bstr_is_eq2info((a), (b))
-#define FIO_MAP_KEY_DESTROY(key)     fio_bstr_free((key))
-#define FIO_MAP_KEY_COPY(dest, src)                                            \
-  (dest) = fio___http_str_cached(FIO___HTTP_STR_CACHE_COOKIE, (src))
-#define FIO_MAP_KEY_DISCARD(key)
-
-#define FIO_MAP_VALUE_BSTR /* not cached */
+#define FIO_MAP_NAME          fio___http_cmap
+#define FIO_MAP_KEY           fio_str_info_s
+#define FIO_MAP_KEY_CMP(a, b) FIO_STR_INFO_IS_EQ((a), (b))
+#define FIO_MAP_VALUE         fio_str_info_s
 #define FIO_MAP_HASH_FN(k)                                                     \
   fio_risky_hash((k).buf, (k).len, (uint64_t)(uintptr_t)fio___http_cmap_destroy)
 #include FIO_INCLUDE_FILE
@@ -1174,7 +1688,10 @@ FIO_SFUNC void fio___mock_c_write_body(fio_http_s *h,
     if (args.dealloc)
       args.dealloc((void *)args.buf);
   } else if (args.fd != -1) {
-    close(args.fd);
+    if (args.dealloc)
+      args.dealloc((void *)(intptr_t)args.fd);
+    else
+      close(args.fd);
   }
   (void)h;
 }
@@ -1216,6 +1733,16 @@ HTTP Handle Type
 
 FIO_SFUNC int fio____http_write_start(fio_http_s *, fio_http_write_args_s *);
 FIO_SFUNC int fio____http_write_cont(fio_http_s *, fio_http_write_args_s *);
+#if HAVE_ZLIB
+FIO_SFUNC void fio___http_compress_free(fio_http_s *);
+#else
+#define fio___http_compress_free(h)
+#endif
+#if FIO_HTTP_RESPONSE_CACHE_LIMIT
+FIO_SFUNC void fio___http_rcache_abort(fio_http_s *);
+#else
+#define fio___http_rcache_abort(h)
+#endif
 
 struct fio_http_s {
   void *udata;
@@ -1233,12 +1760,24 @@ struct fio_http_s {
   fio_keystr_s version;
   fio___http_hmap_s headers[2]; /* request, response */
   fio___http_cmap_s cookies[2]; /* read, write */
+  fio___http_arena_s arena; /* owns all per-request strings */
+  struct {
+    fio_buf_info_s name[FIO_HTTP_MAX_PARAMS];
+    fio_buf_info_s value[FIO_HTTP_MAX_PARAMS]; /* views, not copied */
+    size_t count;
+  } params;
   struct {
     char *buf;
     size_t len;
     size_t pos;
     int fd;
   } body;
+  struct {
+    size_t min;           /* zero == disabled */
+    void *z;              /* stream state for compressed (streamed) responses */
+    fio_str_info_s types; /* compressible types (not owned) */
+  } compress;
+  void *cache; /* a pending response cache entry, filled by this response */
 };
 
 #define HTTP_HDR_REQUEST(h)  (h->headers + 0)
@@ -1256,20 +1795,48 @@ SFUNC fio_http_s *fio_http_destroy(fio_http_s *h) {
     return h;
   h->controller->on_destroyed(h);
 
-  fio_keystr_destroy(&h->method, fio___http_keystr_free);
-  fio_keystr_destroy(&h->path, fio___http_keystr_free);
-  fio_keystr_destroy(&h->query, fio___http_keystr_free);
-  fio_keystr_destroy(&h->version, fio___http_keystr_free);
   fio___http_hmap_destroy(h->headers);
   fio___http_hmap_destroy(h->headers + 1);
   fio___http_cmap_destroy(h->cookies);
   fio___http_cmap_destroy(h->cookies + 1);
+  fio___http_arena_destroy(&h->arena);
   fio_bstr_free(h->body.buf);
+  fio___http_compress_free(h);
+  fio___http_rcache_abort(h);
   if (h->body.fd != -1)
     close(h->body.fd);
   FIO_REF_INIT(*h);
   return h;
 }
+
+SFUNC fio_http_s *fio_http_reset(fio_http_s *h) {
+  if (!h)
+    return h;
+  h->controller->on_destroyed(h);
+
+  fio___http_hmap_reset(h->headers);
+  fio___http_hmap_reset(h->headers + 1);
+  fio___http_cmap_clear(h->cookies);
+  fio___http_cmap_clear(h->cookies + 1);
+  fio___http_arena_reset(&h->arena);
+  fio___http_compress_free(h);
+  fio___http_rcache_abort(h);
+  if (h->body.fd != -1)
+    close(h->body.fd);
+  if (fio_bstr_len(h->body.buf) > FIO_HTTP_ARENA_BLOCK_SIZE) {
+    fio_bstr_free(h->body.buf); /* don't hoard large buffers */
+    h->body.buf = NULL;
+  }
+  fio_http_s old = *h;
+  FIO_REF_INIT(*h);
+  h->headers[0] = old.headers[0];
+  h->headers[1] = old.headers[1];
+  h->cookies[0] = old.cookies[0];
+  h->cookies[1] = old.cookies[1];
+  h->arena = old.arena;
+  h->body.buf = fio_bstr_len_set(old.body.buf, 0);
+  return h;
+}
 #include FIO_INCLUDE_FILE
 
 /** Create a new http_s handle. */
@@ -1286,6 +1853,12 @@ SFUNC void fio_http_start_time_set(fio_http_s *h) {
   h->received_at = fio_http_get_timestump();
 }
 
+/** Allocates memory that is released when the HTTP handle is destroyed. */
+SFUNC void *fio_http_arena_alloc(fio_http_s *h, size_t len) {
+  FIO_ASSERT_DEBUG(h, "NULL HTTP handler!");
+  return fio___http_arena_alloc(&h->arena, len);
+}
+
 #undef FIO___RECURSIVE_INCLUDE
 /* *****************************************************************************
 Simple Property Set / Get
@@ -1300,8 +1873,7 @@ Simple Property Set / Get
   fio_str_info_s fio_http_##property##_set(fio_http_s *h,                      \
                                            fio_str_info_s value) {             \
     FIO_ASSERT_DEBUG(h, "NULL HTTP handler!");                                 \
-    fio_keystr_destroy(&h->property, fio___http_keystr_free);                  \
-    h->property = fio_keystr_copy(value, fio___http_keystr_alloc);             \
+    h->property = fio___http_arena_keystr(&h->arena, value);                   \
     return fio_keystr_info(&h->property);                                      \
   }
 
@@ -1376,7 +1948,7 @@ Header Data Management
                                                       fio_str_info_s name,     \
                                                       fio_str_info_s value) {  \
     FIO_ASSERT_DEBUG(h, "NULL HTTP Handle!");                                  \
-    return fio___http_hmap_set2(headers(h), name, value, add_val);             \
+    return fio___http_hmap_set2(headers(h), &h->arena, name, value, add_val);  \
   }
 FIO___HTTP_HEADER_SET_FN(request, set, HTTP_HDR_REQUEST, -1)
 FIO___HTTP_HEADER_SET_FN(request, set_if_missing, HTTP_HDR_REQUEST, 0)
@@ -1409,13 +1981,7 @@ size_t fio_http_request_header_each(fio_http_s *h,
   FIO_ASSERT_DEBUG(h, "NULL HTTP Handle!");
   if (!callback)
     return fio___http_hmap_count(HTTP_HDR_REQUEST(h));
-  fio___http_hmap_each_info_s d = {.h = h,
-                                   .callback = callback,
-                                   .udata = udata};
-  return fio___http_hmap_each(HTTP_HDR_REQUEST(h),
-                              fio___http_h_each_task_wrapper,
-                              &d,
-                              0);
+  return fio___http_hmap_each(HTTP_HDR_REQUEST(h), h, callback, udata);
 }
 
 /** Iterates through all headers. A non-zero return will stop iteration. */
@@ -1426,20 +1992,63 @@ size_t fio_http_response_header_each(
   FIO_ASSERT_DEBUG(h, "NULL HTTP Handle!");
   if (!callback)
     return fio___http_hmap_count(HTTP_HDR_RESPONSE(h));
-  fio___http_hmap_each_info_s d = {.h = h,
-                                   .callback = callback,
-                                   .udata = udata};
-  return fio___http_hmap_each(HTTP_HDR_RESPONSE(h),
-                              fio___http_h_each_task_wrapper,
-                              &d,
-                              0);
+  return fio___http_hmap_each(HTTP_HDR_RESPONSE(h), h, callback, udata);
 }
 
 /* *****************************************************************************
-Cookies
+Path Parameters
 ***************************************************************************** */
 
-/** (Helper) HTTP Cookie Parser */
+/** Gets the value of the named path parameter, or an empty value. */
+SFUNC fio_str_info_s fio_http_param(fio_http_s *h, fio_str_info_s name) {
+  FIO_ASSERT_DEBUG(h, "NULL HTTP Handle!");
+  for (size_t i = 0; i < h->params.count; ++i) {
+    if (h->params.name[i].len == name.len &&
+        !FIO_MEMCMP(h->params.name[i].buf, name.buf, name.len))
+      return FIO_BUF2STR_INFO(h->params.value[i]);
+  }
+  return (fio_str_info_s){0};
+}
+
+/** Adds a path parameter (views, not copied). Returns -1 if full. */
+SFUNC int fio_http_param_add(fio_http_s *h,
+                             fio_str_info_s name,
+                             fio_str_info_s value) {
+  FIO_ASSERT_DEBUG(h, "NULL HTTP Handle!");
+  if (h->params.count == FIO_HTTP_MAX_PARAMS)
+    return -1;
+  h->params.name[h->params.count] = FIO_STR2BUF_INFO(name);
+  h->params.value[h->params.count] = FIO_STR2BUF_INFO(value);
+  ++h->params.count;
+  return 0;
+}
+
+/** Iterates through all path parameters. */
+SFUNC size_t fio_http_param_each(fio_http_s *h,
+                                 int (*callback)(fio_http_s *,
+                                                 fio_str_info_s name,
+                                                 fio_str_info_s value,
+                                                 void *udata),
+                                 void *udata) {
+  FIO_ASSERT_DEBUG(h, "NULL HTTP Handle!");
+  size_t i = 0;
+  if (!callback)
+    return h->params.count;
+  while (i < h->params.count) {
+    fio_str_info_s name = FIO_BUF2STR_INFO(h->params.name[i]);
+    fio_str_info_s value = FIO_BUF2STR_INFO(h->params.value[i]);
+    ++i;
+    if (callback(h, name, value, udata))
+      break;
+  }
+  return i;
+}
+
+/* *****************************************************************************
+Cookies
+***************************************************************************** */
+
+/** (Helper) HTTP Cookie Parser */
 FIO_IFUNC void fio___http_cookie_parse_cookie(fio_http_s *h, fio_str_info_s s) {
   /* loop and read Cookie: name=value; name2=value2; name3=value3 */
   while (s.len) {
@@ -1474,15 +2083,11 @@ FIO_IFUNC void fio___http_cookie_parse_cookie(fio_http_s *h, fio_str_info_s s) {
 
 /** (Helper) Parses all HTTP Cookies */
 FIO_SFUNC void fio___http_cookie_collect(fio_http_s *h) {
-  fio___http_sary_s *header = NULL;
-  {
-    header = fio___http_hmap_node2val_ptr(
-        fio___http_hmap_get_ptr(h->headers, FIO_STR_INFO1((char *)"cookie")));
-  }
-  if (!header)
-    return;
-  FIO_ARRAY_EACH(fio___http_sary, header, pos) {
-    fio___http_cookie_parse_cookie(h, fio_bstr_info(*pos));
+  fio___http_hentry_s *header =
+      fio___http_hmap_get(h->headers, FIO_STR_INFO2((char *)"cookie", 6));
+  FIO___HTTP_HMAP_EACH_VALUE(h->headers, header, pos) {
+    fio___http_cookie_parse_cookie(h,
+                                   FIO_STR_INFO2(pos->value, pos->value_len));
   }
   return;
 }
@@ -1670,12 +2275,19 @@ SFUNC int fio_http_cookie_set FIO_NOOP(fio_http_s *h,
   if (t.buf[t.len - 1] == ' ')
     --t.len;
 
+  /* copy strings to the arena */
+  cookie.name.buf = fio___http_arena_strdup(&h->arena, cookie.name);
+  cookie.value.buf = fio___http_arena_strdup(&h->arena, cookie.value);
+  fio_str_info_s old = t;
+  t.buf = fio___http_arena_strdup(&h->arena, old);
+  if (old.buf != tmp_buf)
+    FIO_STRING_FREE2(old);
+  if (!cookie.name.buf || !cookie.value.buf || !t.buf)
+    return -1;
   /* set the "write" cookie store data */
   fio___http_cmap_set(h->cookies + 1, cookie.name, t, NULL);
   /* set the "read" cookie store data */
   fio___http_cmap_set(h->cookies, cookie.name, cookie.value, NULL);
-  if (t.buf != tmp_buf)
-    FIO_STRING_FREE2(t);
   return 0;
 }
 
@@ -1849,49 +2461,1292 @@ SFUNC size_t fio_http_body_seek(fio_http_s *h, ssize_t pos) {
   return pos;
 }
 
-/** Reads up to `length` of data from the body, returns nothing on EOF. */
-SFUNC fio_str_info_s fio_http_body_read(fio_http_s *h, size_t length) {
-  fio_str_info_s r = {0};
-  if (h->body.pos == h->body.len)
-    return r;
-  if (h->body.pos + length > h->body.len)
-    length = h->body.len - h->body.pos;
-  r = ((h->body.fd == -1) ? fio___http_body_read_buf
-                          : fio___http_body_read_fd)(h, length);
-  return r;
+/** Reads up to `length` of data from the body, returns nothing on EOF. */
+SFUNC fio_str_info_s fio_http_body_read(fio_http_s *h, size_t length) {
+  fio_str_info_s r = {0};
+  if (h->body.pos == h->body.len)
+    return r;
+  if (h->body.pos + length > h->body.len)
+    length = h->body.len - h->body.pos;
+  r = ((h->body.fd == -1) ? fio___http_body_read_buf
+                          : fio___http_body_read_fd)(h, length);
+  return r;
+}
+
+/**
+ * Reads from the body until finding `token`, reaching `limit` or EOF.
+ *
+ * Note: `limit` is ignored if the
+ */
+SFUNC fio_str_info_s fio_http_body_read_until(fio_http_s *h,
+                                              char token,
+                                              size_t limit) {
+  fio_str_info_s r = {0};
+  if (h->body.pos == h->body.len)
+    return r;
+  if (!limit || (h->body.pos + limit) > h->body.len)
+    limit = h->body.len - h->body.pos;
+  r = ((h->body.fd == -1) ? fio___http_body_read_until_buf
+                          : fio___http_body_read_until_fd)(h, token, limit);
+  return r;
+}
+
+/** Allocates a body (payload) of (at least) the `expected_length`. */
+SFUNC void fio_http_body_expect(fio_http_s *h, size_t expected_length) {
+  ((h->body.fd == -1) ? fio___http_body_expect_buf
+                      : fio___http_body_expect_fd)(h, expected_length);
+}
+
+/** Writes `data` to the body (payload) associated with the HTTP handle. */
+SFUNC void fio_http_body_write(fio_http_s *h, const void *data, size_t len) {
+  if (!data || !len)
+    return;
+  ((h->body.fd == -1) ? fio___http_body_write_buf
+                      : fio___http_body_write_fd)(h, data, len);
+}
+
+/* *****************************************************************************
+Form Data Parsing
+***************************************************************************** */
+
+#define FIO___HTTP_FORM_URLENCODED 1
+#define FIO___HTTP_FORM_MULTIPART  2
+
+#define FIO___HTTP_FORM_START    0 /* multipart: first boundary, url: name */
+#define FIO___HTTP_FORM_PREAMBLE 1 /* skipped (multipart preamble) */
+#define FIO___HTTP_FORM_BOUNDARY 2 /* multipart: right after a boundary */
+#define FIO___HTTP_FORM_HEADERS  3 /* multipart: part headers */
+#define FIO___HTTP_FORM_DATA     4 /* field value */
+#define FIO___HTTP_FORM_DONE     5 /* multipart: final boundary found */
+#define FIO___HTTP_FORM_ERROR    6
+
+FIO_SFUNC int fio___http_form_on_field_noop(fio_buf_info_s n,
+                                            fio_buf_info_s f,
+                                            fio_buf_info_s t,
+                                            void *u) {
+  return ((void)n, (void)f, (void)t, (void)u, 0);
+}
+FIO_SFUNC int fio___http_form_on_data_noop(fio_buf_info_s d, void *u) {
+  return ((void)d, (void)u, 0);
+}
+FIO_SFUNC int fio___http_form_on_field_end_noop(void *u) {
+  return ((void)u, 0);
+}
+
+/* case insensitive prefix test (`lower` must be lower case) */
+FIO_SFUNC int fio___http_form_is_prefix(char *pos,
+                                        char *end,
+                                        const char *lower,
+                                        size_t len) {
+  if ((size_t)(end - pos) < len)
+    return 0;
+  for (size_t i = 0; i < len; ++i) {
+    char c = pos[i];
+    if (c >= 'A' && c <= 'Z')
+      c |= 32;
+    if (c != lower[i])
+      return 0;
+  }
+  return 1;
+}
+
+FIO_IFUNC char *fio___http_form_skip_ws(char *pos, char *end) {
+  while (pos < end && (*pos == ' ' || *pos == '\t'))
+    ++pos;
+  return pos;
+}
+
+/* reads a header parameter value (quoted or token), updating `*ppos` */
+FIO_SFUNC fio_buf_info_s fio___http_form_param_value(char **ppos, char *end) {
+  fio_buf_info_s v;
+  char *pos = *ppos;
+  if (pos < end && *pos == '"') {
+    v.buf = ++pos;
+    pos = (char *)FIO_MEMCHR(pos, '"', end - pos);
+    if (!pos)
+      pos = end;
+    v.len = pos - v.buf;
+  } else {
+    v.buf = pos;
+    while (pos < end && *pos != ';' && *pos != ' ' && *pos != '\t')
+      ++pos;
+    v.len = pos - v.buf;
+  }
+  *ppos = pos;
+  return v;
+}
+
+/* decodes `x-www-form-urlencoded` data in place, returns the new length */
+FIO_SFUNC size_t fio___http_form_url_decode(char *buf, size_t len) {
+  char *w = buf;
+  char *const end = buf + len;
+  for (char *r = buf; r < end; ++r) {
+    if (*r == '+') {
+      *w++ = ' ';
+    } else if (*r == '%' && end - r > 2 && fio_c2i((uint8_t)r[1]) < 16 &&
+               fio_c2i((uint8_t)r[2]) < 16) {
+      *w++ = (char)((fio_c2i((uint8_t)r[1]) << 4) | fio_c2i((uint8_t)r[2]));
+      r += 2;
+    } else {
+      *w++ = *r;
+    }
+  }
+  return (size_t)(w - buf);
+}
+
+/* finds the multipart delimiter, or where a partial delimiter might start */
+FIO_SFUNC char *fio___http_form_delim_find(fio_http_form_s *p,
+                                           char *pos,
+                                           char *end,
+                                           char **safe) {
+  const size_t dlen = p->delim_len;
+  /* the delimiter starts with CR, which is rare enough to memchr for */
+  while (pos < end && (pos = (char *)FIO_MEMCHR(pos, '\r', end - pos))) {
+    const size_t left = end - pos;
+    if (left >= dlen) {
+      if (!FIO_MEMCMP(pos, p->delim, dlen))
+        return pos;
+    } else if (!FIO_MEMCMP(pos, p->delim, left)) {
+      *safe = pos;
+      return NULL;
+    }
+    ++pos;
+  }
+  *safe = end;
+  return NULL;
+}
+
+/* parses a part's header block (`end` points to the final empty line) */
+FIO_SFUNC int fio___http_form_part_headers(fio_http_form_s *p,
+                                           char *pos,
+                                           char *end) {
+  fio_buf_info_s name = {0}, filename = {0}, content_type = {0};
+  while (pos < end) {
+    char *eol = (char *)FIO_MEMCHR(pos, '\r', end - pos);
+    if (!eol)
+      eol = end;
+    if (fio___http_form_is_prefix(pos, eol, "content-disposition:", 20)) {
+      /* form-data; name="field"; filename="file.txt" */
+      pos += 20;
+      while (pos < eol && (pos = (char *)FIO_MEMCHR(pos, ';', eol - pos))) {
+        pos = fio___http_form_skip_ws(pos + 1, eol);
+        if (fio___http_form_is_prefix(pos, eol, "name=", 5)) {
+          pos += 5;
+          name = fio___http_form_param_value(&pos, eol);
+        } else if (fio___http_form_is_prefix(pos, eol, "filename=", 9)) {
+          pos += 9;
+          filename = fio___http_form_param_value(&pos, eol);
+        }
+      }
+    } else if (fio___http_form_is_prefix(pos, eol, "content-type:", 13)) {
+      char *tail = eol;
+      pos = fio___http_form_skip_ws(pos + 13, eol);
+      while (tail > pos && (tail[-1] == ' ' || tail[-1] == '\t'))
+        --tail;
+      content_type = FIO_BUF_INFO2(pos, (size_t)(tail - pos));
+    }
+    pos = eol + 2;
+  }
+  return p->settings.on_field(name, filename, content_type, p->settings.udata);
+}
+
+/* consumes as much multipart data as possible, returns bytes consumed */
+FIO_SFUNC size_t fio___http_form_multipart(fio_http_form_s *p,
+                                           char *buf,
+                                           size_t len) {
+  char *pos = buf, *end = buf + len, *tmp;
+  for (;;) {
+    switch (p->state) {
+    case FIO___HTTP_FORM_START: /* the first boundary has no leading CRLF */
+      if ((size_t)(end - pos) < (size_t)(p->delim_len - 2))
+        return pos - buf;
+      p->state = FIO___HTTP_FORM_PREAMBLE;
+      if (!FIO_MEMCMP(pos, p->delim + 2, p->delim_len - 2)) {
+        pos += p->delim_len - 2;
+        p->state = FIO___HTTP_FORM_BOUNDARY;
+      }
+      continue;
+
+    case FIO___HTTP_FORM_PREAMBLE: /* ignored */
+      if (!(tmp = fio___http_form_delim_find(p, pos, end, &pos)))
+        return pos - buf;
+      pos = tmp + p->delim_len;
+      p->state = FIO___HTTP_FORM_BOUNDARY;
+      continue;
+
+    case FIO___HTTP_FORM_BOUNDARY: /* either `--` (done) or CRLF */
+      if (end - pos < 2)
+        return pos - buf;
+      if (pos[0] == '-' && pos[1] == '-') {
+        p->state = FIO___HTTP_FORM_DONE;
+        return len; /* the epilogue is ignored */
+      }
+      tmp = fio___http_form_skip_ws(pos, end); /* transport padding */
+      if (end - tmp < 2) {
+        if (tmp - pos > 64)
+          return (size_t)-1;
+        return pos - buf;
+      }
+      if (tmp[0] != '\r' || tmp[1] != '\n')
+        return (size_t)-1;
+      pos = tmp + 2;
+      p->state = FIO___HTTP_FORM_HEADERS;
+      continue;
+
+    case FIO___HTTP_FORM_HEADERS: /* find the empty line ending the headers */
+      tmp = pos;
+      if (end - pos >= 2 && pos[0] == '\r' && pos[1] == '\n')
+        goto headers_found;
+      while (tmp < end && (tmp = (char *)FIO_MEMCHR(tmp, '\n', end - tmp))) {
+        if (end - tmp < 3)
+          break;
+        if (tmp[1] == '\r' && tmp[2] == '\n') {
+          tmp -= 1; /* point to the CRLF ending the last header line */
+          goto headers_found;
+        }
+        ++tmp;
+      }
+      if ((size_t)(end - pos) > FIO_HTTP_FORM_HEADER_LIMIT)
+        return (size_t)-1;
+      return pos - buf;
+    headers_found:
+      if (fio___http_form_part_headers(p, pos, tmp))
+        return (size_t)-1;
+      pos = tmp + 2 + (tmp != pos) * 2;
+      p->state = FIO___HTTP_FORM_DATA;
+      continue;
+
+    case FIO___HTTP_FORM_DATA: {
+      char *safe;
+      char *found = fio___http_form_delim_find(p, pos, end, &safe);
+      char *data_end = found ? found : safe;
+      if (data_end > pos &&
+          p->settings.on_data(FIO_BUF_INFO2(pos, (size_t)(data_end - pos)),
+                              p->settings.udata))
+        return (size_t)-1;
+      if (!found)
+        return data_end - buf;
+      if (p->settings.on_field_end(p->settings.udata))
+        return (size_t)-1;
+      pos = found + p->delim_len;
+      p->state = FIO___HTTP_FORM_BOUNDARY;
+      continue;
+    }
+
+    case FIO___HTTP_FORM_DONE: return len;
+    default: return (size_t)-1;
+    }
+  }
+}
+
+/* consumes as much urlencoded data as possible, returns bytes consumed */
+FIO_SFUNC size_t fio___http_form_urlencoded(fio_http_form_s *p,
+                                            char *buf,
+                                            size_t len) {
+  char *pos = buf, *end = buf + len, *tmp;
+  for (;;) {
+    switch (p->state) {
+    case FIO___HTTP_FORM_START: /* field name */
+      tmp = pos;
+      while (tmp < end && *tmp != '=' && *tmp != '&')
+        ++tmp;
+      if (tmp == end) {
+        if ((size_t)(end - pos) > FIO_HTTP_FORM_HEADER_LIMIT)
+          return (size_t)-1;
+        return pos - buf;
+      }
+      if (tmp == pos) { /* no name (i.e., `&&`) */
+        pos = tmp + 1;
+        if (*tmp == '=')
+          p->state = FIO___HTTP_FORM_PREAMBLE; /* skip the value */
+        continue;
+      }
+      if (p->settings.on_field(
+              FIO_BUF_INFO2(pos, fio___http_form_url_decode(pos, tmp - pos)),
+              FIO_BUF_INFO2(NULL, 0),
+              FIO_BUF_INFO2(NULL, 0),
+              p->settings.udata))
+        return (size_t)-1;
+      pos = tmp + 1;
+      if (*tmp == '=') {
+        p->state = FIO___HTTP_FORM_DATA;
+        continue;
+      }
+      if (p->settings.on_field_end(p->settings.udata))
+        return (size_t)-1;
+      continue;
+
+    case FIO___HTTP_FORM_PREAMBLE: /* skip a value without a name */
+      if (!(pos = (char *)FIO_MEMCHR(pos, '&', end - pos)))
+        return len;
+      ++pos;
+      p->state = FIO___HTTP_FORM_START;
+      continue;
+
+    case FIO___HTTP_FORM_DATA: /* field value */
+      tmp = (char *)FIO_MEMCHR(pos, '&', end - pos);
+      {
+        char *data_end = tmp;
+        if (!data_end) { /* keep a partial `%XX` escape for the next chunk */
+          data_end = end;
+          if (data_end - pos > 0 && data_end[-1] == '%')
+            data_end -= 1;
+          else if (data_end - pos > 1 && data_end[-2] == '%')
+            data_end -= 2;
+        }
+        if (data_end > pos) {
+          size_t dlen = fio___http_form_url_decode(pos, data_end - pos);
+          if (p->settings.on_data(FIO_BUF_INFO2(pos, dlen), p->settings.udata))
+            return (size_t)-1;
+        }
+        if (!tmp)
+          return data_end - buf;
+      }
+      if (p->settings.on_field_end(p->settings.udata))
+        return (size_t)-1;
+      pos = tmp + 1;
+      p->state = FIO___HTTP_FORM_START;
+      continue;
+
+    default: return (size_t)-1;
+    }
+  }
+}
+
+FIO_IFUNC size_t fio___http_form_consume(fio_http_form_s *p,
+                                         char *buf,
+                                         size_t len) {
+  size_t r = ((p->type == FIO___HTTP_FORM_MULTIPART)
+                  ? fio___http_form_multipart
+                  : fio___http_form_urlencoded)(p, buf, len);
+  if (r == (size_t)-1)
+    p->state = FIO___HTTP_FORM_ERROR;
+  return r;
+}
+
+/** Initializes a form parser using the `content-type` header value. */
+SFUNC int fio_http_form_init(fio_http_form_s *p,
+                             fio_str_info_s content_type,
+                             fio_http_form_settings_s settings) {
+  *p = (fio_http_form_s){.settings = settings};
+  if (!p->settings.on_field)
+    p->settings.on_field = fio___http_form_on_field_noop;
+  if (!p->settings.on_data)
+    p->settings.on_data = fio___http_form_on_data_noop;
+  if (!p->settings.on_field_end)
+    p->settings.on_field_end = fio___http_form_on_field_end_noop;
+  char *pos = content_type.buf, *end = content_type.buf + content_type.len;
+  if (fio___http_form_is_prefix(pos,
+                                end,
+                                "application/x-www-form-urlencoded",
+                                33)) {
+    pos += 33;
+    if (pos == end || *pos == ';' || *pos == ' ' || *pos == '\t') {
+      p->type = FIO___HTTP_FORM_URLENCODED;
+      return 0;
+    }
+    return -1;
+  }
+  if (!fio___http_form_is_prefix(pos, end, "multipart/form-data", 19))
+    return -1;
+  pos += 19;
+  while (pos < end && (pos = (char *)FIO_MEMCHR(pos, ';', end - pos))) {
+    pos = fio___http_form_skip_ws(pos + 1, end);
+    if (!fio___http_form_is_prefix(pos, end, "boundary=", 9))
+      continue;
+    pos += 9;
+    fio_buf_info_s b = fio___http_form_param_value(&pos, end);
+    if (!b.len || b.len > 70)
+      return -1;
+    FIO_MEMCPY(p->delim, "\r\n--", 4);
+    FIO_MEMCPY(p->delim + 4, b.buf, b.len);
+    p->delim_len = (uint8_t)(b.len + 4);
+    p->type = FIO___HTTP_FORM_MULTIPART;
+    return 0;
+  }
+  return -1;
+}
+
+/** Parses a chunk of form data, calling the callbacks as fields are found. */
+SFUNC int fio_http_form_parse(fio_http_form_s *p, fio_buf_info_s data) {
+  size_t consumed;
+  if (!p->type || p->state == FIO___HTTP_FORM_ERROR)
+    return -1;
+  if (!data.len)
+    return 0;
+  if (fio_bstr_len(p->carry)) {
+    /* complete the tail using as little of the new data as possible */
+    const size_t old = fio_bstr_len(p->carry);
+    size_t add = FIO_HTTP_FORM_HEADER_LIMIT + p->delim_len + 4;
+    if (add > data.len)
+      add = data.len;
+    p->carry = fio_bstr_write(p->carry, data.buf, add);
+    consumed = fio___http_form_consume(p, p->carry, old + add);
+    if (consumed == (size_t)-1)
+      return -1;
+    if (consumed < old) { /* still incomplete (all data was added) */
+      if (add < data.len)
+        goto error;
+      FIO_MEMMOVE(p->carry, p->carry + consumed, (old + add) - consumed);
+      p->carry = fio_bstr_len_set(p->carry, (old + add) - consumed);
+      return 0;
+    }
+    p->carry = fio_bstr_len_set(p->carry, 0);
+    data.buf += consumed - old;
+    data.len -= consumed - old;
+  }
+  consumed = fio___http_form_consume(p, data.buf, data.len);
+  if (consumed == (size_t)-1)
+    return -1;
+  if (consumed < data.len)
+    p->carry =
+        fio_bstr_write(p->carry, data.buf + consumed, data.len - consumed);
+  return 0;
+error:
+  p->state = FIO___HTTP_FORM_ERROR;
+  return -1;
+}
+
+/** Completes parsing and frees the parser's resources. */
+SFUNC int fio_http_form_finish(fio_http_form_s *p) {
+  int r = -1;
+  if (p->type == FIO___HTTP_FORM_MULTIPART) {
+    if (p->state == FIO___HTTP_FORM_DONE)
+      r = 0;
+  } else if (p->type == FIO___HTTP_FORM_URLENCODED &&
+             p->state != FIO___HTTP_FORM_ERROR) {
+    /* the last field is terminated by the end of the data */
+    p->carry = fio_bstr_write(p->carry, "&", 1);
+    if (fio___http_form_consume(p, p->carry, fio_bstr_len(p->carry)) !=
+        (size_t)-1)
+      r = 0;
+  }
+  fio_bstr_free(p->carry);
+  p->carry = NULL;
+  p->type = 0;
+  return r;
+}
+
+/** Parses the HTTP handle's body as form data in a single pass. */
+SFUNC int fio_http_body_parse_form(fio_http_s *h,
+                                   fio_http_form_settings_s settings) {
+  fio_http_form_s p;
+  int r = 0;
+  if (fio_http_form_init(
+          &p,
+          fio_http_request_header(h,
+                                  FIO_STR_INFO2((char *)"content-type", 12),
+                                  0),
+          settings))
+    return -1;
+  /* in-memory bodies are parsed in place, files are read in blocks */
+  const size_t block = (h->body.fd == -1) ? h->body.len : (1UL << 16);
+  fio_http_body_seek(h, 0);
+  for (;;) {
+    fio_str_info_s s = fio_http_body_read(h, block);
+    if (!s.len || (r = fio_http_form_parse(&p, FIO_STR2BUF_INFO(s))))
+      break;
+  }
+  return fio_http_form_finish(&p) | r;
+}
+
+/* *****************************************************************************
+Dynamic Compression (gzip / deflate)
+***************************************************************************** */
+
+/** Allows the response body to be compressed (gzip / deflate) on the fly. */
+SFUNC void fio_http_compress_set(fio_http_s *h,
+                                 size_t min_len,
+                                 fio_str_info_s types) {
+  h->compress.min = min_len;
+  h->compress.types = types;
+}
+
+/** Returns true if a `cache-control` header has the directive (any case). */
+FIO_SFUNC int fio___http_cache_control_has(fio_http_s *h,
+                                           int is_request,
+                                           fio_str_info_s directive) {
+  FIO_HTTP_HEADER_EACH_VALUE(h,
+                             is_request,
+                             FIO_STR_INFO2((char *)"cache-control", 13),
+                             v) {
+    size_t i = 0;
+    if (v.len < directive.len ||
+        (v.len > directive.len && v.buf[directive.len] != '='))
+      continue;
+    while (i < directive.len && (v.buf[i] | 32) == directive.buf[i])
+      ++i;
+    if (i == directive.len)
+      return 1;
+  }
+  return 0;
+}
+
+#if HAVE_ZLIB
+
+#define FIO___HTTP_COMPRESS_GZIP    1
+#define FIO___HTTP_COMPRESS_DEFLATE 2
+
+#if FIO_HTTP_COMPRESS_CACHE_LIMIT
+#define FIO_MAP_NAME             fio___http_zcache_map
+#define FIO_MAP_VALUE            char *
+#define FIO_MAP_VALUE_DESTROY(o) fio_bstr_free(o)
+#define FIO_MAP_VALUE_DISCARD(o) fio_bstr_free(o)
+#define FIO_MAP_LRU              FIO_HTTP_COMPRESS_CACHE_LIMIT
+#define FIO___RECURSIVE_INCLUDE  1
+#include FIO_INCLUDE_FILE
+#undef FIO___RECURSIVE_INCLUDE
+
+static struct {
+  fio___http_zcache_map_s map;
+  fio_lock_i lock;
+} fio___http_zcache = {.map = FIO_MAP_INIT, .lock = FIO_LOCK_INIT};
+
+/** Returns a copy of a cached compressed response (or NULL). */
+FIO_SFUNC char *fio___http_zcache_get(fio_str_info_s key) {
+  char *r;
+  const uint64_t hash = fio_risky_hash(key.buf, key.len, 0);
+  fio_lock(&fio___http_zcache.lock);
+  r = fio_bstr_copy(fio___http_zcache_map_get(&fio___http_zcache.map,
+                                               hash,
+                                               key));
+  fio_unlock(&fio___http_zcache.lock);
+  return r;
+}
+
+/** Caches a compressed response (a copy of `data` is stored). */
+FIO_SFUNC void fio___http_zcache_set(fio_str_info_s key, char *data) {
+  const uint64_t hash = fio_risky_hash(key.buf, key.len, 0);
+  if (fio_bstr_len(data) > FIO_HTTP_COMPRESS_CACHE_ITEM_LIMIT)
+    return;
+  fio_lock(&fio___http_zcache.lock);
+  fio___http_zcache_map_set(&fio___http_zcache.map,
+                            hash,
+                            key,
+                            fio_bstr_copy(data),
+                            NULL);
+  fio_unlock(&fio___http_zcache.lock);
+}
+
+FIO_SFUNC void fio___http_zcache_destroy(void) {
+  fio_lock(&fio___http_zcache.lock);
+  fio___http_zcache_map_destroy(&fio___http_zcache.map);
+  fio_unlock(&fio___http_zcache.lock);
+}
+#else
+#define fio___http_zcache_get(key)       NULL
+#define fio___http_zcache_set(key, data) ((void)(data))
+#define fio___http_zcache_destroy()
+#endif /* FIO_HTTP_COMPRESS_CACHE_LIMIT */
+
+/** Returns the preferred encoding accepted by the client (or zero). */
+FIO_SFUNC int fio___http_compress_encoding(fio_http_s *h) {
+  int r = 0;
+  FIO_HTTP_HEADER_EACH_VALUE(h,
+                             1,
+                             FIO_STR_INFO2((char *)"accept-encoding", 15),
+                             val) {
+    int e;
+    if (val.len == 4 && (fio_buf2u32u(val.buf) | 0x20202020UL) ==
+                            fio_buf2u32u("gzip"))
+      e = FIO___HTTP_COMPRESS_GZIP;
+    else if (val.len == 7 &&
+             (fio_buf2u64u(val.buf) | 0x0020202020202020ULL) ==
+                 (fio_buf2u64u("deflate") | 0x0020202020202020ULL))
+      e = FIO___HTTP_COMPRESS_DEFLATE;
+    else if (val.len == 1 && val.buf[0] == '*')
+      e = FIO___HTTP_COMPRESS_GZIP;
+    else
+      continue;
+    FIO_HTTP_HEADER_VALUE_EACH_PROPERTY(val, p) { /* test for `q=0` */
+      if (p.name.len == 1 && (p.name.buf[0] | 32) == 'q' && p.value.len &&
+          p.value.buf[0] == '0') {
+        size_t i = 1;
+        while (i < p.value.len &&
+               (p.value.buf[i] == '.' || p.value.buf[i] == '0'))
+          ++i;
+        if (i == p.value.len)
+          e = 0;
+      }
+    }
+    if (e == FIO___HTTP_COMPRESS_GZIP)
+      return e;
+    r |= e;
+  }
+  return r;
+}
+
+/** Returns true if the `content-type` is listed in `types` (see above). */
+FIO_SFUNC int fio___http_compress_mime_test(fio_str_info_s types,
+                                            fio_str_info_s t) {
+  if (!types.len)
+    types = FIO_STR_INFO2((char *)FIO_HTTP_COMPRESS_TYPES,
+                          sizeof(FIO_HTTP_COMPRESS_TYPES) - 1);
+  for (size_t i = 0; i < t.len; ++i) { /* ignore parameters (i.e., charset) */
+    if (t.buf[i] != ';' && t.buf[i] != ' ')
+      continue;
+    t.len = i;
+    break;
+  }
+  while (types.len) {
+    fio_str_info_s e = types;
+    char *comma = (char *)FIO_MEMCHR(types.buf, ',', types.len);
+    size_t offset = 0, i = 0;
+    if (comma)
+      e.len = (size_t)(comma - types.buf);
+    types.buf += e.len + !!comma;
+    types.len -= e.len + !!comma;
+    while (e.len && e.buf[0] == ' ')
+      ++e.buf, --e.len;
+    while (e.len && e.buf[e.len - 1] == ' ')
+      --e.len;
+    if (!e.len || e.len > t.len)
+      continue;
+    if (e.buf[0] == '+') /* suffix */
+      offset = t.len - e.len;
+    else if (e.buf[e.len - 1] != '/' && e.len != t.len) /* exact match */
+      continue;
+    while (i < e.len && (t.buf[offset + i] | 32) == (e.buf[i] | 32))
+      ++i;
+    if (i == e.len)
+      return 1;
+  }
+  return 0;
+}
+
+/** Returns the preferred encoding if the response should be compressed. */
+FIO_SFUNC int fio___http_compress_test(fio_http_s *h) {
+  fio_str_info_s tmp;
+  if (h->status < 200 || h->status > 299 || h->status == 204 ||
+      h->status == 206 || (h->state & FIO_HTTP_STATE_UPGRADED))
+    return 0;
+  tmp = fio_keystr_info(&h->method);
+  if (tmp.len == 4 &&
+      (fio_buf2u32u(tmp.buf) | 0x20202020UL) == fio_buf2u32u("head"))
+    return 0;
+  if (fio___http_hmap_get(HTTP_HDR_RESPONSE(h),
+                          FIO_STR_INFO2((char *)"content-encoding", 16)))
+    return 0;
+  if (fio___http_cache_control_has(
+          h,
+          0,
+          FIO_STR_INFO2((char *)"no-transform", 12)))
+    return 0;
+  tmp = fio_http_response_header(h,
+                                 FIO_STR_INFO2((char *)"content-type", 12),
+                                 0);
+  if (!fio___http_compress_mime_test(h->compress.types, tmp))
+    return 0;
+  return fio___http_compress_encoding(h);
+}
+
+/** Compresses `data` (gzip / deflate), returning a `fio_bstr` (or NULL). */
+FIO_SFUNC char *fio___http_compress_data(fio_buf_info_s data, int encoding) {
+  char *r;
+  z_stream z = {0};
+  if (deflateInit2(&z,
+                   Z_DEFAULT_COMPRESSION,
+                   Z_DEFLATED,
+                   (encoding == FIO___HTTP_COMPRESS_GZIP ? 31 : 15),
+                   8,
+                   Z_DEFAULT_STRATEGY) != Z_OK)
+    return NULL;
+  r = fio_bstr_reserve(NULL, (size_t)deflateBound(&z, (uLong)data.len));
+  z.next_in = (Bytef *)data.buf;
+  z.avail_in = (uInt)data.len;
+  z.next_out = (Bytef *)r;
+  z.avail_out = (uInt)(fio_bstr_info(r).capa - 1);
+  if (deflate(&z, Z_FINISH) != Z_STREAM_END || z.total_out >= data.len) {
+    /* failed, or not worth it */
+    fio_bstr_free(r);
+    r = NULL;
+  } else
+    r = fio_bstr_len_set(r, (size_t)z.total_out);
+  deflateEnd(&z);
+  return r;
+}
+
+/** Releases the data described by the write arguments. */
+FIO_IFUNC void fio___http_compress_args_free(fio_http_write_args_s *args) {
+  if (args->buf) {
+    if (args->dealloc)
+      args->dealloc((void *)args->buf);
+  } else if (args->fd > 0) {
+    if (args->dealloc)
+      args->dealloc((void *)(intptr_t)args->fd);
+    else
+      close(args->fd);
+  }
+}
+
+/** Reads the file described by the write arguments to a `fio_bstr`. */
+FIO_SFUNC char *fio___http_compress_args_read(fio_http_write_args_s *args) {
+  char *r = NULL;
+  if (args->fd < 1 || !args->len)
+    return r;
+  r = fio_bstr_readfd(NULL, args->fd, (intptr_t)args->offset, args->len);
+  if (fio_bstr_len(r) != args->len)
+    r = (fio_bstr_free(r), NULL);
+  return r;
+}
+
+/** Frees the streaming compression state (if any). */
+FIO_SFUNC void fio___http_compress_free(fio_http_s *h) {
+  z_stream *z = (z_stream *)h->compress.z;
+  if (!z)
+    return;
+  h->compress.z = NULL;
+  deflateEnd(z);
+  FIO_MEM_FREE_(z, sizeof(*z));
+}
+
+/** The writer for streamed (compressed) responses. */
+FIO_SFUNC int fio____http_write_deflate(fio_http_s *h,
+                                        fio_http_write_args_s *args) {
+  z_stream *z = (z_stream *)h->compress.z;
+  const int flush = args->finish ? Z_FINISH : Z_SYNC_FLUSH;
+  char *out = NULL;
+  char *in = NULL;
+  fio_http_write_args_s a = {.finish = args->finish};
+  if (args->buf)
+    z->next_in = (Bytef *)args->buf + args->offset;
+  else if (args->fd > 0 && !(in = fio___http_compress_args_read(args)))
+    FIO_LOG_ERROR("HTTP compression couldn't read file data (fd %d)",
+                  args->fd);
+  else
+    z->next_in = (Bytef *)in;
+  z->avail_in = (uInt)((in || args->buf) ? args->len : 0);
+  do {
+    fio_str_info_s i;
+    out = fio_bstr_reserve(out, (z->avail_in >> 1) + 64);
+    i = fio_bstr_info(out);
+    z->next_out = (Bytef *)i.buf + i.len;
+    z->avail_out = (uInt)(i.capa - i.len - 1);
+    deflate(z, flush);
+    out = fio_bstr_len_set(out, i.capa - 1 - z->avail_out);
+  } while (!z->avail_out);
+  fio_bstr_free(in);
+  fio___http_compress_args_free(args);
+  if (args->finish)
+    fio___http_compress_free(h);
+  if (fio_bstr_len(out)) {
+    a.buf = out;
+    a.len = fio_bstr_len(out);
+    a.dealloc = (void (*)(void *))fio_bstr_free;
+  } else
+    fio_bstr_free(out);
+  return fio____http_write_cont(h, &a);
+}
+
+static const fio_str_info_s fio___http_compress_names[] = {
+    {0},
+    {.buf = (char *)"gzip", .len = 4},
+    {.buf = (char *)"deflate", .len = 7},
+};
+
+/**
+ * Marks (or un-marks) the `etag` header with the encoding, so the compressed
+ * representation has a different ETag. Returns -1 if the ETag is too long.
+ */
+FIO_SFUNC int fio___http_compress_etag(fio_http_s *h, int encoding, int mark) {
+  FIO_STR_INFO_TMP_VAR(tag, 255);
+  const fio_str_info_s name = fio___http_compress_names[encoding];
+  fio_str_info_s etag =
+      fio_http_response_header(h, FIO_STR_INFO2((char *)"etag", 4), 0);
+  size_t quote;
+  if (!etag.len)
+    return 0;
+  if (etag.len + name.len + 2 > tag.capa)
+    return -1;
+  quote = (etag.buf[etag.len - 1] == '"');
+  etag.len -= quote;
+  if (mark) {
+    fio_string_write2(&tag,
+                      NULL,
+                      FIO_STRING_WRITE_STR2(etag.buf, etag.len),
+                      FIO_STRING_WRITE_STR2("-", 1),
+                      FIO_STRING_WRITE_STR2(name.buf, name.len),
+                      FIO_STRING_WRITE_STR2("\"", quote));
+  } else {
+    if (etag.len < name.len + 1 ||
+        FIO_MEMCMP(etag.buf + etag.len - name.len, name.buf, name.len))
+      return 0;
+    etag.len -= name.len + 1;
+    fio_string_write2(&tag,
+                      NULL,
+                      FIO_STRING_WRITE_STR2(etag.buf, etag.len),
+                      FIO_STRING_WRITE_STR2("\"", quote));
+  }
+  fio___http_hmap_set2(HTTP_HDR_RESPONSE(h),
+                       &h->arena,
+                       FIO_STR_INFO2((char *)"etag", 4),
+                       tag,
+                       -1);
+  return 0;
+}
+
+/**
+ * Returns the encoding if the response should be compressed (or zero), marking
+ * the `etag` header, so `if-none-match` is tested against the compressed ETag.
+ */
+FIO_SFUNC int fio___http_compress_prepare(fio_http_s *h,
+                                          fio_http_write_args_s *args) {
+  int encoding;
+  if (args->finish) { /* file backed responses are never compressed */
+    if (args->len < h->compress.min || args->len > FIO_HTTP_COMPRESS_MAX_LEN ||
+        !args->buf)
+      return 0;
+  } else if (fio___http_hmap_get(HTTP_HDR_RESPONSE(h),
+                                 FIO_STR_INFO2((char *)"content-length", 14)))
+    return 0; /* not streaming */
+  encoding = fio___http_compress_test(h);
+  if (encoding && fio___http_compress_etag(h, encoding, 1))
+    encoding = 0;
+  return encoding;
+}
+
+/**
+ * Compresses the response using `encoding` (see `fio___http_compress_prepare`),
+ * updating the headers and the write arguments (or the writer, for streamed
+ * responses).
+ */
+FIO_SFUNC void fio___http_compress_start(fio_http_s *h,
+                                         fio_http_write_args_s *args,
+                                         int encoding) {
+  char *out = NULL;
+  if (!args->finish) { /* streaming */
+    z_stream *z = (z_stream *)FIO_MEM_REALLOC_(NULL, 0, sizeof(*z), 0);
+    if (!z)
+      goto no_compression;
+    *z = (z_stream){0};
+    if (deflateInit2(z,
+                     Z_DEFAULT_COMPRESSION,
+                     Z_DEFLATED,
+                     (encoding == FIO___HTTP_COMPRESS_GZIP ? 31 : 15),
+                     8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+      FIO_MEM_FREE_(z, sizeof(*z));
+      goto no_compression;
+    }
+    h->compress.z = z;
+    h->writer = fio____http_write_deflate;
+    goto set_headers;
+  }
+  {
+    FIO_STR_INFO_TMP_VAR(key, 1023);
+    fio_str_info_s etag =
+        fio_http_response_header(h, FIO_STR_INFO2((char *)"etag", 4), 0);
+    if (etag.len) { /* cache key: length, (marked) etag and path */
+      fio_str_info_s path = fio_keystr_info(&h->path);
+      if (etag.len + path.len + 48 < key.capa)
+        fio_string_write2(&key,
+                          NULL,
+                          FIO_STRING_WRITE_UNUM(args->len),
+                          FIO_STRING_WRITE_STR2(" ", 1),
+                          FIO_STRING_WRITE_STR2(etag.buf, etag.len),
+                          FIO_STRING_WRITE_STR2(" ", 1),
+                          FIO_STRING_WRITE_STR2(path.buf, path.len));
+      if (key.len)
+        out = fio___http_zcache_get(key);
+    }
+    if (!out) {
+      out = fio___http_compress_data(
+          FIO_BUF_INFO2((char *)args->buf + args->offset, args->len),
+          encoding);
+      if (!out)
+        goto no_compression;
+      if (key.len)
+        fio___http_zcache_set(key, out);
+    }
+  }
+  fio___http_compress_args_free(args);
+  *args = (fio_http_write_args_s){
+      .buf = out,
+      .len = fio_bstr_len(out),
+      .dealloc = (void (*)(void *))fio_bstr_free,
+      .finish = 1,
+  };
+  { /* set the (updated) content-length */
+    char ibuf[32];
+    fio_str_info_s v = FIO_STR_INFO3(ibuf, 0, 32);
+    v.len = fio_digits10u(args->len);
+    fio_ltoa10u(v.buf, args->len, v.len);
+    fio___http_hmap_set2(HTTP_HDR_RESPONSE(h),
+                         &h->arena,
+                         FIO_STR_INFO2((char *)"content-length", 14),
+                         v,
+                         -1);
+  }
+
+set_headers: /* ranges refer to the identity (uncompressed) representation */
+  fio___http_hmap_set2(HTTP_HDR_RESPONSE(h),
+                       &h->arena,
+                       FIO_STR_INFO2((char *)"accept-ranges", 13),
+                       FIO_STR_INFO2(NULL, 0),
+                       0);
+  fio_http_response_header_set(h,
+                               FIO_STR_INFO2((char *)"content-encoding", 16),
+                               fio___http_compress_names[encoding]);
+  fio_http_response_header_add(h,
+                               FIO_STR_INFO2((char *)"vary", 4),
+                               FIO_STR_INFO2((char *)"accept-encoding", 15));
+  return;
+
+no_compression: /* the identity representation keeps the original etag */
+  fio___http_compress_etag(h, encoding, 0);
+}
+
+#undef FIO___HTTP_COMPRESS_GZIP
+#undef FIO___HTTP_COMPRESS_DEFLATE
+#else
+#define fio___http_zcache_destroy()
+#endif /* HAVE_ZLIB */
+
+/* *****************************************************************************
+Response (Micro) Cache
+
+Responses are stored by a key built from the request's path, query and
+selected (`vary`) request headers. An entry holds the response status, the
+response headers (serialized) and the body, in a single (shared) buffer.
+
+While the first request to a resource is handled (the entry is pending),
+concurrent requests to the same resource wait for its response.
+***************************************************************************** */
+#if FIO_HTTP_RESPONSE_CACHE_LIMIT
+
+/** A request waiting for a pending cache entry. */
+typedef struct fio___http_rcache_waiter_s {
+  struct fio___http_rcache_waiter_s *next;
+  fio_http_s *h;
+  void (*on_release)(fio_http_s *h, void *udata);
+  void *udata;
+} fio___http_rcache_waiter_s;
+
+/** A cached response (or a pending one, if `data` is NULL). */
+typedef struct {
+  /** Serialized headers, followed by the body (a `fio_bstr`). */
+  char *data;
+  /** Requests waiting for the response (while pending). */
+  fio___http_rcache_waiter_s *waiters;
+  /** The time (in seconds) the response was stored. */
+  int64_t stored;
+  /** The time (in seconds) after which the response is stale. */
+  int64_t expires;
+  /** The length of the serialized headers. */
+  uint32_t headers_len;
+  /** The cache time-to-live in seconds. */
+  uint32_t ttl;
+  /** True if the response may be sent to requests with credentials. */
+  uint8_t is_public;
+} fio___http_rcache_s;
+
+FIO_SFUNC void fio___http_rcache_release(fio___http_rcache_waiter_s *w,
+                                         fio___http_rcache_s *e);
+
+#define FIO_REF_NAME             fio___http_rcache
+#define FIO_REF_CONSTRUCTOR_ONLY 1
+#define FIO_REF_DESTROY(o)                                                     \
+  do {                                                                         \
+    fio___http_rcache_release((o).waiters, NULL);                              \
+    fio_bstr_free((o).data);                                                   \
+  } while (0)
+#define FIO___RECURSIVE_INCLUDE 1
+#include FIO_INCLUDE_FILE
+#undef FIO___RECURSIVE_INCLUDE
+
+#define FIO_MAP_NAME             fio___http_rcache_map
+#define FIO_MAP_VALUE            fio___http_rcache_s *
+#define FIO_MAP_VALUE_DESTROY(o) fio___http_rcache_free(o)
+#define FIO_MAP_VALUE_DISCARD(o) fio___http_rcache_free(o)
+#define FIO_MAP_LRU              FIO_HTTP_RESPONSE_CACHE_LIMIT
+#define FIO___RECURSIVE_INCLUDE  1
+#include FIO_INCLUDE_FILE
+#undef FIO___RECURSIVE_INCLUDE
+
+static struct {
+  fio___http_rcache_map_s map;
+  fio_lock_i lock;
+} fio___http_rcache = {.map = FIO_MAP_INIT, .lock = FIO_LOCK_INIT};
+
+FIO_SFUNC void fio___http_rcache_destroy(void) {
+  fio_lock(&fio___http_rcache.lock);
+  fio___http_rcache_map_destroy(&fio___http_rcache.map);
+  fio_unlock(&fio___http_rcache.lock);
+}
+
+/** Sends a cached response using the HTTP handle (the body is shared). */
+FIO_SFUNC void fio___http_rcache_send(fio_http_s *h, fio___http_rcache_s *e) {
+  char *data = fio_bstr_copy(e->data);
+  const size_t len = fio_bstr_len(data);
+  const int64_t age = (h->received_at / FIO___HTTP_TIME_DIV) - e->stored;
+  char *pos = data + 4;
+  char *end = data + e->headers_len;
+  h->status = fio_buf2u32u(data);
+  while (pos < end) { /* name length, value length, name, value */
+    const uint32_t nlen = fio_buf2u32u(pos);
+    const uint32_t vlen = fio_buf2u32u(pos + 4);
+    fio___http_hmap_set2(HTTP_HDR_RESPONSE(h),
+                         &h->arena,
+                         FIO_STR_INFO2(pos + 8, nlen),
+                         FIO_STR_INFO2(pos + 8 + nlen, vlen),
+                         1);
+    pos += 8 + nlen + vlen;
+  }
+  if (age > 0) {
+    char buf[32];
+    fio_str_info_s v = FIO_STR_INFO3(buf, 0, 32);
+    v.len = fio_digits10u((uint64_t)age);
+    fio_ltoa10u(v.buf, (uint64_t)age, v.len);
+    fio___http_hmap_set2(HTTP_HDR_RESPONSE(h),
+                         &h->arena,
+                         FIO_STR_INFO2((char *)"age", 3),
+                         v,
+                         -1);
+  }
+  fio_http_write(h,
+                 .buf = data,
+                 .offset = e->headers_len,
+                 .len = len - e->headers_len,
+                 .dealloc = (void (*)(void *))fio_bstr_free,
+                 .finish = 1);
+}
+
+/** Releases waiting requests (sending the response, if `e` is available). */
+FIO_SFUNC void fio___http_rcache_release(fio___http_rcache_waiter_s *w,
+                                         fio___http_rcache_s *e) {
+  while (w) {
+    fio___http_rcache_waiter_s *tmp = w;
+    w = w->next;
+    if (e)
+      fio___http_rcache_send(tmp->h, e);
+    tmp->on_release(tmp->h, tmp->udata);
+    FIO_MEM_FREE_(tmp, sizeof(*tmp));
+  }
+}
+
+/** Returns true if the request carries credentials (authorization / cookie). */
+FIO_SFUNC int fio___http_rcache_is_personal(fio_http_s *h) {
+  return fio___http_hmap_get(HTTP_HDR_REQUEST(h),
+                             FIO_STR_INFO2((char *)"authorization", 13)) ||
+         fio___http_hmap_get(HTTP_HDR_REQUEST(h),
+                             FIO_STR_INFO2((char *)"cookie", 6));
+}
+
+/** Writes the cache key (host, path, query and `vary` headers). -1 if long. */
+FIO_SFUNC int fio___http_rcache_key(fio_str_info_s *key,
+                                    fio_http_s *h,
+                                    fio_str_info_s vary) {
+  fio_str_info_s host =
+      fio_http_request_header(h, FIO_STR_INFO2((char *)"host", 4), 0);
+  fio_str_info_s path = fio_keystr_info(&h->path);
+  fio_str_info_s query = fio_keystr_info(&h->query);
+  if (host.len + path.len + query.len + 2 >= key->capa)
+    return -1;
+  fio_string_write2(key,
+                    NULL,
+                    FIO_STRING_WRITE_STR2(host.buf, host.len),
+                    FIO_STRING_WRITE_STR2("\0", 1),
+                    FIO_STRING_WRITE_STR2(path.buf, path.len),
+                    FIO_STRING_WRITE_STR2("?", 1));
+  if (query.len)
+    fio_string_write(key, NULL, query.buf, query.len);
+  while (vary.len) {
+    fio_str_info_s name = vary;
+    char *comma = (char *)FIO_MEMCHR(vary.buf, ',', vary.len);
+    if (comma)
+      name.len = (size_t)(comma - vary.buf);
+    vary.buf += name.len + !!comma;
+    vary.len -= name.len + !!comma;
+    while (name.len && name.buf[0] == ' ')
+      ++name.buf, --name.len;
+    while (name.len && name.buf[name.len - 1] == ' ')
+      --name.len;
+    if (!name.len)
+      continue;
+    for (size_t i = 0;; ++i) {
+      fio_str_info_s value = fio_http_request_header(h, name, i);
+      if (!value.buf)
+        break;
+      if (key->len + value.len + 1 >= key->capa)
+        return -1;
+      fio_string_write2(key,
+                        NULL,
+                        FIO_STRING_WRITE_STR2("\n", 1),
+                        FIO_STRING_WRITE_STR2(value.buf, value.len));
+    }
+    if (key->len + 1 >= key->capa)
+      return -1;
+    fio_string_write(key, NULL, "\0", 1);
+  }
+  return 0;
+}
+
+/** Collects a response header's serialized length. */
+FIO_SFUNC int fio___http_rcache_header_len(fio_http_s *h,
+                                           fio_str_info_s name,
+                                           fio_str_info_s value,
+                                           void *len_) {
+  *(size_t *)len_ += 8 + name.len + value.len;
+  return 0;
+  (void)h;
+}
+
+/** Serializes a response header (except `date` and `content-length`). */
+FIO_SFUNC int fio___http_rcache_header_write(fio_http_s *h,
+                                             fio_str_info_s name,
+                                             fio_str_info_s value,
+                                             void *pos_) {
+  char **pos = (char **)pos_;
+  if (FIO_STR_INFO_IS_EQ(name, FIO_STR_INFO2((char *)"date", 4)) ||
+      FIO_STR_INFO_IS_EQ(name, FIO_STR_INFO2((char *)"content-length", 14)))
+    return 0;
+  fio_u2buf32u(*pos, (uint32_t)name.len);
+  fio_u2buf32u(*pos + 4, (uint32_t)value.len);
+  FIO_MEMCPY(*pos + 8, name.buf, name.len);
+  FIO_MEMCPY(*pos + 8 + name.len, value.buf, value.len);
+  *pos += 8 + name.len + value.len;
+  return 0;
+  (void)h;
+}
+
+/** Stores the response in the pending cache entry (or aborts). */
+FIO_SFUNC void fio___http_rcache_store(fio_http_s *h,
+                                       fio_http_write_args_s *args) {
+  fio___http_rcache_s *e = (fio___http_rcache_s *)h->cache;
+  fio___http_rcache_waiter_s *waiters;
+  char *data = NULL;
+  if (h->status != 200 || !args->finish || !args->buf ||
+      args->len > FIO_HTTP_RESPONSE_CACHE_ITEM_LIMIT ||
+      fio___http_cmap_count(h->cookies + 1) ||
+      fio___http_cache_control_has(h,
+                                   0,
+                                   FIO_STR_INFO2((char *)"no-store", 8)) ||
+      fio___http_cache_control_has(h,
+                                   0,
+                                   FIO_STR_INFO2((char *)"private", 7)) ||
+      fio___http_cache_control_has(h,
+                                   0,
+                                   FIO_STR_INFO2((char *)"no-cache", 8)))
+    goto abort;
+  e->is_public =
+      fio___http_cache_control_has(h, 0, FIO_STR_INFO2((char *)"public", 6));
+  if (!e->is_public && fio___http_rcache_is_personal(h))
+    goto abort;
+  { /* serialize: status, (name length, value length, name, value)... body */
+    size_t len = 4 + args->len;
+    char *pos;
+    fio_http_response_header_each(h, fio___http_rcache_header_len, &len);
+    data = fio_bstr_reserve(NULL, len);
+    if (!data)
+      goto abort;
+    pos = data;
+    fio_u2buf32u(pos, h->status);
+    pos += 4;
+    fio_http_response_header_each(h, fio___http_rcache_header_write, &pos);
+    e->headers_len = (uint32_t)(pos - data);
+    FIO_MEMCPY(pos, (char *)args->buf + args->offset, args->len);
+    pos += args->len;
+    data = fio_bstr_len_set(data, (size_t)(pos - data));
+  }
+  e->stored = fio_http_get_timestump() / FIO___HTTP_TIME_DIV;
+  fio_lock(&fio___http_rcache.lock);
+  e->data = data;
+  e->expires = e->stored + e->ttl;
+  waiters = e->waiters;
+  e->waiters = NULL;
+  fio_unlock(&fio___http_rcache.lock);
+  h->cache = NULL;
+  fio___http_rcache_release(waiters, e);
+  fio___http_rcache_free(e);
+  return;
+abort:
+  fio___http_rcache_abort(h);
 }
 
-/**
- * Reads from the body until finding `token`, reaching `limit` or EOF.
- *
- * Note: `limit` is ignored if the
- */
-SFUNC fio_str_info_s fio_http_body_read_until(fio_http_s *h,
-                                              char token,
-                                              size_t limit) {
-  fio_str_info_s r = {0};
-  if (h->body.pos == h->body.len)
-    return r;
-  if (!limit || (h->body.pos + limit) > h->body.len)
-    limit = h->body.len - h->body.pos;
-  r = ((h->body.fd == -1) ? fio___http_body_read_until_buf
-                          : fio___http_body_read_until_fd)(h, token, limit);
-  return r;
+/** Removes a pending cache entry (if any), releasing waiting requests. */
+FIO_SFUNC void fio___http_rcache_abort(fio_http_s *h) {
+  fio___http_rcache_s *e = (fio___http_rcache_s *)h->cache;
+  fio___http_rcache_waiter_s *waiters;
+  if (!e)
+    return;
+  h->cache = NULL;
+  fio_lock(&fio___http_rcache.lock);
+  waiters = e->waiters;
+  e->waiters = NULL;
+  e->expires = 0; /* the next request will retry */
+  fio_unlock(&fio___http_rcache.lock);
+  fio___http_rcache_release(waiters, NULL);
+  fio___http_rcache_free(e);
 }
 
-/** Allocates a body (payload) of (at least) the `expected_length`. */
-SFUNC void fio_http_body_expect(fio_http_s *h, size_t expected_length) {
-  ((h->body.fd == -1) ? fio___http_body_expect_buf
-                      : fio___http_body_expect_fd)(h, expected_length);
+/** Attempts to answer a `GET` request from the response cache. */
+SFUNC int fio_http_cache(fio_http_s *h, fio_http_cache_args_s args) {
+  FIO_STR_INFO_TMP_VAR(key, 2047);
+  fio_str_info_s method = fio_keystr_info(&h->method);
+  fio___http_rcache_s *e;
+  fio___http_rcache_waiter_s *w = NULL;
+  uint64_t hash;
+  int64_t now;
+  int personal;
+  if (!args.ttl || !args.on_release || h->cache || method.len != 3 ||
+      fio_buf2u32u(method.buf) != fio_buf2u32u("GET\0") ||
+      fio___http_rcache_key(&key, h, args.vary))
+    return -1;
+  hash = fio_risky_hash(key.buf, key.len, 0);
+  now = h->received_at / FIO___HTTP_TIME_DIV;
+  personal = fio___http_rcache_is_personal(h);
+  fio_lock(&fio___http_rcache.lock);
+  e = fio___http_rcache_map_get(&fio___http_rcache.map, hash, key);
+  if (e && personal && e->expires && (!e->data || !e->is_public))
+    goto no_cache; /* only explicitly public responses are shared */
+  if (e && e->data && e->expires > now) { /* cache hit */
+    e = fio___http_rcache_dup(e);
+    fio_unlock(&fio___http_rcache.lock);
+    fio___http_rcache_send(h, e);
+    fio___http_rcache_free(e);
+    args.on_release(h, args.udata);
+    return 0;
+  }
+  if (e && !e->data && e->expires) { /* pending, wait for the response */
+    w = (fio___http_rcache_waiter_s *)
+        FIO_MEM_REALLOC_(NULL, 0, sizeof(*w), 0);
+    if (!w)
+      goto no_cache;
+    *w = (fio___http_rcache_waiter_s){.next = e->waiters,
+                                      .h = h,
+                                      .on_release = args.on_release,
+                                      .udata = args.udata};
+    e->waiters = w;
+    fio_unlock(&fio___http_rcache.lock);
+    return 0;
+  }
+  /* a miss, the response will be stored in a new (pending) entry */
+  e = fio___http_rcache_new();
+  if (!e)
+    goto no_cache;
+  e->ttl = args.ttl;
+  e->expires = 1; /* pending */
+  fio___http_rcache_map_set(&fio___http_rcache.map,
+                            hash,
+                            key,
+                            fio___http_rcache_dup(e),
+                            NULL);
+  fio_unlock(&fio___http_rcache.lock);
+  h->cache = (void *)e;
+  return -1;
+no_cache:
+  fio_unlock(&fio___http_rcache.lock);
+  return -1;
 }
 
-/** Writes `data` to the body (payload) associated with the HTTP handle. */
-SFUNC void fio_http_body_write(fio_http_s *h, const void *data, size_t len) {
-  if (!data || !len)
-    return;
-  ((h->body.fd == -1) ? fio___http_body_write_buf
-                      : fio___http_body_write_fd)(h, data, len);
+#else
+#define fio___http_rcache_store(h, args) fio___http_rcache_abort(h)
+#define fio___http_rcache_destroy()
+SFUNC int fio_http_cache(fio_http_s *h, fio_http_cache_args_s args) {
+  return -1;
+  (void)h, (void)args;
 }
+#endif /* FIO_HTTP_RESPONSE_CACHE_LIMIT */
 
 /* *****************************************************************************
 A Response Payload
@@ -1903,6 +3758,7 @@ FIO_IFUNC int fio___http_response_etag_if_none_match(fio_http_s *h) {
     return 0;
   h->status = 304;
   fio___http_hmap_set2(HTTP_HDR_RESPONSE(h),
+                       &h->arena,
                        FIO_STR_INFO2((char *)"content-length", 14),
                        FIO_STR_INFO2((char *)"0", 1),
                        -1);
@@ -1928,11 +3784,23 @@ FIO_SFUNC int fio____http_write_start(fio_http_s *h,
                                       fio_http_write_args_s *args) {
   /* if response has an `etag` header matching `if-none-match`, skip */
   fio___http_hmap_s *hdrs = h->headers + (!!h->status);
+  if (h->cache) /* store the response (before it's compressed / validated) */
+    fio___http_rcache_store(h, args);
+#if HAVE_ZLIB
+  /* select an encoding (marking the etag) before testing `if-none-match` */
+  int encoding = 0;
+  if (h->compress.min && h->status)
+    encoding = fio___http_compress_prepare(h, args);
+#endif
   if (h->status && args->len && fio___http_response_etag_if_none_match(h))
     return -1;
+#if HAVE_ZLIB
+  /* compress the response (updates headers and arguments) */
+  if (encoding)
+    fio___http_compress_start(h, args, encoding);
+#endif
   /* test if streaming / single body response */
-  if (!fio___http_hmap_get_ptr(hdrs,
-                               FIO_STR_INFO2((char *)"content-length", 14))) {
+  if (!fio___http_hmap_get(hdrs, FIO_STR_INFO2((char *)"content-length", 14))) {
     if (args->finish) {
       /* validate / set Content-Length (not streaming) */
       char ibuf[32];
@@ -1940,7 +3808,7 @@ FIO_SFUNC int fio____http_write_start(fio_http_s *h,
       fio_str_info_s v = FIO_STR_INFO3(ibuf, 0, 32);
       v.len = fio_digits10u(args->len);
       fio_ltoa10u(v.buf, args->len, v.len);
-      fio___http_hmap_set2(hdrs, k, v, -1);
+      fio___http_hmap_set2(hdrs, &h->arena, k, v, -1);
     } else {
       h->state |= FIO_HTTP_STATE_STREAMING;
     }
@@ -1948,13 +3816,16 @@ FIO_SFUNC int fio____http_write_start(fio_http_s *h,
   /* validate Date header */
   fio___http_hmap_set2(
       hdrs,
+      &h->arena,
       FIO_STR_INFO2((char *)"date", 4),
       fio_http_date(fio_http_get_timestump() / FIO___HTTP_TIME_DIV),
       0);
 
   /* start a response, unless status == 0 (which starts a request). */
   h->controller->send_headers(h);
-  return (h->writer = fio____http_write_cont)(h, args);
+  if (h->writer == fio____http_write_start)
+    h->writer = fio____http_write_cont;
+  return h->writer(h, args);
 }
 FIO_SFUNC int fio____http_write_cont(fio_http_s *h,
                                      fio_http_write_args_s *args) {
@@ -1985,10 +3856,15 @@ SFUNC void fio_http_write FIO_NOOP(fio_http_s *h, fio_http_write_args_s args) {
   return;
 
 handle_error:
-  if (args.fd)
-    close(args.fd);
-  if (args.dealloc && args.buf)
-    args.dealloc((void *)args.buf);
+  if (args.buf) {
+    if (args.dealloc)
+      args.dealloc((void *)args.buf);
+  } else if (args.fd > 0) {
+    if (args.dealloc)
+      args.dealloc((void *)(intptr_t)args.fd);
+    else
+      close(args.fd);
+  }
 }
 
 /* *****************************************************************************
@@ -2127,9 +4003,11 @@ SFUNC void fio_http_upgrade_sse(fio_http_s *h) {
   fio_http_response_header_set(h,
                                FIO_STR_INFO2((char *)"cache-control", 13),
                                FIO_STR_INFO2((char *)"no-store", 8));
-  fio___http_hmap_remove(HTTP_HDR_RESPONSE(h),
-                         FIO_STR_INFO2((char *)"content-length", 14),
-                         NULL);
+  fio___http_hmap_set2(HTTP_HDR_RESPONSE(h),
+                       &h->arena,
+                       FIO_STR_INFO2((char *)"content-length", 14),
+                       FIO_STR_INFO2(NULL, 0),
+                       -1);
   h->state |=
       FIO_HTTP_STATE_FINISHED | FIO_HTTP_STATE_UPGRADED | FIO_HTTP_STATE_SSE;
   h->controller->send_headers(h);
@@ -2211,16 +4089,15 @@ FIO_SFUNC int fio___http_header_parse_properties(fio_str_info_s *dst,
 FIO_IFUNC int fio___http_header_parse(fio___http_hmap_s *map,
                                       fio_str_info_s *dst,
                                       fio_str_info_s header_name) {
-  fio___http_sary_s *a =
-      fio___http_hmap_node2val_ptr(fio___http_hmap_get_ptr(map, header_name));
-  if (!a)
+  fio___http_hentry_s *head = fio___http_hmap_get(map, header_name);
+  if (!head)
     return -1;
   dst->len = 0;
   if (dst->capa < 3)
     return -1;
   dst->buf[dst->len++] = 0; /* first byte is a pretend NUL */
-  FIO_ARRAY_EACH(fio___http_sary, a, pos) {
-    fio_buf_info_s i = fio_bstr_buf(*pos);
+  FIO___HTTP_HMAP_EACH_VALUE(map, head, pos) {
+    fio_buf_info_s i = FIO_BUF_INFO2(pos->value, pos->value_len);
     if (!i.len)
       continue;
     char *const end = i.buf + i.len;
@@ -2242,6 +4119,8 @@ FIO_IFUNC int fio___http_header_parse(fio___http_hmap_s *map,
       dst->buf[dst->len++] = 0;
       if (prop != sep) { /* parse properties */
         ++prop;
+        while (prop < sep && (*prop == ' ' || *prop == '\t'))
+          ++prop;
         len = sep - prop;
         if ((len & (~(size_t)0x3FFF)) | (dst->len + len + 3 > dst->capa))
           return -1;
@@ -2326,6 +4205,170 @@ SFUNC void fio_http_send_error_response(fio_http_s *h, size_t status) {
   fio_http_write FIO_NOOP(h, args);
 }
 
+/* *****************************************************************************
+HTTP Logging - Buffered Writer
+
+Log lines are collected in one buffer while the other is written to STDOUT by a
+background thread (started lazily, per process).
+***************************************************************************** */
+
+static struct {
+  fio_thread_mutex_t lock;    /* protects the buffer */
+  fio_thread_mutex_t writing; /* held while a batch is written */
+  fio_thread_cond_t wake;
+  fio_thread_t thread;
+  fio_thread_pid_t pid; /* the process running the writer thread */
+  size_t len;
+  size_t dropped;
+  char *buf; /* collects log lines */
+  char *out; /* being written */
+  uint8_t sleeping;
+  uint8_t stop;
+  uint8_t sync; /* no writer thread, write lines immediately */
+} fio___http_log = {
+    .lock = FIO_THREAD_MUTEX_INIT,
+    .writing = FIO_THREAD_MUTEX_INIT,
+};
+static char fio___http_log_mem[2][FIO_HTTP_LOG_BUFFER_SIZE];
+
+/* writes the collected log lines (call with `writing` locked). */
+FIO_SFUNC void fio___http_log_flush_unsafe(void) {
+  char *out;
+  size_t len;
+  fio_thread_mutex_lock(&fio___http_log.lock);
+  out = fio___http_log.buf;
+  len = fio___http_log.len;
+  fio___http_log.buf = fio___http_log.out;
+  fio___http_log.out = out;
+  fio___http_log.len = 0;
+  fio_thread_mutex_unlock(&fio___http_log.lock);
+  if (!len)
+    return;
+  fwrite(out, 1, len, stdout);
+  fflush(stdout);
+}
+
+FIO_SFUNC void *fio___http_log_thread(void *ignr_) {
+  for (;;) {
+    fio_thread_mutex_lock(&fio___http_log.lock);
+    while (!fio___http_log.len && !fio___http_log.stop) {
+      fio___http_log.sleeping = 1;
+      fio_thread_cond_wait(&fio___http_log.wake, &fio___http_log.lock);
+    }
+    fio___http_log.sleeping = 0;
+    if (!fio___http_log.len) { /* stopped */
+      fio_thread_mutex_unlock(&fio___http_log.lock);
+      return NULL;
+    }
+    fio_thread_mutex_unlock(&fio___http_log.lock);
+    fio_thread_mutex_lock(&fio___http_log.writing);
+    fio___http_log_flush_unsafe();
+    fio_thread_mutex_unlock(&fio___http_log.writing);
+  }
+  (void)ignr_;
+}
+
+/* starts the writer thread for this process (call with `lock` locked). */
+FIO_SFUNC void fio___http_log_start(void) {
+  fio___http_log.pid = fio_thread_getpid();
+  fio___http_log.buf = fio___http_log_mem[0];
+  fio___http_log.out = fio___http_log_mem[1];
+  fio___http_log.len = 0; /* lines collected by a parent are the parent's */
+  fio___http_log.sleeping = 0;
+  fio___http_log.stop = 0;
+  fio___http_log.sync = 1;
+  if (fio_thread_cond_init(&fio___http_log.wake))
+    goto failed;
+  if (fio_thread_create(&fio___http_log.thread, fio___http_log_thread, NULL))
+    goto failed_thread;
+  fio___http_log.sync = 0;
+  return;
+failed_thread:
+  fio_thread_cond_destroy(&fio___http_log.wake);
+failed:
+  FIO_LOG_ERROR("HTTP logging thread failed to start, logging synchronously.");
+}
+
+/* adds a line to the log buffer, waking the writer thread if sleeping. */
+FIO_SFUNC void fio___http_log_write(const char *line, size_t len) {
+  uint8_t wake;
+  if (len > FIO_HTTP_LOG_BUFFER_SIZE)
+    len = FIO_HTTP_LOG_BUFFER_SIZE;
+  for (;;) {
+    fio_thread_mutex_lock(&fio___http_log.lock);
+    if (fio___http_log.pid != fio_thread_getpid())
+      fio___http_log_start();
+    if (fio___http_log.len + len <= FIO_HTTP_LOG_BUFFER_SIZE)
+      break;
+    if (FIO_HTTP_LOG_DROP_WHEN_FULL && !fio___http_log.sync) {
+      ++fio___http_log.dropped;
+      fio_thread_mutex_unlock(&fio___http_log.lock);
+      return;
+    }
+    fio_thread_mutex_unlock(&fio___http_log.lock);
+    if (fio___http_log.sync) { /* no writer thread, write the buffer now */
+      fio_thread_mutex_lock(&fio___http_log.writing);
+      fio___http_log_flush_unsafe();
+      fio_thread_mutex_unlock(&fio___http_log.writing);
+      continue;
+    }
+    FIO_THREAD_RESCHEDULE(); /* wait for the writer thread */
+  }
+  FIO_MEMCPY(fio___http_log.buf + fio___http_log.len, line, len);
+  fio___http_log.len += len;
+  wake = fio___http_log.sleeping;
+  fio___http_log.sleeping = 0;
+  fio_thread_mutex_unlock(&fio___http_log.lock);
+  if (wake)
+    fio_thread_cond_signal(&fio___http_log.wake);
+  if (!fio___http_log.sync)
+    return;
+  fio_thread_mutex_lock(&fio___http_log.writing);
+  fio___http_log_flush_unsafe();
+  fio_thread_mutex_unlock(&fio___http_log.writing);
+}
+
+/* the writer thread isn't copied by `fork`, reset the state for the child. */
+FIO_SFUNC void fio___http_log_on_fork(void *ignr_) {
+  fio_thread_mutex_init(&fio___http_log.lock);
+  fio_thread_mutex_init(&fio___http_log.writing);
+  fio___http_log.pid = 0;
+  (void)ignr_;
+}
+
+/* stops the writer thread and writes any remaining log lines. */
+FIO_SFUNC void fio___http_log_at_exit(void *ignr_) {
+  if (fio___http_log.pid != fio_thread_getpid())
+    return;
+  if (!fio___http_log.sync) {
+    fio_thread_mutex_lock(&fio___http_log.lock);
+    fio___http_log.stop = 1;
+    fio___http_log.sync = 1;
+    fio_thread_mutex_unlock(&fio___http_log.lock);
+    fio_thread_cond_signal(&fio___http_log.wake);
+    fio_thread_join(&fio___http_log.thread);
+    fio_thread_cond_destroy(&fio___http_log.wake);
+  }
+  fio_thread_mutex_lock(&fio___http_log.writing);
+  fio___http_log_flush_unsafe();
+  fio_thread_mutex_unlock(&fio___http_log.writing);
+  (void)ignr_;
+}
+
+FIO_CONSTRUCTOR(fio___http_log_constructor) {
+  fio_state_callback_add(FIO_CALL_IN_CHILD, fio___http_log_on_fork, NULL);
+  fio_state_callback_add(FIO_CALL_AT_EXIT, fio___http_log_at_exit, NULL);
+}
+
+/** Returns the number of log lines dropped because the log buffer was full. */
+SFUNC size_t fio_http_log_dropped(void) {
+  size_t r;
+  fio_thread_mutex_lock(&fio___http_log.lock);
+  r = fio___http_log.dropped;
+  fio_thread_mutex_unlock(&fio___http_log.lock);
+  return r;
+}
+
 /* *****************************************************************************
 HTTP Logging
 ***************************************************************************** */
@@ -2397,7 +4440,7 @@ SFUNC void fio_http_write_log(fio_http_s *h, fio_buf_info_s peer_addr) {
   if (buf.buf[buf.len - 1] != '\n')
     buf.buf[buf.len++] = '\n'; /* log was truncated, data too long */
 
-  fwrite(buf.buf, 1, buf.len, stdout);
+  fio___http_log_write(buf.buf, buf.len);
   h->received_at = time_end;
 }
 
@@ -2433,7 +4476,9 @@ SFUNC int fio_http_etag_is_match(fio_http_s *h) {
       ++cond.buf;
     if (cond.buf > end || (size_t)(end - cond.buf) < (size_t)etag.len)
       return 0;
-    if (FIO_MEMCMP(cond.buf, etag.buf, etag.len)) {
+    if (FIO_MEMCMP(cond.buf, etag.buf, etag.len) ||
+        (cond.buf + etag.len < end && cond.buf[etag.len] != ',' &&
+         cond.buf[etag.len] != ' ')) { /* no match (or only a prefix match) */
       cond.buf = (char *)FIO_MEMCHR(cond.buf, ',', end - cond.buf);
       if (!cond.buf)
         return 0;
@@ -2456,159 +4501,360 @@ Param Parsing (TODO! - parse query, parse mime/multipart parse text/json)
 ***************************************************************************** */
 
 /* *****************************************************************************
-Static file helper
+Static file cache
+
+Resolved static files (and their pre-compressed variants) are cached by the
+requested (decoded) path. Small files are also kept in memory.
+
+Entries are re-validated against the file system after
+FIO_HTTP_STATIC_CACHE_TTL seconds and are immutable once published, so they
+can be safely shared between threads (using reference counting).
 ***************************************************************************** */
 
-/**
- * Attempts to send a static file from the `root` folder. On success the
- * response is complete and 0 is returned. Otherwise returns -1.
- */
-SFUNC int fio_http_static_file_response(fio_http_s *h,
-                                        fio_str_info_s rt,
-                                        fio_str_info_s fnm,
-                                        size_t max_age) {
-  int fd = -1;
-  /* combine public folder with path to get file name */
-  fio_str_info_s mime_type = {0};
-  FIO_STR_INFO_TMP_VAR(etag, 31);
-  FIO_STR_INFO_TMP_VAR(filename, 4095);
-  { /* test for HEAD and OPTIONS requests */
-    fio_str_info_s m = fio_keystr_info(&h->method);
-    if ((m.len == 7 && (fio_buf2u64u(m.buf) | 0x2020202020202020ULL) ==
-                           (fio_buf2u64u("options") | 0x2020202020202020ULL)))
-      goto file_not_found;
+/** Number of static file variants: identity, `gz`, `br`, `zip` (deflate). */
+#define FIO___HTTP_SFILE_VARIANTS 4
+
+static const struct {
+  fio_str_info_s encoding;
+  fio_buf_info_s ext;
+} fio___http_sfile_variants[FIO___HTTP_SFILE_VARIANTS] = {
+    {{0}, {0}},
+    {{.buf = (char *)"gzip", .len = 4}, {.buf = (char *)".gz", .len = 3}},
+    {{.buf = (char *)"br", .len = 2}, {.buf = (char *)".br", .len = 3}},
+    {{.buf = (char *)"deflate", .len = 7}, {.buf = (char *)".zip", .len = 4}},
+};
+
+/** A resolved static file and its pre-compressed variants. */
+typedef struct {
+  /** Time (in seconds) after which the file system must be re-checked. */
+  int64_t expires;
+  /** A bitmap of the available variants (bit 0 is the file itself). */
+  uint8_t variants;
+  /** The resolved file name length (the name is stored in `name`). */
+  uint32_t len;
+  struct {
+    /** File data (a `fio_bstr`), if the file is small enough. */
+    char *data;
+    /** File length. */
+    size_t len;
+    /** Last modification time, used to validate open files. */
+    time_t mtime;
+    /** Pre-rendered ETag value. */
+    uint8_t etag_len;
+    char etag[19];
+    /** Pre-rendered Last-Modified value. */
+    uint8_t date_len;
+    char date[35];
+  } v[FIO___HTTP_SFILE_VARIANTS];
+  /** The resolved file name. */
+  char name[];
+} fio___http_sfile_s;
+
+#define FIO_REF_NAME             fio___http_sfile
+#define FIO_REF_FLEX_TYPE        char
+#define FIO_REF_CONSTRUCTOR_ONLY 1
+#define FIO_REF_DESTROY(o)                                                     \
+  do {                                                                         \
+    for (size_t i_ = 0; i_ < FIO___HTTP_SFILE_VARIANTS; ++i_)                  \
+      fio_bstr_free(o.v[i_].data);                                             \
+  } while (0)
+#define FIO___RECURSIVE_INCLUDE 1
+#include FIO_INCLUDE_FILE
+#undef FIO___RECURSIVE_INCLUDE
+
+/** Used as a `dealloc` callback for in-memory file data. */
+FIO_SFUNC void fio___http_sfile_data_free(void *data) {
+  fio_bstr_free((char *)data);
+}
+
+#ifdef H___FIO_SERVER___H
+/* when available, use the server's shared file descriptors */
+#define fio___http_sfile_open(name, st) fio_srv_file_open((name), (st))
+#define fio___http_sfile_close(fd)      fio_srv_file_close((fd))
+#define fio___http_sfile_release        fio_srv_file_release
+#else
+FIO_SFUNC int fio___http_sfile_open(const char *name, struct stat *st) {
+  int fd = fio_filename_open(name, O_RDONLY);
+  if (fd != -1 && fstat(fd, st)) {
+    close(fd);
+    fd = -1;
   }
-  rt.len -= ((rt.len > 0) && fnm.buf[0] == '/' &&
-             (rt.buf[rt.len - 1] == '/' || rt.buf[rt.len - 1] == '\\'));
-  fio_string_write(&filename, NULL, rt.buf, rt.len);
-  fio_string_write_url_dec(&filename, NULL, fnm.buf, fnm.len);
-  if (fio_filename_is_unsafe_url(filename.buf))
-    goto file_not_found;
+  return fd;
+}
+FIO_SFUNC void fio___http_sfile_close(int fd) {
+  if (fd != -1)
+    close(fd);
+}
+#define fio___http_sfile_release NULL
+#endif
 
-  if (filename.buf[filename.len - 1] == '/')
-    fio_string_write(&filename,
+/** Resolves a (decoded) file name to a static file object, or returns NULL. */
+FIO_SFUNC fio___http_sfile_s *fio___http_sfile_resolve(
+    fio_str_info_s *filename) {
+  fio___http_sfile_s *f;
+  struct stat stt;
+  if (filename->buf[filename->len - 1] == '/')
+    fio_string_write(filename,
                      NULL,
                      "/" FIO_HTTP_DEFAULT_INDEX_FILENAME,
                      sizeof(FIO_HTTP_DEFAULT_INDEX_FILENAME));
 
   { /* Test for incomplete file name */
-    size_t file_type = fio_filename_type(filename.buf);
+    size_t file_type = fio_filename_type(filename->buf);
 #if FIO_HTTP_STATIC_FILE_COMPLETION
     if (!file_type) {
-      char *ext = filename.buf + filename.len;
+      char *ext = filename->buf + filename->len;
       do {
         --ext;
       } while (ext[0] != '.' && ext[0] != '/');
       if (ext[0] == '.')
-        goto file_not_found;
-      fio_string_write(&filename, NULL, ".html", 5);
-      file_type = fio_filename_type(filename.buf);
+        return NULL;
+      fio_string_write(filename, NULL, ".html", 5);
+      file_type = fio_filename_type(filename->buf);
     }
     switch (file_type) {
 #ifdef S_IFDIR
     case S_IFDIR:
-      fio_string_write(&filename,
+      fio_string_write(filename,
                        NULL,
                        "/" FIO_HTTP_DEFAULT_INDEX_FILENAME,
                        sizeof(FIO_HTTP_DEFAULT_INDEX_FILENAME));
-      if (!fio_filename_type(filename.buf))
-        goto file_not_found;
+      if (!fio_filename_type(filename->buf))
+        return NULL;
       break;
 #endif
     case S_IFREG: break;
 #ifdef S_IFLNK
     case S_IFLNK: break;
 #endif
-    default: goto file_not_found;
+    default: return NULL;
     }
 #else
     if (!file_type)
-      goto file_not_found;
+      return NULL;
 #endif
   }
-  {
-    /* find mime type if registered */
-    char *end = filename.buf + filename.len;
-    char *ext = end;
-    do {
-      --ext;
-    } while (ext[0] != '.' && ext[0] != '/');
-    if ((ext++)[0] == '.') {
-      mime_type = fio_http_mimetype(ext, end - ext);
-      if (!mime_type.len)
-        FIO_LOG_WARNING("missing mime-type for extension %s (not registered).",
-                        ext);
+
+  f = fio___http_sfile_new(filename->len + 1);
+  if (!f)
+    return f;
+  f->expires = (fio_http_get_timestump() / FIO___HTTP_TIME_DIV) +
+               FIO_HTTP_STATIC_CACHE_TTL;
+  f->len = (uint32_t)filename->len;
+  FIO_MEMCPY(f->name, filename->buf, filename->len);
+  f->name[f->len] = 0;
+
+  for (size_t i = 0; i < FIO___HTTP_SFILE_VARIANTS; ++i) {
+    fio_string_write(filename,
+                     NULL,
+                     fio___http_sfile_variants[i].ext.buf,
+                     fio___http_sfile_variants[i].ext.len);
+    if (stat(filename->buf, &stt) || (stt.st_mode & S_IFMT) != S_IFREG)
+      goto next_variant;
+    f->variants |= (uint8_t)(1U << i);
+    f->v[i].len = (size_t)stt.st_size;
+    f->v[i].mtime = stt.st_mtime;
+    { /* ETag only hashes stable data (access time is ignored) */
+      uint64_t etag_data[4] = {(uint64_t)stt.st_dev,
+                               (uint64_t)stt.st_ino,
+                               (uint64_t)stt.st_size,
+                               (uint64_t)stt.st_mtime};
+      fio_str_info_s etag = FIO_STR_INFO3(f->v[i].etag, 0, 18);
+      fio_string_write_hex(&etag,
+                           NULL,
+                           fio_risky_hash(etag_data, sizeof(etag_data), 0));
+      f->v[i].etag_len = (uint8_t)etag.len;
     }
+    f->v[i].date_len = (uint8_t)fio_time2rfc7231(f->v[i].date, stt.st_mtime);
+    if (f->v[i].len && f->v[i].len <= FIO_HTTP_STATIC_CACHE_FILE_LIMIT) {
+      f->v[i].data = fio_bstr_readfile(NULL, filename->buf, 0, f->v[i].len);
+      if (fio_bstr_len(f->v[i].data) != f->v[i].len) { /* file changed? */
+        fio_bstr_free(f->v[i].data);
+        f->v[i].data = NULL;
+      }
+    }
+  next_variant:
+    filename->len = f->len;
+    filename->buf[filename->len] = 0;
   }
-  {
+  if (!(f->variants & 1)) {
+    fio___http_sfile_free(f);
+    return NULL;
+  }
+  return f;
+}
+
+#if FIO_HTTP_STATIC_CACHE_LIMIT
+#define FIO_MAP_NAME              fio___http_sfile_map
+#define FIO_MAP_VALUE             fio___http_sfile_s *
+#define FIO_MAP_VALUE_DESTROY(o)  fio___http_sfile_free(o)
+#define FIO_MAP_VALUE_DISCARD(o)  fio___http_sfile_free(o)
+#define FIO_MAP_LRU               FIO_HTTP_STATIC_CACHE_LIMIT
+#define FIO___RECURSIVE_INCLUDE   1
+#include FIO_INCLUDE_FILE
+#undef FIO___RECURSIVE_INCLUDE
+
+static struct {
+  fio___http_sfile_map_s map;
+  fio_lock_i lock;
+} fio___http_sfile_cache = {.map = FIO_MAP_INIT, .lock = FIO_LOCK_INIT};
+
+/** Removes a cached static file object (i.e., if it changed on disk). */
+FIO_SFUNC void fio___http_sfile_forget(fio_str_info_s key, uint64_t hash) {
+  fio_lock(&fio___http_sfile_cache.lock);
+  fio___http_sfile_map_remove(&fio___http_sfile_cache.map, hash, key, NULL);
+  fio_unlock(&fio___http_sfile_cache.lock);
+}
+
+FIO_SFUNC void fio___http_sfile_cache_destroy(void) {
+  fio_lock(&fio___http_sfile_cache.lock);
+  fio___http_sfile_map_destroy(&fio___http_sfile_cache.map);
+  fio_unlock(&fio___http_sfile_cache.lock);
+}
+#else
+#define fio___http_sfile_forget(key, hash)
+#define fio___http_sfile_cache_destroy()
+#endif /* FIO_HTTP_STATIC_CACHE_LIMIT */
+
+/**
+ * Returns a static file object (caller must free), or NULL if not found.
+ *
+ * `filename` is used as a buffer (should have enough capacity for the file
+ * name's completion). On success, the cache key is left intact in `filename`.
+ */
+FIO_SFUNC fio___http_sfile_s *fio___http_sfile_get(fio_str_info_s *filename,
+                                                   uint64_t hash,
+                                                   int skip_cache) {
+  fio___http_sfile_s *f;
+#if FIO_HTTP_STATIC_CACHE_LIMIT
+  const fio_str_info_s key = FIO_STR_INFO2(filename->buf, filename->len);
+  if (!skip_cache) {
+    const int64_t now = fio_http_get_timestump() / FIO___HTTP_TIME_DIV;
+    fio_lock(&fio___http_sfile_cache.lock);
+    f = fio___http_sfile_map_get(&fio___http_sfile_cache.map, hash, key);
+    f = (f && f->expires > now) ? fio___http_sfile_dup(f) : NULL;
+    fio_unlock(&fio___http_sfile_cache.lock);
+    if (f)
+      return f;
+  }
+  f = fio___http_sfile_resolve(filename);
+  filename->len = key.len;
+  filename->buf[key.len] = 0;
+  fio_lock(&fio___http_sfile_cache.lock);
+  if (f)
+    fio___http_sfile_map_set(&fio___http_sfile_cache.map,
+                             hash,
+                             key,
+                             fio___http_sfile_dup(f),
+                             NULL);
+  else
+    fio___http_sfile_map_remove(&fio___http_sfile_cache.map, hash, key, NULL);
+  fio_unlock(&fio___http_sfile_cache.lock);
+#else
+  f = fio___http_sfile_resolve(filename);
+  (void)hash, (void)skip_cache;
+#endif
+  return f;
+}
+
+/* *****************************************************************************
+Static file helper
+***************************************************************************** */
+
+/**
+ * Attempts to send a static file from the `root` folder. On success the
+ * response is complete and 0 is returned. Otherwise returns -1.
+ */
+SFUNC int fio_http_static_file_response(fio_http_s *h,
+                                        fio_str_info_s rt,
+                                        fio_str_info_s fnm,
+                                        size_t max_age) {
+  int fd = -1;
+  size_t v = 0; /* variant */
+  size_t file_length, file_offset = 0;
+  uint64_t hash;
+  int skip_cache = 0;
+  fio___http_sfile_s *f = NULL;
+  fio_str_info_s mime_type = {0};
+  FIO_STR_INFO_TMP_VAR(filename, 4095);
+  { /* test for HEAD and OPTIONS requests */
+    fio_str_info_s m = fio_keystr_info(&h->method);
+    if ((m.len == 7 && (fio_buf2u64u(m.buf) | 0x2020202020202020ULL) ==
+                           (fio_buf2u64u("options") | 0x2020202020202020ULL)))
+      return -1;
+  }
+  /* combine public folder with path to get file name */
+  rt.len -= ((rt.len > 0) && fnm.buf[0] == '/' &&
+             (rt.buf[rt.len - 1] == '/' || rt.buf[rt.len - 1] == '\\'));
+  fio_string_write(&filename, NULL, rt.buf, rt.len);
+  fio_string_write_url_dec(&filename, NULL, fnm.buf, fnm.len);
+  if (fio_filename_is_unsafe_url(filename.buf))
+    return -1;
+  hash = fio_risky_hash(filename.buf, filename.len, 0);
+
+find_file:
+  f = fio___http_sfile_get(&filename, hash, skip_cache);
+  if (!f)
+    return -1;
+
+  if (f->variants > 1) { /* test for pre-compressed variants */
     fio_str_info_s ac =
         fio_http_request_header(h,
                                 FIO_STR_INFO2((char *)"accept-encoding", 15),
                                 0);
-    if (!ac.len)
-      goto accept_encoding_header_test_done;
-    struct {
-      char *value;
-      fio_buf_info_s ext;
-    } options[] = {{(char *)"gzip", FIO_BUF_INFO2((char *)".gz", 3)},
-                   {(char *)"br", FIO_BUF_INFO2((char *)".br", 3)},
-                   {(char *)"deflate", FIO_BUF_INFO2((char *)".zip", 4)},
-                   {NULL}};
-    for (size_t i = 0; options[i].value; ++i) {
-      if (!strstr(ac.buf, options[i].value))
-        continue;
-      fio_string_write(&filename, NULL, options[i].ext.buf, options[i].ext.len);
-      if (!fio_filename_type(filename.buf)) {
-        filename.len -= options[i].ext.len;
-        filename.buf[filename.len] = 0;
+    for (size_t i = 1; ac.len && i < FIO___HTTP_SFILE_VARIANTS; ++i) {
+      if (!(f->variants & (1U << i)) ||
+          !strstr(ac.buf, fio___http_sfile_variants[i].encoding.buf))
         continue;
-      }
-      fio_http_response_header_set(
-          h,
-          FIO_STR_INFO2((char *)"vary", 4),
-          FIO_STR_INFO2((char *)"accept-encoding", 15));
-      fio_http_response_header_set(
-          h,
-          FIO_STR_INFO2((char *)"content-encoding", 16),
-          FIO_STR_INFO1(options[i].value));
+      v = i;
       break;
     }
   }
 
-accept_encoding_header_test_done:
-  /* attempt to open file */
-  fd = fio_filename_open(filename.buf, O_RDONLY);
-  if (fd == -1)
-    goto file_not_found;
-
-  { /* test / validate etag */
+  if (!f->v[v].data) { /* attempt to open file */
     struct stat stt;
-    if (fstat(fd, &stt))
-      goto file_not_found;
-    uint64_t etag_hash = fio_risky_hash(&stt, sizeof(stt), 0);
-    fio_string_write_hex(&etag, NULL, etag_hash);
-    fio_http_response_header_set(h, FIO_STR_INFO2((char *)"etag", 4), etag);
+    FIO_STR_INFO_TMP_VAR(name, 4103);
+    fio_string_write2(
+        &name,
+        NULL,
+        FIO_STRING_WRITE_STR2(f->name, f->len),
+        FIO_STRING_WRITE_STR2(fio___http_sfile_variants[v].ext.buf,
+                              fio___http_sfile_variants[v].ext.len));
+    fd = fio___http_sfile_open(name.buf, &stt);
+    if (fd == -1 || (size_t)stt.st_size != f->v[v].len ||
+        stt.st_mtime != f->v[v].mtime)
+      goto file_changed;
+  }
+
+  if (v) {
+    fio_http_response_header_set(h,
+                                 FIO_STR_INFO2((char *)"vary", 4),
+                                 FIO_STR_INFO2((char *)"accept-encoding", 15));
+    fio_http_response_header_set(h,
+                                 FIO_STR_INFO2((char *)"content-encoding", 16),
+                                 fio___http_sfile_variants[v].encoding);
+  }
+  fio_http_response_header_set(
+      h,
+      FIO_STR_INFO2((char *)"etag", 4),
+      FIO_STR_INFO2(f->v[v].etag, (size_t)f->v[v].etag_len));
+  fio_http_response_header_set(
+      h,
+      FIO_STR_INFO1((char *)"last-modified"),
+      FIO_STR_INFO2(f->v[v].date, (size_t)f->v[v].date_len));
+  if (max_age) {
     filename.len = 0;
-    filename.len = fio_time2rfc7231(filename.buf, stt.st_mtime);
+    fio_string_write2(&filename,
+                      NULL,
+                      FIO_STRING_WRITE_STR2("max-age=", 8),
+                      FIO_STRING_WRITE_UNUM(max_age));
     fio_http_response_header_set(h,
-                                 FIO_STR_INFO1((char *)"last-modified"),
+                                 FIO_STR_INFO1((char *)"cache-control"),
                                  filename);
-    if (max_age) {
-      filename.len = 0;
-      fio_string_write2(&filename,
-                        NULL,
-                        FIO_STRING_WRITE_STR2("max-age=", 8),
-                        FIO_STRING_WRITE_UNUM(max_age));
-      fio_http_response_header_set(h,
-                                   FIO_STR_INFO1((char *)"cache-control"),
-                                   filename);
-    }
-    filename.len = stt.st_size;
-    filename.capa = 0;
-    if (fio___http_response_etag_if_none_match(h))
-      return 0;
   }
-  /* Note: at this point filename.len holds the length of the file */
+  if (fio___http_response_etag_if_none_match(h))
+    goto finish;
+  file_length = f->v[v].len;
 
   /* test for range requests. */
   {
@@ -2620,13 +4866,15 @@ accept_encoding_header_test_done:
     {
       fio_str_info_s ifrng =
           fio_http_request_header(h, FIO_STR_INFO2((char *)"if-range", 8), 0);
-      if (ifrng.len && !FIO_STR_INFO_IS_EQ(ifrng, etag))
+      if (ifrng.len &&
+          !FIO_STR_INFO_IS_EQ(
+              ifrng,
+              FIO_STR_INFO2(f->v[v].etag, (size_t)f->v[v].etag_len)))
         goto range_request_review_finished;
     }
     if (rng.len < 7 || fio_buf2u32u(rng.buf) != fio_buf2u32u("byte") ||
         fio_buf2u16u(rng.buf + 4) != fio_buf2u16u("s="))
       goto range_request_review_finished;
-    const size_t file_length = filename.len;
     char *ipos = rng.buf + 6;
     size_t start_range = fio_atol10u(&ipos);
     if (ipos == rng.buf + 6)
@@ -2635,20 +4883,19 @@ accept_encoding_header_test_done:
       goto range_request_review_finished;
     ++ipos;
     size_t end_range = fio_atol10u(&ipos);
-    if (end_range > file_length)
+    if (end_range > f->v[v].len)
       goto range_request_review_finished;
     if (!end_range)
-      end_range = file_length - 1;
+      end_range = f->v[v].len - 1;
     if (start_range > end_range) {
-      start_range = file_length - end_range;
-      end_range = file_length - 1;
+      start_range = f->v[v].len - end_range;
+      end_range = f->v[v].len - 1;
     }
-    if (!start_range && end_range + 1 == file_length)
+    if (!start_range && end_range + 1 == f->v[v].len)
       goto range_request_review_finished;
     /* update response headers and info */
     h->status = 206;
     filename.len = 0;
-    filename.capa = 1024;
     fio_string_write2(&filename,
                       NULL,
                       FIO_STRING_WRITE_STR2("bytes ", 6),
@@ -2656,12 +4903,12 @@ accept_encoding_header_test_done:
                       FIO_STRING_WRITE_STR2("-", 1),
                       FIO_STRING_WRITE_UNUM((end_range)),
                       FIO_STRING_WRITE_STR2("/", 1),
-                      FIO_STRING_WRITE_UNUM(file_length));
+                      FIO_STRING_WRITE_UNUM(f->v[v].len));
     fio_http_response_header_set(h,
                                  FIO_STR_INFO2((char *)"content-range", 13),
                                  filename);
-    filename.len = (end_range - start_range) + 1;
-    filename.capa = start_range;
+    file_length = (end_range - start_range) + 1;
+    file_offset = start_range;
     fio_http_response_header_set(h,
                                  FIO_STR_INFO2((char *)"etag", 4),
                                  FIO_STR_INFO2(NULL, 0));
@@ -2680,6 +4927,19 @@ range_request_review_finished:
       goto head_request;
   }
 
+  { /* find mime type if registered */
+    char *end = f->name + f->len;
+    char *ext = end;
+    do {
+      --ext;
+    } while (ext > f->name && ext[0] != '.' && ext[0] != '/');
+    if ((ext++)[0] == '.') {
+      mime_type = fio_http_mimetype(ext, end - ext);
+      if (!mime_type.len)
+        FIO_LOG_WARNING("missing mime-type for extension %s (not registered).",
+                        ext);
+    }
+  }
   /* finish up (set mime type and send file) */
   if (mime_type.len)
     fio_http_response_header_set(h,
@@ -2687,27 +4947,39 @@ range_request_review_finished:
                                  mime_type);
   { /* send response (avoid macro for C++ compatibility) */
     fio_http_write_args_s args = {
+        .buf = fio_bstr_copy(f->v[v].data),
         .fd = fd,
-        .len = filename.len,     /* now holds body length */
-        .offset = filename.capa, /* now holds starting offset */
+        .len = file_length,
+        .offset = file_offset,
+        .dealloc = (f->v[v].data ? fio___http_sfile_data_free
+                                 : fio___http_sfile_release),
         .finish = 1};
     fio_http_write FIO_NOOP(h, args);
   }
+  fio___http_sfile_free(f);
   return 0;
 
-file_not_found:
-  if (fd != -1)
-    close(fd);
-  return -1;
+file_changed:
+  fio___http_sfile_close(fd);
+  fd = -1;
+  fio___http_sfile_forget(FIO_STR_INFO2(filename.buf, filename.len), hash);
+  fio___http_sfile_free(f);
+  if (skip_cache)
+    return -1;
+  skip_cache = 1;
+  v = 0;
+  goto find_file;
 
 head_request:
   /* TODO! HEAD responses should close?. */
-  if (fd != -1)
-    close(fd);
   {
     fio_http_write_args_s args = {.finish = 1};
     fio_http_write FIO_NOOP(h, args);
   }
+
+finish:
+  fio___http_sfile_close(fd);
+  fio___http_sfile_free(f);
   return 0;
 }
 
@@ -3011,32 +5283,13 @@ Constructor / Destructor
 
 FIO_SFUNC void fio___http_cleanup(void *ignr_) {
   (void)ignr_;
-#if FIO_HTTP_CACHE_LIMIT
-  for (size_t i = 0; i < 2; ++i) {
-    const char *names[] = {"cookie names", "header values"};
-    FIO_LOG_DEBUG2(
-        "freeing %zu strings from %s cache (capacity was: %zu)",
-        fio___http_str_cache_count(&FIO___HTTP_STRING_CACHE[i].cache),
-        names[i],
-        fio___http_str_cache_capa(&FIO___HTTP_STRING_CACHE[i].cache));
-#ifdef FIO_LOG_LEVEL_DEBUG
-    if (FIO_LOG_LEVEL_DEBUG == FIO_LOG_LEVEL) {
-      FIO_MAP_EACH(fio___http_str_cache,
-                   (&FIO___HTTP_STRING_CACHE[i].cache),
-                   pos) {
-        fprintf(stderr, "\t \"%s\" (%zu bytes)\n", pos.key.buf, pos.key.len);
-      }
-    }
-#endif
-    fio___http_str_cache_destroy(&FIO___HTTP_STRING_CACHE[i].cache);
-    FIO___LOCK_DESTROY(FIO___HTTP_STRING_CACHE[i].lock);
-    (void)names; /* if unused */
-  }
-#endif /* FIO_HTTP_CACHE_LIMIT */
   FIO_LOG_DEBUG2("HTTP MIME hash storage count/capa: %zu / %zu",
                  FIO___HTTP_MIMETYPES.count,
                  fio___http_mime_map_capa(&FIO___HTTP_MIMETYPES));
   fio___http_mime_map_destroy(&FIO___HTTP_MIMETYPES);
+  fio___http_sfile_cache_destroy();
+  fio___http_zcache_destroy();
+  fio___http_rcache_destroy();
 }
 
 FIO_CONSTRUCTOR(fio___http_str_cache_static_builder) {
@@ -3049,6 +5302,14 @@ FIO_CONSTRUCTOR(fio___http_str_cache_static_builder) {
 Cleanup
 ***************************************************************************** */
 #undef FIO___HTTP_TIME_DIV
+#undef FIO___HTTP_SFILE_VARIANTS
+#undef fio___http_sfile_open
+#undef fio___http_sfile_close
+#undef fio___http_sfile_release
+#undef fio___http_compress_free
+#undef fio___http_zcache_get
+#undef fio___http_zcache_set
+#undef fio___http_zcache_destroy
 #undef FIO___HTTP_TIME_UNIT
 
 #endif /* FIO_EXTERN_COMPLETE */
@@ -44,6 +44,24 @@ FIO_SFUNC size_t fio_http1_parse(fio_http1_parser_s *p,
 /** Returns true if the parser is waiting to parse a new request/response .*/
 FIO_IFUNC size_t fio_http1_parser_is_empty(fio_http1_parser_s *p);
 
+/** Returns true if the parser is reading a body (the headers were parsed). */
+FIO_IFUNC size_t fio_http1_parser_is_body(fio_http1_parser_s *p);
+
+/**
+ * Marks the response being parsed as ending when the connection closes, unless
+ * its headers set a length (`content-length` or a chunked encoding).
+ *
+ * Call from `fio_http1_on_status` (not for HEAD, 1xx, 204 and 304 responses).
+ */
+FIO_IFUNC void fio_http1_parser_until_close(fio_http1_parser_s *p);
+
+/**
+ * Completes a response read until the connection closed (EOF).
+ *
+ * Returns 0 if `fio_http1_on_complete` was called, otherwise -1.
+ */
+FIO_SFUNC int fio_http1_parse_eof(fio_http1_parser_s *p, void *udata);
+
 /** The error return value for fio_http1_parse. */
 #define FIO_HTTP1_PARSER_ERROR ((size_t)-1)
 
@@ -98,6 +116,10 @@ static int fio_http1___read_body(fio_http1_parser_s *p,
 static int fio_http1___read_body_chunked(fio_http1_parser_s *p,
                                          fio_buf_info_s *buf,
                                          void *udata);
+/* parsing stage 2 - read body until the connection closes (responses). */
+static int fio_http1___read_body_until_close(fio_http1_parser_s *p,
+                                             fio_buf_info_s *buf,
+                                             void *udata);
 /* parsing stage 1 - read headers. */
 static int fio_http1___read_trailer(fio_http1_parser_s *p,
                                     fio_buf_info_s *buf,
@@ -122,6 +144,14 @@ FIO_IFUNC size_t fio_http1_parser_is_empty(fio_http1_parser_s *p) {
   return !p->fn || p->fn == fio_http1___start;
 }
 
+/** Returns true if the parser is reading a body (the headers were parsed). */
+FIO_IFUNC size_t fio_http1_parser_is_body(fio_http1_parser_s *p) {
+  return p->fn == fio_http1___read_body ||
+         p->fn == fio_http1___read_body_chunked ||
+         p->fn == fio_http1___read_trailer ||
+         p->fn == fio_http1___read_body_until_close;
+}
+
 /* *****************************************************************************
 Main Parsing Loop
 ***************************************************************************** */
@@ -141,7 +171,14 @@ FIO_SFUNC size_t fio_http1_parse(fio_http1_parser_s *p,
     return FIO_HTTP1_PARSER_ERROR;
   return buf.buf - buf_start;
 }
-#define HTTP1___EXPECTED_CHUNKED ((size_t)(-1))
+#define HTTP1___EXPECTED_CHUNKED     ((size_t)(-1))
+#define HTTP1___EXPECTED_UNTIL_CLOSE ((size_t)(-2))
+
+/** Marks the response being parsed as ending when the connection closes. */
+FIO_IFUNC void fio_http1_parser_until_close(fio_http1_parser_s *p) {
+  if (!p->expected)
+    p->expected = HTTP1___EXPECTED_UNTIL_CLOSE;
+}
 
 /* completed parsing. */
 static int fio_http1___finish(fio_http1_parser_s *p,
@@ -153,6 +190,280 @@ static int fio_http1___finish(fio_http1_parser_s *p,
   return 1;
 }
 
+/* *****************************************************************************
+Tokenizer - Block Scanning (SIMD / SWAR)
+
+The first line and header names are scanned in 16-32 byte blocks (8 byte words
+when no vector registers are available), finding delimiters and validating the
+bytes in the same pass. The (less common) bytes that stop a block are tested one
+at a time by the caller.
+
+Header lines are found using `FIO_MEMCHR`, as the (runtime selected) SIMD of
+the C library is faster than a validating scan for the many short lines.
+***************************************************************************** */
+
+#define FIO___HTTP1_SWAR_ONES ((uint64_t)0x0101010101010101ULL)
+#define FIO___HTTP1_SWAR_7F   ((uint64_t)0x7F7F7F7F7F7F7F7FULL)
+#define FIO___HTTP1_SWAR_80   ((uint64_t)0x8080808080808080ULL)
+/* high bit set for bytes (with a clear high bit) within the range [lo, hi] */
+#define FIO___HTTP1_SWAR_RANGE(heptets, lo, hi)                                \
+  (((heptets) + FIO___HTTP1_SWAR_ONES * (0x80U - (lo))) ^                      \
+   ((heptets) + FIO___HTTP1_SWAR_ONES * (0x7FU - (hi))))
+
+/*
+ * Returns the first control character (< 0x20), `end` or (without vector
+ * registers) a position within 8 bytes of `end`.
+ *
+ * Vector loads are aligned, so they never cross a page boundary and may safely
+ * read past `end` (the extra bytes are masked away or ignored).
+ */
+FIO_IFUNC FIO___ASAN_AVOID char *fio___http1_skip_text(char *pos, char *end) {
+  if (pos >= end) /* an aligned load at `end` might cross a page boundary */
+    return end;
+#if FIO___HAS_X86_AVX2
+#define FIO___HTTP1_AVX2_CTL(p)                                                \
+  ((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(                           \
+      _mm256_min_epu8(_mm256_load_si256((const __m256i *)(p)),                 \
+                      _mm256_set1_epi8(0x1F)),                                 \
+      _mm256_load_si256((const __m256i *)(p)))))
+  char *a = FIO_PTR_MATH_RMASK(char, pos, 5);
+  uint32_t m = FIO___HTTP1_AVX2_CTL(a) & (~(uint32_t)0 << (pos - a));
+  while (!m) {
+    if ((a += 32) >= end)
+      return end;
+    m = FIO___HTTP1_AVX2_CTL(a);
+  }
+#undef FIO___HTTP1_AVX2_CTL
+  a += fio_lsb_index_unsafe((uint64_t)m);
+  return (a < end ? a : end);
+#elif FIO___HAS_X86_SSE2
+#define FIO___HTTP1_SSE2_CTL(p)                                                \
+  ((uint32_t)_mm_movemask_epi8(                                                \
+      _mm_cmpeq_epi8(_mm_min_epu8(_mm_load_si128((const __m128i *)(p)),        \
+                                  _mm_set1_epi8(0x1F)),                        \
+                     _mm_load_si128((const __m128i *)(p)))))
+  char *a = FIO_PTR_MATH_RMASK(char, pos, 4);
+  uint32_t m = FIO___HTTP1_SSE2_CTL(a) & (~(uint32_t)0 << (pos - a));
+  while (!m) {
+    if ((a += 16) >= end)
+      return end;
+    m = FIO___HTTP1_SSE2_CTL(a);
+  }
+#undef FIO___HTTP1_SSE2_CTL
+  a += fio_lsb_index_unsafe((uint64_t)m);
+  return (a < end ? a : end);
+#elif FIO___HAS_ARM_NEON
+  /* narrowed to 4 bits per byte, so the result fits a 64 bit word */
+#define FIO___HTTP1_NEON_CTL(p)                                                \
+  vget_lane_u64(                                                               \
+      vreinterpret_u64_u8(vshrn_n_u16(                                         \
+          vreinterpretq_u16_u8(                                                \
+              vcleq_u8(vld1q_u8((const uint8_t *)(p)), vdupq_n_u8(0x1F))),     \
+          4)),                                                                 \
+      0)
+  char *a = FIO_PTR_MATH_RMASK(char, pos, 4);
+  uint64_t m = FIO___HTTP1_NEON_CTL(a) & (~(uint64_t)0 << ((pos - a) << 2));
+  while (!m) {
+    if ((a += 16) >= end)
+      return end;
+    m = FIO___HTTP1_NEON_CTL(a);
+  }
+#undef FIO___HTTP1_NEON_CTL
+  a += fio_lsb_index_unsafe(m) >> 2;
+  return (a < end ? a : end);
+#else
+  for (; pos + 8 <= end; pos += 8) {
+    /* the first (least significant) flag is exact, later ones may not be */
+    const uint64_t w = fio_buf2u64_le(pos);
+    const uint64_t m =
+        ((w - FIO___HTTP1_SWAR_ONES * 0x20U) & ~w) & FIO___HTTP1_SWAR_80;
+    if (m)
+      return pos + (fio_lsb_index_unsafe(m) >> 3);
+  }
+  return pos;
+#endif
+}
+
+/* Lower-cases and skips `[A-Za-z0-9-]` blocks, stops at 8 bytes to `end`. */
+FIO_IFUNC char *fio___http1_skip_name(char *pos, char *end) {
+#if FIO___HAS_X86_AVX2
+  for (; pos + 32 <= end; pos += 32) {
+    const __m256i v = _mm256_loadu_si256((const __m256i *)pos);
+    __m256i t = _mm256_sub_epi8(v, _mm256_set1_epi8('A'));
+    __m256i up = _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(25)), t);
+    const __m256i l =
+        _mm256_or_si256(v, _mm256_and_si256(up, _mm256_set1_epi8(32)));
+    __m256i ok;
+    uint32_t m;
+    t = _mm256_sub_epi8(l, _mm256_set1_epi8('a'));
+    ok = _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(25)), t);
+    t = _mm256_sub_epi8(l, _mm256_set1_epi8('0'));
+    ok = _mm256_or_si256(
+        ok,
+        _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(9)), t));
+    ok = _mm256_or_si256(ok, _mm256_cmpeq_epi8(l, _mm256_set1_epi8('-')));
+    m = ~(uint32_t)_mm256_movemask_epi8(ok);
+    if (m) { /* write the name only, as the next scan reads the rest */
+      const size_t k = fio_lsb_index_unsafe((uint64_t)m);
+      if ((uint32_t)_mm256_movemask_epi8(up) & ((1UL << k) - 1)) {
+        char tmp[32];
+        _mm256_storeu_si256((__m256i *)tmp, l);
+        fio_memcpy31x(pos, tmp, k);
+      }
+      return pos + k;
+    }
+    if (_mm256_movemask_epi8(up))
+      _mm256_storeu_si256((__m256i *)pos, l);
+  }
+#endif
+#if FIO___HAS_X86_SSE2
+  for (; pos + 16 <= end; pos += 16) {
+    const __m128i v = _mm_loadu_si128((const __m128i *)pos);
+    __m128i t = _mm_sub_epi8(v, _mm_set1_epi8('A'));
+    __m128i up = _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(25)), t);
+    const __m128i l = _mm_or_si128(v, _mm_and_si128(up, _mm_set1_epi8(32)));
+    __m128i ok;
+    uint32_t m;
+    t = _mm_sub_epi8(l, _mm_set1_epi8('a'));
+    ok = _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(25)), t);
+    t = _mm_sub_epi8(l, _mm_set1_epi8('0'));
+    ok = _mm_or_si128(ok, _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(9)), t));
+    ok = _mm_or_si128(ok, _mm_cmpeq_epi8(l, _mm_set1_epi8('-')));
+    m = ~(uint32_t)_mm_movemask_epi8(ok) & 0xFFFFU;
+    if (m) { /* lower-case the name only, the rest of the block is unchanged */
+      const size_t k = fio_lsb_index_unsafe((uint64_t)m);
+      const __m128i idx =
+          _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+      up = _mm_and_si128(up, _mm_cmpgt_epi8(_mm_set1_epi8((char)k), idx));
+      if (_mm_movemask_epi8(up))
+        _mm_storeu_si128((__m128i *)pos,
+                         _mm_or_si128(v, _mm_and_si128(up, _mm_set1_epi8(32))));
+      return pos + k;
+    }
+    if (_mm_movemask_epi8(up))
+      _mm_storeu_si128((__m128i *)pos, l);
+  }
+#elif FIO___HAS_ARM_NEON
+  for (; pos + 16 <= end; pos += 16) {
+    const uint8x16_t v = vld1q_u8((const uint8_t *)pos);
+    uint8x16_t up = vcleq_u8(vsubq_u8(v, vdupq_n_u8('A')), vdupq_n_u8(25));
+    const uint8x16_t l = vorrq_u8(v, vandq_u8(up, vdupq_n_u8(32)));
+    uint8x16_t ok =
+        vorrq_u8(vcleq_u8(vsubq_u8(l, vdupq_n_u8('a')), vdupq_n_u8(25)),
+                 vcleq_u8(vsubq_u8(l, vdupq_n_u8('0')), vdupq_n_u8(9)));
+    uint64_t m;
+    ok = vorrq_u8(ok, vceqq_u8(l, vdupq_n_u8('-')));
+    /* narrow to 4 bits per byte, so the result fits a 64 bit word */
+    m = ~vget_lane_u64(
+        vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(ok), 4)),
+        0);
+    if (m) { /* write the name only, as the next scan reads the rest */
+      const size_t k = fio_lsb_index_unsafe(m) >> 2;
+      char tmp[16];
+      vst1q_u8((uint8_t *)tmp, l);
+      fio_memcpy15x(pos, tmp, k);
+      return pos + k;
+    }
+    vst1q_u8((uint8_t *)pos, l);
+  }
+#endif
+  for (; pos + 8 <= end; pos += 8) {
+    /* ASCII bytes only (high bit clear), so the ranges never carry over */
+    const uint64_t w = fio_buf2u64_le(pos);
+    const uint64_t ascii = ~w & FIO___HTTP1_SWAR_80;
+    const uint64_t up =
+        FIO___HTTP1_SWAR_RANGE(w & FIO___HTTP1_SWAR_7F, 'A', 'Z') & ascii;
+    const uint64_t h = (w | (up >> 2)) & FIO___HTTP1_SWAR_7F;
+    const uint64_t d = h ^ (FIO___HTTP1_SWAR_ONES * '-');
+    const uint64_t ok =
+        (FIO___HTTP1_SWAR_RANGE(h, 'a', 'z') |
+         FIO___HTTP1_SWAR_RANGE(h, '0', '9') | ~(d + FIO___HTTP1_SWAR_7F)) &
+        ascii;
+    if (ok != FIO___HTTP1_SWAR_80) { /* write the name only */
+      const size_t k = fio_lsb_index_unsafe(~ok & FIO___HTTP1_SWAR_80) >> 3;
+      if (up & ((1ULL << (k << 3)) - 1)) {
+        char tmp[8];
+        fio_u2buf64_le(tmp, w | (up >> 2));
+        fio_memcpy7x(pos, tmp, k);
+      }
+      return pos + k;
+    }
+    if (up)
+      fio_u2buf64_le(pos, w | (up >> 2));
+  }
+  return pos;
+}
+
+#undef FIO___HTTP1_SWAR_RANGE
+#undef FIO___HTTP1_SWAR_80
+#undef FIO___HTTP1_SWAR_7F
+#undef FIO___HTTP1_SWAR_ONES
+
+/*
+ * Seeks the end of the line, testing for control characters (except HTAB).
+ *
+ * Returns the EOL (the first `\r` or `\n`) and sets `next` to the next line.
+ *
+ * Returns NULL if the line is incomplete or `end` if the line is invalid.
+ */
+FIO_IFUNC char *fio_http1___seek_eol(char *pos, char *end, char **next) {
+  for (;;) {
+    pos = fio___http1_skip_text(pos, end);
+    if (pos == end)
+      return NULL;
+    if ((uint8_t)pos[0] < 0x20U && pos[0] != '\t')
+      break;
+    ++pos;
+  }
+  if (pos[0] == '\n') {
+    *next = pos + 1;
+    return pos;
+  }
+  if (pos[0] != '\r')
+    return end;
+  if (pos + 1 == end)
+    return NULL;
+  if (pos[1] != '\n')
+    return end;
+  *next = pos + 2;
+  return pos;
+}
+
+/* returns either a lower case (ASCII) or the original char. */
+FIO_IFUNC uint8_t fio_http1_tolower(uint8_t c) {
+  c |= (uint8_t)((uint8_t)(c - 'A') < 26U) << 5;
+  return c;
+}
+
+/*
+ * Seeks the ':' divisor while testing and converting the name to downcase.
+ *
+ * The line's (`\r` or `\n`) EOL must be found before `end`, as it stops the
+ * scan. Blocks are scanned up to `end`, so short lines still use whole blocks.
+ */
+FIO_IFUNC char *fio_http1___seek_header_div(char *pos, char *end) {
+  /* this is the subset of the forbidden chars that allows UTF-8 headers */
+  static const _Bool forbidden_name_chars[256] = {
+      1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+      1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 0, 0, 0, 0, 0, 1, 1, 0, 0, 1, 0, 0, 1,
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 1, 0, 1, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+  for (;;) { /* the `eol` byte is always forbidden, stopping the loop */
+    const uint8_t c =
+        fio_http1_tolower((uint8_t)(pos = fio___http1_skip_name(pos, end))[0]);
+    if (FIO_UNLIKELY(forbidden_name_chars[c]))
+      return pos;
+    *(pos++) = (char)c;
+  }
+}
+
 /* *****************************************************************************
 Reading the first line
 ***************************************************************************** */
@@ -163,27 +474,29 @@ static int fio_http1___start(fio_http1_parser_s *p,
                              void *udata) {
   /* find line start/end and test */
   char *start = buf->buf;
+  char *end = buf->buf + buf->len;
   char *tmp;
-  while ((start[0] == ' ' || start[0] == '\r' || start[0] == '\n') &&
-         start < buf->buf + buf->len) /* skip white space */
-    ++start;
-  if (start == buf->buf + buf->len) {
+  char *eol;
+  while (start < end &&
+         (start[0] == ' ' || start[0] == '\r' || start[0] == '\n'))
+    ++start; /* skip white space */
+  if (start == end) {
     buf->buf = start;
     return 1;
   }
-  char *eol = (char *)FIO_MEMCHR(start, '\n', buf->len);
-  if (!eol)
+  if (!(eol = fio_http1___seek_eol(start, end, &tmp)))
     return 1;
-  if (start + 13 > eol) /* test for minimal data GET HTTP/1 or ### HTTP/1 */
+  if (eol == end)
+    return -1;
+  if (start + 12 > eol) /* test for minimal data GET / HTTP/1 or ### HTTP/1 */
     return -1;
 
   /* prep next stage */
-  buf->len -= (eol - buf->buf) + 1;
-  buf->buf = eol + 1;
-  eol -= eol[-1] == '\r';
+  buf->len -= tmp - buf->buf;
+  buf->buf = tmp;
 
-  /* parse first line */
-  if (start[0] > ('0' - 1) && start[0] < ('9' + 1))
+  /* parse first line (a response starts with the version, i.e., "HTTP/") */
+  if (fio_buf2u32u(start) == fio_buf2u32u("HTTP") && start[4] == '/')
     goto parse_response_line;
   /* request: method path version */
   if (!(tmp = (char *)FIO_MEMCHR(start, ' ', (size_t)(eol - start))))
@@ -205,21 +518,28 @@ static int fio_http1___start(fio_http1_parser_s *p,
     return -1;
   return (p->fn = fio_http1___read_header)(p, buf, udata);
 
-parse_response_line:
-  /* response: version code text */
+parse_response_line: {
+  /* response: version code text (the status callback comes first) */
+  fio_buf_info_s version;
+  size_t status;
   if (!(tmp = (char *)FIO_MEMCHR(start, ' ', eol - start)))
     return -1;
-  if (fio_http1_on_version(FIO_BUF_INFO2(start, (size_t)(tmp - start)), udata))
-    return -1;
-  start = tmp + 1;
-  if (!(tmp = (char *)FIO_MEMCHR(start, ' ', eol - start)))
+  version = FIO_BUF_INFO2(start, (size_t)(tmp - start));
+  start = tmp = tmp + 1;
+  status = (size_t)fio_atol10u(&tmp);
+  if (status < 100 || status > 999 || tmp != start + 3 ||
+      (tmp != eol && *tmp != ' '))
     return -1;
-  if (fio_http1_on_status(fio_atol10(&start),
-                          FIO_BUF_INFO2((tmp + 1), (size_t)(eol - tmp)),
+  tmp += (tmp != eol); /* the reason phrase may be empty */
+  if (fio_http1_on_status(status,
+                          FIO_BUF_INFO2(tmp, (size_t)(eol - tmp)),
                           udata))
     return -1;
+  if (fio_http1_on_version(version, udata))
+    return -1;
   return (p->fn = fio_http1___read_header)(p, buf, udata);
 }
+}
 
 /* *****************************************************************************
 Reading Headers
@@ -245,7 +565,7 @@ static inline int fio_http1___on_header(fio_http1_parser_s *p,
       uint64_t clen = fio_atol10u(&tmp);
       if (tmp != value.buf + value.len)
         return -1;
-      if (p->expected)
+      if (p->expected && p->expected != HTTP1___EXPECTED_UNTIL_CLOSE)
         return 0 - (p->expected != clen);
       p->expected = clen;
       return 0 -
@@ -260,7 +580,8 @@ static inline int fio_http1___on_header(fio_http1_parser_s *p,
       char *c_start = value.buf + value.len - 7;
       if ((fio_buf2u32u(c_start) | 0x20202020UL) == fio_buf2u32u("chun") &&
           (fio_buf2u32u(c_start + 3) | 0x20202020UL) == fio_buf2u32u("nked")) {
-        if (p->expected && p->expected != HTTP1___EXPECTED_CHUNKED)
+        if (p->expected && p->expected != HTTP1___EXPECTED_CHUNKED &&
+            p->expected != HTTP1___EXPECTED_UNTIL_CLOSE)
           return -1;
         p->expected = HTTP1___EXPECTED_CHUNKED;
         /* endpoint does not need to know if the body was chunked or not */
@@ -312,36 +633,6 @@ static inline int fio_http1___on_trailer(fio_http1_parser_s *p,
   return fio_http1_on_header(name, value, udata);
 }
 
-/* returns either a lower case (ASCI) or the original char. */
-static uint8_t fio_http1_tolower(uint8_t c) {
-  if ((c - ((uint8_t)'A' - 1U)) < ((uint8_t)'Z' - (uint8_t)'A'))
-    c |= 32;
-  return c;
-}
-
-/* seeks to the ':' divisor while testing and converting to downcase. */
-static char *fio_http1___seek_header_div(char *p) {
-  /* this is the subset of the forbidden chars that allows UTF-8 headers */
-  static const _Bool forbidden_name_chars[256] = {
-      1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-      1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 0, 0, 0, 0, 0, 1, 1, 0, 0, 1, 0, 0, 1,
-      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0,
-      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 0, 0,
-      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-      0, 0, 0, 1, 0, 1, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-  for (;;) {
-    *p = (char)fio_http1_tolower((uint8_t)(*p));
-    ++p;
-    if (FIO_UNLIKELY(forbidden_name_chars[((uint8_t)(*p))]))
-      return p;
-  }
-}
-
 /* extract header name and value from a line and pass info to handler */
 static inline int fio_http1___read_header_line(
     fio_http1_parser_s *p,
@@ -354,6 +645,7 @@ static inline int fio_http1___read_header_line(
   int r;
   for (;;) {
     char *start = buf->buf;
+    char *end = start + buf->len;
     char *eol = (char *)FIO_MEMCHR(start, '\n', buf->len);
     char *div;
     fio_buf_info_s name, value;
@@ -366,8 +658,8 @@ static inline int fio_http1___read_header_line(
     if (FIO_UNLIKELY(eol == start))
       goto headers_finished;
 
-    div = fio_http1___seek_header_div(start);
-    if (div[0] != ':')
+    div = fio_http1___seek_header_div(start, end);
+    if (div[0] != ':' || div == start)
       return -1;
     name = FIO_BUF_INFO2(start, (size_t)(div - start));
     do {
@@ -386,6 +678,7 @@ static inline int fio_http1___read_header_line(
 headers_finished:
   p->fn = (!p->expected)         ? fio_http1___finish
           : (!(p->expected + 1)) ? fio_http1___read_body_chunked
+          : (!(p->expected + 2)) ? fio_http1___read_body_until_close
                                  : fio_http1___read_body;
   return p->fn(p, buf, udata);
 }
@@ -429,6 +722,28 @@ static int fio_http1___read_body(fio_http1_parser_s *p,
   return 1;
 }
 
+/* parsing stage 2 - read body until the connection closes (responses). */
+static int fio_http1___read_body_until_close(fio_http1_parser_s *p,
+                                             fio_buf_info_s *buf,
+                                             void *udata) {
+  (void)p;
+  if (!buf->len)
+    return 1;
+  if (fio_http1_on_body_chunk(*buf, udata))
+    return -1;
+  buf->buf += buf->len;
+  buf->len = 0;
+  return 1;
+}
+
+/** Completes a response read until the connection closed (EOF). */
+FIO_SFUNC int fio_http1_parse_eof(fio_http1_parser_s *p, void *udata) {
+  if (p->fn != fio_http1___read_body_until_close)
+    return -1;
+  fio_http1___finish(p, NULL, udata);
+  return 0;
+}
+
 /* *****************************************************************************
 Reading the Body (chunked)
 ***************************************************************************** */
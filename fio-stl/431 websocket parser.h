@@ -62,6 +62,20 @@ FIO_SFUNC void fio_websocket_on_message(void *udata,
                                         fio_buf_info_s msg,
                                         unsigned char is_text);
 
+/**
+ * Called with each (unmasked) chunk of a streamed message.
+ *
+ * Messages are only streamed if the parser's `stream` flag is set (compressed
+ * messages are never streamed). A chunk may be empty only if `is_last` is set.
+ *
+ * Return -1 to stop parsing (i.e., invalid UTF-8 data), otherwise return 0.
+ */
+FIO_SFUNC int fio_websocket_on_message_partial(void *udata,
+                                               fio_buf_info_s chunk,
+                                               unsigned char is_text,
+                                               unsigned char is_first,
+                                               unsigned char is_last);
+
 /**
  * Called when the parser needs to copy the message to an external buffer.
  *
@@ -182,20 +196,20 @@ FIO_IFUNC uint64_t fio_websocket_header(void *target,
   ((uint8_t *)target)[1] = ((!!mask) << 7U);
   size_t mask_l = ((!!mask) << 2);
   if (message_len < 126) {
-    ((uint8_t *)target)[1] = message_len;
+    ((uint8_t *)target)[1] |= message_len;
     if (mask)
       fio_u2buf32u(((uint8_t *)target + 2), mask);
     return 2 + mask_l;
   } else if (message_len < (1UL << 16)) {
     /* head is 4 bytes */
-    ((uint8_t *)target)[1] = 126;
+    ((uint8_t *)target)[1] |= 126;
     fio_u2buf16_be(((uint8_t *)target + 2), message_len);
     if (mask)
       fio_u2buf32u(((uint8_t *)target + 4), mask);
     return 4 + mask_l;
   } else {
     /* Really Long Message  */
-    ((uint8_t *)target)[1] = 127;
+    ((uint8_t *)target)[1] |= 127;
     fio_u2buf64_be(((uint8_t *)target + 2), message_len);
     if (mask)
       fio_u2buf32u(((uint8_t *)target + 10), mask);
@@ -290,6 +304,9 @@ struct fio_websocket_parser_s {
   uint8_t first;
   uint8_t current;
   uint8_t must_mask;
+  uint8_t stream;    /* set to stream data messages (see on_message_partial) */
+  uint8_t streaming; /* the current message is streamed */
+  uint8_t started;   /* the streamed message's first chunk was delivered */
 };
 
 /* *****************************************************************************
@@ -321,7 +338,7 @@ FIO_SFUNC int fio___websocket_consume_frame_finish(fio_websocket_parser_s *p,
   fio_xmask(msg.buf + p->start_at,
             msg.len - p->start_at,
             (((uint64_t)p->mask) << 32) | (uint64_t)p->mask);
-  p->start_at += msg.len;
+  p->start_at = msg.len; /* `msg` is the whole message (all fragments) */
   p->fn = fio___websocket_consume_header;
   if (!(p->current & 128)) /* done? if not, consume next frame */
     return 0;
@@ -332,11 +349,18 @@ FIO_SFUNC int fio___websocket_consume_frame_finish(fio_websocket_parser_s *p,
       return -1;
   }
   size_t cond = (p->first & 15);
-  *p = (fio_websocket_parser_s){.fn = fio___websocket_consume_header};
+  *p = (fio_websocket_parser_s){.fn = fio___websocket_consume_header,
+                                .stream = p->stream};
   switch (cond) {
   case 0: return -1;         /* continuation - error? */
   case 1: /* fall through */ /* text / data frame */
-  case 2: fio_websocket_on_message(udata, msg, (cond & 1)); return 1;
+  case 2:
+    if (p->stream) /* compressed messages are streamed as a single chunk */
+      return fio_websocket_on_message_partial(udata, msg, (cond & 1), 1, 1)
+                 ? -1
+                 : 1;
+    fio_websocket_on_message(udata, msg, (cond & 1));
+    return 1;
   case 8: fio_websocket_on_protocol_close(udata, msg); return 1;
   case 9: fio_websocket_on_protocol_ping(udata, msg); return 1;
   case 10: fio_websocket_on_protocol_pong(udata, msg); return 1;
@@ -348,9 +372,50 @@ FIO_SFUNC int fio___websocket_consume_frame_finish(fio_websocket_parser_s *p,
   return 1;
 }
 
+FIO_SFUNC int fio___websocket_consume_frame_stream(fio_websocket_parser_s *p,
+                                                   fio_buf_info_s *buf,
+                                                   void *udata) {
+  fio_buf_info_s chunk =
+      FIO_BUF_INFO2(buf->buf, (p->expect > buf->len ? buf->len : p->expect));
+  unsigned char is_last;
+  buf->buf += chunk.len;
+  buf->len -= chunk.len;
+  p->expect -= chunk.len;
+  if (p->mask) { /* unmask and rotate the mask for the frame's next byte */
+    char m[8];
+    fio_xmask(chunk.buf,
+              chunk.len,
+              (((uint64_t)p->mask) << 32) | (uint64_t)p->mask);
+    fio_u2buf32u(m, p->mask);
+    fio_u2buf32u(m + 4, p->mask);
+    p->mask = fio_buf2u32u(m + (chunk.len & 3));
+  }
+  is_last = (!p->expect && (p->current & 128));
+  if (chunk.len || is_last) {
+    if (fio_websocket_on_message_partial(udata,
+                                         chunk,
+                                         ((p->first & 15) == 1),
+                                         !p->started,
+                                         is_last))
+      return -1;
+    p->started = 1;
+  }
+  if (p->expect)
+    return 1; /* wait for more data */
+  if (!is_last) { /* consume the next frame */
+    p->fn = fio___websocket_consume_header;
+    return 0;
+  }
+  *p = (fio_websocket_parser_s){.fn = fio___websocket_consume_header,
+                                .stream = p->stream};
+  return 1;
+}
+
 FIO_SFUNC int fio___websocket_consume_frame(fio_websocket_parser_s *p,
                                             fio_buf_info_s *buf,
                                             void *udata) {
+  if (p->streaming)
+    return fio___websocket_consume_frame_stream(p, buf, udata);
   return (p->expect > buf->len
               ? fio___websocket_consume_frame_partial
               : fio___websocket_consume_frame_finish)(p, buf, udata);
@@ -407,6 +472,9 @@ FIO_SFUNC int fio___websocket_consume_header(fio_websocket_parser_s *p,
     p->start_at = 0;
     if (!(info & 15)) /* continuation frame == 0 ; where's the first? */
       return -1;
+    /* stream uncompressed text / binary messages (if requested) */
+    p->streaming = p->stream && !(info & 64) &&
+                   ((info & 15) == 1 || (info & 15) == 2);
   }
   if (p->must_mask && !p->mask)
     return -1;
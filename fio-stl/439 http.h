@@ -41,6 +41,18 @@ HTTP Setting Defaults
 #ifndef FIO_HTTP_DEFAULT_TIMEOUT_LONG
 #define FIO_HTTP_DEFAULT_TIMEOUT_LONG 50
 #endif
+#ifndef FIO_HTTP_DEFAULT_HEADER_TIMEOUT
+/** The default `header_timeout`, in seconds (0 == disabled). */
+#define FIO_HTTP_DEFAULT_HEADER_TIMEOUT 0
+#endif
+#ifndef FIO_HTTP_DEFAULT_MIN_BODY_RATE
+/** The default `min_body_rate`, in bytes per second (0 == disabled). */
+#define FIO_HTTP_DEFAULT_MIN_BODY_RATE 0
+#endif
+#ifndef FIO_HTTP_BODY_RATE_WINDOW
+/** The request body upload rate is measured once every this many seconds. */
+#define FIO_HTTP_BODY_RATE_WINDOW 10
+#endif
 
 #ifndef FIO_HTTP_SHOW_CONTENT_LENGTH_HEADER
 /** Adds a "content-length" header to the HTTP handle (usually redundant). */
@@ -57,12 +69,78 @@ HTTP Setting Defaults
 #define FIO_WEBSOCKET_STATS 0
 #endif
 
+#ifndef FIO_HTTP_PIPELINE_COPY_LIMIT
+/** Pipelined responses shorter than this are copied and sent as one batch. */
+#define FIO_HTTP_PIPELINE_COPY_LIMIT 16384
+#endif
+
+#ifndef FIO_HTTP_CHUNK_COPY_LIMIT
+/** Streamed response chunks shorter than this are framed in a single copy. */
+#define FIO_HTTP_CHUNK_COPY_LIMIT 16384
+#endif
+
+#ifndef FIO_HTTP_BODY_STREAM_LIMIT
+/** Streamed request body data is delivered once this many bytes are read. */
+#define FIO_HTTP_BODY_STREAM_LIMIT (1UL << 16)
+#endif
+
+#ifndef FIO_HTTP_WEBSOCKET_DEFLATE_WINDOW_BITS
+/**
+ * The deflate window (log2, 9..15) for compressed outgoing WebSocket messages.
+ *
+ * Larger windows compress better, but require more memory per connection.
+ */
+#define FIO_HTTP_WEBSOCKET_DEFLATE_WINDOW_BITS 13
+#endif
+
+#ifndef FIO_HTTP_CLIENT_MAX_CONNECTIONS
+/** The default maximum number of client connections per host. */
+#define FIO_HTTP_CLIENT_MAX_CONNECTIONS 8
+#endif
+
+#ifndef FIO_HTTP_READ_BUFFER_POOL_LIMIT
+/**
+ * The maximum number of idle read buffers kept for reuse (per listener).
+ *
+ * Connections only borrow a read buffer (of `max_line_len` bytes) while data
+ * is pending, so idle connections don't hold a buffer.
+ */
+#define FIO_HTTP_READ_BUFFER_POOL_LIMIT 64
+#endif
+
 /* *****************************************************************************
 HTTP Listen
 ***************************************************************************** */
+
+/** An HTTP router, see `fio_http_router_new`. */
+typedef struct fio_http_router_s fio_http_router_s;
+
 typedef struct fio_http_settings_s {
   /** Callback for HTTP requests (server) or responses (client). */
   void (*on_http)(fio_http_s *h);
+  /**
+   * (optional) Streams request bodies (server only) instead of storing them.
+   *
+   * When set, the request body is never stored by the HTTP handle (neither in
+   * memory nor in a temporary file). Instead, `on_body_chunk` is called (using
+   * the same task queue as `on_http`) for each chunk of body data, in order,
+   * and `on_http` is called once the whole body was received (the handle's
+   * body will be empty).
+   *
+   * The connection stops reading while a chunk is being handled, so slow
+   * consumers throttle the client rather than buffer the upload.
+   *
+   * If the connection is lost mid-body, `on_http` is never called.
+   *
+   * A response may be sent early, by finishing the handle from `on_body_chunk`
+   * (i.e., to reject an upload), in which case `on_http` is never called. If
+   * the body wasn't fully received, the rest of it is never read and the
+   * connection is closed once the response was sent. When pipelining, such
+   * responses are discarded if responses to previous requests are pending.
+   *
+   * Form data can be parsed as it arrives using `fio_http_form_parse`.
+   */
+  void (*on_body_chunk)(fio_http_s *h, fio_buf_info_s chunk);
   /** (optional) the callback to be performed when the HTTP service closes. */
   void (*on_finish)(struct fio_http_settings_s *settings);
 
@@ -76,6 +154,19 @@ typedef struct fio_http_settings_s {
 
   /** Called when a WebSocket message is received. */
   void (*on_message)(fio_http_s *h, fio_buf_info_s msg, uint8_t is_text);
+  /**
+   * (optional) Streams WebSocket messages, called for each chunk as it arrives.
+   *
+   * If set, `on_message` is never called for WebSocket messages, which are not
+   * collected in memory (except compressed messages, delivered as one chunk).
+   *
+   * Text is UTF-8 validated, a code point may be split between chunks.
+   */
+  void (*on_message_partial)(fio_http_s *h,
+                             fio_buf_info_s chunk,
+                             uint8_t is_text,
+                             uint8_t is_first,
+                             uint8_t is_last);
   /** Called when an EventSource event is received. */
   void (*on_eventsource)(fio_http_s *h,
                          fio_buf_info_s id,
@@ -99,11 +190,22 @@ typedef struct fio_http_settings_s {
   fio_tls_s *tls;
   /** Optional HTTP task queue (for multi-threading HTTP responses) */
   fio_srv_async_s *queue;
+  /**
+   * (optional) Routes requests by method and path (see `fio_http_route`).
+   *
+   * Requests that match no route are handled by `on_http`. The listener keeps
+   * its own reference, so the router may be freed once `fio_http_listen`
+   * returns.
+   */
+  fio_http_router_s *router;
   /**
    * A public folder for file transfers - allows to circumvent any application
    * layer logic and simply serve static files.
    *
    * Supports automatic `gz` pre-compressed alternatives.
+   *
+   * Resolved files are cached (small files are kept in memory) and
+   * re-validated every `FIO_HTTP_STATIC_CACHE_TTL` seconds.
    */
   fio_str_info_s public_folder;
   /**
@@ -113,6 +215,57 @@ typedef struct fio_http_settings_s {
    * Defaults to 0 (not sent).
    */
   size_t max_age;
+  /**
+   * Pre-rendered header lines sent with every HTTP/1.1 response, i.e.:
+   *
+   *     .static_headers = FIO_STR_INFO1("server:facil.io\r\n")
+   *
+   * Each line MUST end with CRLF. The data is copied.
+   *
+   * This is faster than setting the same headers for every response, but the
+   * headers will not be visible using `fio_http_response_header`.
+   */
+  fio_str_info_s static_headers;
+  /**
+   * Opt-in response (micro) cache for `GET` requests, see `fio_http_cache`.
+   *
+   * Responses are cached for `cache_ttl` seconds, keyed by the request's path,
+   * query and the request headers listed in `cache_vary`. Concurrent requests
+   * for the same resource wait for a single handler to respond.
+   *
+   * Defaults to 0 (disabled).
+   */
+  uint32_t cache_ttl;
+  /**
+   * Request header names (comma separated, lower case) that are part of the
+   * response cache key (i.e., "accept-language,x-tenant").
+   *
+   * The data is copied.
+   */
+  fio_str_info_s cache_vary;
+  /**
+   * Opt-in dynamic response compression (gzip / deflate), requires zlib.
+   *
+   * Responses at least `compress_min` bytes long, with a `content-type` listed
+   * in `compress_types`, are compressed when the client's `accept-encoding`
+   * allows it. Streamed responses are always compressed (when allowed).
+   * Compressed responses are cached by ETag. Responses sent from a file (i.e.,
+   * static files) are never compressed dynamically.
+   *
+   * Defaults to 0 (disabled).
+   */
+  size_t compress_min;
+  /**
+   * A comma separated list of compressible `content-type` values, i.e.:
+   *
+   *     .compress_types = FIO_STR_INFO1("text/,application/json,+xml")
+   *
+   * Entries ending with `/` match a type prefix, entries starting with `+`
+   * match a suffix and other entries must match the type exactly.
+   *
+   * Defaults to `FIO_HTTP_COMPRESS_TYPES`. The data is copied.
+   */
+  fio_str_info_s compress_types;
   /**
    * The maximum total of bytes for the overall size of the request string and
    * headers, combined.
@@ -135,12 +288,41 @@ typedef struct fio_http_settings_s {
   /**
    * The maximum websocket message size/buffer (in bytes) for Websocket
    * connections. Defaults to FIO_HTTP_DEFAULT_WS_MAX_MSG_SIZE bytes.
+   *
+   * Uncompressed messages streamed by `on_message_partial` aren't limited.
    */
   size_t ws_max_msg_size;
+  /**
+   * Opt-in WebSocket compression (permessage-deflate, RFC 7692), requires zlib.
+   *
+   * When set, the extension is accepted when offered by the client and
+   * outgoing messages at least `ws_compress_min` bytes long are compressed.
+   *
+   * Defaults to 0 (disabled).
+   */
+  size_t ws_compress_min;
   /** reserved for future use. */
   intptr_t reserved1;
   /** reserved for future use. */
   intptr_t reserved2;
+  /**
+   * The minimal upload rate (in bytes per second) for request bodies, measured
+   * once every FIO_HTTP_BODY_RATE_WINDOW seconds. Slower clients are
+   * disconnected. Time spent waiting for the server (i.e., while a streamed
+   * body chunk is handled) isn't counted.
+   *
+   * Defaults to FIO_HTTP_DEFAULT_MIN_BODY_RATE (0, disabled).
+   */
+  uint32_t min_body_rate;
+  /**
+   * The maximum number of concurrent connections per client IP address.
+   * Further connections from the same address are closed once accepted.
+   *
+   * Connections are counted per worker process.
+   *
+   * Defaults to 0 (no limit).
+   */
+  uint32_t max_clients_per_ip;
   /**
    * An HTTP/1.x connection timeout.
    *
@@ -149,6 +331,16 @@ typedef struct fio_http_settings_s {
    * Note: the connection might be closed (by other side) before timeout occurs.
    */
   uint8_t timeout;
+  /**
+   * The time (in seconds) a client has to send a complete request head (the
+   * request line and headers), measured from the request's first byte.
+   *
+   * Unlike `timeout`, this deadline isn't extended when data arrives, so
+   * clients trickling a request (i.e., "slowloris") are disconnected.
+   *
+   * Defaults to FIO_HTTP_DEFAULT_HEADER_TIMEOUT (0, disabled).
+   */
+  uint8_t header_timeout;
   /**
    * Timeout for the WebSocket connections, a ping will be sent whenever the
    * timeout is reached. Defaults to FIO_HTTP_DEFAULT_TIMEOUT_LONG seconds.
@@ -165,6 +357,23 @@ typedef struct fio_http_settings_s {
    * fails).
    */
   uint8_t sse_timeout;
+  /**
+   * If set, WebSocket compression doesn't retain its context between messages
+   * (`server_no_context_takeover` and `client_no_context_takeover`).
+   *
+   * This lowers the compression ratio, but compression memory is only used
+   * while a message is processed, rather than for the connection's lifetime.
+   */
+  uint8_t ws_no_context_takeover;
+  /**
+   * The number of pipelined HTTP/1.1 requests that may be handled concurrently
+   * per connection.
+   *
+   * Responses are sequenced in request order and sent in batches.
+   *
+   * Defaults to 0 (requests are handled one at a time).
+   */
+  uint8_t pipeline;
   /** Logging flag - set to TRUE to log HTTP requests. */
   uint8_t log;
 } fio_http_settings_s;
@@ -186,6 +395,151 @@ SFUNC fio_s *fio_http_io(fio_http_s *);
 #define fio_http_subscribe(h, ...)                                             \
   fio_subscribe(.io = fio_http_io(h), __VA_ARGS__)
 
+/* *****************************************************************************
+HTTP Router - Method and Path Dispatch
+***************************************************************************** */
+
+/** Per-route settings, see `fio_http_route`. */
+typedef struct {
+  /** Callback for requests matching the route (required). */
+  void (*on_http)(fio_http_s *h);
+  /** (optional) Opaque user data, replaces the listener's `udata`. */
+  void *udata;
+  /** (optional) The task queue for `on_http`, replaces the listener's. */
+  fio_srv_async_s *queue;
+  /** (optional) The maximum body size, replaces the listener's. */
+  size_t max_body_size;
+  /** (optional) Response cache TTL in seconds, replaces the listener's. */
+  uint32_t cache_ttl;
+  /** (optional) Request headers that vary cached responses (copied). */
+  fio_str_info_s cache_vary;
+} fio_http_route_s;
+
+/** Creates a new (empty) HTTP router. */
+SFUNC fio_http_router_s *fio_http_router_new(void);
+
+/** Reduces a router's reference count or frees it. */
+SFUNC void fio_http_router_free(fio_http_router_s *);
+
+/** Increases a router's reference count. */
+SFUNC fio_http_router_s *fio_http_router_dup(fio_http_router_s *);
+
+/**
+ * Adds a route to the router, replacing any existing route with the same
+ * method and pattern.
+ *
+ * The `method` is case sensitive (i.e., "GET"). If `method` is NULL or empty,
+ * the route accepts any method not routed explicitly.
+ *
+ * The `pattern` is a path that may contain parameter segments:
+ *
+ * - `:name` matches a single (non-empty) path segment, i.e., "/users/:id".
+ *
+ * - `*name` matches the rest of the path (may be empty) and must be the last
+ *   segment, i.e., "/files/" followed by "*path".
+ *
+ * Static segments take precedence over `:name` segments, which take
+ * precedence over `*name` segments.
+ *
+ * Routes are compiled into a radix tree, so matching is performed in a single
+ * pass over the path (O(path length)) and without allocating memory.
+ *
+ * Routes should be added before the server starts (the router isn't
+ * thread-safe).
+ *
+ * Returns -1 on error (i.e., invalid pattern or conflicting parameter names).
+ */
+SFUNC int fio_http_route(fio_http_router_s *router,
+                         const char *method,
+                         const char *pattern,
+                         fio_http_route_s route);
+
+/** Adds a route to the router, see `fio_http_route_s`. */
+#define fio_http_route(router, method, pattern, ...)                           \
+  fio_http_route((router), (method), (pattern), (fio_http_route_s){__VA_ARGS__})
+
+/**
+ * Returns the route matching the HTTP handle's method and path (or NULL).
+ *
+ * Captured path parameters are set on the handle (see `fio_http_param`).
+ * Parameter values are views into the (raw, undecoded) path.
+ *
+ * Note: this is performed automatically for listeners with a `router`.
+ */
+SFUNC fio_http_route_s *fio_http_router_match(fio_http_router_s *router,
+                                              fio_http_s *h);
+
+/* *****************************************************************************
+HTTP Client - Pooled (Keep-Alive) Connections
+***************************************************************************** */
+
+/** Named arguments for the `fio_http_request` function. */
+typedef struct {
+  /**
+   * Called (on a worker thread) once the response was received.
+   *
+   * The response's status is 0 if the request failed (no response available).
+   *
+   * The HTTP handle is freed once the callback returns, unless `fio_http_dup`
+   * was called.
+   */
+  void (*on_response)(fio_http_s *h);
+  /** Opaque user data, available using `fio_http_udata(h)`. */
+  void *udata;
+  /** The request method, defaults to "GET" (or "POST" if a body is set). */
+  fio_str_info_s method;
+  /** Additional request headers - each header line MUST end with CRLF. */
+  fio_str_info_s headers;
+  /** The request body (copied). */
+  fio_str_info_s body;
+  /** TLS settings for `https` requests (used when the pool is created). */
+  fio_tls_s *tls;
+  /** Maximum response body size, defaults to the HTTP server's default. */
+  size_t max_body_size;
+  /** Maximum connections to the host, see FIO_HTTP_CLIENT_MAX_CONNECTIONS. */
+  uint16_t max_connections;
+  /** Connection timeout in seconds, defaults to FIO_HTTP_DEFAULT_TIMEOUT. */
+  uint8_t timeout;
+  /**
+   * The number of requests that may be pipelined on a busy connection.
+   *
+   * Requests are only pipelined when all `max_connections` connections are
+   * busy. Defaults to 1 (requests wait for an idle connection).
+   */
+  uint8_t pipeline;
+} fio_http_request_args_s;
+
+/**
+ * Sends an HTTP/1.1 request to `url` (`http://` or `https://`).
+ *
+ * Connections are pooled per host (scheme, host and port) and kept alive, so
+ * subsequent requests to the same host reuse existing connections instead of
+ * performing a new TCP (and TLS) handshake.
+ *
+ * The pool's limits (`max_connections`, `pipeline`, `max_body_size` and
+ * `timeout`) follow the most recent request to the host.
+ *
+ * Idempotent requests that were sent on a reused connection which was closed
+ * before a response arrived (i.e., a stale keep-alive connection) are retried
+ * once on a different connection.
+ *
+ * Host names are resolved by a short lived thread, so DNS lookups never block
+ * the IO thread (IP addresses are connected immediately). For `https` requests
+ * the host name is sent as the TLS server name (SNI), unless the `tls` settings
+ * set one using `fio_tls_server_name_set`.
+ *
+ * Responses with neither a `content-length` nor a chunked `transfer-encoding`
+ * are read until the server closes the connection.
+ *
+ * Returns -1 on error (i.e., unsupported URL) or 0 if the request was
+ * scheduled (`on_response` will be called).
+ */
+SFUNC int fio_http_request(const char *url, fio_http_request_args_s args);
+
+/** Sends an HTTP/1.1 request to `url`, see `fio_http_request_args_s`. */
+#define fio_http_request(url, ...)                                             \
+  fio_http_request(url, (fio_http_request_args_s){__VA_ARGS__})
+
 /* *****************************************************************************
 WebSocket Helpers - HTTP Upgraded Connections
 ***************************************************************************** */
@@ -252,6 +606,10 @@ All memory allocations should use:
 
 */
 
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+
 /* *****************************************************************************
 HTTP Settings Validation
 ***************************************************************************** */
@@ -327,9 +685,20 @@ static void http_settings_validate(fio_http_settings_s *s, int is_client) {
     s->timeout = FIO_HTTP_DEFAULT_TIMEOUT;
   if (!s->ws_timeout)
     s->ws_timeout = FIO_HTTP_DEFAULT_TIMEOUT_LONG;
+  if (!s->header_timeout)
+    s->header_timeout = FIO_HTTP_DEFAULT_HEADER_TIMEOUT;
+  if (!s->min_body_rate)
+    s->min_body_rate = FIO_HTTP_DEFAULT_MIN_BODY_RATE;
 
   if (s->max_header_size < s->max_line_len)
     s->max_header_size = s->max_line_len;
+#if !HAVE_ZLIB
+  if (s->compress_min || s->ws_compress_min) {
+    FIO_LOG_WARNING("HTTP / WebSocket compression requires zlib (HAVE_ZLIB).");
+    s->compress_min = 0;
+    s->ws_compress_min = 0;
+  }
+#endif
 
   if (s->public_folder.buf) {
     if (s->public_folder.len > 1 &&
@@ -343,6 +712,13 @@ static void http_settings_validate(fio_http_settings_s *s, int is_client) {
       s->public_folder = ((fio_str_info_s){0});
     }
   }
+  if (s->static_headers.len &&
+      (s->static_headers.len < 4 ||
+       s->static_headers.buf[s->static_headers.len - 2] != '\r' ||
+       s->static_headers.buf[s->static_headers.len - 1] != '\n')) {
+    FIO_LOG_ERROR("HTTP static headers must end with CRLF, setting ignored.");
+    s->static_headers = ((fio_str_info_s){0});
+  }
 }
 
 /* *****************************************************************************
@@ -365,6 +741,72 @@ FIO_IFUNC fio_protocol_s fio___http_protocol_get(fio___http_protocol_selector_e,
 FIO_IFUNC fio_http_controller_s
 fio___http_controller_get(fio___http_protocol_selector_e, int is_client);
 
+/* *****************************************************************************
+HTTP Read Buffer Pool (idle buffers are linked using their first bytes)
+***************************************************************************** */
+
+typedef struct {
+  void **head;
+  uint32_t count;
+  fio_lock_i lock;
+} fio___http_buffer_pool_s;
+
+FIO___LEAK_COUNTER_DEF(http___read_buffer)
+
+/** Borrows a buffer from the pool, allocating a new buffer if none are idle. */
+FIO_SFUNC char *fio___http_buffer_pool_pop(fio___http_buffer_pool_s *pool,
+                                           size_t capa) {
+  void **b;
+  fio_lock(&pool->lock);
+  b = pool->head;
+  if (b) {
+    pool->head = (void **)*b;
+    --pool->count;
+  }
+  fio_unlock(&pool->lock);
+  if (b)
+    return (char *)b;
+  b = (void **)FIO_MEM_REALLOC_(NULL, 0, capa, 0);
+  FIO_ASSERT_ALLOC(b);
+  FIO___LEAK_COUNTER_ON_ALLOC(http___read_buffer);
+  return (char *)b;
+}
+
+/** Returns a buffer to the pool, freeing it if the pool is full. */
+FIO_SFUNC void fio___http_buffer_pool_push(fio___http_buffer_pool_s *pool,
+                                           char *buf,
+                                           size_t capa) {
+  void **b = (void **)buf;
+  if (!b)
+    return;
+  fio_lock(&pool->lock);
+  if (pool->count < FIO_HTTP_READ_BUFFER_POOL_LIMIT) {
+    *b = (void *)pool->head;
+    pool->head = b;
+    ++pool->count;
+    b = NULL;
+  }
+  fio_unlock(&pool->lock);
+  if (!b)
+    return;
+  FIO_MEM_FREE_(b, capa);
+  FIO___LEAK_COUNTER_ON_FREE(http___read_buffer);
+  (void)capa; /* if unused */
+}
+
+/** Frees all idle buffers. */
+FIO_SFUNC void fio___http_buffer_pool_destroy(fio___http_buffer_pool_s *pool,
+                                              size_t capa) {
+  while (pool->head) {
+    void **b = pool->head;
+    pool->head = (void **)*b;
+    FIO_MEM_FREE_(b, capa);
+    FIO___LEAK_COUNTER_ON_FREE(http___read_buffer);
+  }
+  pool->count = 0;
+  (void)capa; /* if unused */
+}
+
 /* *****************************************************************************
 HTTP Protocol Container (vtable + settings storage)
 ***************************************************************************** */
@@ -374,6 +816,7 @@ typedef struct {
   fio_http_settings_s settings;
   void (*on_http_callback)(void *, void *);
   fio_queue_s *queue;
+  fio___http_buffer_pool_s buffers; /* read buffers (`max_line_len` bytes) */
   struct {
     fio_protocol_s protocol;
     fio_http_controller_s controller;
@@ -387,13 +830,468 @@ typedef struct {
 #define FIO_REF_CONSTRUCTOR_ONLY 1
 #define FIO_REF_DESTROY(o)                                                     \
   do {                                                                         \
+    fio___http_buffer_pool_destroy(&o.buffers, o.settings.max_line_len);       \
     if (o.settings.tls)                                                        \
       fio_tls_free(o.settings.tls);                                            \
+    if (o.settings.router)                                                     \
+      fio_http_router_free(o.settings.router);                                 \
     if (o.settings.on_finish)                                                  \
       o.settings.on_finish(&o.settings);                                       \
   } while (0)
 #include FIO_INCLUDE_FILE
 
+/* *****************************************************************************
+HTTP Client Containers (requests and per-host connection pools)
+***************************************************************************** */
+
+/** A client request, waiting to be sent or for its response. */
+typedef struct fio___http_client_req_s {
+  struct fio___http_client_req_s *next;
+  fio_http_request_args_s args; /* only callbacks and settings are valid */
+  char *data; /* the rendered request (bstr), kept in case of a retry */
+  char *key;  /* the pool's key / URL (bstr), until the request is queued */
+  uint8_t is_head;
+  uint8_t retry; /* idempotent requests may be retried once */
+} fio___http_client_req_s;
+
+/** A FIFO queue of client requests. */
+typedef struct {
+  fio___http_client_req_s *head;
+  fio___http_client_req_s *tail;
+} fio___http_client_fifo_s;
+
+FIO___LEAK_COUNTER_DEF(http___client_request)
+
+FIO_IFUNC void fio___http_client_fifo_push(fio___http_client_fifo_s *q,
+                                           fio___http_client_req_s *r) {
+  r->next = NULL;
+  if (q->tail)
+    q->tail->next = r;
+  else
+    q->head = r;
+  q->tail = r;
+}
+
+FIO_IFUNC fio___http_client_req_s *fio___http_client_fifo_shift(
+    fio___http_client_fifo_s *q) {
+  fio___http_client_req_s *r = q->head;
+  if (!r)
+    return r;
+  q->head = r->next;
+  if (!q->head)
+    q->tail = NULL;
+  return r;
+}
+
+FIO_SFUNC fio___http_client_req_s *fio___http_client_req_new(void) {
+  fio___http_client_req_s *r =
+      (fio___http_client_req_s *)FIO_MEM_REALLOC_(NULL, 0, sizeof(*r), 0);
+  FIO_ASSERT_ALLOC(r);
+  FIO___LEAK_COUNTER_ON_ALLOC(http___client_request);
+  return r;
+}
+
+FIO_SFUNC void fio___http_client_req_free(fio___http_client_req_s *r) {
+  fio_bstr_free(r->data);
+  fio_bstr_free(r->key);
+  fio_tls_free(r->args.tls);
+  FIO_MEM_FREE_(r, sizeof(*r));
+  FIO___LEAK_COUNTER_ON_FREE(http___client_request);
+}
+
+/** A per-host pool of keep-alive connections (IO thread only). */
+typedef struct fio___http_client_pool_s {
+  FIO_LIST_HEAD connections;
+  fio___http_client_fifo_s pending; /* requests waiting for a connection */
+  fio___http_protocol_s *protocol;
+  void *tls; /* a TLS context built for client connections (https) */
+  char *url;
+  uint32_t count;
+  uint16_t max_connections;
+  uint8_t pipeline;
+} fio___http_client_pool_s;
+
+FIO_SFUNC void fio___http_client_pool_destroy(fio___http_client_pool_s *pool) {
+  fio___http_client_req_s *r;
+  while ((r = fio___http_client_fifo_shift(&pool->pending)))
+    fio___http_client_req_free(r);
+  if (pool->tls)
+    pool->protocol->state[FIO___HTTP_PROTOCOL_HTTP1]
+        .protocol.io_functions.free_context(pool->tls);
+  fio_bstr_free(pool->url);
+  fio___http_protocol_free(pool->protocol);
+}
+
+#define FIO_REF_NAME             fio___http_client_pool
+#define FIO_REF_CONSTRUCTOR_ONLY 1
+#define FIO_REF_DESTROY(o)       fio___http_client_pool_destroy(&(o))
+#include FIO_INCLUDE_FILE
+
+#define FIO_MAP_NAME             fio___http_client_pool_map
+#define FIO_MAP_VALUE            fio___http_client_pool_s *
+#define FIO_MAP_VALUE_DESTROY(o) fio___http_client_pool_free(o)
+#define FIO_MAP_VALUE_DISCARD(o) fio___http_client_pool_free(o)
+#include FIO_INCLUDE_FILE
+
+/* *****************************************************************************
+HTTP Router Container (radix tree)
+***************************************************************************** */
+
+/** A route, as stored by a radix tree node. */
+typedef struct {
+  fio_http_route_s route;
+  uint32_t method_len; /* zero == any method */
+  char method[20];
+} fio___http_rentry_s;
+
+/** A radix tree node - static children are keyed by their label's 1st byte. */
+typedef struct fio___http_rnode_s {
+  fio_buf_info_s label; /* the static edge (or the `:name` / `*name` segment) */
+  struct fio___http_rnode_s **kids; /* static children */
+  struct fio___http_rnode_s *param; /* the `:name` child (if any) */
+  struct fio___http_rnode_s *wild;  /* the `*name` child (if any) */
+  fio___http_rentry_s *routes;      /* routes ending at this node */
+  uint32_t kids_len;
+  uint32_t routes_len;
+  char buf[];
+} fio___http_rnode_s;
+
+/** Captured path parameters (collected before they're set on the handle). */
+typedef struct {
+  fio_buf_info_s name[FIO_HTTP_MAX_PARAMS];
+  fio_buf_info_s value[FIO_HTTP_MAX_PARAMS];
+  size_t count;
+} fio___http_rparams_s;
+
+struct fio_http_router_s {
+  fio___http_rnode_s *root;
+  size_t body_limits; /* routes with a `max_body_size` (tested early) */
+};
+
+FIO___LEAK_COUNTER_DEF(http___router_node)
+
+FIO_SFUNC fio___http_rnode_s *fio___http_rnode_new(const char *label,
+                                                   size_t len) {
+  fio___http_rnode_s *n = (fio___http_rnode_s *)
+      FIO_MEM_REALLOC_(NULL, 0, sizeof(*n) + len + 1, 0);
+  if (!n)
+    return n;
+  FIO___LEAK_COUNTER_ON_ALLOC(http___router_node);
+  *n = (fio___http_rnode_s){.label = FIO_BUF_INFO2(n->buf, len)};
+  if (len)
+    FIO_MEMCPY(n->buf, label, len);
+  n->buf[len] = 0;
+  return n;
+}
+
+FIO_SFUNC void fio___http_rnode_free(fio___http_rnode_s *n) {
+  if (!n)
+    return;
+  for (uint32_t i = 0; i < n->kids_len; ++i)
+    fio___http_rnode_free(n->kids[i]);
+  for (uint32_t i = 0; i < n->routes_len; ++i)
+    fio_bstr_free(n->routes[i].route.cache_vary.buf);
+  fio___http_rnode_free(n->param);
+  fio___http_rnode_free(n->wild);
+  FIO_MEM_FREE_(n->kids, sizeof(*n->kids) * n->kids_len);
+  FIO_MEM_FREE_(n->routes, sizeof(*n->routes) * n->routes_len);
+  /* the label may have been shortened (from the front) when splitting */
+  FIO_MEM_FREE_(n,
+                sizeof(*n) + (size_t)(n->label.buf - n->buf) + n->label.len +
+                    1);
+  FIO___LEAK_COUNTER_ON_FREE(http___router_node);
+}
+
+/** Copies the route's `cache_vary` string (a `fio_bstr`). */
+FIO_SFUNC int fio___http_rentry_vary_copy(fio_http_route_s *route) {
+  if (!route->cache_vary.len) {
+    route->cache_vary = (fio_str_info_s){0};
+    return 0;
+  }
+  route->cache_vary.buf =
+      fio_bstr_write(NULL, route->cache_vary.buf, route->cache_vary.len);
+  return -(!route->cache_vary.buf);
+}
+
+/** Adds a static child (takes ownership of `kid`), returns -1 on error. */
+FIO_SFUNC int fio___http_rnode_kid_add(fio___http_rnode_s *n,
+                                       fio___http_rnode_s *kid) {
+  fio___http_rnode_s **kids = (fio___http_rnode_s **)
+      FIO_MEM_REALLOC_(n->kids,
+                       sizeof(*kids) * n->kids_len,
+                       sizeof(*kids) * (n->kids_len + 1),
+                       sizeof(*kids) * n->kids_len);
+  if (!kids) {
+    fio___http_rnode_free(kid);
+    return -1;
+  }
+  kids[n->kids_len++] = kid;
+  n->kids = kids;
+  return 0;
+}
+
+/** Inserts a static path fragment, returning the node where it ends. */
+FIO_SFUNC fio___http_rnode_s *fio___http_rnode_insert(fio___http_rnode_s *n,
+                                                      const char *s,
+                                                      size_t len) {
+  while (len) {
+    fio___http_rnode_s *k = NULL;
+    uint32_t i = 0;
+    size_t common = 1;
+    for (; i < n->kids_len; ++i) {
+      if (n->kids[i]->label.buf[0] != s[0])
+        continue;
+      k = n->kids[i];
+      break;
+    }
+    if (!k) { /* a new edge */
+      k = fio___http_rnode_new(s, len);
+      if (!k || fio___http_rnode_kid_add(n, k))
+        return NULL;
+      return k;
+    }
+    while (common < len && common < k->label.len &&
+           k->label.buf[common] == s[common])
+      ++common;
+    if (common < k->label.len) { /* split the edge at the common prefix */
+      fio___http_rnode_s *m = fio___http_rnode_new(s, common);
+      if (!m)
+        return NULL;
+      m->kids = (fio___http_rnode_s **)
+          FIO_MEM_REALLOC_(NULL, 0, sizeof(*m->kids), 0);
+      if (!m->kids) {
+        fio___http_rnode_free(m);
+        return NULL;
+      }
+      m->kids[0] = k;
+      m->kids_len = 1;
+      k->label.buf += common;
+      k->label.len -= common;
+      n->kids[i] = m;
+      k = m;
+    }
+    n = k;
+    s += common;
+    len -= common;
+  }
+  return n;
+}
+
+/** Returns a method specific route, or a route accepting any method. */
+FIO_IFUNC fio___http_rentry_s *fio___http_rnode_pick(fio___http_rnode_s *n,
+                                                     fio_str_info_s method) {
+  fio___http_rentry_s *any = NULL;
+  for (uint32_t i = 0; i < n->routes_len; ++i) {
+    fio___http_rentry_s *e = n->routes + i;
+    if (!e->method_len)
+      any = e;
+    else if (e->method_len == method.len &&
+             !FIO_MEMCMP(e->method, method.buf, method.len))
+      return e;
+  }
+  return any;
+}
+
+/** Matches the rest of the path (`pos` to `end`), backtracking if needed. */
+FIO_SFUNC fio___http_rentry_s *fio___http_rnode_match(fio___http_rnode_s *n,
+                                                      fio_str_info_s method,
+                                                      const char *pos,
+                                                      const char *end,
+                                                      fio___http_rparams_s *p) {
+  fio___http_rentry_s *r;
+  if (pos == end) {
+    if ((r = fio___http_rnode_pick(n, method)))
+      return r;
+    goto wildcard;
+  }
+  for (uint32_t i = 0; i < n->kids_len; ++i) {
+    fio___http_rnode_s *k = n->kids[i];
+    if (k->label.buf[0] != pos[0])
+      continue;
+    /* only a single child may start with the same byte */
+    if (k->label.len <= (size_t)(end - pos) &&
+        !FIO_MEMCMP(k->label.buf, pos, k->label.len) &&
+        (r = fio___http_rnode_match(k, method, pos + k->label.len, end, p)))
+      return r;
+    break;
+  }
+  if (n->param && p->count < FIO_HTTP_MAX_PARAMS && pos[0] != '/') {
+    const char *eos = (const char *)FIO_MEMCHR(pos, '/', (size_t)(end - pos));
+    if (!eos)
+      eos = end;
+    p->name[p->count] = n->param->label;
+    p->value[p->count] = FIO_BUF_INFO2((char *)pos, (size_t)(eos - pos));
+    ++p->count;
+    if ((r = fio___http_rnode_match(n->param, method, eos, end, p)))
+      return r;
+    --p->count;
+  }
+wildcard:
+  if (n->wild && p->count < FIO_HTTP_MAX_PARAMS &&
+      (r = fio___http_rnode_pick(n->wild, method))) {
+    p->name[p->count] = n->wild->label;
+    if (p->name[p->count].len > 1) { /* "*name" => "name" */
+      ++p->name[p->count].buf;
+      --p->name[p->count].len;
+    }
+    p->value[p->count] = FIO_BUF_INFO2((char *)pos, (size_t)(end - pos));
+    ++p->count;
+    return r;
+  }
+  return NULL;
+}
+
+FIO_SFUNC fio___http_rentry_s *fio___http_router_find(fio_http_router_s *r,
+                                                      fio_str_info_s method,
+                                                      fio_str_info_s path,
+                                                      fio___http_rparams_s *p) {
+  p->count = 0;
+  if (!r->root || !path.len)
+    return NULL;
+  return fio___http_rnode_match(r->root,
+                                method,
+                                path.buf,
+                                path.buf + path.len,
+                                p);
+}
+
+FIO_SFUNC void fio___http_router_destroy(fio_http_router_s *r) {
+  fio___http_rnode_free(r->root);
+  *r = (fio_http_router_s){0};
+}
+
+#define FIO_REF_NAME       fio_http_router
+#define FIO_REF_DESTROY(o) fio___http_router_destroy(&(o))
+#include FIO_INCLUDE_FILE
+
+/** Creates a new (empty) HTTP router. */
+SFUNC fio_http_router_s *fio_http_router_new(void) {
+  return fio_http_router_new2();
+}
+
+/** Reduces a router's reference count or frees it. */
+SFUNC void fio_http_router_free(fio_http_router_s *r) {
+  fio_http_router_free2(r);
+}
+
+/** Increases a router's reference count. */
+SFUNC fio_http_router_s *fio_http_router_dup(fio_http_router_s *r) {
+  return fio_http_router_dup2(r);
+}
+
+/** Adds a route to the router. */
+SFUNC int fio_http_route FIO_NOOP(fio_http_router_s *r,
+                                  const char *method,
+                                  const char *pattern,
+                                  fio_http_route_s route) {
+  fio___http_rnode_s *n;
+  size_t params = 0;
+  size_t method_len = method ? FIO_STRLEN(method) : 0;
+  if (!r || !pattern || pattern[0] != '/' || !route.on_http ||
+      method_len >= sizeof(((fio___http_rentry_s *)0)->method))
+    goto bad_route;
+  if (!r->root && !(r->root = fio___http_rnode_new(NULL, 0)))
+    return -1;
+  n = r->root;
+  for (const char *pos = pattern; *pos;) {
+    const char *start = pos;
+    size_t len;
+    /* static text, up to a `:name` / `*name` segment */
+    while (*pos && !((pos[0] == ':' || pos[0] == '*') && pos[-1] == '/'))
+      ++pos;
+    if (pos > start && !(n = fio___http_rnode_insert(n,
+                                                     start,
+                                                     (size_t)(pos - start))))
+      return -1;
+    if (!*pos)
+      break;
+    start = pos;
+    if (pos[0] == '*') {
+      len = FIO_STRLEN(pos);
+      if (FIO_MEMCHR(pos, '/', len) || ++params > FIO_HTTP_MAX_PARAMS)
+        goto bad_route;
+      if (!n->wild && !(n->wild = fio___http_rnode_new(pos, len)))
+        return -1;
+      if (n->wild->label.len != len || FIO_MEMCMP(n->wild->label.buf, pos, len))
+        goto bad_name;
+      n = n->wild;
+      break;
+    }
+    while (*pos && *pos != '/')
+      ++pos;
+    len = (size_t)(pos - ++start);
+    if (!len || ++params > FIO_HTTP_MAX_PARAMS)
+      goto bad_route;
+    if (!n->param && !(n->param = fio___http_rnode_new(start, len)))
+      return -1;
+    if (n->param->label.len != len ||
+        FIO_MEMCMP(n->param->label.buf, start, len))
+      goto bad_name;
+    n = n->param;
+  }
+  for (uint32_t i = 0; i < n->routes_len; ++i) {
+    if (n->routes[i].method_len != method_len ||
+        FIO_MEMCMP(n->routes[i].method, method, method_len))
+      continue;
+    if (fio___http_rentry_vary_copy(&route))
+      return -1;
+    fio_bstr_free(n->routes[i].route.cache_vary.buf);
+    r->body_limits -= !!n->routes[i].route.max_body_size;
+    r->body_limits += !!route.max_body_size;
+    n->routes[i].route = route;
+    return 0;
+  }
+  {
+    fio___http_rentry_s *routes;
+    if (fio___http_rentry_vary_copy(&route))
+      return -1;
+    routes = (fio___http_rentry_s *)
+        FIO_MEM_REALLOC_(n->routes,
+                         sizeof(*routes) * n->routes_len,
+                         sizeof(*routes) * (n->routes_len + 1),
+                         sizeof(*routes) * n->routes_len);
+    if (!routes) {
+      fio_bstr_free(route.cache_vary.buf);
+      return -1;
+    }
+    n->routes = routes;
+    routes += n->routes_len++;
+    *routes = (fio___http_rentry_s){.route = route,
+                                    .method_len = (uint32_t)method_len};
+    if (method_len)
+      FIO_MEMCPY(routes->method, method, method_len);
+  }
+  r->body_limits += !!route.max_body_size;
+  return 0;
+
+bad_route:
+  FIO_LOG_ERROR("HTTP router: invalid route %s %s",
+                (method ? method : "*"),
+                (pattern ? pattern : "(NULL)"));
+  return -1;
+bad_name:
+  FIO_LOG_ERROR("HTTP router: conflicting parameter names in %s",
+                pattern);
+  return -1;
+}
+
+/** Returns the route matching the HTTP handle (setting path parameters). */
+SFUNC fio_http_route_s *fio_http_router_match(fio_http_router_s *r,
+                                              fio_http_s *h) {
+  fio___http_rparams_s p;
+  fio___http_rentry_s *e;
+  if (!r || !h)
+    return NULL;
+  e = fio___http_router_find(r, fio_http_method(h), fio_http_path(h), &p);
+  if (!e)
+    return NULL;
+  for (size_t i = 0; i < p.count; ++i)
+    fio_http_param_add(h,
+                       FIO_BUF2STR_INFO(p.name[i]),
+                       FIO_BUF2STR_INFO(p.value[i]));
+  return &e->route;
+}
+
 /* *****************************************************************************
 HTTP Connection Container
 ***************************************************************************** */
@@ -402,12 +1300,38 @@ struct fio___http_connection_http_s {
   void (*on_http_callback)(void *, void *);
   void (*on_http)(fio_http_s *h);
   fio_http1_parser_s parser;
+  char *body;      /* streamed request body data, pending delivery */
+  size_t streamed; /* total streamed request body length */
+  size_t max_body; /* the request's body limit (may be set by a route) */
   uint32_t max_header;
+  uint8_t streaming; /* a body chunk is being delivered, don't parse */
+  struct {         /* client connections only */
+    fio___http_client_pool_s *pool;
+    fio___http_client_fifo_s sent; /* requests waiting for a response */
+    FIO_LIST_NODE node;            /* the pool's connection list */
+    uint32_t in_flight;
+    uint32_t served;
+    uint8_t closing; /* 1: no new requests, 2: also, don't retry requests */
+  } client;
 };
 struct fio___http_connection_ws_s {
   void (*on_message)(fio_http_s *h, fio_buf_info_s msg, uint8_t is_text);
   fio_websocket_parser_s parser;
   char *msg;
+  uint8_t utf8_len; /* bytes of a code point split between streamed chunks */
+  char utf8[4];
+#if HAVE_ZLIB
+  struct { /* permessage-deflate state */
+    z_stream *in;  /* lazily allocated */
+    z_stream *out; /* lazily allocated */
+    size_t min;    /* shorter messages aren't compressed */
+    fio_lock_i lock; /* compression order MUST match the write order */
+    uint8_t on;
+    uint8_t bits;      /* window bits for outgoing messages */
+    uint8_t in_reset;  /* client_no_context_takeover */
+    uint8_t out_reset; /* server_no_context_takeover */
+  } deflate;
+#endif
 };
 struct fio___http_connection_sse_s {
   void (*on_message)(fio_http_s *h, fio_buf_info_s msg, uint8_t is_text);
@@ -416,6 +1340,86 @@ struct fio___http_connection_sse_s {
   void (*on_close)(fio_http_s *h);
 };
 
+/** A pending (buffered) segment of a pipelined response. */
+typedef struct fio___http_pipeline_seg_s {
+  struct fio___http_pipeline_seg_s *next;
+  fio_write_args_s args;
+} fio___http_pipeline_seg_s;
+
+/** A pipelined request, waiting for its turn to send the response. */
+typedef struct {
+  fio_http_s *h;
+  fio___http_pipeline_seg_s *seg;
+  fio___http_pipeline_seg_s *last;
+  uint8_t finished;
+  uint8_t upgraded;
+} fio___http_pipeline_slot_s;
+
+/** HTTP/1.1 pipelining state - sequences responses in request order. */
+typedef struct {
+  fio_http_s *held; /* upgrade request, waiting for pipeline to drain */
+  char *held_body;  /* the held request's (streamed) body, if any */
+  fio_lock_i lock;
+  uint32_t head;
+  uint32_t count;
+  uint32_t capa;
+  uint8_t flush_scheduled;
+  uint8_t upgraded;
+  uint8_t closing;
+  fio___http_pipeline_slot_s slots[];
+} fio___http_pipeline_s;
+
+FIO___LEAK_COUNTER_DEF(http___pipeline)
+FIO___LEAK_COUNTER_DEF(http___pipeline_segment)
+
+FIO_SFUNC void fio___http_pipeline_bstr_free(void *b) {
+  fio_bstr_free((char *)b);
+}
+
+/** Deallocates a segment, including any data it owns. */
+FIO_SFUNC void fio___http_pipeline_seg_free(fio___http_pipeline_seg_s *seg) {
+  if (seg->args.buf) {
+    if (seg->args.dealloc)
+      seg->args.dealloc(seg->args.buf);
+  } else if (seg->args.fd != -1) {
+    if (seg->args.dealloc)
+      seg->args.dealloc((void *)seg->args.fd);
+    else
+      close((int)seg->args.fd);
+  }
+  FIO_MEM_FREE_(seg, sizeof(*seg));
+  FIO___LEAK_COUNTER_ON_FREE(http___pipeline_segment);
+}
+
+FIO_SFUNC fio___http_pipeline_s *fio___http_pipeline_new(uint32_t capa) {
+  const size_t len = sizeof(fio___http_pipeline_s) +
+                     (sizeof(fio___http_pipeline_slot_s) * capa);
+  fio___http_pipeline_s *p =
+      (fio___http_pipeline_s *)FIO_MEM_REALLOC_(NULL, 0, len, 0);
+  FIO_ASSERT_ALLOC(p);
+  FIO___LEAK_COUNTER_ON_ALLOC(http___pipeline);
+  FIO_MEMSET(p, 0, len);
+  p->capa = capa;
+  return p;
+}
+
+FIO_SFUNC void fio___http_pipeline_free(fio___http_pipeline_s *p) {
+  if (!p)
+    return;
+  for (uint32_t i = 0; i < p->capa; ++i) {
+    while (p->slots[i].seg) {
+      fio___http_pipeline_seg_s *tmp = p->slots[i].seg;
+      p->slots[i].seg = tmp->next;
+      fio___http_pipeline_seg_free(tmp);
+    }
+  }
+  fio_bstr_free(p->held_body);
+  FIO_MEM_FREE_(p,
+                sizeof(fio___http_pipeline_s) +
+                    (sizeof(fio___http_pipeline_slot_s) * p->capa));
+  FIO___LEAK_COUNTER_ON_FREE(http___pipeline);
+}
+
 /** Connection objects for managing HTTP / WebSocket connection state. */
 typedef struct {
   fio_s *io;
@@ -423,6 +1427,12 @@ typedef struct {
   fio_http_settings_s *settings;
   fio_queue_s *queue;
   void *udata;
+  fio___http_pipeline_s *pipeline;
+  fio_http_s *spare; /* a reset handle, recycled for the next request */
+  FIO_LIST_NODE deadline_node; /* the deadline wheel's bucket (IO thread) */
+  int64_t deadline;            /* in seconds, see `deadline_kind` */
+  size_t received;             /* bytes read, for the minimal body rate */
+  size_t received_mark;        /* `received` when the deadline was set */
   union {
     struct fio___http_connection_http_s http;
     struct fio___http_connection_ws_s ws;
@@ -433,25 +1443,275 @@ typedef struct {
   uint8_t log;
   uint8_t suspend;
   uint8_t is_client;
-  char buf[];
+  uint8_t deadline_kind; /* a `fio___http_deadline_e` value */
+  uint8_t ip_counted;    /* counted by the per IP connection limit */
+  uint8_t peer_len;
+  char peer[48]; /* the peer address (when logging or limiting per IP) */
+  char *buf;     /* borrowed from the pool only while data is pending */
 } fio___http_connection_s;
 
 #define FIO_REF_NAME             fio___http_connection
 #define FIO_REF_CONSTRUCTOR_ONLY 1
-#define FIO_REF_FLEX_TYPE        char
 #define FIO_REF_DESTROY(o)                                                     \
   do {                                                                         \
+    fio___http_pipeline_free(o.pipeline);                                      \
+    fio_http_free(o.spare);                                                    \
+    fio___http_buffer_pool_push(                                               \
+        &FIO_PTR_FROM_FIELD(fio___http_protocol_s, settings, o.settings)       \
+             ->buffers,                                                        \
+        o.buf,                                                                 \
+        o.capa);                                                               \
     fio___http_protocol_free(                                                  \
         FIO_PTR_FROM_FIELD(fio___http_protocol_s, settings, o.settings));      \
   } while (0)
 #include FIO_INCLUDE_FILE
 
-#undef FIO___RECURSIVE_INCLUDE
+/** Returns the connection's read buffer, borrowing one from the pool. */
+FIO_IFUNC char *fio___http_buffer(fio___http_connection_s *c) {
+  if (!c->buf)
+    c->buf = fio___http_buffer_pool_pop(
+        &FIO_PTR_FROM_FIELD(fio___http_protocol_s, settings, c->settings)
+             ->buffers,
+        c->capa);
+  return c->buf;
+}
+
+/** Returns the read buffer to the pool once all pending data was consumed. */
+FIO_IFUNC void fio___http_buffer_release(fio___http_connection_s *c) {
+  if (c->len || !c->buf)
+    return;
+  fio___http_buffer_pool_push(
+      &FIO_PTR_FROM_FIELD(fio___http_protocol_s, settings, c->settings)
+           ->buffers,
+      c->buf,
+      c->capa);
+  c->buf = NULL;
+}
+
+/* concurrent connection count per peer address (IO thread only) */
+#define FIO_MAP_NAME  fio___http_ip_map
+#define FIO_MAP_VALUE uint32_t
+#include FIO_INCLUDE_FILE
+
+#undef FIO___RECURSIVE_INCLUDE
+
+/* *****************************************************************************
+HTTP/1.1 Slow Clients (request deadlines and per IP connection limits)
+
+Request deadlines are stored in a wheel of one second buckets, reviewed once a
+second by a single server timer, rather than using per connection timers. The
+wheel and the per IP connection count are only accessed by the IO thread.
+***************************************************************************** */
+
+#define FIO___HTTP_DEADLINE_BUCKETS 64 /* must be a power of 2 */
+
+typedef enum {
+  FIO___HTTP_DEADLINE_NONE = 0,
+  FIO___HTTP_DEADLINE_HEAD, /* the request line and headers must arrive */
+  FIO___HTTP_DEADLINE_BODY, /* the body must arrive at `min_body_rate` */
+} fio___http_deadline_e;
+
+static struct {
+  FIO_LIST_HEAD bucket[FIO___HTTP_DEADLINE_BUCKETS];
+  int64_t reviewed; /* the last second reviewed */
+  uint8_t running;
+} fio___http_deadlines;
+
+static fio___http_ip_map_s fio___http_ips = FIO_MAP_INIT;
+
+FIO_SFUNC int fio___http_deadline_review(void *ignr1_, void *ignr2_);
+
+FIO_SFUNC void fio___http_deadline_on_finish(void *ignr1_, void *ignr2_) {
+  fio___http_deadlines.running = 0;
+  (void)ignr1_, (void)ignr2_;
+}
+
+/** Removes the connection from the deadline wheel (if listed). */
+FIO_IFUNC void fio___http_deadline_clear(fio___http_connection_s *c) {
+  if (!c->deadline_kind)
+    return;
+  FIO_LIST_REMOVE(&c->deadline_node);
+  c->deadline_kind = FIO___HTTP_DEADLINE_NONE;
+}
+
+/** Sets (or replaces) the connection's deadline, `seconds` from now. */
+FIO_SFUNC void fio___http_deadline_set(fio___http_connection_s *c,
+                                       fio___http_deadline_e kind,
+                                       int64_t seconds) {
+  const int64_t now = fio_srv_last_tick() / 1000;
+  if (!fio___http_deadlines.running) {
+    fio___http_deadlines.running = 1;
+    fio___http_deadlines.reviewed = now;
+    if (!fio___http_deadlines.bucket[0].next) {
+      for (size_t i = 0; i < FIO___HTTP_DEADLINE_BUCKETS; ++i)
+        fio___http_deadlines.bucket[i] =
+            FIO_LIST_INIT(fio___http_deadlines.bucket[i]);
+    }
+    fio_srv_run_every(.fn = fio___http_deadline_review,
+                      .on_finish = fio___http_deadline_on_finish,
+                      .every = 1000,
+                      .repetitions = -1);
+  }
+  fio___http_deadline_clear(c);
+  c->deadline = now + seconds;
+  c->received_mark = c->received;
+  c->deadline_kind = (uint8_t)kind;
+  FIO_LIST_PUSH(fio___http_deadlines.bucket +
+                    (c->deadline & (FIO___HTTP_DEADLINE_BUCKETS - 1)),
+                &c->deadline_node);
+}
+
+/** Sets, keeps or clears the deadline, according to the parser's state. */
+FIO_SFUNC void fio___http1_deadline_update(fio___http_connection_s *c,
+                                           size_t pending) {
+  fio___http_deadline_e kind = FIO___HTTP_DEADLINE_NONE;
+  if (c->is_client || c->suspend)
+    kind = FIO___HTTP_DEADLINE_NONE; /* waiting for the server, not the peer */
+  else if (fio_http1_parser_is_body(&c->state.http.parser))
+    kind = FIO___HTTP_DEADLINE_BODY;
+  else if (pending || !fio_http1_parser_is_empty(&c->state.http.parser))
+    kind = FIO___HTTP_DEADLINE_HEAD;
+  if ((uint8_t)kind == c->deadline_kind)
+    return; /* deadlines are never extended while waiting for the same data */
+  switch (kind) {
+  case FIO___HTTP_DEADLINE_NONE: break;
+  case FIO___HTTP_DEADLINE_HEAD:
+    if (!c->settings->header_timeout)
+      kind = FIO___HTTP_DEADLINE_NONE;
+    break;
+  case FIO___HTTP_DEADLINE_BODY:
+    if (!c->settings->min_body_rate)
+      kind = FIO___HTTP_DEADLINE_NONE;
+    break;
+  }
+  if (!kind) {
+    fio___http_deadline_clear(c);
+    return;
+  }
+  fio___http_deadline_set(c,
+                          kind,
+                          (kind == FIO___HTTP_DEADLINE_HEAD
+                               ? (int64_t)c->settings->header_timeout
+                               : (int64_t)FIO_HTTP_BODY_RATE_WINDOW));
+}
+
+/** Closes a connection that reached its deadline (or sets the next one). */
+FIO_SFUNC void fio___http_deadline_expired(fio___http_connection_s *c) {
+  if (c->deadline_kind == FIO___HTTP_DEADLINE_BODY &&
+      (c->suspend || c->state.http.streaming ||
+       (c->received - c->received_mark) >=
+           ((size_t)c->settings->min_body_rate * FIO_HTTP_BODY_RATE_WINDOW))) {
+    fio___http_deadline_set(c,
+                            FIO___HTTP_DEADLINE_BODY,
+                            FIO_HTTP_BODY_RATE_WINDOW);
+    return;
+  }
+  FIO_LOG_DDEBUG2("(%d) HTTP closing slow client (%p), %s deadline reached",
+                  (int)fio_thread_getpid(),
+                  (void *)c->io,
+                  (c->deadline_kind == FIO___HTTP_DEADLINE_HEAD ? "header"
+                                                                : "body"));
+  fio___http_deadline_clear(c);
+  fio_close(c->io);
+}
+
+/** Reviews the wheel's buckets for every second since the last review. */
+FIO_SFUNC int fio___http_deadline_review(void *ignr1_, void *ignr2_) {
+  const int64_t now = fio_srv_last_tick() / 1000;
+  int64_t i = fio___http_deadlines.reviewed;
+  if (now - i > FIO___HTTP_DEADLINE_BUCKETS)
+    i = now - FIO___HTTP_DEADLINE_BUCKETS;
+  while (i < now) {
+    ++i;
+    FIO_LIST_EACH(fio___http_connection_s,
+                  deadline_node,
+                  fio___http_deadlines.bucket +
+                      (i & (FIO___HTTP_DEADLINE_BUCKETS - 1)),
+                  c) {
+      if (c->deadline <= now)
+        fio___http_deadline_expired(c);
+    }
+  }
+  fio___http_deadlines.reviewed = now;
+  return 0;
+  (void)ignr1_, (void)ignr2_;
+}
+
+FIO_SFUNC void fio___http_ip_cleanup(void *ignr_) {
+  fio___http_ip_map_destroy(&fio___http_ips);
+  (void)ignr_;
+}
+
+/** Counts the peer's connections, returning -1 if the limit was reached. */
+FIO_SFUNC int fio___http_ip_add(fio___http_connection_s *c, uint32_t limit) {
+  fio___http_ip_map_node_s *n;
+  uint64_t hash;
+  if (!c->peer_len)
+    return 0; /* unknown address (i.e., a Unix socket) */
+  hash = fio_risky_hash(c->peer, c->peer_len, 0);
+  n = fio___http_ip_map_get_ptr(&fio___http_ips,
+                                hash,
+                                FIO_STR_INFO2(c->peer, c->peer_len));
+  if (n && n->value >= limit)
+    return -1;
+  if (n) {
+    ++n->value;
+  } else {
+    if (!fio___http_ip_map_capa(&fio___http_ips)) /* freed at exit */
+      fio_state_callback_add(FIO_CALL_AT_EXIT, fio___http_ip_cleanup, NULL);
+    fio___http_ip_map_set(&fio___http_ips,
+                          hash,
+                          FIO_STR_INFO2(c->peer, c->peer_len),
+                          1,
+                          NULL);
+  }
+  c->ip_counted = 1;
+  return 0;
+}
+
+/** Releases the connection's slot in the per IP connection count. */
+FIO_SFUNC void fio___http_ip_remove(fio___http_connection_s *c) {
+  fio___http_ip_map_node_s *n;
+  uint64_t hash;
+  if (!c->ip_counted)
+    return;
+  c->ip_counted = 0;
+  hash = fio_risky_hash(c->peer, c->peer_len, 0);
+  n = fio___http_ip_map_get_ptr(&fio___http_ips,
+                                hash,
+                                FIO_STR_INFO2(c->peer, c->peer_len));
+  if (n && !--n->value)
+    fio___http_ip_map_remove(&fio___http_ips,
+                             hash,
+                             FIO_STR_INFO2(c->peer, c->peer_len),
+                             NULL);
+}
 
 /* *****************************************************************************
 HTTP Request handling / handling
 ***************************************************************************** */
 
+/** Releases the connection reference held by an HTTP handle. */
+FIO_SFUNC void fio___http_controller_on_destroyed_task(void *c_, void *ignr_);
+
+/** Frees the handle, or resets it for the next keep-alive request. */
+FIO_SFUNC void fio___http_handle_free_or_recycle(fio___http_connection_s *c,
+                                                 fio_http_s *h) {
+  /* recycle only if the user didn't keep a reference and is done with it */
+  if (fio_http_references(h) != 1 ||
+      (fio_http_is_upgraded(h) | !fio_http_is_finished(h)) ||
+      !fio_srv_is_open(c->io) || c->spare) {
+    fio_http_free(h);
+    return;
+  }
+  /* the controller's `on_destroyed` is skipped, so the connection is kept */
+  fio_http_controller_set(h, NULL);
+  fio_http_reset(h);
+  h = fio_atomic_exchange(&c->spare, h);
+  fio_http_free(h); /* in case another thread recycled a handle first */
+  fio_queue_push(fio_srv_queue(), fio___http_controller_on_destroyed_task, c);
+}
+
 FIO_SFUNC void fio___http_perform_user_callback(void *cb_, void *h_) {
   union {
     void (*fn)(fio_http_s *);
@@ -461,9 +1721,262 @@ FIO_SFUNC void fio___http_perform_user_callback(void *cb_, void *h_) {
   fio___http_connection_s *c = (fio___http_connection_s *)fio_http_cdata(h);
   if (FIO_LIKELY(fio_srv_is_open(c->io)))
     cb.fn(h);
-  fio_http_free(h);
+  fio___http_handle_free_or_recycle(c, h);
+}
+
+/* *****************************************************************************
+WebSocket permessage-deflate negotiation (RFC 7692)
+***************************************************************************** */
+#if HAVE_ZLIB
+
+/** Accepts the first valid permessage-deflate offer (if any). */
+FIO_SFUNC void fio___websocket_deflate_negotiate(fio_http_s *h,
+                                                fio___http_connection_s *c) {
+  if (!c->settings->ws_compress_min)
+    return;
+  FIO_HTTP_HEADER_EACH_VALUE(h,
+                             1,
+                             FIO_STR_INFO2((char *)"sec-websocket-extensions",
+                                           24),
+                             val) {
+    FIO_STR_INFO_TMP_VAR(ext, 127);
+    size_t server_bits = 0;
+    uint8_t ok = 1;
+    uint8_t server_nct = c->settings->ws_no_context_takeover;
+    uint8_t client_nct = c->settings->ws_no_context_takeover;
+    if (!FIO_STR_INFO_IS_EQ(val,
+                            FIO_STR_INFO2((char *)"permessage-deflate", 18)))
+      continue;
+    FIO_HTTP_HEADER_VALUE_EACH_PROPERTY(val, p) {
+      char *iptr = p.value.buf;
+      if (FIO_STR_INFO_IS_EQ(
+              p.name,
+              FIO_STR_INFO2((char *)"server_no_context_takeover", 26)))
+        server_nct = 1;
+      else if (FIO_STR_INFO_IS_EQ(
+                   p.name,
+                   FIO_STR_INFO2((char *)"client_no_context_takeover", 26)))
+        client_nct = 1;
+      else if (FIO_STR_INFO_IS_EQ(
+                   p.name,
+                   FIO_STR_INFO2((char *)"server_max_window_bits", 22))) {
+        /* zlib's raw deflate can't use a 256 byte window (8 bits) */
+        server_bits = (p.value.len ? fio_atol10u(&iptr) : 0);
+        ok &= (server_bits > 8 && server_bits < 16 &&
+               iptr == p.value.buf + p.value.len);
+      } else if (FIO_STR_INFO_IS_EQ(
+                     p.name,
+                     FIO_STR_INFO2((char *)"client_max_window_bits", 22))) {
+        /* we inflate using a 15 bit window, any client window is supported */
+        size_t client_bits = (p.value.len ? fio_atol10u(&iptr) : 15);
+        ok &= (client_bits > 7 && client_bits < 16 &&
+               iptr == p.value.buf + p.value.len);
+      } else
+        ok = 0; /* unknown parameter, decline offer */
+    }
+    if (!ok)
+      continue;
+    fio_string_write(&ext, NULL, "permessage-deflate", 18);
+    if (server_nct)
+      fio_string_write(&ext, NULL, "; server_no_context_takeover", 28);
+    if (client_nct)
+      fio_string_write(&ext, NULL, "; client_no_context_takeover", 28);
+    if (server_bits) {
+      if (server_bits > FIO_HTTP_WEBSOCKET_DEFLATE_WINDOW_BITS)
+        server_bits = FIO_HTTP_WEBSOCKET_DEFLATE_WINDOW_BITS;
+      fio_string_write2(&ext,
+                        NULL,
+                        FIO_STRING_WRITE_STR2("; server_max_window_bits=", 25),
+                        FIO_STRING_WRITE_UNUM(server_bits));
+    }
+    fio_http_response_header_set(
+        h,
+        FIO_STR_INFO2((char *)"sec-websocket-extensions", 24),
+        ext);
+    return;
+  }
+}
+
+/** Sets up the permessage-deflate state using the negotiation's response. */
+FIO_SFUNC void fio___websocket_deflate_setup(fio___http_connection_s *c) {
+  FIO_HTTP_HEADER_EACH_VALUE(c->h,
+                             0,
+                             FIO_STR_INFO2((char *)"sec-websocket-extensions",
+                                           24),
+                             val) {
+    if (!FIO_STR_INFO_IS_EQ(val,
+                            FIO_STR_INFO2((char *)"permessage-deflate", 18)))
+      continue;
+    c->state.ws.deflate.on = 1;
+    c->state.ws.deflate.min = c->settings->ws_compress_min;
+    c->state.ws.deflate.bits = FIO_HTTP_WEBSOCKET_DEFLATE_WINDOW_BITS;
+    FIO_HTTP_HEADER_VALUE_EACH_PROPERTY(val, p) {
+      char *iptr = p.value.buf;
+      if (FIO_STR_INFO_IS_EQ(
+              p.name,
+              FIO_STR_INFO2((char *)"server_no_context_takeover", 26)))
+        c->state.ws.deflate.out_reset = 1;
+      else if (FIO_STR_INFO_IS_EQ(
+                   p.name,
+                   FIO_STR_INFO2((char *)"client_no_context_takeover", 26)))
+        c->state.ws.deflate.in_reset = 1;
+      else if (FIO_STR_INFO_IS_EQ(
+                   p.name,
+                   FIO_STR_INFO2((char *)"server_max_window_bits", 22)) &&
+               iptr)
+        c->state.ws.deflate.bits = (uint8_t)fio_atol10u(&iptr);
+    }
+    return;
+  }
+}
+
+/** Frees the permessage-deflate state. */
+FIO_SFUNC void fio___websocket_deflate_destroy(fio___http_connection_s *c) {
+  if (c->state.ws.deflate.in) {
+    inflateEnd(c->state.ws.deflate.in);
+    FIO_MEM_FREE_(c->state.ws.deflate.in, sizeof(z_stream));
+  }
+  if (c->state.ws.deflate.out) {
+    deflateEnd(c->state.ws.deflate.out);
+    FIO_MEM_FREE_(c->state.ws.deflate.out, sizeof(z_stream));
+  }
+  c->state.ws.deflate.in = c->state.ws.deflate.out = NULL;
+}
+
+/** Inflates a compressed message, returns NULL on error. */
+FIO_SFUNC char *fio___websocket_inflate(fio___http_connection_s *c,
+                                        fio_buf_info_s msg) {
+  z_stream *z = c->state.ws.deflate.in;
+  char *r = NULL;
+  const size_t limit = c->settings->ws_max_msg_size;
+  if (!c->state.ws.deflate.on)
+    return r;
+  if (!z) {
+    z = (z_stream *)FIO_MEM_REALLOC_(NULL, 0, sizeof(*z), 0);
+    if (!z)
+      return r;
+    *z = (z_stream){0};
+    if (inflateInit2(z, -15) != Z_OK) {
+      FIO_MEM_FREE_(z, sizeof(*z));
+      return r;
+    }
+    c->state.ws.deflate.in = z;
+  }
+  z->next_in = (Bytef *)msg.buf;
+  z->avail_in = (uInt)msg.len;
+  for (;;) {
+    fio_str_info_s i;
+    int e;
+    r = fio_bstr_reserve(r, (msg.len << 1) + 64);
+    i = fio_bstr_info(r);
+    z->next_out = (Bytef *)i.buf + i.len;
+    z->avail_out = (uInt)(i.capa - i.len - 1);
+    e = inflate(z, Z_SYNC_FLUSH);
+    r = fio_bstr_len_set(r, i.capa - 1 - z->avail_out);
+    if (e == Z_STREAM_END) { /* the peer used BFINAL, start a new stream */
+      inflateReset(z);
+      if (!z->avail_in)
+        break;
+      continue;
+    }
+    if (e != Z_OK && e != Z_BUF_ERROR)
+      goto inflate_error;
+    if (fio_bstr_len(r) > limit)
+      goto inflate_error;
+    if (!z->avail_in && z->avail_out)
+      break;
+    if (e == Z_BUF_ERROR && z->avail_out)
+      break; /* no progress possible */
+  }
+  if (c->state.ws.deflate.in_reset) {
+    inflateEnd(z);
+    FIO_MEM_FREE_(z, sizeof(*z));
+    c->state.ws.deflate.in = NULL;
+  }
+  return r;
+
+inflate_error:
+  FIO_LOG_DDEBUG2("WebSocket message inflate error (or message too big)");
+  fio_bstr_free(r);
+  return NULL;
+}
+
+/** Writes a compressed WebSocket message, returns -1 on error. */
+FIO_SFUNC int fio___websocket_write_deflated(fio___http_connection_s *c,
+                                             const void *buf,
+                                             size_t len,
+                                             uint8_t opcode) {
+  z_stream *z;
+  char *tmp = NULL, *payload;
+  fio_lock(&c->state.ws.deflate.lock);
+  z = c->state.ws.deflate.out;
+  if (!z) {
+    const int bits = c->state.ws.deflate.bits;
+    z = (z_stream *)FIO_MEM_REALLOC_(NULL, 0, sizeof(*z), 0);
+    if (!z)
+      goto error;
+    *z = (z_stream){0};
+    if (deflateInit2(z,
+                     Z_DEFAULT_COMPRESSION,
+                     Z_DEFLATED,
+                     0 - bits,
+                     (bits > 9 ? bits - 7 : 2),
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+      FIO_MEM_FREE_(z, sizeof(*z));
+      goto error;
+    }
+    c->state.ws.deflate.out = z;
+  }
+  z->next_in = (Bytef *)buf;
+  z->avail_in = (uInt)len;
+  do {
+    fio_str_info_s i;
+    tmp = fio_bstr_reserve(tmp, (z->avail_in >> 1) + 64);
+    i = fio_bstr_info(tmp);
+    z->next_out = (Bytef *)i.buf + i.len;
+    z->avail_out = (uInt)(i.capa - i.len - 1);
+    deflate(z, Z_SYNC_FLUSH);
+    tmp = fio_bstr_len_set(tmp, i.capa - 1 - z->avail_out);
+  } while (!z->avail_out);
+  if (c->state.ws.deflate.out_reset) {
+    deflateEnd(z);
+    FIO_MEM_FREE_(z, sizeof(*z));
+    c->state.ws.deflate.out = NULL;
+  }
+  /* remove the trailing 0x00 0x00 0xFF 0xFF (RFC 7692, section 7.2.1) */
+  len = fio_bstr_len(tmp) - 4;
+  payload =
+      fio_bstr_reserve(NULL,
+                       fio_websocket_wrapped_len(len) + (c->is_client << 2));
+  payload = fio_bstr_len_set(
+      payload,
+      (c->is_client ? fio_websocket_client_wrap : fio_websocket_server_wrap)(
+          payload,
+          tmp,
+          len,
+          opcode,
+          1,
+          1,
+          4 /* RSV1 */));
+  fio_bstr_free(tmp);
+  fio_write2(c->io,
+             .buf = payload,
+             .len = fio_bstr_len(payload),
+             .dealloc = (void (*)(void *))fio_bstr_free);
+  fio_unlock(&c->state.ws.deflate.lock);
+  return 0 - !fio_srv_is_open(c->io);
+error:
+  fio_unlock(&c->state.ws.deflate.lock);
+  return -1;
 }
 
+#else
+#define fio___websocket_deflate_negotiate(h, c)
+#define fio___websocket_deflate_setup(c)
+#define fio___websocket_deflate_destroy(c)
+#define fio___websocket_inflate(c, msg) ((void)(msg), (char *)NULL)
+#endif /* HAVE_ZLIB */
+
 FIO_SFUNC void fio___http_perform_user_upgrade_callback_websockets(void *cb_,
                                                                    void *h_) {
   union {
@@ -477,50 +1990,7 @@ FIO_SFUNC void fio___http_perform_user_upgrade_callback_websockets(void *cb_,
     goto refuse_upgrade;
   if (c->h) /* request after WebSocket Upgrade? an attack vector? */
     goto refuse_upgrade;
-#if HAVE_ZLIB && 0           /* TODO: logs and fix extension handling logic */
-  FIO_HTTP_HEADER_EACH_VALUE(/* TODO: setup WebSocket extension */
-                             h,
-                             1,
-                             FIO_STR_INFO2((char *)"sec-websocket-extensions",
-                                           24),
-                             val) {
-    FIO_LOG_DDEBUG2("WebSocket extension requested: %.*s",
-                    (int)val.len,
-                    val.buf);
-    if (!FIO_STR_INFO_IS_EQ(val,
-                            FIO_STR_INFO2((char *)"permessage-deflate", 18)))
-      continue;
-    size_t client_bits = 0, server_bits = 0;
-    FIO_HTTP_HEADER_VALUE_EACH_PROPERTY(val, p) {
-      FIO_LOG_DDEBUG2("\t %.*s: %.*s",
-                      (int)p.name.len,
-                      p.name.buf,
-                      (int)p.value.len,
-                      p.value.buf);
-      if (FIO_STR_INFO_IS_EQ(p.name,
-                             FIO_STR_INFO2((char *)"client_max_window_bits",
-                                           22))) { /* used by chrome */
-        char *iptr = p.value.buf;
-        client_bits = iptr ? fio_atol10u(&iptr) : 0;
-        if (client_bits < 8 || client_bits > 15)
-          client_bits = (size_t)-1;
-      }
-      if (FIO_STR_INFO_IS_EQ(
-              p.name,
-              FIO_STR_INFO2((char *)"server_max_window_bits", 22))) {
-        char *iptr = p.value.buf;
-        server_bits = iptr ? fio_atol10u(&iptr) : 0;
-        if (server_bits < 8 || server_bits > 15)
-          server_bits = (size_t)-1;
-      }
-    }
-    if (client_bits)
-      ; /* TODO */
-    if (server_bits)
-      ; /* TODO */
-    break;
-  } /* HAVE_ZLIB */
-#endif
+  fio___websocket_deflate_negotiate(h, c);
   fio_http_upgrade_websockets(h);
   return;
 
@@ -585,17 +2055,62 @@ http2_requested:
 #endif
 }
 
-FIO_SFUNC void fio___http_on_http_direct(void *h_, void *ignr) {
-  fio_http_s *h = (fio_http_s *)h_;
-  fio_http_status_set(h, 200);
+/** Continues a request released by the response cache. */
+FIO_SFUNC void fio___http_cache_on_release(fio_http_s *h, void *route_) {
   fio___http_connection_s *c = (fio___http_connection_s *)fio_http_cdata(h);
-  if (fio___http_on_http_test4upgrade(h, c))
+  fio_http_route_s *r = (fio_http_route_s *)route_;
+  union {
+    void (*fn)(fio_http_s *);
+    void *ptr;
+  } cb = {.fn = (r ? r->on_http : c->state.http.on_http)};
+  if (fio_http_is_finished(h)) {
+    /* sent from the cache, the connection may already be closed */
+    fio_http_free(h);
     return;
+  }
+  fio_queue_push(((r && r->queue) ? r->queue->q : c->queue),
+                 fio___http_perform_user_callback,
+                 cb.ptr,
+                 (void *)h);
+}
+
+/** Routes the request (if a router was set) and schedules `on_http`. */
+FIO_IFUNC void fio___http_on_http_dispatch(fio___http_connection_s *c,
+                                           fio_http_s *h) {
   union {
     void (*fn)(fio_http_s *);
     void *ptr;
   } cb = {.fn = c->state.http.on_http};
-  fio_queue_push(c->queue, fio___http_perform_user_callback, cb.ptr, (void *)h);
+  fio_queue_s *q = c->queue;
+  fio_http_route_s *r = NULL;
+  fio_http_cache_args_s cache = {.ttl = c->settings->cache_ttl,
+                                 .vary = c->settings->cache_vary,
+                                 .on_release = fio___http_cache_on_release};
+  if (c->settings->router &&
+      (r = fio_http_router_match(c->settings->router, h))) {
+    cb.fn = r->on_http;
+    if (r->udata)
+      fio_http_udata_set(h, r->udata);
+    if (r->queue)
+      q = r->queue->q;
+    if (r->cache_ttl) {
+      cache.ttl = r->cache_ttl;
+      cache.vary = r->cache_vary;
+    }
+    cache.udata = (void *)r;
+  }
+  if (cache.ttl && !fio_http_cache(h, cache))
+    return;
+  fio_queue_push(q, fio___http_perform_user_callback, cb.ptr, (void *)h);
+}
+
+FIO_SFUNC void fio___http_on_http_direct(void *h_, void *ignr) {
+  fio_http_s *h = (fio_http_s *)h_;
+  fio_http_status_set(h, 200);
+  fio___http_connection_s *c = (fio___http_connection_s *)fio_http_cdata(h);
+  if (fio___http_on_http_test4upgrade(h, c))
+    return;
+  fio___http_on_http_dispatch(c, h);
   (void)ignr;
 }
 
@@ -614,11 +2129,7 @@ FIO_SFUNC void fio___http_on_http_with_public_folder(void *h_, void *ignr) {
     fio_http_free(h);
     return;
   }
-  union {
-    void (*fn)(fio_http_s *);
-    void *ptr;
-  } cb = {.fn = c->state.http.on_http};
-  fio_queue_push(c->queue, fio___http_perform_user_callback, cb.ptr, (void *)h);
+  fio___http_on_http_dispatch(c, h);
   (void)ignr;
 }
 
@@ -655,7 +2166,9 @@ static void fio___http_listen_on_finished(fio_protocol_s *p, void *u) {
 void fio_http_listen___(void); /* IDE marker */
 SFUNC void *fio_http_listen FIO_NOOP(const char *url, fio_http_settings_s s) {
   http_settings_validate(&s, 0);
-  fio___http_protocol_s *p = fio___http_protocol_new(s.public_folder.len + 1);
+  fio___http_protocol_s *p = fio___http_protocol_new(
+      s.public_folder.len + s.static_headers.len + s.cache_vary.len +
+      s.compress_types.len + 1);
   fio_tls_s *auto_tls_detected = NULL;
   FIO_ASSERT_ALLOC(p);
   for (size_t i = 0; i < FIO___HTTP_PROTOCOL_NONE + 1; ++i) {
@@ -701,14 +2214,33 @@ SFUNC void *fio_http_listen FIO_NOOP(const char *url, fio_http_settings_s s) {
     for (size_t i = 0; i < FIO___HTTP_PROTOCOL_NONE + 1; ++i)
       p->state[i].protocol.io_functions = *s.tls_io_func;
   }
+  if (s.router)
+    s.router = fio_http_router_dup(s.router);
   p->settings = s;
   p->on_http_callback = (p->settings.public_folder.len)
                             ? fio___http_on_http_with_public_folder
                             : fio___http_on_http_direct;
   p->settings.public_folder.buf = p->public_folder_buf;
+  p->settings.static_headers.buf = p->public_folder_buf + s.public_folder.len;
+  p->settings.cache_vary.buf =
+      p->settings.static_headers.buf + s.static_headers.len;
+  p->settings.compress_types.buf =
+      p->settings.cache_vary.buf + s.cache_vary.len;
   p->queue = p->settings.queue ? p->settings.queue->q : fio_srv_queue();
   if (s.public_folder.len)
     FIO_MEMCPY(p->public_folder_buf, s.public_folder.buf, s.public_folder.len);
+  if (s.static_headers.len)
+    FIO_MEMCPY(p->settings.static_headers.buf,
+               s.static_headers.buf,
+               s.static_headers.len);
+  if (s.cache_vary.len)
+    FIO_MEMCPY(p->settings.cache_vary.buf, s.cache_vary.buf, s.cache_vary.len);
+  if (s.compress_types.len)
+    FIO_MEMCPY(p->settings.compress_types.buf,
+               s.compress_types.buf,
+               s.compress_types.len);
+  p->public_folder_buf[s.public_folder.len + s.static_headers.len +
+                       s.cache_vary.len + s.compress_types.len] = 0;
   void *listener =
       fio_srv_listen(.url = url,
                      .protocol = &p->state[FIO___HTTP_PROTOCOL_ACCEPT].protocol,
@@ -720,19 +2252,391 @@ SFUNC void *fio_http_listen FIO_NOOP(const char *url, fio_http_settings_s s) {
   return listener;
 }
 
+/* *****************************************************************************
+HTTP/1.1 Pipelining - sequencing and batching responses
+***************************************************************************** */
+
+FIO_SFUNC int fio___http1_process_data(fio_s *io, fio___http_connection_s *c);
+FIO_IFUNC void fio___http1_on_http_schedule(fio___http_connection_s *c,
+                                            fio_http_s *h,
+                                            char *body);
+
+/** Finds the (unfinished) slot for the HTTP handle. Call within lock. */
+FIO_IFUNC fio___http_pipeline_slot_s *fio___http_pipeline_find(
+    fio___http_pipeline_s *p,
+    fio_http_s *h) {
+  for (uint32_t i = 0, pos = p->head; i < p->count; ++i) {
+    if (p->slots[pos].h == h && !p->slots[pos].finished)
+      return p->slots + pos;
+    if (++pos == p->capa)
+      pos = 0;
+  }
+  return NULL;
+}
+
+/** Adds a request to the pipeline (reactor thread only). */
+FIO_SFUNC void fio___http_pipeline_add(fio___http_connection_s *c,
+                                       fio_http_s *h) {
+  fio___http_pipeline_s *p = c->pipeline;
+  uint32_t pos;
+  fio_lock(&p->lock);
+  pos = p->head + p->count;
+  if (pos >= p->capa)
+    pos -= p->capa;
+  p->slots[pos] = (fio___http_pipeline_slot_s){.h = h};
+  ++p->count;
+  fio_unlock(&p->lock);
+  if (p->count < p->capa)
+    return;
+  c->suspend = 1; /* pipeline is full, stop parsing until it drains. */
+  fio_srv_suspend(c->io);
+}
+
+/** Writes a batch of segments to the IO. Call within lock. */
+FIO_SFUNC void fio___http_pipeline_send(fio___http_connection_s *c,
+                                        fio___http_pipeline_seg_s *seg) {
+  char *batch = NULL;
+  const int is_open = c->io && fio_srv_is_open(c->io);
+  while (seg) {
+    fio___http_pipeline_seg_s *next = seg->next;
+    if (!is_open)
+      goto discard;
+    if (seg->args.dealloc == fio___http_pipeline_bstr_free) {
+      /* merge copied data into a single write */
+      if (!batch) {
+        batch = (char *)seg->args.buf;
+        seg->args.buf = NULL;
+      } else {
+        batch = fio_bstr_write(batch,
+                               seg->args.buf,
+                               fio_bstr_len((char *)seg->args.buf));
+      }
+      goto discard;
+    }
+    if (batch)
+      fio_write2(c->io,
+                 .buf = batch,
+                 .len = fio_bstr_len(batch),
+                 .dealloc = fio___http_pipeline_bstr_free);
+    batch = NULL;
+    fio_write2 FIO_NOOP(c->io, seg->args);
+    seg->args = (fio_write_args_s){.fd = -1};
+  discard:
+    fio___http_pipeline_seg_free(seg);
+    seg = next;
+  }
+  if (batch)
+    fio_write2(c->io,
+               .buf = batch,
+               .len = fio_bstr_len(batch),
+               .dealloc = fio___http_pipeline_bstr_free);
+}
+
+/** Sends all responses that are next in line and resumes parsing. */
+FIO_SFUNC void fio___http_pipeline_flush_task(void *c_, void *ignr_) {
+  fio___http_connection_s *c = (fio___http_connection_s *)c_;
+  fio___http_pipeline_s *p = c->pipeline;
+  fio_http_s *held = NULL;
+  char *held_body = NULL;
+  fio_lock(&p->lock);
+  p->flush_scheduled = 0;
+  while (p->count) {
+    fio___http_pipeline_slot_s *s = p->slots + p->head;
+    fio___http_pipeline_send(c, s->seg);
+    s->seg = s->last = NULL;
+    if (!s->finished)
+      break;
+    p->upgraded |= s->upgraded;
+    if (++p->head == p->capa)
+      p->head = 0;
+    --p->count;
+  }
+  if (!p->count && p->held) { /* upgrade requests are handled on their own */
+    held = p->held;
+    held_body = p->held_body;
+    p->held = NULL;
+    p->held_body = NULL;
+    p->slots[p->head] = (fio___http_pipeline_slot_s){.h = held};
+    ++p->count;
+  }
+  fio_unlock(&p->lock);
+  if (!c->io) { /* connection lost, the held request is never handled */
+    fio_bstr_free(held_body);
+    fio_http_free(held);
+    goto finish;
+  }
+  if (held) {
+    fio___http1_on_http_schedule(c, held, held_body);
+    goto finish;
+  }
+  if (p->closing) {
+    if (!p->count)
+      fio_close(c->io);
+    goto finish;
+  }
+  if (c->suspend && !p->held && !p->upgraded && p->count < p->capa &&
+      fio_srv_is_open(c->io)) {
+    c->suspend = 0;
+    fio___http1_process_data(c->io, c);
+    if (!c->suspend)
+      fio_srv_unsuspend(c->io);
+  }
+finish:
+  fio___http_connection_free(c);
+  (void)ignr_;
+}
+
+/** Schedules a flush task (if one isn't scheduled). Call within lock. */
+FIO_IFUNC int fio___http_pipeline_flush_schedule(fio___http_pipeline_s *p) {
+  if (p->flush_scheduled)
+    return 0;
+  p->flush_scheduled = 1;
+  return 1;
+}
+
+/** Appends a new segment to the slot. Call within lock. */
+FIO_SFUNC fio___http_pipeline_seg_s *fio___http_pipeline_seg_push(
+    fio___http_pipeline_slot_s *s,
+    fio_write_args_s args) {
+  fio___http_pipeline_seg_s *seg =
+      (fio___http_pipeline_seg_s *)FIO_MEM_REALLOC_(NULL, 0, sizeof(*seg), 0);
+  FIO_ASSERT_ALLOC(seg);
+  FIO___LEAK_COUNTER_ON_ALLOC(http___pipeline_segment);
+  *seg = (fio___http_pipeline_seg_s){.args = args};
+  if (s->last)
+    s->last->next = seg;
+  else
+    s->seg = seg;
+  s->last = seg;
+  return seg;
+}
+
+/**
+ * Buffers the data if the response must wait for its turn.
+ *
+ * Returns -1 if the data should be written directly to the IO.
+ */
+FIO_SFUNC int fio___http_pipeline_write(fio___http_connection_s *c,
+                                        fio_http_s *h,
+                                        fio_write_args_s args) {
+  fio___http_pipeline_s *p = c->pipeline;
+  fio___http_pipeline_slot_s *s;
+  int flush = 0;
+  fio_lock(&p->lock);
+  s = fio___http_pipeline_find(p, h);
+  if (!s)
+    goto not_pipelined;
+  if (s == p->slots + p->head) {
+    if (p->count == 1 && !s->seg)
+      goto write_directly; /* nothing to sequence or batch */
+    if (fio_http_is_streaming(h))
+      flush = fio___http_pipeline_flush_schedule(p);
+  }
+  if (args.buf && (args.copy || args.len < FIO_HTTP_PIPELINE_COPY_LIMIT)) {
+    /* copy small / volatile data, so it can be sent as part of a batch */
+    fio___http_pipeline_seg_s *seg = s->last;
+    if (!seg || seg->args.dealloc != fio___http_pipeline_bstr_free)
+      seg = fio___http_pipeline_seg_push(
+          s,
+          (fio_write_args_s){.fd = -1,
+                             .dealloc = fio___http_pipeline_bstr_free});
+    seg->args.buf = fio_bstr_write((char *)seg->args.buf,
+                                   (char *)args.buf + args.offset,
+                                   args.len);
+    if (args.dealloc)
+      args.dealloc(args.buf);
+  } else {
+    fio___http_pipeline_seg_push(s, args);
+  }
+  fio_unlock(&p->lock);
+  if (flush)
+    fio_srv_defer(fio___http_pipeline_flush_task,
+                  (void *)fio___http_connection_dup(c),
+                  NULL);
+  return 0;
+not_pipelined:
+  if (p->count && h == c->h)
+    goto discard; /* an early response (before `on_http`) can't be sequenced */
+write_directly:
+  fio_unlock(&p->lock);
+  return -1;
+discard: /* the connection is closed once pending responses were sent */
+  fio_unlock(&p->lock);
+  if (args.buf) {
+    if (args.dealloc)
+      args.dealloc(args.buf);
+  } else if (args.fd != -1) {
+    if (args.dealloc)
+      args.dealloc((void *)args.fd);
+    else if (!args.copy)
+      close((int)args.fd);
+  }
+  return 0;
+}
+
+/** Marks a pipelined response as finished. */
+FIO_SFUNC void fio___http_pipeline_finish(fio___http_connection_s *c,
+                                          fio_http_s *h) {
+  fio___http_pipeline_s *p = c->pipeline;
+  fio___http_pipeline_slot_s *s;
+  int flush = 0;
+  fio_lock(&p->lock);
+  s = fio___http_pipeline_find(p, h);
+  if (s) {
+    s->finished = 1;
+    s->upgraded = !!fio_http_is_upgraded(h);
+    if (s == p->slots + p->head)
+      flush = fio___http_pipeline_flush_schedule(p);
+  }
+  fio_unlock(&p->lock);
+  if (flush)
+    fio_srv_defer(fio___http_pipeline_flush_task,
+                  (void *)fio___http_connection_dup(c),
+                  NULL);
+}
+
+/** Closes the connection once all pending responses were sent. */
+FIO_SFUNC void fio___http_pipeline_close(fio___http_connection_s *c) {
+  fio___http_pipeline_s *p = c->pipeline;
+  c->suspend = 1;
+  fio_srv_suspend(c->io);
+  fio_lock(&p->lock);
+  p->closing = 1;
+  if (!p->count)
+    fio_close(c->io);
+  fio_unlock(&p->lock);
+}
+
+/** Writes response data, sequencing the data when pipelining. */
+FIO_IFUNC void fio___http1_write(fio___http_connection_s *c,
+                                 fio_http_s *h,
+                                 fio_write_args_s args) {
+  if (c->pipeline && !fio___http_pipeline_write(c, h, args))
+    return;
+  fio_write2 FIO_NOOP(c->io, args);
+}
+
+/* *****************************************************************************
+HTTP/1.1 Streamed Request Bodies
+***************************************************************************** */
+
+FIO_SFUNC void fio___http1_body_flush(fio___http_connection_s *c);
+
+/** Delivers the last of the streamed body data, then handles the request. */
+FIO_SFUNC void fio___http1_body_last_task(void *h_, void *body) {
+  fio_http_s *h = (fio_http_s *)h_;
+  fio___http_connection_s *c = (fio___http_connection_s *)fio_http_cdata(h);
+  c->settings->on_body_chunk(h, fio_bstr_buf((char *)body));
+  fio_bstr_free((char *)body);
+  if (fio_http_is_finished(h)) { /* responded from `on_body_chunk` */
+    fio_http_free(h);
+    return;
+  }
+  fio_queue_push(
+      fio_srv_queue(),
+      FIO_PTR_FROM_FIELD(fio___http_protocol_s, settings, c->settings)
+          ->on_http_callback,
+      h);
+}
+
+/** Resumes parsing once a body chunk was delivered (IO thread). */
+FIO_SFUNC void fio___http1_body_resume_task(void *c_, void *body) {
+  fio___http_connection_s *c = (fio___http_connection_s *)c_;
+  c->state.http.streaming = 0;
+  if (c->io && !c->state.http.body) { /* reuse the buffer */
+    c->state.http.body = fio_bstr_len_set((char *)body, 0);
+    body = NULL;
+  }
+  fio_bstr_free((char *)body);
+  if (!c->io || (c->pipeline && c->pipeline->closing))
+    goto finish;
+  c->suspend = 0;
+  if (fio_srv_is_open(c->io))
+    fio___http1_process_data(c->io, c);
+  fio___http1_body_flush(c); /* don't wait for more data, deliver it now */
+  if (!c->suspend)
+    fio_srv_unsuspend(c->io);
+finish:
+  fio___http_connection_free(c);
+}
+
+/** Delivers streamed body data, then resumes parsing. */
+FIO_SFUNC void fio___http1_body_chunk_task(void *h_, void *body) {
+  fio_http_s *h = (fio_http_s *)h_;
+  fio___http_connection_s *c =
+      fio___http_connection_dup((fio___http_connection_s *)fio_http_cdata(h));
+  c->settings->on_body_chunk(h, fio_bstr_buf((char *)body));
+  fio_http_free(h);
+  fio_srv_defer(fio___http1_body_resume_task, (void *)c, body);
+}
+
+/** Delivers any streamed body data, suspending the IO until it's handled. */
+FIO_SFUNC void fio___http1_body_flush(fio___http_connection_s *c) {
+  char *body = c->state.http.body;
+  if (!c->h || !body || !fio_bstr_len(body) || c->state.http.streaming)
+    return;
+  c->state.http.body = NULL;
+  c->state.http.streaming = 1;
+  c->suspend = 1;
+  fio_srv_suspend(c->io);
+  fio_queue_push(c->queue,
+                 fio___http1_body_chunk_task,
+                 (void *)fio_http_dup(c->h),
+                 (void *)body);
+}
+
 /* *****************************************************************************
 HTTP/1.1 Request / Response Completed
 ***************************************************************************** */
 
+/** Schedules the `on_http` callback, delivering any streamed body data. */
+FIO_IFUNC void fio___http1_on_http_schedule(fio___http_connection_s *c,
+                                            fio_http_s *h,
+                                            char *body) {
+  if (body && fio_bstr_len(body)) {
+    fio_queue_push(c->queue, fio___http1_body_last_task, (void *)h, body);
+    return;
+  }
+  fio_bstr_free(body);
+  fio_queue_push(fio_srv_queue(), c->state.http.on_http_callback, h);
+}
+
+/** Delivers a client's response and sends pending requests (IO thread). */
+FIO_SFUNC void fio___http_client_on_response(fio___http_connection_s *c);
+
 /** called when either a request or a response was received. */
 static void fio_http1_on_complete(void *udata) {
   fio___http_connection_s *c = (fio___http_connection_s *)udata;
+  if (c->is_client) {
+    fio___http_client_on_response(c);
+    return;
+  }
   fio_dup(c->io);
-  fio_srv_suspend(c->io);
+  fio___http_deadline_clear(c); /* the next request gets a new deadline */
   fio_http_s *h = c->h;
+  char *body = c->state.http.body;
   c->h = NULL;
+  c->state.http.body = NULL;
+  if (c->pipeline)
+    goto pipelined;
+  fio_srv_suspend(c->io);
   c->suspend = 1;
-  fio_queue_push(fio_srv_queue(), c->state.http.on_http_callback, h);
+  fio___http1_on_http_schedule(c, h, body);
+  return;
+
+pipelined:
+  if (fio_http_websockets_requested(h) || fio_http_sse_requested(h)) {
+    /* stop parsing, the connection might switch protocols */
+    c->suspend = 1;
+    fio_srv_suspend(c->io);
+    if (c->pipeline->count) { /* wait for pending responses */
+      c->pipeline->held = h;
+      c->pipeline->held_body = body;
+      return;
+    }
+  }
+  fio___http_pipeline_add(c, h);
+  fio___http1_on_http_schedule(c, h, body);
 }
 
 /* *****************************************************************************
@@ -740,7 +2644,11 @@ HTTP/1.1 Parser callbacks
 ***************************************************************************** */
 
 FIO_IFUNC void fio_http1_attach_handle(fio___http_connection_s *c) {
-  c->h = fio_http_new();
+  c->h = c->spare ? fio_atomic_exchange(&c->spare, NULL) : NULL;
+  if (c->h)
+    fio_http_start_time_set(c->h);
+  else
+    c->h = fio_http_new();
   FIO_ASSERT_ALLOC(c->h);
   fio_http_controller_set(
       c->h,
@@ -749,6 +2657,24 @@ FIO_IFUNC void fio_http1_attach_handle(fio___http_connection_s *c) {
            .controller);
   fio_http_udata_set(c->h, c->udata);
   fio_http_cdata_set(c->h, fio___http_connection_dup(c));
+  c->state.http.max_body = c->settings->max_body_size;
+  if (c->is_client)
+    return;
+  fio_http_compress_set(c->h,
+                        c->settings->compress_min,
+                        c->settings->compress_types);
+  c->state.http.streamed = 0;
+}
+
+/** Applies a route's body limit (if any), once the path is known. */
+FIO_SFUNC void fio___http_route_body_limit(fio___http_connection_s *c) {
+  fio___http_rparams_s p;
+  fio___http_rentry_s *e = fio___http_router_find(c->settings->router,
+                                                  fio_http_method(c->h),
+                                                  fio_http_path(c->h),
+                                                  &p);
+  if (e && e->route.max_body_size)
+    c->state.http.max_body = e->route.max_body_size;
 }
 
 /** called when a request method is parsed. */
@@ -762,6 +2688,13 @@ static int fio_http1_on_method(fio_buf_info_s method, void *udata) {
 }
 /** called when a response status is parsed. the status_str is the string
  * without the prefixed numerical status indicator.*/
+/** Tests if a client's response has no body (HEAD, 1xx, 204 and 304). */
+FIO_IFUNC int fio___http_client_no_body(fio___http_connection_s *c) {
+  const size_t status = fio_http_status(c->h);
+  return (status < 200) | (status == 204) | (status == 304) |
+         (c->state.http.client.sent.head &&
+          c->state.http.client.sent.head->is_head);
+}
 static int fio_http1_on_status(size_t istatus,
                                fio_buf_info_s status,
                                void *udata) {
@@ -770,6 +2703,8 @@ static int fio_http1_on_status(size_t istatus,
     return -1;
   fio_http1_attach_handle(c);
   fio_http_status_set(c->h, istatus);
+  if (c->is_client && !fio___http_client_no_body(c))
+    fio_http1_parser_until_close(&c->state.http.parser);
   return 0;
   (void)status;
 }
@@ -782,6 +2717,8 @@ static int fio_http1_on_url(fio_buf_info_s url, void *udata) {
   fio_http_path_set(c->h, FIO_BUF2STR_INFO(u.path));
   if (u.query.len)
     fio_http_query_set(c->h, FIO_BUF2STR_INFO(u.query));
+  if (c->settings->router && c->settings->router->body_limits)
+    fio___http_route_body_limit(c);
   if (u.host.len)
     (!(c->h) ? fio_http_request_header_set
              : fio_http_response_header_set)(c->h,
@@ -814,9 +2751,13 @@ static int fio_http1_on_header_content_length(fio_buf_info_s name,
                                               void *udata) {
   fio___http_connection_s *c = (fio___http_connection_s *)udata;
   fio_http_s *h = c->h;
-  if (content_length > c->settings->max_body_size)
+  if (c->is_client && fio___http_client_no_body(c)) {
+    c->state.http.parser.expected = 0; /* i.e., a response to a HEAD request */
+    return 0;
+  }
+  if (content_length > c->state.http.max_body)
     goto too_big;
-  if (content_length)
+  if (content_length && !(c->settings->on_body_chunk && !c->is_client))
     fio_http_body_expect(c->h, content_length);
 #if FIO_HTTP_SHOW_CONTENT_LENGTH_HEADER
   (!(h->status) ? fio_http_request_header_add
@@ -826,8 +2767,12 @@ static int fio_http1_on_header_content_length(fio_buf_info_s name,
 #endif
   return 0;
 too_big:
+  if (c->is_client) /* the connection is closed and the request fails */
+    return -1;
   c->h = NULL;
   fio_dup(c->io);
+  if (c->pipeline)
+    fio___http_pipeline_add(c, h);
   fio_http_send_error_response(h, 413);
   fio_http_free(h);
   return -1;
@@ -836,7 +2781,10 @@ too_big:
 /** called when `Expect` arrives and may require a 100 continue response. */
 static int fio_http1_on_expect(fio_buf_info_s expected, void *udata) {
   fio___http_connection_s *c = (fio___http_connection_s *)udata;
-  fio_write2(c->io, .buf = (char *)"100 Continue\r\n", .len = 14, .copy = 0);
+  fio_write2(c->io,
+             .buf = (char *)"HTTP/1.1 100 Continue\r\n\r\n",
+             .len = 25,
+             .copy = 0);
   return 0; /* TODO?: improve support for `expect` headers? */
   (void)expected;
 }
@@ -844,10 +2792,18 @@ static int fio_http1_on_expect(fio_buf_info_s expected, void *udata) {
 /** called when a body chunk is parsed. */
 static int fio_http1_on_body_chunk(fio_buf_info_s chunk, void *udata) {
   fio___http_connection_s *c = (fio___http_connection_s *)udata;
-  if (chunk.len + fio_http_body_length(c->h) > c->settings->max_body_size)
+  if (c->settings->on_body_chunk && !c->is_client)
+    goto stream_body;
+  if (chunk.len + fio_http_body_length(c->h) > c->state.http.max_body)
     return -1;
   fio_http_body_write(c->h, chunk.buf, chunk.len);
   return 0;
+
+stream_body:
+  if ((c->state.http.streamed += chunk.len) > c->state.http.max_body)
+    return -1;
+  c->state.http.body = fio_bstr_write(c->state.http.body, chunk.buf, chunk.len);
+  return 0;
 }
 
 /* *****************************************************************************
@@ -863,7 +2819,7 @@ FIO_SFUNC void fio___http_on_attach_accept(fio_s *io) {
                          fio_protocol_get(io));
   fio___http_protocol_dup(p);
   const uint32_t capa = p->settings.max_line_len;
-  fio___http_connection_s *c = fio___http_connection_new(capa);
+  fio___http_connection_s *c = fio___http_connection_new();
   FIO_ASSERT_ALLOC(c);
   *c = (fio___http_connection_s){
       .settings = &(p->settings),
@@ -879,7 +2835,20 @@ FIO_SFUNC void fio___http_on_attach_accept(fio_s *io) {
       .capa = capa,
       .log = p->settings.log,
   };
+  if (p->settings.pipeline > 1)
+    c->pipeline = fio___http_pipeline_new(p->settings.pipeline);
+  if (c->log || p->settings.max_clients_per_ip) /* collected only once */
+    c->peer_len =
+        (uint8_t)fio_sock_peer_addr(c->peer, sizeof(c->peer), fio_fd_get(io));
   fio_udata_set(io, (void *)c);
+  if (p->settings.max_clients_per_ip &&
+      fio___http_ip_add(c, p->settings.max_clients_per_ip)) {
+    FIO_LOG_DDEBUG2("(%d) HTTP connection limit reached for %s",
+                    (int)fio_thread_getpid(),
+                    c->peer);
+    fio_close(io);
+    return;
+  }
   FIO_LOG_DDEBUG2("(%d) HTTP accepted a new connection (%p)",
                   (int)fio_thread_getpid(),
                   c->io);
@@ -900,10 +2869,13 @@ FIO_SFUNC void fio___http1_accept_on_data(fio_s *io) {
       24);
   fio___http_connection_s *c = (fio___http_connection_s *)fio_udata_get(io);
   fio_protocol_s *phttp_new;
-  size_t r = fio_read(io, c->buf + c->len, c->capa - c->len);
-  if (!r) /* nothing happened */
+  size_t r = fio_read(io, fio___http_buffer(c) + c->len, c->capa - c->len);
+  if (!r) { /* nothing happened */
+    fio___http_buffer_release(c);
     return;
+  }
   c->len = r;
+  c->received = r;
   if (prior_knowledge.buf[0] != c->buf[0] ||
       FIO_MEMCMP(
           prior_knowledge.buf,
@@ -925,6 +2897,7 @@ FIO_SFUNC void fio___http1_accept_on_data(fio_s *io) {
                 c->buf + prior_knowledge.len,
                 c->len - prior_knowledge.len);
   c->len -= prior_knowledge.len;
+  fio___http_buffer_release(c);
   phttp_new = &(FIO_PTR_FROM_FIELD(fio___http_protocol_s, settings, c->settings)
                     ->state[FIO___HTTP_PROTOCOL_HTTP2]
                     .protocol);
@@ -938,7 +2911,11 @@ FIO_SFUNC void fio___http_on_close(void *udata) {
                   udata);
   fio___http_connection_s *c = (fio___http_connection_s *)udata;
   c->io = NULL;
+  fio___http_deadline_clear(c);
+  fio___http_ip_remove(c);
   fio_http_free(c->h);
+  fio_bstr_free(c->state.http.body);
+  c->state.http.body = NULL;
   fio___http_connection_free(c);
 }
 
@@ -947,29 +2924,55 @@ HTTP/1.1 Protocol
 ***************************************************************************** */
 
 FIO_SFUNC int fio___http1_process_data(fio_s *io, fio___http_connection_s *c) {
-  (void)io, (void)c;
-  size_t consumed = fio_http1_parse(&c->state.http.parser,
-                                    FIO_BUF_INFO2(c->buf, c->len),
-                                    (void *)c);
-  if (!consumed)
+  size_t consumed, total = 0;
+  if (c->state.http.streaming) { /* wait for the body chunk to be handled */
+    c->suspend = 1;
+    return -1;
+  }
+  while (total < c->len) { /* pipelined requests are parsed without waiting */
+    consumed = fio_http1_parse(&c->state.http.parser,
+                               FIO_BUF_INFO2(c->buf + total, c->len - total),
+                               (void *)c);
+    if (consumed == FIO_HTTP1_PARSER_ERROR)
+      goto http1_error;
+    total += consumed;
+    if (!consumed || c->suspend)
+      break;
+  }
+  fio___http1_deadline_update(c, c->len - total);
+  if (!total)
     return -1;
-  if (consumed == FIO_HTTP1_PARSER_ERROR)
-    goto http1_error;
-  c->len -= consumed;
+  c->len -= total;
   if (c->len)
-    FIO_MEMMOVE(c->buf, c->buf + consumed, c->len);
+    FIO_MEMMOVE(c->buf, c->buf + total, c->len);
+  else
+    fio___http_buffer_release(c);
+  if (c->state.http.body &&
+      fio_bstr_len(c->state.http.body) >= FIO_HTTP_BODY_STREAM_LIMIT)
+    fio___http1_body_flush(c);
   if (c->suspend)
     return -1;
   return 0;
 
 http1_error:
+  if (c->is_client) {
+    c->state.http.client.closing = 2; /* don't retry, the response was bad */
+    fio_close(io);
+    return -1;
+  }
   if (c->h) {
     fio_http_s *h = c->h;
     c->h = NULL;
     fio_dup(c->io);
+    if (c->pipeline)
+      fio___http_pipeline_add(c, h);
     fio_http_send_error_response(h, 400);
     fio_http_free(h);
   }
+  if (c->pipeline) {
+    fio___http_pipeline_close(c);
+    return -1;
+  }
   fio_close(io);
   return -1;
 }
@@ -981,12 +2984,15 @@ FIO_SFUNC void fio___http1_on_data(fio_s *io) {
   for (;;) {
     if (c->capa == c->len)
       return;
-    if (!(r = fio_read(io, c->buf + c->len, c->capa - c->len)))
-      return;
+    if (!(r = fio_read(io, fio___http_buffer(c) + c->len, c->capa - c->len)))
+      break;
     c->len += r;
+    c->received += r;
     if (fio___http1_process_data(io, c))
       return;
   }
+  fio___http_buffer_release(c);
+  fio___http1_body_flush(c); /* no more data for now, deliver streamed body */
 }
 
 // /** Called when an IO is attached to a protocol. */
@@ -1001,20 +3007,135 @@ FIO_SFUNC void fio___http1_on_attach(fio_s *io) {
 HTTP/1 Controller
 ***************************************************************************** */
 
-/** called by the HTTP handle for each header. */
+/** called by the HTTP handle for each header - collects the exact length. */
+FIO_SFUNC int fio_http1___header_length_callback(fio_http_s *h,
+                                                 fio_str_info_s name,
+                                                 fio_str_info_s value,
+                                                 void *len_) {
+  *(size_t *)len_ += name.len + value.len + 3;
+  return 0;
+  (void)h;
+}
+
+/** called by the HTTP handle for each header (buffer size is pre-computed). */
 FIO_SFUNC int fio_http1___write_header_callback(fio_http_s *h,
                                                 fio_str_info_s name,
                                                 fio_str_info_s value,
-                                                void *out_) {
+                                                void *pos_) {
+  char **pos = (char **)pos_;
+  FIO_MEMCPY(*pos, name.buf, name.len);
+  (*pos)[name.len] = ':';
+  *pos += name.len + 1;
+  FIO_MEMCPY(*pos, value.buf, value.len);
+  (*pos)[value.len] = '\r';
+  (*pos)[value.len + 1] = '\n';
+  *pos += value.len + 2;
+  return 0;
   (void)h;
-  /* manually copy, as this is an "all or nothing" copy (no truncation) */
-  fio_str_info_s *out = (fio_str_info_s *)out_;
-  return fio_string_write2(out,
-                           FIO_STRING_REALLOC,
-                           FIO_STRING_WRITE_STR2(name.buf, name.len),
-                           FIO_STRING_WRITE_STR2(":", 1),
-                           FIO_STRING_WRITE_STR2(value.buf, value.len),
-                           FIO_STRING_WRITE_STR2("\r\n", 2));
+}
+
+/** Returns a pre-rendered HTTP/1.1 status line for common status codes. */
+FIO_IFUNC fio_str_info_s fio___http1_status_line_cached(size_t status) {
+#define FIO___HTTP1_STATUS_LINE(code, str)                                     \
+  case code:                                                                   \
+    return FIO_STR_INFO2((char *)"HTTP/1.1 " #code " " str "\r\n",             \
+                         sizeof("HTTP/1.1 " #code " " str "\r\n") - 1)
+  switch (status) {
+    FIO___HTTP1_STATUS_LINE(101, "Switching Protocols");
+    FIO___HTTP1_STATUS_LINE(200, "OK");
+    FIO___HTTP1_STATUS_LINE(201, "Created");
+    FIO___HTTP1_STATUS_LINE(202, "Accepted");
+    FIO___HTTP1_STATUS_LINE(204, "No Content");
+    FIO___HTTP1_STATUS_LINE(206, "Partial Content");
+    FIO___HTTP1_STATUS_LINE(301, "Moved Permanently");
+    FIO___HTTP1_STATUS_LINE(302, "Found");
+    FIO___HTTP1_STATUS_LINE(303, "See Other");
+    FIO___HTTP1_STATUS_LINE(304, "Not Modified");
+    FIO___HTTP1_STATUS_LINE(307, "Temporary Redirect");
+    FIO___HTTP1_STATUS_LINE(400, "Bad Request");
+    FIO___HTTP1_STATUS_LINE(401, "Unauthorized");
+    FIO___HTTP1_STATUS_LINE(403, "Forbidden");
+    FIO___HTTP1_STATUS_LINE(404, "Not Found");
+    FIO___HTTP1_STATUS_LINE(405, "Method Not Allowed");
+    FIO___HTTP1_STATUS_LINE(413, "Content Too Large");
+    FIO___HTTP1_STATUS_LINE(500, "Internal Server Error");
+    FIO___HTTP1_STATUS_LINE(502, "Bad Gateway");
+    FIO___HTTP1_STATUS_LINE(503, "Service Unavailable");
+  }
+#undef FIO___HTTP1_STATUS_LINE
+  return FIO_STR_INFO2(NULL, 0);
+}
+
+/** Writes the status line to `dest` (if not NULL), returns its length. */
+FIO_SFUNC size_t fio___http1_status_line(char *dest, fio_http_s *h) {
+  const size_t status = fio_http_status(h);
+  fio_str_info_s ver = fio_http_version(h);
+  fio_str_info_s line = fio___http1_status_line_cached(status);
+  fio_str_info_s reason;
+  size_t len;
+  if (line.buf &&
+      (!ver.len ||
+       FIO_STR_INFO_IS_EQ(ver, FIO_STR_INFO2((char *)"HTTP/1.1", 8)))) {
+    if (dest)
+      FIO_MEMCPY(dest, line.buf, line.len);
+    return line.len;
+  }
+  if (ver.len > 15) {
+    if (!dest)
+      FIO_LOG_ERROR("HTTP/1.1 client version string too long!");
+    ver.len = 0;
+  }
+  if (!ver.len)
+    ver = FIO_STR_INFO2((char *)"HTTP/1.1", 8);
+  reason = fio_http_status2str(status);
+  len = ver.len + reason.len + fio_digits10u(status) + 4;
+  if (!dest)
+    return len;
+  FIO_MEMCPY(dest, ver.buf, ver.len);
+  dest += ver.len;
+  *(dest++) = ' ';
+  fio_ltoa10u(dest, status, fio_digits10u(status));
+  dest += fio_digits10u(status);
+  *(dest++) = ' ';
+  FIO_MEMCPY(dest, reason.buf, reason.len);
+  dest += reason.len;
+  dest[0] = '\r';
+  dest[1] = '\n';
+  return len;
+}
+
+/**
+ * Writes the response head to `dest` (if not NULL), returns its length.
+ *
+ * When `dest` is NULL, the exact length is computed without writing.
+ */
+FIO_SFUNC size_t fio___http1_head(char *dest,
+                                  fio_http_s *h,
+                                  fio_str_info_s static_headers) {
+  const size_t streaming = (fio_http_is_streaming(h) ? 28 : 0);
+  char *pos = dest;
+  size_t len;
+  if (!dest) {
+    len = fio___http1_status_line(NULL, h) + static_headers.len + streaming + 2;
+    fio_http_response_header_each(h, fio_http1___header_length_callback, &len);
+    fio_http_set_cookie_each(h, fio_http1___header_length_callback, &len);
+    return len;
+  }
+  /* write status line, headers, cookies and static headers */
+  pos += fio___http1_status_line(pos, h);
+  fio_http_response_header_each(h, fio_http1___write_header_callback, &pos);
+  fio_http_set_cookie_each(h, fio_http1___write_header_callback, &pos);
+  if (static_headers.len) {
+    FIO_MEMCPY(pos, static_headers.buf, static_headers.len);
+    pos += static_headers.len;
+  }
+  if (streaming) { /* add streaming headers */
+    FIO_MEMCPY(pos, "transfer-encoding: chunked\r\n", 28);
+    pos += 28;
+  }
+  *(pos++) = '\r';
+  *(pos++) = '\n';
+  return (size_t)(pos - dest);
 }
 
 /** Informs the controller that request / response headers must be sent. */
@@ -1022,40 +3143,30 @@ FIO_SFUNC void fio___http_controller_http1_send_headers(fio_http_s *h) {
   fio___http_connection_s *c = (fio___http_connection_s *)fio_http_cdata(h);
   if (!c->io || !fio_srv_is_open(c->io))
     return;
-  fio_str_info_s buf = FIO_STR_INFO2(NULL, 0);
-  { /* write status string */
-    fio_str_info_s ver = fio_http_version(h);
-    fio_str_info_s status = fio_http_status2str(fio_http_status(h));
-    if (ver.len > 15) {
-      FIO_LOG_ERROR("HTTP/1.1 client version string too long!");
-      ver = FIO_STR_INFO1((char *)"HTTP/1.1");
+  char tmp[4096];
+  /* compute exact length */
+  size_t len = fio___http1_head(NULL, h, c->settings->static_headers);
+  /* small headers are copied by the stream (a single allocation) */
+  fio_str_info_s buf = FIO_STR_INFO3(tmp, 0, sizeof(tmp));
+  if (len > sizeof(tmp)) {
+    buf = FIO_STR_INFO2(NULL, 0);
+    if (FIO_STRING_REALLOC(&buf, len)) {
+      FIO_LOG_ERROR("HTTP/1.1 couldn't allocate memory for response headers");
+      fio_close(c->io);
+      return;
     }
-    fio_string_write2(&buf,
-                      FIO_STRING_REALLOC,
-                      FIO_STRING_WRITE_STR2(ver.buf, ver.len),
-                      FIO_STRING_WRITE_STR2(" ", 1),
-                      FIO_STRING_WRITE_NUM(fio_http_status(h)),
-                      FIO_STRING_WRITE_STR2(" ", 1),
-                      FIO_STRING_WRITE_STR2(status.buf, status.len),
-                      FIO_STRING_WRITE_STR2("\r\n", 2));
-  }
-  /* write headers */
-  fio_http_response_header_each(h, fio_http1___write_header_callback, &buf);
-  /* write cookies */
-  fio_http_set_cookie_each(h, fio_http1___write_header_callback, &buf);
-  /* add streaming headers? */
-  if (fio_http_is_streaming(h))
-    fio_string_write(&buf,
-                     FIO_STRING_REALLOC,
-                     "transfer-encoding: chunked\r\n",
-                     28);
-  fio_string_write(&buf, FIO_STRING_REALLOC, "\r\n", 2);
-  /* send data (move memory ownership) */
-  fio_write2(c->io,
-             .buf = buf.buf,
-             .len = buf.len,
-             .copy = 0,
-             .dealloc = FIO_STRING_FREE);
+  }
+  buf.len = fio___http1_head(buf.buf, h, c->settings->static_headers);
+  FIO_ASSERT_DEBUG(buf.len == len, "HTTP/1.1 header length miscalculated");
+  /* send data (move memory ownership, unless on the stack) */
+  fio___http1_write(c,
+                    h,
+                    (fio_write_args_s){.buf = buf.buf,
+                                       .len = buf.len,
+                                       .copy = (buf.buf == tmp),
+                                       .dealloc = ((buf.buf == tmp)
+                                                       ? NULL
+                                                       : FIO_STRING_FREE)});
 }
 /** called by the HTTP handle for each body chunk (or to finish a response. */
 FIO_SFUNC void fio___http_controller_http1_write_body(
@@ -1066,36 +3177,81 @@ FIO_SFUNC void fio___http_controller_http1_write_body(
     goto no_write_err;
   if (fio_http_is_streaming(h))
     goto stream_chunk;
-  fio_write2(c->io,
-             .buf = (void *)args.buf,
-             .len = args.len,
-             .fd = args.fd,
-             .offset = args.offset,
-             .dealloc = args.dealloc,
-             .copy = (uint8_t)args.copy);
+  fio___http1_write(c,
+                    h,
+                    (fio_write_args_s){.buf = (void *)args.buf,
+                                       .len = args.len,
+                                       .fd = args.fd,
+                                       .offset = args.offset,
+                                       .dealloc = args.dealloc,
+                                       .copy = (uint8_t)args.copy});
   return;
 stream_chunk:
-  if (args.len) { /* print chunk header */
+  if (!args.len) { /* an empty chunk would end the (chunked) response */
+    FIO_LOG_ERROR("HTTP1 streaming requires a correctly pre-determined "
+                  "length per chunk.");
+    goto no_write_err;
+  }
+  if (args.buf && (args.copy || args.len < FIO_HTTP_CHUNK_COPY_LIMIT)) {
+    /* frame the chunk in a single packet (header, data and trailer) */
+    char tmp[4096];
+    const size_t digits = fio_digits16u(args.len);
+    const size_t len = digits + args.len + 4;
+    fio_str_info_s buf = FIO_STR_INFO3(tmp, 0, sizeof(tmp));
+    if (len > sizeof(tmp)) {
+      buf = FIO_STR_INFO2(NULL, 0);
+      if (FIO_STRING_REALLOC(&buf, len)) {
+        FIO_LOG_ERROR("HTTP/1.1 couldn't allocate memory for response chunk");
+        fio_close(c->io);
+        goto no_write_err;
+      }
+    }
+    fio_ltoa16u(buf.buf, args.len, digits);
+    buf.buf[digits] = '\r';
+    buf.buf[digits + 1] = '\n';
+    FIO_MEMCPY(buf.buf + digits + 2,
+               (char *)args.buf + args.offset,
+               args.len);
+    buf.buf[len - 2] = '\r';
+    buf.buf[len - 1] = '\n';
+    if (args.dealloc)
+      args.dealloc((void *)args.buf);
+    /* small chunks are copied by the stream (a single allocation) */
+    fio___http1_write(c,
+                      h,
+                      (fio_write_args_s){.buf = buf.buf,
+                                         .len = len,
+                                         .copy = (buf.buf == tmp),
+                                         .dealloc = ((buf.buf == tmp)
+                                                         ? NULL
+                                                         : FIO_STRING_FREE)});
+    return;
+  }
+  { /* large buffers and files aren't copied, the framing is written apart */
     char buf[24];
     fio_str_info_s i = FIO_STR_INFO3(buf, 0, 24);
     fio_string_write_hex(&i, NULL, args.len);
     fio_string_write(&i, NULL, "\r\n", 2);
-    fio_write2(c->io, .buf = (void *)i.buf, .len = i.len, .copy = 1);
-  } else {
-    FIO_LOG_ERROR("HTTP1 streaming requires a correctly pre-determined "
-                  "length per chunk.");
+    fio___http1_write(
+        c,
+        h,
+        (fio_write_args_s){.buf = (void *)i.buf, .len = i.len, .copy = 1});
   }
-  fio_write2(c->io,
-             .buf = (void *)args.buf,
-             .len = args.len,
-             .fd = args.fd,
-             .offset = args.offset,
-             .dealloc = args.dealloc,
-             .copy = (uint8_t)args.copy);
+  fio___http1_write(c,
+                    h,
+                    (fio_write_args_s){.buf = (void *)args.buf,
+                                       .len = args.len,
+                                       .fd = args.fd,
+                                       .offset = args.offset,
+                                       .dealloc = args.dealloc,
+                                       .copy = (uint8_t)args.copy});
   /* print chunk trailer */
   {
     fio_buf_info_s trailer = FIO_BUF_INFO2((char *)"\r\n", 2);
-    fio_write2(c->io, .buf = trailer.buf, .len = trailer.len, .copy = 1);
+    fio___http1_write(
+        c,
+        h,
+        (fio_write_args_s){.buf = trailer.buf, .len = trailer.len, .copy = 1});
   }
   return;
 no_write_err:
@@ -1103,16 +3259,21 @@ no_write_err:
     if (args.dealloc)
       args.dealloc((void *)args.buf);
   } else if (args.fd != -1) {
-    close(args.fd);
+    if (args.dealloc)
+      args.dealloc((void *)(intptr_t)args.fd);
+    else
+      close(args.fd);
   }
 }
 
 FIO_SFUNC void fio___http_controller_http1_on_finish_task(void *c_,
                                                           void *upgraded) {
   fio___http_connection_s *c = (fio___http_connection_s *)c_;
-  c->suspend = 0;
   if (upgraded)
     goto upgraded;
+  if (c->pipeline) /* parsing is resumed once the response was sent */
+    goto pipelined;
+  c->suspend = 0;
   if (fio_srv_is_open(c->io)) {
     fio___http1_process_data(c->io, c);
   }
@@ -1121,7 +3282,13 @@ FIO_SFUNC void fio___http_controller_http1_on_finish_task(void *c_,
   fio_undup(c->io);
   return;
 
+pipelined:
+  fio_undup(c->io);
+  return;
+
 upgraded:
+  c->suspend = 0;
+  fio___http_deadline_clear(c);
   if (c->h || !fio_srv_is_open(c->io))
     goto something_is_wrong;
   c->h = (fio_http_s *)upgraded;
@@ -1157,16 +3324,47 @@ something_is_wrong:
   fio___http_connection_free(c); /* free HTTP connection element */
 }
 
+/** Closes a connection that responded before the request body was read. */
+FIO_SFUNC void fio___http1_finished_early_task(void *c_, void *ignr_) {
+  fio___http_connection_s *c = (fio___http_connection_s *)c_;
+  if (!c->io)
+    goto finish;
+  if (c->pipeline)
+    fio___http_pipeline_close(c); /* send pending responses first */
+  else
+    fio_close(c->io);
+finish:
+  fio___http_connection_free(c);
+  (void)ignr_;
+}
+
 /** called once a request / response had finished */
 FIO_SFUNC void fio___http_controller_http1_on_finish(fio_http_s *h) {
   fio___http_connection_s *c = (fio___http_connection_s *)fio_http_cdata(h);
   if (fio_http_is_streaming(h))
-    fio_write2(c->io, .buf = (char *)"0\r\n\r\n", .len = 5, .copy = 1);
+    fio___http1_write(
+        c,
+        h,
+        (fio_write_args_s){.buf = (char *)"0\r\n\r\n", .len = 5, .copy = 1});
   if (c->log)
-    fio_http_write_log(h, FIO_BUF_INFO2(NULL, 0)); /* TODO: get_peer_addr */
+    fio_http_write_log(h, FIO_BUF_INFO2(c->peer, c->peer_len));
+  if (c->pipeline)
+    fio___http_pipeline_finish(c, h);
+  if (!c->io) /* connection lost before the request was handed off */
+    return;
+  /* `fio_http1_on_complete` hands the handle off (`c->h = NULL`) when calling
+   * `fio_dup`. Until then, the IO wasn't duplicated nor suspended for us. */
+  if (h == c->h)
+    goto finished_early;
   fio_srv_defer(fio___http_controller_http1_on_finish_task,
                 (void *)(c),
                 fio_http_is_upgraded(h) ? (void *)h : NULL);
+  return;
+
+finished_early: /* from `on_body_chunk`, the rest of the body is never read */
+  fio_srv_defer(fio___http1_finished_early_task,
+                (void *)fio___http_connection_dup(c),
+                NULL);
 }
 
 /* *****************************************************************************
@@ -1256,6 +3454,67 @@ FIO_SFUNC void fio_websocket_on_message(void *udata,
   (void)msg;
 }
 
+/** Returns the expected UTF-8 sequence length for a lead byte (0 if invalid) */
+FIO_IFUNC size_t fio___websocket_utf8_seq_len(uint8_t c) {
+  return (c < 0x80)            ? 1
+         : ((c & 0xE0) == 0xC0) ? 2
+         : ((c & 0xF0) == 0xE0) ? 3
+         : ((c & 0xF8) == 0xF0) ? 4
+                                : 0;
+}
+
+/** Validates streamed UTF-8 text, where chunks may split a code point. */
+FIO_SFUNC int fio___websocket_utf8_stream(fio___http_connection_s *c,
+                                          fio_buf_info_s chunk,
+                                          uint8_t is_last) {
+  size_t tail = 0;
+  if (c->state.ws.utf8_len) { /* complete the code point from the last chunk */
+    size_t l = fio___websocket_utf8_seq_len((uint8_t)c->state.ws.utf8[0]);
+    while (c->state.ws.utf8_len < l && chunk.len) {
+      c->state.ws.utf8[c->state.ws.utf8_len++] = *chunk.buf++;
+      --chunk.len;
+    }
+    if (c->state.ws.utf8_len < l)
+      return (is_last ? -1 : 0);
+    if (fio_string_utf8_valid_code_point(c->state.ws.utf8, l) != l)
+      return -1;
+    c->state.ws.utf8_len = 0;
+  }
+  /* look for a code point that continues in the next chunk */
+  for (size_t i = 1; i < 4 && i <= chunk.len; ++i) {
+    uint8_t u = (uint8_t)chunk.buf[chunk.len - i];
+    if ((u & 0xC0) == 0x80)
+      continue;
+    if (fio___websocket_utf8_seq_len(u) > i)
+      tail = i;
+    break;
+  }
+  if (tail && is_last)
+    return -1;
+  if (!fio_string_utf8_valid(FIO_STR_INFO2(chunk.buf, chunk.len - tail)))
+    return -1;
+  FIO_MEMCPY(c->state.ws.utf8, chunk.buf + chunk.len - tail, tail);
+  c->state.ws.utf8_len = (uint8_t)tail;
+  return 0;
+}
+
+/** Called with each (unmasked) chunk of a streamed message. */
+FIO_SFUNC int fio_websocket_on_message_partial(void *udata,
+                                               fio_buf_info_s chunk,
+                                               unsigned char is_text,
+                                               unsigned char is_first,
+                                               unsigned char is_last) {
+  fio___http_connection_s *c = (fio___http_connection_s *)udata;
+  if (is_text && fio___websocket_utf8_stream(c, chunk, is_last))
+    return -1;
+  c->settings->on_message_partial(c->h, chunk, is_text, is_first, is_last);
+  if (is_last) { /* compressed messages are inflated to `msg` */
+    fio_bstr_free(c->state.ws.msg);
+    c->state.ws.msg = NULL;
+  }
+  return 0;
+}
+
 /**
  * Called when the parser needs to copy the message to an external buffer.
  *
@@ -1277,9 +3536,16 @@ FIO_SFUNC fio_buf_info_s fio_websocket_write_partial(void *udata,
 FIO_SFUNC fio_buf_info_s fio_websocket_decompress(void *udata,
                                                   fio_buf_info_s msg) {
   fio___http_connection_s *c = (fio___http_connection_s *)udata;
-  FIO_LOG_ERROR("WebSocket permessage-deflate not yet implemented!");
-  (void)c;
-  return msg;
+  char *inflated;
+  /* append the removed 0x00 0x00 0xFF 0xFF tail (RFC 7692, section 7.2.2) */
+  c->state.ws.msg = fio_bstr_write(c->state.ws.msg, "\x00\x00\xFF\xFF", 4);
+  msg = fio_bstr_buf(c->state.ws.msg);
+  inflated = fio___websocket_inflate(c, msg);
+  if (!inflated) /* protocol error (RSV1 without negotiation?) */
+    return (fio_buf_info_s){0};
+  fio_bstr_free(c->state.ws.msg);
+  c->state.ws.msg = inflated;
+  return fio_bstr_buf(inflated);
 }
 
 /** Called when a `ping` message was received. */
@@ -1346,17 +3612,21 @@ WebSocket Protocol
 
 FIO_SFUNC int fio___websocket_process_data(fio_s *io,
                                            fio___http_connection_s *c) {
-  (void)io, (void)c;
-  size_t consumed = fio_websocket_parse(&c->state.ws.parser,
-                                        FIO_BUF_INFO2(c->buf, c->len),
-                                        (void *)c);
-  if (!consumed)
-    return -1;
-  if (consumed == FIO_WEBSOCKET_PARSER_ERROR)
-    goto ws_error;
-  c->len -= consumed;
-  if (c->len)
-    FIO_MEMMOVE(c->buf, c->buf + consumed, c->len);
+  (void)io;
+  while (c->len && !c->suspend) { /* the parser stops after each message */
+    size_t consumed = fio_websocket_parse(&c->state.ws.parser,
+                                          FIO_BUF_INFO2(c->buf, c->len),
+                                          (void *)c);
+    if (!consumed)
+      break; /* incomplete frame header, wait for more data */
+    if (consumed == FIO_WEBSOCKET_PARSER_ERROR)
+      goto ws_error;
+    c->len -= consumed;
+    if (c->len)
+      FIO_MEMMOVE(c->buf, c->buf + consumed, c->len);
+  }
+  if (!c->len)
+    fio___http_buffer_release(c);
   if (c->suspend)
     return -1;
   return 0;
@@ -1374,8 +3644,10 @@ FIO_SFUNC void fio___websocket_on_data(fio_s *io) {
   for (;;) {
     if (c->capa == c->len)
       return;
-    if (!(r = fio_read(io, c->buf + c->len, c->capa - c->len)))
+    if (!(r = fio_read(io, fio___http_buffer(c) + c->len, c->capa - c->len))) {
+      fio___http_buffer_release(c);
       return;
+    }
     c->len += r;
     if (fio___websocket_process_data(io, c))
       return;
@@ -1402,7 +3674,9 @@ FIO_SFUNC void fio___websocket_on_attach(fio_s *io) {
   fio_http_s *h = c->h;
   c->state.ws = (struct fio___http_connection_ws_s){
       .on_message = c->settings->on_message,
+      .parser.stream = !!c->settings->on_message_partial,
   };
+  fio___websocket_deflate_setup(c);
   c->settings->on_open(h);
   fio___websocket_process_data(io, c);
 }
@@ -1415,6 +3689,7 @@ FIO_SFUNC void fio___websocket_on_close(void *udata) {
   fio___http_connection_s *c = (fio___http_connection_s *)udata;
   c->io = NULL;
   fio_bstr_free(c->state.ws.msg);
+  fio___websocket_deflate_destroy(c);
   fio_http_free(c->h);
   fio___http_connection_free(c);
 }
@@ -1443,13 +3718,68 @@ SFUNC int fio_http_on_message_set(fio_http_s *h,
 WebSocket Writing / Subscription Helpers
 ***************************************************************************** */
 
+/** Tests if a message should be sent as UTF-8 text (for direct writes). */
+FIO_IFUNC uint8_t fio___http_websocket_is_text(fio_str_info_s msg) {
+  return (msg.len < FIO_HTTP_WEBSOCKET_WRITE_VALIDITY_TEST_LIMIT) &&
+         fio_string_utf8_valid(msg);
+}
+
+/* Pub/Sub message cache: the message, framed once for all connections. */
+FIO_SFUNC void *fio___http_websocket_frame(fio_str_info_s ch,
+                                           fio_str_info_s msg,
+                                           int16_t filter,
+                                           uint8_t is_json) {
+  char *frame = fio_bstr_reserve(NULL, fio_websocket_wrapped_len(msg.len));
+  frame = fio_bstr_len_set(
+      frame,
+      fio_websocket_server_wrap(frame,
+                                msg.buf,
+                                msg.len,
+                                (fio___http_websocket_is_text(msg) ? 1 : 2),
+                                1,
+                                1,
+                                0));
+  return (void *)frame;
+  (void)ch, (void)filter, (void)is_json;
+}
+
+FIO_SFUNC void fio___http_websocket_frame_free(void *frame) {
+  fio_bstr_free((char *)frame);
+}
+
+/* opcode: 1 = text, 2 = binary, 0 = test message (text if UTF-8 valid) */
 FIO_IFUNC void fio___http_websocket_subscribe_imp(fio_msg_s *msg,
-                                                  uint8_t is_text) {
+                                                  uint8_t opcode) {
   fio___http_connection_s *c =
       (fio___http_connection_s *)fio_udata_get(msg->io);
+  char *frame;
   if (!c)
     return;
-  fio_http_websocket_write(c->h, msg->message.buf, msg->message.len, is_text);
+  if (c->is_client || !c->h || !fio_http_is_websocket(c->h))
+    goto write_message;
+#if HAVE_ZLIB
+  if (c->state.ws.deflate.on && msg->message.len >= c->state.ws.deflate.min)
+    goto write_message;
+#endif
+  frame = (char *)fio_message_cache(msg,
+                                    fio___http_websocket_frame,
+                                    fio___http_websocket_frame_free);
+  /* the shared frame's opcode must match (a single write, never split) */
+  if (!frame || (opcode && opcode != (frame[0] & 15)))
+    goto write_message;
+  fio_write2(c->io,
+             .buf = fio_bstr_copy(frame),
+             .len = fio_bstr_len(frame),
+             .dealloc = (void (*)(void *))fio_bstr_free);
+  return;
+
+write_message:
+  if (!opcode)
+    opcode = 2 - fio___http_websocket_is_text(msg->message);
+  fio_http_websocket_write(c->h,
+                           msg->message.buf,
+                           msg->message.len,
+                           (opcode == 1));
 }
 
 /** Optional WebSocket subscription callback - all messages are UTF-8 valid. */
@@ -1458,16 +3788,12 @@ SFUNC void FIO_HTTP_WEBSOCKET_SUBSCRIBE_DIRECT_TEXT(fio_msg_s *msg) {
 }
 /** Optional WebSocket subscription callback - messages may be non-UTF-8. */
 SFUNC void FIO_HTTP_WEBSOCKET_SUBSCRIBE_DIRECT_BINARY(fio_msg_s *msg) {
-  fio___http_websocket_subscribe_imp(msg, 0);
+  fio___http_websocket_subscribe_imp(msg, 2);
 }
 
 /** Optional WebSocket subscription callback. */
 SFUNC void FIO_HTTP_WEBSOCKET_SUBSCRIBE_DIRECT(fio_msg_s *msg) {
-  ((msg->message.len < FIO_HTTP_WEBSOCKET_WRITE_VALIDITY_TEST_LIMIT) &&
-           (fio_string_utf8_valid(
-               FIO_STR_INFO2((char *)msg->message.buf, msg->message.len)))
-       ? FIO_HTTP_WEBSOCKET_SUBSCRIBE_DIRECT_TEXT
-       : FIO_HTTP_WEBSOCKET_SUBSCRIBE_DIRECT_BINARY)(msg);
+  fio___http_websocket_subscribe_imp(msg, 0);
 }
 
 /* *****************************************************************************
@@ -1554,6 +3880,10 @@ SFUNC int fio_http_websocket_write(fio_http_s *h,
   is_text = (!!is_text);
   is_text |= (!is_text) << 1;
   uint8_t rsv = 0;
+#if HAVE_ZLIB
+  if (c->state.ws.deflate.on && len >= c->state.ws.deflate.min)
+    return fio___websocket_write_deflated(c, buf, len, is_text);
+#endif
   if (len < 512) {
     char tmp[520];
     size_t wlen =
@@ -1563,9 +3893,6 @@ SFUNC int fio_http_websocket_write(fio_http_s *h,
     fio_write2(c->io, .buf = tmp, .len = wlen, .copy = 1);
     return 0;
   }
-#if HAVE_ZLIB /* TODO: compress? */
-  // if(len > 512 && c->state.ws.deflate) ;
-#endif
   char *payload =
       fio_bstr_reserve(NULL,
                        fio_websocket_wrapped_len(len) + (c->is_client << 2));
@@ -1646,6 +3973,8 @@ static void fio___sse_on_attach(fio_s *io) {
   c->state.sse = (struct fio___http_connection_sse_s){
       .on_message = c->settings->on_message,
   };
+  c->len = 0; /* EventSource clients don't send data, release the buffer */
+  fio___http_buffer_release(c);
   c->settings->on_open(h);
   // fio___websocket_process_data(io, c); /* TODO: SSE client mode */
 }
@@ -1687,10 +4016,15 @@ FIO_SFUNC void fio___http_controller_sse_write_body(
   if (args.buf && args.len) {
     fio_http_sse_write(c->h, .data = FIO_BUF_INFO2((char *)args.buf, args.len));
   }
-  if (args.dealloc && args.buf)
-    args.dealloc((void *)args.buf);
-  if (args.fd != -1)
-    close(args.fd);
+  if (args.buf) {
+    if (args.dealloc)
+      args.dealloc((void *)args.buf);
+  } else if (args.fd != -1) {
+    if (args.dealloc)
+      args.dealloc((void *)(intptr_t)args.fd);
+    else
+      close(args.fd);
+  }
 }
 /* *****************************************************************************
 Connection Lost
@@ -1723,6 +4057,507 @@ FIO_SFUNC void fio__http_controller_on_destroyed2(fio_http_s *h) {
                  fio_http_cdata(h));
 }
 
+/* *****************************************************************************
+HTTP Client - Pooled Connections (pool state is only accessed by the IO thread)
+***************************************************************************** */
+
+static fio___http_client_pool_map_s fio___http_client_pools = FIO_MAP_INIT;
+
+FIO_SFUNC void fio___http_client_on_response_task(void *cb_, void *h_) {
+  union {
+    void (*fn)(fio_http_s *);
+    void *ptr;
+  } cb = {.ptr = cb_};
+  fio_http_s *h = (fio_http_s *)h_;
+  cb.fn(h);
+  fio_http_free(h);
+}
+
+/** Schedules the user's `on_response` callback and frees the request. */
+FIO_SFUNC void fio___http_client_respond(fio___http_client_req_s *r,
+                                         fio_http_s *h) {
+  union {
+    void (*fn)(fio_http_s *);
+    void *ptr;
+  } cb = {.fn = r->args.on_response};
+  fio_http_udata_set(h, r->args.udata);
+  fio_queue_push(fio_srv_queue(),
+                 fio___http_client_on_response_task,
+                 cb.ptr,
+                 (void *)h);
+  fio___http_client_req_free(r);
+}
+
+/** Fails a request - `on_response` is called with a status of 0. */
+FIO_SFUNC void fio___http_client_fail(fio___http_client_req_s *r) {
+  fio_http_s *h = fio_http_new();
+  FIO_ASSERT_ALLOC(h);
+  fio___http_client_respond(r, h);
+}
+
+/** Returns the pool's host name (the URL without the scheme and port). */
+FIO_IFUNC fio_buf_info_s
+fio___http_client_host(fio___http_client_pool_s *pool) {
+  char *start = pool->url + 7 + (pool->url[4] == 's');
+  char *end = pool->url + fio_bstr_len(pool->url);
+  while (end > start && end[-1] != ':') /* the key always ends with a port */
+    --end;
+  return FIO_BUF_INFO2(start, (size_t)(end - start) - (end > start));
+}
+
+/** Tests if a host is an IP address (connecting performs no DNS lookup). */
+FIO_IFUNC int fio___http_client_is_ip(fio_buf_info_s host) {
+  if (host.len && host.buf[0] == '[') /* IPv6 */
+    return 1;
+  for (size_t i = 0; i < host.len; ++i)
+    if (host.buf[i] != '.' && (host.buf[i] < '0' || host.buf[i] > '9'))
+      return 0;
+  return 1;
+}
+
+/** Sends a request on an attached connection. */
+FIO_IFUNC void fio___http_client_send(fio___http_connection_s *c,
+                                      fio___http_client_req_s *r) {
+  fio_write2(c->io,
+             .buf = fio_bstr_copy(r->data),
+             .len = fio_bstr_len(r->data),
+             .dealloc = fio___http_pipeline_bstr_free);
+}
+
+/** Attaches a connected socket and sends any requests already assigned. */
+FIO_SFUNC void fio___http_client_attach(fio___http_connection_s *c, int fd) {
+  fio___http_client_pool_s *pool = c->state.http.client.pool;
+  c->io = fio_srv_attach_fd(
+      fd,
+      &pool->protocol->state[FIO___HTTP_PROTOCOL_HTTP1].protocol,
+      (void *)c,
+      pool->tls);
+  FIO_LOG_DDEBUG2("(%d) HTTP client connecting to %s (%p)",
+                  (int)fio_thread_getpid(),
+                  pool->url,
+                  (void *)c->io);
+  for (fio___http_client_req_s *r = c->state.http.client.sent.head; r;
+       r = r->next)
+    fio___http_client_send(c, r);
+}
+
+FIO_SFUNC void fio___http_client_on_close(void *udata);
+
+/** Attaches a resolved connection or fails it (IO thread). */
+FIO_SFUNC void fio___http_client_connect_task(void *c_, void *fd_) {
+  fio___http_connection_s *c = (fio___http_connection_s *)c_;
+  int fd = (int)(intptr_t)fd_;
+  if (fd != -1 && fio_srv_is_running()) {
+    fio___http_client_attach(c, fd);
+    return;
+  }
+  if (fd != -1)
+    fio_sock_close(fd);
+  fio___http_client_on_close(c);
+}
+
+/** Resolves the host name and connects, as DNS lookups may block. */
+FIO_SFUNC void *fio___http_client_connect_thread(void *c_) {
+  fio___http_connection_s *c = (fio___http_connection_s *)c_;
+  int fd = fio_sock_open2(c->state.http.client.pool->url,
+                          FIO_SOCK_CLIENT | FIO_SOCK_NONBLOCK);
+  fio_srv_defer(fio___http_client_connect_task, c_, (void *)(intptr_t)fd);
+  return NULL;
+}
+
+/**
+ * Opens a new (non-blocking) connection to the pool's host.
+ *
+ * Host names are resolved on a new thread, requests assigned to the connection
+ * meanwhile are sent once it's attached.
+ */
+FIO_SFUNC fio___http_connection_s *fio___http_client_connect(
+    fio___http_client_pool_s *pool) {
+  fio___http_protocol_s *p = pool->protocol;
+  fio___http_connection_s *c;
+  fio_thread_t thread;
+  int fd = -1;
+  if (fio___http_client_is_ip(fio___http_client_host(pool)) &&
+      (fd = fio_sock_open2(pool->url, FIO_SOCK_CLIENT | FIO_SOCK_NONBLOCK)) ==
+          -1)
+    return NULL;
+  c = fio___http_connection_new();
+  FIO_ASSERT_ALLOC(c);
+  fio___http_protocol_dup(p);
+  *c = (fio___http_connection_s){
+      .settings = &(p->settings),
+      .queue = p->queue,
+      .state.http =
+          {
+              .max_header = p->settings.max_header_size,
+              .client.pool = fio___http_client_pool_dup(pool),
+          },
+      .capa = p->settings.max_line_len,
+      .is_client = 1,
+  };
+  FIO_LIST_PUSH(&pool->connections, &c->state.http.client.node);
+  ++pool->count;
+  if (fd != -1) {
+    fio___http_client_attach(c, fd);
+    return c;
+  }
+  if (!fio_thread_create(&thread, fio___http_client_connect_thread, c)) {
+    fio_thread_detach(&thread);
+    return c;
+  }
+  FIO_LOG_WARNING("(%d) HTTP client couldn't spawn a DNS thread for %s",
+                  (int)fio_thread_getpid(),
+                  pool->url);
+  fio___http_client_connect_thread(c); /* resolve on the IO thread */
+  return c;
+}
+
+/** Selects an idle connection, a new connection or the least busy one. */
+FIO_SFUNC fio___http_connection_s *fio___http_client_select(
+    fio___http_client_pool_s *pool) {
+  fio___http_connection_s *best = NULL, *c;
+  FIO_LIST_EACH(fio___http_connection_s,
+                state.http.client.node,
+                &pool->connections,
+                pos) {
+    if (pos->state.http.client.closing)
+      continue;
+    if (!pos->state.http.client.in_flight)
+      return pos;
+    if (pos->state.http.client.in_flight < pool->pipeline &&
+        (!best ||
+         best->state.http.client.in_flight > pos->state.http.client.in_flight))
+      best = pos;
+  }
+  if (pool->count < pool->max_connections &&
+      (c = fio___http_client_connect(pool)))
+    return c;
+  return best;
+}
+
+/** Sends pending requests, failing them if the host can't be reached. */
+FIO_SFUNC void fio___http_client_dispatch(fio___http_client_pool_s *pool) {
+  fio___http_client_req_s *r;
+  fio___http_connection_s *c;
+  if (!fio_srv_is_running())
+    goto fail_pending;
+  while (pool->pending.head && (c = fio___http_client_select(pool))) {
+    r = fio___http_client_fifo_shift(&pool->pending);
+    fio___http_client_fifo_push(&c->state.http.client.sent, r);
+    ++c->state.http.client.in_flight;
+    if (c->io) /* otherwise, sent once connected */
+      fio___http_client_send(c, r);
+  }
+  if (pool->count)
+    return;
+fail_pending:
+  while ((r = fio___http_client_fifo_shift(&pool->pending)))
+    fio___http_client_fail(r);
+}
+
+/** Tests if the server will close the connection after this response. */
+FIO_SFUNC int fio___http_client_is_last(fio_http_s *h) {
+  fio_str_info_s v =
+      fio_http_response_header(h, FIO_STR_INFO2((char *)"connection", 10), 0);
+  if (v.len == 5)
+    return (fio_buf2u32u(v.buf) | 0x20202020UL) == fio_buf2u32u("clos") &&
+           (v.buf[4] | 0x20) == 'e';
+  if (v.len) /* i.e., keep-alive */
+    return 0;
+  v = fio_http_version(h);
+  return (v.len == 8 && v.buf[7] == '0'); /* HTTP/1.0 */
+}
+
+FIO_SFUNC void fio___http_client_on_response(fio___http_connection_s *c) {
+  fio_http_s *h = c->h;
+  fio___http_client_req_s *r;
+  c->h = NULL;
+  if (fio_http_status(h) < 200) { /* ignore informational (1xx) responses */
+    fio_http_free(h);
+    return;
+  }
+  r = fio___http_client_fifo_shift(&c->state.http.client.sent);
+  if (!r) { /* a response without a request */
+    fio_http_free(h);
+    c->state.http.client.closing = 2;
+    fio_close(c->io);
+    return;
+  }
+  --c->state.http.client.in_flight;
+  ++c->state.http.client.served;
+  if (fio___http_client_is_last(h)) {
+    c->state.http.client.closing |= 1; /* requests sent after it are retried */
+    fio_close(c->io);
+  }
+  fio___http_client_respond(r, h);
+  fio___http_client_dispatch(c->state.http.client.pool);
+}
+
+FIO_SFUNC void fio___http_client_on_timeout(fio_s *io) {
+  fio___http_connection_s *c = (fio___http_connection_s *)fio_udata_get(io);
+  c->state.http.client.closing = 2; /* timed out requests aren't retried */
+  fio_close_now(io);
+}
+
+FIO_SFUNC void fio___http_client_on_close(void *udata) {
+  fio___http_connection_s *c = (fio___http_connection_s *)udata;
+  fio___http_client_pool_s *pool = c->state.http.client.pool;
+  fio___http_client_fifo_s retry = {0};
+  fio___http_client_req_s *r;
+  int reused, partial;
+  FIO_LOG_DDEBUG2("(%d) HTTP client connection closed for %p",
+                  (int)fio_thread_getpid(),
+                  udata);
+  c->io = NULL;
+  c->state.http.client.closing |= 1;
+  if (c->h) /* a response without a length ends when the connection closes */
+    fio_http1_parse_eof(&c->state.http.parser, c);
+  /* requests on a stale keep-alive connection (closed by the server) may be
+   * retried, unless a response had started arriving */
+  reused = c->state.http.client.served && !(c->state.http.client.closing & 2);
+  partial = !!c->h;
+  fio_http_free(c->h);
+  c->h = NULL;
+  FIO_LIST_REMOVE(&c->state.http.client.node);
+  --pool->count;
+  while ((r = fio___http_client_fifo_shift(&c->state.http.client.sent))) {
+    if (reused && !partial && r->retry) {
+      r->retry = 0;
+      fio___http_client_fifo_push(&retry, r);
+    } else
+      fio___http_client_fail(r);
+    partial = 0;
+  }
+  if (retry.head) { /* retried requests are sent first */
+    retry.tail->next = pool->pending.head;
+    if (!pool->pending.head)
+      pool->pending.tail = retry.tail;
+    pool->pending.head = retry.head;
+  }
+  if (!c->state.http.client.served && !pool->count) /* host unreachable */
+    while ((r = fio___http_client_fifo_shift(&pool->pending)))
+      fio___http_client_fail(r);
+  fio___http_client_dispatch(pool);
+  fio___http_client_pool_free(pool);
+  fio___http_connection_free(c);
+}
+
+FIO_SFUNC int fio___http_client_tls_cert(fio_tls_each_s *e,
+                                         const char *server_name,
+                                         const char *public_cert_file,
+                                         const char *private_key_file,
+                                         const char *pk_password) {
+  fio_tls_cert_add((fio_tls_s *)e->udata,
+                   server_name,
+                   public_cert_file,
+                   private_key_file,
+                   pk_password);
+  return 0;
+}
+FIO_SFUNC int fio___http_client_tls_alpn(fio_tls_each_s *e,
+                                         const char *protocol_name,
+                                         void (*on_selected)(fio_s *)) {
+  fio_tls_alpn_add((fio_tls_s *)e->udata, protocol_name, on_selected);
+  return 0;
+}
+FIO_SFUNC int fio___http_client_tls_trust(fio_tls_each_s *e,
+                                          const char *public_cert_file) {
+  fio_tls_trust_add((fio_tls_s *)e->udata, public_cert_file);
+  return 0;
+}
+
+/** Copies the user's TLS settings, setting the host as server name (SNI). */
+FIO_SFUNC fio_tls_s *fio___http_client_tls(fio_tls_s *settings,
+                                           fio_buf_info_s host) {
+  fio_tls_s *tls = fio_tls_new();
+  const char *server_name = fio_tls_server_name(settings);
+  char buf[256];
+  fio_tls_each(settings,
+               .udata = tls,
+               .each_cert = fio___http_client_tls_cert,
+               .each_alpn = fio___http_client_tls_alpn,
+               .each_trust = fio___http_client_tls_trust);
+  if (!server_name && host.len < sizeof(buf) &&
+      !fio___http_client_is_ip(host)) { /* IP addresses aren't sent (SNI) */
+    FIO_MEMCPY(buf, host.buf, host.len);
+    buf[host.len] = 0;
+    server_name = buf;
+  }
+  return fio_tls_server_name_set(tls, server_name);
+}
+
+/** Creates a connection pool for the request's host (IO thread). */
+FIO_SFUNC fio___http_client_pool_s *fio___http_client_pool_create(
+    fio___http_client_req_s *r) {
+  fio_http_settings_s s = {.max_body_size = r->args.max_body_size};
+  fio___http_client_pool_s *pool;
+  fio___http_protocol_s *p;
+  http_settings_validate(&s, 1);
+  p = fio___http_protocol_new(1);
+  FIO_ASSERT_ALLOC(p);
+  for (size_t i = 0; i < FIO___HTTP_PROTOCOL_NONE + 1; ++i) {
+    p->state[i].protocol =
+        fio___http_protocol_get((fio___http_protocol_selector_e)i, 1);
+    p->state[i].controller =
+        fio___http_controller_get((fio___http_protocol_selector_e)i, 1);
+  }
+  p->settings = s;
+  p->settings.public_folder.buf = p->public_folder_buf;
+  p->public_folder_buf[0] = 0;
+  p->queue = fio_srv_queue();
+  pool = fio___http_client_pool_new();
+  FIO_ASSERT_ALLOC(pool);
+  *pool = (fio___http_client_pool_s){
+      .connections = FIO_LIST_INIT(pool->connections),
+      .protocol = p,
+      .url = r->key,
+  };
+  r->key = NULL;
+  if (pool->url[4] == 's') { /* https */
+    fio_io_functions_s *io_fn =
+        &p->state[FIO___HTTP_PROTOCOL_HTTP1].protocol.io_functions;
+    p->settings.tls = fio___http_client_tls(r->args.tls,
+                                            fio___http_client_host(pool));
+    *io_fn = fio_tls_default_io_functions(NULL);
+    pool->tls = io_fn->build_context(p->settings.tls, 1);
+  }
+  return pool;
+}
+
+FIO_SFUNC void fio___http_client_request_task(void *r_, void *ignr_) {
+  fio___http_client_req_s *r = (fio___http_client_req_s *)r_;
+  fio___http_client_pool_s *pool;
+  const fio_str_info_s key = FIO_STR_INFO2(r->key, fio_bstr_len(r->key));
+  const uint64_t hash = fio_risky_hash(key.buf, key.len, 0);
+  pool = fio___http_client_pool_map_get(&fio___http_client_pools, hash, key);
+  if (!pool) {
+    pool = fio___http_client_pool_create(r);
+    fio___http_client_pool_map_set(&fio___http_client_pools,
+                                   hash,
+                                   FIO_STR_INFO2(pool->url, key.len),
+                                   pool,
+                                   NULL);
+  }
+  /* the pool's limits follow the most recent request */
+  pool->max_connections = r->args.max_connections
+                              ? r->args.max_connections
+                              : FIO_HTTP_CLIENT_MAX_CONNECTIONS;
+  pool->pipeline = r->args.pipeline ? r->args.pipeline : 1;
+  pool->protocol->settings.max_body_size =
+      r->args.max_body_size ? r->args.max_body_size
+                            : FIO_HTTP_DEFAULT_MAX_BODY_SIZE;
+  pool->protocol->state[FIO___HTTP_PROTOCOL_HTTP1].protocol.timeout =
+      (r->args.timeout ? r->args.timeout : FIO_HTTP_DEFAULT_TIMEOUT) * 1000;
+  fio_bstr_free(r->key);
+  r->key = NULL;
+  fio_tls_free(r->args.tls);
+  r->args.tls = NULL;
+  fio___http_client_fifo_push(&pool->pending, r);
+  fio___http_client_dispatch(pool);
+  (void)ignr_;
+}
+
+FIO_SFUNC void fio___http_client_cleanup(void *ignr_) {
+  fio___http_client_pool_map_destroy(&fio___http_client_pools);
+  (void)ignr_;
+}
+
+FIO_CONSTRUCTOR(fio___http_client_constructor) {
+  fio_state_callback_add(FIO_CALL_AT_EXIT, fio___http_client_cleanup, NULL);
+}
+
+/** Tests for idempotent request methods (these may be retried). */
+FIO_IFUNC uint8_t fio___http_client_is_idempotent(fio_str_info_s m) {
+  switch (m.len) {
+  case 3: return !FIO_MEMCMP(m.buf, "GET", 3) || !FIO_MEMCMP(m.buf, "PUT", 3);
+  case 4: return !FIO_MEMCMP(m.buf, "HEAD", 4);
+  case 5: return !FIO_MEMCMP(m.buf, "TRACE", 5);
+  case 6: return !FIO_MEMCMP(m.buf, "DELETE", 6);
+  case 7: return !FIO_MEMCMP(m.buf, "OPTIONS", 7);
+  }
+  return 0;
+}
+
+void fio_http_request___(void); /* IDE marker */
+SFUNC int fio_http_request FIO_NOOP(const char *url,
+                                    fio_http_request_args_s args) {
+  fio_url_s u;
+  fio___http_client_req_s *r;
+  size_t is_tls = 0;
+  if (!url)
+    return -1;
+  u = fio_url_parse(url, FIO_STRLEN(url));
+  if (!u.host.len)
+    return -1;
+  if (u.scheme.len == 5 && (u.scheme.buf[4] | 0x20) == 's')
+    is_tls = 1, --u.scheme.len;
+  if (u.scheme.len && (u.scheme.len != 4 ||
+                       (fio_buf2u32u(u.scheme.buf) | 0x20202020UL) !=
+                           fio_buf2u32u("http")))
+    return -1;
+  if (args.headers.len &&
+      (args.headers.len < 4 || args.headers.buf[args.headers.len - 2] != '\r' ||
+       args.headers.buf[args.headers.len - 1] != '\n'))
+    return -1;
+  if (!args.method.len)
+    args.method = args.body.len ? FIO_STR_INFO2((char *)"POST", 4)
+                                : FIO_STR_INFO2((char *)"GET", 3);
+  if (!args.on_response)
+    args.on_response = fio___http_default_noop;
+  if (!u.path.len)
+    u.path = FIO_BUF_INFO2((char *)"/", 1);
+
+  r = fio___http_client_req_new();
+  *r = (fio___http_client_req_s){
+      .args = args,
+      .is_head =
+          (args.method.len == 4 && !FIO_MEMCMP(args.method.buf, "HEAD", 4)),
+      .retry = fio___http_client_is_idempotent(args.method),
+  };
+  r->args.method = r->args.headers = r->args.body = (fio_str_info_s){0};
+  r->args.tls = (is_tls && args.tls) ? fio_tls_dup(args.tls) : NULL;
+  /* the pool key is also the URL used for opening new connections */
+  r->key = fio_bstr_write2(
+      NULL,
+      FIO_STRING_WRITE_STR2((is_tls ? "https://" : "http://"), 7 + is_tls),
+      FIO_STRING_WRITE_STR2(u.host.buf, u.host.len),
+      FIO_STRING_WRITE_STR2(":", 1));
+  if (u.port.len)
+    r->key = fio_bstr_write(r->key, u.port.buf, u.port.len);
+  else
+    r->key = fio_bstr_write(r->key, (is_tls ? "443" : "80"), 2 + is_tls);
+  /* render the request once, it is copied by reference when sent */
+  r->data = fio_bstr_write2(NULL,
+                            FIO_STRING_WRITE_STR2(args.method.buf,
+                                                  args.method.len),
+                            FIO_STRING_WRITE_STR2(" ", 1),
+                            FIO_STRING_WRITE_STR2(u.path.buf, u.path.len));
+  if (u.query.len)
+    r->data = fio_bstr_write2(r->data,
+                              FIO_STRING_WRITE_STR2("?", 1),
+                              FIO_STRING_WRITE_STR2(u.query.buf, u.query.len));
+  r->data = fio_bstr_write2(r->data,
+                            FIO_STRING_WRITE_STR2(" HTTP/1.1\r\nhost: ", 17),
+                            FIO_STRING_WRITE_STR2(u.host.buf, u.host.len));
+  if (u.port.len)
+    r->data = fio_bstr_write2(r->data,
+                              FIO_STRING_WRITE_STR2(":", 1),
+                              FIO_STRING_WRITE_STR2(u.port.buf, u.port.len));
+  r->data = fio_bstr_write(r->data, "\r\n", 2);
+  if (args.headers.len)
+    r->data = fio_bstr_write(r->data, args.headers.buf, args.headers.len);
+  if (args.body.len)
+    r->data = fio_bstr_write2(r->data,
+                              FIO_STRING_WRITE_STR2("content-length: ", 16),
+                              FIO_STRING_WRITE_UNUM(args.body.len),
+                              FIO_STRING_WRITE_STR2("\r\n", 2));
+  r->data = fio_bstr_write(r->data, "\r\n", 2);
+  if (args.body.len)
+    r->data = fio_bstr_write(r->data, args.body.buf, args.body.len);
+  fio_srv_defer(fio___http_client_request_task, (void *)r, NULL);
+  return 0;
+}
+
 /* *****************************************************************************
 The Protocols at play
 ***************************************************************************** */
@@ -1739,6 +4574,13 @@ fio___http_protocol_get(fio___http_protocol_selector_e s, int is_client) {
                          .on_close = fio___http_on_close};
     return r;
   case FIO___HTTP_PROTOCOL_HTTP1:
+    if (is_client) {
+      r = (fio_protocol_s){.on_attach = fio___http1_on_attach,
+                           .on_data = fio___http1_on_data,
+                           .on_timeout = fio___http_client_on_timeout,
+                           .on_close = fio___http_client_on_close};
+      return r;
+    }
     r = (fio_protocol_s){.on_attach = fio___http1_on_attach,
                          .on_data = fio___http1_on_data,
                          .on_close = fio___http_on_close};
@@ -1790,6 +4632,12 @@ fio___http_controller_get(fio___http_protocol_selector_e s, int is_client) {
     };
     return r;
   case FIO___HTTP_PROTOCOL_HTTP1:
+    if (is_client) { /* responses are only read, never written */
+      r = (fio_http_controller_s){
+          .on_destroyed = fio__http_controller_on_destroyed2,
+      };
+      return r;
+    }
     r = (fio_http_controller_s){
         .send_headers = fio___http_controller_http1_send_headers,
         .write_body = fio___http_controller_http1_write_body,
@@ -1837,12 +4685,16 @@ SFUNC fio_s *fio_http_io(fio_http_s *h) {
   if (!h)
     return NULL;
   fio___http_connection_s *c = (fio___http_connection_s *)fio_http_cdata(h);
-  return c->io;
+  return c ? c->io : NULL;
 }
 
 /* *****************************************************************************
 Cleanup
 ***************************************************************************** */
+#undef fio___websocket_deflate_negotiate
+#undef fio___websocket_deflate_setup
+#undef fio___websocket_deflate_destroy
+#undef fio___websocket_inflate
 
 #endif /* FIO_EXTERN_COMPLETE */
 #undef FIO_HTTP
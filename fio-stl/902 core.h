@@ -291,6 +291,26 @@ FIO_SFUNC void FIO_NAME_TEST(stl, core)(void) {
       FIO_ASSERT(!memcmp(buf + i + 1, data, len),
                  "fio_xmask rountrip (with move) error");
     }
+    char big[515], expected[515], cpy[515];
+    fio_rand_bytes(big, 515);
+    for (size_t l = 0; l < 512; l += 1 + (l >> 4)) {
+      for (size_t i = 0; i < 3; ++i) {
+        for (size_t j = 0; j < l; ++j)
+          expected[j] = big[i + j] ^ ((char *)&mask)[j & 7];
+        cpy[l] = '\xFF';
+        fio_xmask_cpy(cpy, big + i, l, mask);
+        FIO_ASSERT(!memcmp(cpy, expected, l) && cpy[l] == '\xFF',
+                   "fio_xmask_cpy error (%zu bytes, offset %zu)",
+                   l,
+                   i);
+        fio_xmask(big + i, l, mask);
+        FIO_ASSERT(!memcmp(big + i, expected, l),
+                   "fio_xmask error (%zu bytes, offset %zu)",
+                   l,
+                   i);
+        fio_xmask(big + i, l, mask);
+      }
+    }
   }
 }
 /* *****************************************************************************
@@ -26,6 +26,47 @@ Copyright and License: see header file (000 copyright.h) or top of file
 // #undef FIO___TEST_REINCLUDE
 // #endif
 
+#if HAVE_ZLIB
+/* collects the response body written to a mock controller */
+static char *fio___test_http_compress_body;
+
+FIO_SFUNC void fio___test_http_compress_write_body(fio_http_s *h,
+                                                   fio_http_write_args_s args) {
+  if (args.buf) {
+    fio___test_http_compress_body =
+        fio_bstr_write(fio___test_http_compress_body,
+                       (char *)args.buf + args.offset,
+                       args.len);
+    if (args.dealloc)
+      args.dealloc((void *)args.buf);
+  } else if (args.fd > 0) {
+    fio___test_http_compress_body =
+        fio_bstr_readfd(fio___test_http_compress_body,
+                        args.fd,
+                        (intptr_t)args.offset,
+                        args.len);
+    close(args.fd);
+  }
+  (void)h;
+}
+
+/* decompresses `fio___test_http_compress_body` (gzip / deflate) */
+FIO_SFUNC char *fio___test_http_inflate(void) {
+  char *r = fio_bstr_reserve(NULL, (1 << 16));
+  z_stream z = {0};
+  FIO_ASSERT(inflateInit2(&z, 47) == Z_OK, "inflateInit2 failed");
+  z.next_in = (Bytef *)fio___test_http_compress_body;
+  z.avail_in = (uInt)fio_bstr_len(fio___test_http_compress_body);
+  z.next_out = (Bytef *)r;
+  z.avail_out = (uInt)(1 << 16);
+  FIO_ASSERT(inflate(&z, Z_FINISH) == Z_STREAM_END,
+             "compressed HTTP response couldn't be inflated");
+  r = fio_bstr_len_set(r, (size_t)z.total_out);
+  inflateEnd(&z);
+  return r;
+}
+#endif /* HAVE_ZLIB */
+
 FIO_SFUNC void FIO_NAME_TEST(stl, http_s)(void) {
   fprintf(stderr, "* Testing HTTP handle (fio_http_s).\n");
   fio_http_s *h = fio_http_new();
@@ -175,6 +216,205 @@ FIO_SFUNC void FIO_NAME_TEST(stl, http_s)(void) {
                "fio_http_body_read_until token error");
   }
 
+  { /* test arena allocations and arena owned strings */
+    char long_path[FIO_HTTP_ARENA_BLOCK_SIZE];
+    FIO_MEMSET(long_path, '/', sizeof(long_path));
+    for (size_t i = 1; i < FIO_HTTP_ARENA_BLOCK_SIZE; i <<= 1) {
+      char *mem = (char *)fio_http_arena_alloc(h, i);
+      FIO_ASSERT(mem && !((uintptr_t)mem & 15),
+                 "fio_http_arena_alloc should return aligned memory (%zu)",
+                 i);
+      FIO_MEMSET(mem, 0xFF, i);
+    }
+    fio_http_path_set(h, FIO_STR_INFO2(long_path, sizeof(long_path)));
+    FIO_ASSERT(FIO_STR_INFO_IS_EQ(fio_http_path(h),
+                                  FIO_STR_INFO2(long_path, sizeof(long_path))),
+               "fio_http_path roundtrip error for long paths");
+    fio_http_cookie_set(h,
+                        .name = FIO_STR_INFO1((char *)"my_cookie"),
+                        .value = FIO_STR_INFO1((char *)"my_value"));
+    FIO_ASSERT(FIO_STR_INFO_IS_EQ(fio_http_cookie(h, "my_cookie", 9),
+                                  FIO_STR_INFO1((char *)"my_value")),
+               "fio_http_cookie_set roundtrip error");
+    fio_http_path_set(h, FIO_STR_INFO1((char *)"/path"));
+  }
+  { /* test handle reset (reused for keep-alive requests) */
+    fio_http_s *r = fio_http_new();
+    for (size_t round = 0; round < 3; ++round) {
+      FIO_ASSERT(!fio_http_path(r).buf && !fio_http_status(r) &&
+                     !fio_http_request_header_each(r, NULL, NULL) &&
+                     !fio_http_response_header_each(r, NULL, NULL) &&
+                     !fio_http_body_length(r),
+                 "fio_http_reset should clear all data (round %zu)",
+                 round);
+      FIO_ASSERT(!fio_http_request_header(r, FIO_STR_INFO1((char *)"host"), 0)
+                      .buf,
+                 "fio_http_reset should clear request headers");
+      fio_http_path_set(r, FIO_STR_INFO1((char *)"/a/long/enough/path/name"));
+      fio_http_request_header_add(r,
+                                  FIO_STR_INFO1((char *)"host"),
+                                  FIO_STR_INFO1((char *)"example.com"));
+      fio_http_request_header_add(r,
+                                  FIO_STR_INFO1((char *)"cookie"),
+                                  FIO_STR_INFO1((char *)"a=1; b=2"));
+      fio_http_response_header_add(r,
+                                   FIO_STR_INFO1((char *)"x-round"),
+                                   FIO_STR_INFO1((char *)"value"));
+      fio_http_body_write(r, "body", 4);
+      FIO_ASSERT(FIO_STR_INFO_IS_EQ(fio_http_cookie(r, "b", 1),
+                                    FIO_STR_INFO1((char *)"2")),
+                 "cookie parsing error after fio_http_reset");
+      FIO_ASSERT(FIO_STR_INFO_IS_EQ(
+                     fio_http_request_header(r,
+                                             FIO_STR_INFO1((char *)"host"),
+                                             0),
+                     FIO_STR_INFO1((char *)"example.com")),
+                 "request header error after fio_http_reset");
+      FIO_ASSERT(fio_http_reset(r) == r, "fio_http_reset should return handle");
+    }
+    fio_http_free(r);
+  }
+
+#if HAVE_ZLIB
+  { /* test dynamic compression */
+    static fio_http_controller_s ctrl = {
+        .write_body = fio___test_http_compress_write_body,
+    };
+    struct {
+      const char *accept;
+      const char *encoding;
+      int streaming;
+      const char *types;
+      const char *if_none_match;
+      int from_file;
+      size_t status;
+      const char *etag;
+    } tests[] = {
+        {"gzip, deflate", "gzip", 0, NULL, NULL, 0, 200, "\"v1-gzip\""},
+        {"gzip;q=0, deflate",
+         "deflate",
+         0,
+         NULL,
+         NULL,
+         0,
+         200,
+         "\"v1-deflate\""},
+        {"br", NULL, 0, NULL, NULL, 0, 200, "\"v1\""},
+        {"*", "gzip", 1, NULL, NULL, 0, 200, "\"v1-gzip\""},
+        {"deflate;q=0.5", "deflate", 1, NULL, NULL, 0, 200, "\"v1-deflate\""},
+        {"gzip",
+         "gzip",
+         0,
+         "text/, APPLICATION/JSON",
+         NULL,
+         0,
+         200,
+         "\"v1-gzip\""},
+        {"gzip", NULL, 0, "+json, +xml", NULL, 0, 200, "\"v1\""},
+        {"gzip", "gzip", 0, "application/json", NULL, 0, 200, "\"v1-gzip\""},
+        {"gzip", NULL, 0, "text/,application/jso", NULL, 0, 200, "\"v1\""},
+        {"gzip", NULL, 0, "application/", NULL, 1, 200, "\"v1\""},
+        {"gzip", NULL, 0, NULL, "\"v1-gzip\"", 0, 304, "\"v1-gzip\""},
+        {"gzip", "gzip", 0, NULL, "\"v1\"", 0, 200, "\"v1-gzip\""},
+        {"br", NULL, 0, NULL, "\"v1-gzip\"", 0, 200, "\"v1\""},
+        {"br", NULL, 0, NULL, "\"v1\"", 0, 304, "\"v1\""},
+    };
+    char data[4096];
+    for (size_t i = 0; i < sizeof(data); ++i)
+      data[i] = "{\"key\": \"value\"},\n"[i & 15];
+    fio_http_s *r = fio_http_new();
+    for (size_t t = 0; t < sizeof(tests) / sizeof(tests[0]); ++t) {
+      fio_str_info_s enc, etag;
+      fio_http_reset(r);
+      fio_http_controller_set(r, &ctrl);
+      fio_http_compress_set(
+          r,
+          64,
+          (tests[t].types ? FIO_STR_INFO1((char *)tests[t].types)
+                          : FIO_STR_INFO2(NULL, 0)));
+      fio_http_method_set(r, FIO_STR_INFO1((char *)"GET"));
+      fio_http_status_set(r, 200);
+      fio_http_path_set(r, FIO_STR_INFO1((char *)"/json"));
+      fio_http_request_header_add(r,
+                                  FIO_STR_INFO1((char *)"accept-encoding"),
+                                  FIO_STR_INFO1((char *)tests[t].accept));
+      if (tests[t].if_none_match)
+        fio_http_request_header_add(
+            r,
+            FIO_STR_INFO1((char *)"if-none-match"),
+            FIO_STR_INFO1((char *)tests[t].if_none_match));
+      fio_http_response_header_set(
+          r,
+          FIO_STR_INFO1((char *)"content-type"),
+          FIO_STR_INFO1((char *)"application/json; charset=utf-8"));
+      fio_http_response_header_set(r,
+                                   FIO_STR_INFO1((char *)"etag"),
+                                   FIO_STR_INFO1((char *)"\"v1\""));
+      if (tests[t].streaming) {
+        for (size_t pos = 0; pos < sizeof(data); pos += 1024)
+          fio_http_write(r, .buf = data + pos, .len = 1024, .copy = 1);
+        fio_http_finish(r);
+      } else if (tests[t].from_file) {
+        FILE *tmp = tmpfile();
+        FIO_ASSERT(tmp && fwrite(data, 1, sizeof(data), tmp) == sizeof(data) &&
+                       !fflush(tmp),
+                   "couldn't create a temporary file for testing");
+        fio_http_write(r,
+                       .fd = dup(fileno(tmp)),
+                       .len = sizeof(data),
+                       .finish = 1);
+        fclose(tmp);
+      } else {
+        fio_http_write(r, .buf = data, .len = sizeof(data), .finish = 1);
+      }
+      FIO_ASSERT(fio_http_status(r) == tests[t].status,
+                 "dynamic compression status error for %s (%s): %zu",
+                 tests[t].accept,
+                 (tests[t].if_none_match ? tests[t].if_none_match : "-"),
+                 fio_http_status(r));
+      enc = fio_http_response_header(r,
+                                     FIO_STR_INFO1((char *)"content-encoding"),
+                                     0);
+      etag = fio_http_response_header(r, FIO_STR_INFO1((char *)"etag"), 0);
+      FIO_ASSERT(tests[t].encoding
+                     ? FIO_STR_INFO_IS_EQ(
+                           enc,
+                           FIO_STR_INFO1((char *)tests[t].encoding))
+                     : !enc.buf,
+                 "dynamic compression encoding error for %s (%s)",
+                 tests[t].accept,
+                 (enc.buf ? enc.buf : "none"));
+      FIO_ASSERT(FIO_STR_INFO_IS_EQ(etag, FIO_STR_INFO1((char *)tests[t].etag)),
+                 "compressed responses should mark the etag (%s != %s)",
+                 etag.buf,
+                 tests[t].etag);
+      if (tests[t].status == 304) {
+        FIO_ASSERT(!fio_bstr_len(fio___test_http_compress_body),
+                   "304 responses should have no body");
+      } else if (tests[t].encoding) {
+        char *inflated = fio___test_http_inflate();
+        FIO_ASSERT(fio_bstr_len(fio___test_http_compress_body) < sizeof(data),
+                   "dynamic compression should reduce the body's length");
+        FIO_ASSERT(fio_bstr_len(inflated) == sizeof(data) &&
+                       !FIO_MEMCMP(inflated, data, sizeof(data)),
+                   "dynamically compressed body error (%s)",
+                   tests[t].accept);
+        fio_bstr_free(inflated);
+      } else {
+        FIO_ASSERT(fio_bstr_len(fio___test_http_compress_body) ==
+                           sizeof(data) &&
+                       !FIO_MEMCMP(fio___test_http_compress_body,
+                                   data,
+                                   sizeof(data)),
+                   "uncompressed body error");
+      }
+      fio_bstr_free(fio___test_http_compress_body);
+      fio___test_http_compress_body = NULL;
+    }
+    fio_http_free(r);
+  }
+#endif /* HAVE_ZLIB */
+
   /* almost done, just make sure reference counting doesn't destroy object */
   fio_http_free(fio_http_dup(h));
   FIO_ASSERT(
@@ -185,6 +425,732 @@ FIO_SFUNC void FIO_NAME_TEST(stl, http_s)(void) {
   fio_http_free(h);
 }
 
+/* *****************************************************************************
+Form Data Parsing Tests
+***************************************************************************** */
+
+/* collects parsed fields as: `[name|filename|content_type]value;` */
+FIO_SFUNC int fio___test_http_form_on_field(fio_buf_info_s name,
+                                            fio_buf_info_s filename,
+                                            fio_buf_info_s content_type,
+                                            void *udata) {
+  char **out = (char **)udata;
+  *out = fio_bstr_write2(*out,
+                         FIO_STRING_WRITE_STR2("[", 1),
+                         FIO_STRING_WRITE_STR2(name.buf, name.len),
+                         FIO_STRING_WRITE_STR2("|", 1),
+                         FIO_STRING_WRITE_STR2(filename.buf, filename.len),
+                         FIO_STRING_WRITE_STR2("|", 1),
+                         FIO_STRING_WRITE_STR2(content_type.buf,
+                                               content_type.len),
+                         FIO_STRING_WRITE_STR2("]", 1));
+  return 0;
+}
+FIO_SFUNC int fio___test_http_form_on_data(fio_buf_info_s data, void *udata) {
+  char **out = (char **)udata;
+  FIO_ASSERT(data.len, "form parser shouldn't report empty data");
+  *out = fio_bstr_write(*out, data.buf, data.len);
+  return 0;
+}
+FIO_SFUNC int fio___test_http_form_on_field_end(void *udata) {
+  char **out = (char **)udata;
+  *out = fio_bstr_write(*out, ";", 1);
+  return 0;
+}
+
+FIO_SFUNC void FIO_NAME_TEST(stl, http_form)(void) {
+  fprintf(stderr, "* Testing HTTP form data parsing.\n");
+  char *out = NULL;
+  fio_http_form_settings_s settings = {
+      .on_field = fio___test_http_form_on_field,
+      .on_data = fio___test_http_form_on_data,
+      .on_field_end = fio___test_http_form_on_field_end,
+      .udata = &out,
+  };
+  struct {
+    const char *content_type;
+    const char *body;
+    const char *expected;
+  } tests[] = {
+      {
+          .content_type = "multipart/form-data; boundary=\"-xYz-\"",
+          .body = "ignored preamble\r\n"
+                  "---xYz-\r\n"
+                  "Content-Disposition: form-data; name=\"text\"\r\n"
+                  "\r\n"
+                  "Hello\r\n---xY not a boundary\r\n"
+                  "---xYz-  \r\n"
+                  "Content-Disposition: form-data; name=\"file\"; "
+                  "filename=\"a.txt\"\r\n"
+                  "Content-Type: text/plain \r\n"
+                  "\r\n"
+                  "\r\n\r\nfile\r\n"
+                  "---xYz-\r\n"
+                  "content-disposition: form-data; name=empty\r\n"
+                  "\r\n"
+                  "\r\n"
+                  "---xYz---\r\n"
+                  "ignored epilogue",
+          .expected = "[text||]Hello\r\n---xY not a boundary;"
+                      "[file|a.txt|text/plain]\r\n\r\nfile;"
+                      "[empty||];",
+      },
+      {
+          .content_type = "Multipart/Form-Data;boundary=b",
+          .body = "--b\r\n\r\nno headers\r\n--b--",
+          .expected = "[||]no headers;",
+      },
+      {
+          .content_type = "application/x-www-form-urlencoded",
+          .body = "a=1&b=hello+world%21&&flag&=skipped&c=%41%4&d=",
+          .expected = "[a||]1;[b||]hello world!;[flag||];[c||]A%4;[d||];",
+      },
+  };
+  for (size_t t = 0; t < sizeof(tests) / sizeof(tests[0]); ++t) {
+    const size_t len = FIO_STRLEN(tests[t].body);
+    /* test every possible split point, as well as byte-by-byte parsing */
+    for (size_t split = 0; split <= len + 1; ++split) {
+      fio_http_form_s p;
+      char *body = fio_bstr_write(NULL, tests[t].body, len);
+      FIO_ASSERT(
+          !fio_http_form_init(&p,
+                              FIO_STR_INFO1((char *)tests[t].content_type),
+                              settings),
+                 "fio_http_form_init failed for %s",
+                 tests[t].content_type);
+      if (split > len) {
+        for (size_t i = 0; i < len; ++i)
+          FIO_ASSERT(!fio_http_form_parse(&p, FIO_BUF_INFO2(body + i, 1)),
+                     "form parsing error (byte by byte) at %zu",
+                     i);
+      } else {
+        FIO_ASSERT(!fio_http_form_parse(&p, FIO_BUF_INFO2(body, split)) &&
+                       !fio_http_form_parse(
+                           &p,
+                           FIO_BUF_INFO2(body + split, len - split)),
+                   "form parsing error (split at %zu)",
+                   split);
+      }
+      FIO_ASSERT(!fio_http_form_finish(&p), "form parsing incomplete");
+      FIO_ASSERT(FIO_STR_INFO_IS_EQ(fio_bstr_info(out),
+                                    FIO_STR_INFO1((char *)tests[t].expected)),
+                 "form parsing error (split at %zu):\n%s\nexpected:\n%s",
+                 split,
+                 out,
+                 tests[t].expected);
+      fio_bstr_free(body);
+      fio_bstr_free(out);
+      out = NULL;
+    }
+  }
+  { /* errors */
+    fio_http_form_s p;
+    FIO_ASSERT(fio_http_form_init(&p,
+                                  FIO_STR_INFO1((char *)"text/plain"),
+                                  settings),
+               "fio_http_form_init should fail for non-form data");
+    FIO_ASSERT(fio_http_form_init(&p,
+                                  FIO_STR_INFO1((char *)"multipart/form-data"),
+                                  settings),
+               "fio_http_form_init should fail without a boundary");
+    FIO_ASSERT(!fio_http_form_init(
+                   &p,
+                   FIO_STR_INFO1((char *)"multipart/form-data; boundary=b"),
+                   settings),
+               "fio_http_form_init failed");
+    FIO_ASSERT(!fio_http_form_parse(
+                   &p,
+                   FIO_BUF_INFO1((char *)"--b\r\n\r\nunterminated")),
+               "form parsing error");
+    FIO_ASSERT(fio_http_form_finish(&p),
+               "fio_http_form_finish should fail for incomplete data");
+    fio_bstr_free(out);
+    out = NULL;
+  }
+  { /* parsing a body stored in a temporary file */
+    fio_http_s *h = fio_http_new();
+    const size_t value_len = FIO_HTTP_BODY_RAM_LIMIT + 1024;
+    char *value = fio_bstr_reserve(NULL, value_len);
+    for (size_t i = 0; i < value_len; ++i)
+      value[i] = (i & 1023) ? (char)('a' + (i % 26)) : '\r';
+    value = fio_bstr_len_set(value, value_len);
+    fio_http_request_header_set(
+        h,
+        FIO_STR_INFO1((char *)"content-type"),
+        FIO_STR_INFO1((char *)"multipart/form-data; boundary=0123456789"));
+    char *prefix = (char *)"--0123456789\r\n"
+                           "Content-Disposition: form-data; name=\"big\"\r\n"
+                           "\r\n";
+    fio_http_body_write(h, prefix, FIO_STRLEN(prefix));
+    fio_http_body_write(h, value, value_len);
+    fio_http_body_write(h, "\r\n--0123456789--\r\n", 18);
+    FIO_ASSERT(!fio_http_body_parse_form(h, settings),
+               "fio_http_body_parse_form failed");
+    FIO_ASSERT(fio_bstr_len(out) == value_len + 8 &&
+                   !FIO_MEMCMP(out, "[big||]", 7) &&
+                   !FIO_MEMCMP(out + 7, value, value_len),
+               "fio_http_body_parse_form error (file body)");
+    fio_bstr_free(out);
+    fio_bstr_free(value);
+    fio_http_free(h);
+  }
+}
+
+/* *****************************************************************************
+Response Cache Tests
+***************************************************************************** */
+
+/* collects the response body written to a mock controller */
+static char *fio___test_http_cache_body;
+static size_t fio___test_http_cache_sent;
+static size_t fio___test_http_cache_failed;
+
+FIO_SFUNC void fio___test_http_cache_write_body(fio_http_s *h,
+                                                fio_http_write_args_s args) {
+  if (args.buf) {
+    fio___test_http_cache_body = fio_bstr_write(fio___test_http_cache_body,
+                                                (char *)args.buf + args.offset,
+                                                args.len);
+    if (args.dealloc)
+      args.dealloc((void *)args.buf);
+  }
+  (void)h;
+}
+
+FIO_SFUNC void fio___test_http_cache_on_release(fio_http_s *h, void *udata) {
+  if (fio_http_is_finished(h)) {
+    FIO_ASSERT(fio_http_status(h) == 200,
+               "cached response status error (%zu)",
+               fio_http_status(h));
+    FIO_ASSERT(
+        fio_http_response_header(h, FIO_STR_INFO1((char *)"x-test"), 0).len ==
+            2,
+        "cached response header missing");
+    ++fio___test_http_cache_sent;
+  } else {
+    ++fio___test_http_cache_failed;
+  }
+  fio_http_free(h);
+  (void)udata;
+}
+
+FIO_SFUNC fio_http_s *fio___test_http_cache_request(const char *method,
+                                                    const char *lang) {
+  static fio_http_controller_s ctrl = {
+      .write_body = fio___test_http_cache_write_body,
+  };
+  fio_http_s *h = fio_http_new();
+  fio_http_controller_set(h, &ctrl);
+  fio_http_method_set(h, FIO_STR_INFO1((char *)method));
+  fio_http_path_set(h, FIO_STR_INFO1((char *)"/cached"));
+  fio_http_query_set(h, FIO_STR_INFO1((char *)"a=1"));
+  fio_http_request_header_set(h,
+                              FIO_STR_INFO1((char *)"accept-language"),
+                              FIO_STR_INFO1((char *)lang));
+  return h;
+}
+
+FIO_SFUNC void FIO_NAME_TEST(stl, http_cache)(void) {
+  fprintf(stderr, "* Testing HTTP response cache (fio_http_cache).\n");
+#if FIO_HTTP_RESPONSE_CACHE_LIMIT
+  fio_http_cache_args_s args = {
+      .ttl = 10,
+      .vary = FIO_STR_INFO1((char *)"accept-language"),
+      .on_release = fio___test_http_cache_on_release,
+  };
+  fio_http_s *leader = fio___test_http_cache_request("GET", "en");
+  fio_http_s *h;
+  FIO_ASSERT(fio_http_cache(leader, args) == -1,
+             "fio_http_cache should miss for the first request");
+  h = fio___test_http_cache_request("GET", "en");
+  FIO_ASSERT(!fio_http_cache(h, args) && !fio___test_http_cache_sent,
+             "fio_http_cache should wait for a pending response");
+  fio_http_status_set(leader, 200);
+  fio_http_response_header_set(leader,
+                               FIO_STR_INFO1((char *)"x-test"),
+                               FIO_STR_INFO1((char *)"ok"));
+  fio_http_write(leader, .buf = "hello", .len = 5, .copy = 1, .finish = 1);
+  FIO_ASSERT(fio___test_http_cache_sent == 1,
+             "waiting requests should be sent the cached response");
+  FIO_ASSERT(fio_bstr_len(fio___test_http_cache_body) == 10 &&
+                 !FIO_MEMCMP(fio___test_http_cache_body, "hellohello", 10),
+             "cached response body error");
+  fio_http_free(leader);
+  h = fio___test_http_cache_request("GET", "en");
+  FIO_ASSERT(!fio_http_cache(h, args) && fio___test_http_cache_sent == 2,
+             "fio_http_cache should hit");
+  h = fio___test_http_cache_request("POST", "en");
+  FIO_ASSERT(fio_http_cache(h, args) == -1, "POST requests aren't cached");
+  fio_http_free(h);
+  /* a response that can't be cached releases waiting requests */
+  leader = fio___test_http_cache_request("GET", "fr");
+  FIO_ASSERT(fio_http_cache(leader, args) == -1,
+             "fio_http_cache should miss for a different vary header");
+  h = fio___test_http_cache_request("GET", "fr");
+  FIO_ASSERT(!fio_http_cache(h, args), "fio_http_cache should wait");
+  fio_http_status_set(leader, 500);
+  fio_http_write(leader, .buf = "error", .len = 5, .copy = 1, .finish = 1);
+  FIO_ASSERT(fio___test_http_cache_failed == 1 &&
+                 fio___test_http_cache_sent == 2,
+             "waiting requests should be released if caching failed");
+  fio_http_free(leader);
+  leader = fio___test_http_cache_request("GET", "fr");
+  FIO_ASSERT(fio_http_cache(leader, args) == -1,
+             "fio_http_cache should miss after a failed attempt");
+  h = fio___test_http_cache_request("GET", "fr");
+  FIO_ASSERT(!fio_http_cache(h, args), "fio_http_cache should wait");
+  fio_http_free(leader); /* no response */
+  FIO_ASSERT(fio___test_http_cache_failed == 2,
+             "waiting requests should be released if the handle is freed");
+  /* the host is part of the key, credentials require a public response */
+  {
+    size_t sent = fio___test_http_cache_sent;
+    struct {
+      const char *host;
+      const char *cookie;
+      const char *cc; /* response cache-control (NULL == not responding) */
+      int hit;
+    } cases[] = {
+        {"a.test", NULL, "max-age=10", 0},           /* stored */
+        {"a.test", NULL, NULL, 1},                   /* same host hits */
+        {"b.test", NULL, "Max-Age=10, No-Cache", 0}, /* not stored */
+        {"b.test", NULL, NULL, 0},                   /* so this misses */
+        {"a.test", "id=1", NULL, 0},                 /* credentials miss */
+        {"c.test", "id=1", "max-age=10", 0},         /* not stored */
+        {"c.test", NULL, NULL, 0},                   /* so this misses */
+        {"d.test", "id=1", "Public, max-age=10", 0}, /* stored (public) */
+        {"d.test", "id=2", NULL, 1},                 /* and shared */
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+      h = fio___test_http_cache_request("GET", "de");
+      fio_http_request_header_set(h,
+                                  FIO_STR_INFO1((char *)"host"),
+                                  FIO_STR_INFO1((char *)cases[i].host));
+      if (cases[i].cookie)
+        fio_http_request_header_set(h,
+                                    FIO_STR_INFO1((char *)"cookie"),
+                                    FIO_STR_INFO1((char *)cases[i].cookie));
+      if (cases[i].hit) {
+        FIO_ASSERT(!fio_http_cache(h, args) &&
+                       fio___test_http_cache_sent == ++sent,
+                   "fio_http_cache should hit (%zu)",
+                   i);
+        continue;
+      }
+      FIO_ASSERT(fio_http_cache(h, args) == -1,
+                 "fio_http_cache should miss (%zu)",
+                 i);
+      if (cases[i].cc) {
+        fio_http_status_set(h, 200);
+        fio_http_response_header_set(h,
+                                     FIO_STR_INFO1((char *)"x-test"),
+                                     FIO_STR_INFO1((char *)"ok"));
+        fio_http_response_header_set(h,
+                                     FIO_STR_INFO1((char *)"cache-control"),
+                                     FIO_STR_INFO1((char *)cases[i].cc));
+        fio_http_write(h, .buf = "hello", .len = 5, .copy = 1, .finish = 1);
+      }
+      fio_http_free(h);
+    }
+  }
+  fio_bstr_free(fio___test_http_cache_body);
+  fio___test_http_cache_body = NULL;
+#endif
+}
+
+/* *****************************************************************************
+HTTP Logging Tests (buffered writer)
+***************************************************************************** */
+#if FIO_OS_POSIX
+/* redirects STDOUT to a temporary file, returns the original STDOUT */
+FIO_SFUNC int fio___test_http_log_redirect(FILE *tmp) {
+  int org;
+  fflush(stdout);
+  org = dup(fileno(stdout));
+  FIO_ASSERT(tmp && org != -1 && dup2(fileno(tmp), fileno(stdout)) != -1,
+             "couldn't redirect STDOUT for testing");
+  return org;
+}
+
+/* stops the writer thread (writing all lines), restores STDOUT */
+FIO_SFUNC char *fio___test_http_log_collect(FILE *tmp, int org) {
+  char *r;
+  fio___http_log_at_exit(NULL);
+  fio___http_log.pid = 0; /* the next line restarts the writer thread */
+  fflush(stdout);
+  dup2(org, fileno(stdout));
+  close(org);
+  r = fio_bstr_readfd(NULL, fileno(tmp), 0, 0);
+  fclose(tmp);
+  return r;
+}
+
+/* writes `count` numbered log lines, `len` bytes each */
+FIO_SFUNC void fio___test_http_log_lines(const char *prefix,
+                                         size_t count,
+                                         size_t len) {
+  char line[128];
+  FIO_ASSERT(len < sizeof(line), "test log line too long");
+  for (size_t i = 0; i < count; ++i) {
+    FIO_MEMSET(line, '.', len);
+    snprintf(line, len, "%s %06zu", prefix, i);
+    line[strlen(line)] = ' ';
+    line[len - 1] = '\n';
+    fio___http_log_write(line, len);
+  }
+}
+
+/* counts the lines starting with `prefix`, -1 if out of order */
+FIO_SFUNC long fio___test_http_log_count(const char *log, const char *prefix) {
+  long count = 0;
+  uint64_t next = 0; /* dropped lines may be skipped */
+  const size_t prefix_len = strlen(prefix);
+  for (const char *pos = log; pos && *pos; pos = strchr(pos, '\n'), ++pos) {
+    char *num;
+    uint64_t i;
+    if (strncmp(pos, prefix, prefix_len) || pos[prefix_len] != ' ')
+      continue;
+    num = (char *)pos + prefix_len + 1;
+    if ((i = fio_atol10u(&num)) < next)
+      return -1;
+    next = i + 1;
+    ++count;
+  }
+  return count;
+}
+
+FIO_SFUNC void FIO_NAME_TEST(stl, http_log)(void) {
+  fprintf(stderr, "* Testing HTTP logging (buffered writer).\n");
+  const size_t count = (FIO_HTTP_LOG_BUFFER_SIZE / 100) * 4;
+  size_t dropped = fio_http_log_dropped();
+  FILE *tmp = tmpfile();
+  int org = fio___test_http_log_redirect(tmp);
+  char *log;
+  long written;
+  { /* lines are written in order, even if the buffer fills up */
+    fio___test_http_log_lines("a", count, 100);
+    FIO_ASSERT(fio___http_log.pid == fio_thread_getpid() &&
+                   !fio___http_log.sync,
+               "HTTP log lines should be written by a background thread");
+    log = fio___test_http_log_collect(tmp, org);
+    written = fio___test_http_log_count(log, "a");
+    FIO_ASSERT(written != -1, "HTTP log lines written out of order");
+    FIO_ASSERT((size_t)written + (fio_http_log_dropped() - dropped) == count &&
+                   fio_bstr_len(log) == (size_t)written * 100,
+               "HTTP log lines missing (%ld / %zu written)",
+               written,
+               count);
+    FIO_ASSERT(FIO_HTTP_LOG_DROP_WHEN_FULL || written == (long)count,
+               "HTTP log lines shouldn't be dropped (%ld / %zu written)",
+               written,
+               count);
+    fio_bstr_free(log);
+  }
+#if FIO_HTTP_LOG_DROP_WHEN_FULL
+  { /* lines are dropped (and counted) while the writer is busy */
+    tmp = tmpfile();
+    org = fio___test_http_log_redirect(tmp);
+    fio___test_http_log_lines("start", 1, 100); /* start the writer */
+    fio_thread_mutex_lock(&fio___http_log.writing); /* the writer is busy */
+    dropped = fio_http_log_dropped();
+    fio___test_http_log_lines("c", count, 100);
+    fio_thread_mutex_unlock(&fio___http_log.writing);
+    log = fio___test_http_log_collect(tmp, org);
+    written = fio___test_http_log_count(log, "c");
+    FIO_ASSERT(written > 0 && (size_t)written < count &&
+                   (size_t)written + (fio_http_log_dropped() - dropped) ==
+                       count,
+               "HTTP log dropped line count error (%ld written, %zu dropped)",
+               written,
+               fio_http_log_dropped() - dropped);
+    fio_bstr_free(log);
+  }
+#endif
+  { /* a forked child starts its own writer, parent lines aren't copied */
+    int status = -1;
+    fio_thread_pid_t child;
+    tmp = tmpfile();
+    org = fio___test_http_log_redirect(tmp);
+    fio___test_http_log_lines("start", 1, 100); /* start the writer */
+    fio_thread_mutex_lock(&fio___http_log.writing); /* keep lines buffered */
+    fio___test_http_log_lines("p", 10, 100);
+    child = fio_thread_fork();
+    FIO_ASSERT(child != -1, "fork failed");
+    if (!child) {
+      fio___http_log_on_fork(NULL); /* a FIO_CALL_IN_CHILD callback */
+      fio___test_http_log_lines("child", 10, 100);
+      status = (fio___http_log.pid == fio_thread_getpid() &&
+                !fio___http_log.sync);
+      fio___http_log_at_exit(NULL);
+      _exit(status ? 0 : 1);
+    }
+    fio_thread_mutex_unlock(&fio___http_log.writing);
+    FIO_ASSERT(fio_thread_waitpid(child, &status, 0) == child &&
+                   WIFEXITED(status) && !WEXITSTATUS(status),
+               "forked child should start its own HTTP log writer");
+    log = fio___test_http_log_collect(tmp, org);
+    FIO_ASSERT(fio___test_http_log_count(log, "start") == 1 &&
+                   fio___test_http_log_count(log, "p") == 10 &&
+                   fio___test_http_log_count(log, "child") == 10,
+               "forked HTTP logs error:\n%s",
+               log);
+    fio_bstr_free(log);
+  }
+}
+#else
+FIO_SFUNC void FIO_NAME_TEST(stl, http_log)(void) {}
+#endif /* FIO_OS_POSIX */
+
+/* *****************************************************************************
+Static File Cache Tests
+***************************************************************************** */
+#if FIO_HTTP_STATIC_CACHE_LIMIT && FIO_OS_POSIX
+/* writes `len` bytes of `c` to `dir/name`, leaving the file name in `fn` */
+FIO_SFUNC void fio___test_sfile_write(fio_str_info_s *fn,
+                                      const char *dir,
+                                      const char *name,
+                                      int c,
+                                      size_t len) {
+  FILE *f;
+  fn->len = 0;
+  fio_string_printf(fn, NULL, "%s/%s", dir, name);
+  f = fopen(fn->buf, "wb");
+  FIO_ASSERT(f, "couldn't create a temporary file for testing");
+  for (size_t i = 0; i < len; ++i)
+    fputc(c, f);
+  fclose(f);
+}
+
+/* gets a static file object from the cache (or the file system) */
+FIO_SFUNC fio___http_sfile_s *fio___test_sfile_get(fio_str_info_s *fn) {
+  return fio___http_sfile_get(fn, fio_risky_hash(fn->buf, fn->len, 0), 0);
+}
+
+/* returns the cached object (if any), without resolving the file */
+FIO_SFUNC fio___http_sfile_s *fio___test_sfile_peek(fio_str_info_s fn) {
+  return fio___http_sfile_map_get(&fio___http_sfile_cache.map,
+                                  fio_risky_hash(fn.buf, fn.len, 0),
+                                  fn);
+}
+
+FIO_SFUNC void FIO_NAME_TEST(stl, http_static_cache)(void) {
+  fprintf(stderr, "* Testing HTTP static file cache (fio___http_sfile).\n");
+  char dir[] = "/tmp/fio_test_sfile_XXXXXX";
+  FIO_STR_INFO_TMP_VAR(fn, 1023);
+  fio___http_sfile_s *f, *f2;
+  FIO_ASSERT(mkdtemp(dir), "couldn't create a temporary folder for testing");
+  fio___http_sfile_cache_destroy();
+
+  /* hit within the TTL, even if the file changed */
+  fio___test_sfile_write(&fn, dir, "a.txt", 'a', 5);
+  f = fio___test_sfile_get(&fn);
+  FIO_ASSERT(f && f->v[0].len == 5 && fio_bstr_len(f->v[0].data) == 5 &&
+                 !FIO_MEMCMP(f->v[0].data, "aaaaa", 5),
+             "static file should be resolved and kept in memory");
+  fio___test_sfile_write(&fn, dir, "a.txt", 'b', 7);
+  f2 = fio___test_sfile_get(&fn);
+  FIO_ASSERT(f2 == f && f2->v[0].len == 5,
+             "static file cache should hit within the TTL");
+  fio___http_sfile_free(f2);
+
+  /* re-validated (re-stat) once the TTL expired */
+  f->expires = 0; /* expire the cached object */
+  fio___http_sfile_free(f);
+  f = fio___test_sfile_get(&fn);
+  FIO_ASSERT(f && f != f2 && f->v[0].len == 7 &&
+                 fio_bstr_len(f->v[0].data) == 7 &&
+                 !FIO_MEMCMP(f->v[0].data, "bbbbbbb", 7),
+             "static file should be re-validated after the TTL");
+  FIO_ASSERT(fio___test_sfile_peek(fn) == f,
+             "re-validated file should replace the cached object");
+  fio___http_sfile_free(f);
+
+  /* files over the size limit aren't kept in memory */
+  fio___test_sfile_write(&fn,
+                         dir,
+                         "big.txt",
+                         'c',
+                         FIO_HTTP_STATIC_CACHE_FILE_LIMIT + 1);
+  f = fio___test_sfile_get(&fn);
+  FIO_ASSERT(f && f->v[0].len == FIO_HTTP_STATIC_CACHE_FILE_LIMIT + 1 &&
+                 !f->v[0].data,
+             "large static files should bypass the in-memory cache");
+  fio___http_sfile_free(f);
+  fio___test_sfile_write(&fn,
+                         dir,
+                         "limit.txt",
+                         'c',
+                         FIO_HTTP_STATIC_CACHE_FILE_LIMIT);
+  f = fio___test_sfile_get(&fn);
+  FIO_ASSERT(f && fio_bstr_len(f->v[0].data) ==
+                      FIO_HTTP_STATIC_CACHE_FILE_LIMIT,
+             "static files up to the size limit should be kept in memory");
+  fio___http_sfile_free(f);
+
+  /* LRU eviction: the least recently used file is evicted first */
+  fio___http_sfile_cache_destroy();
+  for (size_t i = 0; i <= FIO_HTTP_STATIC_CACHE_LIMIT; ++i) {
+    char name[32];
+    snprintf(name, sizeof(name), "%zu.txt", i);
+    fio___test_sfile_write(&fn, dir, name, 'd', 1);
+    if (i == FIO_HTTP_STATIC_CACHE_LIMIT) { /* touch file 0 before overflow */
+      FIO_STR_INFO_TMP_VAR(first, 1023);
+      fio___test_sfile_write(&first, dir, "0.txt", 'd', 1);
+      fio___http_sfile_free(fio___test_sfile_get(&first));
+    }
+    fio___http_sfile_free(fio___test_sfile_get(&fn));
+  }
+  FIO_ASSERT(fio___http_sfile_map_count(&fio___http_sfile_cache.map) ==
+                 FIO_HTTP_STATIC_CACHE_LIMIT,
+             "static file cache should be limited to %zu entries (%zu)",
+             (size_t)FIO_HTTP_STATIC_CACHE_LIMIT,
+             (size_t)fio___http_sfile_map_count(&fio___http_sfile_cache.map));
+  FIO_ASSERT(fio___test_sfile_peek(fn),
+             "newest static file should be cached");
+  fn.len = 0;
+  fio_string_printf(&fn, NULL, "%s/0.txt", dir);
+  FIO_ASSERT(fio___test_sfile_peek(fn),
+             "recently used static file shouldn't be evicted");
+  fn.len = 0;
+  fio_string_printf(&fn, NULL, "%s/1.txt", dir);
+  FIO_ASSERT(!fio___test_sfile_peek(fn),
+             "least recently used static file should be evicted");
+
+  /* cleanup */
+  fio___http_sfile_cache_destroy();
+  for (size_t i = 0; i <= FIO_HTTP_STATIC_CACHE_LIMIT; ++i) {
+    fn.len = 0;
+    fio_string_printf(&fn, NULL, "%s/%zu.txt", dir, i);
+    unlink(fn.buf);
+  }
+  const char *others[] = {"a.txt", "big.txt", "limit.txt"};
+  for (size_t i = 0; i < sizeof(others) / sizeof(others[0]); ++i) {
+    fn.len = 0;
+    fio_string_printf(&fn, NULL, "%s/%s", dir, others[i]);
+    unlink(fn.buf);
+  }
+  FIO_ASSERT(!rmdir(dir), "couldn't remove the temporary test folder");
+}
+#else
+FIO_SFUNC void FIO_NAME_TEST(stl, http_static_cache)(void) {}
+#endif /* FIO_HTTP_STATIC_CACHE_LIMIT */
+
+/* *****************************************************************************
+Router Tests
+***************************************************************************** */
+#if defined(H___FIO_HTTP___H)
+FIO_SFUNC void fio___test_http_route_a(fio_http_s *h) { (void)h; }
+FIO_SFUNC void fio___test_http_route_b(fio_http_s *h) { (void)h; }
+FIO_SFUNC void fio___test_http_route_c(fio_http_s *h) { (void)h; }
+FIO_SFUNC void fio___test_http_route_d(fio_http_s *h) { (void)h; }
+FIO_SFUNC void fio___test_http_route_e(fio_http_s *h) { (void)h; }
+
+FIO_SFUNC void FIO_NAME_TEST(stl, http_router)(void) {
+  fprintf(stderr, "* Testing HTTP router (fio_http_router_s).\n");
+  fio_http_router_s *r = fio_http_router_new();
+  fio_http_s *h = fio_http_new();
+  FIO_ASSERT(!fio_http_route(r, "GET", "/", .on_http = fio___test_http_route_a),
+             "route / should be valid");
+  FIO_ASSERT(!fio_http_route(r,
+                             "GET",
+                             "/users/list",
+                             .on_http = fio___test_http_route_b),
+             "route /users/list should be valid");
+  FIO_ASSERT(!fio_http_route(r,
+                             "GET",
+                             "/users/:id",
+                             .on_http = fio___test_http_route_c),
+             "route /users/:id should be valid");
+  FIO_ASSERT(!fio_http_route(r,
+                             "GET",
+                             "/users/:id/posts/:post",
+                             .on_http = fio___test_http_route_d),
+             "route /users/:id/posts/:post should be valid");
+  FIO_ASSERT(!fio_http_route(r,
+                             NULL,
+                             "/users/:id/*rest",
+                             .on_http = fio___test_http_route_e,
+                             .max_body_size = 10),
+             "route /users/:id/*rest should be valid");
+  FIO_ASSERT(!fio_http_route(r,
+                             "POST",
+                             "/users/lisp",
+                             .on_http = fio___test_http_route_a),
+             "route /users/lisp should be valid (splits an edge)");
+  FIO_ASSERT(fio_http_route(r,
+                            "GET",
+                            "/users/:name/x",
+                            .on_http = fio___test_http_route_a),
+             "conflicting parameter names should fail");
+  FIO_ASSERT(fio_http_route(r,
+                            "GET",
+                            "/*a/b",
+                            .on_http = fio___test_http_route_a),
+             "wildcard segments must be last");
+  FIO_ASSERT(fio_http_route(r,
+                            "GET",
+                            "no/slash",
+                            .on_http = fio___test_http_route_a),
+             "patterns must start with a slash");
+  struct {
+    const char *method;
+    const char *path;
+    void (*expected)(fio_http_s *);
+    const char *name;
+    const char *value;
+  } tests[] = {
+      {"GET", "/", fio___test_http_route_a, NULL, NULL},
+      {"GET", "/users/list", fio___test_http_route_b, NULL, NULL},
+      {"POST", "/users/lisp", fio___test_http_route_a, NULL, NULL},
+      {"GET", "/users/lisp", fio___test_http_route_c, "id", "lisp"},
+      {"GET", "/users/42", fio___test_http_route_c, "id", "42"},
+      {"GET", "/users/42/posts/7", fio___test_http_route_d, "post", "7"},
+      {"GET", "/users/42/posts", fio___test_http_route_e, "rest", "posts"},
+      {"PUT", "/users/42/posts/7", fio___test_http_route_e, "rest", "posts/7"},
+      {"GET", "/users/42/", fio___test_http_route_e, "rest", ""},
+      {"POST", "/users/list", NULL, NULL, NULL},
+      {"GET", "/users/", NULL, NULL, NULL},
+      {"GET", "/nothing", NULL, NULL, NULL},
+      {NULL},
+  };
+  for (size_t i = 0; tests[i].method; ++i) {
+    fio_http_reset(h);
+    fio_http_method_set(h, FIO_STR_INFO1((char *)tests[i].method));
+    fio_http_path_set(h, FIO_STR_INFO1((char *)tests[i].path));
+    fio_http_route_s *route = fio_http_router_match(r, h);
+    FIO_ASSERT((route ? route->on_http : NULL) == tests[i].expected,
+               "HTTP router match error for %s %s",
+               tests[i].method,
+               tests[i].path);
+    if (!tests[i].name)
+      continue;
+    fio_str_info_s v =
+        fio_http_param(h, FIO_STR_INFO1((char *)tests[i].name));
+    FIO_ASSERT(v.buf && v.len == FIO_STRLEN(tests[i].value) &&
+                   !FIO_MEMCMP(v.buf, tests[i].value, v.len),
+               "HTTP router param error for %s %s (%s => %.*s)",
+               tests[i].method,
+               tests[i].path,
+               tests[i].name,
+               (int)v.len,
+               v.buf);
+  }
+  fio_http_reset(h);
+  fio_http_method_set(h, FIO_STR_INFO1((char *)"GET"));
+  fio_http_path_set(h, FIO_STR_INFO1((char *)"/users/42/posts/7"));
+  FIO_ASSERT(fio_http_router_match(r, h)->max_body_size == 0,
+             "HTTP router route settings error");
+  FIO_ASSERT(fio_http_param_each(h, NULL, NULL) == 2,
+             "HTTP router should capture 2 params");
+  FIO_ASSERT(fio_http_param(h, FIO_STR_INFO1((char *)"id")).len == 2,
+             "HTTP router param id error");
+  fio_http_free(h);
+  fio_http_router_free(r);
+}
+#else
+FIO_SFUNC void FIO_NAME_TEST(stl, http_router)(void) {}
+#endif /* H___FIO_HTTP___H */
+
 /* *****************************************************************************
 Cleanup
 ***************************************************************************** */
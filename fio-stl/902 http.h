@@ -0,0 +1,1601 @@
+/* ************************************************************************* */
+#if !defined(FIO_INCLUDE_FILE) /* Dev test - ignore line */
+#define FIO___DEV___           /* Development inclusion - ignore line */
+#define FIO_TEST_ALL           /* Development inclusion - ignore line */
+#include "./include.h"         /* Development inclusion - ignore line */
+#endif                         /* Development inclusion - ignore line */
+/* *****************************************************************************
+
+
+
+
+                        FIO_HTTP Test Helper
+
+
+
+
+Copyright and License: see header file (000 copyright.h) or top of file
+***************************************************************************** */
+#if defined(FIO_TEST_ALL) && !defined(FIO___TEST_REINCLUDE) &&                 \
+    !defined(H___FIO_HTTP_TEST___H)
+#define H___FIO_HTTP_TEST___H
+#if defined(H___FIO_HTTP___H)
+
+/* *****************************************************************************
+Mock WebSocket Connections (data is fed directly, without an IO object)
+***************************************************************************** */
+
+/* collects the messages received by a mock WebSocket connection */
+static struct {
+  char *msg;    /* the message data (all messages, concatenated) */
+  size_t count; /* the number of messages received */
+  size_t text;  /* the number of text messages received */
+} fio___test_ws;
+
+FIO_SFUNC void fio___test_ws_reset(void) {
+  fio_bstr_free(fio___test_ws.msg);
+  fio___test_ws.msg = NULL;
+  fio___test_ws.count = 0;
+  fio___test_ws.text = 0;
+}
+
+FIO_SFUNC void fio___test_ws_on_message(fio_http_s *h,
+                                        fio_buf_info_s msg,
+                                        uint8_t is_text) {
+  fio___test_ws.msg = fio_bstr_write(fio___test_ws.msg, msg.buf, msg.len);
+  ++fio___test_ws.count;
+  fio___test_ws.text += is_text;
+  (void)h;
+}
+
+FIO_SFUNC void fio___test_ws_on_partial(fio_http_s *h,
+                                        fio_buf_info_s chunk,
+                                        uint8_t is_text,
+                                        uint8_t is_first,
+                                        uint8_t is_last) {
+  fio___test_ws.msg = fio_bstr_write(fio___test_ws.msg, chunk.buf, chunk.len);
+  fio___test_ws.count += is_last;
+  fio___test_ws.text += (is_text & is_first);
+  (void)h;
+}
+
+/* creates a server side connection, as if upgraded to WebSockets */
+FIO_SFUNC fio___http_connection_s *fio___test_ws_new(fio_http_settings_s s) {
+  fio___http_protocol_s *p = fio___http_protocol_new(0);
+  fio___http_connection_s *c = fio___http_connection_new();
+  FIO_ASSERT_ALLOC(p && c);
+  FIO_MEMSET(p, 0, sizeof(*p));
+  if (!s.on_message)
+    s.on_message = fio___test_ws_on_message;
+  http_settings_validate(&s, 0);
+  p->settings = s;
+  p->queue = fio_srv_queue();
+  *c = (fio___http_connection_s){
+      .settings = &p->settings,
+      .queue = p->queue,
+      .h = fio_http_new(),
+      .capa = p->settings.max_line_len,
+  };
+  c->state.ws = (struct fio___http_connection_ws_s){
+      .on_message = c->settings->on_message,
+      .parser.stream = !!c->settings->on_message_partial,
+  };
+  return c;
+}
+
+FIO_SFUNC void fio___test_ws_free(fio___http_connection_s *c) {
+  c->len = 0;
+  fio___http_buffer_release(c);
+  fio_bstr_free(c->state.ws.msg);
+#if HAVE_ZLIB
+  fio___websocket_deflate_destroy(c);
+#endif
+  fio_http_free(c->h);
+  fio___http_connection_free(c);
+}
+
+/* feeds data to the connection, returns -1 on a protocol error */
+FIO_SFUNC int fio___test_ws_feed(fio___http_connection_s *c,
+                                 const char *data,
+                                 size_t len) {
+  fio___http_buffer_pool_s *pool =
+      &FIO_PTR_FROM_FIELD(fio___http_protocol_s, settings, c->settings)
+           ->buffers;
+  int r;
+  FIO_ASSERT(c->len + len <= c->capa, "mock WebSocket data too long");
+  FIO_MEMCPY(fio___http_buffer(c) + c->len, data, len);
+  FIO_ASSERT(c->buf && !pool->count, "read buffer should be borrowed");
+  c->len += (uint32_t)len;
+  r = fio___websocket_process_data(NULL, c);
+  FIO_ASSERT(c->len ? (c->buf && !pool->count) : (!c->buf && pool->count == 1),
+             "idle connections should return the read buffer (%u bytes left)",
+             (unsigned)c->len);
+  return r;
+}
+
+FIO_SFUNC void FIO_NAME_TEST(stl, http_buffer_pool)(void) {
+  fprintf(stderr, "* Testing HTTP read buffer pool.\n");
+  enum { FIO___TEST_BUF_COUNT = FIO_HTTP_READ_BUFFER_POOL_LIMIT + 8 };
+  fio___http_buffer_pool_s pool = {0};
+  char *buffers[FIO___TEST_BUF_COUNT];
+  for (size_t i = 0; i < FIO___TEST_BUF_COUNT; ++i)
+    buffers[i] = fio___http_buffer_pool_pop(&pool, 128);
+  for (size_t i = 0; i < FIO___TEST_BUF_COUNT; ++i) {
+    fio___http_buffer_pool_push(&pool, buffers[i], 128);
+    FIO_ASSERT(pool.count == (i < FIO_HTTP_READ_BUFFER_POOL_LIMIT
+                                  ? i + 1
+                                  : FIO_HTTP_READ_BUFFER_POOL_LIMIT),
+               "read buffer pool should keep at most %zu idle buffers (%u)",
+               (size_t)FIO_HTTP_READ_BUFFER_POOL_LIMIT,
+               (unsigned)pool.count);
+  }
+  /* idle buffers are reused (most recently returned first) */
+  for (size_t i = FIO_HTTP_READ_BUFFER_POOL_LIMIT; i--;) {
+    char *b = fio___http_buffer_pool_pop(&pool, 128);
+    FIO_ASSERT(b == buffers[i] && pool.count == i,
+               "read buffer pool should reuse idle buffers (%zu)",
+               i);
+  }
+  FIO_ASSERT(!pool.count && !pool.head, "read buffer pool should be empty");
+  for (size_t i = 0; i < FIO_HTTP_READ_BUFFER_POOL_LIMIT; ++i)
+    fio___http_buffer_pool_push(&pool, buffers[i], 128);
+  fio___http_buffer_pool_destroy(&pool, 128);
+  FIO_ASSERT(!pool.count && !pool.head, "read buffer pool destroy error");
+}
+
+/* *****************************************************************************
+WebSocket permessage-deflate (RFC 7692)
+***************************************************************************** */
+#if HAVE_ZLIB
+
+/* compresses and frames a (masked) client message, returns the frame length */
+FIO_SFUNC size_t fio___test_ws_deflate_frame(char *dest,
+                                             z_stream *z,
+                                             const char *msg,
+                                             size_t len,
+                                             uint8_t opcode) {
+  char tmp[4096];
+  z->next_in = (Bytef *)msg;
+  z->avail_in = (uInt)len;
+  z->next_out = (Bytef *)tmp;
+  z->avail_out = (uInt)sizeof(tmp);
+  FIO_ASSERT(deflate(z, Z_SYNC_FLUSH) == Z_OK && z->avail_out,
+             "test message deflate error");
+  /* remove the trailing 0x00 0x00 0xFF 0xFF (RFC 7692, section 7.2.1) */
+  len = sizeof(tmp) - z->avail_out - 4;
+  return (size_t)fio_websocket_client_wrap(dest, tmp, len, opcode, 1, 1, 4);
+}
+
+FIO_SFUNC void FIO_NAME_TEST(stl, http_websocket_deflate)(void) {
+  fprintf(stderr, "* Testing WebSocket permessage-deflate.\n");
+  { /* offer / response negotiation */
+    struct {
+      const char *offer;
+      const char *response; /* NULL == declined */
+      uint8_t no_context_takeover;
+      uint8_t in_reset;
+      uint8_t out_reset;
+      uint8_t bits;
+    } tests[] = {
+        {"permessage-deflate", "permessage-deflate", 0, 0, 0, 13},
+        {"permessage-deflate; server_no_context_takeover",
+         "permessage-deflate; server_no_context_takeover",
+         0,
+         0,
+         1,
+         13},
+        {"permessage-deflate; client_no_context_takeover",
+         "permessage-deflate; client_no_context_takeover",
+         0,
+         1,
+         0,
+         13},
+        {"permessage-deflate",
+         "permessage-deflate; server_no_context_takeover; "
+         "client_no_context_takeover",
+         1,
+         1,
+         1,
+         13},
+        {"permessage-deflate; server_max_window_bits=10",
+         "permessage-deflate; server_max_window_bits=10",
+         0,
+         0,
+         0,
+         10},
+        {"permessage-deflate; server_max_window_bits=15",
+         "permessage-deflate; server_max_window_bits=13",
+         0,
+         0,
+         0,
+         13},
+        {"permessage-deflate; client_max_window_bits",
+         "permessage-deflate",
+         0,
+         0,
+         0,
+         13},
+        {"permessage-deflate; client_max_window_bits=9",
+         "permessage-deflate",
+         0,
+         0,
+         0,
+         13},
+        {"permessage-deflate; server_max_window_bits=8", NULL, 0, 0, 0, 0},
+        {"permessage-deflate; server_max_window_bits", NULL, 0, 0, 0, 0},
+        {"permessage-deflate; client_max_window_bits=16", NULL, 0, 0, 0, 0},
+        {"permessage-deflate; unknown_parameter", NULL, 0, 0, 0, 0},
+        {"x-webkit-deflate-frame", NULL, 0, 0, 0, 0},
+        {"permessage-deflate; server_max_window_bits=8, permessage-deflate",
+         "permessage-deflate",
+         0,
+         0,
+         0,
+         13},
+    };
+    for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i) {
+      fio___http_connection_s *c =
+          fio___test_ws_new((fio_http_settings_s){
+              .ws_compress_min = 1,
+              .ws_no_context_takeover = tests[i].no_context_takeover});
+      fio_str_info_s r;
+      fio_http_request_header_set(
+          c->h,
+          FIO_STR_INFO1((char *)"sec-websocket-extensions"),
+          FIO_STR_INFO1((char *)tests[i].offer));
+      fio___websocket_deflate_negotiate(c->h, c);
+      r = fio_http_response_header(
+          c->h,
+          FIO_STR_INFO1((char *)"sec-websocket-extensions"),
+          0);
+      FIO_ASSERT(tests[i].response
+                     ? FIO_STR_INFO_IS_EQ(
+                           r,
+                           FIO_STR_INFO1((char *)tests[i].response))
+                     : !r.len,
+                 "permessage-deflate negotiation error for:\n\t%s\n\t%s",
+                 tests[i].offer,
+                 (r.len ? r.buf : "(declined)"));
+      fio___websocket_deflate_setup(c);
+      FIO_ASSERT(c->state.ws.deflate.on == !!tests[i].response &&
+                     c->state.ws.deflate.in_reset == tests[i].in_reset &&
+                     c->state.ws.deflate.out_reset == tests[i].out_reset &&
+                     c->state.ws.deflate.bits == tests[i].bits,
+                 "permessage-deflate setup error for:\n\t%s",
+                 tests[i].offer);
+      fio___test_ws_free(c);
+    }
+    { /* compression is opt-in */
+      fio___http_connection_s *c =
+          fio___test_ws_new((fio_http_settings_s){0});
+      fio_http_request_header_set(
+          c->h,
+          FIO_STR_INFO1((char *)"sec-websocket-extensions"),
+          FIO_STR_INFO1((char *)"permessage-deflate"));
+      fio___websocket_deflate_negotiate(c->h, c);
+      FIO_ASSERT(!fio_http_response_header(
+                      c->h,
+                      FIO_STR_INFO1((char *)"sec-websocket-extensions"),
+                      0)
+                      .len,
+                 "permessage-deflate should be declined unless enabled");
+      fio___test_ws_free(c);
+    }
+  }
+  { /* compressed messages round-trip through the parser */
+    char msg[2048];
+    char frame[4096];
+    for (size_t i = 0; i < sizeof(msg); ++i)
+      msg[i] = "permessage-deflate test message\n"[i & 31];
+    for (size_t reset = 0; reset < 2; ++reset) {
+      for (size_t stream = 0; stream < 2; ++stream) {
+        fio___http_connection_s *c = fio___test_ws_new((fio_http_settings_s){
+            .ws_compress_min = 1,
+            .ws_no_context_takeover = (uint8_t)reset,
+            .on_message_partial =
+                (stream ? fio___test_ws_on_partial : NULL),
+        });
+        z_stream z = {0};
+        FIO_ASSERT(deflateInit2(&z,
+                                Z_DEFAULT_COMPRESSION,
+                                Z_DEFLATED,
+                                -15,
+                                8,
+                                Z_DEFAULT_STRATEGY) == Z_OK,
+                   "deflateInit2 failed");
+        fio_http_request_header_set(
+            c->h,
+            FIO_STR_INFO1((char *)"sec-websocket-extensions"),
+            FIO_STR_INFO1((char *)"permessage-deflate"));
+        fio___websocket_deflate_negotiate(c->h, c);
+        fio___websocket_deflate_setup(c);
+        fio___test_ws_reset();
+        for (size_t round = 0; round < 3; ++round) {
+          /* messages reuse the compression context, unless reset */
+          size_t len = fio___test_ws_deflate_frame(frame,
+                                                   &z,
+                                                   msg,
+                                                   sizeof(msg),
+                                                   (round & 1) + 1);
+          FIO_ASSERT(len < sizeof(msg), "test message should be compressed");
+          FIO_ASSERT(!fio___test_ws_feed(c, frame, len),
+                     "compressed WebSocket message rejected (round %zu)",
+                     round);
+          if (reset)
+            deflateReset(&z);
+        }
+        FIO_ASSERT(fio___test_ws.count == 3 && fio___test_ws.text == 2 &&
+                       fio_bstr_len(fio___test_ws.msg) == sizeof(msg) * 3,
+                   "compressed WebSocket messages missing (%zu, %zu bytes)",
+                   fio___test_ws.count,
+                   fio_bstr_len(fio___test_ws.msg));
+        for (size_t i = 0; i < 3; ++i)
+          FIO_ASSERT(!FIO_MEMCMP(fio___test_ws.msg + (i * sizeof(msg)),
+                                 msg,
+                                 sizeof(msg)),
+                     "compressed WebSocket message corrupted");
+        FIO_ASSERT(!reset || !c->state.ws.deflate.in,
+                   "client_no_context_takeover should release the inflater");
+        deflateEnd(&z);
+        fio___test_ws_free(c);
+      }
+    }
+  }
+  { /* inflated messages are limited by `ws_max_msg_size` */
+    char msg[4096];
+    char frame[4096];
+    size_t len;
+    fio___http_connection_s *c =
+        fio___test_ws_new((fio_http_settings_s){.ws_compress_min = 1,
+                                                .ws_max_msg_size = 1024});
+    z_stream z = {0};
+    FIO_MEMSET(msg, 'a', sizeof(msg));
+    FIO_ASSERT(
+        deflateInit2(&z, Z_BEST_COMPRESSION, Z_DEFLATED, -15, 8, 0) == Z_OK,
+        "deflateInit2 failed");
+    fio_http_request_header_set(
+        c->h,
+        FIO_STR_INFO1((char *)"sec-websocket-extensions"),
+        FIO_STR_INFO1((char *)"permessage-deflate"));
+    fio___websocket_deflate_negotiate(c->h, c);
+    fio___websocket_deflate_setup(c);
+    fio___test_ws_reset();
+    len = fio___test_ws_deflate_frame(frame, &z, msg, 1000, 2);
+    FIO_ASSERT(!fio___test_ws_feed(c, frame, len) && fio___test_ws.count == 1,
+               "compressed messages within the limit should be accepted");
+    len = fio___test_ws_deflate_frame(frame, &z, msg, sizeof(msg), 2);
+    FIO_ASSERT(len < 1024, "test message should be compressed below limit");
+    { /* the protocol error attempts to send a close frame to a NULL IO */
+      int old_level = FIO_LOG_LEVEL_GET();
+      FIO_LOG_LEVEL_SET(FIO_LOG_LEVEL_FATAL);
+      FIO_ASSERT(
+          fio___test_ws_feed(c, frame, len) && fio___test_ws.count == 1,
+          "messages exceeding ws_max_msg_size once inflated should fail");
+      FIO_LOG_LEVEL_SET(old_level);
+    }
+    deflateEnd(&z);
+    fio___test_ws_free(c);
+    fio___test_ws_reset();
+  }
+}
+#else
+FIO_SFUNC void FIO_NAME_TEST(stl, http_websocket_deflate)(void) {}
+#endif /* HAVE_ZLIB */
+
+/* *****************************************************************************
+WebSocket Parsing (split frames, streaming and UTF-8 validation)
+***************************************************************************** */
+
+/* frames a (masked) client message as `frames` fragments, returns the length */
+FIO_SFUNC size_t fio___test_ws_frames(char *dest,
+                                      const char *msg,
+                                      size_t len,
+                                      size_t frames,
+                                      uint8_t opcode) {
+  size_t r = 0;
+  for (size_t i = 0; i < frames; ++i) {
+    const size_t start = (len * i) / frames;
+    const size_t end = (len * (i + 1)) / frames;
+    r += (size_t)fio_websocket_client_wrap(dest + r,
+                                           msg + start,
+                                           end - start,
+                                           opcode,
+                                           !i,
+                                           (i + 1 == frames),
+                                           0);
+  }
+  return r;
+}
+
+/* feeds data in two chunks (split at `at`), returns -1 on a protocol error */
+FIO_SFUNC int fio___test_ws_feed_split(fio___http_connection_s *c,
+                                       const char *data,
+                                       size_t len,
+                                       size_t at) {
+  int r = fio___test_ws_feed(c, data, at);
+  if (!r && at < len)
+    r = fio___test_ws_feed(c, data + at, len - at);
+  return r;
+}
+
+/* tests that a fed message was received once, as `msg` */
+#define FIO___TEST_WS_RECEIVED(msg, len, ...)                                  \
+  FIO_ASSERT(fio___test_ws.count == 1 && fio___test_ws.text == 1 &&            \
+                 fio_bstr_len(fio___test_ws.msg) == (len) &&                   \
+                 !FIO_MEMCMP(fio___test_ws.msg, (msg), (len)),                 \
+             __VA_ARGS__)
+
+FIO_SFUNC void FIO_NAME_TEST(stl, http_websocket_parser)(void) {
+  fprintf(stderr, "* Testing WebSocket parsing (split frames, UTF-8).\n");
+  /* ASCII and 2, 3 and 4 byte code points, split by fragments and chunks */
+  static const char msg[] = "WebSocket: \xC3\xA9t\xC3\xA9 \xE2\x82\xAC" "5 "
+                            "\xF0\x9F\x98\x80 - text, split everywhere.";
+  const size_t len = sizeof(msg) - 1;
+  char frame[512];
+  for (size_t stream = 0; stream < 2; ++stream) {
+    fio___http_connection_s *c = fio___test_ws_new((fio_http_settings_s){
+        .on_message_partial = (stream ? fio___test_ws_on_partial : NULL),
+    });
+    for (size_t frames = 1; frames < 4; ++frames) {
+      /* frames may split a code point, chunks split at every mask offset */
+      size_t flen = fio___test_ws_frames(frame, msg, len, frames, 1);
+      for (size_t at = 0; at <= flen; ++at) {
+        fio___test_ws_reset();
+        FIO_ASSERT(!fio___test_ws_feed_split(c, frame, flen, at),
+                   "split WebSocket message rejected (stream %zu, frames "
+                   "%zu, split at %zu)",
+                   stream,
+                   frames,
+                   at);
+        FIO___TEST_WS_RECEIVED(msg,
+                               len,
+                               "split WebSocket message error (stream %zu, "
+                               "frames %zu, split at %zu)",
+                               stream,
+                               frames,
+                               at);
+      }
+      fio___test_ws_reset();
+      for (size_t i = 0; i < flen; ++i) /* a byte at a time */
+        FIO_ASSERT(!fio___test_ws_feed(c, frame + i, 1),
+                   "WebSocket message fed a byte at a time rejected");
+      FIO___TEST_WS_RECEIVED(msg,
+                             len,
+                             "WebSocket message fed a byte at a time error");
+    }
+    { /* many messages in a single feed are all delivered */
+      size_t flen = fio___test_ws_frames(frame, msg, len, 1, 1);
+      flen += fio___test_ws_frames(frame + flen, msg, len, 2, 2);
+      flen += fio___test_ws_frames(frame + flen, msg, len, 3, 1);
+      fio___test_ws_reset();
+      FIO_ASSERT(!fio___test_ws_feed(c, frame, flen) &&
+                     fio___test_ws.count == 3 && fio___test_ws.text == 2 &&
+                     fio_bstr_len(fio___test_ws.msg) == len * 3,
+                 "WebSocket messages in a single feed missing (stream %zu, "
+                 "%zu messages)",
+                 stream,
+                 fio___test_ws.count);
+    }
+    fio___test_ws_free(c);
+  }
+  { /* invalid or truncated UTF-8 text fails when streamed */
+    struct {
+      const char *msg;
+      size_t frames;
+      size_t at; /* the second chunk (0 == fed at once) */
+    } tests[] = {
+        {"abc\xC3\x28" "def", 1, 0},         /* an invalid continuation */
+        {"abc\x80" "def", 1, 0},              /* a lone continuation byte */
+        {"abc\xFF\xBF\xBF\xBF" "def", 1, 0}, /* an invalid lead byte */
+        {"abc\xE2\x82", 1, 0},               /* truncated (end of message) */
+        {"abc\xE2\x82", 2, 0},               /* truncated, fragmented */
+        {"abc\xE2\x82", 1, 10},              /* truncated, split chunks */
+        {"abc\xE2\x28\xA1" "def", 2, 0},     /* invalid, split fragments */
+        {"abc\xE2\x28\xA1" "def", 1, 10},    /* invalid, split chunks */
+    };
+    int old_level = FIO_LOG_LEVEL_GET();
+    FIO_LOG_LEVEL_SET(FIO_LOG_LEVEL_FATAL); /* the close frame has no IO */
+    for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i) {
+      fio___http_connection_s *c = fio___test_ws_new((fio_http_settings_s){
+          .on_message_partial = fio___test_ws_on_partial,
+      });
+      size_t flen = fio___test_ws_frames(frame,
+                                         tests[i].msg,
+                                         FIO_STRLEN(tests[i].msg),
+                                         tests[i].frames,
+                                         1);
+      fio___test_ws_reset();
+      FIO_ASSERT(fio___test_ws_feed_split(c,
+                                          frame,
+                                          flen,
+                                          (tests[i].at ? tests[i].at : flen)) &&
+                     !fio___test_ws.count,
+                 "invalid UTF-8 should fail a streamed message (%zu)",
+                 i);
+      fio___test_ws_free(c);
+    }
+    FIO_LOG_LEVEL_SET(old_level);
+    fio___test_ws_reset();
+  }
+}
+#undef FIO___TEST_WS_RECEIVED
+
+/* *****************************************************************************
+WebSocket Tests
+***************************************************************************** */
+
+FIO_SFUNC void FIO_NAME_TEST(stl, http_websocket)(void) {
+  FIO_NAME_TEST(stl, http_buffer_pool)();
+  FIO_NAME_TEST(stl, http_websocket_parser)();
+  FIO_NAME_TEST(stl, http_websocket_deflate)();
+}
+
+/* *****************************************************************************
+Mock HTTP Client Connections (responses are fed directly, without an IO object)
+***************************************************************************** */
+
+/* collects the responses received by the HTTP client */
+static struct {
+  void *listener;    /* the test server's listener */
+  char *body;        /* the response bodies (all responses, concatenated) */
+  size_t count;      /* the number of responses received */
+  size_t status[8];  /* the response status codes, in order */
+  size_t accepted;   /* connections accepted by the test server */
+  size_t limit;      /* requests served per connection before it's closed */
+} fio___test_client;
+
+FIO_SFUNC void fio___test_client_reset(void) {
+  fio_bstr_free(fio___test_client.body);
+  FIO_MEMSET(&fio___test_client, 0, sizeof(fio___test_client));
+}
+
+FIO_SFUNC void fio___test_client_on_response(fio_http_s *h) {
+  fio_str_info_s body = fio_http_body_read(h, (size_t)-1);
+  fio___test_client.body =
+      fio_bstr_write(fio___test_client.body, body.buf, body.len);
+  if (fio___test_client.count < 8)
+    fio___test_client.status[fio___test_client.count] = fio_http_status(h);
+  ++fio___test_client.count;
+}
+
+/* creates a client connection (and pool), as if connected to a server */
+FIO_SFUNC fio___http_connection_s *fio___test_client_new(void) {
+  fio___http_client_req_s r = {
+      .key = fio_bstr_write(NULL, "http://127.0.0.1:9", 18)};
+  fio___http_client_pool_s *pool = fio___http_client_pool_create(&r);
+  fio___http_protocol_s *p = pool->protocol;
+  fio___http_connection_s *c = fio___http_connection_new();
+  FIO_ASSERT_ALLOC(c);
+  fio___http_protocol_dup(p);
+  *c = (fio___http_connection_s){
+      .settings = &p->settings,
+      .queue = p->queue,
+      .state.http = {.max_header = p->settings.max_header_size,
+                     .client.pool = pool}, /* the pool's only reference */
+      .capa = p->settings.max_line_len,
+      .is_client = 1,
+  };
+  FIO_LIST_PUSH(&pool->connections, &c->state.http.client.node);
+  ++pool->count;
+  return c;
+}
+
+/* adds a request that waits for a response */
+FIO_SFUNC void fio___test_client_send(fio___http_connection_s *c,
+                                      uint8_t is_head) {
+  fio___http_client_req_s *r = fio___http_client_req_new();
+  *r = (fio___http_client_req_s){
+      .args.on_response = fio___test_client_on_response,
+      .is_head = is_head,
+  };
+  fio___http_client_fifo_push(&c->state.http.client.sent, r);
+  ++c->state.http.client.in_flight;
+}
+
+/* feeds response data, returns -1 if the response was rejected */
+FIO_SFUNC int fio___test_client_feed(fio___http_connection_s *c,
+                                     const char *data) {
+  size_t len = FIO_STRLEN(data);
+  FIO_ASSERT(c->len + len <= c->capa, "mock response data too long");
+  FIO_MEMCPY(fio___http_buffer(c) + c->len, data, len);
+  c->len += (uint32_t)len;
+  fio___http1_process_data(NULL, c);
+  fio_queue_perform_all(fio_srv_queue());
+  return 0 - (c->state.http.client.closing == 2);
+}
+
+/* closes the connection (failing requests without a response) */
+FIO_SFUNC void fio___test_client_close(fio___http_connection_s *c) {
+  c->len = 0;
+  fio___http_buffer_release(c);
+  fio___http_client_on_close(c);
+  fio_queue_perform_all(fio_srv_queue());
+}
+
+/* *****************************************************************************
+HTTP Client - Response Parsing
+***************************************************************************** */
+
+FIO_SFUNC void FIO_NAME_TEST(stl, http_client_response)(void) {
+  fprintf(stderr, "* Testing HTTP client response parsing.\n");
+  struct {
+    const char *response[2]; /* the second is fed after the first */
+    const char *body;
+    size_t status[2];
+    uint8_t requests;
+    uint8_t is_head;
+    uint8_t error;
+  } tests[] = {
+      {{"HTTP/1.1 200 OK\r\ncontent-length: 5\r\n\r\nHello", NULL},
+       "Hello",
+       {200},
+       1},
+      {{"HTTP/1.1 204 No Content\r\n\r\n", NULL}, "", {204}, 1},
+      {{"HTTP/1.1 204\r\n\r\n", NULL}, "", {204}, 1},
+      {{"HTTP/1.1 304 \r\n\r\n", NULL}, "", {304}, 1},
+      {{"HTTP/1.1 100 Continue\r\n\r\n",
+        "HTTP/1.1 201 Created\r\ncontent-length: 2\r\n\r\nOK"},
+       "OK",
+       {201},
+       1},
+      {{"HTTP/1.1 200 OK\r\ncontent-length: 9\r\n\r\n"
+        "HTTP/1.1 404 Not Found\r\ncontent-length: 1\r\n\r\nX",
+        NULL},
+       "X",
+       {200, 404},
+       2,
+       1},
+      {{"HTTP/1.1 200 OK\r\ntransfer-encoding: chunked\r\n\r\n3\r\nabc\r\n",
+        "2\r\nde\r\n0\r\n\r\n"},
+       "abcde",
+       {200},
+       1},
+      {{"HTTP/1.1 200 OK\r\ncontent-length: 3\r\n\r\nab", "c"},
+       "abc",
+       {200},
+       1},
+      {{"HTTP/1.1 200 OK\r\ncontent-length: 1\r\n\r\n1"
+        "HTTP/1.1 200 OK\r\ncontent-length: 1\r\n\r\n2",
+        NULL},
+       "12",
+       {200, 200},
+       2},
+      /* bodies without a length end when the connection closes */
+      {{"HTTP/1.0 200 OK\r\n\r\nuntil ", "closed"},
+       "until closed",
+       {200},
+       1},
+      {{"HTTP/1.1 200 OK\r\nconnection: close\r\n\r\n", NULL},
+       "",
+       {200},
+       1},
+      /* invalid response lines fail the request (status 0) */
+      {{"HTTP/1.1 20 OK\r\n\r\n", NULL}, "", {0}, 1, 0, 1},
+      {{"HTTP/1.1 2000 OK\r\n\r\n", NULL}, "", {0}, 1, 0, 1},
+      {{"HTTP/1.1 200OK\r\n\r\n", NULL}, "", {0}, 1, 0, 1},
+      {{"HTTP/1.1 099 Low\r\n\r\n", NULL}, "", {0}, 1, 0, 1},
+      {{"HTTP/1.1 abc OK\r\n\r\n", NULL}, "", {0}, 1, 0, 1},
+      {{"HTTP/1.1\r\n\r\n", NULL}, "", {0}, 1, 0, 1},
+      {{"HTTP/1.1 200 OK\r\ncontent-length: 1\r\ncontent-length: 2\r\n\r\n",
+        NULL},
+       "",
+       {0},
+       1,
+       0,
+       1},
+  };
+  for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i) {
+    fio___http_connection_s *c = fio___test_client_new();
+    int r = 0;
+    fio___test_client_reset();
+    for (size_t j = 0; j < tests[i].requests; ++j)
+      fio___test_client_send(c, (uint8_t)(tests[i].is_head & !j));
+    for (size_t j = 0; j < 2 && tests[i].response[j] && !r; ++j)
+      r = fio___test_client_feed(c, tests[i].response[j]);
+    FIO_ASSERT(r == 0 - (int)tests[i].error,
+               "HTTP client response error state wrong for test %zu",
+               i);
+    fio___test_client_close(c);
+    FIO_ASSERT(fio___test_client.count == tests[i].requests,
+               "HTTP client response count error for test %zu (%zu)",
+               i,
+               fio___test_client.count);
+    for (size_t j = 0; j < tests[i].requests; ++j)
+      FIO_ASSERT(fio___test_client.status[j] == tests[i].status[j],
+                 "HTTP client response %zu status error for test %zu (%zu)",
+                 j,
+                 i,
+                 fio___test_client.status[j]);
+    FIO_ASSERT(fio_bstr_len(fio___test_client.body) ==
+                       FIO_STRLEN(tests[i].body) &&
+                   (!fio_bstr_len(fio___test_client.body) ||
+                    !FIO_MEMCMP(fio___test_client.body,
+                                tests[i].body,
+                                FIO_STRLEN(tests[i].body))),
+               "HTTP client response body error for test %zu",
+               i);
+  }
+  fio___test_client_reset();
+}
+
+/* *****************************************************************************
+HTTP Client - Pooled Connections (reuse, retry and failure, using a server)
+***************************************************************************** */
+
+/* a raw test server that closes a connection after `limit` requests */
+FIO_SFUNC void fio___test_client_srv_on_attach(fio_s *io) {
+  ++fio___test_client.accepted;
+  fio_udata_set(io, NULL);
+}
+
+FIO_SFUNC void fio___test_client_srv_on_data(fio_s *io) {
+  char buf[1024];
+  size_t len;
+  while ((len = fio_read(io, buf, sizeof(buf) - 1))) {
+    uintptr_t served = (uintptr_t)fio_udata_get(io);
+    buf[len] = 0;
+    for (char *pos = buf; (pos = strstr(pos, "\r\n\r\n")); pos += 4) {
+      if (served >= fio___test_client.limit) { /* a stale keep-alive */
+        fio_close_now(io);
+        return;
+      }
+      fio_udata_set(io, (void *)++served);
+      fio_write(io, "HTTP/1.1 200 OK\r\ncontent-length: 2\r\n\r\nOK", 40);
+    }
+  }
+}
+
+static fio_protocol_s FIO___TEST_CLIENT_SRV_PROTOCOL = {
+    .on_attach = fio___test_client_srv_on_attach,
+    .on_data = fio___test_client_srv_on_data,
+};
+
+#define FIO___TEST_CLIENT_URL "http://127.0.0.1:9438/"
+
+/* each response sends the next request */
+FIO_SFUNC void fio___test_client_pool_step(fio_http_s *h) {
+  if (h)
+    fio___test_client_on_response(h);
+  switch (fio___test_client.count) {
+  case 0: /* a new connection */
+  case 1: /* the same (idle) connection is reused */
+  case 3: /* the retried request's connection is reused */
+    fio_http_request(FIO___TEST_CLIENT_URL,
+                     .on_response = fio___test_client_pool_step);
+    return;
+  case 2: /* the idle connection is closed when used, the GET is retried */
+    fio___test_client.limit = 2;
+    fio_http_request(FIO___TEST_CLIENT_URL,
+                     .on_response = fio___test_client_pool_step);
+    return;
+  case 4: /* the connection is closed when used, a POST isn't retried */
+    fio_http_request(FIO___TEST_CLIENT_URL,
+                     .on_response = fio___test_client_pool_step,
+                     .body = FIO_STR_INFO2((char *)"x", 1));
+    return;
+  case 5: /* an unreachable host (resolved by a DNS thread) fails */
+    fio_http_request("http://localhost:1/",
+                     .on_response = fio___test_client_pool_step);
+    return;
+  }
+}
+
+FIO_SFUNC void fio___test_client_pool_start(fio_protocol_s *p, void *u) {
+  if (!fio___test_client.count)
+    fio___test_client_pool_step(NULL);
+  (void)p, (void)u;
+}
+
+/* listens while the server is running, so the listener can be stopped */
+FIO_SFUNC int fio___test_client_pool_listen(void *ignr1_, void *ignr2_) {
+  fio___test_client.listener =
+      fio_srv_listen(.url = "tcp://127.0.0.1:9438",
+                     .protocol = &FIO___TEST_CLIENT_SRV_PROTOCOL,
+                     .on_start = fio___test_client_pool_start,
+                     .hide_from_log = 1);
+  FIO_ASSERT(fio___test_client.listener, "HTTP client test couldn't listen");
+  return -1;
+  (void)ignr1_, (void)ignr2_;
+}
+
+FIO_SFUNC int fio___test_client_pool_watch(void *deadline_, void *ignr_) {
+  if (fio___test_client.count < 6 &&
+      fio_time_milli() < (int64_t)(uintptr_t)deadline_)
+    return 0;
+  fio_srv_listen_stop(fio___test_client.listener);
+  fio___test_client.listener = NULL;
+  fio_srv_stop();
+  return -1;
+  (void)ignr_;
+}
+
+FIO_SFUNC void FIO_NAME_TEST(stl, http_client_pool)(void) {
+  fprintf(stderr, "* Testing HTTP client connection pool.\n");
+  size_t expected[] = {200, 200, 200, 200, 0, 0};
+  size_t old_level = FIO_LOG_LEVEL_GET();
+  fio___test_client_reset();
+  fio___test_client.limit = (size_t)-1;
+  fio_srv_run_every(.fn = fio___test_client_pool_listen,
+                    .every = 1,
+                    .repetitions = 1);
+  fio_srv_run_every(.fn = fio___test_client_pool_watch,
+                    .udata1 = (void *)(uintptr_t)(fio_time_milli() + 5000),
+                    .every = 10,
+                    .repetitions = -1);
+  FIO_LOG_LEVEL_SET(FIO_LOG_LEVEL_FATAL); /* failed connections are logged */
+  fio_srv_start(0);
+  FIO_LOG_LEVEL_SET(old_level);
+  FIO_ASSERT(fio___test_client.count == 6,
+             "HTTP client pool test timed out (%zu responses)",
+             fio___test_client.count);
+  for (size_t i = 0; i < 6; ++i)
+    FIO_ASSERT(fio___test_client.status[i] == expected[i],
+               "HTTP client pool response %zu status error (%zu)",
+               i,
+               fio___test_client.status[i]);
+  FIO_ASSERT(fio___test_client.accepted == 2,
+             "HTTP client pool should reuse connections (%zu accepted)",
+             fio___test_client.accepted);
+  fio___test_client_reset();
+}
+#undef FIO___TEST_CLIENT_URL
+
+/** Tests the TLS settings used by the client (the SNI server name). */
+FIO_SFUNC void FIO_NAME_TEST(stl, http_client_tls)(void) {
+  fprintf(stderr, "* Testing HTTP client TLS settings (SNI).\n");
+  fio_tls_s *user = fio_tls_new();
+  fio_tls_s *t = fio___http_client_tls(NULL, FIO_BUF_INFO1("example.com"));
+  FIO_ASSERT(fio_tls_server_name(t) &&
+                 !strcmp(fio_tls_server_name(t), "example.com"),
+             "the host should be set as the server name (SNI)");
+  fio_tls_free(t);
+  t = fio___http_client_tls(NULL, FIO_BUF_INFO1("10.0.0.1"));
+  FIO_ASSERT(!fio_tls_server_name(t), "IP addresses aren't sent as SNI");
+  fio_tls_free(t);
+  t = fio___http_client_tls(NULL, FIO_BUF_INFO1("[::1]"));
+  FIO_ASSERT(!fio_tls_server_name(t), "IPv6 addresses aren't sent as SNI");
+  fio_tls_free(t);
+  fio_tls_alpn_add(user, "http/1.1", NULL);
+  fio_tls_trust_add(user, NULL);
+  t = fio___http_client_tls(user, FIO_BUF_INFO1("example.com"));
+  FIO_ASSERT(fio_tls_alpn_count(t) == 1 && !fio_tls_server_name(user),
+             "the user's TLS settings should be copied, not changed");
+  fio_tls_free(t);
+  fio_tls_server_name_set(user, "other.example.com");
+  t = fio___http_client_tls(user, FIO_BUF_INFO1("example.com"));
+  FIO_ASSERT(!strcmp(fio_tls_server_name(t), "other.example.com"),
+             "a server name set by the user should be kept");
+  fio_tls_free(t);
+  fio_tls_free(user);
+}
+
+FIO_SFUNC void FIO_NAME_TEST(stl, http_client)(void) {
+  FIO_NAME_TEST(stl, http_client_response)();
+  FIO_NAME_TEST(stl, http_client_tls)();
+  FIO_NAME_TEST(stl, http_client_pool)();
+}
+
+/* *****************************************************************************
+HTTP/1.1 Slow Clients (request deadlines and per IP connection limits)
+***************************************************************************** */
+
+/* the raw test clients ('a', 'b', 'c'), in the order they were closed */
+static struct {
+  void *listener; /* the HTTP listener, stopped once the test is done */
+  char closed[4]; /* the client names, in the order closed */
+  size_t count;   /* the number of clients closed */
+  size_t ok;      /* the number of responses received */
+} fio___test_slow;
+
+#define FIO___TEST_SLOW_URL "tcp://127.0.0.1:9439"
+
+FIO_SFUNC void fio___test_slow_on_http(fio_http_s *h) {
+  fio_http_write(h, .buf = "ok", .len = 2, .finish = 1);
+}
+
+/* clients 'a' and 'b' trickle a request, 'c' sends a complete request */
+FIO_SFUNC void fio___test_slow_on_attach(fio_s *io) {
+  if ((uintptr_t)fio_udata_get(io) == 'c')
+    fio_write(io, "GET / HTTP/1.1\r\nhost: c\r\n\r\n", 27);
+  else
+    fio_write(io, "GET / HTTP/1.1\r\nhost: ", 22);
+}
+
+FIO_SFUNC void fio___test_slow_on_data(fio_s *io) {
+  char buf[256];
+  size_t len;
+  while ((len = fio_read(io, buf, sizeof(buf)))) {
+    if (len > 12 && !FIO_MEMCMP(buf, "HTTP/1.1 200", 12)) {
+      ++fio___test_slow.ok;
+      fio_close(io);
+    }
+  }
+}
+
+FIO_SFUNC void fio___test_slow_on_close(void *udata);
+
+static fio_protocol_s FIO___TEST_SLOW_PROTOCOL = {
+    .on_attach = fio___test_slow_on_attach,
+    .on_data = fio___test_slow_on_data,
+    .on_close = fio___test_slow_on_close,
+};
+
+FIO_SFUNC int fio___test_slow_connect(void *name, void *ignr_) {
+  FIO_ASSERT(!fio_srv_connect(FIO___TEST_SLOW_URL,
+                              &FIO___TEST_SLOW_PROTOCOL,
+                              name,
+                              NULL),
+             "slow client test couldn't connect");
+  return 0;
+  (void)ignr_;
+}
+
+/* stops the listener while the server is running (avoids restarting it) */
+FIO_SFUNC void fio___test_slow_done(void) {
+  fio_srv_listen_stop(fio___test_slow.listener);
+  fio___test_slow.listener = NULL;
+  fio_srv_stop();
+}
+
+FIO_SFUNC void fio___test_slow_on_close(void *udata) {
+  if (fio___test_slow.count < 3)
+    fio___test_slow.closed[fio___test_slow.count] = (char)(uintptr_t)udata;
+  ++fio___test_slow.count;
+  if ((uintptr_t)udata == 'a') /* 'a' released its slot, 'c' can connect */
+    fio_srv_run_every(.fn = fio___test_slow_connect,
+                      .udata1 = (void *)(uintptr_t)'c',
+                      .every = 100,
+                      .repetitions = 1);
+  else if ((uintptr_t)udata == 'c')
+    fio___test_slow_done();
+}
+
+FIO_SFUNC int fio___test_slow_start(void *ignr1_, void *ignr2_) {
+  fio___test_slow.listener =
+      fio_http_listen("http://127.0.0.1:9439",
+                      .on_http = fio___test_slow_on_http,
+                      .header_timeout = 1,
+                      .max_clients_per_ip = 1);
+  FIO_ASSERT(fio___test_slow.listener, "slow client test couldn't listen");
+  fio___test_slow_connect((void *)(uintptr_t)'a', NULL);
+  fio___test_slow_connect((void *)(uintptr_t)'b', NULL);
+  return -1;
+  (void)ignr1_, (void)ignr2_;
+}
+
+FIO_SFUNC int fio___test_slow_watch(void *deadline_, void *ignr_) {
+  if (!fio___test_slow.listener)
+    return -1;
+  if (fio_time_milli() < (int64_t)(uintptr_t)deadline_)
+    return 0;
+  fio___test_slow_done();
+  return -1;
+  (void)ignr_;
+}
+
+FIO_SFUNC void FIO_NAME_TEST(stl, http_deadlines)(void) {
+  fprintf(stderr, "* Testing HTTP/1.1 request deadlines and IP limits.\n");
+  { /* the body rate window is renewed only while the client keeps up */
+    fio_http_settings_s s = {.min_body_rate = 16};
+    fio___http_connection_s c = {.settings = &s};
+    fio___http_deadline_set(&c,
+                            FIO___HTTP_DEADLINE_BODY,
+                            FIO_HTTP_BODY_RATE_WINDOW);
+    c.received += 16 * FIO_HTTP_BODY_RATE_WINDOW;
+    fio___http_deadline_expired(&c);
+    FIO_ASSERT(c.deadline_kind == FIO___HTTP_DEADLINE_BODY &&
+                   c.received_mark == c.received,
+               "the body rate window should be renewed at the minimal rate");
+    c.received += 16 * FIO_HTTP_BODY_RATE_WINDOW - 1;
+    fio___http_deadline_expired(&c);
+    FIO_ASSERT(c.deadline_kind == FIO___HTTP_DEADLINE_NONE,
+               "a slow body upload should reach its deadline");
+  }
+  { /* 'a' reaches the head deadline, 'b' exceeds the IP limit, 'c' is ok */
+    size_t old_level = FIO_LOG_LEVEL_GET();
+    FIO_MEMSET(&fio___test_slow, 0, sizeof(fio___test_slow));
+    fio_srv_run_every(.fn = fio___test_slow_start,
+                      .every = 1,
+                      .repetitions = 1);
+    fio_srv_run_every(.fn = fio___test_slow_watch,
+                      .udata1 = (void *)(uintptr_t)(fio_time_milli() + 6000),
+                      .every = 10,
+                      .repetitions = -1);
+    FIO_LOG_LEVEL_SET(FIO_LOG_LEVEL_FATAL);
+    fio_srv_start(0);
+    FIO_LOG_LEVEL_SET(old_level);
+    FIO_ASSERT(fio___test_slow.count == 3 &&
+                   !FIO_MEMCMP(fio___test_slow.closed, "bac", 3),
+               "slow client test close order error (%zu: %.3s)",
+               fio___test_slow.count,
+               fio___test_slow.closed);
+    FIO_ASSERT(fio___test_slow.ok == 1,
+               "the per IP connection count should be released on close");
+  }
+}
+#undef FIO___TEST_SLOW_URL
+
+/* *****************************************************************************
+HTTP/1.1 Server (raw requests and the data on the wire, using a server)
+***************************************************************************** */
+
+/* a raw client, sending a request to a test listener and collecting replies */
+static struct {
+  fio_http_settings_s settings; /* the listener's settings */
+  void *listener;               /* stopped once the client was closed */
+  fio_buf_info_s request;       /* sent by the client once connected */
+  const char *until;            /* the client closes once this was received */
+  char *response;               /* the data received by the client */
+  char *log;                    /* events, logged by the server's callbacks */
+  size_t received;              /* streamed request body bytes received */
+  size_t chunks;                /* the number of `on_body_chunk` calls */
+  uint8_t body_error;           /* set if streamed body data was corrupted */
+  uint8_t hangup;               /* the client closes after sending `request` */
+  uint8_t timeout;              /* set if the client wasn't closed in time */
+} fio___test_srv;
+
+#define FIO___TEST_SRV_URL "http://127.0.0.1:9440"
+
+FIO_SFUNC void fio___test_srv_on_attach(fio_s *io) {
+  fio_write(io, fio___test_srv.request.buf, fio___test_srv.request.len);
+  if (fio___test_srv.hangup)
+    fio_close(io);
+}
+
+FIO_SFUNC void fio___test_srv_on_data(fio_s *io) {
+  char buf[4096];
+  size_t len;
+  while ((len = fio_read(io, buf, sizeof(buf))))
+    fio___test_srv.response = fio_bstr_write(fio___test_srv.response, buf, len);
+  if (fio___test_srv.until && fio___test_srv.response &&
+      strstr(fio___test_srv.response, fio___test_srv.until))
+    fio_close(io);
+}
+
+/* stops the listener while the server is running (avoids restarting it) */
+FIO_SFUNC void fio___test_srv_done(void) {
+  if (!fio___test_srv.listener)
+    return;
+  fio_srv_listen_stop(fio___test_srv.listener);
+  fio___test_srv.listener = NULL;
+  fio_srv_stop();
+}
+
+FIO_SFUNC int fio___test_srv_done_task(void *ignr1_, void *ignr2_) {
+  fio___test_srv_done();
+  return -1;
+  (void)ignr1_, (void)ignr2_;
+}
+
+FIO_SFUNC void fio___test_srv_on_close(void *udata) {
+  if (fio___test_srv.hangup) /* let the server handle the lost connection */
+    fio_srv_run_every(.fn = fio___test_srv_done_task,
+                      .every = 50,
+                      .repetitions = 1);
+  else
+    fio___test_srv_done();
+  (void)udata;
+}
+
+static fio_protocol_s FIO___TEST_SRV_PROTOCOL = {
+    .on_attach = fio___test_srv_on_attach,
+    .on_data = fio___test_srv_on_data,
+    .on_close = fio___test_srv_on_close,
+};
+
+FIO_SFUNC int fio___test_srv_start(void *ignr1_, void *ignr2_) {
+  fio___test_srv.listener =
+      fio_http_listen FIO_NOOP(FIO___TEST_SRV_URL, fio___test_srv.settings);
+  FIO_ASSERT(fio___test_srv.listener, "HTTP server test couldn't listen");
+  FIO_ASSERT(!fio_srv_connect(FIO___TEST_SRV_URL,
+                              &FIO___TEST_SRV_PROTOCOL,
+                              NULL,
+                              NULL),
+             "HTTP server test couldn't connect");
+  return -1;
+  (void)ignr1_, (void)ignr2_;
+}
+
+FIO_SFUNC int fio___test_srv_watch(void *deadline_, void *ignr_) {
+  if (!fio___test_srv.listener)
+    return -1;
+  if (fio_time_milli() < (int64_t)(uintptr_t)deadline_)
+    return 0;
+  fio___test_srv.timeout = 1;
+  fio___test_srv_done();
+  return -1;
+  (void)ignr_;
+}
+
+/* sends `request`, returns the data received until the client was closed */
+FIO_SFUNC char *fio___test_srv_run2(fio_http_settings_s settings,
+                                    fio_buf_info_s request,
+                                    const char *until,
+                                    uint8_t hangup) {
+  size_t old_level = FIO_LOG_LEVEL_GET();
+  fio_bstr_free(fio___test_srv.response);
+  fio_bstr_free(fio___test_srv.log);
+  fio___test_srv = (__typeof__(fio___test_srv)){
+      .settings = settings,
+      .request = request,
+      .until = until,
+      .hangup = hangup,
+  };
+  fio_srv_run_every(.fn = fio___test_srv_start, .every = 1, .repetitions = 1);
+  fio_srv_run_every(.fn = fio___test_srv_watch,
+                    .udata1 = (void *)(uintptr_t)(fio_time_milli() + 5000),
+                    .every = 10,
+                    .repetitions = -1);
+  FIO_LOG_LEVEL_SET(FIO_LOG_LEVEL_FATAL); /* bad requests are logged */
+  fio_srv_start(0);
+  FIO_LOG_LEVEL_SET(old_level);
+  FIO_ASSERT(!fio___test_srv.timeout,
+             "HTTP server test timed out, received:\n%s",
+             (fio___test_srv.response ? fio___test_srv.response : ""));
+  return fio___test_srv.response ? fio___test_srv.response : (char *)"";
+}
+
+FIO_SFUNC char *fio___test_srv_run(fio_http_settings_s settings,
+                                   fio_buf_info_s request,
+                                   const char *until) {
+  return fio___test_srv_run2(settings, request, until, 0);
+}
+
+/* tests that the strings (a NULL terminated list) were received, in order */
+FIO_SFUNC int fio___test_srv_in_order(const char *r, const char **list) {
+  for (; r && *list; ++list)
+    if ((r = strstr(r, *list)))
+      r += strlen(*list);
+  return !!r;
+}
+
+/* responds with the path's name (i.e., "[a]"), delayed by the query's ms */
+FIO_SFUNC int fio___test_srv_respond(void *h_, void *ignr_) {
+  fio_http_s *h = (fio_http_s *)h_;
+  char buf[3] = {'[', fio_http_path(h).buf[1], ']'};
+  fio_http_write(h, .buf = buf, .len = 3, .copy = 1, .finish = 1);
+  fio_http_free(h);
+  return -1;
+  (void)ignr_;
+}
+
+FIO_SFUNC void fio___test_srv_on_http_delayed(fio_http_s *h) {
+  char *query = fio_http_query(h).buf;
+  size_t delay = (size_t)fio_atol10u(&query);
+  if (!delay) {
+    fio___test_srv_respond(fio_http_dup(h), NULL);
+    return;
+  }
+  fio_srv_run_every(.fn = fio___test_srv_respond,
+                    .udata1 = fio_http_dup(h),
+                    .every = (uint32_t)delay,
+                    .repetitions = 1);
+}
+
+/* *****************************************************************************
+HTTP/1.1 Response Heads (status lines, exact length and static headers)
+***************************************************************************** */
+
+FIO_SFUNC void FIO_NAME_TEST(stl, http1_head)(void) {
+  fprintf(stderr, "* Testing HTTP/1.1 response heads (exact length).\n");
+  for (size_t i = 100; i < 600; ++i) { /* pre-rendered lines can't drift */
+    fio_str_info_s line = fio___http1_status_line_cached(i);
+    char expected[128];
+    int len;
+    if (!line.buf)
+      continue;
+    len = snprintf(expected,
+                   sizeof(expected),
+                   "HTTP/1.1 %zu %s\r\n",
+                   i,
+                   fio_http_status2str(i).buf);
+    FIO_ASSERT(FIO_STR_INFO_IS_EQ(line, FIO_STR_INFO2(expected, (size_t)len)),
+               "pre-rendered status line error for %zu: %s",
+               i,
+               line.buf);
+  }
+  struct {
+    size_t status;
+    const char *version;
+    const char *line; /* the expected status line */
+    size_t headers;   /* the number of (100 byte) headers */
+    size_t cookies;
+    const char *static_headers;
+  } tests[] = {
+      {200, NULL, "HTTP/1.1 200 OK\r\n", 0, 0, NULL},
+      {404, "HTTP/1.1", "HTTP/1.1 404 Not Found\r\n", 2, 0, NULL},
+      {404, "HTTP/1.0", "HTTP/1.0 404 Not Found\r\n", 2, 1, NULL},
+      {599, NULL, "HTTP/1.1 599 Unknown\r\n", 1, 1, "server:facil.io\r\n"},
+      {200, NULL, "HTTP/1.1 200 OK\r\n", 60, 3, "x-a:1\r\nx-b:2\r\n"},
+      {499, "HTTP/1.1", "HTTP/1.1 499 Client Closed Request\r\n", 50, 0, "x:3\r\n"},
+  };
+  for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i) {
+    fio_http_s *h = fio_http_new();
+    fio_str_info_s sh = FIO_STR_INFO1((char *)tests[i].static_headers);
+    char value[100];
+    char *buf;
+    size_t len, written;
+    fio_http_status_set(h, tests[i].status);
+    if (tests[i].version)
+      fio_http_version_set(h, FIO_STR_INFO1((char *)tests[i].version));
+    FIO_MEMSET(value, 'v', sizeof(value));
+    for (size_t j = 0; j < tests[i].headers; ++j) {
+      char name[16] = {'x', '-', 'h'};
+      fio_ltoa10u(name + 3, j, fio_digits10u(j));
+      fio_http_response_header_add(h,
+                                   FIO_STR_INFO1(name),
+                                   FIO_STR_INFO2(value, sizeof(value)));
+    }
+    for (size_t j = 0; j < tests[i].cookies; ++j) {
+      char name[4] = {'c', (char)('a' + j)};
+      fio_http_cookie_set(h,
+                          .name = FIO_STR_INFO1(name),
+                          .value = FIO_STR_INFO1((char *)"value"),
+                          .path = FIO_STR_INFO1((char *)"/"));
+    }
+    len = fio___http1_head(NULL, h, sh);
+    buf = (char *)FIO_MEM_REALLOC(NULL, 0, len + 8, 0);
+    FIO_ASSERT_ALLOC(buf);
+    FIO_MEMSET(buf, '#', len + 8);
+    written = fio___http1_head(buf, h, sh);
+    FIO_ASSERT(written == len && buf[len] == '#',
+               "HTTP/1.1 head length miscalculated (%zu): %zu != %zu",
+               i,
+               written,
+               len);
+    FIO_ASSERT(len > strlen(tests[i].line) &&
+                   !FIO_MEMCMP(buf, tests[i].line, strlen(tests[i].line)) &&
+                   !FIO_MEMCMP(buf + len - 4, "\r\n\r\n", 4),
+               "HTTP/1.1 head status line error (%zu):\n%.*s",
+               i,
+               (int)len,
+               buf);
+    FIO_ASSERT(!sh.len || !FIO_MEMCMP(buf + len - 2 - sh.len, sh.buf, sh.len),
+               "HTTP/1.1 static headers should end the head (%zu)",
+               i);
+    {
+      size_t found = 0, cookies = 0;
+      buf[len] = 0;
+      for (char *pos = buf; (pos = strstr(pos, "\r\nx-h")); ++pos)
+        ++found;
+      for (char *pos = buf; (pos = strstr(pos, "\r\nset-cookie:c")); ++pos)
+        ++cookies;
+      FIO_ASSERT(found == tests[i].headers && cookies == tests[i].cookies,
+                 "HTTP/1.1 head should contain all headers and cookies (%zu)",
+                 i);
+    }
+    FIO_MEM_FREE(buf, len + 8);
+    fio_http_free(h);
+  }
+}
+
+/* a response with large headers, cookies and static headers, streamed */
+FIO_SFUNC void fio___test_srv_on_http_head(fio_http_s *h) {
+  char value[100];
+  FIO_MEMSET(value, 'v', sizeof(value));
+  for (size_t j = 0; j < 60; ++j) { /* over 4KiB of headers */
+    char name[16] = {'x', '-', 'h'};
+    fio_ltoa10u(name + 3, j, fio_digits10u(j));
+    fio_http_response_header_add(h,
+                                 FIO_STR_INFO1(name),
+                                 FIO_STR_INFO2(value, sizeof(value)));
+  }
+  fio_http_cookie_set(h,
+                      .name = FIO_STR_INFO1((char *)"ca"),
+                      .value = FIO_STR_INFO1((char *)"value"));
+  fio_http_write(h, .buf = "hello", .len = 5, .copy = 1);
+  fio_http_write(h, .finish = 1);
+}
+
+FIO_SFUNC void FIO_NAME_TEST(stl, http1_head_wire)(void) {
+  fprintf(stderr, "* Testing HTTP/1.1 response heads (large, chunked).\n");
+  const char *expected[] = {"HTTP/1.1 200 OK",
+                            "\r\nx-h0:",
+                            "\r\nx-h59:",
+                            "\r\nset-cookie:ca=value",
+                            "\r\nserver:test\r\nx-static:1\r\n"
+                            "transfer-encoding: chunked\r\n\r\n",
+                            "\r\nhello\r\n0\r\n\r\n",
+                            NULL};
+  char *r = fio___test_srv_run(
+      (fio_http_settings_s){
+          .on_http = fio___test_srv_on_http_head,
+          .static_headers =
+              FIO_STR_INFO1((char *)"server:test\r\nx-static:1\r\n"),
+      },
+      FIO_BUF_INFO1((char *)"GET / HTTP/1.1\r\nhost: x\r\n\r\n"),
+      "0\r\n\r\n");
+  FIO_ASSERT(strlen(r) > 6000 && fio___test_srv_in_order(r, expected),
+             "HTTP/1.1 large / chunked response head error:\n%s",
+             r);
+}
+
+/* streams chunks using every framing path (stack, heap and separate writes) */
+FIO_SFUNC void fio___test_srv_on_http_chunks(fio_http_s *h) {
+  static char large[FIO_HTTP_CHUNK_COPY_LIMIT + 3616]; /* not copied */
+  char mid[8000];
+  FILE *tmp = tmpfile();
+  FIO_ASSERT(tmp, "couldn't create a temporary file for testing");
+  for (size_t i = 0; i < 6000; ++i)
+    fputc('d', tmp);
+  fflush(tmp);
+  FIO_MEMSET(mid, 'b', sizeof(mid));
+  FIO_MEMSET(large, 'c', sizeof(large));
+  fio_http_write(h, .buf = "hello", .len = 5, .copy = 1);
+  fio_http_write(h, .buf = mid, .len = sizeof(mid), .copy = 1);
+  fio_http_write(h, .buf = "", .len = 0, .copy = 1); /* no (final) chunk */
+  fio_http_write(h, .buf = large, .len = sizeof(large));
+  fio_http_write(h, .fd = dup(fileno(tmp)), .len = 6000);
+  fio_http_write(h, .finish = 1);
+  fclose(tmp);
+}
+
+/* decodes a chunked response body, returning the number of chunks (or -1) */
+FIO_SFUNC int fio___test_srv_unchunk(const char *r, char **body) {
+  if (!(r = strstr(r, "\r\n\r\n")))
+    return -1;
+  r += 4;
+  for (int count = 0;; ++count) {
+    char *end;
+    size_t len = (size_t)strtoul(r, &end, 16);
+    if (end == r || end[0] != '\r' || end[1] != '\n')
+      return -1;
+    r = end + 2;
+    if (!len)
+      return count;
+    if (strlen(r) < len + 2 || r[len] != '\r' || r[len + 1] != '\n')
+      return -1;
+    *body = fio_bstr_write(*body, r, len);
+    r += len + 2;
+  }
+}
+
+FIO_SFUNC void FIO_NAME_TEST(stl, http1_stream_chunk)(void) {
+  fprintf(stderr, "* Testing HTTP/1.1 streamed response chunks.\n");
+  const size_t lengths[] = {8000, FIO_HTTP_CHUNK_COPY_LIMIT + 3616, 6000};
+  char *expected = fio_bstr_write(NULL, "hello", 5);
+  char *body = NULL;
+  char *r;
+  int chunks;
+  for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); ++i)
+    for (size_t j = 0; j < lengths[i]; ++j)
+      expected = fio_bstr_write(expected, "bcd" + i, 1);
+  r = fio___test_srv_run(
+      (fio_http_settings_s){.on_http = fio___test_srv_on_http_chunks},
+      FIO_BUF_INFO1((char *)"GET / HTTP/1.1\r\nhost: x\r\n\r\n"),
+      "\r\n0\r\n\r\n");
+  chunks = fio___test_srv_unchunk(r, &body);
+  FIO_ASSERT(chunks == 4,
+             "streamed response should have 4 chunks (%d):\n%.*s",
+             chunks,
+             256,
+             r);
+  FIO_ASSERT(fio_bstr_is_eq2info(body, fio_bstr_info(expected)),
+             "streamed response body error (%zu bytes)",
+             fio_bstr_len(body));
+  fio_bstr_free(expected);
+  fio_bstr_free(body);
+}
+
+/* *****************************************************************************
+HTTP/1.1 Pipelining (responses are sent in request order)
+***************************************************************************** */
+
+#define FIO___TEST_SRV_REQ(name, delay)                                        \
+  "GET /" name "?" delay " HTTP/1.1\r\nhost: x\r\n\r\n"
+
+FIO_SFUNC void FIO_NAME_TEST(stl, http_pipeline)(void) {
+  fprintf(stderr, "* Testing HTTP/1.1 pipelining (response order).\n");
+  struct {
+    const char *request;
+    const char *expected[8];
+    const char *until; /* NULL: the server closes the connection */
+    uint8_t pipeline;
+  } tests[] = {
+      { /* responses finish out of order, but are sent in order */
+       FIO___TEST_SRV_REQ("a", "60") FIO___TEST_SRV_REQ("b", "0")
+           FIO___TEST_SRV_REQ("c", "30") FIO___TEST_SRV_REQ("d", "0"),
+       {"[a]", "[b]", "[c]", "[d]", NULL},
+       "[d]",
+       4},
+      { /* a full pipeline stops parsing until responses were sent */
+       FIO___TEST_SRV_REQ("a", "20") FIO___TEST_SRV_REQ("b", "0")
+           FIO___TEST_SRV_REQ("c", "10") FIO___TEST_SRV_REQ("d", "0")
+               FIO___TEST_SRV_REQ("e", "0") FIO___TEST_SRV_REQ("f", "0"),
+       {"[a]", "[b]", "[c]", "[d]", "[e]", "[f]", NULL},
+       "[f]",
+       2},
+      { /* a bad request is answered (and closed) after pending responses */
+       FIO___TEST_SRV_REQ("a", "30") FIO___TEST_SRV_REQ("b", "0")
+           "GET /c HTTP/1.1\r\nno colon\r\n\r\n",
+       {"[a]", "[b]", "HTTP/1.1 400", NULL},
+       NULL,
+       4},
+  };
+  for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i) {
+    char *r = fio___test_srv_run(
+        (fio_http_settings_s){.on_http = fio___test_srv_on_http_delayed,
+                              .pipeline = tests[i].pipeline},
+        FIO_BUF_INFO1((char *)tests[i].request),
+        tests[i].until);
+    FIO_ASSERT(fio___test_srv_in_order(r, tests[i].expected),
+               "pipelined responses out of order (%zu):\n%s",
+               i,
+               r);
+  }
+}
+#undef FIO___TEST_SRV_REQ
+
+/* *****************************************************************************
+HTTP/1.1 Streamed Request Bodies (`on_body_chunk`)
+***************************************************************************** */
+
+/* the streamed body data at `pos` (so the order can be validated) */
+#define FIO___TEST_SRV_BODY_BYTE(pos) ((char)('a' + ((pos) % 26)))
+
+/* validates and counts body data, responding early if the path is "/early" */
+FIO_SFUNC void fio___test_srv_on_body_chunk(fio_http_s *h,
+                                            fio_buf_info_s chunk) {
+  for (size_t i = 0; i < chunk.len; ++i)
+    fio___test_srv.body_error |=
+        (chunk.buf[i] != FIO___TEST_SRV_BODY_BYTE(fio___test_srv.received + i));
+  fio___test_srv.received += chunk.len;
+  ++fio___test_srv.chunks;
+  if (FIO_STR_INFO_IS_EQ(fio_http_path(h), FIO_STR_INFO2((char *)"/early", 6)))
+    fio_http_write(h, .buf = "{early}", .len = 7, .copy = 1, .finish = 1);
+}
+
+/* responds with the number of body bytes received, i.e., "{10}" */
+FIO_SFUNC void fio___test_srv_on_http_body(fio_http_s *h) {
+  char buf[32];
+  size_t len;
+  fio___test_srv.log = fio_bstr_write(fio___test_srv.log, "[on_http]", 9);
+  len = (size_t)snprintf(buf, sizeof(buf), "{%zu}", fio___test_srv.received);
+  fio_http_write(h, .buf = buf, .len = len, .copy = 1, .finish = 1);
+}
+
+FIO_SFUNC int fio___test_srv_deny(fio_http_s *h) {
+  return -1;
+  (void)h;
+}
+
+/* returns a request (a `fio_bstr`) with a (streamed) body of `len` bytes */
+FIO_SFUNC char *fio___test_srv_body_request(const char *path,
+                                            size_t len,
+                                            size_t content_length,
+                                            size_t chunk_size) {
+  char *r = fio_bstr_printf(NULL, "POST %s HTTP/1.1\r\nhost: x\r\n", path);
+  if (chunk_size)
+    r = fio_bstr_write(r, "transfer-encoding: chunked\r\n\r\n", 30);
+  else
+    r = fio_bstr_printf(r, "content-length: %zu\r\n\r\n", content_length);
+  for (size_t pos = 0; pos < len;) {
+    size_t end = chunk_size ? pos + chunk_size : len;
+    if (end > len)
+      end = len;
+    if (chunk_size)
+      r = fio_bstr_printf(r, "%zx\r\n", end - pos);
+    for (; pos < end; ++pos) {
+      char c = FIO___TEST_SRV_BODY_BYTE(pos);
+      r = fio_bstr_write(r, &c, 1);
+    }
+    if (chunk_size)
+      r = fio_bstr_write(r, "\r\n", 2);
+  }
+  if (chunk_size)
+    r = fio_bstr_write(r, "0\r\n\r\n", 5);
+  return r;
+}
+
+FIO_SFUNC void FIO_NAME_TEST(stl, http_body_chunk)(void) {
+  fprintf(stderr, "* Testing HTTP/1.1 streamed request bodies.\n");
+  fio_http_settings_s settings = {
+      .on_http = fio___test_srv_on_http_body,
+      .on_body_chunk = fio___test_srv_on_body_chunk,
+  };
+  char *req;
+  char *r;
+  { /* body chunks arrive in order, `on_http` is called once it's complete */
+    const size_t len = (FIO_HTTP_BODY_STREAM_LIMIT * 3) + 17;
+    char expected[32];
+    snprintf(expected, sizeof(expected), "{%zu}", len);
+    req = fio___test_srv_body_request("/", len, len, 0);
+    r = fio___test_srv_run(settings, fio_bstr_buf(req), "}");
+    FIO_ASSERT(strstr(r, expected) && fio___test_srv.chunks > 1 &&
+                   !fio___test_srv.body_error,
+               "streamed body error (%zu chunks):\n%s",
+               fio___test_srv.chunks,
+               r);
+    fio_bstr_free(req);
+    /* chunked (transfer-encoding) bodies are streamed as well */
+    req = fio___test_srv_body_request("/", len, 0, 1000);
+    r = fio___test_srv_run(settings, fio_bstr_buf(req), "}");
+    FIO_ASSERT(strstr(r, expected) && !fio___test_srv.body_error,
+               "streamed (chunked) body error:\n%s",
+               r);
+    fio_bstr_free(req);
+  }
+  { /* `max_body_size` is enforced against the streamed total */
+    fio_http_settings_s limited = settings;
+    limited.max_body_size = 1000;
+    req = fio___test_srv_body_request("/", 1800, 0, 600);
+    r = fio___test_srv_run(limited, fio_bstr_buf(req), NULL);
+    FIO_ASSERT(!strncmp(r, "HTTP/1.1 400", 12) && !fio___test_srv.log &&
+                   fio___test_srv.received <= 1000,
+               "streamed body should respect max_body_size:\n%s",
+               r);
+    fio_bstr_free(req);
+    req = fio___test_srv_body_request("/", 1800, 1800, 0);
+    r = fio___test_srv_run(limited, fio_bstr_buf(req), NULL);
+    FIO_ASSERT(!strncmp(r, "HTTP/1.1 413", 12) && !fio___test_srv.log &&
+                   !fio___test_srv.received,
+               "streamed body content-length should respect max_body_size:\n%s",
+               r);
+    fio_bstr_free(req);
+  }
+  { /* a response sent from `on_body_chunk` skips `on_http` */
+    const size_t len = FIO_HTTP_BODY_STREAM_LIMIT * 8;
+    req = fio___test_srv_body_request("/early", len, len, 0);
+    r = fio___test_srv_run(settings, fio_bstr_buf(req), NULL);
+    FIO_ASSERT(strstr(r, "{early}") && !strstr(r, "}{") &&
+                   !fio___test_srv.log && fio___test_srv.chunks &&
+                   fio___test_srv.received < len && !fio___test_srv.body_error,
+               "early response from on_body_chunk error:\n%s",
+               r);
+    fio_bstr_free(req);
+  }
+  { /* `on_http` is never called if the connection was lost mid-body */
+    const size_t len = FIO_HTTP_BODY_STREAM_LIMIT * 2;
+    req = fio___test_srv_body_request("/", len, len * 2, 0);
+    fio___test_srv_run2(settings, fio_bstr_buf(req), NULL, 1);
+    FIO_ASSERT(!fio___test_srv.log && fio___test_srv.chunks &&
+                   fio___test_srv.received <= len && !fio___test_srv.body_error,
+               "on_http called for a lost connection (%zu bytes received)",
+               fio___test_srv.received);
+    fio_bstr_free(req);
+  }
+  { /* a pipelined upgrade request waits for pending responses, with its body */
+    fio_http_settings_s sse = settings;
+    const char *expected[] = {"[a]", "HTTP/1.1 403", NULL};
+    sse.on_http = fio___test_srv_on_http_delayed;
+    sse.on_authenticate_sse = fio___test_srv_deny;
+    sse.pipeline = 4;
+    r = fio___test_srv_run(
+        sse,
+        FIO_BUF_INFO1((char *)"GET /a?30 HTTP/1.1\r\nhost: x\r\n\r\n"
+                              "GET /s HTTP/1.1\r\nhost: x\r\n"
+                              "accept: text/event-stream\r\n"
+                              "content-length: 5\r\n\r\nabcde"),
+        "HTTP/1.1 403");
+    FIO_ASSERT(fio___test_srv_in_order(r, expected) &&
+                   fio___test_srv.received == 5 && !fio___test_srv.body_error,
+               "held upgrade request body error (%zu bytes):\n%s",
+               fio___test_srv.received,
+               r);
+  }
+}
+#undef FIO___TEST_SRV_BODY_BYTE
+
+FIO_SFUNC void FIO_NAME_TEST(stl, http_server)(void) {
+  FIO_NAME_TEST(stl, http1_head)();
+  FIO_NAME_TEST(stl, http1_head_wire)();
+  FIO_NAME_TEST(stl, http1_stream_chunk)();
+  FIO_NAME_TEST(stl, http_pipeline)();
+  FIO_NAME_TEST(stl, http_body_chunk)();
+  fio_bstr_free(fio___test_srv.response);
+  fio_bstr_free(fio___test_srv.log);
+  fio___test_srv.response = fio___test_srv.log = NULL;
+}
+#undef FIO___TEST_SRV_URL
+
+#else
+FIO_SFUNC void FIO_NAME_TEST(stl, http_websocket)(void) {}
+FIO_SFUNC void FIO_NAME_TEST(stl, http_client)(void) {}
+FIO_SFUNC void FIO_NAME_TEST(stl, http_deadlines)(void) {}
+FIO_SFUNC void FIO_NAME_TEST(stl, http_server)(void) {}
+#endif /* H___FIO_HTTP___H */
+
+/* *****************************************************************************
+Cleanup
+***************************************************************************** */
+#endif /* FIO_TEST_ALL */
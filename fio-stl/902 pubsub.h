@@ -173,6 +173,235 @@ FIO_SFUNC void FIO_NAME_TEST(stl, pubsub_roundtrip)(void) {
 #undef FIO___PUBLISH2TEST
 }
 
+/* *****************************************************************************
+Pattern Matching Testing
+***************************************************************************** */
+
+FIO_SFUNC uint8_t FIO_NAME_TEST(stl, pubsub_match)(fio_str_info_s pattern,
+                                                   fio_str_info_s channel) {
+  return fio_glob_match(pattern, channel);
+}
+
+FIO_SFUNC void FIO_NAME_TEST(stl, pubsub_patterns)(void) {
+  fprintf(stderr, "* Testing pub/sub pattern matching (indexed).\n");
+  static const char *patterns[] = {
+      "user.*.events",
+      "user.1.*",
+      "user.1?.events",
+      "user.[0-9].events",
+      "*",
+      "*.events",
+      "news",
+      "news*",
+      "[nu]*",
+      "\\news",
+      "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa*",
+      "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaab",
+  };
+  static const char *channels[] = {
+      "user.1.events",
+      "user.12.events",
+      "user.1.other",
+      "user.x.events",
+      "news",
+      "newsroom",
+      "",
+      "u",
+      "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaab",
+      "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaac",
+  };
+  const size_t pattern_count = sizeof(patterns) / sizeof(patterns[0]);
+  const size_t channel_count = sizeof(channels) / sizeof(channels[0]);
+  int state[sizeof(patterns) / sizeof(patterns[0])] = {0};
+  int ignored = 0;
+  /* the same pattern, using a different filter, is never matched */
+  fio_subscribe(.channel = FIO_BUF_INFO1((char *)"*"),
+                .on_message = FIO_NAME_TEST(stl, pubsub_on_message),
+                .filter = -125,
+                .udata = &ignored,
+                .is_pattern = 1);
+  for (size_t i = 0; i < pattern_count; ++i)
+    fio_subscribe(.channel = FIO_BUF_INFO1((char *)patterns[i]),
+                  .on_message = FIO_NAME_TEST(stl, pubsub_on_message),
+                  .filter = -126,
+                  .udata = state + i,
+                  .is_pattern = 1);
+  fio_queue_perform_all(fio___srv_tasks);
+  for (int round = 0; round < 2; ++round) {
+    /* the second round tests the fallback (non-indexed) matching */
+    if (round)
+      FIO_PUBSUB_PATTERN_MATCH = FIO_NAME_TEST(stl, pubsub_match);
+    for (size_t c = 0; c < channel_count; ++c) {
+      FIO_MEMSET(state, 0, sizeof(state));
+      fio_publish(.channel = FIO_BUF_INFO1((char *)channels[c]),
+                  .filter = -126,
+                  .engine = FIO_PUBSUB_PROCESS);
+      fio_queue_perform_all(fio___srv_tasks);
+      for (size_t i = 0; i < pattern_count; ++i) {
+        int expected = fio_glob_match(FIO_STR_INFO1((char *)patterns[i]),
+                                      FIO_STR_INFO1((char *)channels[c]));
+        FIO_ASSERT(state[i] == expected,
+                   "pattern delivery error (round %d) for %s => %s (%d)",
+                   round,
+                   patterns[i],
+                   channels[c],
+                   state[i]);
+      }
+    }
+  }
+  FIO_PUBSUB_PATTERN_MATCH = fio_glob_match;
+  FIO_ASSERT(!ignored, "pattern filter ignored!");
+  fio_unsubscribe(.channel = FIO_BUF_INFO1((char *)"*"),
+                  .on_message = FIO_NAME_TEST(stl, pubsub_on_message),
+                  .filter = -125,
+                  .udata = &ignored,
+                  .is_pattern = 1);
+  for (size_t i = 0; i < pattern_count; ++i)
+    fio_unsubscribe(.channel = FIO_BUF_INFO1((char *)patterns[i]),
+                    .on_message = FIO_NAME_TEST(stl, pubsub_on_message),
+                    .filter = -126,
+                    .udata = state + i,
+                    .is_pattern = 1);
+  fio_queue_perform_all(fio___srv_tasks);
+  FIO_ASSERT(!FIO_POSTOFFICE.pattern_prefixes &&
+                 !fio___pattern_map_count(&FIO_POSTOFFICE.pattern_index),
+             "pattern index should be empty once all patterns unsubscribed");
+}
+
+/* *****************************************************************************
+Channel Fan-out Testing
+***************************************************************************** */
+
+#define FIO___PUBSUB_FANOUT_TEST_COUNT ((FIO_PUBSUB_DELIVERY_BUDGET * 3) + 7)
+static struct {
+  int state[FIO___PUBSUB_FANOUT_TEST_COUNT];
+  uintptr_t handles[FIO___PUBSUB_FANOUT_TEST_COUNT];
+} FIO_NAME_TEST(stl, pubsub_fanout_data);
+
+FIO_SFUNC void FIO_NAME_TEST(stl, pubsub_fanout_on_message)(fio_msg_s *msg) {
+  int *state = (int *)msg->udata;
+  const size_t i = state - FIO_NAME_TEST(stl, pubsub_fanout_data).state;
+  *state += 1;
+  if (i == 0) { /* unsubscribes the subscriber pinned by the delivery task */
+    fio_unsubscribe(.subscription_handle_ptr =
+                        FIO_NAME_TEST(stl, pubsub_fanout_data).handles +
+                        FIO_PUBSUB_DELIVERY_BUDGET);
+    fio_unsubscribe(.subscription_handle_ptr =
+                        FIO_NAME_TEST(stl, pubsub_fanout_data).handles +
+                        FIO_PUBSUB_DELIVERY_BUDGET + 1);
+  }
+  if (i == 2 && *state == 1)
+    fio_message_defer(msg);
+}
+
+FIO_SFUNC void FIO_NAME_TEST(stl, pubsub_fanout)(void) {
+  fprintf(stderr,
+          "* Testing pub/sub channel fan-out (%d subscribers).\n",
+          (int)FIO___PUBSUB_FANOUT_TEST_COUNT);
+  int *state = FIO_NAME_TEST(stl, pubsub_fanout_data).state;
+  uintptr_t *handles = FIO_NAME_TEST(stl, pubsub_fanout_data).handles;
+  fio_buf_info_s channel = FIO_BUF_INFO1((char *)"pubsub_fanout_test");
+  for (size_t i = 0; i < FIO___PUBSUB_FANOUT_TEST_COUNT; ++i)
+    fio_subscribe(.channel = channel,
+                  .on_message = FIO_NAME_TEST(stl, pubsub_fanout_on_message),
+                  .subscription_handle_ptr = handles + i,
+                  .filter = -124,
+                  .udata = state + i);
+  fio_queue_perform_all(fio___srv_tasks);
+  fio_publish(.channel = channel,
+              .filter = -124,
+              .engine = FIO_PUBSUB_PROCESS);
+  fio_queue_perform_all(fio___srv_tasks);
+  for (size_t i = 0; i < FIO___PUBSUB_FANOUT_TEST_COUNT; ++i) {
+    int expected = (i == 2) ? 2 : (i == FIO_PUBSUB_DELIVERY_BUDGET ||
+                                   i == FIO_PUBSUB_DELIVERY_BUDGET + 1)
+                                      ? 0
+                                      : 1;
+    FIO_ASSERT(state[i] == expected,
+               "fan-out delivery error for subscriber %zu (%d != %d)",
+               i,
+               state[i],
+               expected);
+  }
+  for (size_t i = 0; i < FIO___PUBSUB_FANOUT_TEST_COUNT; ++i)
+    if (i != FIO_PUBSUB_DELIVERY_BUDGET && i != FIO_PUBSUB_DELIVERY_BUDGET + 1)
+      fio_unsubscribe(.subscription_handle_ptr = handles + i);
+  fio_queue_perform_all(fio___srv_tasks);
+}
+#undef FIO___PUBSUB_FANOUT_TEST_COUNT
+
+/* *****************************************************************************
+Message Cache Testing
+***************************************************************************** */
+
+static struct {
+  size_t built;
+  size_t freed;
+  size_t matched;
+} FIO_NAME_TEST(stl, pubsub_cache_data);
+
+FIO_SFUNC void *FIO_NAME_TEST(stl, pubsub_cache_build)(fio_str_info_s ch,
+                                                       fio_str_info_s msg,
+                                                       int16_t filter,
+                                                       uint8_t is_json) {
+  ++FIO_NAME_TEST(stl, pubsub_cache_data).built;
+  return (void *)fio_bstr_write(NULL, msg.buf, msg.len);
+  (void)ch, (void)filter, (void)is_json;
+}
+
+FIO_SFUNC void FIO_NAME_TEST(stl, pubsub_cache_free)(void *data) {
+  ++FIO_NAME_TEST(stl, pubsub_cache_data).freed;
+  fio_bstr_free((char *)data);
+}
+
+FIO_SFUNC void FIO_NAME_TEST(stl, pubsub_cache_on_message)(fio_msg_s *msg) {
+  if (!msg->udata)
+    return;
+  char *data = (char *)fio_message_cache(msg,
+                                         FIO_NAME_TEST(stl, pubsub_cache_build),
+                                         FIO_NAME_TEST(stl, pubsub_cache_free));
+  FIO_NAME_TEST(stl, pubsub_cache_data).matched +=
+      FIO_BUF_INFO_IS_EQ(fio_bstr_buf(data),
+                         FIO_BUF_INFO2(msg->message.buf, msg->message.len));
+}
+
+FIO_SFUNC void FIO_NAME_TEST(stl, pubsub_cache)(void) {
+  fprintf(stderr, "* Testing pub/sub message cache.\n");
+  uintptr_t handles[4] = {0};
+  fio_buf_info_s channels[] = {
+      FIO_BUF_INFO1((char *)"pubsub_cache_test"),
+      FIO_BUF_INFO1((char *)"pubsub_cache_skip"),
+  };
+  /* 3 subscribers use the cache, one ignores it (udata == NULL) */
+  for (size_t i = 0; i < 4; ++i)
+    fio_subscribe(.channel = channels[i == 3],
+                  .on_message = FIO_NAME_TEST(stl, pubsub_cache_on_message),
+                  .subscription_handle_ptr = handles + i,
+                  .filter = -123,
+                  .udata = (void *)(uintptr_t)(i != 3));
+  fio_queue_perform_all(fio___srv_tasks);
+  fio_publish(.channel = channels[0],
+              .message = FIO_BUF_INFO1((char *)"cached message"),
+              .filter = -123,
+              .engine = FIO_PUBSUB_PROCESS);
+  fio_publish(.channel = channels[1],
+              .message = FIO_BUF_INFO1((char *)"never cached"),
+              .filter = -123,
+              .engine = FIO_PUBSUB_PROCESS);
+  fio_queue_perform_all(fio___srv_tasks);
+  FIO_ASSERT(FIO_NAME_TEST(stl, pubsub_cache_data).matched == 3,
+             "fio_message_cache returned wrong data (%zu/3)",
+             FIO_NAME_TEST(stl, pubsub_cache_data).matched);
+  FIO_ASSERT(FIO_NAME_TEST(stl, pubsub_cache_data).built == 1,
+             "fio_message_cache should build once, only when requested (%zu)",
+             FIO_NAME_TEST(stl, pubsub_cache_data).built);
+  FIO_ASSERT(FIO_NAME_TEST(stl, pubsub_cache_data).freed == 1,
+             "fio_message_cache data should be freed with the message");
+  for (size_t i = 0; i < 4; ++i)
+    fio_unsubscribe(.subscription_handle_ptr = handles + i);
+  fio_queue_perform_all(fio___srv_tasks);
+}
+
 /* *****************************************************************************
 
 ***************************************************************************** */
@@ -180,6 +409,9 @@ FIO_SFUNC void FIO_NAME_TEST(stl, pubsub_roundtrip)(void) {
 FIO_SFUNC void FIO_NAME_TEST(stl, pubsub)(void) {
   FIO_NAME_TEST(stl, letter)();
   FIO_NAME_TEST(stl, pubsub_roundtrip)();
+  FIO_NAME_TEST(stl, pubsub_patterns)();
+  FIO_NAME_TEST(stl, pubsub_fanout)();
+  FIO_NAME_TEST(stl, pubsub_cache)();
   fio___srv_cleanup_at_exit(NULL);
 }
 
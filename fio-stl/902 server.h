@@ -258,6 +258,101 @@ FIO_SFUNC void FIO_NAME_TEST(FIO_NAME_TEST(stl, server), env)(void) {
   FIO_ASSERT(a == 2 && b == 1 && c == 1, "destroy should call callbacks.");
 }
 
+/* *****************************************************************************
+Test shared (cached) file descriptors
+***************************************************************************** */
+#if FIO_SRV_FILE_CACHE_LIMIT && FIO_OS_POSIX
+/* tests if a file descriptor is (still) open */
+FIO_IFUNC int FIO_NAME_TEST(FIO_NAME_TEST(stl, server), fd_is_open)(int fd) {
+  return fcntl(fd, F_GETFD) != -1;
+}
+
+FIO_SFUNC void FIO_NAME_TEST(FIO_NAME_TEST(stl, server), files)(void) {
+  fprintf(stderr, "   * Testing fio_srv_file_open (shared files).\n");
+  char name[] = "/tmp/fio_test_srv_file_XXXXXX";
+  char buf[16];
+  struct stat st;
+  int fd, fd2;
+  int tmp = mkstemp(name);
+  FIO_ASSERT(tmp != -1 && write(tmp, "hello", 5) == 5 && !close(tmp),
+             "couldn't create a temporary file for testing");
+
+  /* concurrent users share a single file descriptor */
+  fd = fio_srv_file_open(name, &st);
+  fd2 = fio_srv_file_open(name, NULL);
+  FIO_ASSERT(fd != -1 && st.st_size == 5, "fio_srv_file_open failed");
+  FIO_ASSERT(fd == fd2, "fio_srv_file_open should share file descriptors");
+  fio_srv_file_close(fd2);
+  FIO_ASSERT(FIO_NAME_TEST(FIO_NAME_TEST(stl, server), fd_is_open)(fd),
+             "shared file descriptor closed while still in use");
+
+  /* `fio_srv_sendfile` releases (rather than closes) the file descriptor */
+  fd2 = fio_srv_file_open(name, NULL);
+  FIO_ASSERT(fd == fd2, "fio_srv_file_open should share file descriptors");
+  {
+    int old_level = FIO_LOG_LEVEL_GET();
+    FIO_LOG_LEVEL_SET(FIO_LOG_LEVEL_FATAL); /* writing to a NULL IO errors */
+    fio_srv_sendfile(NULL, fd2, 0, 5);
+    FIO_LOG_LEVEL_SET(old_level);
+  }
+  FIO_ASSERT(FIO_NAME_TEST(FIO_NAME_TEST(stl, server), fd_is_open)(fd),
+             "fio_srv_sendfile shouldn't close shared file descriptors");
+  { /* stream packets release the file once the data was consumed */
+    fio_stream_s s = FIO_STREAM_INIT(s);
+    char *pos = buf;
+    size_t len = sizeof(buf);
+    fd2 = fio_srv_file_open(name, NULL);
+    fio_stream_add(&s, fio_stream_pack_fd2(fd2, 5, 0, fio_srv_file_release));
+    fio_stream_read(&s, &pos, &len);
+    FIO_ASSERT(len == 5 && !FIO_MEMCMP(pos, "hello", 5),
+               "shared file descriptor read error");
+    fio_stream_advance(&s, len);
+    fio_stream_destroy(&s);
+  }
+  fio_srv_file_close(fd);
+  FIO_ASSERT(FIO_NAME_TEST(FIO_NAME_TEST(stl, server), fd_is_open)(fd),
+             "cached file descriptors should remain open");
+  FIO_ASSERT(fio___srv_file_fds_count(&fio___srv_files.fds) == 1,
+             "shared file descriptor should be tracked while cached");
+  fio___srv_files_cleanup();
+  FIO_ASSERT(!FIO_NAME_TEST(FIO_NAME_TEST(stl, server), fd_is_open)(fd) &&
+                 !fio___srv_file_fds_count(&fio___srv_files.fds),
+             "released file descriptor should be closed once uncached");
+
+  /* a changed file gets a new file descriptor, the old one remains valid */
+  fd = fio_srv_file_open(name, NULL);
+  FIO_ASSERT(fd != -1, "fio_srv_file_open failed");
+  tmp = open(name, O_WRONLY | O_APPEND);
+  FIO_ASSERT(tmp != -1 && write(tmp, " world", 6) == 6 && !close(tmp),
+             "couldn't update the temporary file");
+  {
+    fio_str_info_s key = FIO_STR_INFO1(name);
+    fio___srv_file_s *f =
+        fio___srv_file_cache_get(&fio___srv_files.cache,
+                                 fio_risky_hash(key.buf, key.len, 0),
+                                 key);
+    FIO_ASSERT(f && f->fd == fd, "file should be cached");
+    f->expires = 0; /* skip waiting for FIO_SRV_FILE_CACHE_TTL */
+  }
+  fd2 = fio_srv_file_open(name, &st);
+  FIO_ASSERT(fd2 != -1 && fd2 != fd && st.st_size == 11,
+             "changed file should be re-opened after the TTL");
+  FIO_ASSERT(FIO_NAME_TEST(FIO_NAME_TEST(stl, server), fd_is_open)(fd) &&
+                 pread(fd, buf, 5, 0) == 5 && !FIO_MEMCMP(buf, "hello", 5),
+             "stale file descriptor should remain valid until released");
+  fio_srv_file_close(fd);
+  FIO_ASSERT(!FIO_NAME_TEST(FIO_NAME_TEST(stl, server), fd_is_open)(fd),
+             "stale file descriptor should be closed once released");
+  fio_srv_file_close(fd2);
+  fio___srv_files_cleanup();
+  FIO_ASSERT(!FIO_NAME_TEST(FIO_NAME_TEST(stl, server), fd_is_open)(fd2),
+             "released file descriptor should be closed once uncached");
+  unlink(name);
+}
+#else
+FIO_SFUNC void FIO_NAME_TEST(FIO_NAME_TEST(stl, server), files)(void) {}
+#endif /* FIO_SRV_FILE_CACHE_LIMIT */
+
 /* *****************************************************************************
 Test Server Modules
 ***************************************************************************** */
@@ -266,6 +361,7 @@ FIO_SFUNC void FIO_NAME_TEST(stl, server)(void) {
   fprintf(stderr, "* Testing fio_srv units (TODO).\n");
   FIO_NAME_TEST(FIO_NAME_TEST(stl, server), env)();
   FIO_NAME_TEST(FIO_NAME_TEST(stl, server), tls_helpers)();
+  FIO_NAME_TEST(FIO_NAME_TEST(stl, server), files)();
 }
 /* *****************************************************************************
 Cleanup
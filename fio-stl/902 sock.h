@@ -126,6 +126,71 @@ FIO_SFUNC void FIO_NAME_TEST(stl, sock)(void) {
       unlink(server_tests[i].address);
 #endif
   }
+  {
+    /* peer addresses (Unix sockets have no IP address) */
+    fprintf(stderr, "* Testing fio_sock_peer_addr\n");
+    struct {
+      const char *address;
+      const char *port;
+      const char *peer;
+      uint16_t flag;
+    } peer_tests[] = {
+      {"127.0.0.1", "9438", "127.0.0.1", FIO_SOCK_TCP},
+      {"::1", "9438", "::1", FIO_SOCK_TCP},
+#ifdef AF_UNIX
+#if defined(P_tmpdir) && !defined(__MINGW32__)
+      {P_tmpdir "/tmp_unix_testing_peer_facil_io.sock",
+       NULL,
+       "",
+       FIO_SOCK_UNIX},
+#else
+      {"./tmp_unix_testing_peer_facil_io.sock", NULL, "", FIO_SOCK_UNIX},
+#endif
+#endif
+      {.address = NULL},
+    };
+    char buf[64];
+    FIO_ASSERT(!fio_sock_peer_addr(buf, sizeof(buf), -1) && !buf[0],
+               "fio_sock_peer_addr should fail for an invalid socket");
+    for (size_t i = 0; peer_tests[i].address; ++i) {
+      size_t len;
+      int srv = fio_sock_open(peer_tests[i].address,
+                              peer_tests[i].port,
+                              peer_tests[i].flag | FIO_SOCK_SERVER);
+      if (srv == -1 && peer_tests[i].address[0] == ':') {
+        fprintf(stderr, "\t- IPv6 unavailable, skipped\n");
+        continue;
+      }
+      FIO_ASSERT(srv != -1,
+                 "server socket failed to open: %s",
+                 strerror(errno));
+      int cl = fio_sock_open(peer_tests[i].address,
+                             peer_tests[i].port,
+                             peer_tests[i].flag | FIO_SOCK_CLIENT);
+      FIO_ASSERT(FIO_SOCK_FD_ISVALID(cl) &&
+                     (fio_sock_wait_io(srv, POLLIN, 200) & POLLIN),
+                 "client socket failed to connect (%s)",
+                 peer_tests[i].address);
+      int accepted = (int)accept(srv, NULL, NULL);
+      FIO_ASSERT(FIO_SOCK_FD_ISVALID(accepted), "accept failed");
+      FIO_MEMSET(buf, 'x', sizeof(buf));
+      len = fio_sock_peer_addr(buf, sizeof(buf), accepted);
+      FIO_ASSERT(len == strlen(peer_tests[i].peer) &&
+                     !memcmp(buf, peer_tests[i].peer, len + 1),
+                 "fio_sock_peer_addr error for %s: %s",
+                 peer_tests[i].address,
+                 buf);
+      FIO_ASSERT(!fio_sock_peer_addr(buf, 2, accepted) && !buf[0],
+                 "fio_sock_peer_addr should fail if `dest` is too short");
+      fio_sock_close(accepted);
+      fio_sock_close(cl);
+      fio_sock_close(srv);
+#ifdef AF_UNIX
+      if (FIO_SOCK_UNIX == peer_tests[i].flag)
+        unlink(peer_tests[i].address);
+#endif
+    }
+  }
   {
     /* UDP semi test */
     fprintf(stderr, "* Testing UDP socket (abbreviated test)\n");
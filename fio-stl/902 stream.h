@@ -214,6 +214,37 @@ FIO_SFUNC void FIO_NAME_TEST(stl, stream)(void) {
   FIO_ASSERT(!fio_stream_length(&s),
              "stream length should be zero at this point.");
   fio_stream_destroy(&s);
+  { /* shared file descriptors are released, not closed */
+    int fd = open(__FILE__, O_RDONLY);
+    FIO_ASSERT(fd != -1, "couldn't open test file");
+    fio_stream_add(&s,
+                   fio_stream_pack_fd2(fd,
+                                       20,
+                                       0,
+                                       FIO_NAME_TEST(stl, stream___noop_dealloc)));
+    fio_stream_add(&s,
+                   fio_stream_pack_fd2(fd,
+                                       20,
+                                       0,
+                                       FIO_NAME_TEST(stl, stream___noop_dealloc)));
+    buf = mem;
+    len = 4000;
+    fio_stream_read(&s, &buf, &len);
+    FIO_ASSERT(len == 40 && !memcmp(buf, buf + 20, 20) &&
+                   !memcmp("/* *****************", buf, 20),
+               "fio_stream_read shared file read error (%zu)",
+               len);
+    fio_stream_advance(&s, 20);
+    FIO_ASSERT(FIO_NAME_TEST(stl, stream___noop_dealloc_count) ==
+                   ++expect_dealloc,
+               "consumed shared file packets should be released.");
+    fio_stream_destroy(&s);
+    FIO_ASSERT(FIO_NAME_TEST(stl, stream___noop_dealloc_count) ==
+                   ++expect_dealloc,
+               "destroyed shared file packets should be released.");
+    FIO_ASSERT(fio_fd_size(fd) && !close(fd),
+               "shared file descriptors shouldn't be closed by the stream.");
+  }
 }
 
 /* *****************************************************************************
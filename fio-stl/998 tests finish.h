@@ -364,9 +364,19 @@ FIO_SFUNC void fio_test_dynamic_types(void) {
   FIO_NAME_TEST(stl, fiobj)();
   fprintf(stderr, "===============\n");
   FIO_NAME_TEST(stl, server)();
+  /* these run the server, before the pub/sub test cleans up its state */
+  FIO_NAME_TEST(stl, http_client)();
+  FIO_NAME_TEST(stl, http_deadlines)();
+  FIO_NAME_TEST(stl, http_server)();
   FIO_NAME_TEST(stl, pubsub)();
   fprintf(stderr, "===============\n");
   FIO_NAME_TEST(stl, http_s)();
+  FIO_NAME_TEST(stl, http_form)();
+  FIO_NAME_TEST(stl, http_cache)();
+  FIO_NAME_TEST(stl, http_static_cache)();
+  FIO_NAME_TEST(stl, http_log)();
+  FIO_NAME_TEST(stl, http_router)();
+  FIO_NAME_TEST(stl, http_websocket)();
   fprintf(stderr, "===============\n");
   FIO_NAME_TEST(stl, risky)();
   fprintf(stderr, "===============\n");
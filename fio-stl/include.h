@@ -164,6 +164,7 @@
 #include "902 fiobj.h"
 #include "902 glob matching.h"
 #include "902 http handle.h"
+#include "902 http.h"
 #include "902 imap.h"
 #include "902 math.h"
 #include "902 memalt.h"
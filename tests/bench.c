@@ -0,0 +1,625 @@
+/* *****************************************************************************
+Copyright: Boaz Segev, 2019-2020
+License: ISC / MIT (choose your license)
+
+Feel free to copy, use and enjoy according to the license provided.
+***************************************************************************** */
+
+/* *****************************************************************************
+An HTTP / WebSocket / SSE load generator, built on the facil.io reactor and the
+(pooled) HTTP client.
+
+Requests are sent in a closed loop (each response sends the next request), so
+`connections * pipeline` requests are always in flight. WebSocket clients send
+time stamped messages at a fixed rate, measuring the latency of every message
+they receive back from the server (i.e., the pub/sub fan-out of the echo chat
+in `examples/server.c`). SSE clients measure the same messages.
+
+The results (throughput and latency percentiles, in microseconds) are printed
+to `stdout` in JSON format. Latency is recorded using HDR style (log-linear)
+histograms, with a ~6% precision. Failed requests (and error responses) are
+counted as `errors` and aren't part of the latency histogram.
+
+Run against `examples/server.c` (over loopback) using:
+
+    make bench
+    make bench BENCH_ARGS="-c 64 -pl 4 -ws 16 -wsr 20 -sse 16"
+
+Or against any server:
+
+    tmp/bench http://127.0.0.1:3000/ -d 10 -c 32 -m "GET /=9,POST /echo=1"
+***************************************************************************** */
+#define FIO_CLI
+#define FIO_LOG
+#define FIO_HTTP
+#include "fio-stl/include.h"
+
+/* *****************************************************************************
+Latency Histogram (HDR style - log-linear buckets)
+***************************************************************************** */
+
+/* the number of sub-buckets per power of 2 (log2) */
+#define BENCH_HIST_SUB_BITS 4
+#define BENCH_HIST_SUB      (1ULL << BENCH_HIST_SUB_BITS)
+
+typedef struct {
+  uint64_t count[64 * BENCH_HIST_SUB];
+  uint64_t total;
+  uint64_t sum;
+  uint64_t min;
+  uint64_t max;
+} bench_hist_s;
+
+/** Returns the bucket for `v`, values below BENCH_HIST_SUB are exact. */
+FIO_SFUNC size_t bench_hist_index(uint64_t v) {
+  size_t msb;
+  if (v < BENCH_HIST_SUB)
+    return (size_t)v;
+  msb = fio_msb_index_unsafe(v);
+  return ((msb - BENCH_HIST_SUB_BITS + 1) << BENCH_HIST_SUB_BITS) +
+         (size_t)((v >> (msb - BENCH_HIST_SUB_BITS)) & (BENCH_HIST_SUB - 1));
+}
+
+/** Returns the highest value that shares the bucket at index `i`. */
+FIO_SFUNC uint64_t bench_hist_value(size_t i) {
+  const size_t group = i >> BENCH_HIST_SUB_BITS;
+  if (!group)
+    return (uint64_t)i;
+  return ((BENCH_HIST_SUB + (i & (BENCH_HIST_SUB - 1)) + 1) << (group - 1)) - 1;
+}
+
+FIO_SFUNC void bench_hist_add(bench_hist_s *h, int64_t value) {
+  const uint64_t v = (value > 0) ? (uint64_t)value : 0;
+  ++h->count[bench_hist_index(v)];
+  if (!h->total || v < h->min)
+    h->min = v;
+  if (v > h->max)
+    h->max = v;
+  ++h->total;
+  h->sum += v;
+}
+
+/** Returns the value at the `percentile` (0..100). */
+FIO_SFUNC uint64_t bench_hist_percentile(bench_hist_s *h, double percentile) {
+  uint64_t target = (uint64_t)((h->total * percentile) / 100.0);
+  uint64_t seen = 0;
+  if (!h->total)
+    return 0;
+  if (target < 1)
+    target = 1;
+  for (size_t i = 0; i < (64 * BENCH_HIST_SUB); ++i) {
+    seen += h->count[i];
+    if (seen >= target) {
+      const uint64_t v = bench_hist_value(i);
+      return (v > h->max) ? h->max : v;
+    }
+  }
+  return h->max;
+}
+
+FIO_SFUNC void bench_hist_print(bench_hist_s *h) {
+  fprintf(stdout,
+          "{\"count\":%llu,\"min\":%llu,\"mean\":%.1f,\"p50\":%llu,"
+          "\"p90\":%llu,\"p99\":%llu,\"p99_9\":%llu,\"max\":%llu}",
+          (unsigned long long)h->total,
+          (unsigned long long)h->min,
+          (h->total ? ((double)h->sum / h->total) : 0.0),
+          (unsigned long long)bench_hist_percentile(h, 50),
+          (unsigned long long)bench_hist_percentile(h, 90),
+          (unsigned long long)bench_hist_percentile(h, 99),
+          (unsigned long long)bench_hist_percentile(h, 99.9),
+          (unsigned long long)h->max);
+}
+
+/* *****************************************************************************
+Benchmark State (accessed only by the IO thread)
+***************************************************************************** */
+
+#define BENCH_MIX_MAX 16
+
+typedef struct {
+  fio_str_info_s method;
+  char *url; /* the full request URL (bstr) */
+  uint32_t weight;
+} bench_mix_s;
+
+typedef struct {
+  fio_s *io;
+  char *buf; /* unprocessed data (bstr) */
+  size_t sent;
+  uint8_t is_sse;
+  uint8_t upgraded;
+} bench_client_s;
+
+static struct {
+  fio_url_s url;
+  char *host; /* the `host` header value (bstr) */
+  char *path; /* the path for WebSocket / SSE connections (bstr) */
+  int64_t start;
+  int64_t end;
+  size_t duration;
+  size_t connections;
+  size_t pipeline;
+  fio_str_info_s body;
+  bench_mix_s mix[BENCH_MIX_MAX];
+  size_t mix_len;
+  uint32_t mix_weight;
+  uint8_t stopping;
+  struct {
+    size_t sent;
+    size_t responses;
+    size_t errors;
+    size_t bytes;
+    bench_hist_s latency;
+  } http;
+  struct {
+    bench_client_s *clients;
+    size_t count;
+    size_t rate; /* messages per second, per connection */
+    size_t open;
+    size_t failed;
+    size_t sent;
+    size_t received;
+    bench_hist_s latency;
+  } ws;
+  struct {
+    size_t count;
+    size_t open;
+    size_t failed;
+    size_t received;
+    bench_hist_s latency;
+  } sse;
+} bench;
+
+/* *****************************************************************************
+HTTP Requests (closed loop)
+***************************************************************************** */
+
+FIO_SFUNC void bench_http_on_response(fio_http_s *h);
+
+FIO_SFUNC void bench_http_send(void) {
+  bench_mix_s *m = bench.mix;
+  if (bench.mix_len > 1) {
+    uint32_t pick = (uint32_t)(fio_rand64() % bench.mix_weight);
+    while (pick >= m->weight) {
+      pick -= m->weight;
+      ++m;
+    }
+  }
+  ++bench.http.sent;
+  fio_http_request(m->url,
+                   .on_response = bench_http_on_response,
+                   .udata = (void *)(uintptr_t)fio_time_micro(),
+                   .method = m->method,
+                   .body = (m->method.len == 3 && m->method.buf[0] == 'G')
+                               ? FIO_STR_INFO2(NULL, 0)
+                               : bench.body,
+                   .max_connections = (uint16_t)bench.connections,
+                   .pipeline = (uint8_t)bench.pipeline);
+}
+
+FIO_SFUNC int bench_http_retry_task(void *ignr1_, void *ignr2_) {
+  if (!bench.stopping)
+    bench_http_send();
+  return -1;
+  (void)ignr1_, (void)ignr2_;
+}
+
+FIO_SFUNC void bench_http_on_response(fio_http_s *h) {
+  const int64_t now = fio_time_micro();
+  const size_t status = fio_http_status(h);
+  if (bench.stopping)
+    return; /* responses after the benchmark ended aren't counted */
+  if (!status || status >= 400) { /* errors aren't part of the latency */
+    ++bench.http.errors;
+  } else {
+    ++bench.http.responses;
+    bench.http.bytes += fio_http_body_length(h);
+    bench_hist_add(&bench.http.latency,
+                   now - (int64_t)(uintptr_t)fio_http_udata(h));
+  }
+  if (!status) { /* connection failed, an immediate retry would never yield */
+    fio_srv_run_every(.fn = bench_http_retry_task,
+                      .every = 10,
+                      .repetitions = 1);
+    return;
+  }
+  bench_http_send();
+}
+
+/** Parses the request mix, i.e., "GET /=9,POST /echo=1". */
+FIO_SFUNC void bench_mix_parse(const char *mix) {
+  size_t base_len = strlen(bench.url.scheme.buf); /* "http://host:port" */
+  if (bench.url.path.buf)
+    base_len = (size_t)(bench.url.path.buf - bench.url.scheme.buf);
+  while (mix && *mix && bench.mix_len < BENCH_MIX_MAX) {
+    const char *end = strchr(mix, ',');
+    const char *sp = strchr(mix, ' ');
+    const char *eq = strchr(mix, '=');
+    bench_mix_s *m = bench.mix + bench.mix_len;
+    if (!end)
+      end = mix + strlen(mix);
+    if (!sp || sp > end) {
+      FIO_LOG_ERROR("request mix entries are \"METHOD /path[=weight]\"");
+      exit(1);
+    }
+    if (!eq || eq > end)
+      eq = end;
+    m->method = FIO_STR_INFO2((char *)mix, (size_t)(sp - mix));
+    m->weight = (eq < end) ? (uint32_t)atol(eq + 1) : 1;
+    if (!m->weight)
+      m->weight = 1;
+    m->url = fio_bstr_write2(
+        NULL,
+        FIO_STRING_WRITE_STR2(bench.url.scheme.buf, base_len),
+        FIO_STRING_WRITE_STR2(sp + 1, (size_t)(eq - (sp + 1))));
+    bench.mix_weight += m->weight;
+    ++bench.mix_len;
+    mix = *end ? end + 1 : end;
+  }
+}
+
+/* *****************************************************************************
+WebSocket / SSE Clients
+***************************************************************************** */
+
+FIO_SFUNC void bench_client_on_attach(fio_s *io);
+FIO_SFUNC void bench_client_on_data(fio_s *io);
+FIO_SFUNC void bench_client_on_close(void *udata);
+FIO_SFUNC void bench_client_on_timeout(fio_s *io) { fio_touch(io); }
+
+static fio_protocol_s BENCH_CLIENT_PROTOCOL = {
+    .on_attach = bench_client_on_attach,
+    .on_data = bench_client_on_data,
+    .on_close = bench_client_on_close,
+    .on_timeout = bench_client_on_timeout,
+};
+
+/** Records the latency of a time stamped message ("bench:<microseconds>"). */
+FIO_SFUNC void bench_client_on_message(bench_client_s *c, fio_buf_info_s msg) {
+  char *pos = msg.buf + 6;
+  int64_t sent;
+  if (bench.stopping || msg.len < 7 || FIO_MEMCMP(msg.buf, "bench:", 6))
+    return;
+  sent = fio_atol(&pos);
+  if (c->is_sse) {
+    ++bench.sse.received;
+    bench_hist_add(&bench.sse.latency, fio_time_micro() - sent);
+  } else {
+    ++bench.ws.received;
+    bench_hist_add(&bench.ws.latency, fio_time_micro() - sent);
+  }
+}
+
+/** Writes a (masked) WebSocket frame. */
+FIO_SFUNC void bench_ws_write(bench_client_s *c,
+                              uint8_t opcode,
+                              fio_buf_info_s msg) {
+  char frame[256];
+  const uint64_t mask = fio_rand64();
+  if (msg.len > 125)
+    return;
+  frame[0] = (char)(0x80 | opcode);
+  frame[1] = (char)(0x80 | msg.len);
+  fio_u2buf32u(frame + 2, (uint32_t)mask);
+  for (size_t i = 0; i < msg.len; ++i)
+    frame[6 + i] = msg.buf[i] ^ frame[2 + (i & 3)];
+  fio_write2(c->io, .buf = frame, .len = 6 + msg.len, .copy = 1);
+}
+
+/** Consumes complete WebSocket frames, returning the number of bytes used. */
+FIO_SFUNC size_t bench_ws_consume(bench_client_s *c, char *buf, size_t len) {
+  size_t total = 0;
+  while (len - total >= 2) {
+    char *b = buf + total;
+    const uint8_t opcode = (uint8_t)b[0] & 15;
+    size_t head = 2 + (((uint8_t)b[1] & 128) ? 4 : 0);
+    uint64_t plen = (uint8_t)b[1] & 127;
+    if (plen == 126) {
+      if (len - total < 4)
+        break;
+      plen = fio_buf2u16_be(b + 2);
+      head += 2;
+    } else if (plen == 127) {
+      if (len - total < 10)
+        break;
+      plen = fio_buf2u64_be(b + 2);
+      head += 8;
+    }
+    if (len - total < head + plen)
+      break;
+    switch (opcode) {
+    case 0: /* fall through (the server doesn't fragment short messages) */
+    case 1: /* fall through */
+    case 2: bench_client_on_message(c, FIO_BUF_INFO2(b + head, plen)); break;
+    case 8: fio_close(c->io); break;
+    case 9: bench_ws_write(c, 10, FIO_BUF_INFO2(b + head, plen)); break;
+    }
+    total += head + plen;
+  }
+  return total;
+}
+
+/** Consumes complete SSE lines, returning the number of bytes used. */
+FIO_SFUNC size_t bench_sse_consume(bench_client_s *c, char *buf, size_t len) {
+  size_t total = 0;
+  char *eol;
+  while ((eol = (char *)FIO_MEMCHR(buf + total, '\n', len - total))) {
+    char *line = buf + total;
+    size_t line_len = (size_t)(eol - line);
+    if (line_len && line[line_len - 1] == '\r')
+      --line_len;
+    if (line_len > 5 && !FIO_MEMCMP(line, "data:", 5))
+      bench_client_on_message(c, FIO_BUF_INFO2(line + 5, line_len - 5));
+    total += (size_t)(eol - line) + 1;
+  }
+  return total;
+}
+
+/** Consumes the upgrade response, returning -1 if the upgrade failed. */
+FIO_SFUNC int bench_client_upgrade(bench_client_s *c) {
+  const char *expected = c->is_sse ? "HTTP/1.1 200" : "HTTP/1.1 101";
+  const size_t len = fio_bstr_len(c->buf);
+  for (size_t i = 3; i < len; ++i) {
+    if (c->buf[i] != '\n' || c->buf[i - 1] != '\r' || c->buf[i - 2] != '\n')
+      continue;
+    if (FIO_MEMCMP(c->buf, expected, 12))
+      return -1;
+    FIO_MEMMOVE(c->buf, c->buf + i + 1, len - (i + 1));
+    c->buf = fio_bstr_len_set(c->buf, len - (i + 1));
+    c->upgraded = 1;
+    if (c->is_sse)
+      ++bench.sse.open;
+    else
+      ++bench.ws.open;
+    return 0;
+  }
+  return 0;
+}
+
+FIO_SFUNC void bench_client_on_attach(fio_s *io) {
+  bench_client_s *c = (bench_client_s *)fio_udata_get(io);
+  char *req = fio_bstr_write2(
+      NULL,
+      FIO_STRING_WRITE_STR2("GET ", 4),
+      FIO_STRING_WRITE_STR2(bench.path, fio_bstr_len(bench.path)),
+      FIO_STRING_WRITE_STR2(" HTTP/1.1\r\nhost: ", 17),
+      FIO_STRING_WRITE_STR2(bench.host, fio_bstr_len(bench.host)),
+      FIO_STRING_WRITE_STR1(
+          (c->is_sse ? "\r\naccept: text/event-stream\r\n\r\n"
+                     : "\r\nupgrade: websocket\r\nconnection: upgrade\r\n"
+                       "sec-websocket-key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                       "sec-websocket-version: 13\r\n\r\n")));
+  c->io = io;
+  fio_write2(io,
+             .buf = req,
+             .len = fio_bstr_len(req),
+             .dealloc = (void (*)(void *))fio_bstr_free);
+}
+
+FIO_SFUNC void bench_client_on_data(fio_s *io) {
+  bench_client_s *c = (bench_client_s *)fio_udata_get(io);
+  char buf[8192];
+  size_t r, used;
+  while ((r = fio_read(io, buf, sizeof(buf))))
+    c->buf = fio_bstr_write(c->buf, buf, r);
+  if (!c->upgraded && (bench_client_upgrade(c) || !c->upgraded)) {
+    if (c->upgraded)
+      return;
+    if (fio_bstr_len(c->buf) >= 12 &&
+        FIO_MEMCMP(c->buf, (c->is_sse ? "HTTP/1.1 200" : "HTTP/1.1 101"), 12))
+      fio_close(io);
+    return;
+  }
+  used = c->is_sse ? bench_sse_consume(c, c->buf, fio_bstr_len(c->buf))
+                   : bench_ws_consume(c, c->buf, fio_bstr_len(c->buf));
+  if (!used)
+    return;
+  FIO_MEMMOVE(c->buf, c->buf + used, fio_bstr_len(c->buf) - used);
+  c->buf = fio_bstr_len_set(c->buf, fio_bstr_len(c->buf) - used);
+}
+
+FIO_SFUNC void bench_client_on_close(void *udata) {
+  bench_client_s *c = (bench_client_s *)udata;
+  if (!c->upgraded && !bench.stopping) {
+    if (c->is_sse)
+      ++bench.sse.failed;
+    else
+      ++bench.ws.failed;
+  }
+  c->io = NULL;
+  c->upgraded = 0;
+  fio_bstr_free(c->buf);
+  c->buf = NULL;
+}
+
+/** Sends WebSocket messages, keeping every connection at its message rate. */
+FIO_SFUNC int bench_ws_send_task(void *ignr1_, void *ignr2_) {
+  const int64_t now = fio_time_micro();
+  const size_t expected =
+      (size_t)(((now - bench.start) * (int64_t)bench.ws.rate) / 1000000);
+  if (bench.stopping)
+    return -1;
+  for (size_t i = 0; i < bench.ws.count; ++i) {
+    bench_client_s *c = bench.ws.clients + i;
+    if (!c->upgraded)
+      continue;
+    while (c->sent < expected) {
+      char msg[32];
+      fio_str_info_s s = FIO_STR_INFO3(msg, 0, 32);
+      fio_string_write2(&s,
+                        NULL,
+                        FIO_STRING_WRITE_STR2("bench:", 6),
+                        FIO_STRING_WRITE_NUM(fio_time_micro()));
+      bench_ws_write(c, 1, FIO_STR2BUF_INFO(s));
+      ++c->sent;
+      ++bench.ws.sent;
+    }
+  }
+  return 0;
+  (void)ignr1_, (void)ignr2_;
+}
+
+/* *****************************************************************************
+Benchmark Life Cycle
+***************************************************************************** */
+
+FIO_SFUNC int bench_stop_task(void *ignr1_, void *ignr2_) {
+  fio_srv_stop();
+  return -1;
+  (void)ignr1_, (void)ignr2_;
+}
+
+FIO_SFUNC int bench_end_task(void *ignr1_, void *ignr2_) {
+  bench.stopping = 1;
+  bench.end = fio_time_micro();
+  /* allow pending IO to complete before stopping the reactor */
+  fio_srv_run_every(.fn = bench_stop_task, .every = 250, .repetitions = 1);
+  return -1;
+  (void)ignr1_, (void)ignr2_;
+}
+
+FIO_SFUNC void bench_on_start(void *ignr_) {
+  bench.start = fio_time_micro();
+  for (size_t i = 0; i < bench.ws.count + bench.sse.count; ++i) {
+    bench_client_s *c = bench.ws.clients + i;
+    c->is_sse = (i >= bench.ws.count);
+    if (fio_srv_connect(fio_cli_unnamed(0), &BENCH_CLIENT_PROTOCOL, c, NULL)) {
+      if (c->is_sse)
+        ++bench.sse.failed;
+      else
+        ++bench.ws.failed;
+    }
+  }
+  if (bench.mix_len) {
+    for (size_t i = 0; i < bench.connections * bench.pipeline; ++i)
+      bench_http_send();
+  }
+  if (bench.ws.count && bench.ws.rate)
+    fio_srv_run_every(.fn = bench_ws_send_task, .every = 5, .repetitions = -1);
+  fio_srv_run_every(.fn = bench_end_task,
+                    .every = (uint32_t)(bench.duration * 1000),
+                    .repetitions = 1);
+  (void)ignr_;
+}
+
+FIO_SFUNC void bench_report(void) {
+  const double seconds = (double)(bench.end - bench.start) / 1000000.0;
+  fprintf(stdout,
+          "{\n\"url\":\"%s\",\n\"duration\":%.3f,\n"
+          "\"http\":{\"connections\":%zu,\"pipeline\":%zu,\"requests\":%zu,"
+          "\"errors\":%zu,\"requests_per_sec\":%.1f,"
+          "\"bytes_per_sec\":%.1f,\"latency_us\":",
+          fio_cli_unnamed(0),
+          seconds,
+          (bench.mix_len ? bench.connections : 0),
+          bench.pipeline,
+          bench.http.responses,
+          bench.http.errors,
+          (seconds > 0 ? bench.http.responses / seconds : 0.0),
+          (seconds > 0 ? bench.http.bytes / seconds : 0.0));
+  bench_hist_print(&bench.http.latency);
+  fprintf(stdout,
+          "},\n\"websocket\":{\"connections\":%zu,\"failed\":%zu,"
+          "\"rate\":%zu,\"sent\":%zu,\"received\":%zu,"
+          "\"messages_per_sec\":%.1f,\"latency_us\":",
+          bench.ws.open,
+          bench.ws.failed,
+          bench.ws.rate,
+          bench.ws.sent,
+          bench.ws.received,
+          (seconds > 0 ? bench.ws.received / seconds : 0.0));
+  bench_hist_print(&bench.ws.latency);
+  fprintf(stdout,
+          "},\n\"sse\":{\"connections\":%zu,\"failed\":%zu,\"received\":%zu,"
+          "\"messages_per_sec\":%.1f,\"latency_us\":",
+          bench.sse.open,
+          bench.sse.failed,
+          bench.sse.received,
+          (seconds > 0 ? bench.sse.received / seconds : 0.0));
+  bench_hist_print(&bench.sse.latency);
+  fprintf(stdout, "}\n}\n");
+}
+
+int main(int argc, char const *argv[]) {
+  fio_cli_start(
+      argc,
+      argv,
+      0,
+      1,
+      "HTTP / WebSocket / SSE load generator, reports results in JSON.\n"
+      "\tNAME [url] [options]\n\n"
+      "The url defaults to http://127.0.0.1:3000/",
+      FIO_CLI_INT("--duration -d (5) benchmark duration in seconds."),
+      FIO_CLI_PRINT_HEADER("HTTP"),
+      FIO_CLI_INT("--connections -c (16) concurrent HTTP connections."),
+      FIO_CLI_INT("--pipeline -pl (1) pipelined requests per connection."),
+      FIO_CLI_STRING("--mix -m (GET /) the request mix, i.e.: "
+                     "\"GET /=9,POST /echo=1\" (0 == no HTTP requests)."),
+      FIO_CLI_INT("--body -bs (0) request body length (non-GET requests)."),
+      FIO_CLI_PRINT_HEADER("WebSocket / SSE"),
+      FIO_CLI_INT("--websockets -ws (0) WebSocket connections."),
+      FIO_CLI_INT("--ws-rate -wsr (10) messages per second per WebSocket."),
+      FIO_CLI_INT("--sse -sse (0) SSE (EventSource) subscribers."),
+      FIO_CLI_PRINT_HEADER("Misc"),
+      FIO_CLI_BOOL("--verbose -V -v print out debugging messages."));
+  if (fio_cli_get_bool("-V"))
+    FIO_LOG_LEVEL = FIO_LOG_LEVEL_DEBUG;
+  if (!fio_cli_unnamed(0))
+    fio_cli_set_unnamed(0, "http://127.0.0.1:3000/");
+
+  bench.url = fio_url_parse(fio_cli_unnamed(0), strlen(fio_cli_unnamed(0)));
+  FIO_ASSERT(bench.url.host.len && bench.url.scheme.len,
+             "URL should be in the form http://host:port/path");
+  bench.host = fio_bstr_write(NULL, bench.url.host.buf, bench.url.host.len);
+  if (bench.url.port.len)
+    bench.host = fio_bstr_write2(
+        bench.host,
+        FIO_STRING_WRITE_STR2(":", 1),
+        FIO_STRING_WRITE_STR2(bench.url.port.buf, bench.url.port.len));
+  if (bench.url.path.len)
+    bench.path = fio_bstr_write(NULL, bench.url.path.buf, bench.url.path.len);
+  else
+    bench.path = fio_bstr_write(NULL, "/", 1);
+  bench.duration = (size_t)fio_cli_get_i("-d");
+  bench.connections = (size_t)fio_cli_get_i("-c");
+  bench.pipeline = (size_t)fio_cli_get_i("-pl");
+  bench.ws.count = (size_t)fio_cli_get_i("-ws");
+  bench.ws.rate = (size_t)fio_cli_get_i("-wsr");
+  bench.sse.count = (size_t)fio_cli_get_i("-sse");
+  if (!bench.duration)
+    bench.duration = 1;
+  if (!bench.connections || bench.connections > 0xFFFF)
+    bench.connections = 16;
+  if (!bench.pipeline || bench.pipeline > 255)
+    bench.pipeline = 1;
+  if (fio_cli_get_i("-bs") > 0) {
+    bench.body.len = (size_t)fio_cli_get_i("-bs");
+    bench.body.buf = (char *)malloc(bench.body.len);
+    FIO_ASSERT_ALLOC(bench.body.buf);
+    FIO_MEMSET(bench.body.buf, 'x', bench.body.len);
+  }
+  if (strcmp(fio_cli_get("-m"), "0"))
+    bench_mix_parse(fio_cli_get("-m"));
+  if (bench.ws.count + bench.sse.count) {
+    bench.ws.clients =
+        (bench_client_s *)calloc(bench.ws.count + bench.sse.count,
+                                 sizeof(*bench.ws.clients));
+    FIO_ASSERT_ALLOC(bench.ws.clients);
+  }
+
+  fio_state_callback_add(FIO_CALL_ON_START, bench_on_start, NULL);
+  fio_srv_start(0);
+  if (!bench.end)
+    bench.end = fio_time_micro();
+  bench_report();
+
+  for (size_t i = 0; i < bench.mix_len; ++i)
+    fio_bstr_free(bench.mix[i].url);
+  fio_bstr_free(bench.host);
+  fio_bstr_free(bench.path);
+  free(bench.body.buf);
+  free(bench.ws.clients);
+  fio_cli_end();
+  return 0;
+}
@@ -0,0 +1,47 @@
+/* *****************************************************************************
+fio_xmask speed, by WebSocket frame size, compared to a 64 bit word loop.
+
+Run using: make tests/xmask
+***************************************************************************** */
+#define FIO_TEST_ALL
+#include "fio-stl.h"
+
+/* fio_xmask, as called by the WebSocket parser */
+FIO_SFUNC uintptr_t xmask_wrapper(char *buf, size_t len) {
+  fio_xmask(buf, len, fio_rand64());
+  return len;
+}
+
+/* the 64 bit word (non-SIMD) masking loop, for comparison */
+FIO_SFUNC uintptr_t xmask_word_wrapper(char *buf, size_t len) {
+  const uint64_t mask = fio_rand64();
+  for (size_t i = 7; i < len; i += 8) {
+    fio_u2buf64u(buf, (fio_buf2u64u(buf) ^ mask));
+    buf += 8;
+  }
+  if (len & 7) {
+    uint64_t tmp;
+    fio_memcpy7x(&tmp, buf, len);
+    tmp ^= mask;
+    fio_memcpy7x(buf, &tmp, len);
+  }
+  return len;
+}
+
+int main(int argc, char const *argv[]) {
+  for (uint8_t size_log = 6; size_log < 21; size_log += 2) {
+    fio_test_hash_function(xmask_wrapper,
+                           (char *)"fio_xmask",
+                           size_log,
+                           0,
+                           2);
+    fio_test_hash_function(xmask_word_wrapper,
+                           (char *)"xmask (64 bit words)",
+                           size_log,
+                           0,
+                           2);
+  }
+  (void)argc;
+  (void)argv;
+  return 0;
+}